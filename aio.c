@@ -0,0 +1,383 @@
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aio.h"
+#include "conf.h"
+#include "ext.h"
+#include "io.h"
+#include "tle.h"
+
+static_assert(BMM_MFRAME >= 2, "Too few frames");
+
+/// The call `bmm_aio_flush(aio, frame)`
+/// writes the frame `frame` into the destination of `aio`
+/// and returns zero or the standard error number of the failure.
+__attribute__ ((__nonnull__))
+static int bmm_aio_flush(struct bmm_aio const *const aio,
+    struct bmm_aio_frame const *const frame) {
+  if (frame->n != 0 && fwrite(frame->buf, frame->n, 1, aio->stream) != 1)
+    return errno != 0 ? errno : EIO;
+
+  if (fflush(aio->stream) == EOF)
+    return errno != 0 ? errno : EIO;
+
+  return 0;
+}
+
+__attribute__ ((__nonnull__))
+static void *bmm_aio_run(void *const ptr) {
+  struct bmm_aio *const aio = ptr;
+
+  (void) pthread_mutex_lock(&aio->mutex);
+
+  for ever {
+    while (aio->nfull == 0 && aio->prio.n == 0 && !aio->sync && !aio->quit)
+      (void) pthread_cond_wait(&aio->cfull, &aio->mutex);
+
+    // High-priority messages overtake every pending frame,
+    // although not the one already being written.
+    if (aio->prio.n != 0) {
+      struct bmm_aio_frame const frame = aio->pout;
+      aio->pout = aio->prio;
+      aio->prio = frame;
+      aio->prio.n = 0;
+
+      (void) pthread_mutex_unlock(&aio->mutex);
+
+      int const nerr = aio->nerr != 0 ? aio->nerr :
+        bmm_aio_flush(aio, &aio->pout);
+
+      (void) pthread_mutex_lock(&aio->mutex);
+
+      aio->nerr = nerr;
+
+      (void) pthread_cond_signal(&aio->cempty);
+
+      continue;
+    }
+
+    if (aio->nfull == 0) {
+      if (!aio->sync)
+        break;
+
+      aio->sync = false;
+
+      (void) pthread_mutex_unlock(&aio->mutex);
+
+      int const nerr = aio->nerr != 0 ? aio->nerr :
+        bmm_io_sync(aio->stream) ? 0 : errno != 0 ? errno : EIO;
+
+      (void) pthread_mutex_lock(&aio->mutex);
+
+      aio->nerr = nerr;
+
+      continue;
+    }
+
+    struct bmm_aio_frame const *const frame = &aio->frame[aio->ifirst];
+
+    (void) pthread_mutex_unlock(&aio->mutex);
+
+    // Once something fails, the rest is just thrown away,
+    // because the stream would have a hole in it.
+    int const nerr = aio->nerr != 0 ? aio->nerr : bmm_aio_flush(aio, frame);
+
+    (void) pthread_mutex_lock(&aio->mutex);
+
+    aio->nerr = nerr;
+    aio->ifirst = (aio->ifirst + 1) % BMM_MFRAME;
+    --aio->nfull;
+
+    (void) pthread_cond_signal(&aio->cempty);
+  }
+
+  (void) pthread_mutex_unlock(&aio->mutex);
+
+  return NULL;
+}
+
+bool bmm_aio_start(struct bmm_aio *const aio,
+    FILE *const stream, enum bmm_aio_lag const lag) {
+  aio->stream = stream;
+  aio->lag = lag;
+  aio->ifirst = 0;
+  aio->nfull = 0;
+  aio->icur = 0;
+  aio->quit = false;
+  aio->sync = false;
+  aio->nerr = 0;
+
+  for (size_t iframe = 0; iframe < BMM_MFRAME; ++iframe) {
+    aio->frame[iframe].n = 0;
+    aio->frame[iframe].ncap = 0;
+    aio->frame[iframe].buf = NULL;
+  }
+
+  struct bmm_aio_frame *const prios[] = {&aio->pcur, &aio->prio, &aio->pout};
+  for (size_t iprio = 0; iprio < nmembof(prios); ++iprio) {
+    prios[iprio]->n = 0;
+    prios[iprio]->ncap = 0;
+    prios[iprio]->buf = NULL;
+  }
+
+  int nerr;
+
+  nerr = pthread_mutex_init(&aio->mutex, NULL);
+  if (nerr != 0) {
+    errno = nerr;
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  nerr = pthread_cond_init(&aio->cfull, NULL);
+  if (nerr != 0) {
+    errno = nerr;
+    BMM_TLE_STDS();
+
+    (void) pthread_mutex_destroy(&aio->mutex);
+
+    return false;
+  }
+
+  nerr = pthread_cond_init(&aio->cempty, NULL);
+  if (nerr != 0) {
+    errno = nerr;
+    BMM_TLE_STDS();
+
+    (void) pthread_cond_destroy(&aio->cfull);
+    (void) pthread_mutex_destroy(&aio->mutex);
+
+    return false;
+  }
+
+  // Signals are left for the calling thread to handle,
+  // so the writer thread starts with all of them blocked.
+  sigset_t set;
+  (void) sigfillset(&set);
+
+  sigset_t oldset;
+  (void) pthread_sigmask(SIG_SETMASK, &set, &oldset);
+
+  nerr = pthread_create(&aio->thread, NULL, bmm_aio_run, aio);
+
+  (void) pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+  if (nerr != 0) {
+    errno = nerr;
+    BMM_TLE_STDS();
+
+    (void) pthread_cond_destroy(&aio->cempty);
+    (void) pthread_cond_destroy(&aio->cfull);
+    (void) pthread_mutex_destroy(&aio->mutex);
+
+    return false;
+  }
+
+  return true;
+}
+
+bool bmm_aio_stop(struct bmm_aio *const aio) {
+  (void) pthread_mutex_lock(&aio->mutex);
+
+  aio->quit = true;
+  (void) pthread_cond_signal(&aio->cfull);
+
+  (void) pthread_mutex_unlock(&aio->mutex);
+
+  (void) pthread_join(aio->thread, NULL);
+
+  (void) pthread_cond_destroy(&aio->cempty);
+  (void) pthread_cond_destroy(&aio->cfull);
+  (void) pthread_mutex_destroy(&aio->mutex);
+
+  for (size_t iframe = 0; iframe < BMM_MFRAME; ++iframe)
+    free(aio->frame[iframe].buf);
+
+  free(aio->pout.buf);
+  free(aio->prio.buf);
+  free(aio->pcur.buf);
+
+  if (aio->nerr != 0) {
+    errno = aio->nerr;
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return true;
+}
+
+enum bmm_aio_begin bmm_aio_begin(struct bmm_aio *const aio) {
+  enum bmm_aio_begin result = BMM_AIO_BEGIN_READY;
+
+  (void) pthread_mutex_lock(&aio->mutex);
+
+  if (aio->nfull == BMM_MFRAME)
+    switch (aio->lag) {
+      case BMM_AIO_LAG_BLOCK:
+        while (aio->nfull == BMM_MFRAME && aio->nerr == 0)
+          (void) pthread_cond_wait(&aio->cempty, &aio->mutex);
+
+        break;
+      case BMM_AIO_LAG_DROP:
+        result = BMM_AIO_BEGIN_SKIP;
+
+        break;
+      case BMM_AIO_LAG_COALESCE:
+        // There are at least two pending frames,
+        // so the newest one is not being written.
+        --aio->nfull;
+        result = BMM_AIO_BEGIN_LOST;
+
+        break;
+    }
+
+  int const nerr = aio->nerr;
+
+  if (nerr == 0 && result != BMM_AIO_BEGIN_SKIP) {
+    aio->icur = (aio->ifirst + aio->nfull) % BMM_MFRAME;
+    aio->frame[aio->icur].n = 0;
+  }
+
+  (void) pthread_mutex_unlock(&aio->mutex);
+
+  if (nerr != 0) {
+    errno = nerr;
+    BMM_TLE_STDS();
+
+    return BMM_AIO_BEGIN_ERROR;
+  }
+
+  return result;
+}
+
+/// The call `bmm_aio_grow(frame, buf, n)`
+/// appends `n` bytes from `buf` to `frame`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_aio_grow(struct bmm_aio_frame *const frame,
+    void const *const buf, size_t const n) {
+  if (n > frame->ncap - frame->n) {
+    if (n > SIZE_MAX - frame->n) {
+      errno = ENOMEM;
+      BMM_TLE_STDS();
+
+      return false;
+    }
+
+    size_t const nnew = frame->n + n;
+    size_t const ncap = frame->ncap > SIZE_MAX / 2 ? SIZE_MAX :
+      frame->ncap * 2 < nnew ? nnew : frame->ncap * 2;
+
+    unsigned char *const ptr = realloc(frame->buf, ncap);
+    if (ptr == NULL) {
+      BMM_TLE_STDS();
+
+      return false;
+    }
+
+    frame->buf = ptr;
+    frame->ncap = ncap;
+  }
+
+  (void) memcpy(&frame->buf[frame->n], buf, n);
+  frame->n += n;
+
+  return true;
+}
+
+bool bmm_aio_write(struct bmm_aio *const aio,
+    void const *const buf, size_t const n) {
+  // The current frame belongs to the calling thread,
+  // because the writer thread never looks past the pending ones.
+  return bmm_aio_grow(&aio->frame[aio->icur], buf, n);
+}
+
+bool bmm_aio_end(struct bmm_aio *const aio) {
+  (void) pthread_mutex_lock(&aio->mutex);
+
+  ++aio->nfull;
+  (void) pthread_cond_signal(&aio->cfull);
+
+  (void) pthread_mutex_unlock(&aio->mutex);
+
+  return true;
+}
+
+bool bmm_aio_sync(struct bmm_aio *const aio) {
+  (void) pthread_mutex_lock(&aio->mutex);
+
+  aio->sync = true;
+  (void) pthread_cond_signal(&aio->cfull);
+
+  int const nerr = aio->nerr;
+
+  (void) pthread_mutex_unlock(&aio->mutex);
+
+  if (nerr != 0) {
+    errno = nerr;
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return true;
+}
+
+bool bmm_aio_prio_write(struct bmm_aio *const aio,
+    void const *const buf, size_t const n) {
+  return bmm_aio_grow(&aio->pcur, buf, n);
+}
+
+bool bmm_aio_prio_end(struct bmm_aio *const aio) {
+  bool result = true;
+
+  (void) pthread_mutex_lock(&aio->mutex);
+
+  // Something always fits when nothing is waiting,
+  // so that oversized batches do not wait forever.
+  bool keep = true;
+  if (aio->prio.n != 0 && aio->pcur.n > BMM_MPRIO - aio->prio.n)
+    switch (aio->lag) {
+      case BMM_AIO_LAG_BLOCK:
+        while (aio->prio.n != 0 && aio->nerr == 0)
+          (void) pthread_cond_wait(&aio->cempty, &aio->mutex);
+
+        break;
+      case BMM_AIO_LAG_DROP:
+      case BMM_AIO_LAG_COALESCE:
+        keep = false;
+
+        break;
+    }
+
+  int const nerr = aio->nerr;
+
+  if (nerr == 0 && keep && aio->pcur.n != 0) {
+    result = bmm_aio_grow(&aio->prio, aio->pcur.buf, aio->pcur.n);
+
+    (void) pthread_cond_signal(&aio->cfull);
+  }
+
+  (void) pthread_mutex_unlock(&aio->mutex);
+
+  aio->pcur.n = 0;
+
+  if (nerr != 0) {
+    errno = nerr;
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return result;
+}
@@ -0,0 +1,152 @@
+/// Asynchronous output.
+///
+/// High-priority messages go through a lane of their own,
+/// which the writer thread empties before it starts on any pending frame,
+/// so that they never wait behind bulk data.
+
+#ifndef BMM_AIO_H
+#define BMM_AIO_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "conf.h"
+
+/// Policies for when the consumer falls behind.
+enum bmm_aio_lag {
+  /// Wait for the consumer to catch up.
+  BMM_AIO_LAG_BLOCK,
+  /// Drop the new frame.
+  BMM_AIO_LAG_DROP,
+  /// Replace the newest pending frame with the new frame.
+  BMM_AIO_LAG_COALESCE
+};
+
+/// Outcomes of beginning a frame.
+enum bmm_aio_begin {
+  /// Something went wrong.
+  BMM_AIO_BEGIN_ERROR,
+  /// The frame may be written.
+  BMM_AIO_BEGIN_READY,
+  /// The frame may be written, but the pending frame before it was lost.
+  BMM_AIO_BEGIN_LOST,
+  /// The frame must not be written.
+  BMM_AIO_BEGIN_SKIP
+};
+
+/// Frames in flight.
+struct bmm_aio_frame {
+  /// Number of bytes.
+  size_t n;
+  /// Number of bytes there is room for.
+  size_t ncap;
+  /// Bytes.
+  unsigned char *buf;
+};
+
+/// Writer state.
+struct bmm_aio {
+  /// Destination.
+  FILE *stream;
+  /// Policy for when the consumer falls behind.
+  enum bmm_aio_lag lag;
+  /// Writer thread.
+  pthread_t thread;
+  /// Lock for everything below.
+  pthread_mutex_t mutex;
+  /// Signal for the writer that there is something to write.
+  pthread_cond_t cfull;
+  /// Signal for the producer that there is room for more.
+  pthread_cond_t cempty;
+  /// Ring of frames.
+  struct bmm_aio_frame frame[BMM_MFRAME];
+  /// Index of the oldest pending frame.
+  size_t ifirst;
+  /// Number of pending frames, including the one being written.
+  size_t nfull;
+  /// Index of the frame being filled by the producer.
+  size_t icur;
+  /// High-priority messages being put together by the producer,
+  /// which it owns.
+  struct bmm_aio_frame pcur;
+  /// High-priority messages waiting to go ahead of the pending frames.
+  struct bmm_aio_frame prio;
+  /// High-priority messages being written,
+  /// which the writer thread owns.
+  struct bmm_aio_frame pout;
+  /// Whether the writer should stop once it runs out of frames.
+  bool quit;
+  /// Whether the writer should synchronize the destination
+  /// with its storage device once it runs out of frames.
+  bool sync;
+  /// Standard error number of the first failed write or zero.
+  int nerr;
+};
+
+/// The call `bmm_aio_start(aio, stream, lag)`
+/// starts a writer thread that writes frames into `stream`,
+/// following the policy `lag` when it falls behind.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_aio_start(struct bmm_aio *, FILE *, enum bmm_aio_lag);
+
+/// The call `bmm_aio_stop(aio)`
+/// waits for the writer thread to write out every pending frame and
+/// stops it.
+/// If every frame was written successfully, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_aio_stop(struct bmm_aio *);
+
+/// The call `bmm_aio_begin(aio)`
+/// makes room for a new frame if the policy allows it.
+/// The frame must be finished with `bmm_aio_end`
+/// unless `BMM_AIO_BEGIN_SKIP` or `BMM_AIO_BEGIN_ERROR` is returned.
+__attribute__ ((__nonnull__))
+enum bmm_aio_begin bmm_aio_begin(struct bmm_aio *);
+
+/// The call `bmm_aio_write(aio, buf, n)`
+/// appends `n` bytes from `buf` to the current frame.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_aio_write(struct bmm_aio *, void const *, size_t);
+
+/// The call `bmm_aio_end(aio)`
+/// hands the current frame over to the writer thread.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_aio_end(struct bmm_aio *);
+
+/// The call `bmm_aio_sync(aio)`
+/// asks the writer thread to synchronize its destination
+/// with the storage device as soon as it has written every frame
+/// handed over so far, without waiting for it to do so.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_aio_sync(struct bmm_aio *);
+
+/// The call `bmm_aio_prio_write(aio, buf, n)`
+/// appends `n` bytes from `buf` to the current high-priority messages,
+/// which may be written whether or not a frame is in progress.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_aio_prio_write(struct bmm_aio *, void const *, size_t);
+
+/// The call `bmm_aio_prio_end(aio)`
+/// hands the current high-priority messages over to the writer thread,
+/// which writes them before any pending frame.
+/// If more than `BMM_MPRIO` bytes of them are already waiting,
+/// the policy decides whether to wait or to drop the new ones.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_aio_prio_end(struct bmm_aio *);
+
+#endif
@@ -0,0 +1,790 @@
+#include <gsl/gsl_rng.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dem.h"
+#include "ext.h"
+#include "geom.h"
+#include "io.h"
+#include "ival.h"
+#include "kde.h"
+#include "kernel.h"
+#include "msg.h"
+#include "opt.h"
+#include "sec.h"
+#include "str.h"
+#include "tle.h"
+
+/// Synthetic packings.
+enum bmm_bench_pack {
+  /// Hexagonal packing made by `BMM_DEM_MODE_CREATE_HEX`.
+  BMM_BENCH_PACK_HEX,
+  /// Uniformly scattered gas.
+  BMM_BENCH_PACK_GAS
+};
+
+/// Benchmark options.
+struct bmm_bench_opts {
+  /// Smallest number of particles.
+  size_t nmin;
+  /// Largest number of particles.
+  size_t nmax;
+  /// Number of repetitions for each measurement.
+  size_t nrep;
+  /// Number of threads to evaluate forces and build caches with.
+  size_t nthread;
+  /// Whether to measure scaling instead of hot paths.
+  bool scale;
+  /// Number of steps for each scaling measurement.
+  size_t nstep;
+};
+
+/// Benchmark state.
+struct bmm_bench {
+  struct bmm_bench_opts opts;
+  /// Packing being measured.
+  enum bmm_bench_pack pack;
+  /// Simulation being measured.
+  struct bmm_dem dem;
+};
+
+/// The call `bmm_bench_name(pack)`
+/// returns the name of the packing `pack`.
+__attribute__ ((__const__, __returns_nonnull__))
+static char const *bmm_bench_name(enum bmm_bench_pack const pack) {
+  switch (pack) {
+    case BMM_BENCH_PACK_HEX:
+      return "hex";
+    case BMM_BENCH_PACK_GAS:
+      return "gas";
+  }
+
+  dynamic_assert(false, "Unsupported packing");
+}
+
+/// The call `bmm_bench_put(bench, str, t, tmin, nrep)`
+/// prints one line of results for the case `str`
+/// that took `t` seconds over `nrep` repetitions,
+/// the fastest of which took `tmin` seconds.
+__attribute__ ((__nonnull__))
+static bool bmm_bench_put(struct bmm_bench const *const bench,
+    char const *const str, double const t, double const tmin,
+    size_t const nrep) {
+  if (printf("%s\t%zu\t%zu\t%s\t%zu\t%.9e\t%.9e\n",
+        bmm_bench_name(bench->pack), bench->dem.part.n, bench->opts.nthread,
+        str, nrep, t / (double) nrep, tmin) < 0) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return true;
+}
+
+/// The call `bmm_bench_setup(bench, npart, integ)`
+/// fills the simulation of `bench` with about `npart` particles
+/// arranged according to its packing and
+/// integrated with the scheme `integ`,
+/// so that it ends up in an idle stage with fresh caches and
+/// both weak and strong contacts.
+__attribute__ ((__nonnull__))
+static bool bmm_bench_setup(struct bmm_bench *const bench,
+    size_t const npart, enum bmm_dem_integ const integ) {
+  double const ravg = 1.0e-3;
+  double const rnew[] = {
+    2.0 * ravg / (1.0 + sqrt(2.0)),
+    4.0 * ravg / (2.0 + sqrt(2.0))
+  };
+  double const eta = bench->pack == BMM_BENCH_PACK_HEX ?
+    bmm_geom_ballmpd(BMM_NDIM) : 1.0 / 8.0;
+
+  struct bmm_dem_opts opts;
+  bmm_dem_opts_def(&opts);
+
+  opts.box.x[0] = sqrt((double) npart * bmm_geom_ballvol(ravg, BMM_NDIM) /
+      eta);
+  opts.box.x[1] = opts.box.x[0];
+  opts.box.per[0] = true;
+  opts.box.per[1] = false;
+
+  opts.part.rho = 2.7e+3;
+  opts.time.integ = integ;
+  opts.thread.n = bench->opts.nthread;
+  opts.trap.enabled = false;
+
+  bmm_dem_opts_set_rnew(&opts, rnew);
+
+  // Large boxes would need more neighbor cells than there is room for,
+  // but fewer and larger cells are still correct.
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    opts.cache.ncell[idim] = $(bmm_min, size_t)(opts.cache.ncell[idim],
+        BMM_MCELL);
+
+  size_t istage;
+
+  if (bench->pack == BMM_BENCH_PACK_HEX) {
+    istage = bmm_dem_script_addstage(&opts);
+    opts.script.mode[istage] = BMM_DEM_MODE_CREATE_HEX;
+    opts.script.params[istage].create.eta = eta;
+  }
+
+  istage = bmm_dem_script_addstage(&opts);
+  opts.script.mode[istage] = BMM_DEM_MODE_PRESET0;
+  opts.script.params[istage].preset.eta = 1.0e+1;
+  opts.script.params[istage].preset.kn = 1.0e+7;
+  opts.script.params[istage].preset.gamman = 1.0e+1;
+
+  istage = bmm_dem_script_addstage(&opts);
+  opts.script.mode[istage] = BMM_DEM_MODE_LINK;
+
+  istage = bmm_dem_script_addstage(&opts);
+  opts.script.mode[istage] = BMM_DEM_MODE_IDLE;
+  opts.script.tspan[istage] = INFINITY;
+  opts.script.dt[istage] = 1.0e-9;
+
+  struct bmm_dem *const dem = &bench->dem;
+
+  if (!bmm_dem_def(dem, &opts))
+    return false;
+
+  // The same seed makes every run measure the same packing.
+  dem->seed = gsl_rng_default_seed;
+
+  double const unit[] = {0.0, 1.0};
+
+  if (bench->pack == BMM_BENCH_PACK_GAS)
+    for (size_t ipart = 0; ipart < npart; ++ipart) {
+      size_t const jpart = bmm_dem_addpart(dem);
+      if (jpart == SIZE_MAX)
+        return false;
+
+      size_t const l = dem->part.l[jpart];
+
+      double const r = ravg *
+        (0.5 + bmm_dem_random(dem, BMM_DEM_STREAM_RADIUS, l, 0, unit));
+
+      dem->part.r[jpart] = r;
+      dem->part.m[jpart] = dem->opts.part.rho * bmm_geom_ballvol(r, 3);
+
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+        dem->part.x[jpart][idim] =
+          bmm_dem_random(dem, BMM_DEM_STREAM_POS, l, idim, unit) *
+          dem->opts.box.x[idim];
+    }
+
+  while (dem->script.i < istage) {
+    if (!bmm_dem_step(dem))
+      return false;
+
+    if (!bmm_dem_script_trans(dem))
+      return false;
+  }
+
+  // One step in the idle stage sets the time step and
+  // fills in the history of the integration scheme.
+  return bmm_dem_step(dem) && bmm_dem_cache_build(dem);
+}
+
+/// The call `bmm_bench_free(bench)`
+/// releases the simulation of `bench`.
+__attribute__ ((__nonnull__))
+static void bmm_bench_free(struct bmm_bench *const bench) {
+  bmm_dem_free(&bench->dem);
+}
+
+/// The call `bmm_bench_startup(bench, npart)`
+/// initializes and releases a fresh simulation
+/// with room for `npart` particles,
+/// which every run pays for before its first step.
+__attribute__ ((__nonnull__))
+static bool bmm_bench_startup(struct bmm_bench const *const bench,
+    size_t const npart) {
+  struct bmm_dem_opts opts;
+  bmm_dem_opts_def(&opts);
+
+  opts.part.ncap = npart;
+  opts.thread.n = bench->opts.nthread;
+
+  struct bmm_dem *const dem = malloc(sizeof *dem);
+  if (dem == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  bool const result = bmm_dem_def(dem, &opts);
+
+  bmm_dem_free(dem);
+  free(dem);
+
+  return result;
+}
+
+/// Time `expr` for the case `str` of `bench`.
+/// Every repetition is timed separately,
+/// so that the fastest one can be told apart from the mean.
+#define BMM_BENCH_TIME(bench, str, expr) \
+  begin \
+    double t = 0.0; \
+    double tmin = INFINITY; \
+    \
+    for (size_t irep = 0; irep < (bench)->opts.nrep; ++irep) { \
+      double const t0 = bmm_sec_now(); \
+      \
+      if (!(expr)) \
+        return false; \
+      \
+      double const dt = bmm_sec_now() - t0; \
+      \
+      t += dt; \
+      tmin = fmin(tmin, dt); \
+    } \
+    \
+    if (!bmm_bench_put((bench), (str), t, tmin, (bench)->opts.nrep)) \
+      return false; \
+  end
+
+__attribute__ ((__nonnull__))
+static bool bmm_bench_analyze(struct bmm_dem *const dem) {
+  bmm_dem_analyze(dem);
+
+  return true;
+}
+
+__attribute__ ((__nonnull__))
+static bool bmm_bench_force(struct bmm_dem *const dem) {
+  bmm_dem_force(dem);
+
+  return true;
+}
+
+__attribute__ ((__nonnull__))
+static bool bmm_bench_integ(struct bmm_dem *const dem) {
+  bmm_dem_predict(dem);
+  bmm_dem_correct(dem);
+
+  return true;
+}
+
+/// The call `bmm_bench_kde(dem, pc, py, m)`
+/// bins the horizontal positions of the particles in `dem`
+/// onto the grid `pc` of `m` points and smooths them into `py`.
+__attribute__ ((__nonnull__))
+static bool bmm_bench_kde(struct bmm_dem const *const dem,
+    double *const pc, double *const py, size_t const m) {
+  double const dx = dem->opts.box.x[0] / (double) (m - 1);
+
+  for (size_t i = 0; i < m; ++i)
+    pc[i] = 0.0;
+
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    bmm_kde_bin(pc, m, 0.0, dx, dem->part.x[ipart][0], 1.0);
+
+  bmm_kde_conv(py, pc, m, dx, BMM_KERNEL_EPAN,
+      bmm_ival_midpoint(dem->opts.part.rnew));
+
+  return true;
+}
+
+/// The call `bmm_bench_puts(dem)`
+/// encodes one complete frame of `dem` into the standard output
+/// and rewinds it for the next one.
+__attribute__ ((__nonnull__))
+static bool bmm_bench_puts(struct bmm_dem const *const dem) {
+  return bmm_dem_puts(dem, BMM_MSG_NUM_ISTEP) &&
+    bmm_dem_puts(dem, BMM_MSG_NUM_NEIGH) &&
+    bmm_dem_puts(dem, BMM_MSG_NUM_PARTS) &&
+    bmm_dem_puts(dem, BMM_MSG_NUM_EST) &&
+    fflush(stdout) != EOF && lseek(STDOUT_FILENO, 0, SEEK_SET) != -1;
+}
+
+__attribute__ ((__nonnull__))
+static enum bmm_io_read bmm_bench_read(void *const buf, size_t const n,
+    void *const ptr) {
+  int const *const fd = ptr;
+
+  return bmm_io_read(*fd, buf, n);
+}
+
+/// The call `bmm_bench_gets(fd, buf, nmsg)`
+/// decodes `nmsg` messages from the file descriptor `fd`
+/// into the buffer `buf` that is large enough for any of them.
+__attribute__ ((__nonnull__))
+static bool bmm_bench_gets(int fd, unsigned char *const buf,
+    size_t const nmsg) {
+  if (lseek(fd, 0, SEEK_SET) == -1) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  for (size_t imsg = 0; imsg < nmsg; ++imsg) {
+    struct bmm_msg_spec spec;
+    if (!bmm_io_read_to_bool(bmm_msg_spec_read(&spec, bmm_bench_read, &fd)))
+      return false;
+
+    enum bmm_msg_num num;
+    if (!bmm_io_read_to_bool(bmm_msg_num_read(&num, bmm_bench_read, &fd)))
+      return false;
+
+    if (!bmm_io_read_to_bool(bmm_io_read(fd, buf,
+            spec.msg.size - BMM_MSG_NUMSIZE)))
+      return false;
+  }
+
+  return true;
+}
+
+/// The call `bmm_bench_msg(bench)`
+/// measures encoding and decoding frames of the simulation of `bench`
+/// through a temporary file that stands in for the standard output.
+__attribute__ ((__nonnull__))
+static bool bmm_bench_msg(struct bmm_bench const *const bench) {
+  struct bmm_dem const *const dem = &bench->dem;
+
+  size_t const size = bmm_dem_sniff_size(dem, BMM_MSG_NUM_NEIGH) +
+    bmm_dem_sniff_size(dem, BMM_MSG_NUM_PARTS);
+
+  unsigned char *const buf = malloc(size);
+  if (buf == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  FILE *const stream = tmpfile();
+  if (stream == NULL) {
+    BMM_TLE_STDS();
+
+    free(buf);
+
+    return false;
+  }
+
+  if (fflush(stdout) == EOF) {
+    BMM_TLE_STDS();
+
+    (void) fclose(stream);
+    free(buf);
+
+    return false;
+  }
+
+  int const fdout = dup(STDOUT_FILENO);
+  if (fdout == -1 || dup2(fileno(stream), STDOUT_FILENO) == -1) {
+    BMM_TLE_STDS();
+
+    if (fdout != -1)
+      (void) close(fdout);
+    (void) fclose(stream);
+    free(buf);
+
+    return false;
+  }
+
+  double t = 0.0;
+  double tmin = INFINITY;
+  bool result = true;
+
+  for (size_t irep = 0; irep < bench->opts.nrep && result; ++irep) {
+    double const t0 = bmm_sec_now();
+
+    result = bmm_bench_puts(dem);
+
+    double const dt = bmm_sec_now() - t0;
+
+    t += dt;
+    tmin = fmin(tmin, dt);
+  }
+
+  // Every frame was flushed,
+  // so nothing is left buffered in the standard output stream.
+  if (dup2(fdout, STDOUT_FILENO) == -1) {
+    BMM_TLE_STDS();
+
+    result = false;
+  }
+
+  (void) close(fdout);
+
+  result = result && bmm_bench_put(bench, "msg_encode", t, tmin,
+      bench->opts.nrep);
+
+  if (result) {
+    t = 0.0;
+    tmin = INFINITY;
+
+    for (size_t irep = 0; irep < bench->opts.nrep && result; ++irep) {
+      double const t0 = bmm_sec_now();
+
+      result = bmm_bench_gets(fileno(stream), buf, 4);
+
+      double const dt = bmm_sec_now() - t0;
+
+      t += dt;
+      tmin = fmin(tmin, dt);
+    }
+
+    result = result && bmm_bench_put(bench, "msg_decode", t, tmin,
+        bench->opts.nrep);
+  }
+
+  (void) fclose(stream);
+  free(buf);
+
+  return result;
+}
+
+/// The call `bmm_bench_run_one(bench, npart)`
+/// measures every case for the packing of `bench` with `npart` particles.
+__attribute__ ((__nonnull__))
+static bool bmm_bench_run_one(struct bmm_bench *const bench,
+    size_t const npart) {
+  struct {
+    enum bmm_dem_integ integ;
+    char const *str;
+  } const integs[] = {
+    {BMM_DEM_INTEG_EULER, "integ_euler"},
+    {BMM_DEM_INTEG_TAYLOR, "integ_taylor"},
+    {BMM_DEM_INTEG_VELVET, "integ_velvet"},
+    {BMM_DEM_INTEG_BEEMAN, "integ_beeman"},
+    {BMM_DEM_INTEG_KURAEV, "integ_kuraev"},
+    {BMM_DEM_INTEG_RESPA, "integ_respa"}
+  };
+
+  for (size_t iinteg = 0; iinteg < nmembof(integs); ++iinteg) {
+    if (!bmm_bench_setup(bench, npart, integs[iinteg].integ))
+      return false;
+
+    struct bmm_dem *const dem = &bench->dem;
+
+    // The rest only needs to be measured once.
+    if (iinteg == 0) {
+      BMM_BENCH_TIME(bench, "startup", bmm_bench_startup(bench, npart));
+      BMM_BENCH_TIME(bench, "cache_build", bmm_dem_cache_build(dem));
+      BMM_BENCH_TIME(bench, "analyze", bmm_bench_analyze(dem));
+      BMM_BENCH_TIME(bench, "force", bmm_bench_force(dem));
+
+      double r[BMM_MBIN];
+      double g[BMM_MBIN];
+      BMM_BENCH_TIME(bench, "est_raddist", bmm_dem_est_raddist(r, g,
+            nmembof(r), 8.0 * bmm_ival_midpoint(dem->opts.part.rnew), dem));
+
+      double c[BMM_MBIN];
+      double y[BMM_MBIN];
+      BMM_BENCH_TIME(bench, "kde", bmm_bench_kde(dem, c, y, nmembof(c)));
+
+      if (!bmm_bench_msg(bench))
+        return false;
+    }
+
+    BMM_BENCH_TIME(bench, integs[iinteg].str, bmm_bench_integ(dem));
+
+    bmm_bench_free(bench);
+  }
+
+  return true;
+}
+
+/// Number of values in each array of the bandwidth measurement,
+/// which needs to be large enough to spill out of every cache.
+#define BMM_BENCH_NSTREAM ((size_t) 1 << 23)
+
+/// The call `bmm_bench_stream(bw, bench)`
+/// measures the memory bandwidth `bw` in bytes per second
+/// that the threads of `bench` reach with the triad of STREAM,
+/// which stands in for the peak bandwidth of the machine.
+__attribute__ ((__nonnull__))
+static bool bmm_bench_stream(double *const bw,
+    struct bmm_bench const *const bench) {
+  size_t const n = BMM_BENCH_NSTREAM;
+
+  double *const a = malloc(3 * n * sizeof *a);
+  if (a == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  double *const b = &a[n];
+  double *const c = &a[2 * n];
+
+  // Each thread touches its own pages first,
+  // so that they end up near it.
+#pragma omp parallel for schedule(static) \
+  num_threads((int) bench->opts.nthread)
+  for (size_t i = 0; i < n; ++i) {
+    a[i] = 0.0;
+    b[i] = 1.0;
+    c[i] = 2.0;
+  }
+
+  double tmin = INFINITY;
+
+  for (size_t irep = 0; irep < bench->opts.nrep; ++irep) {
+    double const t0 = bmm_sec_now();
+
+#pragma omp parallel for schedule(static) \
+  num_threads((int) bench->opts.nthread)
+    for (size_t i = 0; i < n; ++i)
+      a[i] = b[i] + 3.0 * c[i];
+
+    tmin = fmin(tmin, bmm_sec_now() - t0);
+  }
+
+  free(a);
+
+  *bw = (double) (3 * n * sizeof *a) / tmin;
+
+  return true;
+}
+
+/// The call `bmm_bench_traffic(dem)`
+/// returns the number of bytes a step of `dem` has to move at least
+/// if nothing stays in the caches from one step to the next.
+/// Every particle is read once and its dynamic state is written once,
+/// while its neighbors and contacts are only read.
+__attribute__ ((__nonnull__, __pure__))
+static size_t bmm_bench_traffic(struct bmm_dem const *const dem) {
+  size_t const nread = sizeof *dem->part.role + sizeof *dem->part.r +
+    sizeof *dem->part.m + sizeof *dem->part.jred;
+  size_t const nwrite = sizeof *dem->part.x + sizeof *dem->part.v +
+    sizeof *dem->part.a + sizeof *dem->part.phi +
+    sizeof *dem->part.omega + sizeof *dem->part.alpha +
+    sizeof *dem->part.f + sizeof *dem->part.tau;
+
+  return dem->part.n * (nread + 2 * nwrite +
+      sizeof *dem->cache.neigh + BMM_NCT * sizeof *dem->pair[0].cont.src) +
+    dem->cache.nneigh * sizeof *dem->cache.ineigh;
+}
+
+/// The call `bmm_bench_scale_one(bench, str, npart, bw)`
+/// measures whole steps for the case `str`
+/// with the packing of `bench` with `npart` particles
+/// and prints one line of results,
+/// comparing the bandwidth they need against the peak bandwidth `bw`.
+__attribute__ ((__nonnull__))
+static bool bmm_bench_scale_one(struct bmm_bench *const bench,
+    char const *const str, size_t const npart, double const bw) {
+  struct bmm_dem_opts opts;
+  bmm_dem_opts_def(&opts);
+
+  if (!bmm_bench_setup(bench, npart, opts.time.integ))
+    return false;
+
+  struct bmm_dem *const dem = &bench->dem;
+
+  double tmin = INFINITY;
+
+  for (size_t irep = 0; irep < bench->opts.nrep; ++irep) {
+    double const t0 = bmm_sec_now();
+
+    for (size_t istep = 0; istep < bench->opts.nstep; ++istep)
+      if (!bmm_dem_step(dem)) {
+        bmm_bench_free(bench);
+
+        return false;
+      }
+
+    tmin = fmin(tmin, bmm_sec_now() - t0);
+  }
+
+  double const rate = (double) bench->opts.nstep / tmin;
+  size_t const size = bmm_bench_traffic(dem);
+
+  bool const result = printf("%s\t%s\t%zu\t%zu\t%zu\t%.9e\t%zu\t%.9e\t%.9e\n",
+      str, bmm_bench_name(bench->pack), dem->part.n, bench->opts.nthread,
+      bench->opts.nstep, rate, size, rate * (double) size, bw) >= 0;
+  if (!result)
+    BMM_TLE_STDS();
+
+  bmm_bench_free(bench);
+
+  return result;
+}
+
+/// The call `bmm_bench_scale(opts)`
+/// measures strong and weak scaling for every packing
+/// with the benchmark options `opts`.
+/// Strong scaling keeps `opts->nmax` particles
+/// while doubling the number of threads up to `opts->nthread`,
+/// while weak scaling gives each thread `opts->nmin` particles.
+/// The peak bandwidth is measured anew for each number of threads,
+/// so that the bandwidth column works as the roof of a roofline plot.
+__attribute__ ((__nonnull__))
+static bool bmm_bench_scale(struct bmm_bench *const bench) {
+  struct bmm_bench_opts const opts = bench->opts;
+
+  if (printf("case\tpack\tnpart\tnthread\tnstep"
+        "\trate\tsize\tbw\tbwpeak\n") < 0) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  enum bmm_bench_pack const packs[] = {BMM_BENCH_PACK_HEX, BMM_BENCH_PACK_GAS};
+
+  bool result = true;
+
+  for (size_t nthread = 1; result; nthread *= 2) {
+    bench->opts.nthread = $(bmm_min, size_t)(nthread, opts.nthread);
+
+    double bw;
+    result = bmm_bench_stream(&bw, bench);
+
+    for (size_t ipack = 0; ipack < nmembof(packs) && result; ++ipack) {
+      bench->pack = packs[ipack];
+
+      result = bmm_bench_scale_one(bench, "strong", opts.nmax, bw) &&
+        bmm_bench_scale_one(bench, "weak",
+            opts.nmin * bench->opts.nthread, bw);
+    }
+
+    if (bench->opts.nthread == opts.nthread)
+      break;
+  }
+
+  bench->opts = opts;
+
+  return result;
+}
+
+/// The call `bmm_bench_run(opts)`
+/// measures every case for every packing and particle count
+/// with the benchmark options `opts`.
+__attribute__ ((__nonnull__))
+static bool bmm_bench_run(struct bmm_bench_opts const *const opts) {
+  // This only reads the default seed.
+  if (gsl_rng_env_setup() == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  struct bmm_bench *const bench = malloc(sizeof *bench);
+  if (bench == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  bench->opts = *opts;
+
+  if (opts->scale) {
+    bool const result = bmm_bench_scale(bench);
+
+    free(bench);
+
+    return result;
+  }
+
+  bool result = printf("pack\tnpart\tnthread\tcase\tnrep\tmean\tmin\n") >= 0;
+  if (!result)
+    BMM_TLE_STDS();
+
+  enum bmm_bench_pack const packs[] = {BMM_BENCH_PACK_HEX, BMM_BENCH_PACK_GAS};
+
+  for (size_t ipack = 0; ipack < nmembof(packs) && result; ++ipack) {
+    bench->pack = packs[ipack];
+
+    for (size_t npart = opts->nmin; npart <= opts->nmax && result;
+        npart *= 4)
+      result = bmm_bench_run_one(bench, npart);
+  }
+
+  free(bench);
+
+  return result;
+}
+
+__attribute__ ((__nonnull__ (1, 2)))
+static bool f(char const *const key, char const *const value,
+    void *const ptr) {
+  struct bmm_bench_opts *const opts = ptr;
+
+  if (strcmp(key, "nmin") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    if (n == 0)
+      return false;
+
+    opts->nmin = n;
+  } else if (strcmp(key, "nmax") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    opts->nmax = n;
+  } else if (strcmp(key, "nrep") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    if (n == 0)
+      return false;
+
+    opts->nrep = n;
+  } else if (strcmp(key, "threads") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    if (n == 0 || n > BMM_MTHREAD)
+      return false;
+
+    opts->nthread = n;
+  } else if (strcmp(key, "scale") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->scale = p;
+  } else if (strcmp(key, "nstep") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    if (n == 0)
+      return false;
+
+    opts->nstep = n;
+  } else
+    return false;
+
+  return true;
+}
+
+__attribute__ ((__nonnull__))
+int main(int const argc, char **const argv) {
+  bmm_tle_reset(argv[0]);
+
+  struct bmm_bench_opts opts;
+  opts.nmin = 256;
+  opts.nmax = 4096;
+  opts.nrep = 16;
+  opts.nthread = 1;
+  opts.scale = false;
+  opts.nstep = 64;
+
+  if (!bmm_opt_parse((char const *const *) &argv[1], (size_t) (argc - 1),
+        f, &opts)) {
+    bmm_tle_put();
+
+    return EXIT_FAILURE;
+  }
+
+  if (!bmm_bench_run(&opts)) {
+    bmm_tle_put();
+
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -1,6 +1,7 @@
 #include <math.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -8,9 +9,11 @@
 #include "ext.h"
 #include "fp.h"
 #include "geom.h"
+#include "io.h"
 #include "opt.h"
 #include "str.h"
 #include "tle.h"
+#include "view.h"
 
 __attribute__ ((__nonnull__))
 static bool ind_straight(double const *const x, void *const cls) {
@@ -27,6 +30,15 @@ static bool ind_wave(double const *const x, void *const cls) {
     sin(M_2PI * (double) opts->fault.njag * x[0] / opts->box.x[0]);
 }
 
+/// Parameter sweep to run instead of a single simulation.
+static struct {
+  /// Swept option followed by its comma-separated values
+  /// in the form `key=x,y,...` or `NULL` if there is no sweep.
+  char const *spec;
+  /// Number of stages the variants share.
+  size_t nshared;
+} sweep = {.spec = NULL, .nshared = 0};
+
 __attribute__ ((__nonnull__ (1, 2)))
 static bool f(char const *const key, char const *const value,
     void *const ptr) {
@@ -327,6 +339,71 @@ static bool f(char const *const key, char const *const value,
       opts->script.params[istage].crunch.fadjust[1] = padjust;
       opts->script.params[istage].crunch.p = pdriv;
 
+      istage = bmm_dem_script_addstage(opts);
+      opts->script.mode[istage] = BMM_DEM_MODE_EXPORT;
+      opts->script.params[istage].expr.entropic = false;
+      opts->script.params[istage].expr.str = "fragment";
+    } else if (strcmp(value, "leshear") == 0) {
+      // This is like `shear`, but without the driven layers.
+      opts->box.x[1] = 0.025;
+      opts->box.x[0] = opts->box.x[1];
+      opts->box.per[1] = true;
+
+      bmm_dem_opts_set_rnew(opts, rnew);
+
+      dtstuff = 2.0e-8;
+      opts->comm.dt = 1.0e-4;
+
+      istage = bmm_dem_script_addstage(opts);
+      opts->script.mode[istage] = BMM_DEM_MODE_CREATE_HC;
+      opts->script.params[istage].create.eta = bmm_geom_ballmpd(BMM_NDIM);
+
+      istage = bmm_dem_script_addstage(opts);
+      opts->script.mode[istage] = BMM_DEM_MODE_PRESET0;
+      opts->script.params[istage].preset.eta = eta;
+      opts->script.params[istage].preset.kn = kn;
+      opts->script.params[istage].preset.gamman = gamman;
+
+      istage = bmm_dem_script_addstage(opts);
+      opts->script.mode[istage] = BMM_DEM_MODE_IDLE;
+      opts->script.tspan[istage] = 0.5e-3;
+      opts->script.dt[istage] = dtstuff;
+
+      istage = bmm_dem_script_addstage(opts);
+      opts->script.mode[istage] = BMM_DEM_MODE_LINK;
+
+      istage = bmm_dem_script_addstage(opts);
+      opts->script.mode[istage] = BMM_DEM_MODE_PRESET1;
+      opts->script.params[istage].preset.fric = fric;
+      opts->script.params[istage].preset.eta2 = eta2;
+      opts->script.params[istage].preset.a = a;
+      opts->script.params[istage].preset.mu = mu;
+      opts->script.params[istage].preset.kt = kt;
+      opts->script.params[istage].preset.gammat = gammat;
+      opts->script.params[istage].preset.kn = kn;
+      opts->script.params[istage].preset.gamman = gamman;
+      opts->script.params[istage].preset.barkn = barkn;
+      opts->script.params[istage].preset.bargamman = bargamman;
+      opts->script.params[istage].preset.barkt = barkt;
+      opts->script.params[istage].preset.bargammat = bargammat;
+
+      istage = bmm_dem_script_addstage(opts);
+      opts->script.mode[istage] = BMM_DEM_MODE_SET_DENSITY;
+
+      istage = bmm_dem_script_addstage(opts);
+      opts->script.mode[istage] = BMM_DEM_MODE_PRESET2;
+      opts->script.params[istage].preset.eta3 = eta3;
+      opts->script.params[istage].preset.sigmacrit = sigmacrit;
+      opts->script.params[istage].preset.taucrit = taucrit;
+      opts->script.params[istage].preset.sigmacritt = sigmacritt;
+      opts->script.params[istage].preset.taucritt = taucritt;
+
+      istage = bmm_dem_script_addstage(opts);
+      opts->script.mode[istage] = BMM_DEM_MODE_LESHEAR;
+      opts->script.tspan[istage] = 7.0e-3;
+      opts->script.dt[istage] = dtstuff;
+      opts->script.params[istage].leshear.v = vdriv;
+
       istage = bmm_dem_script_addstage(opts);
       opts->script.mode[istage] = BMM_DEM_MODE_EXPORT;
       opts->script.params[istage].expr.entropic = false;
@@ -571,6 +648,20 @@ static bool f(char const *const key, char const *const value,
       opts->script.mode[istage] = BMM_DEM_MODE_IDLE;
       opts->script.tspan[istage] = 6.0e-3;
       opts->script.dt[istage] = dtstuff;
+    } else if (strcmp(value, "pack") == 0) {
+      dtstuff = 2.0e-8;
+
+      bmm_dem_opts_set_rnew(opts, rnew);
+
+      istage = bmm_dem_script_addstage(opts);
+      opts->script.mode[istage] = BMM_DEM_MODE_CREATE_PACK;
+      opts->script.params[istage].pack.eta = 0.5;
+      opts->script.params[istage].pack.ntry = 256;
+
+      istage = bmm_dem_script_addstage(opts);
+      opts->script.mode[istage] = BMM_DEM_MODE_IDLE;
+      opts->script.tspan[istage] = 0.6e-3;
+      opts->script.dt[istage] = dtstuff;
     } else if (strcmp(value, "triplet") == 0) {
       dtstuff = 2.0e-8;
 
@@ -623,6 +714,524 @@ static bool f(char const *const key, char const *const value,
       return false;
 
     opts->gross.ds = x;
+  } else if (strcmp(key, "settle") == 0) {
+    double x;
+    if (!bmm_str_strtod(&x, value))
+      return false;
+
+    if (!(x > 0.0))
+      return false;
+
+    for (size_t istage = 0; istage < opts->script.n; ++istage)
+      if (opts->script.mode[istage] == BMM_DEM_MODE_SEDIMENT ||
+          (opts->script.mode[istage] == BMM_DEM_MODE_CRUNCH &&
+           opts->script.params[istage].crunch.v == 0.0)) {
+        opts->script.conv[istage].nstep = 100;
+        opts->script.conv[istage].nwin = 10;
+        opts->script.conv[istage].ek = x;
+      }
+  } else if (strcmp(key, "sweep") == 0) {
+    char const *const eq = strchr(value, '=');
+    if (eq == NULL || eq == value || eq[1] == '\0')
+      return false;
+
+    sweep.spec = value;
+  } else if (strcmp(key, "shared") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    sweep.nshared = n;
+  } else if (strcmp(key, "ncap") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    opts->part.ncap = n;
+  } else if (strcmp(key, "threads") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    if (n == 0 || n > BMM_MTHREAD)
+      return false;
+
+    opts->thread.n = n;
+  } else if (strcmp(key, "nacc") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    if (n > BMM_MTHREAD)
+      return false;
+
+    opts->thread.nacc = n;
+  } else if (strcmp(key, "pin") == 0) {
+    if (strcmp(value, "none") == 0)
+      opts->thread.pin = BMM_DEM_PIN_NONE;
+    else if (strcmp(value, "close") == 0)
+      opts->thread.pin = BMM_DEM_PIN_CLOSE;
+    else if (strcmp(value, "spread") == 0)
+      opts->thread.pin = BMM_DEM_PIN_SPREAD;
+    else
+      return false;
+  } else if (strcmp(key, "huge") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->thread.huge = p;
+  } else if (strcmp(key, "perf") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    opts->perf.nstep = n;
+  } else if (strcmp(key, "trace") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    opts->trace.nev = n;
+  } else if (strcmp(key, "plug") == 0) {
+    // Every occurrence adds another plugin.
+    if (opts->plug.n >= BMM_MPLUG)
+      return false;
+
+    opts->plug.path[opts->plug.n] = value;
+    ++opts->plug.n;
+  } else if (strcmp(key, "nmemb") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    if (n == 0)
+      return false;
+
+    opts->ens.n = n;
+  } else if (strcmp(key, "ckpt") == 0) {
+    opts->ckpt.path = value;
+  } else if (strcmp(key, "ckptdt") == 0) {
+    double x;
+    if (!bmm_str_strtod(&x, value))
+      return false;
+
+    if (!(x > 0.0))
+      return false;
+
+    opts->ckpt.dt = x;
+  } else if (strcmp(key, "resume") == 0) {
+    opts->ckpt.resume = value;
+  } else if (strcmp(key, "ckptfork") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->ckpt.fork = p;
+  } else if (strcmp(key, "nkey") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    if (n == 0)
+      return false;
+
+    opts->comm.nkey = n;
+  } else if (strcmp(key, "quant") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    if (!(n == 0 || n == 16 || n == 32))
+      return false;
+
+    opts->comm.nbit = n;
+  } else if (strcmp(key, "zip") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    if (n > 9)
+      return false;
+
+    opts->comm.zip = n;
+  } else if (strcmp(key, "literal") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->comm.lit = p;
+  } else if (strcmp(key, "columns") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->comm.cols = p;
+  } else if (strcmp(key, "shuffle") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->comm.shuffle = p;
+  } else if (strcmp(key, "async") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->comm.async = p;
+  } else if (strcmp(key, "lag") == 0) {
+    if (strcmp(value, "block") == 0)
+      opts->comm.lag = BMM_AIO_LAG_BLOCK;
+    else if (strcmp(value, "drop") == 0)
+      opts->comm.lag = BMM_AIO_LAG_DROP;
+    else if (strcmp(value, "coalesce") == 0)
+      opts->comm.lag = BMM_AIO_LAG_COALESCE;
+    else
+      return false;
+  } else if (strcmp(key, "cadence") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->comm.cadence.on = p;
+  } else if (strcmp(key, "cadencemin") == 0) {
+    double x;
+    if (!bmm_str_strtod(&x, value))
+      return false;
+
+    if (!(x > 0.0 && x <= 1.0))
+      return false;
+
+    opts->comm.cadence.fmin = x;
+  } else if (strcmp(key, "cadencemax") == 0) {
+    double x;
+    if (!bmm_str_strtod(&x, value))
+      return false;
+
+    if (!(x >= 1.0))
+      return false;
+
+    opts->comm.cadence.fmax = x;
+  } else if (strcmp(key, "pub") == 0) {
+    opts->comm.pub = value;
+  } else if (strcmp(key, "prof") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->comm.prof = p;
+  } else if (strcmp(key, "stats") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->comm.stats = p;
+  } else if (strcmp(key, "sketch") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->comm.sketch = p;
+  } else if (strcmp(key, "frag") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->comm.frag = p;
+  } else if (strcmp(key, "exportbin") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->expr.bin = p;
+  } else if (strcmp(key, "field") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->field.on = p;
+  } else if (strcmp(key, "fieldncell") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    if (n > BMM_MCELL)
+      return false;
+
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      opts->field.ncell[idim] = n;
+  } else if (strcmp(key, "fieldkernel") == 0) {
+    if (strcmp(value, "rect") == 0)
+      opts->field.kernel = BMM_KERNEL_RECT;
+    else if (strcmp(value, "tri") == 0)
+      opts->field.kernel = BMM_KERNEL_TRI;
+    else if (strcmp(value, "epan") == 0)
+      opts->field.kernel = BMM_KERNEL_EPAN;
+    else if (strcmp(value, "biweight") == 0)
+      opts->field.kernel = BMM_KERNEL_BIWEIGHT;
+    else if (strcmp(value, "cos") == 0)
+      opts->field.kernel = BMM_KERNEL_COS;
+    else if (strcmp(value, "gaussian") == 0)
+      opts->field.kernel = BMM_KERNEL_GAUSSIAN;
+    else if (strcmp(value, "logistic") == 0)
+      opts->field.kernel = BMM_KERNEL_LOGISTIC;
+    else
+      return false;
+  } else if (strcmp(key, "fieldbw") == 0) {
+    double x;
+    if (!bmm_str_strtod(&x, value))
+      return false;
+
+    if (!(x > 0.0))
+      return false;
+
+    opts->field.bw = x;
+  } else if (strcmp(key, "fielddt") == 0) {
+    double x;
+    if (!bmm_str_strtod(&x, value))
+      return false;
+
+    if (!(x >= 0.0))
+      return false;
+
+    opts->field.dt = x;
+  } else if (strcmp(key, "adapt") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->time.adapt = p;
+  } else if (strcmp(key, "cadapt") == 0) {
+    double x;
+    if (!bmm_str_strtod(&x, value))
+      return false;
+
+    if (!(x > 0.0))
+      return false;
+
+    opts->time.cadapt = x;
+  } else if (strcmp(key, "nsub") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    if (n == 0)
+      return false;
+
+    opts->time.nsub = n;
+  } else if (strcmp(key, "nltol") == 0) {
+    double x;
+    if (!bmm_str_strtod(&x, value))
+      return false;
+
+    if (!(x >= 0.0 && x < 1.0))
+      return false;
+
+    opts->nonlin.tol = x;
+  } else if (strcmp(key, "link") == 0) {
+    if (strcmp(value, "pair") == 0)
+      opts->bond.tag = BMM_DEM_BOND_NONE;
+    else if (strcmp(value, "delaunay") == 0)
+      opts->bond.tag = BMM_DEM_BOND_DELAUNAY;
+    else
+      return false;
+  } else if (strcmp(key, "sleep") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->sleep.on = p;
+  } else if (strcmp(key, "sleepek") == 0) {
+    double x;
+    if (!bmm_str_strtod(&x, value))
+      return false;
+
+    if (!(x > 0.0))
+      return false;
+
+    opts->sleep.ek = x;
+  } else if (strcmp(key, "sleepf") == 0) {
+    double x;
+    if (!bmm_str_strtod(&x, value))
+      return false;
+
+    if (!(x > 0.0))
+      return false;
+
+    opts->sleep.f = x;
+  } else if (strcmp(key, "nsleep") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    if (n == 0)
+      return false;
+
+    opts->sleep.nstep = n;
+  } else if (strcmp(key, "clump") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->clump.on = p;
+  } else if (strcmp(key, "clumpmin") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    if (n == 0)
+      return false;
+
+    opts->clump.nmin = n;
+  } else if (strcmp(key, "clumpyield") == 0) {
+    double x;
+    if (!bmm_str_strtod(&x, value))
+      return false;
+
+    if (!(x > 0.0 && x < 1.0))
+      return false;
+
+    opts->clump.fyield = x;
+  } else if (strcmp(key, "nclump") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    if (n == 0)
+      return false;
+
+    opts->clump.nstep = n;
+  } else if (strcmp(key, "walls") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->wall.on = p;
+  } else if (strcmp(key, "walljag") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    opts->wall.njag = n;
+  } else if (strcmp(key, "wallhjag") == 0) {
+    double x;
+    if (!bmm_str_strtod(&x, value))
+      return false;
+
+    if (!(x >= 0.0))
+      return false;
+
+    opts->wall.hjag = x;
+  } else if (strcmp(key, "wallk") == 0) {
+    double x;
+    if (!bmm_str_strtod(&x, value))
+      return false;
+
+    if (!(x > 0.0))
+      return false;
+
+    opts->wall.k = x;
+  } else if (strcmp(key, "wallgamma") == 0) {
+    double x;
+    if (!bmm_str_strtod(&x, value))
+      return false;
+
+    if (!(x > 0.0))
+      return false;
+
+    opts->wall.gamma = x;
+  } else if (strcmp(key, "wallgammat") == 0) {
+    double x;
+    if (!bmm_str_strtod(&x, value))
+      return false;
+
+    if (!(x > 0.0))
+      return false;
+
+    opts->wall.gammat = x;
+  } else if (strcmp(key, "wallmu") == 0) {
+    double x;
+    if (!bmm_str_strtod(&x, value))
+      return false;
+
+    if (!(x > 0.0))
+      return false;
+
+    opts->wall.mu = x;
+  } else if (strcmp(key, "integ") == 0) {
+    if (strcmp(value, "euler") == 0)
+      opts->time.integ = BMM_DEM_INTEG_EULER;
+    else if (strcmp(value, "taylor") == 0)
+      opts->time.integ = BMM_DEM_INTEG_TAYLOR;
+    else if (strcmp(value, "velvet") == 0)
+      opts->time.integ = BMM_DEM_INTEG_VELVET;
+    else if (strcmp(value, "beeman") == 0)
+      opts->time.integ = BMM_DEM_INTEG_BEEMAN;
+    else if (strcmp(value, "kuraev") == 0)
+      opts->time.integ = BMM_DEM_INTEG_KURAEV;
+    else if (strcmp(value, "respa") == 0)
+      opts->time.integ = BMM_DEM_INTEG_RESPA;
+    else
+      return false;
+  } else if (strcmp(key, "incr") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->cache.incr = p;
+  } else if (strcmp(key, "fuse") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->cache.fuse = p;
+  } else if (strcmp(key, "tune") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->cache.tune = p;
+  } else if (strcmp(key, "ntune") == 0) {
+    size_t n;
+    if (!bmm_str_strtoz(&n, value))
+      return false;
+
+    if (n == 0)
+      return false;
+
+    opts->cache.ntune = n;
+  } else if (strcmp(key, "ghost") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->cache.ghost = p;
+  } else if (strcmp(key, "spec") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->cache.spec = p;
+  } else if (strcmp(key, "cache") == 0) {
+    if (strcmp(value, "neigh") == 0)
+      opts->cache.tag = BMM_DEM_CACHE_NEIGH;
+    else if (strcmp(value, "level") == 0)
+      opts->cache.tag = BMM_DEM_CACHE_LEVEL;
+    else
+      return false;
+  } else if (strcmp(key, "reorder") == 0) {
+    if (strcmp(value, "hilbert") == 0)
+      opts->cache.reorder = BMM_DEM_ORDER_HILBERT;
+    else if (strcmp(value, "cell") == 0)
+      opts->cache.reorder = BMM_DEM_ORDER_CELL;
+    else {
+      // Truth values are still accepted for the space-filling curve.
+      bool p;
+      if (!bmm_str_strtob(&p, value))
+        return false;
+
+      opts->cache.reorder = p ? BMM_DEM_ORDER_HILBERT : BMM_DEM_ORDER_NONE;
+    }
   } else if (strcmp(key, "verbose") == 0) {
     bool p;
     if (!bmm_str_strtob(&p, value))
@@ -641,21 +1250,104 @@ static bool f(char const *const key, char const *const value,
   return true;
 }
 
+/// The call `run_sweep(args, narg)`
+/// runs the sweep in `sweep`
+/// by parsing the command line argument strings `args` of length `narg`
+/// once for every value of the swept option,
+/// with that value coming before everything else.
+__attribute__ ((__nonnull__))
+static bool run_sweep(char const *const *const args, size_t const narg) {
+  char const *const eq = strchr(sweep.spec, '=');
+
+  char key[BUFSIZ];
+  if ((size_t) snprintf(key, sizeof key, "--%.*s",
+        (int) (eq - sweep.spec), sweep.spec) >= sizeof key) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_PARSE, "Swept key too long");
+
+    return false;
+  }
+
+  size_t n = 1;
+  for (char const *c = &eq[1]; *c != '\0'; ++c)
+    if (*c == ',')
+      ++n;
+
+  char *const values = malloc(strlen(&eq[1]) + 1);
+  char const **const vargs = malloc((narg + 2) * sizeof *vargs);
+  struct bmm_dem_opts *const opts = malloc(n * sizeof *opts);
+  if (values == NULL || vargs == NULL || opts == NULL) {
+    BMM_TLE_STDS();
+
+    free(opts);
+    free(vargs);
+    free(values);
+
+    return false;
+  }
+
+  (void) strcpy(values, &eq[1]);
+
+  vargs[0] = key;
+  for (size_t iarg = 0; iarg < narg; ++iarg)
+    vargs[iarg + 2] = args[iarg];
+
+  bool result = true;
+
+  char *value = values;
+  for (size_t i = 0; i < n; ++i) {
+    char *const comma = strchr(value, ',');
+    if (comma != NULL)
+      *comma = '\0';
+
+    vargs[1] = value;
+
+    bmm_dem_opts_def(&opts[i]);
+    if (!bmm_opt_parse(vargs, narg + 2, f, &opts[i])) {
+      result = false;
+
+      break;
+    }
+
+    if (comma != NULL)
+      value = &comma[1];
+  }
+
+  result = result && bmm_dem_run_sweep(opts, n, sweep.nshared);
+
+  free(opts);
+  free(vargs);
+  free(values);
+
+  return result;
+}
+
+bool bmm_dem_opts_parse(struct bmm_dem_opts *const opts,
+    char const *const *const args, size_t const narg) {
+  return bmm_opt_parse(args, narg, f, opts);
+}
+
 __attribute__ ((__nonnull__))
 int main(int const argc, char **const argv) {
   bmm_tle_reset(argv[0]);
 
+  if (!bmm_io_setbufio()) {
+    bmm_tle_put();
+
+    return EXIT_FAILURE;
+  }
+
   struct bmm_dem_opts opts;
   bmm_dem_opts_def(&opts);
 
-  if (!bmm_opt_parse((char const *const *) &argv[1], (size_t) (argc - 1),
-        f, &opts)) {
+  if (!bmm_dem_opts_parse(&opts,
+        (char const *const *) &argv[1], (size_t) (argc - 1))) {
     bmm_tle_put();
 
     return EXIT_FAILURE;
   }
 
-  if (!bmm_dem_run_with(&opts)) {
+  if (!(sweep.spec == NULL ? bmm_dem_run_with(&opts) :
+        run_sweep((char const *const *) &argv[1], (size_t) (argc - 1)))) {
     bmm_tle_put();
 
     return EXIT_FAILURE;
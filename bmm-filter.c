@@ -6,6 +6,7 @@
 #include "conf.h"
 #include "ext.h"
 #include "filter.h"
+#include "io.h"
 #include "msg.h"
 #include "opt.h"
 #include "str.h"
@@ -16,13 +17,20 @@ static bool f(char const *const key, char const *const value,
     void *const ptr) {
   struct bmm_filter_opts *const opts = ptr;
 
+  // Masks and decimation apply to the most recent additional output,
+  // if there is one.
+  bool *const mask = opts->ntee == 0 ?
+    opts->mask : opts->tee[opts->ntee - 1].mask;
+  size_t *const every = opts->ntee == 0 ?
+    &opts->every : &opts->tee[opts->ntee - 1].every;
+
   if (strcmp(key, "mode") == 0) {
     if (strcmp(value, "blacklist") == 0)
       for (size_t imsg = 0; imsg < BMM_MMSG; ++imsg)
-        opts->mask[imsg] = true;
+        mask[imsg] = true;
     else if (strcmp(value, "whitelist") == 0)
       for (size_t imsg = 0; imsg < BMM_MMSG; ++imsg)
-        opts->mask[imsg] = false;
+        mask[imsg] = false;
     else
       return false;
   } else if (strcmp(key, "pass") == 0) {
@@ -30,19 +38,59 @@ static bool f(char const *const key, char const *const value,
     if (!bmm_msg_from_str(&num, value))
       return false;
 
-    opts->mask[(size_t) num] = true;
+    mask[(size_t) num] = true;
   } else if (strcmp(key, "stop") == 0) {
     enum bmm_msg_num num;
     if (!bmm_msg_from_str(&num, value))
       return false;
 
-    opts->mask[(size_t) num] = false;
+    mask[(size_t) num] = false;
+  } else if (strcmp(key, "tee") == 0) {
+    if (strlen(value) < 1 || opts->ntee >= BMM_MTEE)
+      return false;
+
+    struct bmm_filter_tee *const tee = &opts->tee[opts->ntee];
+    tee->path = value;
+    tee->every = 1;
+
+    for (size_t imsg = 0; imsg < BMM_MMSG; ++imsg)
+      tee->mask[imsg] = false;
+
+    ++opts->ntee;
   } else if (strcmp(key, "verbose") == 0) {
     bool p;
     if (!bmm_str_strtob(&p, value))
       return false;
 
     opts->verbose = p;
+  } else if (strcmp(key, "zcopy") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->zcopy = p;
+  } else if (strcmp(key, "store") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->store = p;
+  } else if (strcmp(key, "sub") == 0)
+    opts->sub = value;
+  else if (strcmp(key, "load") == 0) {
+    if (strlen(value) < 1)
+      return false;
+
+    opts->load = value;
+  } else if (strcmp(key, "every") == 0) {
+    if (!bmm_str_strtoz(every, value) || *every < 1)
+      return false;
+  } else if (strcmp(key, "from") == 0) {
+    if (!bmm_str_strtod(&opts->from, value))
+      return false;
+  } else if (strcmp(key, "to") == 0) {
+    if (!bmm_str_strtod(&opts->to, value))
+      return false;
   } else
     return false;
 
@@ -53,6 +101,12 @@ __attribute__ ((__nonnull__))
 int main(int const argc, char **const argv) {
   bmm_tle_reset(argv[0]);
 
+  if (!bmm_io_setbufio()) {
+    bmm_tle_put();
+
+    return EXIT_FAILURE;
+  }
+
   struct bmm_filter_opts opts;
   bmm_filter_opts_def(&opts);
 
@@ -6,6 +6,7 @@
 #include <string.h>
 
 #include "ext.h"
+#include "io.h"
 #include "opt.h"
 #include "str.h"
 #include "tle.h"
@@ -25,6 +26,25 @@ static bool f(char const *const key, char const *const value,
       return false;
 
     opts->fpath = value;
+  } else if (strcmp(key, "cvpath") == 0) {
+    if (strlen(value) < 1)
+      return false;
+
+    opts->cvpath = value;
+  } else if (strcmp(key, "color") == 0) {
+    if (strcmp(value, "role") == 0)
+      opts->color = BMM_GLUT_COLOR_ROLE;
+    else if (strcmp(value, "speed") == 0)
+      opts->color = BMM_GLUT_COLOR_SPEED;
+    else if (strcmp(value, "force") == 0)
+      opts->color = BMM_GLUT_COLOR_FORCE;
+    else if (strcmp(value, "angle") == 0)
+      opts->color = BMM_GLUT_COLOR_ANGLE;
+    else
+      return false;
+  } else if (strcmp(key, "cmax") == 0) {
+    if (!bmm_str_strtod(&opts->cmax, value))
+      return false;
   } else
     return false;
 
@@ -35,6 +55,12 @@ __attribute__ ((__nonnull__))
 int main(int const argc, char **const argv) {
   bmm_tle_reset(argv[0]);
 
+  if (!bmm_io_setbufio()) {
+    bmm_tle_put();
+
+    return EXIT_FAILURE;
+  }
+
   struct bmm_glut_opts opts;
   bmm_glut_opts_def(&opts);
 
@@ -4,6 +4,7 @@
 #include <string.h>
 
 #include "ext.h"
+#include "io.h"
 #include "nc.h"
 #include "opt.h"
 #include "str.h"
@@ -24,6 +25,14 @@ static bool f(char const *const key, char const *const value,
       return false;
 
     opts->path = value;
+  } else if (strcmp(key, "store") == 0) {
+    if (strlen(value) < 1)
+      return false;
+
+    opts->store = value;
+  } else if (strcmp(key, "frame") == 0) {
+    if (!bmm_str_strtoz(&opts->frame, value))
+      return false;
   } else if (strcmp(key, "id") == 0) {
     bool p;
     if (!bmm_str_strtob(&p, value))
@@ -54,6 +63,27 @@ static bool f(char const *const key, char const *const value,
       return false;
 
     opts->f = p;
+  } else if (strcmp(key, "batch") == 0) {
+    if (!bmm_str_strtoz(&opts->nbatch, value))
+      return false;
+  } else if (strcmp(key, "natom") == 0) {
+    if (!bmm_str_strtoz(&opts->natom, value))
+      return false;
+  } else if (strcmp(key, "deflate") == 0) {
+    if (!bmm_str_strtou(&opts->deflate, value) || opts->deflate > 9)
+      return false;
+  } else if (strcmp(key, "shuffle") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->shuffle = p;
+  } else if (strcmp(key, "single") == 0) {
+    bool p;
+    if (!bmm_str_strtob(&p, value))
+      return false;
+
+    opts->single = p;
   } else
     return false;
 
@@ -64,6 +94,12 @@ __attribute__ ((__nonnull__))
 int main(int const argc, char **const argv) {
   bmm_tle_reset(argv[0]);
 
+  if (!bmm_io_setbufio()) {
+    bmm_tle_put();
+
+    return EXIT_FAILURE;
+  }
+
   struct bmm_nc_opts opts;
   bmm_nc_opts_def(&opts);
 
@@ -1,5 +1,6 @@
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -7,6 +8,7 @@
 #include "sdl.h"
 
 #include "ext.h"
+#include "io.h"
 #include "opt.h"
 #include "str.h"
 #include "tle.h"
@@ -31,6 +33,38 @@ static bool f(char const *const key, char const *const value,
   } else if (strcmp(key, "zoomfac") == 0) {
     if (!bmm_str_strtod(&opts->zoomfac, value))
       return false;
+  } else if (strcmp(key, "store") == 0) {
+    if (strlen(value) < 1)
+      return false;
+
+    opts->store = value;
+  } else if (strcmp(key, "frame") == 0) {
+    if (!bmm_str_strtoz(&opts->frame, value))
+      return false;
+  } else if (strcmp(key, "vpath") == 0) {
+    if (strlen(value) < 1)
+      return false;
+
+    opts->vpath = value;
+  } else if (strcmp(key, "fpath") == 0) {
+    if (strlen(value) < 1)
+      return false;
+
+    opts->fpath = value;
+  } else if (strcmp(key, "lod") == 0) {
+    if (!bmm_str_strtod(&opts->lod, value))
+      return false;
+  } else if (strcmp(key, "video") == 0) {
+    if (strlen(value) < 1)
+      return false;
+
+    opts->video = value;
+  } else if (strcmp(key, "every") == 0) {
+    if (!bmm_str_strtoz(&opts->every, value) || opts->every < 1)
+      return false;
+  } else if (strcmp(key, "hist") == 0) {
+    if (!bmm_str_strtoz(&opts->hist, value) || opts->hist > SIZE_MAX >> 20)
+      return false;
   } else
     return false;
 
@@ -41,6 +75,12 @@ __attribute__ ((__nonnull__))
 int main(int const argc, char **const argv) {
   bmm_tle_reset(argv[0]);
 
+  if (!bmm_io_setbufio()) {
+    bmm_tle_put();
+
+    return EXIT_FAILURE;
+  }
+
   struct bmm_sdl_opts opts;
   bmm_sdl_opts_def(&opts);
 
@@ -0,0 +1,301 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "col.h"
+#include "endy.h"
+#include "ext.h"
+#include "io.h"
+#include "msg.h"
+#include "tle.h"
+
+// Counts are written as they are held.
+static_assert(sizeof (size_t) == sizeof (uint64_t), "Unsupported size type");
+
+size_t bmm_col_size(enum bmm_col_type const type) {
+  switch (type) {
+    case BMM_COL_TYPE_U8:
+      return 1;
+    case BMM_COL_TYPE_U16:
+      return 2;
+    case BMM_COL_TYPE_U32:
+    case BMM_COL_TYPE_I32:
+      return 4;
+    case BMM_COL_TYPE_U64:
+    case BMM_COL_TYPE_I64:
+    case BMM_COL_TYPE_F64:
+      return 8;
+  }
+
+  dynamic_assert(false, "Unsupported column type");
+}
+
+void bmm_col_tab_def(struct bmm_col_tab *const tab,
+    enum bmm_msg_num const num) {
+  tab->num = num;
+  tab->ncol = 0;
+}
+
+void bmm_col_tab_add(struct bmm_col_tab *const tab, char const *const name,
+    enum bmm_col_type const type, size_t const n) {
+  dynamic_assert(tab->ncol < BMM_COL_MCOL, "Too many columns");
+  dynamic_assert(strlen(name) < BMM_COL_MNAME, "Column name too long");
+
+  struct bmm_col *const col = &tab->col[tab->ncol];
+  (void) memset(col->name, 0, sizeof col->name);
+  (void) strcpy(col->name, name);
+  col->type = type;
+  col->n = n;
+
+  ++tab->ncol;
+}
+
+size_t bmm_col_tab_size(struct bmm_col_tab const *const tab,
+    size_t const nrow) {
+  size_t size = sizeof nrow;
+
+  for (size_t icol = 0; icol < tab->ncol; ++icol) {
+    size_t const width = bmm_col_size(tab->col[icol].type);
+    if (tab->col[icol].n > SIZE_MAX / width)
+      return SIZE_MAX;
+
+    size_t const stride = tab->col[icol].n * width;
+    if (stride != 0 && nrow > SIZE_MAX / stride)
+      return SIZE_MAX;
+
+    if (nrow * stride > SIZE_MAX - size)
+      return SIZE_MAX;
+
+    size += nrow * stride;
+  }
+
+  return size;
+}
+
+enum bmm_io_read bmm_col_tab_read(struct bmm_col_tab const *const tab,
+    size_t const nrow, struct bmm_col_want const *const want,
+    size_t const nwant, bool const swap,
+    bmm_msg_reader const f, bmm_col_skipper const g, void *const ptr) {
+  for (size_t icol = 0; icol < tab->ncol; ++icol) {
+    struct bmm_col const *const col = &tab->col[icol];
+    size_t const width = bmm_col_size(col->type);
+    size_t const nword = nrow * col->n;
+
+    // Columns that do not look as expected are as good as unknown.
+    void *buf = NULL;
+    for (size_t iwant = 0; iwant < nwant; ++iwant)
+      if (strcmp(col->name, want[iwant].name) == 0 &&
+          col->type == want[iwant].type && col->n == want[iwant].n) {
+        buf = want[iwant].buf;
+
+        break;
+      }
+
+    if (buf == NULL) {
+      switch (g(nword * width, ptr)) {
+        case BMM_IO_READ_ERROR:
+          return BMM_IO_READ_ERROR;
+        case BMM_IO_READ_EOF:
+          return BMM_IO_READ_EOF;
+      }
+
+      continue;
+    }
+
+    switch (f(buf, nword * width, ptr)) {
+      case BMM_IO_READ_ERROR:
+        return BMM_IO_READ_ERROR;
+      case BMM_IO_READ_EOF:
+        return BMM_IO_READ_EOF;
+    }
+
+    if (swap)
+      bmm_endy_swap(buf, nword, width);
+  }
+
+  return BMM_IO_READ_SUCCESS;
+}
+
+struct bmm_col_tab const *bmm_col_schema_find(
+    struct bmm_col_schema const *const schema, enum bmm_msg_num const num) {
+  for (size_t itab = 0; itab < schema->ntab; ++itab)
+    if (schema->tab[itab].num == num)
+      return &schema->tab[itab];
+
+  return NULL;
+}
+
+size_t bmm_col_schema_size(struct bmm_col_schema const *const schema) {
+  size_t size = sizeof schema->ntab;
+
+  for (size_t itab = 0; itab < schema->ntab; ++itab)
+    size += BMM_MSG_NUMSIZE + sizeof schema->tab[itab].ncol +
+      schema->tab[itab].ncol * (BMM_COL_MNAME + 1 + sizeof (size_t));
+
+  return size;
+}
+
+bool bmm_col_schema_write(struct bmm_col_schema const *const schema,
+    bmm_msg_writer const f, void *const ptr) {
+  if (!f(&schema->ntab, sizeof schema->ntab, ptr))
+    return false;
+
+  for (size_t itab = 0; itab < schema->ntab; ++itab) {
+    struct bmm_col_tab const *const tab = &schema->tab[itab];
+
+    if (!(bmm_msg_num_write(&tab->num, f, ptr) &&
+          f(&tab->ncol, sizeof tab->ncol, ptr)))
+      return false;
+
+    for (size_t icol = 0; icol < tab->ncol; ++icol) {
+      unsigned char const type = (unsigned char) tab->col[icol].type;
+
+      if (!(f(tab->col[icol].name, BMM_COL_MNAME, ptr) &&
+            f(&type, sizeof type, ptr) &&
+            f(&tab->col[icol].n, sizeof tab->col[icol].n, ptr)))
+        return false;
+    }
+  }
+
+  return true;
+}
+
+/// The call `bmm_col_get(buf, n, nrem, f, ptr)`
+/// reads `n` bytes into `buf` by calling `f(buf, n, ptr)`
+/// if there are at least that many of
+/// the `nrem` bytes remaining and then takes them off `nrem`.
+__attribute__ ((__nonnull__ (1, 3, 4)))
+static enum bmm_io_read bmm_col_get(void *const buf, size_t const n,
+    size_t *const nrem, bmm_msg_reader const f, void *const ptr) {
+  if (n > *nrem) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Schema too short");
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  switch (f(buf, n, ptr)) {
+    case BMM_IO_READ_ERROR:
+      return BMM_IO_READ_ERROR;
+    case BMM_IO_READ_EOF:
+      return BMM_IO_READ_EOF;
+  }
+
+  *nrem -= n;
+
+  return BMM_IO_READ_SUCCESS;
+}
+
+/// The call `bmm_col_get_count(n, nrem, swap, f, ptr)`
+/// works like `bmm_col_get(n, sizeof *n, nrem, f, ptr)`
+/// for a count that is converted if `swap` is set.
+__attribute__ ((__nonnull__ (1, 2, 4)))
+static enum bmm_io_read bmm_col_get_count(size_t *const n,
+    size_t *const nrem, bool const swap,
+    bmm_msg_reader const f, void *const ptr) {
+  enum bmm_io_read const result = bmm_col_get(n, sizeof *n, nrem, f, ptr);
+
+  if (result == BMM_IO_READ_SUCCESS && swap)
+    bmm_endy_swap(n, 1, sizeof *n);
+
+  return result;
+}
+
+enum bmm_io_read bmm_col_schema_read(struct bmm_col_schema *const schema,
+    size_t const size, bool const swap,
+    bmm_msg_reader const f, void *const ptr) {
+  size_t nrem = size;
+
+  // The schema is not left half-read when the message is malformed.
+  schema->ntab = 0;
+
+  size_t ntab;
+  switch (bmm_col_get_count(&ntab, &nrem, swap, f, ptr)) {
+    case BMM_IO_READ_ERROR:
+      return BMM_IO_READ_ERROR;
+    case BMM_IO_READ_EOF:
+      return BMM_IO_READ_EOF;
+  }
+
+  if (ntab > BMM_COL_MTAB) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Too many tables");
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  for (size_t itab = 0; itab < ntab; ++itab) {
+    struct bmm_col_tab *const tab = &schema->tab[itab];
+
+    if (nrem < BMM_MSG_NUMSIZE) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Schema too short");
+
+      return BMM_IO_READ_ERROR;
+    }
+
+    switch (bmm_msg_num_read(&tab->num, f, ptr)) {
+      case BMM_IO_READ_ERROR:
+        return BMM_IO_READ_ERROR;
+      case BMM_IO_READ_EOF:
+        return BMM_IO_READ_EOF;
+    }
+
+    nrem -= BMM_MSG_NUMSIZE;
+
+    switch (bmm_col_get_count(&tab->ncol, &nrem, swap, f, ptr)) {
+      case BMM_IO_READ_ERROR:
+        return BMM_IO_READ_ERROR;
+      case BMM_IO_READ_EOF:
+        return BMM_IO_READ_EOF;
+    }
+
+    if (tab->ncol > BMM_COL_MCOL) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Too many columns");
+
+      return BMM_IO_READ_ERROR;
+    }
+
+    for (size_t icol = 0; icol < tab->ncol; ++icol) {
+      struct bmm_col *const col = &tab->col[icol];
+
+      unsigned char type;
+      switch (bmm_col_get(col->name, BMM_COL_MNAME, &nrem, f, ptr)) {
+        case BMM_IO_READ_ERROR:
+          return BMM_IO_READ_ERROR;
+        case BMM_IO_READ_EOF:
+          return BMM_IO_READ_EOF;
+      }
+
+      switch (bmm_col_get(&type, sizeof type, &nrem, f, ptr)) {
+        case BMM_IO_READ_ERROR:
+          return BMM_IO_READ_ERROR;
+        case BMM_IO_READ_EOF:
+          return BMM_IO_READ_EOF;
+      }
+
+      switch (bmm_col_get_count(&col->n, &nrem, swap, f, ptr)) {
+        case BMM_IO_READ_ERROR:
+          return BMM_IO_READ_ERROR;
+        case BMM_IO_READ_EOF:
+          return BMM_IO_READ_EOF;
+      }
+
+      if (col->name[BMM_COL_MNAME - 1] != '\0' || type >= BMM_COL_NTYPE) {
+        BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Invalid column");
+
+        return BMM_IO_READ_ERROR;
+      }
+
+      col->type = (enum bmm_col_type) type;
+    }
+  }
+
+  if (nrem != 0) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Schema too long");
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  schema->ntab = ntab;
+
+  return BMM_IO_READ_SUCCESS;
+}
@@ -0,0 +1,167 @@
+/// Column-grouped payloads.
+///
+/// The payload of a table message begins with its number of rows and
+/// then holds its columns one after another,
+/// each of which has the same number of words of one type for every row.
+/// What the columns are is said by a schema message,
+/// which lists the name, type and number of words of every column
+/// of each table message it describes.
+/// Readers can thus take the columns they know by name and
+/// skip past the rest without knowing anything else about them.
+///
+///     | Schema
+///     | Number of Tables | Number | Number of Columns | Name | Type | Count
+///     | Table
+///     | Number of Rows | Column | Column | ...
+///
+/// The numbers of tables, columns, rows and words are 64-bit integers and
+/// the words in the columns are in the byte order of the message
+/// just like everything else in the payload.
+/// Names are padded with zero octets to `BMM_COL_MNAME` octets and
+/// types take one octet each.
+
+#ifndef BMM_COL_H
+#define BMM_COL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ext.h"
+#include "io.h"
+#include "msg.h"
+
+/// Number of octets in the name of a column,
+/// including the zero octet at its end.
+#define BMM_COL_MNAME 16
+
+/// Maximum number of columns in a table.
+#define BMM_COL_MCOL 64
+
+/// Maximum number of tables in a schema.
+#define BMM_COL_MTAB 4
+
+/// Types of the words in a column.
+enum bmm_col_type {
+  BMM_COL_TYPE_U8 = 0,
+  BMM_COL_TYPE_U16 = 1,
+  BMM_COL_TYPE_U32 = 2,
+  BMM_COL_TYPE_U64 = 3,
+  BMM_COL_TYPE_I32 = 4,
+  BMM_COL_TYPE_I64 = 5,
+  BMM_COL_TYPE_F64 = 6
+};
+
+/// Number of column types.
+#define BMM_COL_NTYPE 7
+
+/// This structure describes one column.
+struct bmm_col {
+  /// Name.
+  char name[BMM_COL_MNAME];
+  /// Type of the words.
+  enum bmm_col_type type;
+  /// Number of words per row.
+  size_t n;
+};
+
+/// This structure describes the columns of one table message.
+struct bmm_col_tab {
+  /// Number of the table message.
+  enum bmm_msg_num num;
+  /// Number of columns.
+  size_t ncol;
+  /// Columns in the order they appear in.
+  struct bmm_col col[BMM_COL_MCOL];
+};
+
+/// This structure describes every table message that is sent.
+struct bmm_col_schema {
+  /// Number of tables.
+  size_t ntab;
+  /// Tables.
+  struct bmm_col_tab tab[BMM_COL_MTAB];
+};
+
+/// This structure says where a reader wants a column to go.
+struct bmm_col_want {
+  /// Name.
+  char const *name;
+  /// Type of the words.
+  enum bmm_col_type type;
+  /// Number of words per row.
+  size_t n;
+  /// Buffer with room for every row.
+  void *buf;
+};
+
+/// Assuming `bmm_col_skipper f`, the call `f(n, ptr)`
+/// skips `n` bytes that are about to be read.
+/// The additional `ptr` can be used for passing in a closure.
+typedef enum bmm_io_read (*bmm_col_skipper)(size_t, void *);
+
+/// The call `bmm_col_size(type)`
+/// returns the number of bytes in each word of the type `type`.
+__attribute__ ((__const__))
+size_t bmm_col_size(enum bmm_col_type);
+
+/// The call `bmm_col_tab_def(tab, num)`
+/// starts describing the table message `num` in `tab`.
+__attribute__ ((__nonnull__))
+void bmm_col_tab_def(struct bmm_col_tab *, enum bmm_msg_num);
+
+/// The call `bmm_col_tab_add(tab, name, type, n)`
+/// adds the column `name` with `n` words of the type `type` per row
+/// to the end of `tab`.
+/// The name must be shorter than `BMM_COL_MNAME` and
+/// the table must have room for the column.
+__attribute__ ((__nonnull__))
+void bmm_col_tab_add(struct bmm_col_tab *, char const *,
+    enum bmm_col_type, size_t);
+
+/// The call `bmm_col_tab_size(tab, nrow)`
+/// returns the size of the payload of the table message `tab`
+/// with `nrow` rows or `SIZE_MAX` if it would not fit.
+__attribute__ ((__nonnull__, __pure__))
+size_t bmm_col_tab_size(struct bmm_col_tab const *, size_t);
+
+/// The call `bmm_col_tab_read(tab, nrow, want, nwant, swap, f, g, ptr)`
+/// reads the columns of the table message `tab` with `nrow` rows
+/// by sequentially calling `f(buf, n, ptr)` and `g(n, ptr)`,
+/// putting each column that matches one of the `nwant` columns in `want`
+/// into its buffer and skipping the others.
+/// Columns that are wanted but missing are left as they were.
+/// If `swap` is set, the words are converted to the other byte order.
+/// The number of rows must already have been read.
+__attribute__ ((__nonnull__ (1, 6, 7)))
+enum bmm_io_read bmm_col_tab_read(struct bmm_col_tab const *, size_t,
+    struct bmm_col_want const *, size_t, bool,
+    bmm_msg_reader, bmm_col_skipper, void *);
+
+/// The call `bmm_col_schema_find(schema, num)`
+/// returns the description of the table message `num` in `schema`
+/// or `NULL` if there is none.
+__attribute__ ((__nonnull__, __pure__))
+struct bmm_col_tab const *bmm_col_schema_find(struct bmm_col_schema const *,
+    enum bmm_msg_num);
+
+/// The call `bmm_col_schema_size(schema)`
+/// returns the size of the payload of the schema message `schema`.
+__attribute__ ((__nonnull__, __pure__))
+size_t bmm_col_schema_size(struct bmm_col_schema const *);
+
+/// The call `bmm_col_schema_write(schema, f, ptr)`
+/// writes the payload of the schema message `schema`
+/// by sequentially calling `f(buf, n, ptr)`.
+__attribute__ ((__nonnull__ (1, 2)))
+bool bmm_col_schema_write(struct bmm_col_schema const *,
+    bmm_msg_writer, void *);
+
+/// The call `bmm_col_schema_read(schema, size, swap, f, ptr)`
+/// reads the payload of size `size` of a schema message into `schema`
+/// by sequentially calling `f(buf, n, ptr)`.
+/// If `swap` is set, the integers are converted to the other byte order.
+__attribute__ ((__nonnull__ (1, 4)))
+enum bmm_io_read bmm_col_schema_read(struct bmm_col_schema *, size_t, bool,
+    bmm_msg_reader, void *);
+
+#endif
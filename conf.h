@@ -31,9 +31,53 @@
 /// This may not be adjustable without other changes.
 #define BMM_MCHARID 64
 
-/// Maximum number of particles.
+/// Maximum number of particles in fixed-size buffers.
+/// The simulation itself grows its storage as necessary,
+/// but some exporters and viewers are still bounded by this.
 #define BMM_MPART 4096
 
+/// Alignment of particle columns in bytes.
+/// This should be at least the width of the widest vector register.
+#define BMM_ALIGN 64
+
+/// Size of a transparent huge page in bytes.
+/// Particle columns at least this large are aligned to it,
+/// so that they can be backed by huge pages when requested.
+#define BMM_HUGE 2097152
+
+/// Maximum number of threads.
+#define BMM_MTHREAD 256
+
+/// Maximum number of blocks that sums over particles are split into.
+/// Each block is summed in order and the blocks are then summed pairwise,
+/// so the result does not depend on the number of threads.
+#define BMM_MSUM 256
+
+/// Maximum number of output frames in flight.
+#define BMM_MFRAME 4
+
+/// Maximum number of subscribers to published output.
+#define BMM_MSUB 8
+
+/// Maximum number of additional outputs for a filter.
+#define BMM_MTEE 8
+
+/// Maximum number of analysis plugins.
+#define BMM_MPLUG 8
+
+/// Maximum number of centroids in a quantile sketch.
+#define BMM_MSKETCH 512
+
+/// Compression of quantile sketches,
+/// which bounds the number of centroids that survive compressing.
+#define BMM_CSKETCH 200.0
+
+/// Number of quantiles reported for each sketch.
+#define BMM_NQUANT 7
+
+/// Maximum number of bytes of high-priority messages in flight.
+#define BMM_MPRIO 65536
+
 /// Maximum number of directed contacts per particle.
 #define BMM_MCONTACT 8
 
@@ -43,8 +87,19 @@
 /// Maximum number of neighbor cells per dimension.
 #define BMM_MCELL 32
 
-/// Maximum number of particles per neighbor cell.
-#define BMM_MGROUP 128
+/// Maximum number of levels in hierarchical neighbor grids.
+#define BMM_MLEVEL 4
+
+/// Maximum number of neighbor cells per dimension
+/// on each level of hierarchical neighbor grids.
+#define BMM_MLCELL 128
+
+/// Whether neighbor searches compare distances in single precision.
+/// Positions, forces and energies stay in double precision regardless.
+/// This can be set when building with `make PRECISION=mixed`.
+#ifndef BMM_MIXED
+#define BMM_MIXED 0
+#endif
 
 /// Maximum number of message numbers.
 /// This is not adjustable without other changes.
@@ -59,4 +114,30 @@
 /// Maximum number of histogram bins.
 #define BMM_MBIN 1024
 
+/// Number of cutoffs to try when tuning the neighbor cache.
+#define BMM_NTUNE 5
+
+/// Number of logarithmic bins in fragment size histograms.
+#define BMM_NFRAGBIN 32
+
+/// Relative change of an activity indicator between output frames
+/// above which adaptive output speeds up.
+#define BMM_CADENCEHI 0.25
+
+/// Relative change of every activity indicator between output frames
+/// below which adaptive output slows down.
+#define BMM_CADENCELO 0.03125
+
+/// Fraction of strong contacts yielding between output frames
+/// above which adaptive output speeds up.
+#define BMM_CADENCEYIELD 0.00390625
+
+/// Fraction of the wall clock time spent waiting for the consumer
+/// above which adaptive output slows down regardless of activity.
+#define BMM_CADENCEWAIT 0.125
+
+/// Number of bytes after which a container block
+/// is closed before the next frame.
+#define BMM_MBLOCK 1048576
+
 #endif
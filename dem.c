@@ -1,33 +1,251 @@
+#include <errno.h>
+#include <float.h>
 #include <gsl/gsl_rng.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <math.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #ifdef _GNU_SOURCE
 #include <fenv.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
 #endif
 
 // Apologies for the horrible mess that this file became.
 
+#include "aio.h"
+#include "col.h"
 #include "common.h"
 #include "conf.h"
 #include "cpp.h"
 #include "dem.h"
+#include "endy.h"
 #include "fp.h"
 #include "geom.h"
 #include "geom2d.h"
 #include "io.h"
 #include "ival.h"
+#include "kde.h"
 #include "kernel.h"
 #include "msg.h"
 #include "neigh.h"
+#include "plug.h"
+#include "pub.h"
 #include "random.h"
+#include "sec.h"
 #include "sig.h"
+#include "sketch.h"
 #include "tle.h"
+#include "trace.h"
+#include "zip.h"
+
+/// The preprocessor directive `BMM_DEM_ALIGNED(ptr)`
+/// promises the compiler that the particle column `ptr`
+/// is aligned to `BMM_ALIGN` bytes.
+#ifdef __GNUC__
+#define BMM_DEM_ALIGNED(ptr) (__builtin_assume_aligned((ptr), BMM_ALIGN))
+#else
+#define BMM_DEM_ALIGNED(ptr) (ptr)
+#endif
+
+/// The call `bmm_dem_regrow(dem, ptr, nmemb, nnew, size)`
+/// tries to move the array `ptr`
+/// from `nmemb` members of size `size` into a new array of `nnew` members
+/// that is aligned to `BMM_ALIGN` bytes
+/// and zero the new members.
+/// The threads of the simulation `dem` touch the new array
+/// in the same contiguous blocks they work on particles in,
+/// so that each page ends up on the memory node of its thread,
+/// although arrays smaller than `BMM_HUGE` bytes are touched by one thread.
+/// Large arrays are also backed by huge pages if so requested.
+/// If the operation is successful,
+/// the new array is returned and `ptr` is freed.
+/// Otherwise `NULL` is returned and `ptr` is left untouched.
+__attribute__ ((__nonnull__ (1), __warn_unused_result__))
+static void *bmm_dem_regrow(struct bmm_dem const *const dem, void *const ptr,
+    size_t const nmemb, size_t const nnew, size_t const size) {
+  if (nnew > SIZE_MAX / size) {
+    errno = ENOMEM;
+
+    return NULL;
+  }
+
+  size_t const nbuf = nnew * size;
+  bool const huge = dem->opts.thread.huge && nbuf >= BMM_HUGE;
+
+  void *buf;
+  int const nerr = posix_memalign(&buf, huge ? BMM_HUGE : BMM_ALIGN, nbuf);
+  if (nerr != 0) {
+    errno = nerr;
+
+    return NULL;
+  }
+
+#ifdef MADV_HUGEPAGE
+  // This is only advice, so failing to follow it is not an error.
+  if (huge)
+    (void) madvise(buf, nbuf / BMM_HUGE * BMM_HUGE, MADV_HUGEPAGE);
+#endif
+
+  unsigned char *const dst = buf;
+  unsigned char const *const src = ptr;
+  size_t const nthread = dem->opts.thread.n;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) num_threads((int) nthread) \
+  if (nbuf >= BMM_HUGE)
+#endif
+  for (size_t ithread = 0; ithread < nthread; ++ithread) {
+    size_t const imin = ithread * nnew / nthread;
+    size_t const imax = (ithread + 1) * nnew / nthread;
+    size_t const icpy = $(bmm_max, size_t)(imin,
+        $(bmm_min, size_t)(imax, nmemb));
+
+    if (icpy != imin)
+      (void) memcpy(&dst[imin * size], &src[imin * size],
+          (icpy - imin) * size);
+
+    (void) memset(&dst[icpy * size], 0, (imax - icpy) * size);
+  }
+
+  free(ptr);
+
+  return buf;
+}
+
+/// The call `bmm_dem_le(dem)`
+/// checks whether the Lees--Edwards boundary conditions
+/// are in effect in the simulation `dem`.
+__attribute__ ((__nonnull__, __pure__))
+static bool bmm_dem_le(struct bmm_dem const *const dem) {
+  return dem->opts.box.per[0] && dem->opts.box.per[1] &&
+    (dem->le.v != 0.0 || dem->le.x != 0.0);
+}
+
+/// The call `bmm_dem_nacc(dem)`
+/// returns the number of force accumulators in the simulation `dem`.
+__attribute__ ((__nonnull__, __pure__))
+static size_t bmm_dem_nacc(struct bmm_dem const *const dem) {
+  return dem->opts.thread.nacc == 0 ? dem->opts.thread.n :
+    dem->opts.thread.nacc;
+}
+
+/// The call `bmm_dem_pdiff(xdiff, dem, x0, x1)`
+/// sets the vector `xdiff` to the periodic difference
+/// between the vectors `x0` and `x1`
+/// in the bounding box of the simulation `dem`
+/// and returns the number of periodic images it crossed
+/// along the y-axis.
+/// Relative velocities need to be corrected by the same amount
+/// with `bmm_dem_vdiff`.
+__attribute__ ((__nonnull__))
+static double bmm_dem_pdiff(double *restrict const xdiff,
+    struct bmm_dem const *restrict const dem,
+    double const *restrict const x0, double const *restrict const x1) {
+  return bmm_geom2d_lecpdiff(xdiff, x0, x1,
+      dem->opts.box.x, dem->opts.box.per, dem->le.x);
+}
+
+/// The call `bmm_dem_sqrt(dem, x)`
+/// returns the square root of `x` as precisely as
+/// the nonlinear contact laws of the simulation `dem` need it.
+__attribute__ ((__nonnull__, __pure__))
+static inline double bmm_dem_sqrt(struct bmm_dem const *const dem,
+    double const x) {
+  return dem->nonlin.nsqrt == SIZE_MAX ? sqrt(x) :
+    bmm_fp_fsqrt(x, dem->nonlin.nsqrt);
+}
+
+/// The call `bmm_dem_pdist2(dem, x0, x1)`
+/// returns the periodic distance $r^2$
+/// between the vectors `x0` and `x1`
+/// in the bounding box of the simulation `dem`.
+__attribute__ ((__nonnull__, __pure__))
+static double bmm_dem_pdist2(struct bmm_dem const *restrict const dem,
+    double const *restrict const x0, double const *restrict const x1) {
+  return bmm_geom2d_lecpdist2(x0, x1,
+      dem->opts.box.x, dem->opts.box.per, dem->le.x);
+}
+
+/// The call `bmm_dem_vdiff(vdiff, dem, v0, v1, k)`
+/// sets the vector `vdiff` to the difference
+/// between the velocities `v0` and `v1`
+/// of particles that are `k` periodic images apart along the y-axis
+/// in the simulation `dem`.
+__attribute__ ((__nonnull__))
+static void bmm_dem_vdiff(double *restrict const vdiff,
+    struct bmm_dem const *restrict const dem,
+    double const *restrict const v0, double const *restrict const v1,
+    double const k) {
+  bmm_geom2d_diff(vdiff, v0, v1);
+
+  vdiff[0] -= k * dem->le.v;
+}
+
+/// The call `bmm_dem_wrap(dem, ipart)`
+/// wraps the position of the particle `ipart`
+/// along the periodic dimensions of the simulation `dem`.
+/// Crossing the y-axis boundary under the Lees--Edwards boundary conditions
+/// also shifts the position and velocity along the x-axis.
+__attribute__ ((__nonnull__))
+static void bmm_dem_wrap(struct bmm_dem *const dem, size_t const ipart) {
+  if (bmm_dem_le(dem)) {
+    double const k = floor(dem->part.x[ipart][1] / dem->opts.box.x[1]);
+
+    if (k != 0.0) {
+      dem->part.x[ipart][0] -= k * dem->le.x;
+      dem->part.v[ipart][0] -= k * dem->le.v;
+    }
+  }
+
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    if (dem->opts.box.per[idim])
+      dem->part.x[ipart][idim] = $(bmm_uwrap, double)(dem->part.x[ipart][idim],
+          dem->opts.box.x[idim]);
+}
+
+/// The call `bmm_dem_cont_bit(jpart)`
+/// returns the bit of the contact target `jpart` in contact signatures.
+__attribute__ ((__const__))
+static uint64_t bmm_dem_cont_bit(size_t const jpart) {
+  return (uint64_t) 1 << (jpart % 64);
+}
+
+/// The call `bmm_dem_cont_sign(dem, ict, ipart)`
+/// recomputes the signature of the contacts of type `ict`
+/// from the particle `ipart` in the simulation `dem`.
+__attribute__ ((__nonnull__))
+static void bmm_dem_cont_sign(struct bmm_dem *const dem,
+    enum bmm_dem_ct const ict, size_t const ipart) {
+  uint64_t sig = 0;
+
+  for (size_t icont = 0; icont < dem->pair[ict].cont.src[ipart].n; ++icont)
+    sig |= bmm_dem_cont_bit(dem->pair[ict].cont.src[ipart].itgt[icont]);
+
+  dem->pair[ict].cont.src[ipart].sig = sig;
+}
 
 void bmm_dem_opts_set_rnew(struct bmm_dem_opts *const opts,
     double const *const rnew) {
@@ -54,64 +272,126 @@ void bmm_dem_opts_set_rnew(struct bmm_dem_opts *const opts,
   }
 }
 
+void bmm_dem_opts_set_dcutoff(struct bmm_dem_opts *const opts,
+    double const dcutoff) {
+  opts->cache.dcutoff = dcutoff;
+
+  // Fewer and larger cells than would fit are still correct.
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+    size_t const nghost = opts->box.per[idim] ? 0 : 2;
+
+    opts->cache.ncell[idim] = $(bmm_min, size_t)($(bmm_max, size_t)(3,
+          (size_t) (opts->box.x[idim] / dcutoff)) + nghost, BMM_MCELL);
+  }
+}
+
 __attribute__ ((__nonnull__))
 void bmm_dem_est_vdc(double *const pv, struct bmm_dem const *const dem) {
   for (size_t idim = 0; idim < BMM_NDIM; ++idim)
     pv[idim] = 0.0;
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    if (dem->part.role[ipart] == BMM_DEM_ROLE_DRIVEN)
+  for (size_t ipart = bmm_dem_role_begin(dem, BMM_DEM_ROLE_DRIVEN);
+      ipart < bmm_dem_role_end(dem, BMM_DEM_ROLE_DRIVEN); ++ipart)
+    if (dem->cache.parted ||
+        dem->part.role[ipart] == BMM_DEM_ROLE_DRIVEN)
       for (size_t idim = 0; idim < BMM_NDIM; ++idim)
         pv[idim] += dem->part.v[ipart][idim];
 
   for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    pv[idim] /= (double) dem->script.state.crunch.ndrive;
+    pv[idim] /= (double) dem->part.nrole[BMM_DEM_ROLE_DRIVEN];
+
+  // The top wall takes the place of the driven particles.
+  if (dem->wall.on)
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      pv[idim] = dem->wall.v[BMM_DEM_WALL_TOP][idim];
 }
 
-__attribute__ ((__nonnull__, __pure__))
-double bmm_dem_est_epotext(struct bmm_dem const *const dem) {
-  double e = 0.0;
+/// The call `bmm_dem_sum(dem, term, cls)`
+/// returns the sum of `term(dem, ipart, cls)` over the particles `ipart`
+/// of the simulation `dem`.
+/// The particles are split into at most `BMM_MSUM` contiguous blocks,
+/// whose sizes only depend on the number of particles.
+/// The blocks are summed in order over `opts.thread.n` threads
+/// and their sums are then added up pairwise,
+/// so the result does not depend on the number of threads.
+__attribute__ ((__nonnull__ (1, 2)))
+static double bmm_dem_sum(struct bmm_dem const *const dem,
+    double (*const term)(struct bmm_dem const *, size_t, void const *),
+    void const *const cls) {
+  size_t const npart = dem->part.n;
+  size_t const nblock = $(bmm_min, size_t)(npart, BMM_MSUM);
+
+  double e[BMM_MSUM];
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) \
+  num_threads((int) dem->opts.thread.n)
+#endif
+  for (size_t iblock = 0; iblock < nblock; ++iblock) {
+    double eblock = 0.0;
+
+    for (size_t ipart = iblock * npart / nblock;
+        ipart < (iblock + 1) * npart / nblock; ++ipart)
+      eblock += term(dem, ipart, cls);
 
+    e[iblock] = eblock;
+  }
+
+  return bmm_fp_psum(e, nblock);
+}
+
+__attribute__ ((__nonnull__ (1), __pure__))
+static double bmm_dem_est_epotext_one(struct bmm_dem const *const dem,
+    size_t const ipart, void const *const cls) {
   switch (dem->ext.tag) {
     case BMM_DEM_EXT_HARM:
-      for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-        e += (1.0 / 2.0) * dem->ext.params.harm.k * $(bmm_power, double)
-          (dem->opts.box.x[1] / 2.0 - dem->part.x[ipart][1], 2);
-
-      break;
+      return (1.0 / 2.0) * dem->ext.params.harm.k * $(bmm_power, double)
+        (dem->opts.box.x[1] / 2.0 - dem->part.x[ipart][1], 2);
     case BMM_DEM_EXT_GRAVY:
-      for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-        e += dem->ext.params.gravy.g * dem->part.m[ipart] *
-          (dem->opts.box.x[1] / 2.0 - dem->part.x[ipart][1]);
-
-      break;
-    case BMM_DEM_EXT_DRIVE:
-      break;
+      return dem->ext.params.gravy.g * dem->part.m[ipart] *
+        (dem->opts.box.x[1] / 2.0 - dem->part.x[ipart][1]);
   }
 
-  return e;
+  return 0.0;
 }
 
 __attribute__ ((__nonnull__, __pure__))
-double bmm_dem_est_eklin(struct bmm_dem const *const dem) {
+double bmm_dem_est_epotext(struct bmm_dem const *const dem) {
+  switch (dem->ext.tag) {
+    case BMM_DEM_EXT_HARM:
+    case BMM_DEM_EXT_GRAVY:
+      return bmm_dem_sum(dem, bmm_dem_est_epotext_one, NULL);
+  }
+
+  return 0.0;
+}
+
+__attribute__ ((__nonnull__ (1), __pure__))
+static double bmm_dem_est_eklin_one(struct bmm_dem const *const dem,
+    size_t const ipart, void const *const cls) {
   double e = 0.0;
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-      e += dem->part.m[ipart] *
-        $(bmm_power, double)(dem->part.v[ipart][idim], 2);
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    e += dem->part.m[ipart] *
+      $(bmm_power, double)(dem->part.v[ipart][idim], 2);
 
-  return (1.0 / 2.0) * e;
+  return e;
 }
 
 __attribute__ ((__nonnull__, __pure__))
-double bmm_dem_est_ekrot(struct bmm_dem const *const dem) {
-  double e = 0.0;
+double bmm_dem_est_eklin(struct bmm_dem const *const dem) {
+  return (1.0 / 2.0) * bmm_dem_sum(dem, bmm_dem_est_eklin_one, NULL);
+}
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    e += dem->cache.j[ipart] * $(bmm_power, double)(dem->part.omega[ipart], 2);
+__attribute__ ((__nonnull__ (1), __pure__))
+static double bmm_dem_est_ekrot_one(struct bmm_dem const *const dem,
+    size_t const ipart, void const *const cls) {
+  return dem->cache.j[ipart] * $(bmm_power, double)(dem->part.omega[ipart], 2);
+}
 
-  return (1.0 / 2.0) * e;
+__attribute__ ((__nonnull__, __pure__))
+double bmm_dem_est_ekrot(struct bmm_dem const *const dem) {
+  return (1.0 / 2.0) * bmm_dem_sum(dem, bmm_dem_est_ekrot_one, NULL);
 }
 
 __attribute__ ((__nonnull__, __pure__))
@@ -120,8 +400,8 @@ double bmm_dem_est_econt_one(struct bmm_dem const *const dem,
   double e = 0.0;
 
   double xdiffij[BMM_NDIM];
-  bmm_geom2d_cpdiff(xdiffij, dem->part.x[jpart], dem->part.x[ipart],
-      dem->opts.box.x, dem->opts.box.per);
+  double const kij = bmm_dem_pdiff(xdiffij, dem,
+      dem->part.x[jpart], dem->part.x[ipart]);
 
   double const d2 = bmm_geom2d_norm2(xdiffij);
   if (d2 == 0.0)
@@ -144,12 +424,12 @@ double bmm_dem_est_econt_one(struct bmm_dem const *const dem,
   bmm_geom2d_rperp(xtangij, xnormij);
 
   double vdiffij[BMM_NDIM];
-  bmm_geom2d_diff(vdiffij, dem->part.v[jpart], dem->part.v[ipart]);
+  bmm_dem_vdiff(vdiffij, dem, dem->part.v[jpart], dem->part.v[ipart], kij);
 
   double const xi = r - d;
   double const vnormij = -bmm_geom2d_dot(vdiffij, xnormij);
   double const reff = $(bmm_resum2, double)(ri, rj);
-  double const dt = dem->opts.script.dt[dem->script.i];
+  double const dt = dem->script.dt;
 
   double fnorm = 0.0;
 
@@ -180,7 +460,7 @@ double bmm_dem_est_econt_one(struct bmm_dem const *const dem,
       break;
     case BMM_DEM_NORM_BSHP:
       {
-        double const more = dem->est.bshpp * sqrt(reff * xi);
+        double const more = dem->est.bshpp * bmm_dem_sqrt(dem, reff * xi);
 
         if (dem->pair[ict].cohesive) {
           fnorm = more * (xi + dem->pair[ict].norm.params.viscoel.a * vnormij);
@@ -262,22 +542,29 @@ double bmm_dem_est_econt_one(struct bmm_dem const *const dem,
   return e;
 }
 
-// Conservative part only.
 __attribute__ ((__nonnull__, __pure__))
-double bmm_dem_est_econt(struct bmm_dem const *const dem,
-    enum bmm_dem_ct const ict) {
+static double bmm_dem_est_econt_src(struct bmm_dem const *const dem,
+    size_t const ipart, void const *const cls) {
+  enum bmm_dem_ct const ict = *(enum bmm_dem_ct const *) cls;
+
   double e = 0.0;
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    for (size_t icont = 0; icont < dem->pair[ict].cont.src[ipart].n; ++icont) {
-      size_t const jpart = dem->pair[ict].cont.src[ipart].itgt[icont];
+  for (size_t icont = 0; icont < dem->pair[ict].cont.src[ipart].n; ++icont) {
+    size_t const jpart = dem->pair[ict].cont.src[ipart].itgt[icont];
 
-      e += bmm_dem_est_econt_one(dem, ict, ipart, icont, jpart);
-    }
+    e += bmm_dem_est_econt_one(dem, ict, ipart, icont, jpart);
+  }
 
   return e;
 }
 
+// Conservative part only.
+__attribute__ ((__nonnull__, __pure__))
+double bmm_dem_est_econt(struct bmm_dem const *const dem,
+    enum bmm_dem_ct const ict) {
+  return bmm_dem_sum(dem, bmm_dem_est_econt_src, &ict);
+}
+
 size_t bmm_dem_script_addstage(struct bmm_dem_opts *const opts) {
   size_t const istage = opts->script.n;
 
@@ -289,6 +576,11 @@ size_t bmm_dem_script_addstage(struct bmm_dem_opts *const opts) {
   opts->script.mode[istage] = BMM_DEM_MODE_IDLE;
   opts->script.tspan[istage] = 0.0;
   opts->script.dt[istage] = 0.0;
+  opts->script.conv[istage].nstep = 0;
+  opts->script.conv[istage].nwin = 1;
+  opts->script.conv[istage].ek = 0.0;
+  opts->script.conv[istage].dmueff = 0.0;
+  opts->script.conv[istage].dncont = 0.0;
 
   return istage;
 }
@@ -297,15 +589,108 @@ bool bmm_dem_script_ongoing(struct bmm_dem const *const dem) {
   return dem->script.i < dem->opts.script.n;
 }
 
+/// The call `bmm_dem_script_ncont(dem)`
+/// returns the number of contacts of every type
+/// in the simulation `dem`.
+__attribute__ ((__nonnull__, __pure__))
+static size_t bmm_dem_script_ncont(struct bmm_dem const *const dem) {
+  size_t n = 0;
+
+  for (size_t ict = 0; ict < BMM_NCT; ++ict)
+    for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+      n += dem->pair[ict].cont.src[ipart].n;
+
+  return n;
+}
+
+/// The call `bmm_dem_script_conv(dem)`
+/// checks the convergence criteria of the current stage
+/// in the simulation `dem` if a check is due and
+/// returns whether they have held over enough checks.
+/// The checks are consecutive, so any one that fails starts them over.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_script_conv(struct bmm_dem *const dem) {
+  size_t const nstep = dem->opts.script.conv[dem->script.i].nstep;
+
+  if (nstep == 0 || dem->time.istep % nstep != 0)
+    return false;
+
+  double const ek = dem->opts.script.conv[dem->script.i].ek;
+  double const dmueff = dem->opts.script.conv[dem->script.i].dmueff;
+  double const dncont = dem->opts.script.conv[dem->script.i].dncont;
+
+  if (ek != 0.0 && (dem->part.n == 0 ||
+        bmm_dem_est_eklin(dem) + bmm_dem_est_ekrot(dem) >
+        ek * (double) dem->part.n)) {
+    dem->script.conv.n = 0;
+
+    return false;
+  }
+
+  double const mueff = dmueff != 0.0 ? dem->est.mueff : 0.0;
+  size_t const ncont = dncont != 0.0 ? bmm_dem_script_ncont(dem) : 0;
+
+  if (!isfinite(mueff)) {
+    dem->script.conv.n = 0;
+
+    return false;
+  }
+
+  if (dem->script.conv.n == 0) {
+    dem->script.conv.mueff[0] = 0.0;
+    dem->script.conv.mueff[1] = 0.0;
+    dem->script.conv.ncont[0] = ncont;
+    dem->script.conv.ncont[1] = ncont;
+  }
+
+  ++dem->script.conv.n;
+  dem->script.conv.mueff[0] += mueff;
+  dem->script.conv.mueff[1] += $(bmm_power, double)(mueff, 2);
+  dem->script.conv.ncont[0] = $(bmm_min, size_t)(dem->script.conv.ncont[0],
+      ncont);
+  dem->script.conv.ncont[1] = $(bmm_max, size_t)(dem->script.conv.ncont[1],
+      ncont);
+
+  size_t const nwin = dem->opts.script.conv[dem->script.i].nwin;
+
+  if (dem->script.conv.n < nwin)
+    return false;
+
+  double const n = (double) dem->script.conv.n;
+  double const mean = dem->script.conv.mueff[0] / n;
+  double const var = $(bmm_max, double)(0.0,
+      dem->script.conv.mueff[1] / n - $(bmm_power, double)(mean, 2));
+
+  if (dmueff != 0.0 && !(sqrt(var) <= dmueff)) {
+    dem->script.conv.n = 0;
+
+    return false;
+  }
+
+  if (dncont != 0.0 &&
+      (double) (dem->script.conv.ncont[1] - dem->script.conv.ncont[0]) >
+      dncont * (double) dem->script.conv.ncont[1]) {
+    dem->script.conv.n = 0;
+
+    return false;
+  }
+
+  return true;
+}
+
 bool bmm_dem_script_trans(struct bmm_dem *const dem) {
   double const toff = dem->time.t - dem->script.tprev -
     dem->opts.script.tspan[dem->script.i];
 
-  if (toff >= 0.0) {
+  if (toff >= 0.0 || bmm_dem_script_conv(dem)) {
     dem->script.tprev = dem->time.t;
     dem->script.ttrans[dem->script.i] = dem->time.t;
     dem->script.toff[dem->script.i] = toff;
     ++dem->script.i;
+    dem->script.entered = false;
+    dem->script.conv.n = 0;
+
+    bmm_trace_mark(&dem->trace, 0, "stage");
 
     return bmm_dem_script_ongoing(dem);
   }
@@ -333,17 +718,37 @@ static void bmm_dem_cache_x(struct bmm_dem *const dem,
     dem->cache.x[ipart][idim] = dem->part.x[ipart][idim];
 }
 
+/// The call `bmm_dem_cache_corner(dem, idim, jcell)`
+/// returns the coordinate of the lower corner
+/// of the neighbor cells with the index `jcell` along the dimension `idim`
+/// in the simulation `dem`.
+/// The cells outside the box have corners outside the box too.
+__attribute__ ((__nonnull__, __pure__))
+static double bmm_dem_cache_corner(struct bmm_dem const *const dem,
+    size_t const idim, size_t const jcell) {
+  return ((double) jcell - 1.0) *
+    (dem->opts.box.x[idim] / (double) (dem->opts.cache.ncell[idim] - 2));
+}
+
 /// The call `bmm_dem_cache_ijcell(dem, ipart)`
 /// caches the neighbor cell index vector of the particle `ipart`
 /// in the simulation `dem`.
+/// When `BMM_MIXED` is set,
+/// the position relative to the neighbor cell is cached too.
 /// The positions need to be cached first
 /// by calling `bmm_dem_cache_x`.
 __attribute__ ((__nonnull__))
 static void bmm_dem_cache_ijcell(struct bmm_dem *const dem,
     size_t const ipart) {
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
     dem->cache.ijcell[ipart][idim] = bmm_fp_iclerp(dem->cache.x[ipart][idim],
         0.0, dem->opts.box.x[idim], 1, dem->opts.cache.ncell[idim] - 1);
+
+#if BMM_MIXED
+    dem->cache.xrel[ipart][idim] = (float) (dem->cache.x[ipart][idim] -
+        bmm_dem_cache_corner(dem, idim, dem->cache.ijcell[ipart][idim]));
+#endif
+  }
 }
 
 /// The call `bmm_dem_cache_icell(dem, ipart)`
@@ -358,3683 +763,10618 @@ static void bmm_dem_cache_icell(struct bmm_dem *const dem,
       BMM_NDIM, dem->opts.cache.ncell);
 }
 
-/// The call `bmm_dem_cache_clrparts(dem)`
-/// clears the neighbor cell index mapping cache
+/// The call `bmm_dem_cache_bin(dem, all)`
+/// caches the neighbor cell index mappings of all the particles
 /// in the simulation `dem`.
+/// If `all` is `true`,
+/// their positions and neighbor cell indices are cached first.
+/// Otherwise the ones that are already cached are used.
+///
+/// The particles are binned by a counting sort over `opts.thread.n` threads.
+/// Each thread counts the particles of its own chunk,
+/// the counts are turned into offsets with prefix sums and
+/// each thread then places the particles of its chunk.
+/// The static schedule gives every thread the same contiguous chunk
+/// in both passes,
+/// so each neighbor cell lists its particles in increasing order,
+/// just like with one thread.
 __attribute__ ((__nonnull__))
-static void bmm_dem_cache_clrparts(struct bmm_dem *const dem) {
-  for (size_t icell = 0; icell < nmembof(dem->cache.part); ++icell)
-    dem->cache.part[icell].n = 0;
-}
+static void bmm_dem_cache_bin(struct bmm_dem *const dem, bool const all) {
+  size_t const npart = dem->part.n;
+  size_t const ncell = nmembof(dem->cache.part);
+  size_t (*const nbin)[nmembof(dem->cache.part)] = dem->cache.nbin;
 
-/// The call `bmm_dem_cache_addpart(dem, ipart)`
-/// tries to cache the neighbor cell index mapping of the particle `ipart`
-/// in the simulation `dem`.
-/// If there is enough capacity and the operation is successful,
-/// `true` is returned.
-/// Otherwise `false` is returned and
-/// the previous neighbor relations are restored.
-/// The neighbor cell indices need to be cached first
-/// by calling `bmm_dem_cache_icell`.
-__attribute__ ((__nonnull__))
-static bool bmm_dem_cache_addpart(struct bmm_dem *const dem,
-    size_t const ipart) {
-  size_t const icell = dem->cache.icell[ipart];
+#ifdef _OPENMP
+#pragma omp parallel num_threads((int) dem->opts.thread.n)
+#endif
+  {
+#ifdef _OPENMP
+    size_t const ithread = (size_t) omp_get_thread_num();
+    size_t const nthread = (size_t) omp_get_num_threads();
+#else
+    size_t const ithread = 0;
+    size_t const nthread = 1;
+#endif
 
-  if (dem->cache.part[icell].n >= nmembof(dem->cache.part[icell].i)) {
-    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Neighbor cell capacity exceeded");
+    for (size_t icell = 0; icell < ncell; ++icell)
+      nbin[ithread][icell] = 0;
 
-    return false;
-  }
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (size_t ipart = 0; ipart < npart; ++ipart) {
+      if (all) {
+        bmm_dem_cache_j(dem, ipart);
+        bmm_dem_cache_x(dem, ipart);
+        bmm_dem_cache_ijcell(dem, ipart);
+        bmm_dem_cache_icell(dem, ipart);
+      }
 
-  dem->cache.part[icell].i[dem->cache.part[icell].n] = ipart;
-  ++dem->cache.part[icell].n;
+      ++nbin[ithread][dem->cache.icell[ipart]];
+    }
 
-  return true;
-}
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (size_t icell = 0; icell < ncell; ++icell) {
+      size_t n = 0;
+      for (size_t jthread = 0; jthread < nthread; ++jthread) {
+        size_t const m = nbin[jthread][icell];
+        nbin[jthread][icell] = n;
+        n += m;
+      }
 
-/// The call `bmm_dem_cache_eligible(dem, ipart, jpart)`
-/// checks whether the particles `ipart` and `jpart` are eligible neighbors
-/// in the simulation `dem`.
-/// The neighbor cell indices need to be cached first
-/// by calling `bmm_dem_cache_icell`.
-/// Note that this function is neither symmetric nor reflexive
-/// with respect to particle indices.
-__attribute__ ((__nonnull__, __pure__))
-static bool bmm_dem_cache_eligible(struct bmm_dem const *const dem,
-    size_t const ipart, size_t const jpart) {
-  if (dem->cache.icell[ipart] == dem->cache.icell[jpart] && jpart <= ipart)
-    return false;
+      dem->cache.part[icell].n = n;
+    }
 
-  if (bmm_geom2d_cpdist2(dem->cache.x[ipart], dem->cache.x[jpart],
-        dem->opts.box.x, dem->opts.box.per) >
-      $(bmm_power, double)(dem->opts.cache.dcutoff, 2))
-    return false;
+#ifdef _OPENMP
+#pragma omp single
+#endif
+    {
+      size_t i = 0;
+      for (size_t icell = 0; icell < ncell; ++icell) {
+        dem->cache.part[icell].i = i;
+        i += dem->cache.part[icell].n;
+      }
+    }
 
-  return true;
-}
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (size_t ipart = 0; ipart < npart; ++ipart) {
+      size_t const icell = dem->cache.icell[ipart];
 
-/// The call `bmm_dem_cache_clrneighs(dem)`
-/// clears the neighbor cache
-/// in the simulation `dem`.
-__attribute__ ((__nonnull__))
-static void bmm_dem_cache_clrneighs(struct bmm_dem *const dem) {
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    dem->cache.neigh[ipart].n = 0;
+      dem->cache.ipart[dem->cache.part[icell].i + nbin[ithread][icell]] =
+        ipart;
+      ++nbin[ithread][icell];
+    }
+  }
 }
 
-// The procedures `bmm_dem_cache_addfrom` and `bmm_dem_cache_addto`
-// are identical except for those parts that are marked
-// covariant or contravariant with respect to particle indices.
-
-/// The call `bmm_dem_cache_addfrom(dem, ipart, mask)`
-/// tries to add all the eligible particles
-/// inside the `mask`-masked neighborhood
-/// of the particle `ipart` to its neighbors
-/// in the simulation `dem`.
-/// If there is enough capacity and the operation is successful,
-/// `true` is returned.
-/// Otherwise `false` is returned and
-/// the cache is left in an undefined state.
-/// The neighbor cell index mappings need to be cached first
-/// by calling `bmm_dem_cache_addpart`.
-__attribute__ ((__nonnull__))
-static bool bmm_dem_cache_addfrom(struct bmm_dem *const dem,
-    size_t const ipart, int const mask) {
-  size_t const nneigh = bmm_neigh_ncpij(dem->cache.ijcell[ipart],
-      BMM_NDIM, dem->opts.cache.ncell, dem->opts.box.per, mask);
-
-  for (size_t ineigh = 0; ineigh < nneigh; ++ineigh) {
-    size_t const icell = bmm_neigh_icpij(dem->cache.ijcell[ipart], ineigh,
-        BMM_NDIM, dem->opts.cache.ncell, dem->opts.box.per, mask);
+/// The call `bmm_dem_cache_hilbert(ijcell, nside)`
+/// returns the distance of the neighbor cell `ijcell`
+/// along the Hilbert curve that fills a square of `nside` by `nside` cells.
+/// The side `nside` must be a power of two.
+__attribute__ ((__nonnull__, __pure__))
+static size_t bmm_dem_cache_hilbert(size_t const *const ijcell,
+    size_t const nside) {
+  static_assert(BMM_NDIM == 2, "Unsupported number of dimensions");
 
-    for (size_t igroup = 0; igroup < dem->cache.part[icell].n; ++igroup) {
-      size_t const jpart = dem->cache.part[icell].i[igroup];
+  size_t x = ijcell[0];
+  size_t y = ijcell[1];
+  size_t d = 0;
 
-      // This block is covariant.
-      if (bmm_dem_cache_eligible(dem, ipart, jpart)) {
-        if (dem->cache.neigh[ipart].n >= nmembof(dem->cache.neigh[ipart].i)) {
-          BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Neighbor capacity exceeded");
+  for (size_t s = nside / 2; s > 0; s /= 2) {
+    size_t const rx = (x & s) != 0;
+    size_t const ry = (y & s) != 0;
 
-          return false;
-        }
+    d += s * s * ((3 * rx) ^ ry);
 
-        dem->cache.neigh[ipart].i[dem->cache.neigh[ipart].n] = jpart;
-        ++dem->cache.neigh[ipart].n;
+    if (ry == 0) {
+      if (rx == 1) {
+        x = nside - 1 - x;
+        y = nside - 1 - y;
       }
+
+      $(bmm_swap, size_t)(&x, &y);
     }
   }
 
-  return true;
+  return d;
 }
 
-/// The call `bmm_dem_cache_addto(dem, ipart)`
-/// tries to add the particle `ipart` to the neighbors
-/// of all the eligible particles
-/// inside its `mask`-masked neighborhood
-/// in the simulation `dem`.
-/// If there is enough capacity and the operation is successful,
-/// `true` is returned.
-/// Otherwise `false` is returned and
-/// the cache is left in an undefined state.
-/// The neighbor cell index mappings need to be cached first
-/// by calling `bmm_dem_cache_addpart`.
+/// The call `bmm_dem_permute(dem, perm, iperm, npart)`
+/// moves the particle `perm[ipart]` of the simulation `dem`
+/// to the index `ipart` for each `ipart` less than `npart`,
+/// where `iperm` is the inverse of `perm`
+/// with `SIZE_MAX` for the particles that are left out.
+/// All the particle state moves along, including labels,
+/// and contacts are remapped to keep their sources before their targets,
+/// except for those with the particles that are left out.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+/// The number of particles is not changed and
+/// the caller is responsible for making sure that
+/// no particle ends up with more contacts than there is room for.
 __attribute__ ((__nonnull__))
-static bool bmm_dem_cache_addto(struct bmm_dem *const dem,
-    size_t const ipart, int const mask) {
-  size_t const nneigh = bmm_neigh_ncpij(dem->cache.ijcell[ipart],
-      BMM_NDIM, dem->opts.cache.ncell, dem->opts.box.per, mask);
+static bool bmm_dem_permute(struct bmm_dem *const dem,
+    size_t const *restrict const perm, size_t const *restrict const iperm,
+    size_t const npart) {
+  // Difference frames only make sense
+  // if every index still refers to the same particle.
+  dem->comm.ikey = 0;
+
+  if (npart == 0)
+    return true;
 
-  for (size_t ineigh = 0; ineigh < nneigh; ++ineigh) {
-    size_t const icell = bmm_neigh_icpij(dem->cache.ijcell[ipart], ineigh,
-        BMM_NDIM, dem->opts.cache.ncell, dem->opts.box.per, mask);
+  void *const buf = malloc(npart * sizeof *dem->pair[0].cont.src);
+  if (buf == NULL) {
+    BMM_TLE_STDS();
 
-    for (size_t igroup = 0; igroup < dem->cache.part[icell].n; ++igroup) {
-      size_t const jpart = dem->cache.part[icell].i[igroup];
+    return false;
+  }
 
-      // This block is contravariant.
-      if (bmm_dem_cache_eligible(dem, jpart, ipart)) {
-        if (dem->cache.neigh[jpart].n >= nmembof(dem->cache.neigh[jpart].i)) {
-          BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Neighbor capacity exceeded");
+#define PERMUTE(x) \
+  begin \
+    for (size_t ipart = 0; ipart < npart; ++ipart) \
+      (void) memcpy(&((unsigned char *) buf)[ipart * sizeof *(x)], \
+          &(x)[perm[ipart]], sizeof *(x)); \
+    \
+    (void) memcpy((x), buf, npart * sizeof *(x)); \
+  end
+
+  PERMUTE(dem->part.l);
+  PERMUTE(dem->part.role);
+  PERMUTE(dem->part.r);
+  PERMUTE(dem->part.m);
+  PERMUTE(dem->part.jred);
+  PERMUTE(dem->part.x);
+  PERMUTE(dem->part.v);
+  PERMUTE(dem->part.a);
+  PERMUTE(dem->part.phi);
+  PERMUTE(dem->part.omega);
+  PERMUTE(dem->part.alpha);
+  PERMUTE(dem->part.f);
+  PERMUTE(dem->part.tau);
+  PERMUTE(dem->sleep.asleep);
+  PERMUTE(dem->sleep.poke);
+  PERMUTE(dem->sleep.nquiet);
+  PERMUTE(dem->sleep.fref);
+  PERMUTE(dem->clump.ibody);
+  PERMUTE(dem->clump.d);
+  PERMUTE(dem->clump.dphi);
+  PERMUTE(dem->clump.nlink);
 
-          return false;
-        }
+  switch (dem->integ.tag) {
+    case BMM_DEM_INTEG_VELVET:
+      PERMUTE(dem->integ.params.velvet.ao);
+      PERMUTE(dem->integ.params.velvet.alphao);
+
+      break;
+    case BMM_DEM_INTEG_BEEMAN:
+    case BMM_DEM_INTEG_KURAEV:
+      PERMUTE(dem->integ.params.beeman.ao);
+      PERMUTE(dem->integ.params.beeman.aoo);
+      PERMUTE(dem->integ.params.beeman.alphao);
+      PERMUTE(dem->integ.params.beeman.alphaoo);
+
+      break;
+    case BMM_DEM_INTEG_RESPA:
+      PERMUTE(dem->integ.params.respa.f);
+      PERMUTE(dem->integ.params.respa.tau);
 
-        dem->cache.neigh[jpart].i[dem->cache.neigh[jpart].n] = ipart;
-        ++dem->cache.neigh[jpart].n;
+      break;
+  }
+
+#undef PERMUTE
+
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict) {
+    __typeof__ (dem->pair[ict].cont.src) const src = buf;
+
+    for (size_t ipart = 0; ipart < npart; ++ipart) {
+      src[ipart].n = 0;
+      src[ipart].sig = 0;
+    }
+
+    for (size_t ipart = 0; ipart < npart; ++ipart) {
+      size_t const iold = perm[ipart];
+
+      for (size_t icont = 0; icont < dem->pair[ict].cont.src[iold].n; ++icont) {
+        size_t const jpart = iperm[dem->pair[ict].cont.src[iold].itgt[icont]];
+        if (jpart == SIZE_MAX)
+          continue;
+
+        // Contacts that would now point backwards are turned around.
+        bool const flip = jpart < ipart;
+        size_t const ksrc = flip ? jpart : ipart;
+        size_t const kcont = src[ksrc].n;
+
+        src[ksrc].itgt[kcont] = flip ? ipart : jpart;
+        src[ksrc].sig |= bmm_dem_cont_bit(src[ksrc].itgt[kcont]);
+        src[ksrc].drest[kcont] = dem->pair[ict].cont.src[iold].drest[icont];
+        src[ksrc].psirest[kcont][BMM_DEM_END_TAIL] =
+          dem->pair[ict].cont.src[iold].psirest[icont]
+          [flip ? BMM_DEM_END_HEAD : BMM_DEM_END_TAIL];
+        src[ksrc].psirest[kcont][BMM_DEM_END_HEAD] =
+          dem->pair[ict].cont.src[iold].psirest[icont]
+          [flip ? BMM_DEM_END_TAIL : BMM_DEM_END_HEAD];
+        src[ksrc].strength[kcont] =
+          dem->pair[ict].cont.src[iold].strength[icont];
+        src[ksrc].tfat[kcont] = dem->pair[ict].cont.src[iold].tfat[icont];
+        ++src[ksrc].n;
       }
     }
+
+    (void) memcpy(dem->pair[ict].cont.src, src, npart * sizeof *src);
   }
 
+  free(buf);
+
   return true;
 }
 
-bool bmm_dem_cache_build(struct bmm_dem *const dem) {
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    bmm_dem_cache_j(dem, ipart);
-
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    bmm_dem_cache_x(dem, ipart);
+/// The call `bmm_dem_role_rank(role)`
+/// returns the position of the role `role`
+/// in the order that particles are partitioned in.
+/// Driven particles go before fixed ones,
+/// so that the particles that move form one contiguous range.
+__attribute__ ((__const__))
+static size_t bmm_dem_role_rank(enum bmm_dem_role const role) {
+  static size_t const rank[BMM_DEM_NROLE] = {
+    [BMM_DEM_ROLE_FREE] = 0,
+    [BMM_DEM_ROLE_DRIVEN] = 1,
+    [BMM_DEM_ROLE_FIXED] = 2
+  };
+
+  return rank[role];
+}
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    bmm_dem_cache_ijcell(dem, ipart);
+/// The call `bmm_dem_role_parted(dem)`
+/// checks whether the particles of the simulation `dem`
+/// are partitioned by their roles.
+__attribute__ ((__nonnull__, __pure__))
+static bool bmm_dem_role_parted(struct bmm_dem const *const dem) {
+  for (size_t ipart = 1; ipart < dem->part.n; ++ipart)
+    if (bmm_dem_role_rank(dem->part.role[ipart - 1]) >
+        bmm_dem_role_rank(dem->part.role[ipart]))
+      return false;
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    bmm_dem_cache_icell(dem, ipart);
+  return true;
+}
 
-  bmm_dem_cache_clrparts(dem);
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    if (!bmm_dem_cache_addpart(dem, ipart))
-      return false;
+/// The call `bmm_dem_cache_reorder(dem)`
+/// tries to permute the particles of the simulation `dem`
+/// to partition them by their roles and,
+/// within each role,
+/// along the Hilbert curve of their neighbor cells
+/// or in the order of their neighbor cells,
+/// so that particles that are close in space are also close in memory.
+/// Particles with the same role in the same neighbor cell
+/// keep their relative order.
+/// All the particle state moves along, including labels,
+/// and contacts are remapped to keep their sources before their targets.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+/// If remapping the contacts would exceed their capacity,
+/// the particles are left in their old order and
+/// the operation is still considered successful.
+///
+/// This overwrites the neighbor cache,
+/// which needs to be rebuilt afterwards by calling `bmm_dem_cache_bin`
+/// with `all` set.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_cache_reorder(struct bmm_dem *const dem) {
+  static_assert((BMM_MCELL & (BMM_MCELL - 1)) == 0,
+      "Neighbor cell count not a power of two");
 
-  bmm_dem_cache_clrneighs(dem);
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    if (!bmm_dem_cache_addfrom(dem, ipart, BMM_NEIGH_MASK_UPPERH))
-      return false;
+  size_t const npart = dem->part.n;
 
-  dem->cache.stale = false;
+  if (npart == 0)
+    return true;
 
-  return true;
-}
+  size_t nside = 1;
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    while (nside < dem->opts.cache.ncell[idim])
+      nside *= 2;
 
-size_t bmm_dem_search_cont(struct bmm_dem const *const dem,
-    enum bmm_dem_ct const ict, size_t const ipart, size_t const jpart) {
-  for (size_t icont = 0; icont < dem->pair[ict].cont.src[ipart].n; ++icont) {
-    size_t const kpart = dem->pair[ict].cont.src[ipart].itgt[icont];
+  bool const spatial = dem->opts.cache.reorder != BMM_DEM_ORDER_NONE;
+  bool const hilbert = dem->opts.cache.reorder == BMM_DEM_ORDER_HILBERT;
 
-    if (kpart == jpart)
-      return icont;
+  // Each role gets its own block of spatial keys.
+  size_t const nkey = !spatial ? 1 : hilbert ? nside * nside :
+    $(bmm_prod, size_t)(dem->opts.cache.ncell, BMM_NDIM);
+  size_t const nrank = BMM_DEM_NROLE * nkey;
+
+  size_t *const noff = malloc(nrank * sizeof *noff);
+  if (noff == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
   }
 
-  return SIZE_MAX;
-}
+  // The cell indices serve as sort keys and
+  // the packed cell column as the permutation.
+  size_t *const key = dem->cache.icell;
+  size_t *const perm = dem->cache.ipart;
 
-size_t bmm_dem_addcont_unsafe(struct bmm_dem *const dem,
-    enum bmm_dem_ct const ict, size_t const ipart, size_t const jpart) {
-  size_t const icont = dem->pair[ict].cont.src[ipart].n;
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    size_t ikey = 0;
 
-  if (icont >= BMM_MCONTACT)
-    return SIZE_MAX;
+    if (spatial) {
+      bmm_dem_cache_x(dem, ipart);
+      bmm_dem_cache_ijcell(dem, ipart);
 
-  ++dem->pair[ict].cont.src[ipart].n;
+      if (hilbert)
+        ikey = bmm_dem_cache_hilbert(dem->cache.ijcell[ipart], nside);
+      else {
+        bmm_dem_cache_icell(dem, ipart);
+        ikey = dem->cache.icell[ipart];
+      }
+    }
 
-  double xdiffij[BMM_NDIM];
-  bmm_geom2d_cpdiff(xdiffij, dem->part.x[jpart], dem->part.x[ipart],
-      dem->opts.box.x, dem->opts.box.per);
+    key[ipart] = bmm_dem_role_rank(dem->part.role[ipart]) * nkey + ikey;
+  }
 
-  double const d = bmm_geom2d_norm(xdiffij);
-  double const r = dem->part.r[ipart] + dem->part.r[jpart];
+  for (size_t irank = 0; irank < nrank; ++irank)
+    noff[irank] = 0;
 
-  double const lambdaij = bmm_geom2d_dir(xdiffij);
-  double const lambdaji = $(bmm_swrap, double)(lambdaij + M_PI, M_2PI);
-  double const phii = dem->part.phi[ipart];
-  double const phij = dem->part.phi[jpart];
-  double const psii = phii - lambdaij;
-  double const psij = phij - lambdaji;
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    ++noff[key[ipart]];
 
-  dem->pair[ict].cont.src[ipart].strength[icont] = bmm_random_get(dem->rng,
-      dem->opts.part.strnew);
+  size_t i = 0;
+  for (size_t irank = 0; irank < nrank; ++irank) {
+    size_t const n = noff[irank];
+    noff[irank] = i;
+    i += n;
+  }
 
-  dem->pair[ict].cont.src[ipart].drest[icont] = d;
-  dem->pair[ict].cont.src[ipart].itgt[icont] = jpart;
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    perm[noff[key[ipart]]] = ipart;
+    ++noff[key[ipart]];
+  }
 
-  dem->pair[ict].cont.src[ipart].psirest[icont][BMM_DEM_END_TAIL] = psii;
-  dem->pair[ict].cont.src[ipart].psirest[icont][BMM_DEM_END_HEAD] = psij;
+  free(noff);
 
-  // Not used.
-  dem->pair[ict].cont.src[ipart].tfat[icont] = 6;
+  // The keys are no longer needed, so they make room for the inverse.
+  size_t *const iperm = key;
 
-  double const e = bmm_dem_est_econt_one(dem, ict, ipart, icont, jpart);
-  dem->est.ebond += e;
-  if (ict == BMM_DEM_CT_WEAK)
-    dem->est.ewcont += e;
-  else
-    dem->est.escont += e;
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    iperm[perm[ipart]] = ipart;
 
-  // TODO Really?
-  // dem->cache.stale = true;
+  size_t *const ncont = malloc(npart * sizeof *ncont);
+  if (ncont == NULL) {
+    BMM_TLE_STDS();
 
-  return icont;
-}
+    return false;
+  }
 
-size_t bmm_dem_addcont(struct bmm_dem *const dem,
-    enum bmm_dem_ct const ict, size_t const ipart, size_t const jpart) {
-  // TODO Does this ever fail?
-  // dynamic_assert(ipart < jpart, "Yes");
-  if (ipart < jpart)
-    return bmm_dem_addcont_unsafe(dem, ict, ipart, jpart);
-  else
-    return bmm_dem_addcont_unsafe(dem, ict, jpart, ipart);
-}
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict) {
+    for (size_t ipart = 0; ipart < npart; ++ipart)
+      ncont[ipart] = 0;
 
-/// The call `bmm_dem_copycont(dem, ipart, icont, jcont)`
-/// reassigns the contact `jcont` to `icont` for the particle `ipart`.
-__attribute__ ((__nonnull__))
-static void bmm_dem_copycont(struct bmm_dem *const dem,
-    enum bmm_dem_ct const ict, size_t const ipart, size_t const icont, size_t const jcont) {
-  dem->pair[ict].cont.src[ipart].itgt[icont] = dem->pair[ict].cont.src[ipart].itgt[jcont];
+    for (size_t ipart = 0; ipart < npart; ++ipart)
+      for (size_t icont = 0; icont < dem->pair[ict].cont.src[ipart].n; ++icont) {
+        size_t const jpart = dem->pair[ict].cont.src[ipart].itgt[icont];
 
-  dem->pair[ict].cont.src[ipart].drest[icont] = dem->pair[ict].cont.src[ipart].drest[jcont];
+        ++ncont[$(bmm_min, size_t)(iperm[ipart], iperm[jpart])];
+      }
 
-  for (size_t iend = 0; iend < BMM_NEND; ++iend)
-    dem->pair[ict].cont.src[ipart].psirest[icont][iend] = dem->pair[ict].cont.src[ipart].psirest[jcont][iend];
+    for (size_t ipart = 0; ipart < npart; ++ipart)
+      if (ncont[ipart] > BMM_MCONTACT) {
+        free(ncont);
 
-  dem->pair[ict].cont.src[ipart].strength[icont] = dem->pair[ict].cont.src[ipart].strength[jcont];
+        return true;
+      }
+  }
 
-  dem->pair[ict].cont.src[ipart].tfat[icont] = dem->pair[ict].cont.src[ipart].tfat[jcont];
-}
+  free(ncont);
 
-void bmm_dem_remcont_unsafe(struct bmm_dem *const dem,
-    enum bmm_dem_ct const ict, size_t const ipart, size_t const icont, size_t const jpart) {
-  // fprintf(stderr, "Remove contact %zu out of %zu from %zu to %zu.\n", icont, dem->pair[ict].cont.src[ipart].n, ipart, jpart);
+  if (!bmm_dem_permute(dem, perm, iperm, npart))
+    return false;
 
-  --dem->pair[ict].cont.src[ipart].n;
+  // Fragments are found by following particle indices.
+  dem->frag.stale = true;
 
-  size_t const jcont = dem->pair[ict].cont.src[ipart].n;
+  return true;
+}
 
-  if (jcont != icont)
-    bmm_dem_copycont(dem, ict, ipart, icont, jcont);
+/// The call `bmm_dem_cache_sort(dem)`
+/// checks whether the binned particles of the simulation `dem`
+/// are in cell order and remembers the result.
+__attribute__ ((__nonnull__))
+static void bmm_dem_cache_sort(struct bmm_dem *const dem) {
+  dem->cache.sorted = dem->opts.cache.reorder == BMM_DEM_ORDER_CELL;
 
-  // TODO Really?
-  // dem->cache.stale = true;
+  if (dem->cache.sorted)
+    for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+      if (dem->cache.ipart[ipart] != ipart) {
+        dem->cache.sorted = false;
+
+        break;
+      }
 }
 
-void bmm_dem_remcont(struct bmm_dem *const dem,
-    enum bmm_dem_ct const ict, size_t apart, size_t bpart, size_t const icont) {
-  // TODO Does this ever fail?
-  // dynamic_assert(ipart < jpart, "Yes");
-  size_t const ipart = $(bmm_min, size_t)(apart, bpart);
-  size_t const jpart = $(bmm_max, size_t)(apart, bpart);
+/// The call `bmm_dem_cache_jpart(dem, icell, igroup)`
+/// returns the index of the particle `igroup`
+/// in the neighbor cell `icell` of the simulation `dem`.
+/// When the particles are in cell order,
+/// this is a plain offset without going through `ipart`.
+__attribute__ ((__nonnull__, __pure__))
+static size_t bmm_dem_cache_jpart(struct bmm_dem const *const dem,
+    size_t const icell, size_t const igroup) {
+  size_t const i = dem->cache.part[icell].i + igroup;
 
-  double const e = bmm_dem_est_econt_one(dem, ict, ipart, icont, jpart);
-  dem->est.eyieldis += e;
-  if (ict == BMM_DEM_CT_WEAK)
-    dem->est.ewcont -= e;
-  else
-    dem->est.escont -= e;
+  return dem->cache.sorted ? i : dem->cache.ipart[i];
+}
 
-  bmm_dem_remcont_unsafe(dem, ict, ipart, icont, jpart);
+/// The call `bmm_dem_cache_findle(dem, ipart, ineigh)`
+/// works like `bmm_dem_cache_findfrom`
+/// under the Lees--Edwards boundary conditions.
+/// Since the rows of neighbor cells across the y-axis boundary
+/// are offset from each other,
+/// the entire neighborhood is searched
+/// and each pair is only found from its lower index.
+__attribute__ ((__nonnull__ (1)))
+static size_t bmm_dem_cache_findle(struct bmm_dem const *const dem,
+    size_t const ipart, size_t *const ineigh) {
+  size_t n = 0;
+
+  size_t const *const ncell = dem->opts.cache.ncell;
+  double const *const xper = dem->opts.box.x;
+
+  for (size_t ioff = 0; ioff < 3; ++ioff) {
+    size_t const icell1 = dem->cache.ijcell[ipart][1] + ioff;
+    size_t const jcell1 = $(bmm_dec, size_t)(icell1, 1, ncell[1] - 1);
+
+    // The images of the rows across the boundary are shifted,
+    // so the window along the x-axis moves with them.
+    double const k = icell1 < 2 ? -1.0 : icell1 > ncell[1] - 1 ? 1.0 : 0.0;
+    double const x = $(bmm_uwrap, double)(dem->cache.x[ipart][0] -
+        k * dem->le.x, xper[0]);
+    size_t const kcell0 = bmm_fp_iclerp(x, 0.0, xper[0], 1, ncell[0] - 1);
+
+    for (size_t joff = 0; joff < 3; ++joff) {
+      size_t const jcell0 = $(bmm_dec, size_t)(kcell0 + joff, 1, ncell[0] - 1);
+
+      size_t const ijcell[] = {jcell0, jcell1};
+      size_t const icell = $(bmm_unhcd, size_t)(ijcell, BMM_NDIM, ncell);
+
+      for (size_t igroup = 0; igroup < dem->cache.part[icell].n; ++igroup) {
+        size_t const jpart = bmm_dem_cache_jpart(dem, icell, igroup);
+
+        if (jpart > ipart && bmm_dem_pdist2(dem,
+              dem->cache.x[ipart], dem->cache.x[jpart]) <=
+            $(bmm_power, double)(dem->opts.cache.dcutoff, 2)) {
+          if (ineigh != NULL)
+            ineigh[n] = jpart;
+
+          ++n;
+        }
+      }
+    }
+  }
+
+  return n;
 }
 
-// I broke this to only work with KV and BEAM.
-bool bmm_dem_yield_pair(struct bmm_dem *const dem,
-    size_t const ipart, size_t const jpart, size_t const icont) {
-  if (dem->part.role[ipart] != BMM_DEM_ROLE_FREE ||
-      dem->part.role[jpart] != BMM_DEM_ROLE_FREE)
-    return false;
+#if BMM_MIXED
 
-  size_t const ict = BMM_DEM_CT_STRONG;
+/// The call `bmm_dem_cache_mixed(dem)`
+/// checks whether neighbor searches in the simulation `dem`
+/// can walk over neighbor cells in single precision.
+/// This is the case when every periodic dimension has
+/// at least three cells inside the box,
+/// because then the image of each neighbor cell is unambiguous.
+__attribute__ ((__nonnull__, __pure__))
+static bool bmm_dem_cache_mixed(struct bmm_dem const *const dem) {
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    if (dem->opts.box.per[idim] && dem->opts.cache.ncell[idim] < 5)
+      return false;
 
-  double xdiffij[BMM_NDIM];
-  bmm_geom2d_cpdiff(xdiffij, dem->part.x[jpart], dem->part.x[ipart],
-      dem->opts.box.x, dem->opts.box.per);
+  return true;
+}
 
-  double const ri = dem->part.r[ipart];
-  double const rj = dem->part.r[jpart];
-  // double const r = ri + rj;
-  double const r = dem->pair[ict].cont.src[ipart].drest[icont];
-  double const r2 = $(bmm_power, double)(r, 2);
+/// The call `bmm_dem_cache_findmixed(dem, ipart, nneigh, icellneigh, ineigh)`
+/// works like `bmm_dem_cache_findfrom`
+/// over the neighborhood given by `nneigh` and `icellneigh`,
+/// but compares distances in single precision.
+/// Positions are taken relative to the corners of their neighbor cells
+/// and the offset between the corners is only resolved once per cell,
+/// so that rounding does not grow with the size of the box.
+/// The cutoff is padded by a few units of rounding
+/// to keep every neighbor that would be found in double precision.
+__attribute__ ((__nonnull__ (1, 3, 4)))
+static size_t bmm_dem_cache_findmixed(struct bmm_dem const *const dem,
+    size_t const ipart, size_t const *const nneigh,
+    size_t const (*const icellneigh)[BMM_NEIGH_NMAX(BMM_NDIM)],
+    size_t *const ineigh) {
+  size_t n = 0;
+
+  size_t const jcell = dem->cache.icell[ipart];
+  float const d2cutoff = (float) ($(bmm_power, double)(dem->opts.cache.dcutoff,
+        2) * (1.0 + 16.0 * FLT_EPSILON));
+
+  float d2[128];
+
+  for (size_t jneigh = 0; jneigh < nneigh[jcell]; ++jneigh) {
+    size_t const icell = icellneigh[jcell][jneigh];
+    size_t const ifirst = dem->cache.part[icell].i;
+    size_t const ngroup = dem->cache.part[icell].n;
+
+    size_t ijcell[BMM_NDIM];
+    $(bmm_hcd, size_t)(ijcell, icell, BMM_NDIM, dem->opts.cache.ncell);
+
+    float xoff[BMM_NDIM];
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+      double const x = bmm_dem_cache_corner(dem, idim, ijcell[idim]) -
+        bmm_dem_cache_corner(dem, idim, dem->cache.ijcell[ipart][idim]);
 
-  double const d2 = bmm_geom2d_norm2(xdiffij);
-  double const d = sqrt(d2);
+      xoff[idim] = (float) (dem->opts.box.per[idim] ?
+          $(bmm_swrap, double)(x, dem->opts.box.x[idim]) : x);
+    }
 
-  double xnormij[BMM_NDIM];
-  bmm_geom2d_scale(xnormij, xdiffij, 1.0 / d);
+    for (size_t ibatch = 0; ibatch < ngroup; ibatch += nmembof(d2)) {
+      size_t const nbatch = $(bmm_min, size_t)(ngroup - ibatch, nmembof(d2));
 
-  double xtangij[BMM_NDIM];
-  bmm_geom2d_rperp(xtangij, xnormij);
+      bmm_geom2d_offdist2fs(d2, dem->cache.xrel[ipart],
+          dem->cache.sorted ?
+          &dem->cache.xrel[ifirst + ibatch] : dem->cache.xrel,
+          dem->cache.sorted ? NULL : &dem->cache.ipart[ifirst + ibatch],
+          nbatch, xoff);
 
-  double vdiffij[BMM_NDIM];
-  bmm_geom2d_diff(vdiffij, dem->part.v[jpart], dem->part.v[ipart]);
+      for (size_t kbatch = 0; kbatch < nbatch; ++kbatch) {
+        size_t const jpart = bmm_dem_cache_jpart(dem, icell, ibatch + kbatch);
 
-  double const xi = r - d;
-  double const vnormij = -bmm_geom2d_dot(vdiffij, xnormij);
-  double const reff = $(bmm_resum2, double)(ri, rj);
-  double const dt = dem->opts.script.dt[dem->script.i];
+        if ((icell == jcell && jpart <= ipart) || d2[kbatch] > d2cutoff)
+          continue;
 
-  double const fnorm = dem->pair[ict].norm.params.dashpot.k * xi +
-    dem->pair[ict].norm.params.dashpot.gamma * vnormij;
+        if (ineigh != NULL)
+          ineigh[n] = jpart;
 
-  double const lambdaij = bmm_geom2d_dir(xdiffij);
-  double const lambdaji = $(bmm_swrap, double)(lambdaij + M_PI, M_2PI);
-  double const phii = dem->part.phi[ipart];
-  double const phij = dem->part.phi[jpart];
-  double const psii = phii - lambdaij;
-  double const psij = phij - lambdaji;
+        ++n;
+      }
+    }
+  }
 
-  double const dpsii = $(bmm_swrap, double)(psii - dem->pair[ict].cont.src[ipart].psirest[icont][BMM_DEM_END_TAIL], M_2PI);
-  double const dpsij = $(bmm_swrap, double)(psij - dem->pair[ict].cont.src[ipart].psirest[icont][BMM_DEM_END_HEAD], M_2PI);
+  return n;
+}
 
-  double zetai = dem->part.r[ipart] * dpsii;
-  double zetaj = dem->part.r[jpart] * dpsij;
+#endif
 
-  double const proj = bmm_geom2d_dot(xtangij, vdiffij) / d;
-  double const dzetai = ri * (dem->part.omega[ipart] - proj);
-  double const dzetaj = rj * (dem->part.omega[jpart] - proj);
+/// The call `bmm_dem_cache_findfrom(dem, ipart, mask, ineigh)`
+/// finds all the eligible particles
+/// inside the `mask`-masked neighborhood
+/// of the particle `ipart`
+/// in the simulation `dem` and returns their number.
+/// If `ineigh` is not `NULL`,
+/// their indices are also stored into it in order.
+/// The neighbor cell index mappings need to be cached first
+/// by calling `bmm_dem_cache_bin` and
+/// the neighborhoods tabulated by calling `bmm_dem_cache_stencil`.
+__attribute__ ((__nonnull__ (1)))
+static size_t bmm_dem_cache_findfrom(struct bmm_dem const *const dem,
+    size_t const ipart, int const mask, size_t *const ineigh) {
+  if (bmm_dem_le(dem))
+    return bmm_dem_cache_findle(dem, ipart, ineigh);
+
+  size_t n = 0;
+
+  size_t const *nneigh;
+  size_t const (*icellneigh)[BMM_NEIGH_NMAX(BMM_NDIM)];
+  switch (mask) {
+    case BMM_NEIGH_MASK_UPPERH:
+      nneigh = dem->cache.stencil.nupper;
+      icellneigh = dem->cache.stencil.iupper;
 
-  double const ftangconsi = dem->pair[ict].tang.params.beam.k * zetai;
-  double const ftangconsj = dem->pair[ict].tang.params.beam.k * zetaj;
+      break;
+    case BMM_NEIGH_MASK_LOWERH:
+      nneigh = dem->cache.stencil.nlower;
+      icellneigh = dem->cache.stencil.ilower;
 
-  double const ftangdissi = dem->pair[ict].tang.params.beam.dk * dzetai;
-  double const ftangdissj = dem->pair[ict].tang.params.beam.dk * dzetaj;
+      break;
+    default:
+      dynamic_assert(false, "Unsupported mask");
+  }
 
-  double const ftangi = ftangconsi + ftangdissi;
-  double const ftangj = ftangconsj + ftangdissj;
+#if BMM_MIXED
+  if (bmm_dem_cache_mixed(dem))
+    return bmm_dem_cache_findmixed(dem, ipart, nneigh, icellneigh, ineigh);
+#endif
 
-  double const taui = ri * ftangi;
-  double const tauj = rj * ftangj;
+  size_t const jcell = dem->cache.icell[ipart];
+  double const d2cutoff = $(bmm_power, double)(dem->opts.cache.dcutoff, 2);
 
-  double const ftang = (taui + tauj) / d;
+  // Distances are computed for a batch of candidates at a time,
+  // so that the periodic wrapping can be vectorized.
+  double d2[64];
 
-  double const fnormij = fnorm;
-  double const ftangij = $(bmm_abs, double)(ftang);
+  for (size_t jneigh = 0; jneigh < nneigh[jcell]; ++jneigh) {
+    size_t const icell = icellneigh[jcell][jneigh];
+    size_t const ifirst = dem->cache.part[icell].i;
+    size_t const ngroup = dem->cache.part[icell].n;
 
-  double const aij = M_PI * $(bmm_power, double)(
-      dem->pair[ict].cont.src[ipart].strength[icont] *
-      $(bmm_min, double)(dem->part.r[ipart], dem->part.r[jpart]), 2);
+    for (size_t ibatch = 0; ibatch < ngroup; ibatch += nmembof(d2)) {
+      size_t const nbatch = $(bmm_min, size_t)(ngroup - ibatch, nmembof(d2));
 
-  double const sigmanormij = fnormij / aij;
-  double const sigmatangij = ftangij / aij;
+      bmm_geom2d_lecpdist2s(d2, dem->cache.x[ipart],
+          dem->cache.sorted ? &dem->cache.x[ifirst + ibatch] : dem->cache.x,
+          dem->cache.sorted ? NULL : &dem->cache.ipart[ifirst + ibatch],
+          nbatch, dem->opts.box.x, dem->opts.box.per, dem->le.x);
 
-  double const sigmacrit = fnormij < 0.0 ?
-    dem->yield.params.ze.sigmacrit : dem->yield.params.ze.sigmacritt;
-  double const taucrit = fnormij < 0.0 ?
-    dem->yield.params.ze.taucrit : dem->yield.params.ze.taucritt;
+      for (size_t kbatch = 0; kbatch < nbatch; ++kbatch) {
+        size_t const jpart = bmm_dem_cache_jpart(dem, icell, ibatch + kbatch);
 
-  switch (dem->yield.tag) {
-    case BMM_DEM_YIELD_ZE:
-      if ($(bmm_power, double)(sigmanormij / sigmacrit, 2) +
-          $(bmm_power, double)(sigmatangij / taucrit, 2) > 1.0) {
-        bmm_dem_remcont(dem, ict, ipart, jpart, icont);
+        // Pairs in the same cell are only found from their lower index.
+        if ((icell == jcell && jpart <= ipart) || d2[kbatch] > d2cutoff)
+          continue;
 
-        return true;
-      }
+        if (ineigh != NULL)
+          ineigh[n] = jpart;
 
-      break;
+        ++n;
+      }
+    }
   }
 
-  return false;
+  return n;
 }
 
-void bmm_dem_analyze_pair(struct bmm_dem *const dem,
-    size_t const ipart, size_t const jpart) {
-  // TODO Settle these order problems.
-  if (ipart >= jpart) {
-    bmm_dem_analyze_pair(dem, jpart, ipart);
+/// The call `bmm_dem_cache_level_cell(dem, ilevel, x, ijcell)`
+/// stores into `ijcell` the index vector of the cell
+/// on the level `ilevel` of the simulation `dem`
+/// that the position `x` falls into.
+/// Positions outside the box end up in the cells on its edges.
+__attribute__ ((__nonnull__))
+static void bmm_dem_cache_level_cell(struct bmm_dem const *const dem,
+    size_t const ilevel, double const *const x, size_t *const ijcell) {
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+    size_t const ncell = dem->cache.level.ncell[ilevel][idim];
+    double const y = floor(x[idim] / dem->opts.box.x[idim] * (double) ncell);
 
-    return;
+    ijcell[idim] = y < 1.0 ? 0 :
+      y >= (double) (ncell - 1) ? ncell - 1 : (size_t) y;
   }
+}
 
-  bool weak = true;
-  size_t const icont = bmm_dem_search_cont(dem, BMM_DEM_CT_STRONG, ipart, jpart);
-  if (icont != SIZE_MAX)
-    weak = bmm_dem_yield_pair(dem, ipart, jpart, icont);
+/// The call `bmm_dem_cache_level_span(jcell, icell, ncell, per)`
+/// stores into `jcell` the distinct cells
+/// within one step of the cell `icell`
+/// along a dimension with `ncell` cells
+/// that is periodic if `per` is set and
+/// returns their number.
+__attribute__ ((__nonnull__))
+static size_t bmm_dem_cache_level_span(size_t *const jcell,
+    size_t const icell, size_t const ncell, bool const per) {
+  size_t n = 0;
+
+  for (size_t ioff = 0; ioff < 3; ++ioff) {
+    size_t kcell;
+    if (icell + ioff < 1) {
+      if (!per)
+        continue;
 
-  if (weak) {
-    double xdiffij[BMM_NDIM];
-    bmm_geom2d_cpdiff(xdiffij, dem->part.x[jpart], dem->part.x[ipart],
-        dem->opts.box.x, dem->opts.box.per);
+      kcell = ncell - 1;
+    } else if (icell + ioff - 1 >= ncell) {
+      if (!per)
+        continue;
 
-    double const d2 = bmm_geom2d_norm2(xdiffij);
-    double const r2 = $(bmm_power, double)(dem->part.r[ipart] + dem->part.r[jpart], 2);
-    bool const overlap = d2 < r2;
+      kcell = 0;
+    } else
+      kcell = icell + ioff - 1;
 
-    size_t const jcont = bmm_dem_search_cont(dem, BMM_DEM_CT_WEAK, ipart, jpart);
-    if (jcont != SIZE_MAX) {
-      if (!overlap)
-        bmm_dem_remcont(dem, BMM_DEM_CT_WEAK, ipart, jpart, jcont);
-    } else {
-      if (overlap)
-        bmm_dem_addcont(dem, BMM_DEM_CT_WEAK, ipart, jpart);
+    bool seen = false;
+    for (size_t i = 0; i < n; ++i)
+      if (jcell[i] == kcell)
+        seen = true;
+
+    if (!seen) {
+      jcell[n] = kcell;
+      ++n;
     }
   }
-}
 
-void bmm_dem_analyze(struct bmm_dem *const dem) {
-  switch (dem->cache.tag) {
-    case BMM_DEM_CACHE_NONE:
-      for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-        for (size_t jpart = ipart + 1; jpart < dem->part.n; ++jpart)
-          bmm_dem_analyze_pair(dem, ipart, jpart);
-
-      break;
-    case BMM_DEM_CACHE_NEIGH:
-      for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-        for (size_t ineigh = 0; ineigh < dem->cache.neigh[ipart].n; ++ineigh) {
-          size_t const jpart = dem->cache.neigh[ipart].i[ineigh];
+  return n;
+}
 
-          bmm_dem_analyze_pair(dem, ipart, jpart);
+/// The call `bmm_dem_cache_findlevel(dem, ipart, ineigh)`
+/// works like `bmm_dem_cache_findfrom`
+/// over the levels of neighbor cells in the simulation `dem`.
+/// The particle `ipart` finds the particles above it on its own level
+/// and every particle on the levels of larger particles,
+/// whose cells are wide enough to only need
+/// the cells next to it to be searched.
+/// Each pair is thus found exactly once,
+/// from the smaller particle or from the lower index.
+__attribute__ ((__nonnull__ (1)))
+static size_t bmm_dem_cache_findlevel(struct bmm_dem const *const dem,
+    size_t const ipart, size_t *const ineigh) {
+  static_assert(BMM_NDIM == 2, "Unsupported number of dimensions");
+
+  size_t n = 0;
+
+  size_t const ilevel = dem->cache.level.ilevel[ipart];
+  bool const le = bmm_dem_le(dem);
+
+  for (size_t jlevel = 0; jlevel <= ilevel; ++jlevel) {
+    size_t const *const ncell = dem->cache.level.ncell[jlevel];
+    double const d2cutoff = $(bmm_power, double)(dem->cache.level.reach[ilevel] +
+        dem->cache.level.reach[jlevel], 2);
+
+    size_t ijcell[BMM_NDIM];
+    bmm_dem_cache_level_cell(dem, jlevel, dem->cache.x[ipart], ijcell);
+
+    size_t jcell[BMM_NDIM][3];
+    size_t njcell[BMM_NDIM];
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      njcell[idim] = bmm_dem_cache_level_span(jcell[idim],
+          ijcell[idim], ncell[idim], dem->opts.box.per[idim]);
+
+    for (size_t i1 = 0; i1 < njcell[1]; ++i1) {
+      // The rows across the y-axis boundary slide past each other,
+      // so the whole row is searched instead of its nearest cells.
+      bool const slide = le && (ncell[1] < 3 ||
+          (jcell[1][i1] == 0 && ijcell[1] == ncell[1] - 1) ||
+          (jcell[1][i1] == ncell[1] - 1 && ijcell[1] == 0));
+      size_t const n0 = slide ? ncell[0] : njcell[0];
+
+      for (size_t i0 = 0; i0 < n0; ++i0) {
+        size_t const kjcell[] = {slide ? i0 : jcell[0][i0], jcell[1][i1]};
+        size_t const icell = dem->cache.level.ifirst[jlevel] +
+          $(bmm_unhcd, size_t)(kjcell, BMM_NDIM, ncell);
+
+        for (size_t igroup = 0; igroup < dem->cache.level.part[icell].n;
+            ++igroup) {
+          size_t const jpart = dem->cache.level.ipart[
+            dem->cache.level.part[icell].i + igroup];
+
+          if ((jlevel == ilevel && jpart <= ipart) ||
+              bmm_dem_pdist2(dem, dem->cache.x[ipart], dem->cache.x[jpart]) >
+              d2cutoff)
+            continue;
+
+          if (ineigh != NULL)
+            ineigh[n] = jpart;
+
+          ++n;
         }
+      }
+    }
+  }
 
-      break;
-  }
+  return n;
 }
 
-size_t bmm_dem_addpart(struct bmm_dem *const dem) {
-  size_t const ipart = dem->part.n;
+/// The call `bmm_dem_cache_level_bin(dem)`
+/// sorts the radii of the particles in the simulation `dem` into classes,
+/// lays out the levels of neighbor cells for them and
+/// bins the particles into the cells of their own levels.
+/// The positions need to be cached first
+/// by calling `bmm_dem_cache_x`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+///
+/// The radius classes halve from one level to the next,
+/// with the last level taking every particle that is smaller still.
+/// Each level reaches as far past its largest radius
+/// as the uniform cutoff reaches past the largest radius overall,
+/// so every particle may move just as far before the cache expires.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_cache_level_bin(struct bmm_dem *const dem) {
+  size_t const npart = dem->part.n;
+
+  double rmin = INFINITY;
+  double rmax = 0.0;
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    rmin = fmin(rmin, dem->part.r[ipart]);
+    rmax = fmax(rmax, dem->part.r[ipart]);
+  }
 
-  if (ipart >= BMM_MPART)
-    return SIZE_MAX;
+  double const dskin = fmax(0.0, dem->opts.cache.dcutoff / 2.0 - rmax);
 
-  ++dem->part.n;
-  dem->part.l[ipart] = dem->part.lnew;
-  ++dem->part.lnew;
+  size_t nlevel = 1;
+  while (nlevel < BMM_MLEVEL && rmin <= rmax / (double) ((size_t) 1 << nlevel))
+    ++nlevel;
 
-  dem->part.role[ipart] = BMM_DEM_ROLE_FREE;
-  dem->part.r[ipart] = 1.0;
-  dem->part.m[ipart] = 1.0;
-  dem->part.jred[ipart] = bmm_geom_ballprmoi(3);
+  dem->cache.level.n = nlevel;
 
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    dem->part.x[ipart][idim] = 0.0;
+  size_t ncell = 0;
+  for (size_t ilevel = 0; ilevel < nlevel; ++ilevel) {
+    double const reach = rmax / (double) ((size_t) 1 << ilevel) + dskin;
 
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    dem->part.v[ipart][idim] = 0.0;
+    dem->cache.level.reach[ilevel] = reach;
+    dem->cache.level.ifirst[ilevel] = ncell;
 
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    dem->part.a[ipart][idim] = 0.0;
+    // Cells need to be at least as wide as the cutoff on their own level.
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+      double const n = reach > 0.0 ?
+        floor(dem->opts.box.x[idim] / (2.0 * reach)) : (double) BMM_MLCELL;
 
-  dem->part.phi[ipart] = 0.0;
-  dem->part.omega[ipart] = 0.0;
-  dem->part.alpha[ipart] = 0.0;
+      dem->cache.level.ncell[ilevel][idim] = n < 1.0 ? 1 :
+        n > (double) BMM_MLCELL ? BMM_MLCELL : (size_t) n;
+    }
 
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    dem->part.f[ipart][idim] = 0.0;
+    ncell += $(bmm_prod, size_t)(dem->cache.level.ncell[ilevel], BMM_NDIM);
+  }
 
-  dem->part.tau[ipart] = 0.0;
+  dem->cache.level.ifirst[nlevel] = ncell;
 
-  switch (dem->integ.tag) {
-    case BMM_DEM_INTEG_BEEMAN:
-      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-        dem->integ.params.beeman.ao[ipart][idim] = 0.0;
+  if (ncell > dem->cache.level.ncap) {
+    void *const ptr = realloc(dem->cache.level.part,
+        ncell * sizeof *dem->cache.level.part);
+    if (ptr == NULL) {
+      BMM_TLE_STDS();
 
-      dem->integ.params.beeman.alphao[ipart] = 0.0;
+      return false;
+    }
 
-      break;
+    dem->cache.level.part = ptr;
+    dem->cache.level.ncap = ncell;
   }
 
-  dem->cache.stale = true;
+  for (size_t icell = 0; icell < ncell; ++icell)
+    dem->cache.level.part[icell].n = 0;
 
-  return ipart;
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    size_t ilevel = 0;
+    while (ilevel + 1 < nlevel &&
+        dem->part.r[ipart] <= rmax / (double) ((size_t) 2 << ilevel))
+      ++ilevel;
+
+    size_t ijcell[BMM_NDIM];
+    bmm_dem_cache_level_cell(dem, ilevel, dem->cache.x[ipart], ijcell);
+
+    size_t const icell = dem->cache.level.ifirst[ilevel] +
+      $(bmm_unhcd, size_t)(ijcell, BMM_NDIM, dem->cache.level.ncell[ilevel]);
+
+    dem->cache.level.ilevel[ipart] = ilevel;
+    dem->cache.level.icell[ipart] = icell;
+    ++dem->cache.level.part[icell].n;
+  }
+
+  size_t i = 0;
+  for (size_t icell = 0; icell < ncell; ++icell) {
+    dem->cache.level.part[icell].i = i;
+    i += dem->cache.level.part[icell].n;
+    dem->cache.level.part[icell].n = 0;
+  }
+
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    size_t const icell = dem->cache.level.icell[ipart];
+
+    dem->cache.level.ipart[dem->cache.level.part[icell].i +
+      dem->cache.level.part[icell].n] = ipart;
+    ++dem->cache.level.part[icell].n;
+  }
+
+  return true;
 }
 
-/// The call `bmm_dem_copypart(dem, ipart, jpart)`
-/// reassigns the particle `jpart` to `ipart`.
+/// The call `bmm_dem_cache_stencil(dem)`
+/// tabulates the neighborhoods of the neighbor cells
+/// in the simulation `dem`
+/// unless they are already tabulated for the current lattice.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
 __attribute__ ((__nonnull__))
-static void bmm_dem_copypart(struct bmm_dem *const dem,
-    size_t const ipart, size_t const jpart) {
-  dem->part.role[ipart] = dem->part.role[jpart];
-  dem->part.l[ipart] = dem->part.l[jpart];
-  dem->part.r[ipart] = dem->part.r[jpart];
-  dem->part.m[ipart] = dem->part.m[jpart];
-  dem->part.jred[ipart] = dem->part.jred[jpart];
-
+static bool bmm_dem_cache_stencil(struct bmm_dem *const dem) {
+  bool fresh = true;
   for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    dem->part.x[ipart][idim] = dem->part.x[jpart][idim];
+    if (dem->cache.stencil.ncell[idim] != dem->opts.cache.ncell[idim] ||
+        dem->cache.stencil.per[idim] != dem->opts.box.per[idim])
+      fresh = false;
 
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    dem->part.v[ipart][idim] = dem->part.v[jpart][idim];
+  if (fresh)
+    return true;
 
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    dem->part.a[ipart][idim] = dem->part.a[jpart][idim];
+  size_t const ncell = $(bmm_prod, size_t)(dem->opts.cache.ncell, BMM_NDIM);
 
-  dem->part.phi[ipart] = dem->part.phi[jpart];
-  dem->part.omega[ipart] = dem->part.omega[jpart];
-  dem->part.alpha[ipart] = dem->part.alpha[jpart];
+  if (ncell > dem->cache.stencil.ncap) {
+    size_t *const nupper = realloc(dem->cache.stencil.nupper,
+        ncell * sizeof *dem->cache.stencil.nupper);
+    if (nupper == NULL) {
+      BMM_TLE_STDS();
 
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    dem->part.f[ipart][idim] = dem->part.f[jpart][idim];
+      return false;
+    }
+    dem->cache.stencil.nupper = nupper;
 
-  dem->part.tau[ipart] = dem->part.tau[jpart];
+    size_t (*const iupper)[BMM_NEIGH_NMAX(BMM_NDIM)] =
+      realloc(dem->cache.stencil.iupper,
+          ncell * sizeof *dem->cache.stencil.iupper);
+    if (iupper == NULL) {
+      BMM_TLE_STDS();
 
-  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict) {
-    dem->pair[ict].cont.src[ipart].n = dem->pair[ict].cont.src[jpart].n;
+      return false;
+    }
+    dem->cache.stencil.iupper = iupper;
 
-    for (size_t icont = 0; icont < dem->pair[ict].cont.src[jpart].n; ++icont)
-      dem->pair[ict].cont.src[ipart].itgt[icont] = dem->pair[ict].cont.src[jpart].itgt[icont];
+    size_t *const nlower = realloc(dem->cache.stencil.nlower,
+        ncell * sizeof *dem->cache.stencil.nlower);
+    if (nlower == NULL) {
+      BMM_TLE_STDS();
 
-    for (size_t icont = 0; icont < dem->pair[ict].cont.src[jpart].n; ++icont)
-      dem->pair[ict].cont.src[ipart].drest[icont] = dem->pair[ict].cont.src[jpart].drest[icont];
+      return false;
+    }
+    dem->cache.stencil.nlower = nlower;
 
-    for (size_t icont = 0; icont < dem->pair[ict].cont.src[jpart].n; ++icont)
-      for (size_t iend = 0; iend < BMM_NEND; ++iend)
-        dem->pair[ict].cont.src[ipart].psirest[icont][iend] = dem->pair[ict].cont.src[jpart].psirest[icont][iend];
+    size_t (*const ilower)[BMM_NEIGH_NMAX(BMM_NDIM)] =
+      realloc(dem->cache.stencil.ilower,
+          ncell * sizeof *dem->cache.stencil.ilower);
+    if (ilower == NULL) {
+      BMM_TLE_STDS();
 
-    for (size_t icont = 0; icont < dem->pair[ict].cont.src[jpart].n; ++icont)
-      dem->pair[ict].cont.src[ipart].strength[icont] = dem->pair[ict].cont.src[jpart].strength[icont];
+      return false;
+    }
+    dem->cache.stencil.ilower = ilower;
 
-    for (size_t icont = 0; icont < dem->pair[ict].cont.src[jpart].n; ++icont)
-      dem->pair[ict].cont.src[ipart].tfat[icont] = dem->pair[ict].cont.src[jpart].tfat[icont];
+    dem->cache.stencil.ncap = ncell;
   }
-}
-
-void bmm_dem_rempart(struct bmm_dem *const dem,
-    size_t const ipart) {
-  --dem->part.n;
 
-  size_t const jpart = dem->part.n;
+  (void) bmm_neigh_ticp(dem->cache.stencil.nupper,
+      &dem->cache.stencil.iupper[0][0],
+      nmembof(dem->cache.stencil.iupper[0]),
+      BMM_NDIM, dem->opts.cache.ncell, dem->opts.box.per,
+      BMM_NEIGH_MASK_UPPERH);
+  (void) bmm_neigh_ticp(dem->cache.stencil.nlower,
+      &dem->cache.stencil.ilower[0][0],
+      nmembof(dem->cache.stencil.ilower[0]),
+      BMM_NDIM, dem->opts.cache.ncell, dem->opts.box.per,
+      BMM_NEIGH_MASK_LOWERH);
 
-  // TODO Go over particles that are in contact with this (N583) and
-  // update their associations (otherwise there will be dangling contacts).
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+    dem->cache.stencil.ncell[idim] = dem->opts.cache.ncell[idim];
+    dem->cache.stencil.per[idim] = dem->opts.box.per[idim];
+  }
 
-  if (jpart != ipart)
-    bmm_dem_copypart(dem, ipart, jpart);
+  return true;
 }
 
-void bmm_dem_force_creeping(struct bmm_dem *const dem,
-    size_t const ipart) {
-  double const v = bmm_geom2d_norm(dem->part.v[ipart]);
+/// The call `bmm_dem_cache_ghost(dem)`
+/// takes the periodic image of each cached neighbor
+/// in the simulation `dem`,
+/// so that the pair can be followed as a ghost image
+/// without searching for the nearest image again on every step.
+/// The images are oriented from the smaller particle index to the larger one,
+/// just like the contacts.
+/// The positions need to be cached first
+/// by calling `bmm_dem_cache_x`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_cache_ghost(struct bmm_dem *const dem) {
+  size_t const npart = dem->part.n;
+  size_t const ncap = dem->cache.ghost.ncap;
+  size_t const nneigh = dem->cache.nneigh;
+
+  if (nneigh > ncap) {
+    size_t const nnew = $(bmm_max, size_t)(nneigh,
+        ncap > SIZE_MAX / 2 ? SIZE_MAX : ncap * 2);
+
+    void *ptr = bmm_dem_regrow(dem, dem->cache.ghost.xoff,
+        ncap, nnew, sizeof *dem->cache.ghost.xoff);
+    if (ptr == NULL) {
+      BMM_TLE_STDS();
 
-  if (v == 0.0)
-    return;
+      return false;
+    }
+    dem->cache.ghost.xoff = ptr;
 
-  double vunit[BMM_NDIM];
-  bmm_geom2d_scale(vunit, dem->part.v[ipart], 1.0 / v);
+    ptr = bmm_dem_regrow(dem, dem->cache.ghost.kneigh,
+        ncap, nnew, sizeof *dem->cache.ghost.kneigh);
+    if (ptr == NULL) {
+      BMM_TLE_STDS();
 
-  double const f = -3.0 * M_2PI * dem->amb.params.creeping.eta *
-    dem->part.r[ipart] * v;
+      return false;
+    }
+    dem->cache.ghost.kneigh = ptr;
 
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    dem->part.f[ipart][idim] += f * vunit[idim];
+    dem->cache.ghost.ncap = nnew;
+  }
 
-  double const tau = -4.0 * M_2PI * dem->amb.params.creeping.eta *
-    $(bmm_power, double)(dem->part.r[ipart], 3);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) \
+  num_threads((int) dem->opts.thread.n)
+#endif
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    for (size_t ineigh = dem->cache.neigh[ipart].i;
+        ineigh < dem->cache.neigh[ipart].i + dem->cache.neigh[ipart].n;
+        ++ineigh) {
+      size_t const jpart = dem->cache.ineigh[ineigh];
+      size_t const kpart = $(bmm_min, size_t)(ipart, jpart);
+      size_t const lpart = $(bmm_max, size_t)(ipart, jpart);
+
+      double xdiff[BMM_NDIM];
+      dem->cache.ghost.kneigh[ineigh] = bmm_dem_pdiff(xdiff, dem,
+          dem->cache.x[lpart], dem->cache.x[kpart]);
 
-  dem->part.tau[ipart] += tau * dem->part.omega[ipart];
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+        dem->cache.ghost.xoff[ineigh][idim] = xdiff[idim] -
+          (dem->cache.x[lpart][idim] - dem->cache.x[kpart][idim]);
+    }
 
-  double const dt = dem->opts.script.dt[dem->script.i];
-  dem->est.eambdis += fabs(f * v * dt);
-  dem->est.eambdis += fabs((tau / dem->part.r[ipart]) * v * dt);
+  dem->cache.ghost.xle = dem->le.x;
+
+  return true;
 }
 
-// TODO Flatten these to allow loop-invariant code motion.
-void bmm_dem_force_ambient(struct bmm_dem *const dem, size_t const ipart) {
-  switch (dem->amb.tag) {
-    case BMM_DEM_AMB_FAXEN:
-      bmm_dem_force_creeping(dem, ipart);
+/// The call `bmm_dem_cache_ghost_move(dem)`
+/// follows the particles of the simulation `dem`
+/// continuously from their cached positions,
+/// so that the ghost images of their neighbors move along with them.
+/// This only takes one periodic difference per particle
+/// instead of one per neighbor.
+__attribute__ ((__nonnull__))
+static void bmm_dem_cache_ghost_move(struct bmm_dem *const dem) {
+  size_t const npart = dem->part.n;
 
-      break;
+  dem->cache.ghost.dle = bmm_dem_le(dem) ?
+    $(bmm_swrap, double)(dem->le.x - dem->cache.ghost.xle,
+        dem->opts.box.x[0]) : 0.0;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) \
+  num_threads((int) dem->opts.thread.n)
+#endif
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    double xdiff[BMM_NDIM];
+    dem->cache.ghost.k[ipart] = bmm_dem_pdiff(xdiff, dem,
+        dem->part.x[ipart], dem->cache.x[ipart]);
+
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      dem->cache.ghost.x[ipart][idim] =
+        dem->cache.x[ipart][idim] + xdiff[idim];
   }
 }
 
-void bmm_dem_force_unified(struct bmm_dem *const dem,
-    size_t const ipart, size_t const jpart, size_t const icont,
-    enum bmm_dem_ct const ict) {
-  double xdiffij[BMM_NDIM];
-  bmm_geom2d_cpdiff(xdiffij, dem->part.x[jpart], dem->part.x[ipart],
-      dem->opts.box.x, dem->opts.box.per);
+/// The call `bmm_dem_cache_pdiff(xdiff, dem, ipart, jpart, ineigh)`
+/// works like `bmm_dem_pdiff` on the positions
+/// of the particles `jpart` and `ipart` in the simulation `dem`.
+/// If ghost images are in use and `ineigh` is not `SIZE_MAX`,
+/// the cached neighbor `ineigh` is followed as a ghost image instead,
+/// which takes plain differences without any periodic wrapping.
+/// The ghost images need to be moved first
+/// by calling `bmm_dem_cache_ghost_move`.
+__attribute__ ((__nonnull__))
+static double bmm_dem_cache_pdiff(double *restrict const xdiff,
+    struct bmm_dem const *restrict const dem,
+    size_t const ipart, size_t const jpart, size_t const ineigh) {
+  if (!dem->opts.cache.ghost || ineigh == SIZE_MAX)
+    return bmm_dem_pdiff(xdiff, dem, dem->part.x[jpart], dem->part.x[ipart]);
 
-  double const d2 = bmm_geom2d_norm2(xdiffij);
-  if (d2 == 0.0)
-    return;
+  double const s = ipart < jpart ? 1.0 : -1.0;
+  double const kneigh = dem->cache.ghost.kneigh[ineigh];
 
-  double const ri = dem->part.r[ipart];
-  double const rj = dem->part.r[jpart];
-  double const r = ri + rj;
-  double const r2 = $(bmm_power, double)(r, 2);
-  if (!dem->pair[ict].cohesive)
-    if (d2 > r2)
-      return;
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    xdiff[idim] = dem->cache.ghost.x[jpart][idim] -
+      dem->cache.ghost.x[ipart][idim] +
+      s * dem->cache.ghost.xoff[ineigh][idim];
 
-  double const d = sqrt(d2);
+  // The images above the box have slid along since the offsets were taken.
+  xdiff[0] -= s * kneigh * dem->cache.ghost.dle;
 
-  double xnormij[BMM_NDIM];
-  bmm_geom2d_scale(xnormij, xdiffij, 1.0 / d);
+  return s * kneigh + dem->cache.ghost.k[jpart] - dem->cache.ghost.k[ipart];
+}
 
-  double xtangij[BMM_NDIM];
-  bmm_geom2d_rperp(xtangij, xnormij);
+bool bmm_dem_cache_build(struct bmm_dem *const dem) {
+  size_t const npart = dem->part.n;
 
-  double vdiffij[BMM_NDIM];
-  bmm_geom2d_diff(vdiffij, dem->part.v[jpart], dem->part.v[ipart]);
+  if (!bmm_dem_cache_stencil(dem))
+    return false;
 
-  double dxnorm = 0.0;
-  double dxtang = 0.0;
+  if (dem->opts.cache.reorder != BMM_DEM_ORDER_NONE ||
+      !bmm_dem_role_parted(dem)) {
+    if (!bmm_dem_cache_reorder(dem))
+      return false;
+  }
 
-  // Normal forces first.
+  // The loops over roles check each particle
+  // if there were too many contacts to reorder them.
+  dem->cache.parted = bmm_dem_role_parted(dem);
 
-  double fnorm = 0.0;
-  double fnormcons = 0.0;
-  double fnormdiss = 0.0;
+  bmm_dem_cache_bin(dem, true);
+  bmm_dem_cache_sort(dem);
 
-  {
-    double const xi = r - d;
-    double const vnormij = -bmm_geom2d_dot(vdiffij, xnormij);
-    double const reff = $(bmm_resum2, double)(ri, rj);
-    double const dt = dem->opts.script.dt[dem->script.i];
-    dxnorm = vnormij * dt;
+  bool const level = dem->cache.tag == BMM_DEM_CACHE_LEVEL;
 
-    switch (dem->pair[ict].norm.tag) {
-      case BMM_DEM_NORM_KV:
-        if (dem->pair[ict].cohesive) {
-          // double const r = ri + rj;
-          // Maybe.
-          double const r = dem->pair[ict].cont.src[ipart].drest[icont];
-          double const xi = r - d;
+  if (level && !bmm_dem_cache_level_bin(dem))
+    return false;
 
-          fnorm = dem->pair[ict].norm.params.dashpot.k * xi +
-            dem->pair[ict].norm.params.dashpot.gamma * vnormij;
+  // The neighbors are first counted and then found again,
+  // so that they can be packed together without gaps.
+  // Each particle only finds its own neighbors,
+  // because the upper half of the neighborhood is searched from it.
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) \
+  num_threads((int) dem->opts.thread.n)
+#endif
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    dem->cache.neigh[ipart].n = level ?
+      bmm_dem_cache_findlevel(dem, ipart, NULL) :
+      bmm_dem_cache_findfrom(dem, ipart, BMM_NEIGH_MASK_UPPERH, NULL);
+
+  size_t nneigh = 0;
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    dem->cache.neigh[ipart].i = nneigh;
+    nneigh += dem->cache.neigh[ipart].n;
+  }
 
-          fnormcons = dem->pair[ict].norm.params.dashpot.k * xi;
-          fnormdiss = dem->pair[ict].norm.params.dashpot.gamma * vnormij;
-        } else {
-          fnorm = $(bmm_max, double)(0.0,
-              dem->pair[ict].norm.params.dashpot.k * xi +
-              dem->pair[ict].norm.params.dashpot.gamma * vnormij);
+  if (!bmm_dem_cache_reserve(dem, nneigh))
+    return false;
 
-          if (0.0 > dem->pair[ict].norm.params.dashpot.k * xi +
-              dem->pair[ict].norm.params.dashpot.gamma * vnormij) {
-            fnormcons = 0.0;
-            fnormdiss = 0.0;
-          } else {
-            fnormcons = dem->pair[ict].norm.params.dashpot.k * xi;
-            fnormdiss = dem->pair[ict].norm.params.dashpot.gamma * vnormij;
-          }
-        }
+  dem->cache.nneigh = nneigh;
 
-        break;
-      case BMM_DEM_NORM_BSHP:
-        {
-          double const more = dem->est.bshpp * sqrt(reff * xi);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) \
+  num_threads((int) dem->opts.thread.n)
+#endif
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    (void) (level ?
+        bmm_dem_cache_findlevel(dem, ipart,
+          &dem->cache.ineigh[dem->cache.neigh[ipart].i]) :
+        bmm_dem_cache_findfrom(dem, ipart, BMM_NEIGH_MASK_UPPERH,
+          &dem->cache.ineigh[dem->cache.neigh[ipart].i]));
+
+  dem->cache.xle = dem->le.x;
+  dem->cache.stale = false;
 
-          if (dem->pair[ict].cohesive) {
-            fnorm = more * (xi + dem->pair[ict].norm.params.viscoel.a * vnormij);
+  ++dem->spec.ibuild;
+  dem->spec.istep = dem->time.istep;
 
-            fnormcons = more * xi;
-            fnormdiss = more * dem->pair[ict].norm.params.viscoel.a * vnormij;
-          } else {
-            fnorm = $(bmm_max, double)(0.0,
-                more * (xi + dem->pair[ict].norm.params.viscoel.a * vnormij));
+  if (dem->opts.cache.ghost && !bmm_dem_cache_ghost(dem))
+    return false;
 
-            if (0.0 > more * (xi + dem->pair[ict].norm.params.viscoel.a * vnormij)) {
-              fnormcons = 0.0;
-              fnormdiss = 0.0;
-            } else {
-              fnormcons = more * xi;
-              fnormdiss = more * dem->pair[ict].norm.params.viscoel.a * vnormij;
-            }
-          }
-        }
+  return true;
+}
 
-        break;
-    }
+/// The call `bmm_dem_cache_allowance(dem, ipart)`
+/// returns how far the particle `ipart` may move from its cached position
+/// before the neighbor cache of the simulation `dem` expires.
+__attribute__ ((__nonnull__, __pure__))
+static double bmm_dem_cache_allowance(struct bmm_dem const *const dem,
+    size_t const ipart) {
+  if (dem->cache.tag == BMM_DEM_CACHE_LEVEL)
+    return dem->cache.level.reach[dem->cache.level.ilevel[ipart]] -
+      dem->part.r[ipart];
 
-    if (ict == BMM_DEM_CT_WEAK) {
-      dem->est.ewcont += dxnorm * fnormcons;
-      dem->est.ewcontdis += $(bmm_abs, double)(dxnorm * fnormdiss);
-    } else {
-      dem->est.escont += dxnorm * fnormcons;
-      dem->est.escontdis += $(bmm_abs, double)(dxnorm * fnormdiss);
-    }
-  }
+  // TODO Use `dem->opts.part.rnew[1]` instead of `dem->part.r[ipart]`.
+  return dem->opts.cache.dcutoff / 2.0 - dem->part.r[ipart];
+}
 
-  double fnormij[BMM_NDIM];
-  bmm_geom2d_scale(fnormij, xnormij, -fnorm);
+/// The call `bmm_dem_cache_moved(dem, ipart)`
+/// checks whether the particle `ipart` has used up
+/// at least half of its allowance in the simulation `dem`.
+/// Recaching such particles in partial updates,
+/// instead of just the ones that have used up all of it,
+/// keeps the next partial update from following right away.
+__attribute__ ((__nonnull__, __pure__))
+static bool bmm_dem_cache_moved(struct bmm_dem const *const dem,
+    size_t const ipart) {
+  return bmm_dem_pdist2(dem, dem->part.x[ipart], dem->cache.x[ipart]) >=
+    $(bmm_power, double)(bmm_dem_cache_allowance(dem, ipart) / 2.0, 2);
+}
 
-  bmm_geom2d_addto(dem->part.f[ipart], fnormij);
-  bmm_geom2d_diffto(dem->part.f[jpart], fnormij);
+/// The call `bmm_dem_cache_mark(dem, dirty, ipart)`
+/// marks as `dirty` those neighbor cells
+/// whose neighbors may include the particle `ipart`
+/// in its currently cached neighbor cell in the simulation `dem`.
+/// Because neighbors are searched from the upper half of each neighborhood,
+/// these are the cells in the lower half of the neighborhood.
+__attribute__ ((__nonnull__))
+static void bmm_dem_cache_mark(struct bmm_dem const *const dem,
+    bool *const dirty, size_t const ipart) {
+  size_t const icell = dem->cache.icell[ipart];
 
-  // Tangential forces second.
+  for (size_t ineigh = 0; ineigh < dem->cache.stencil.nlower[icell]; ++ineigh)
+    dirty[dem->cache.stencil.ilower[icell][ineigh]] = true;
+}
 
-  double ftang = 0.0;
-  double taui = 0.0;
-  double tauj = 0.0;
-  double ftangcons = 0.0;
-  double ftangdiss = 0.0;
+bool bmm_dem_cache_update(struct bmm_dem *const dem) {
+  size_t const npart = dem->part.n;
 
-  {
-    double const dt = dem->opts.script.dt[dem->script.i];
+  if (!bmm_dem_cache_stencil(dem))
+    return false;
 
-    double const lambdaij = bmm_geom2d_dir(xdiffij);
-    double const lambdaji = $(bmm_swrap, double)(lambdaij + M_PI, M_2PI);
-    double const phii = dem->part.phi[ipart];
-    double const phij = dem->part.phi[jpart];
-    double const psii = phii - lambdaij;
-    double const psij = phij - lambdaji;
+  // Partial updates stop paying off
+  // once a quarter of the particles need to be recached.
+  size_t nmoved = 0;
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    if (bmm_dem_cache_moved(dem, ipart))
+      ++nmoved;
 
-    double const dpsii = $(bmm_swrap, double)(psii - dem->pair[ict].cont.src[ipart].psirest[icont][BMM_DEM_END_TAIL], M_2PI);
-    double const dpsij = $(bmm_swrap, double)(psij - dem->pair[ict].cont.src[ipart].psirest[icont][BMM_DEM_END_HEAD], M_2PI);
+  // Partial updates only know the uniform lattice.
+  if (nmoved > npart / 4 || dem->cache.tag == BMM_DEM_CACHE_LEVEL) {
+    if (!bmm_dem_cache_build(dem))
+      return false;
 
-    double zetai = dem->part.r[ipart] * dpsii;
-    double zetaj = dem->part.r[jpart] * dpsij;
-    double zeta = zetai + zetaj;
+    dem->cache.tprev = dem->time.t;
 
-    double const proj = bmm_geom2d_dot(xtangij, vdiffij) / d;
-    double const dzetai = ri * (dem->part.omega[ipart] - proj);
-    double const dzetaj = rj * (dem->part.omega[jpart] - proj);
-    double const dzeta = dzetai + dzetaj;
+    return true;
+  }
 
-    dxtang = dzeta * dt;
+  bool dirty[nmembof(dem->cache.part)];
+  for (size_t icell = 0; icell < nmembof(dirty); ++icell)
+    dirty[icell] = false;
 
-    switch (dem->pair[ict].tang.tag) {
-      case BMM_DEM_TANG_HW:
-        {
-          double const dyn = dem->pair[ict].tang.params.hw.mu * $(bmm_abs, double)(fnorm);
-          double const shear = dem->pair[ict].tang.params.hw.gamma * $(bmm_abs, double)(dzeta);
+  // Cells around both the old and the new position need to be searched again.
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    if (bmm_dem_cache_moved(dem, ipart)) {
+      bmm_dem_cache_mark(dem, dirty, ipart);
 
-          ftang = copysign($(bmm_min, double)(dyn, shear), dzeta);
-          if (dyn <= shear)
-            ++dem->est.hwmu;
-          else
-            ++dem->est.hwgamma;
+      bmm_dem_cache_x(dem, ipart);
+      bmm_dem_cache_ijcell(dem, ipart);
+      bmm_dem_cache_icell(dem, ipart);
 
-          ftangcons = 0.0;
-          ftangdiss = ftang;
+      bmm_dem_cache_mark(dem, dirty, ipart);
+    }
 
-          taui = ri * ftang;
-          tauj = rj * ftang;
-        }
+  bmm_dem_cache_bin(dem, false);
+  bmm_dem_cache_sort(dem);
 
-        break;
-      case BMM_DEM_TANG_CS:
-        {
-          double const dyn = dem->pair[ict].tang.params.cs.mu * $(bmm_abs, double)(fnorm);
-          double const stat = dem->pair[ict].tang.params.cs.k * $(bmm_abs, double)(zeta);
+  size_t *const off = malloc(npart * sizeof *off);
+  if (off == NULL && npart != 0) {
+    BMM_TLE_STDS();
 
-          ftang = dyn <= stat ? copysign(dyn, dzeta) : copysign(stat, zeta);
+    return false;
+  }
 
-          // This is dubious.
-          if (dyn <= stat) {
-            ftangcons = 0.0;
-            ftangdiss = copysign(dyn, dzeta);
+  // The particles in clean cells keep their old neighbors,
+  // while the rest are counted and then found again,
+  // just like in a full rebuild.
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) \
+  num_threads((int) dem->opts.thread.n)
+#endif
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    off[ipart] = dirty[dem->cache.icell[ipart]] ?
+      bmm_dem_cache_findfrom(dem, ipart, BMM_NEIGH_MASK_UPPERH, NULL) :
+      dem->cache.neigh[ipart].n;
+
+  size_t nneigh = 0;
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    size_t const n = off[ipart];
+    off[ipart] = nneigh;
+    nneigh += n;
+  }
 
-            ++dem->est.csmu;
-          } else {
-            ftangcons = copysign(stat, zeta);
-            ftangdiss = 0.0;
+  size_t const ncap = $(bmm_max, size_t)(nneigh, dem->cache.ncapneigh);
+  size_t *const ineigh = bmm_dem_regrow(dem, NULL, 0, ncap, sizeof *ineigh);
+  if (ineigh == NULL) {
+    BMM_TLE_STDS();
 
-            ++dem->est.csk;
-          }
+    free(off);
 
-          taui = ri * ftang;
-          tauj = rj * ftang;
-        }
+    return false;
+  }
 
-        break;
-      case BMM_DEM_TANG_BEAM:
-        {
-          double const d = bmm_geom2d_norm(xdiffij);
-          double const r = ri + rj;
-          double const r2 = $(bmm_power, double)(r, 2);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) \
+  num_threads((int) dem->opts.thread.n)
+#endif
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    if (dirty[dem->cache.icell[ipart]])
+      dem->cache.neigh[ipart].n = bmm_dem_cache_findfrom(dem,
+          ipart, BMM_NEIGH_MASK_UPPERH, &ineigh[off[ipart]]);
+    else if (dem->cache.neigh[ipart].n != 0)
+      (void) memcpy(&ineigh[off[ipart]],
+          &dem->cache.ineigh[dem->cache.neigh[ipart].i],
+          dem->cache.neigh[ipart].n * sizeof *ineigh);
 
-          double const lambdaij = bmm_geom2d_dir(xdiffij);
-          double const lambdaji = $(bmm_swrap, double)(lambdaij + M_PI, M_2PI);
-          double const phii = dem->part.phi[ipart];
-          double const phij = dem->part.phi[jpart];
-          double const psii = phii - lambdaij;
-          double const psij = phij - lambdaji;
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    dem->cache.neigh[ipart].i = off[ipart];
 
-          double const dpsii = $(bmm_swrap, double)(psii - dem->pair[ict].cont.src[ipart].psirest[icont][BMM_DEM_END_TAIL], M_2PI);
-          double const dpsij = $(bmm_swrap, double)(psij - dem->pair[ict].cont.src[ipart].psirest[icont][BMM_DEM_END_HEAD], M_2PI);
+  free(off);
 
-          double zetai = dem->part.r[ipart] * dpsii;
-          double zetaj = dem->part.r[jpart] * dpsij;
+  free(dem->cache.ineigh);
+  dem->cache.ineigh = ineigh;
+  dem->cache.ncapneigh = ncap;
+  dem->cache.nneigh = nneigh;
 
-          double const proj = bmm_geom2d_dot(xtangij, vdiffij) / d;
-          double const dzetai = ri * (dem->part.omega[ipart] - proj);
-          double const dzetaj = rj * (dem->part.omega[jpart] - proj);
+  dem->cache.tpart = dem->time.t;
+  dem->spec.istep = dem->time.istep;
 
-          double const ftangconsi = dem->pair[ict].tang.params.beam.k * zetai;
-          double const ftangconsj = dem->pair[ict].tang.params.beam.k * zetaj;
+  if (dem->opts.cache.ghost && !bmm_dem_cache_ghost(dem))
+    return false;
 
-          double const ftangdissi = dem->pair[ict].tang.params.beam.dk * dzetai;
-          double const ftangdissj = dem->pair[ict].tang.params.beam.dk * dzetaj;
+  return true;
+}
 
-          double const ftangi = ftangconsi + ftangdissi;
-          double const ftangj = ftangconsj + ftangdissj;
+/// The call `bmm_dem_cache_usage(dem)`
+/// returns the largest fraction of its allowance
+/// that any particle has used up in the simulation `dem`.
+/// The neighbor cache expires once this reaches one,
+/// just like `bmm_dem_cache_expired` would tell.
+__attribute__ ((__nonnull__, __pure__))
+static double bmm_dem_cache_usage(struct bmm_dem const *const dem) {
+  double const dle = bmm_dem_le(dem) ?
+    $(bmm_abs, double)($(bmm_swrap, double)(dem->le.x - dem->cache.xle,
+          dem->opts.box.x[0])) : 0.0;
 
-          taui = ri * ftangi;
-          tauj = rj * ftangj;
+  double e = 0.0;
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
+    double const d = bmm_dem_cache_allowance(dem, ipart);
 
-          ftang = (taui + tauj) / d;
+    if (d <= 0.0)
+      return (double) INFINITY;
 
-          if (ict == BMM_DEM_CT_WEAK) {
-            dem->est.ewcont += (dzetai * dt) * ftangconsi;
-            dem->est.ewcont += (dzetaj * dt) * ftangconsj;
-            dem->est.ewcontdis += $(bmm_abs, double)((dzetai * dt) * ftangdissi);
-            dem->est.ewcontdis += $(bmm_abs, double)((dzetaj * dt) * ftangdissj);
-          } else {
-            dem->est.escont += (dzetai * dt) * ftangconsi;
-            dem->est.escont += (dzetaj * dt) * ftangconsj;
-            dem->est.escontdis += $(bmm_abs, double)((dzetai * dt) * ftangdissi);
-            dem->est.escontdis += $(bmm_abs, double)((dzetaj * dt) * ftangdissj);
-          }
-        }
+    e = fmax(e, (sqrt(bmm_dem_pdist2(dem,
+              dem->part.x[ipart], dem->cache.x[ipart])) + dle) / d);
+  }
 
-        break;
-    }
+  return e;
+}
 
-    if (ict == BMM_DEM_CT_WEAK) {
-      dem->est.ewcont += dxtang * ftangcons;
-      dem->est.ewcontdis += $(bmm_abs, double)(dxtang * ftangdiss);
-    } else {
-      dem->est.escont += dxtang * ftangcons;
-      dem->est.escontdis += $(bmm_abs, double)(dxtang * ftangdiss);
-    }
-  }
+/// The call `bmm_dem_spec_run(ptr)`
+/// builds the neighbor cache of the shadow simulation `ptr`
+/// on the helper thread.
+__attribute__ ((__nonnull__))
+static void *bmm_dem_spec_run(void *const ptr) {
+  struct bmm_dem *const shadow = ptr;
 
-  double ftangij[BMM_NDIM];
-  bmm_geom2d_scale(ftangij, xtangij, -ftang);
+  // Pinning is inherited from the thread that started this one,
+  // which would keep the helper thread on the same processor.
+  cpu_set_t all;
+  CPU_ZERO(&all);
+  for (size_t icpu = 0; icpu < CPU_SETSIZE; ++icpu)
+    CPU_SET(icpu, &all);
+  (void) pthread_setaffinity_np(pthread_self(), sizeof all, &all);
 
-  bmm_geom2d_addto(dem->part.f[ipart], ftangij);
-  bmm_geom2d_diffto(dem->part.f[jpart], ftangij);
+  shadow->spec.failed = !bmm_dem_cache_build(shadow);
 
-  dem->part.tau[ipart] -= taui;
-  dem->part.tau[jpart] -= tauj;
+  return NULL;
 }
 
-void bmm_dem_force_external(struct bmm_dem *const dem, size_t const ipart) {
-  double const dt = dem->opts.script.dt[dem->script.i];
+/// The call `bmm_dem_spec_regrow(shadow, nnew)`
+/// tries to give every array of the shadow simulation `shadow`
+/// room for `nnew` particles without keeping their contents.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_spec_regrow(struct bmm_dem *const shadow,
+    size_t const nnew) {
+  if (nnew == shadow->part.ncap)
+    return true;
 
-  switch (dem->ext.tag) {
-    case BMM_DEM_EXT_HARM:
-      dem->part.f[ipart][1] += dem->ext.params.harm.k *
-        (dem->opts.box.x[1] / 2.0 - dem->part.x[ipart][1]);
+  // Shrinking the capacity first keeps it truthful if anything fails.
+  shadow->part.ncap = 0;
+
+#define REGROW(x) \
+  begin \
+    void *const ptr = bmm_dem_regrow(shadow, (x), 0, nnew, sizeof *(x)); \
+    if (ptr == NULL) { \
+      BMM_TLE_STDS(); \
+      \
+      return false; \
+    } \
+    \
+    (x) = ptr; \
+  end
+
+  REGROW(shadow->part.role);
+  REGROW(shadow->part.r);
+  REGROW(shadow->part.m);
+  REGROW(shadow->part.jred);
+  REGROW(shadow->part.x);
+
+  REGROW(shadow->cache.j);
+  REGROW(shadow->cache.x);
+  REGROW(shadow->cache.ijcell);
+#if BMM_MIXED
+  REGROW(shadow->cache.xrel);
+#endif
+  REGROW(shadow->cache.icell);
+  REGROW(shadow->cache.ipart);
+  REGROW(shadow->cache.neigh);
+
+  if (shadow->cache.tag == BMM_DEM_CACHE_LEVEL) {
+    REGROW(shadow->cache.level.ilevel);
+    REGROW(shadow->cache.level.icell);
+    REGROW(shadow->cache.level.ipart);
+  }
 
-      break;
-    case BMM_DEM_EXT_GRAVY:
-      {
-        dem->part.f[ipart][1] += dem->part.m[ipart] * dem->ext.params.gravy.g;
+#undef REGROW
 
-        double const dy = dem->part.v[ipart][1] * dt;
-      }
+  shadow->part.ncap = nnew;
 
-      break;
-    case BMM_DEM_EXT_DRIVE:
-      switch (dem->part.role[ipart]) {
-        case BMM_DEM_ROLE_DRIVEN:
-          {
-            double f[BMM_NDIM];
-            for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-              f[idim] = dem->script.state.crunch.fdrive[idim] /
-                (double) dem->script.state.crunch.ndrive;
+  return true;
+}
 
-            double const dx = dem->part.v[ipart][0] * dt;
-            double const dy = dem->part.v[ipart][1] * dt;
-            dem->est.edrivtang += dx * f[0];
-            dem->est.edrivnorm += dy * f[1];
+/// The call `bmm_dem_spec_def(dem)`
+/// tries to set up the shadow simulation of the simulation `dem`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_spec_def(struct bmm_dem *const dem) {
+  struct bmm_dem *const shadow = malloc(sizeof *shadow);
+  if (shadow == NULL) {
+    BMM_TLE_STDS();
 
-            for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-              dem->part.f[ipart][idim] += f[idim];
-          }
+    return false;
+  }
 
-          break;
-      }
+  // The helper thread stays out of the way of the others
+  // by building the cache on its own.
+  shadow->opts = dem->opts;
+  shadow->opts.cache.ghost = false;
+  shadow->opts.thread.n = 1;
+  shadow->opts.thread.huge = false;
+
+  shadow->part.n = 0;
+  shadow->part.ncap = 0;
+  shadow->part.role = NULL;
+  shadow->part.r = NULL;
+  shadow->part.m = NULL;
+  shadow->part.jred = NULL;
+  shadow->part.x = NULL;
+
+  shadow->time.istep = 0;
+  shadow->time.t = 0.0;
+
+  shadow->cache.tag = dem->cache.tag;
+  shadow->cache.stale = false;
+  shadow->cache.sorted = false;
+  shadow->cache.xle = 0.0;
+  shadow->cache.j = NULL;
+  shadow->cache.x = NULL;
+  shadow->cache.ijcell = NULL;
+  shadow->cache.xrel = NULL;
+  shadow->cache.icell = NULL;
+  shadow->cache.ipart = NULL;
+  shadow->cache.neigh = NULL;
+  shadow->cache.nneigh = 0;
+  shadow->cache.ncapneigh = 0;
+  shadow->cache.ineigh = NULL;
 
-      break;
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+    shadow->cache.stencil.ncell[idim] = 0;
+    shadow->cache.stencil.per[idim] = false;
   }
-}
 
-void bmm_dem_force(struct bmm_dem *const dem) {
-  double const dt = dem->opts.script.dt[dem->script.i];
+  shadow->cache.stencil.ncap = 0;
+  shadow->cache.stencil.nupper = NULL;
+  shadow->cache.stencil.iupper = NULL;
+  shadow->cache.stencil.nlower = NULL;
+  shadow->cache.stencil.ilower = NULL;
+
+  shadow->cache.level.n = 0;
+  shadow->cache.level.ncap = 0;
+  shadow->cache.level.part = NULL;
+  shadow->cache.level.ilevel = NULL;
+  shadow->cache.level.icell = NULL;
+  shadow->cache.level.ipart = NULL;
+
+  shadow->spec.busy = false;
+  shadow->spec.failed = false;
+  shadow->spec.ibuild = 0;
+  shadow->spec.istep = 0;
+  shadow->spec.shadow = NULL;
+
+  shadow->cache.nbin = malloc(sizeof *shadow->cache.nbin);
+  if (shadow->cache.nbin == NULL) {
+    BMM_TLE_STDS();
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
-    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-      dem->part.f[ipart][idim] = 0.0;
+    free(shadow);
 
-    dem->part.tau[ipart] = 0.0;
+    return false;
   }
 
-  // This goes for the previous frame, so this is not exactly the right spot.
-  // dem->est.eambdis = 0.0;
-  dem->est.epotext_d = 0.0;
-  dem->est.eklin_d = 0.0;
-  dem->est.ekrot_d = 0.0;
-  dem->est.ewcont_d = 0.0;
-  dem->est.escont_d = 0.0;
-  // dem->est.ewcont = 0.0;
-  // dem->est.escont = 0.0;
-  // dem->est.edrivtang = 0.0;
-  // dem->est.edrivnorm = 0.0;
-  // dem->est.ebond = 0.0;
-  // dem->est.eyieldis = 0.0;
-  // dem->est.ewcontdis = 0.0;
-  // dem->est.escontdis = 0.0;
-  dem->est.fback[0] = 0.0;
-  dem->est.fback[1] = 0.0;
-  dem->est.mueff = (double) NAN;
-  dem->est.mueffb = (double) NAN;
-  dem->est.vdriv[0] = (double) NAN;
-  dem->est.vdriv[1] = (double) NAN;
-  dem->est.bshpp = (2.0 / 3.0) * (dem->opts.part.ycomp /
-      (1.0 - $(bmm_power, double)(dem->opts.part.nu, 2)));
+  dem->spec.shadow = shadow;
 
+  return true;
+}
 
-  dem->est.epotext_d += bmm_dem_est_epotext(dem);
-  dem->est.eklin_d += bmm_dem_est_eklin(dem);
-  dem->est.ekrot_d += bmm_dem_est_ekrot(dem);
-  dem->est.ewcont_d += bmm_dem_est_econt(dem, BMM_DEM_CT_WEAK);
-  dem->est.escont_d += bmm_dem_est_econt(dem, BMM_DEM_CT_STRONG);
+/// The call `bmm_dem_spec_free(dem)`
+/// waits for the helper thread of the simulation `dem`
+/// and releases its shadow simulation.
+__attribute__ ((__nonnull__))
+static void bmm_dem_spec_free(struct bmm_dem *const dem) {
+  if (dem->spec.busy) {
+    (void) pthread_join(dem->spec.thread, NULL);
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    bmm_dem_force_ambient(dem, ipart);
+    dem->spec.busy = false;
+  }
 
-  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict)
-    for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-      for (size_t icont = 0; icont < dem->pair[ict].cont.src[ipart].n; ++icont) {
-        size_t const jpart = dem->pair[ict].cont.src[ipart].itgt[icont];
+  struct bmm_dem *const shadow = dem->spec.shadow;
+  if (shadow == NULL)
+    return;
 
-        bmm_dem_force_unified(dem, ipart, jpart, icont, ict);
-      }
+  free(shadow->part.role);
+  free(shadow->part.r);
+  free(shadow->part.m);
+  free(shadow->part.jred);
+  free(shadow->part.x);
+
+  free(shadow->cache.j);
+  free(shadow->cache.x);
+  free(shadow->cache.ijcell);
+  free(shadow->cache.xrel);
+  free(shadow->cache.icell);
+  free(shadow->cache.ipart);
+  free(shadow->cache.neigh);
+  free(shadow->cache.ineigh);
+  free(shadow->cache.nbin);
+  free(shadow->cache.stencil.nupper);
+  free(shadow->cache.stencil.iupper);
+  free(shadow->cache.stencil.nlower);
+  free(shadow->cache.stencil.ilower);
+  free(shadow->cache.level.part);
+  free(shadow->cache.level.ilevel);
+  free(shadow->cache.level.icell);
+  free(shadow->cache.level.ipart);
+
+  free(shadow);
+
+  dem->spec.shadow = NULL;
+}
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    if (dem->part.role[ipart] == BMM_DEM_ROLE_DRIVEN)
-      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-        dem->est.fback[idim] += dem->part.f[ipart][idim];
+/// The call `bmm_dem_spec_due(dem)`
+/// checks whether the neighbor cache of the simulation `dem`
+/// is predicted to expire within `spec.nlead` steps.
+/// The allowance is used up at a roughly steady rate,
+/// so the remaining steps are extrapolated from the steps so far.
+__attribute__ ((__nonnull__, __pure__))
+static bool bmm_dem_spec_due(struct bmm_dem const *const dem) {
+  size_t const nstep = dem->time.istep - dem->spec.istep;
+  if (nstep == 0)
+    return false;
 
-  if (dem->script.state.crunch.fdrive[1] != 0.0)
-    dem->est.mueff = $(bmm_abs, double)(dem->script.state.crunch.fdrive[0] /
-        dem->script.state.crunch.fdrive[1]);
+  double const e = bmm_dem_cache_usage(dem);
 
-  if (dem->est.fback[1] != 0.0)
-    dem->est.mueffb = $(bmm_abs, double)(dem->est.fback[0] /
-        dem->est.fback[1]);
+  return e > 0.0 &&
+    (double) nstep * (1.0 - e) / e <= (double) dem->spec.nlead;
+}
 
-  bmm_dem_est_vdc(dem->est.vdriv, dem);
+/// The call `bmm_dem_spec_start(dem)`
+/// tries to take a snapshot of the particles of the simulation `dem`
+/// and start building the next neighbor cache from it on the helper thread.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_spec_start(struct bmm_dem *const dem) {
+  size_t const npart = dem->part.n;
 
-  dem->script.state.crunch.fdrive[0] +=
-    copysign(dem->opts.script.params[dem->script.i].crunch.fadjust[0] * dt,
-        dem->opts.script.params[dem->script.i].crunch.v - dem->est.vdriv[0]);
+  // Reordering would permute the particles behind the back of the others.
+  if (dem->opts.cache.reorder != BMM_DEM_ORDER_NONE ||
+      !bmm_dem_role_parted(dem))
+    return true;
 
-  dem->script.state.crunch.fdrive[1] +=
-    copysign(dem->opts.script.params[dem->script.i].crunch.fadjust[1] * dt,
-        dem->est.fback[1] -
-        dem->opts.script.params[dem->script.i].crunch.p *
-        dem->opts.box.x[0] *
-        2.0 * bmm_ival_midpoint(dem->opts.part.rnew));
+  if (dem->spec.shadow == NULL && !bmm_dem_spec_def(dem))
+    return false;
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    bmm_dem_force_external(dem, ipart);
-}
+  struct bmm_dem *const shadow = dem->spec.shadow;
 
-void bmm_dem_accel(struct bmm_dem *const dem) {
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    if (dem->part.role[ipart] != BMM_DEM_ROLE_FIXED) {
-      double const m = dem->part.m[ipart];
-      double const j = dem->cache.j[ipart];
+  if (!bmm_dem_spec_regrow(shadow, dem->part.ncap))
+    return false;
 
-      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-        dem->part.a[ipart][idim] = dem->part.f[ipart][idim] / m;
+  // The cutoff and the lattice may have been tuned in the meantime.
+  shadow->opts.cache.ncell[0] = dem->opts.cache.ncell[0];
+  shadow->opts.cache.ncell[1] = dem->opts.cache.ncell[1];
+  shadow->opts.cache.dcutoff = dem->opts.cache.dcutoff;
 
-      dem->part.alpha[ipart] = dem->part.tau[ipart] / j;
-    }
-}
+  shadow->part.n = npart;
+  (void) memcpy(shadow->part.role, dem->part.role,
+      npart * sizeof *dem->part.role);
+  (void) memcpy(shadow->part.r, dem->part.r, npart * sizeof *dem->part.r);
+  (void) memcpy(shadow->part.m, dem->part.m, npart * sizeof *dem->part.m);
+  (void) memcpy(shadow->part.jred, dem->part.jred,
+      npart * sizeof *dem->part.jred);
+  (void) memcpy(shadow->part.x, dem->part.x, npart * sizeof *dem->part.x);
 
-void bmm_dem_integ_euler(struct bmm_dem *const dem) {
-  double const dt = dem->opts.script.dt[dem->script.i];
+  shadow->le = dem->le;
+  shadow->time.istep = dem->time.istep;
+  shadow->time.t = dem->time.t;
 
-  if (dt == 0.0)
-    return;
+  dem->spec.ibuildsnap = dem->spec.ibuild;
+  dem->spec.istepsnap = dem->time.istep;
+  dem->spec.tsnap = dem->time.t;
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
-    for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
-      dem->part.x[ipart][idim] += dem->part.v[ipart][idim] * dt;
-      dem->part.v[ipart][idim] += dem->part.a[ipart][idim] * dt;
+  // Signals are left for the simulation thread to handle,
+  // so the helper thread starts with all of them blocked.
+  sigset_t set;
+  (void) sigfillset(&set);
 
-      if (dem->opts.box.per[idim])
-        dem->part.x[ipart][idim] = $(bmm_uwrap, double)(dem->part.x[ipart][idim],
-            dem->opts.box.x[idim]);
-    }
+  sigset_t oldset;
+  (void) pthread_sigmask(SIG_SETMASK, &set, &oldset);
 
-    dem->part.phi[ipart] += dem->part.omega[ipart] * dt;
-    dem->part.omega[ipart] += dem->part.alpha[ipart] * dt;
-  }
-}
+  int const nerr = pthread_create(&dem->spec.thread, NULL,
+      bmm_dem_spec_run, shadow);
 
-void bmm_dem_integ_taylor(struct bmm_dem *const dem) {
-  double const dt = dem->opts.script.dt[dem->script.i];
+  (void) pthread_sigmask(SIG_SETMASK, &oldset, NULL);
 
-  if (dt == 0.0)
-    return;
+  if (nerr != 0) {
+    errno = nerr;
+    BMM_TLE_STDS();
 
-  double const dt2 = $(bmm_power, double)(dt, 2);
+    return false;
+  }
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
-    for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
-      dem->part.x[ipart][idim] += dem->part.v[ipart][idim] * dt +
-        (1.0 / 2.0) * dem->part.a[ipart][idim] * dt2;
-      dem->part.v[ipart][idim] += dem->part.a[ipart][idim] * dt;
+  dem->spec.busy = true;
 
-      if (dem->opts.box.per[idim])
-        dem->part.x[ipart][idim] = $(bmm_uwrap, double)(dem->part.x[ipart][idim],
-            dem->opts.box.x[idim]);
-    }
+  bmm_trace_mark(&dem->trace, 0, "spec");
 
-    dem->part.phi[ipart] += dem->part.omega[ipart] * dt +
-      (1.0 / 2.0) * dem->part.alpha[ipart] * dt2;
-    dem->part.omega[ipart] += dem->part.alpha[ipart] * dt;
-  }
+  return true;
 }
 
-void bmm_dem_integ_vel(struct bmm_dem *const dem) {
-  double const dt = dem->opts.script.dt[dem->script.i];
+/// The call `bmm_dem_spec_poll(dem)`
+/// swaps in the neighbor cache built on the helper thread
+/// of the simulation `dem` if it is ready.
+/// If the current cache has already expired,
+/// the helper thread is waited for,
+/// since it has a head start on building a new one.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_spec_poll(struct bmm_dem *const dem) {
+  if (!dem->spec.busy)
+    return true;
 
-  if (dt == 0.0)
-    return;
+  bool wait = false;
+  if (pthread_tryjoin_np(dem->spec.thread, NULL) != 0) {
+    if (dem->cache.stale || !bmm_dem_cache_expired(dem))
+      return true;
 
-  double const dt2 = $(bmm_power, double)(dt, 2);
+    (void) pthread_join(dem->spec.thread, NULL);
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
-    for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
-      dem->integ.params.velvet.ao[ipart][idim] = dem->part.a[ipart][idim];
+    wait = true;
+  }
 
-      dem->part.x[ipart][idim] += dem->part.v[ipart][idim] * dt +
-        (1.0 / 2.0) * dem->part.a[ipart][idim] * dt2;
+  dem->spec.busy = false;
 
-      if (dem->opts.box.per[idim])
-        dem->part.x[ipart][idim] = $(bmm_uwrap, double)(dem->part.x[ipart][idim],
-            dem->opts.box.x[idim]);
-    }
+  // Waiting means the snapshot was taken too late,
+  // so the lead is doubled to make up for it.
+  size_t const nstep = dem->time.istep - dem->spec.istepsnap + 1;
+  dem->spec.nlead = wait ? 2 * $(bmm_max, size_t)(nstep, dem->spec.nlead) :
+    nstep;
 
-    dem->integ.params.velvet.alphao[ipart] = dem->part.alpha[ipart];
+  struct bmm_dem *const shadow = dem->spec.shadow;
 
-    dem->part.phi[ipart] += dem->part.omega[ipart] * dt +
-      (1.0 / 2.0) * dem->part.alpha[ipart] * dt2;
-  }
-}
+  // Anything that rebuilt the cache in the meantime
+  // may also have changed the particles the snapshot was taken of.
+  // Failures are left for the simulation thread to run into and report
+  // when it builds the cache itself.
+  if (shadow->spec.failed || dem->spec.ibuild != dem->spec.ibuildsnap ||
+      dem->cache.stale ||
+      shadow->part.n != dem->part.n || shadow->part.ncap != dem->part.ncap)
+    return true;
 
-void bmm_dem_integ_vet(struct bmm_dem *const dem) {
-  double const dt = dem->opts.script.dt[dem->script.i];
+  // The old cache goes to the shadow simulation for the next snapshot.
+#define SWAP(x, y) \
+  begin \
+    __typeof__ (x) const tmp = (x); \
+    (x) = (y); \
+    (y) = tmp; \
+  end
+
+  SWAP(dem->cache.j, shadow->cache.j);
+  SWAP(dem->cache.x, shadow->cache.x);
+  SWAP(dem->cache.ijcell, shadow->cache.ijcell);
+  SWAP(dem->cache.xrel, shadow->cache.xrel);
+  SWAP(dem->cache.icell, shadow->cache.icell);
+  for (size_t icell = 0; icell < nmembof(dem->cache.part); ++icell)
+    SWAP(dem->cache.part[icell], shadow->cache.part[icell]);
+  SWAP(dem->cache.ipart, shadow->cache.ipart);
+  SWAP(dem->cache.sorted, shadow->cache.sorted);
+  SWAP(dem->cache.nneigh, shadow->cache.nneigh);
+  SWAP(dem->cache.ncapneigh, shadow->cache.ncapneigh);
+  SWAP(dem->cache.neigh, shadow->cache.neigh);
+  SWAP(dem->cache.ineigh, shadow->cache.ineigh);
+  SWAP(dem->cache.level, shadow->cache.level);
+  SWAP(dem->cache.xle, shadow->cache.xle);
 
-  if (dt == 0.0)
-    return;
+#undef SWAP
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
-    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-      dem->part.v[ipart][idim] += (1.0 / 2.0) *
-        (dem->part.a[ipart][idim] + dem->integ.params.velvet.ao[ipart][idim]) * dt;
+  dem->cache.tprev = dem->spec.tsnap;
+  dem->spec.istep = dem->spec.istepsnap;
 
-    dem->part.omega[ipart] += (1.0 / 2.0) *
-      (dem->part.alpha[ipart] + dem->integ.params.velvet.alphao[ipart]) * dt;
-  }
+  bmm_trace_mark(&dem->trace, 0, "swap");
+
+  if (dem->opts.cache.ghost && !bmm_dem_cache_ghost(dem))
+    return false;
+
+  return true;
 }
 
-void bmm_dem_integ_bee(struct bmm_dem *const dem) {
-  double const dt = dem->opts.script.dt[dem->script.i];
+size_t bmm_dem_search_cont(struct bmm_dem const *const dem,
+    enum bmm_dem_ct const ict, size_t const ipart, size_t const jpart) {
+  // Most neighbors are not in contact,
+  // so checking the signature first saves searching for them.
+  if ((dem->pair[ict].cont.src[ipart].sig & bmm_dem_cont_bit(jpart)) == 0)
+    return SIZE_MAX;
 
-  if (dt == 0.0)
-    return;
+  for (size_t icont = 0; icont < dem->pair[ict].cont.src[ipart].n; ++icont) {
+    size_t const kpart = dem->pair[ict].cont.src[ipart].itgt[icont];
 
-  double const dt2 = $(bmm_power, double)(dt, 2);
+    if (kpart == jpart)
+      return icont;
+  }
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
-    for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
-      dem->integ.params.beeman.xo[ipart][idim] = dem->part.x[ipart][idim];
-      dem->integ.params.beeman.vo[ipart][idim] = dem->part.v[ipart][idim];
-      dem->integ.params.beeman.aoo[ipart][idim] = dem->integ.params.beeman.ao[ipart][idim];
-      dem->integ.params.beeman.ao[ipart][idim] = dem->part.a[ipart][idim];
+  return SIZE_MAX;
+}
 
-      dem->part.x[ipart][idim] = dem->part.x[ipart][idim] +
-        dem->part.v[ipart][idim] * dt +
-        (1.0 / 2.0) * (1.0 / 3.0) * (4.0 * dem->part.a[ipart][idim] -
-            dem->integ.params.beeman.aoo[ipart][idim]) * dt2;
+/// The call `bmm_dem_djs_find(iparent, ipart)`
+/// returns the representative of the particle `ipart`
+/// in the disjoint sets `iparent`, halving paths along the way.
+__attribute__ ((__nonnull__))
+static size_t bmm_dem_djs_find(size_t *const iparent, size_t ipart) {
+  while (iparent[ipart] != ipart) {
+    iparent[ipart] = iparent[iparent[ipart]];
+    ipart = iparent[ipart];
+  }
 
-      if (dem->opts.box.per[idim])
-        dem->part.x[ipart][idim] = $(bmm_uwrap, double)(dem->part.x[ipart][idim],
-            dem->opts.box.x[idim]);
+  return ipart;
+}
 
-      dem->part.v[ipart][idim] = dem->part.v[ipart][idim] +
-        (1.0 / 2.0) * (3.0 * dem->part.a[ipart][idim] -
-            dem->integ.params.beeman.aoo[ipart][idim]) * dt;
-    }
+/// The call `bmm_dem_djs_union(iparent, ipart, jpart)`
+/// joins the sets of the particles `ipart` and `jpart`
+/// in the disjoint sets `iparent`,
+/// so that the smaller representative represents both.
+/// The representative of the joined set is returned.
+__attribute__ ((__nonnull__))
+static size_t bmm_dem_djs_union(size_t *const iparent,
+    size_t const ipart, size_t const jpart) {
+  size_t const iroot = bmm_dem_djs_find(iparent, ipart);
+  size_t const jroot = bmm_dem_djs_find(iparent, jpart);
 
-    dem->integ.params.beeman.phio[ipart] = dem->part.phi[ipart];
-    dem->integ.params.beeman.omegao[ipart] = dem->part.omega[ipart];
-    dem->integ.params.beeman.alphaoo[ipart] = dem->integ.params.beeman.alphao[ipart];
-    dem->integ.params.beeman.alphao[ipart] = dem->part.alpha[ipart];
+  size_t const kroot = $(bmm_min, size_t)(iroot, jroot);
+  iparent[iroot] = kroot;
+  iparent[jroot] = kroot;
 
-    dem->part.phi[ipart] = dem->part.phi[ipart] +
-      dem->part.omega[ipart] * dt +
-      (1.0 / 2.0) * (1.0 / 3.0) * (4.0 * dem->part.alpha[ipart] -
-          dem->integ.params.beeman.alphaoo[ipart]) * dt2;
+  return kroot;
+}
+
+/// The call `bmm_dem_sleeping(dem, ipart, jpart)`
+/// checks whether the particles `ipart` and `jpart`
+/// of the simulation `dem` are both asleep,
+/// in which case nothing between them can change.
+__attribute__ ((__nonnull__, __pure__))
+static inline bool bmm_dem_sleeping(struct bmm_dem const *const dem,
+    size_t const ipart, size_t const jpart) {
+  return dem->opts.sleep.on &&
+    dem->sleep.asleep[ipart] && dem->sleep.asleep[jpart];
+}
 
-    dem->part.omega[ipart] = dem->part.omega[ipart] +
-      (1.0 / 2.0) * (3.0 * dem->part.alpha[ipart] -
-          dem->integ.params.beeman.alphaoo[ipart]) * dt;
+/// The call `bmm_dem_sleep_poke(dem, ipart, jpart)`
+/// marks the particles `ipart` and `jpart` of the simulation `dem`
+/// to have their groups woken up on the next check
+/// if either of them is asleep.
+__attribute__ ((__nonnull__))
+static inline void bmm_dem_sleep_poke(struct bmm_dem *const dem,
+    size_t const ipart, size_t const jpart) {
+  if (dem->opts.sleep.on &&
+      (dem->sleep.asleep[ipart] || dem->sleep.asleep[jpart])) {
+    dem->sleep.poke[ipart] = true;
+    dem->sleep.poke[jpart] = true;
   }
 }
 
-void bmm_dem_integ_man(struct bmm_dem *const dem) {
-  double const dt = dem->opts.script.dt[dem->script.i];
+/// The call `bmm_dem_rigid(dem, ipart, jpart)`
+/// checks whether the particles `ipart` and `jpart`
+/// of the simulation `dem` are in the same clump,
+/// in which case nothing between them can change.
+__attribute__ ((__nonnull__, __pure__))
+static inline bool bmm_dem_rigid(struct bmm_dem const *const dem,
+    size_t const ipart, size_t const jpart) {
+  return dem->clump.ibody[ipart] != SIZE_MAX &&
+    dem->clump.ibody[ipart] == dem->clump.ibody[jpart];
+}
 
-  if (dt == 0.0)
-    return;
+/// The call `bmm_dem_clump_dissolve(dem, ibody)`
+/// breaks the clump `ibody` of the simulation `dem` up
+/// into its particles, which carry on with the velocities they had.
+/// The last clump takes its place.
+__attribute__ ((__nonnull__))
+static void bmm_dem_clump_dissolve(struct bmm_dem *const dem,
+    size_t const ibody) {
+  size_t const jbody = dem->clump.n - 1;
 
-  double const dt2 = $(bmm_power, double)(dt, 2);
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    if (dem->clump.ibody[ipart] == ibody)
+      dem->clump.ibody[ipart] = SIZE_MAX;
+    else if (dem->clump.ibody[ipart] == jbody)
+      dem->clump.ibody[ipart] = ibody;
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
-    for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
-      dem->part.x[ipart][idim] = dem->integ.params.beeman.xo[ipart][idim] +
-        dem->integ.params.beeman.vo[ipart][idim] * dt +
-        (1.0 / 2.0) * (1.0 / 3.0) * (dem->part.a[ipart][idim] +
-            2.0 * dem->integ.params.beeman.ao[ipart][idim]) * dt2;
+  dem->clump.body[ibody] = dem->clump.body[jbody];
+  --dem->clump.n;
 
-      if (dem->opts.box.per[idim])
-        dem->part.x[ipart][idim] = $(bmm_uwrap, double)(dem->part.x[ipart][idim],
-            dem->opts.box.x[idim]);
+  dem->est.nclump = dem->clump.n;
+}
 
-      dem->part.v[ipart][idim] = dem->integ.params.beeman.vo[ipart][idim] +
-        (1.0 / 6.0) * (2.0 * dem->part.a[ipart][idim] +
-            5.0 * dem->integ.params.beeman.ao[ipart][idim] -
-            dem->integ.params.beeman.aoo[ipart][idim]) * dt;
-    }
+/// The call `bmm_dem_clump_dissolve_all(dem)`
+/// breaks every clump of the simulation `dem` up into its particles.
+__attribute__ ((__nonnull__))
+static void bmm_dem_clump_dissolve_all(struct bmm_dem *const dem) {
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    dem->clump.ibody[ipart] = SIZE_MAX;
 
-    dem->part.phi[ipart] = dem->integ.params.beeman.phio[ipart] +
-      dem->integ.params.beeman.omegao[ipart] * dt +
-      (1.0 / 2.0) * (1.0 / 3.0) * (dem->part.alpha[ipart] +
-          2.0 * dem->integ.params.beeman.alphao[ipart]) * dt2;
+  dem->clump.n = 0;
 
-    dem->part.omega[ipart] = dem->integ.params.beeman.omegao[ipart] +
-      (1.0 / 6.0) * (2.0 * dem->part.alpha[ipart] +
-          5.0 * dem->integ.params.beeman.alphao[ipart] -
-          dem->integ.params.beeman.alphaoo[ipart]) * dt;
-  }
+  dem->est.nclump = 0;
 }
 
-void bmm_dem_integ_kura(struct bmm_dem *const dem) {
-  double const dt = dem->opts.script.dt[dem->script.i];
+/// The call `bmm_dem_clump_break(dem, ipart, jpart)`
+/// breaks the clumps of the particles `ipart` and `jpart`
+/// of the simulation `dem` up into their particles,
+/// since a strong contact between them came or went.
+__attribute__ ((__nonnull__))
+static void bmm_dem_clump_break(struct bmm_dem *const dem,
+    size_t const ipart, size_t const jpart) {
+  if (dem->clump.ibody[ipart] != SIZE_MAX)
+    bmm_dem_clump_dissolve(dem, dem->clump.ibody[ipart]);
 
-  if (dt == 0.0)
-    return;
+  if (dem->clump.ibody[jpart] != SIZE_MAX)
+    bmm_dem_clump_dissolve(dem, dem->clump.ibody[jpart]);
+}
 
-  double const dt2 = $(bmm_power, double)(dt, 2);
+size_t bmm_dem_addcont_unsafe(struct bmm_dem *const dem,
+    enum bmm_dem_ct const ict, size_t const ipart, size_t const jpart) {
+  size_t const icont = dem->pair[ict].cont.src[ipart].n;
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
-    for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
-      dem->integ.params.beeman.xo[ipart][idim] = dem->part.x[ipart][idim];
-      dem->integ.params.beeman.vo[ipart][idim] = dem->part.v[ipart][idim];
-      dem->integ.params.beeman.aoo[ipart][idim] = dem->integ.params.beeman.ao[ipart][idim];
-      dem->integ.params.beeman.ao[ipart][idim] = dem->part.a[ipart][idim];
+  if (icont >= BMM_MCONTACT)
+    return SIZE_MAX;
 
-      dem->part.x[ipart][idim] = dem->part.x[ipart][idim] +
-        dem->part.v[ipart][idim] * dt +
-        (1.0 / 2.0) * (1.0 / 4.0) * (5.0 * dem->part.a[ipart][idim] -
-            dem->integ.params.beeman.aoo[ipart][idim]) * dt2;
+  ++dem->pair[ict].cont.src[ipart].n;
+  ++dem->prof.nadd;
 
-      if (dem->opts.box.per[idim])
-        dem->part.x[ipart][idim] = $(bmm_uwrap, double)(dem->part.x[ipart][idim],
-            dem->opts.box.x[idim]);
+  double xdiffij[BMM_NDIM];
+  (void) bmm_dem_pdiff(xdiffij, dem,
+      dem->part.x[jpart], dem->part.x[ipart]);
 
-      dem->part.v[ipart][idim] = dem->part.v[ipart][idim] +
-        (1.0 / 2.0) * (3.0 * dem->part.a[ipart][idim] -
-            dem->integ.params.beeman.aoo[ipart][idim]) * dt;
-    }
+  double const d = bmm_geom2d_norm(xdiffij);
+  double const r = dem->part.r[ipart] + dem->part.r[jpart];
 
-    dem->integ.params.beeman.phio[ipart] = dem->part.phi[ipart];
-    dem->integ.params.beeman.omegao[ipart] = dem->part.omega[ipart];
-    dem->integ.params.beeman.alphaoo[ipart] = dem->integ.params.beeman.alphao[ipart];
-    dem->integ.params.beeman.alphao[ipart] = dem->part.alpha[ipart];
+  double const lambdaij = bmm_geom2d_dir(xdiffij);
+  double const lambdaji = $(bmm_swrap, double)(lambdaij + M_PI, M_2PI);
+  double const phii = dem->part.phi[ipart];
+  double const phij = dem->part.phi[jpart];
+  double const psii = phii - lambdaij;
+  double const psij = phij - lambdaji;
 
-    dem->part.phi[ipart] = dem->part.phi[ipart] +
-      dem->part.omega[ipart] * dt +
-      (1.0 / 2.0) * (1.0 / 3.0) * (4.0 * dem->part.alpha[ipart] -
-          dem->integ.params.beeman.alphaoo[ipart]) * dt2;
+  dem->pair[ict].cont.src[ipart].strength[icont] =
+    bmm_dem_random(dem, BMM_DEM_STREAM_STRENGTH,
+        dem->part.l[ipart], dem->part.l[jpart], dem->opts.part.strnew);
 
-    dem->part.omega[ipart] = dem->part.omega[ipart] +
-      (1.0 / 2.0) * (3.0 * dem->part.alpha[ipart] -
-          dem->integ.params.beeman.alphaoo[ipart]) * dt;
-  }
-}
+  dem->pair[ict].cont.src[ipart].drest[icont] = d;
+  dem->pair[ict].cont.src[ipart].itgt[icont] = jpart;
+  dem->pair[ict].cont.src[ipart].sig |= bmm_dem_cont_bit(jpart);
 
-void bmm_dem_integ_ev(struct bmm_dem *const dem) {
-  double const dt = dem->opts.script.dt[dem->script.i];
+  dem->pair[ict].cont.src[ipart].psirest[icont][BMM_DEM_END_TAIL] = psii;
+  dem->pair[ict].cont.src[ipart].psirest[icont][BMM_DEM_END_HEAD] = psij;
 
-  if (dt == 0.0)
-    return;
+  // Not used.
+  dem->pair[ict].cont.src[ipart].tfat[icont] = 6;
 
-  double const dt2 = $(bmm_power, double)(dt, 2);
+  double const e = bmm_dem_est_econt_one(dem, ict, ipart, icont, jpart);
+  dem->est.ebond += e;
+  if (ict == BMM_DEM_CT_WEAK)
+    dem->est.ewcont += e;
+  else
+    dem->est.escont += e;
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
-    for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
-      dem->part.x[ipart][idim] = dem->integ.params.beeman.xo[ipart][idim] +
-        dem->integ.params.beeman.vo[ipart][idim] * dt +
-        (1.0 / 2.0) * (1.0 / 4.0) * (dem->part.a[ipart][idim] +
-            3.0 * dem->integ.params.beeman.ao[ipart][idim]) * dt2;
+  // Joining fragments is cheap, unlike splitting them.
+  if (ict == BMM_DEM_CT_STRONG && !dem->frag.stale)
+    (void) bmm_dem_djs_union(dem->frag.iparent, ipart, jpart);
 
-      if (dem->opts.box.per[idim])
-        dem->part.x[ipart][idim] = $(bmm_uwrap, double)(dem->part.x[ipart][idim],
-            dem->opts.box.x[idim]);
+  if (ict == BMM_DEM_CT_STRONG)
+    bmm_dem_clump_break(dem, ipart, jpart);
 
-      dem->part.v[ipart][idim] = dem->integ.params.beeman.vo[ipart][idim] +
-        (1.0 / 8.0) * (3.0 * dem->part.a[ipart][idim] +
-            6.0 * dem->integ.params.beeman.ao[ipart][idim] -
-            dem->integ.params.beeman.aoo[ipart][idim]) * dt;
-    }
+  bmm_dem_sleep_poke(dem, ipart, jpart);
 
-    dem->part.phi[ipart] = dem->integ.params.beeman.phio[ipart] +
-      dem->integ.params.beeman.omegao[ipart] * dt +
-      (1.0 / 2.0) * (1.0 / 3.0) * (dem->part.alpha[ipart] +
-          2.0 * dem->integ.params.beeman.alphao[ipart]) * dt2;
+  // TODO Really?
+  // dem->cache.stale = true;
 
-    dem->part.omega[ipart] = dem->integ.params.beeman.omegao[ipart] +
-      (1.0 / 6.0) * (2.0 * dem->part.alpha[ipart] +
-          5.0 * dem->integ.params.beeman.alphao[ipart] -
-          dem->integ.params.beeman.alphaoo[ipart]) * dt;
-  }
+  return icont;
 }
 
-void bmm_dem_stab(struct bmm_dem *const dem) {
-  // We could reset windings here,
-  // but that would interfere with beam models,
-  // so we relax instead.
+size_t bmm_dem_addcont(struct bmm_dem *const dem,
+    enum bmm_dem_ct const ict, size_t const ipart, size_t const jpart) {
+  // TODO Does this ever fail?
+  // dynamic_assert(ipart < jpart, "Yes");
+  if (ipart < jpart)
+    return bmm_dem_addcont_unsafe(dem, ict, ipart, jpart);
+  else
+    return bmm_dem_addcont_unsafe(dem, ict, jpart, ipart);
 }
 
-void bmm_dem_predict(struct bmm_dem *const dem) {
-  switch (dem->integ.tag) {
-    case BMM_DEM_INTEG_VELVET:
-      bmm_dem_integ_vel(dem);
-
-      break;
-    case BMM_DEM_INTEG_BEEMAN:
-      bmm_dem_integ_bee(dem);
-
-      break;
-    case BMM_DEM_INTEG_KURAEV:
-      bmm_dem_integ_kura(dem);
+/// The call `bmm_dem_copycont(dem, ipart, icont, jcont)`
+/// reassigns the contact `jcont` to `icont` for the particle `ipart`.
+__attribute__ ((__nonnull__))
+static void bmm_dem_copycont(struct bmm_dem *const dem,
+    enum bmm_dem_ct const ict, size_t const ipart, size_t const icont, size_t const jcont) {
+  dem->pair[ict].cont.src[ipart].itgt[icont] = dem->pair[ict].cont.src[ipart].itgt[jcont];
 
-      break;
-  }
-}
+  dem->pair[ict].cont.src[ipart].drest[icont] = dem->pair[ict].cont.src[ipart].drest[jcont];
 
-void bmm_dem_correct(struct bmm_dem *const dem) {
-  switch (dem->integ.tag) {
-    case BMM_DEM_INTEG_EULER:
-      bmm_dem_integ_euler(dem);
+  for (size_t iend = 0; iend < BMM_NEND; ++iend)
+    dem->pair[ict].cont.src[ipart].psirest[icont][iend] = dem->pair[ict].cont.src[ipart].psirest[jcont][iend];
 
-      break;
-    case BMM_DEM_INTEG_TAYLOR:
-      bmm_dem_integ_taylor(dem);
+  dem->pair[ict].cont.src[ipart].strength[icont] = dem->pair[ict].cont.src[ipart].strength[jcont];
 
-      break;
-    case BMM_DEM_INTEG_VELVET:
-      bmm_dem_integ_vet(dem);
+  dem->pair[ict].cont.src[ipart].tfat[icont] = dem->pair[ict].cont.src[ipart].tfat[jcont];
+}
 
-      break;
-    case BMM_DEM_INTEG_BEEMAN:
-      bmm_dem_integ_man(dem);
+void bmm_dem_remcont_unsafe(struct bmm_dem *const dem,
+    enum bmm_dem_ct const ict, size_t const ipart, size_t const icont, size_t const jpart) {
+  // fprintf(stderr, "Remove contact %zu out of %zu from %zu to %zu.\n", icont, dem->pair[ict].cont.src[ipart].n, ipart, jpart);
 
-      break;
-    case BMM_DEM_INTEG_KURAEV:
-      bmm_dem_integ_ev(dem);
+  --dem->pair[ict].cont.src[ipart].n;
+  ++dem->prof.nrem;
 
-      break;
-  }
-}
+  size_t const jcont = dem->pair[ict].cont.src[ipart].n;
 
-bool bmm_dem_fault_pair(struct bmm_dem *const dem,
-    size_t const ipart, size_t const jpart, size_t const icont) {
-  bool const iind = dem->opts.script.params[dem->script.i].fault.
-    ind(dem->part.x[ipart], &dem->opts);
+  if (jcont != icont)
+    bmm_dem_copycont(dem, ict, ipart, icont, jcont);
 
-  bool const jind = dem->opts.script.params[dem->script.i].fault.
-    ind(dem->part.x[jpart], &dem->opts);
+  bmm_dem_cont_sign(dem, ict, ipart);
 
-  if (iind != jind) {
-    bmm_dem_remcont(dem, BMM_DEM_CT_STRONG, ipart, jpart, icont);
+  if (ict == BMM_DEM_CT_STRONG) {
+    dem->frag.stale = true;
 
-    return true;
+    bmm_dem_clump_break(dem, ipart, jpart);
   }
 
-  return false;
+  bmm_dem_sleep_poke(dem, ipart, jpart);
+
+  // TODO Really?
+  // dem->cache.stale = true;
 }
 
-void bmm_dem_fault(struct bmm_dem *const dem) {
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    for (size_t icont = 0; icont < dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].n; ++icont) {
-      size_t const jpart = dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].itgt[icont];
+void bmm_dem_remcont(struct bmm_dem *const dem,
+    enum bmm_dem_ct const ict, size_t apart, size_t bpart, size_t const icont) {
+  // TODO Does this ever fail?
+  // dynamic_assert(ipart < jpart, "Yes");
+  size_t const ipart = $(bmm_min, size_t)(apart, bpart);
+  size_t const jpart = $(bmm_max, size_t)(apart, bpart);
 
-      if (bmm_dem_fault_pair(dem, ipart, jpart, icont))
-        --icont;
-    }
+  double const e = bmm_dem_est_econt_one(dem, ict, ipart, icont, jpart);
+  dem->est.eyieldis += e;
+  if (ict == BMM_DEM_CT_WEAK)
+    dem->est.ewcont -= e;
+  else
+    dem->est.escont -= e;
+
+  bmm_dem_remcont_unsafe(dem, ict, ipart, icont, jpart);
 }
 
-bool bmm_dem_link_pair(struct bmm_dem *const dem,
-    size_t const ipart, size_t const jpart) {
-  // TODO Settle these order problems.
-  if (ipart >= jpart) {
-    return bmm_dem_link_pair(dem, jpart, ipart);
-  }
+// Contacts are marked for removal with one bit each.
+static_assert(BMM_MCONTACT <= CHAR_BIT * sizeof (unsigned int),
+    "Too many contacts per particle");
+
+/// The call `bmm_dem_remconts(dem, ict, ipart, brk)`
+/// works like `bmm_dem_remcont`
+/// for every contact of the type `ict` from the particle `ipart`
+/// whose bit is set in `brk`,
+/// but compacts the remaining contacts in one pass
+/// without changing their order.
+/// The number of contacts removed is returned.
+__attribute__ ((__nonnull__))
+static size_t bmm_dem_remconts(struct bmm_dem *const dem,
+    enum bmm_dem_ct const ict, size_t const ipart, unsigned int const brk) {
+  size_t const ncont = dem->pair[ict].cont.src[ipart].n;
 
-  double xdiffij[BMM_NDIM];
-  bmm_geom2d_cpdiff(xdiffij, dem->part.x[jpart], dem->part.x[ipart],
-      dem->opts.box.x, dem->opts.box.per);
+  size_t jcont = 0;
+  for (size_t icont = 0; icont < ncont; ++icont) {
+    size_t const jpart = dem->pair[ict].cont.src[ipart].itgt[icont];
 
-  double const d2 = bmm_geom2d_norm2(xdiffij);
+    if ((brk & (1u << icont)) == 0) {
+      if (jcont != icont)
+        bmm_dem_copycont(dem, ict, ipart, jcont, icont);
 
-  double const r = dem->part.r[ipart] + dem->part.r[jpart];
-  double const r2 = $(bmm_power, double)(r, 2);
+      ++jcont;
 
-  if (d2 > r2 * dem->bond.ccrcont)
-    return true;
+      continue;
+    }
 
-  size_t const icont = bmm_dem_search_cont(dem, BMM_DEM_CT_WEAK, ipart, jpart);
-  if (icont != SIZE_MAX)
-    bmm_dem_remcont(dem, BMM_DEM_CT_WEAK, ipart, jpart, icont);
+    double const e = bmm_dem_est_econt_one(dem, ict, ipart, icont, jpart);
+    dem->est.eyieldis += e;
+    if (ict == BMM_DEM_CT_WEAK)
+      dem->est.ewcont -= e;
+    else
+      dem->est.escont -= e;
 
-  return bmm_dem_addcont(dem, BMM_DEM_CT_STRONG, ipart, jpart) != SIZE_MAX;
-}
+    ++dem->prof.nrem;
 
-// TODO Check triangulation quality and compare with Delaunay.
-bool bmm_dem_link(struct bmm_dem *const dem) {
-  switch (dem->cache.tag) {
-    case BMM_DEM_CACHE_NONE:
-      for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-        for (size_t jpart = ipart + 1; jpart < dem->part.n; ++jpart)
-          if (!bmm_dem_link_pair(dem, ipart, jpart))
-            return false;
+    if (ict == BMM_DEM_CT_STRONG) {
+      dem->frag.stale = true;
 
-      break;
-    case BMM_DEM_CACHE_NEIGH:
-      for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-        for (size_t ineigh = 0; ineigh < dem->cache.neigh[ipart].n; ++ineigh)
-          if (!bmm_dem_link_pair(dem, ipart, dem->cache.neigh[ipart].i[ineigh]))
-            return false;
+      bmm_dem_clump_break(dem, ipart, jpart);
+    }
 
-      break;
+    bmm_dem_sleep_poke(dem, ipart, jpart);
   }
 
-  return true;
-}
+  dem->pair[ict].cont.src[ipart].n = jcont;
 
-bool bmm_dem_uncont(struct bmm_dem *const dem) {
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].n = 0;
+  bmm_dem_cont_sign(dem, ict, ipart);
 
-  return true;
+  return ncont - jcont;
 }
 
-// TODO Interval arithmetic.
-// TODO Not quite! Edges may overlap if periodicity is turned on.
+/// The call `bmm_dem_yield_crit(dem, ipart, jpart, icont, fnormij, ftangij)`
+/// returns how far along the yield criterion of the simulation `dem`
+/// the strong contact `icont`
+/// between the particles `ipart` and `jpart` is
+/// when it carries the normal force `fnormij`,
+/// which is positive in compression,
+/// and the tangential force `ftangij`,
+/// with the contact yielding once the result exceeds one.
 __attribute__ ((__nonnull__, __pure__))
-static bool bmm_dem_inside(struct bmm_dem const *const dem,
-    size_t const ipart) {
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    if (dem->part.x[ipart][idim] < 0.0 ||
-        dem->part.x[ipart][idim] >= dem->opts.box.x[idim])
-      return false;
+static double bmm_dem_yield_crit(struct bmm_dem const *const dem,
+    size_t const ipart, size_t const jpart, size_t const icont,
+    double const fnormij, double const ftangij) {
+  size_t const ict = BMM_DEM_CT_STRONG;
 
-  return true;
+  double const aij = M_PI * $(bmm_power, double)(
+      dem->pair[ict].cont.src[ipart].strength[icont] *
+      $(bmm_min, double)(dem->part.r[ipart], dem->part.r[jpart]), 2);
+
+  double const sigmanormij = fnormij / aij;
+  double const sigmatangij = ftangij / aij;
+
+  double const sigmacrit = fnormij < 0.0 ?
+    dem->yield.params.ze.sigmacrit : dem->yield.params.ze.sigmacritt;
+  double const taucrit = fnormij < 0.0 ?
+    dem->yield.params.ze.taucrit : dem->yield.params.ze.taucritt;
+
+  switch (dem->yield.tag) {
+    case BMM_DEM_YIELD_ZE:
+      return $(bmm_power, double)(sigmanormij / sigmacrit, 2) +
+        $(bmm_power, double)(sigmatangij / taucrit, 2);
+  }
+
+  return 0.0;
 }
 
-// TODO Not quite! Edges may be excavated if periodicity is turned off.
+// I broke this to only work with KV and BEAM.
+/// The call `bmm_dem_yield_load(dem, ipart, jpart, icont, xdiffij, kij)`
+/// works like `bmm_dem_yield_crit`
+/// for the forces the strong contact `icont`
+/// between the particles `ipart` and `jpart`
+/// that are `xdiffij` apart across `kij` periodic images
+/// carries in the simulation `dem`.
 __attribute__ ((__nonnull__, __pure__))
-static bool bmm_dem_insider(struct bmm_dem const *const dem,
-    size_t const ipart) {
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    if (dem->part.x[ipart][idim] - dem->part.r[ipart] < 0.0 ||
-        dem->part.x[ipart][idim] + dem->part.r[ipart] >= dem->opts.box.x[idim])
-      return false;
+static double bmm_dem_yield_load(struct bmm_dem const *const dem,
+    size_t const ipart, size_t const jpart, size_t const icont,
+    double const *const xdiffij, double const kij) {
+  size_t const ict = BMM_DEM_CT_STRONG;
 
-  return true;
-}
+  double const ri = dem->part.r[ipart];
+  double const rj = dem->part.r[jpart];
+  // double const r = ri + rj;
+  double const r = dem->pair[ict].cont.src[ipart].drest[icont];
+  double const r2 = $(bmm_power, double)(r, 2);
 
-__attribute__ ((__nonnull__))
-static void bmm_dem_script_clip(struct bmm_dem *const dem) {
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    if (!bmm_dem_inside(dem, ipart)) {
-      bmm_dem_rempart(dem, ipart);
-      --ipart;
-    }
+  double const d2 = bmm_geom2d_norm2(xdiffij);
+  double const d = sqrt(d2);
 
-  // TODO See (N583).
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict)
-      dem->pair[ict].cont.src[ipart].n = 0;
-}
+  double xnormij[BMM_NDIM];
+  bmm_geom2d_scale(xnormij, xdiffij, 1.0 / d);
 
-__attribute__ ((__nonnull__))
-double bmm_dem_bulkmod(struct bmm_dem const *const dem) {
-  return dem->opts.part.ycomp / (3.0 * (1.0 - 2.0 * dem->opts.part.nu));
-}
+  double xtangij[BMM_NDIM];
+  bmm_geom2d_rperp(xtangij, xnormij);
 
-__attribute__ ((__nonnull__))
-double bmm_dem_shearmod(struct bmm_dem const *const dem) {
-  return dem->opts.part.ycomp / (2.0 * (1.0 + dem->opts.part.nu));
-}
+  double vdiffij[BMM_NDIM];
+  bmm_dem_vdiff(vdiffij, dem, dem->part.v[jpart], dem->part.v[ipart], kij);
 
-__attribute__ ((__nonnull__))
-double bmm_dem_pwavec(struct bmm_dem const *const dem) {
-  return sqrt((bmm_dem_bulkmod(dem) +
-        (4.0 / 3.0) * bmm_dem_shearmod(dem)) / dem->opts.part.rho);
-}
+  double const xi = r - d;
+  double const vnormij = -bmm_geom2d_dot(vdiffij, xnormij);
+  double const reff = $(bmm_resum2, double)(ri, rj);
+  double const dt = dem->script.dt;
 
-__attribute__ ((__nonnull__))
-double bmm_dem_swavec(struct bmm_dem const *const dem) {
-  return sqrt(bmm_dem_shearmod(dem) / dem->opts.part.rho);
-}
+  double const fnorm = dem->pair[ict].norm.params.dashpot.k * xi +
+    dem->pair[ict].norm.params.dashpot.gamma * vnormij;
 
-static bool export_s(struct bmm_dem const *const dem) {
-  char buf[BUFSIZ];
-  (void) snprintf(buf, sizeof buf, "./%s-s.data",
-      dem->opts.script.params[dem->script.i].expr.str);
+  double const lambdaij = bmm_geom2d_dir(xdiffij);
+  double const lambdaji = $(bmm_swrap, double)(lambdaij + M_PI, M_2PI);
+  double const phii = dem->part.phi[ipart];
+  double const phij = dem->part.phi[jpart];
+  double const psii = phii - lambdaij;
+  double const psij = phij - lambdaji;
 
-  FILE *const stream = fopen(buf, "w");
-  if (stream == NULL) {
-    BMM_TLE_STDS();
+  double const dpsii = $(bmm_swrap, double)(psii - dem->pair[ict].cont.src[ipart].psirest[icont][BMM_DEM_END_TAIL], M_2PI);
+  double const dpsij = $(bmm_swrap, double)(psij - dem->pair[ict].cont.src[ipart].psirest[icont][BMM_DEM_END_HEAD], M_2PI);
 
-    return false;
-  }
+  double zetai = dem->part.r[ipart] * dpsii;
+  double zetaj = dem->part.r[jpart] * dpsij;
 
-  if (fprintf(stream, "%g\n", dem->est.sk) < 0) {
-    BMM_TLE_STDS();
+  double const proj = bmm_geom2d_dot(xtangij, vdiffij) / d;
+  double const dzetai = ri * (dem->part.omega[ipart] - proj);
+  double const dzetaj = rj * (dem->part.omega[jpart] - proj);
 
-    return false;
-  }
+  double const ftangconsi = dem->pair[ict].tang.params.beam.k * zetai;
+  double const ftangconsj = dem->pair[ict].tang.params.beam.k * zetaj;
 
-  if (fclose(stream) != 0) {
-    BMM_TLE_STDS();
+  double const ftangdissi = dem->pair[ict].tang.params.beam.dk * dzetai;
+  double const ftangdissj = dem->pair[ict].tang.params.beam.dk * dzetaj;
 
-    return false;
-  }
+  double const ftangi = ftangconsi + ftangdissi;
+  double const ftangj = ftangconsj + ftangdissj;
 
-  return true;
-}
+  double const taui = ri * ftangi;
+  double const tauj = rj * ftangj;
 
-static bool export_chi(struct bmm_dem const *const dem) {
-  char buf[BUFSIZ];
-  (void) snprintf(buf, sizeof buf, "./%s-chi.data",
-      dem->opts.script.params[dem->script.i].expr.str);
+  double const ftang = (taui + tauj) / d;
 
-  FILE *const stream = fopen(buf, "w");
-  if (stream == NULL) {
-    BMM_TLE_STDS();
+  double const fnormij = fnorm;
+  double const ftangij = $(bmm_abs, double)(ftang);
 
+  return bmm_dem_yield_crit(dem, ipart, jpart, icont, fnormij, ftangij);
+}
+
+/// The call `bmm_dem_yield_pair(dem, ipart, jpart, icont)`
+/// checks whether the strong contact `icont`
+/// between the particles `ipart` and `jpart`
+/// yields in the simulation `dem`.
+__attribute__ ((__nonnull__, __pure__))
+static bool bmm_dem_yield_pair(struct bmm_dem const *const dem,
+    size_t const ipart, size_t const jpart, size_t const icont) {
+  // Sources precede their targets,
+  // so both are free if the target is.
+  if (jpart >= bmm_dem_role_end(dem, BMM_DEM_ROLE_FREE) ||
+      (!dem->cache.parted &&
+       (dem->part.role[ipart] != BMM_DEM_ROLE_FREE ||
+        dem->part.role[jpart] != BMM_DEM_ROLE_FREE)) ||
+      bmm_dem_sleeping(dem, ipart, jpart) || bmm_dem_rigid(dem, ipart, jpart))
     return false;
-  }
 
-  if (fprintf(stream, "%g\n", dem->est.chi) < 0) {
-    BMM_TLE_STDS();
+  double xdiffij[BMM_NDIM];
+  double const kij = bmm_dem_pdiff(xdiffij, dem,
+      dem->part.x[jpart], dem->part.x[ipart]);
 
-    return false;
-  }
+  return bmm_dem_yield_load(dem, ipart, jpart, icont, xdiffij, kij) > 1.0;
+}
 
-  if (fclose(stream) != 0) {
-    BMM_TLE_STDS();
+/// The call `bmm_dem_yield(dem)`
+/// breaks the strong contacts that yield in the simulation `dem`.
+/// The yield criteria are first evaluated in parallel,
+/// because nothing changes until every contact has been marked,
+/// and the marked contacts are then removed in particle order,
+/// so that the outcome does not depend on the number of threads.
+__attribute__ ((__nonnull__))
+static void bmm_dem_yield(struct bmm_dem *const dem) {
+  if (dem->yield.tag == BMM_DEM_YIELD_NONE)
+    return;
 
-    return false;
+  size_t const npart = dem->part.n;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) \
+  num_threads((int) dem->opts.thread.n)
+#endif
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    unsigned int brk = 0;
+
+    for (size_t icont = 0;
+        icont < dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].n; ++icont)
+      if (bmm_dem_yield_pair(dem, ipart,
+            dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].itgt[icont], icont))
+        brk |= 1u << icont;
+
+    dem->batch.brk[ipart] = brk;
   }
 
-  return true;
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    if (dem->batch.brk[ipart] != 0)
+      dem->prof.nyield += bmm_dem_remconts(dem, BMM_DEM_CT_STRONG,
+          ipart, dem->batch.brk[ipart]);
 }
 
-static bool export_x(struct bmm_dem const *const dem) {
-  char buf[BUFSIZ];
-  (void) snprintf(buf, sizeof buf, "./%s-x.data",
-      dem->opts.script.params[dem->script.i].expr.str);
-
-  FILE *const stream = fopen(buf, "w");
-  if (stream == NULL) {
-    BMM_TLE_STDS();
+/// The call `bmm_dem_analyze_cached(dem, ipart, jpart, ineigh)`
+/// works like `bmm_dem_analyze_pair`,
+/// but takes the geometry of the pair from the cached neighbor `ineigh`
+/// unless it is `SIZE_MAX`.
+__attribute__ ((__nonnull__))
+static void bmm_dem_analyze_cached(struct bmm_dem *const dem,
+    size_t const ipart, size_t const jpart, size_t const ineigh) {
+  // TODO Settle these order problems.
+  if (ipart >= jpart) {
+    bmm_dem_analyze_cached(dem, jpart, ipart, ineigh);
 
-    return false;
+    return;
   }
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    if (fprintf(stream, "(%g, %g)\n",
-          dem->part.x[ipart][0], dem->part.x[ipart][1]) < 0) {
-      BMM_TLE_STDS();
+  if (bmm_dem_sleeping(dem, ipart, jpart) || bmm_dem_rigid(dem, ipart, jpart))
+    return;
 
-      return false;
-    }
+  double xdiffij[BMM_NDIM];
+  (void) bmm_dem_cache_pdiff(xdiffij, dem, ipart, jpart, ineigh);
 
-  if (fclose(stream) != 0) {
-    BMM_TLE_STDS();
+  // Strong contacts that yield are already gone by now.
+  if (bmm_dem_search_cont(dem, BMM_DEM_CT_STRONG, ipart, jpart) == SIZE_MAX) {
+    double const d2 = bmm_geom2d_norm2(xdiffij);
+    double const r2 = $(bmm_power, double)(dem->part.r[ipart] + dem->part.r[jpart], 2);
+    bool const overlap = d2 < r2;
 
-    return false;
+    size_t const jcont = bmm_dem_search_cont(dem, BMM_DEM_CT_WEAK, ipart, jpart);
+    if (jcont != SIZE_MAX) {
+      if (!overlap)
+        bmm_dem_remcont(dem, BMM_DEM_CT_WEAK, ipart, jpart, jcont);
+    } else {
+      if (overlap)
+        bmm_dem_addcont(dem, BMM_DEM_CT_WEAK, ipart, jpart);
+    }
   }
+}
 
-  return true;
+void bmm_dem_analyze_pair(struct bmm_dem *const dem,
+    size_t const ipart, size_t const jpart) {
+  bmm_dem_analyze_cached(dem, ipart, jpart, SIZE_MAX);
 }
 
-static bool export_phi(struct bmm_dem const *const dem) {
-  char buf[BUFSIZ];
-  (void) snprintf(buf, sizeof buf, "./%s-phi.data",
-      dem->opts.script.params[dem->script.i].expr.str);
+void bmm_dem_analyze(struct bmm_dem *const dem) {
+  switch (dem->cache.tag) {
+    case BMM_DEM_CACHE_NONE:
+      for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+        for (size_t jpart = ipart + 1; jpart < dem->part.n; ++jpart)
+          bmm_dem_analyze_pair(dem, ipart, jpart);
 
-  FILE *const stream = fopen(buf, "w");
-  if (stream == NULL) {
-    BMM_TLE_STDS();
+      break;
+    case BMM_DEM_CACHE_NEIGH:
+    case BMM_DEM_CACHE_LEVEL:
+      if (dem->opts.cache.ghost)
+        bmm_dem_cache_ghost_move(dem);
 
-    return false;
+      for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+        for (size_t ineigh = dem->cache.neigh[ipart].i;
+            ineigh < dem->cache.neigh[ipart].i + dem->cache.neigh[ipart].n;
+            ++ineigh) {
+          size_t const jpart = dem->cache.ineigh[ineigh];
+
+          bmm_dem_analyze_cached(dem, ipart, jpart, ineigh);
+        }
+
+      break;
   }
+}
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    if (fprintf(stream, "%g\n", dem->part.phi[ipart]) < 0) {
-      BMM_TLE_STDS();
+/// The call `bmm_dem_recap(dem, nnew)`
+/// tries to move every particle array of the simulation `dem`
+/// into new arrays with room for `nnew` particles,
+/// where `nnew` is at least the current capacity.
+/// Moving to the same capacity is useful after pinning threads,
+/// because it makes the pinned threads touch every page anew.
+/// If the operation is successful,
+/// `true` is returned.
+/// Otherwise `false` is returned and the old capacity is kept.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_recap(struct bmm_dem *const dem, size_t const nnew) {
+  size_t const ncap = dem->part.ncap;
+
+  // Every array is regrown separately,
+  // so a failure at any point leaves the old capacity intact.
+#define REGROW(x) \
+  begin \
+    void *const ptr = bmm_dem_regrow(dem, (x), ncap, nnew, sizeof *(x)); \
+    if (ptr == NULL) { \
+      BMM_TLE_STDS(); \
+      \
+      return false; \
+    } \
+    \
+    (x) = ptr; \
+  end
+
+  REGROW(dem->part.l);
+  REGROW(dem->part.role);
+  REGROW(dem->part.r);
+  REGROW(dem->part.m);
+  REGROW(dem->part.jred);
+  REGROW(dem->part.x);
+  REGROW(dem->part.v);
+  REGROW(dem->part.a);
+  REGROW(dem->part.phi);
+  REGROW(dem->part.omega);
+  REGROW(dem->part.alpha);
+  REGROW(dem->part.f);
+  REGROW(dem->part.tau);
 
-      return false;
-    }
+  switch (dem->integ.tag) {
+    case BMM_DEM_INTEG_VELVET:
+      REGROW(dem->integ.params.velvet.ao);
+      REGROW(dem->integ.params.velvet.alphao);
 
-  if (fclose(stream) != 0) {
-    BMM_TLE_STDS();
+      break;
+    case BMM_DEM_INTEG_BEEMAN:
+    case BMM_DEM_INTEG_KURAEV:
+      REGROW(dem->integ.params.beeman.ao);
+      REGROW(dem->integ.params.beeman.aoo);
+      REGROW(dem->integ.params.beeman.alphao);
+      REGROW(dem->integ.params.beeman.alphaoo);
 
-    return false;
+      break;
+    case BMM_DEM_INTEG_RESPA:
+      REGROW(dem->integ.params.respa.f);
+      REGROW(dem->integ.params.respa.tau);
+
+      break;
   }
 
-  return true;
-}
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict)
+    REGROW(dem->pair[ict].cont.src);
 
-static bool export_r(struct bmm_dem const *const dem) {
-  char buf[BUFSIZ];
-  (void) snprintf(buf, sizeof buf, "./%s-r.data",
-      dem->opts.script.params[dem->script.i].expr.str);
+  REGROW(dem->cache.j);
+  REGROW(dem->cache.x);
+  REGROW(dem->cache.ijcell);
+#if BMM_MIXED
+  REGROW(dem->cache.xrel);
+#endif
+  REGROW(dem->cache.icell);
+  REGROW(dem->cache.ipart);
+  REGROW(dem->cache.neigh);
 
-  FILE *const stream = fopen(buf, "w");
-  if (stream == NULL) {
-    BMM_TLE_STDS();
+  if (dem->opts.cache.ghost) {
+    REGROW(dem->cache.ghost.x);
+    REGROW(dem->cache.ghost.k);
+  }
 
-    return false;
+  if (dem->cache.tag == BMM_DEM_CACHE_LEVEL) {
+    REGROW(dem->cache.level.ilevel);
+    REGROW(dem->cache.level.icell);
+    REGROW(dem->cache.level.ipart);
   }
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    if (fprintf(stream, "%g\n", dem->part.r[ipart]) < 0) {
-      BMM_TLE_STDS();
+  REGROW(dem->comm.x);
+  REGROW(dem->comm.phi);
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict)
+    REGROW(dem->comm.src[ict]);
 
-      return false;
-    }
+  for (size_t iacc = 1; iacc < bmm_dem_nacc(dem); ++iacc) {
+    REGROW(dem->thread.acc[iacc].f);
+    REGROW(dem->thread.acc[iacc].tau);
+  }
 
-  if (fclose(stream) != 0) {
-    BMM_TLE_STDS();
+  REGROW(dem->frag.iparent);
+  REGROW(dem->frag.nmemb);
 
-    return false;
+  REGROW(dem->sleep.asleep);
+  REGROW(dem->sleep.poke);
+  REGROW(dem->sleep.nquiet);
+  REGROW(dem->sleep.fref);
+  REGROW(dem->sleep.iparent);
+  REGROW(dem->sleep.wake);
+
+  REGROW(dem->clump.body);
+  REGROW(dem->clump.ibody);
+  REGROW(dem->clump.d);
+  REGROW(dem->clump.dphi);
+  REGROW(dem->clump.nlink);
+
+  REGROW(dem->batch.rem);
+  REGROW(dem->batch.brk);
+
+  if (dem->opts.field.on) {
+    REGROW(dem->field.s);
+
+    for (size_t iacc = 1; iacc < bmm_dem_nacc(dem); ++iacc)
+      REGROW(dem->thread.acc[iacc].s);
   }
 
+#undef REGROW
+
+  dem->part.ncap = nnew;
+
   return true;
 }
 
-static bool export_c(struct bmm_dem const *const dem) {
-  char buf[BUFSIZ];
-  (void) snprintf(buf, sizeof buf, "./%s-c.data",
-      dem->opts.script.params[dem->script.i].expr.str);
+bool bmm_dem_reserve(struct bmm_dem *const dem, size_t const npart) {
+  size_t const ncap = dem->part.ncap;
 
-  FILE *const stream = fopen(buf, "w");
-  if (stream == NULL) {
-    BMM_TLE_STDS();
+  if (npart <= ncap)
+    return true;
 
-    return false;
-  }
+  return bmm_dem_recap(dem, $(bmm_max, size_t)(npart,
+        ncap > SIZE_MAX / 2 ? SIZE_MAX : ncap * 2));
+}
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    if (fprintf(stream, "%d\n", dem->part.role[ipart]) < 0) {
-      BMM_TLE_STDS();
+bool bmm_dem_cache_reserve(struct bmm_dem *const dem, size_t const nneigh) {
+  size_t const ncap = dem->cache.ncapneigh;
 
-      return false;
-    }
+  if (nneigh <= ncap)
+    return true;
 
-  if (fclose(stream) != 0) {
+  size_t const nnew = $(bmm_max, size_t)(nneigh,
+      ncap > SIZE_MAX / 2 ? SIZE_MAX : ncap * 2);
+
+  void *const ptr = bmm_dem_regrow(dem, dem->cache.ineigh,
+      ncap, nnew, sizeof *dem->cache.ineigh);
+  if (ptr == NULL) {
     BMM_TLE_STDS();
 
     return false;
   }
 
+  dem->cache.ineigh = ptr;
+  dem->cache.ncapneigh = nnew;
+
   return true;
 }
 
-struct agraph {
-  struct {
-    size_t n;
-    size_t itgt[BMM_MCONTACT * 2];
-    bool visited[BMM_MCONTACT * 2];
-  } src[BMM_MPART];
-};
-
-struct acls {
-  struct agraph *agraph;
-  struct bmm_dem const *dem;
-  size_t ipart;
-};
-
-struct aface {
-  struct {
-    size_t n;
-    size_t ivert[BMM_MPART * 2];
-    double circ;
-    double area;
-  } poly[BMM_MPART * 4];
-  size_t lastseen[BMM_MPART];
-};
-
-__attribute__ ((__nonnull__, __pure__))
-static int acompar(size_t const i, size_t const j, void *const cls) {
-  struct acls const *const acls = cls;
-  struct bmm_dem const *const dem = acls->dem;
-  struct agraph const *const agraph = acls->agraph;
-  size_t const ipart = acls->ipart;
+double bmm_dem_random(struct bmm_dem const *const dem,
+    enum bmm_dem_stream const istream,
+    size_t const l, size_t const m, double const *const a) {
+  uint64_t const x[] = {l, m, dem->time.istep, istream};
+  uint64_t const k[] = {dem->seed, 0};
 
-  double gammai;
-  {
-    size_t const jpart = agraph->src[ipart].itgt[i];
+  return bmm_random_getctr(x, k, a);
+}
 
-    double xdiffij[BMM_NDIM];
-    bmm_geom2d_diff(xdiffij, dem->part.x[jpart], dem->part.x[ipart]);
+void bmm_dem_setrole(struct bmm_dem *const dem,
+    size_t const ipart, enum bmm_dem_role const role) {
+  if (dem->clump.ibody[ipart] != SIZE_MAX)
+    bmm_dem_clump_dissolve(dem, dem->clump.ibody[ipart]);
 
-    gammai = $(bmm_swrap, double)(bmm_geom2d_dir(xdiffij), M_2PI);
+  if (dem->part.role[ipart] != role) {
+    dem->cache.stale = true;
+    dem->cache.parted = false;
   }
 
-  double gammaj;
-  {
-    size_t const jpart = agraph->src[ipart].itgt[j];
+  --dem->part.nrole[dem->part.role[ipart]];
+  dem->part.role[ipart] = role;
+  ++dem->part.nrole[role];
+}
 
-    double xdiffij[BMM_NDIM];
-    bmm_geom2d_diff(xdiffij, dem->part.x[jpart], dem->part.x[ipart]);
+size_t bmm_dem_role_begin(struct bmm_dem const *const dem,
+    enum bmm_dem_role const role) {
+  if (!dem->cache.parted)
+    return 0;
 
-    gammaj = $(bmm_swrap, double)(bmm_geom2d_dir(xdiffij), M_2PI);
-  }
+  size_t ipart = 0;
+  for (enum bmm_dem_role jrole = 0; jrole < BMM_DEM_NROLE; ++jrole)
+    if (bmm_dem_role_rank(jrole) < bmm_dem_role_rank(role))
+      ipart += dem->part.nrole[jrole];
 
-  return $(bmm_cmp, double)(gammaj, gammai);
+  return ipart;
 }
 
-__attribute__ ((__nonnull__))
-static void aswap(size_t const i, size_t const j, void *const cls) {
-  struct acls *const acls = cls;
-  struct bmm_dem const *const dem = acls->dem;
-  struct agraph *const agraph = acls->agraph;
-  size_t const ipart = acls->ipart;
+size_t bmm_dem_role_end(struct bmm_dem const *const dem,
+    enum bmm_dem_role const role) {
+  if (!dem->cache.parted)
+    return dem->part.n;
 
-  size_t const tmp = agraph->src[ipart].itgt[i];
-  agraph->src[ipart].itgt[i] = agraph->src[ipart].itgt[j];
-  agraph->src[ipart].itgt[j] = tmp;
+  return bmm_dem_role_begin(dem, role) + dem->part.nrole[role];
 }
 
-static bool export_f(struct bmm_dem const *const dem) {
-  char buf[BUFSIZ];
-  (void) snprintf(buf, sizeof buf, "./%s-f.data",
-      dem->opts.script.params[dem->script.i].expr.str);
-
-  FILE *const stream = fopen(buf, "w");
-  if (stream == NULL) {
-    BMM_TLE_STDS();
+size_t bmm_dem_addpart(struct bmm_dem *const dem) {
+  size_t const ipart = dem->part.n;
 
-    return false;
-  }
+  if (ipart == SIZE_MAX - 1 || !bmm_dem_reserve(dem, ipart + 1))
+    return SIZE_MAX;
 
-  // Bidirectionalization of the strong contact graph.
-  // Following great programming conventions, I copied this from below.
-  struct agraph *const agraph = malloc(sizeof *agraph);
-  if (agraph == NULL) {
-    BMM_TLE_STDS();
+  ++dem->part.n;
+  dem->part.l[ipart] = dem->part.lnew;
+  ++dem->part.lnew;
 
-    return false;
-  }
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    agraph->src[ipart].n = 0;
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    for (size_t icont = 0; icont < dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].n; ++icont) {
-      size_t const jpart = dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].itgt[icont];
+  dem->comm.ikey = 0;
 
-      double d[BMM_NDIM];
-      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-        d[idim] = $(bmm_abs, double)
-          (dem->part.x[jpart][idim] - dem->part.x[ipart][idim]);
+  dem->part.role[ipart] = BMM_DEM_ROLE_FREE;
+  ++dem->part.nrole[BMM_DEM_ROLE_FREE];
+  dem->part.r[ipart] = 1.0;
+  dem->part.m[ipart] = 1.0;
+  dem->part.jred[ipart] = bmm_geom_ballprmoi(3);
 
-      // No winding.
-      if (d[0] < dem->opts.box.x[0] / 2.0 &&
-          d[1] < dem->opts.box.x[1] / 2.0) {
-        size_t const jcont = agraph->src[jpart].n;
-        agraph->src[jpart].itgt[jcont] = ipart;
-        ++agraph->src[jpart].n;
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    dem->part.x[ipart][idim] = 0.0;
 
-        // This makes them bidirectional.
-        size_t const kcont = agraph->src[ipart].n;
-        agraph->src[ipart].itgt[kcont] = jpart;
-        ++agraph->src[ipart].n;
-      }
-    }
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    dem->part.v[ipart][idim] = 0.0;
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    if (agraph->src[ipart].n == 0)
-      if (fprintf(stream, "%zu\n", ipart) < 0) {
-        BMM_TLE_STDS();
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    dem->part.a[ipart][idim] = 0.0;
 
-        return false;
-      }
+  dem->part.phi[ipart] = 0.0;
+  dem->part.omega[ipart] = 0.0;
+  dem->part.alpha[ipart] = 0.0;
 
-  free(agraph);
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    dem->part.f[ipart][idim] = 0.0;
 
-  if (fclose(stream) != 0) {
-    BMM_TLE_STDS();
+  dem->part.tau[ipart] = 0.0;
 
-    return false;
-  }
+  switch (dem->integ.tag) {
+    case BMM_DEM_INTEG_BEEMAN:
+    case BMM_DEM_INTEG_KURAEV:
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+        dem->integ.params.beeman.ao[ipart][idim] = 0.0;
 
-  return true;
-}
+      dem->integ.params.beeman.alphao[ipart] = 0.0;
 
-static bool export_p(struct bmm_dem const *const dem) {
-  char buf[BUFSIZ];
-  (void) snprintf(buf, sizeof buf, "./%s-p.data",
-      dem->opts.script.params[dem->script.i].expr.str);
+      break;
+    case BMM_DEM_INTEG_RESPA:
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+        dem->integ.params.respa.f[ipart][idim] = 0.0;
 
-  FILE *const stream = fopen(buf, "w");
-  if (stream == NULL) {
-    BMM_TLE_STDS();
+      dem->integ.params.respa.tau[ipart] = 0.0;
 
-    return false;
+      break;
   }
 
-  // Bidirectionalization of the strong contact graph.
-  struct agraph *const agraph = malloc(sizeof *agraph);
-  if (agraph == NULL) {
-    BMM_TLE_STDS();
-
-    return false;
+  // The slot may have belonged to a particle that was removed.
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict) {
+    dem->pair[ict].cont.src[ipart].n = 0;
+    dem->pair[ict].cont.src[ipart].sig = 0;
   }
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    agraph->src[ipart].n = 0;
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    for (size_t icont = 0; icont < dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].n; ++icont) {
-      size_t const jpart = dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].itgt[icont];
 
-      double d[BMM_NDIM];
-      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-        d[idim] = $(bmm_abs, double)
-          (dem->part.x[jpart][idim] - dem->part.x[ipart][idim]);
+  dem->frag.iparent[ipart] = ipart;
 
-      // No winding.
-      if (d[0] < dem->opts.box.x[0] / 2.0 &&
-          d[1] < dem->opts.box.x[1] / 2.0) {
-        size_t const jcont = agraph->src[jpart].n;
-        agraph->src[jpart].itgt[jcont] = ipart;
-        ++agraph->src[jpart].n;
+  dem->sleep.asleep[ipart] = false;
+  dem->sleep.poke[ipart] = false;
+  dem->sleep.nquiet[ipart] = 0;
 
-        // This makes them bidirectional.
-        size_t const kcont = agraph->src[ipart].n;
-        agraph->src[ipart].itgt[kcont] = jpart;
-        ++agraph->src[ipart].n;
-      }
-    }
+  dem->clump.ibody[ipart] = SIZE_MAX;
 
-  // Angle ordering.
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
-    struct acls acls = {
-      .agraph = agraph,
-      .dem = dem,
-      .ipart = ipart
-    };
-    bmm_hsort_cls(agraph->src[ipart].n, acompar, aswap, &acls);
-    /*
-    for (size_t iarr = 0; iarr < agraph->src[ipart].n / 2; ++iarr)
-      agraph->src[ipart].itgt[iarr] = agraph->src[ipart].itgt[agraph->src[ipart].n - 1 - iarr];
-    */
-  }
-
-  // Preparations.
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    for (size_t iarr = 0; iarr < agraph->src[ipart].n; ++iarr)
-      agraph->src[ipart].visited[iarr] = false;
+  dem->batch.rem[ipart] = false;
 
-  // Elimination walk.
-  struct aface *const faces = malloc(sizeof *faces);
-  if (faces == NULL) {
-    BMM_TLE_STDS();
+  dem->cache.stale = true;
+  dem->cache.parted = false;
 
-    return false;
-  }
-  size_t nface = 0;
-  size_t ipart = 0;
-  while (ipart < dem->part.n) {
-    if (nface >= nmembof(faces->poly)) {
-      fprintf(stderr, "Out of face.\n");
-      break;
-    }
+  return ipart;
+}
+
+void bmm_dem_batch_begin(struct bmm_dem *const dem) {
+  dynamic_assert(!dem->batch.open, "Batch already open");
 
-    faces->poly[nface].n = 0;
+  dem->batch.open = true;
+  dem->batch.nrem = 0;
+}
 
-    faces->poly[nface].ivert[faces->poly[nface].n] = ipart;
-    ++faces->poly[nface].n;
+bool bmm_dem_batch_commit(struct bmm_dem *const dem) {
+  dynamic_assert(dem->batch.open, "Batch not open");
 
-    size_t narr = 0;
-    for (size_t iarr = 0; iarr < agraph->src[ipart].n; ++iarr)
-      if (!agraph->src[ipart].visited[iarr])
-        ++narr;
-    if (narr == 0) {
-      ++nface;
+  dem->batch.open = false;
 
-      ++ipart;
+  if (dem->batch.nrem == 0)
+    return true;
 
-      continue;
+  size_t const npart = dem->part.n;
+
+  // Clumps that lose particles would keep their masses.
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    if (dem->batch.rem[ipart] && dem->clump.ibody[ipart] != SIZE_MAX)
+      bmm_dem_clump_dissolve(dem, dem->clump.ibody[ipart]);
+
+  // The neighbor cache gets rebuilt anyway,
+  // so its arrays can hold the permutation and its inverse.
+  size_t *const perm = dem->cache.ipart;
+  size_t *const iperm = dem->cache.icell;
+
+  // Survivors keep their relative order,
+  // so contacts keep pointing forwards.
+  size_t nnew = 0;
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    if (dem->batch.rem[ipart]) {
+      dem->batch.rem[ipart] = false;
+      --dem->part.nrole[dem->part.role[ipart]];
+      iperm[ipart] = SIZE_MAX;
+    } else {
+      perm[nnew] = ipart;
+      iperm[ipart] = nnew;
+      ++nnew;
     }
 
-    size_t prev = SIZE_MAX;
-    size_t kpart = ipart;
+  dem->batch.nrem = 0;
 
-    size_t initarr = 0;
-    for (size_t iarr = 0; iarr < agraph->src[kpart].n; ++iarr) {
-      if (!agraph->src[kpart].visited[iarr]) {
-        initarr = iarr;
+  if (!bmm_dem_permute(dem, perm, iperm, nnew))
+    return false;
 
-        break;
-      }
+  // The vacated slots are reused by the next particles to be added.
+  for (size_t ipart = nnew; ipart < npart; ++ipart)
+    for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict) {
+      dem->pair[ict].cont.src[ipart].n = 0;
+      dem->pair[ict].cont.src[ipart].sig = 0;
     }
 
-more: ;
+  dem->part.n = nnew;
 
-    size_t inext;
-    if (prev == SIZE_MAX)
-      inext = initarr;
-    else {
-      size_t iback = 0;
-
-      for (size_t iarr = 0; iarr < agraph->src[kpart].n; ++iarr)
-        if (agraph->src[kpart].itgt[iarr] == prev) {
-          iback = iarr;
+  dem->cache.stale = true;
+  dem->frag.stale = true;
 
-          break;
-        }
+  return true;
+}
 
-      inext = 0;
-      for (size_t iarr = 0; iarr < agraph->src[kpart].n; ++iarr) {
-        size_t const off = (iback + 1 + iarr) % agraph->src[kpart].n;
-        if (!agraph->src[kpart].visited[off]) {
-          inext = off;
+void bmm_dem_batch_rempart(struct bmm_dem *const dem,
+    size_t const ipart) {
+  dynamic_assert(dem->batch.open, "Batch not open");
 
-          break;
-        }
-      }
-    }
+  if (!dem->batch.rem[ipart]) {
+    dem->batch.rem[ipart] = true;
+    ++dem->batch.nrem;
+  }
+}
 
-    // fprintf(stderr, "Visited %zu -> %zu.\n", kpart, agraph->src[kpart].itgt[inext]);
-    size_t const jpart = agraph->src[kpart].itgt[inext];
+bool bmm_dem_rempart(struct bmm_dem *const dem,
+    size_t const ipart) {
+  if (dem->batch.open) {
+    bmm_dem_batch_rempart(dem, ipart);
 
-    if (prev != SIZE_MAX)
-      agraph->src[kpart].visited[inext] = true;
+    return true;
+  }
 
-    if (jpart != ipart) {
-      prev = kpart;
-      kpart = jpart;
+  bmm_dem_batch_begin(dem);
+  bmm_dem_batch_rempart(dem, ipart);
 
-      faces->poly[nface].ivert[faces->poly[nface].n] = kpart;
-      ++faces->poly[nface].n;
+  return bmm_dem_batch_commit(dem);
+}
 
-      goto more;
-    } else {
-      size_t inextnext;
-      if (kpart == SIZE_MAX)
-        inextnext = initarr;
-      else {
-        size_t ibackback = 0;
+void bmm_dem_force_creeping(struct bmm_dem *const dem,
+    size_t const ipart) {
+  double const v = bmm_geom2d_norm(dem->part.v[ipart]);
 
-        for (size_t iarr = 0; iarr < agraph->src[jpart].n; ++iarr)
-          if (agraph->src[jpart].itgt[iarr] == kpart) {
-            ibackback = iarr;
+  if (v == 0.0)
+    return;
 
-            break;
-          }
+  double vunit[BMM_NDIM];
+  bmm_geom2d_scale(vunit, dem->part.v[ipart], 1.0 / v);
 
-        inextnext = 0;
-        for (size_t iarr = 0; iarr < agraph->src[jpart].n; ++iarr) {
-          size_t const off = (ibackback + 1 + iarr) % agraph->src[jpart].n;
-          if (!agraph->src[jpart].visited[off]) {
-            inextnext = off;
+  double const f = -3.0 * M_2PI * dem->amb.params.creeping.eta *
+    dem->part.r[ipart] * v;
 
-            break;
-          }
-        }
-      }
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    dem->part.f[ipart][idim] += f * vunit[idim];
 
-      if (inextnext != initarr) {
-        prev = kpart;
-        kpart = jpart;
+  double const tau = -4.0 * M_2PI * dem->amb.params.creeping.eta *
+    $(bmm_power, double)(dem->part.r[ipart], 3);
 
-        faces->poly[nface].ivert[faces->poly[nface].n] = kpart;
-        ++faces->poly[nface].n;
+  dem->part.tau[ipart] += tau * dem->part.omega[ipart];
 
-        goto more;
-      } else {
-        agraph->src[ipart].visited[initarr] = true;
+  double const dt = dem->script.dt;
+  dem->est.eambdis += fabs(f * v * dt);
+  dem->est.eambdis += fabs((tau / dem->part.r[ipart]) * v * dt);
+}
 
-        ++nface;
+// TODO Flatten these to allow loop-invariant code motion.
+void bmm_dem_force_ambient(struct bmm_dem *const dem, size_t const ipart) {
+  switch (dem->amb.tag) {
+    case BMM_DEM_AMB_FAXEN:
+      bmm_dem_force_creeping(dem, ipart);
 
-        continue;
-      }
-    }
+      break;
   }
+}
 
-  // Split self-intersections.
-restart: ;
-  for (size_t iface = 0; iface < nface; ++iface) {
-    for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-      faces->lastseen[ipart] = SIZE_MAX;
-
-    /*
-    fprintf(stderr, "Before split face %zu:", iface);
-    for (size_t ivert = 0; ivert < faces->poly[iface].n; ++ivert)
-      fprintf(stderr, " %zu", faces->poly[iface].ivert[ivert]);
-    fprintf(stderr, ".\n");
-    */
-
-    for (size_t ivert = 0; ivert < faces->poly[iface].n; ++ivert) {
-      size_t const ipart = faces->poly[iface].ivert[ivert];
-      size_t const jvert = faces->lastseen[ipart];
-
-      if (jvert == ivert) {
-        fprintf(stderr, "Choked real bad.\n");
-        goto unstart;
-      }
+/// The call `bmm_dem_force_kernel(dem, acc, ipart, jpart, icont, ict,
+/// xdiffij, kij, norm, tang)`
+/// adds the forces and torques of the contact `icont` of type `ict`
+/// between the particles `ipart` and `jpart`
+/// that are `xdiffij` apart across `kij` periodic images
+/// to the accumulator `acc` of the simulation `dem`,
+/// using the normal force model `norm` and the tangential force model `tang`.
+/// This is always inlined, so that constant models fold their branches away.
+__attribute__ ((__always_inline__, __nonnull__))
+static inline void bmm_dem_force_kernel(struct bmm_dem *const dem,
+    struct bmm_dem_facc *const acc,
+    size_t const ipart, size_t const jpart, size_t const icont,
+    enum bmm_dem_ct const ict,
+    double const *const xdiffij, double const kij,
+    enum bmm_dem_norm const norm, enum bmm_dem_tang const tang) {
+  double const d2 = bmm_geom2d_norm2(xdiffij);
+  if (d2 == 0.0)
+    return;
 
-      if (jvert != SIZE_MAX) {
-        /*
-        fprintf(stderr, "Needs to split at %zu (%zu) to %zu (%zu).\n",
-            jvert, faces->poly[iface].ivert[jvert],
-            ivert, faces->poly[iface].ivert[ivert]);
-        */
+  double const ri = dem->part.r[ipart];
+  double const rj = dem->part.r[jpart];
+  double const r = ri + rj;
+  double const r2 = $(bmm_power, double)(r, 2);
+  if (!dem->pair[ict].cohesive)
+    if (d2 > r2)
+      return;
 
-        if (nface >= nmembof(faces->poly)) {
-          fprintf(stderr, "Out of face again.\n");
-          goto unstart;
-        }
+  double const d = sqrt(d2);
 
-        // Copy midsection to new head.
-        faces->poly[nface].n = 0;
-        for (size_t iarr = jvert; iarr < ivert; ++iarr) {
-          faces->poly[nface].ivert[faces->poly[nface].n] = faces->poly[iface].ivert[iarr];
-          ++faces->poly[nface].n;
-        }
-        ++nface;
-
-        // Move tail over midsection.
-        for (size_t iarr = ivert; iarr < faces->poly[iface].n; ++iarr)
-          faces->poly[iface].ivert[iarr - (ivert - jvert)] = faces->poly[iface].ivert[iarr];
-        faces->poly[iface].n = faces->poly[iface].n - (ivert - jvert);
-
-        /*
-        fprintf(stderr, "After split face %zu: ", iface);
-        for (size_t ivert = 0; ivert < faces->poly[iface].n; ++ivert)
-          fprintf(stderr, "%zu ", faces->poly[iface].ivert[ivert]);
-        fprintf(stderr, "end.\n");
-
-        fprintf(stderr, "After split face %zu: ", nface - 1);
-        for (size_t ivert = 0; ivert < faces->poly[nface - 1].n; ++ivert)
-          fprintf(stderr, "%zu ", faces->poly[nface - 1].ivert[ivert]);
-        fprintf(stderr, "end.\n");
-        */
-
-        goto restart;
-      } else
-        faces->lastseen[ipart] = ivert;
-    }
-  }
-unstart: ;
+  double xnormij[BMM_NDIM];
+  bmm_geom2d_scale(xnormij, xdiffij, 1.0 / d);
 
-  // Face metrics.
-  for (size_t iface = 0; iface < nface; ++iface) {
-    faces->poly[iface].circ = 0.0;
-    faces->poly[iface].area = 0.0;
+  double xtangij[BMM_NDIM];
+  bmm_geom2d_rperp(xtangij, xnormij);
 
-    for (size_t ivert = 1; ivert < faces->poly[iface].n; ++ivert) {
-      size_t const ipart = faces->poly[iface].ivert[ivert - 1];
-      size_t const jpart = faces->poly[iface].ivert[ivert];
+  double vdiffij[BMM_NDIM];
+  bmm_dem_vdiff(vdiffij, dem, dem->part.v[jpart], dem->part.v[ipart], kij);
 
-      double xdiffij[BMM_NDIM];
-      bmm_geom2d_diff(xdiffij, dem->part.x[jpart], dem->part.x[ipart]);
+  double dxnorm = 0.0;
+  double dxtang = 0.0;
 
-      faces->poly[iface].circ += bmm_geom2d_norm(xdiffij);
-    }
+  // Normal forces first.
 
-    for (size_t ilace = 0; ilace < faces->poly[iface].n; ++ilace) {
-      size_t const ivert = ilace % faces->poly[iface].n;
-      size_t const jvert = (ilace + 1) % faces->poly[iface].n;
+  double fnorm = 0.0;
+  double fnormcons = 0.0;
+  double fnormdiss = 0.0;
 
-      size_t const ipart = faces->poly[iface].ivert[ivert];
-      size_t const jpart = faces->poly[iface].ivert[jvert];
-      // fprintf(stderr, "Trilaterated %zu -> %zu.\n", ipart, jpart);
+  {
+    double const xi = r - d;
+    double const vnormij = -bmm_geom2d_dot(vdiffij, xnormij);
+    double const reff = $(bmm_resum2, double)(ri, rj);
+    double const dt = dem->script.dt;
+    dxnorm = vnormij * dt;
 
-      faces->poly[iface].area +=
-        dem->part.x[ipart][0] * dem->part.x[jpart][1] -
-        dem->part.x[jpart][0] * dem->part.x[ipart][1];
-    }
+    switch (norm) {
+      case BMM_DEM_NORM_KV:
+        if (dem->pair[ict].cohesive) {
+          // double const r = ri + rj;
+          // Maybe.
+          double const r = dem->pair[ict].cont.src[ipart].drest[icont];
+          double const xi = r - d;
 
-    faces->poly[iface].area /= 2.0;
-    // fprintf(stderr, "Face %zu with area %g.\n", iface, faces->poly[iface].area);
-  }
-
-  // Filter.
-  for (size_t iface = 0; iface < nface; ++iface)
-    // This would be a useful feature,
-    // but with the current algorithm it loses edges
-    // that are surrounded by a hole and the outside.
-    /*
-    if (faces->poly[iface].area < -1.0e-12 ||
-        faces->poly[iface].circ > 8.0 * bmm_ival_midpoint(dem->opts.part.rnew)) {
-    */
-    if (faces->poly[iface].area < -1.0e-12) {
-      // fprintf(stderr, "Removed face %zu.\n", iface);
-      --nface;
-      faces->poly[iface].n = faces->poly[nface].n;
-      faces->poly[iface].circ = faces->poly[nface].circ;
-      faces->poly[iface].area = faces->poly[nface].area;
-      for (size_t ivert = 0; ivert < faces->poly[nface].n; ++ivert)
-        faces->poly[iface].ivert[ivert] = faces->poly[nface].ivert[ivert];
-
-      --iface;
-    }
+          fnorm = dem->pair[ict].norm.params.dashpot.k * xi +
+            dem->pair[ict].norm.params.dashpot.gamma * vnormij;
 
-  // Rebuild.
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    agraph->src[ipart].n = 0;
-  for (size_t iface = 0; iface < nface; ++iface)
-    for (size_t ivert = 0; ivert < faces->poly[iface].n; ++ivert) {
-      size_t const jvert = (ivert + 1) % faces->poly[iface].n;
-      size_t const ipart = faces->poly[iface].ivert[ivert];
-      size_t const jpart = faces->poly[iface].ivert[jvert];
-
-      if (jpart != ipart) {
-        size_t const icont = agraph->src[ipart].n;
-        agraph->src[ipart].itgt[icont] = jpart;
-        ++agraph->src[ipart].n;
-      }
-    }
-
-  // Preparations.
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    for (size_t iarr = 0; iarr < agraph->src[ipart].n; ++iarr)
-      agraph->src[ipart].visited[iarr] = false;
+          fnormcons = dem->pair[ict].norm.params.dashpot.k * xi;
+          fnormdiss = dem->pair[ict].norm.params.dashpot.gamma * vnormij;
+        } else {
+          fnorm = $(bmm_max, double)(0.0,
+              dem->pair[ict].norm.params.dashpot.k * xi +
+              dem->pair[ict].norm.params.dashpot.gamma * vnormij);
 
-  // Double edge removal.
-harder: ;
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    for (size_t iarr = 0; iarr < agraph->src[ipart].n; ++iarr) {
-      size_t const jpart = agraph->src[ipart].itgt[iarr];
-
-      for (size_t jarr = 0; jarr < agraph->src[jpart].n; ++jarr)
-        if (agraph->src[jpart].itgt[jarr] == ipart) {
-          if (!agraph->src[ipart].visited[iarr] &&
-              !agraph->src[jpart].visited[jarr]) {
-            // fprintf(stderr, "Double removed %zu -> %zu.\n", ipart, jpart);
-            agraph->src[ipart].visited[iarr] = true;
-            agraph->src[jpart].visited[jarr] = true;
-
-            goto harder;
+          if (0.0 > dem->pair[ict].norm.params.dashpot.k * xi +
+              dem->pair[ict].norm.params.dashpot.gamma * vnormij) {
+            fnormcons = 0.0;
+            fnormdiss = 0.0;
+          } else {
+            fnormcons = dem->pair[ict].norm.params.dashpot.k * xi;
+            fnormdiss = dem->pair[ict].norm.params.dashpot.gamma * vnormij;
           }
         }
-    }
 
-  // Restore zero-area double edges.
-  for (size_t iface = 0; iface < nface; ++iface)
-    if (fabs(faces->poly[iface].area) < 1.0e-12) {
-      for (size_t ivert = 0; ivert < faces->poly[iface].n; ++ivert) {
-        size_t const jvert = (ivert + 1) % faces->poly[iface].n;
-        size_t const ipart = faces->poly[iface].ivert[ivert];
-        size_t const jpart = faces->poly[iface].ivert[jvert];
-
-        for (size_t iarr = 0; iarr < agraph->src[ipart].n; ++iarr)
-          if (agraph->src[ipart].itgt[iarr] == jpart) {
-            for (size_t jarr = 0; jarr < agraph->src[jpart].n; ++jarr)
-              if (agraph->src[jpart].itgt[jarr] == ipart) {
-                // fprintf(stderr, "Double restored %zu -> %zu.\n", ipart, jpart);
+        break;
+      case BMM_DEM_NORM_BSHP:
+        {
+          double const more = dem->est.bshpp * bmm_dem_sqrt(dem, reff * xi);
 
-                agraph->src[ipart].visited[iarr] = false;
-                agraph->src[jpart].visited[jarr] = false;
+          if (dem->pair[ict].cohesive) {
+            fnorm = more * (xi + dem->pair[ict].norm.params.viscoel.a * vnormij);
 
-                break;
-              }
+            fnormcons = more * xi;
+            fnormdiss = more * dem->pair[ict].norm.params.viscoel.a * vnormij;
+          } else {
+            fnorm = $(bmm_max, double)(0.0,
+                more * (xi + dem->pair[ict].norm.params.viscoel.a * vnormij));
 
-            break;
+            if (0.0 > more * (xi + dem->pair[ict].norm.params.viscoel.a * vnormij)) {
+              fnormcons = 0.0;
+              fnormdiss = 0.0;
+            } else {
+              fnormcons = more * xi;
+              fnormdiss = more * dem->pair[ict].norm.params.viscoel.a * vnormij;
+            }
           }
-      }
-    }
-
-  /*
-  fprintf(stderr, "digraph {\n");
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    for (size_t iarr = 0; iarr < agraph->src[ipart].n; ++iarr) {
-      size_t const jpart = agraph->src[ipart].itgt[iarr];
+        }
 
-      if (!agraph->src[ipart].visited[iarr])
-        fprintf(stderr, "%zu -> %zu\n", ipart, jpart);
+        break;
     }
-  fprintf(stderr, "}\n");
-  */
-
-  // Connected components.
-  nface = 0;
-  ipart = 0;
-  while (ipart < dem->part.n) {
-    if (nface >= nmembof(faces->poly)) {
-      fprintf(stderr, "Out of face.\n");
-      break;
+
+    if (ict == BMM_DEM_CT_WEAK) {
+      acc->ewcont += dxnorm * fnormcons;
+      acc->ewcontdis += $(bmm_abs, double)(dxnorm * fnormdiss);
+    } else {
+      acc->escont += dxnorm * fnormcons;
+      acc->escontdis += $(bmm_abs, double)(dxnorm * fnormdiss);
     }
+  }
 
-    faces->poly[nface].n = 0;
+  double fnormij[BMM_NDIM];
+  bmm_geom2d_scale(fnormij, xnormij, -fnorm);
 
-    double backdir = (double) NAN;
-    size_t kpart = ipart;
+  bmm_geom2d_addto(acc->f[ipart], fnormij);
+  bmm_geom2d_diffto(acc->f[jpart], fnormij);
 
-morer: ;
+  // Tangential forces second.
 
-    size_t narr = 0;
-    for (size_t iarr = 0; iarr < agraph->src[kpart].n; ++iarr)
-      if (!agraph->src[kpart].visited[iarr])
-        ++narr;
-    if (narr == 0) {
-      // fprintf(stderr, "Face %zu done! ", nface);
+  double ftang = 0.0;
+  double taui = 0.0;
+  double tauj = 0.0;
+  double ftangcons = 0.0;
+  double ftangdiss = 0.0;
 
-      if (faces->poly[nface].n != 0)
-        ++nface;
+  {
+    double const dt = dem->script.dt;
 
-      ++ipart;
+    double const lambdaij = bmm_geom2d_dir(xdiffij);
+    double const lambdaji = $(bmm_swrap, double)(lambdaij + M_PI, M_2PI);
+    double const phii = dem->part.phi[ipart];
+    double const phij = dem->part.phi[jpart];
+    double const psii = phii - lambdaij;
+    double const psij = phij - lambdaji;
 
-      continue;
-    }
+    double const dpsii = $(bmm_swrap, double)(psii - dem->pair[ict].cont.src[ipart].psirest[icont][BMM_DEM_END_TAIL], M_2PI);
+    double const dpsij = $(bmm_swrap, double)(psij - dem->pair[ict].cont.src[ipart].psirest[icont][BMM_DEM_END_HEAD], M_2PI);
 
-    faces->poly[nface].ivert[faces->poly[nface].n] = kpart;
-    ++faces->poly[nface].n;
+    double zetai = dem->part.r[ipart] * dpsii;
+    double zetaj = dem->part.r[jpart] * dpsij;
+    double zeta = zetai + zetaj;
 
-    size_t inext = SIZE_MAX;
-    if (isnan(backdir)) {
-      for (size_t iarr = 0; iarr < agraph->src[kpart].n; ++iarr)
-        if (!agraph->src[kpart].visited[iarr]) {
-          inext = iarr;
+    double const proj = bmm_geom2d_dot(xtangij, vdiffij) / d;
+    double const dzetai = ri * (dem->part.omega[ipart] - proj);
+    double const dzetaj = rj * (dem->part.omega[jpart] - proj);
+    double const dzeta = dzetai + dzetaj;
 
-          break;
-        }
+    dxtang = dzeta * dt;
 
-      size_t const jpart = agraph->src[kpart].itgt[inext];
+    switch (tang) {
+      case BMM_DEM_TANG_HW:
+        {
+          double const dyn = dem->pair[ict].tang.params.hw.mu * $(bmm_abs, double)(fnorm);
+          double const shear = dem->pair[ict].tang.params.hw.gamma * $(bmm_abs, double)(dzeta);
 
-      double xdiffij[BMM_NDIM];
-      bmm_geom2d_diff(xdiffij, dem->part.x[jpart], dem->part.x[kpart]);
+          ftang = copysign($(bmm_min, double)(dyn, shear), dzeta);
+          if (dyn <= shear)
+            ++acc->hwmu;
+          else
+            ++acc->hwgamma;
 
-      double const gammai = $(bmm_swrap, double)(bmm_geom2d_dir(xdiffij), M_2PI);
+          ftangcons = 0.0;
+          ftangdiss = ftang;
 
-      backdir = $(bmm_swrap, double)(gammai + M_PI, M_2PI);
+          taui = ri * ftang;
+          tauj = rj * ftang;
+        }
 
-      // fprintf(stderr, "Set back to %g (%zu).\n", backdir, inext);
-    } else {
-      double cand = M_2PI;
-      for (size_t iarr = 0; iarr < agraph->src[kpart].n; ++iarr) {
-        size_t jpart = agraph->src[kpart].itgt[iarr];
+        break;
+      case BMM_DEM_TANG_CS:
+        {
+          double const dyn = dem->pair[ict].tang.params.cs.mu * $(bmm_abs, double)(fnorm);
+          double const stat = dem->pair[ict].tang.params.cs.k * $(bmm_abs, double)(zeta);
 
-        double xdiffij[BMM_NDIM];
-        bmm_geom2d_diff(xdiffij, dem->part.x[jpart], dem->part.x[kpart]);
+          ftang = dyn <= stat ? copysign(dyn, dzeta) : copysign(stat, zeta);
 
-        double const gammai = $(bmm_swrap, double)(bmm_geom2d_dir(xdiffij), M_2PI);
+          // This is dubious.
+          if (dyn <= stat) {
+            ftangcons = 0.0;
+            ftangdiss = copysign(dyn, dzeta);
 
-        if (!agraph->src[kpart].visited[iarr]) {
-          // fprintf(stderr, "Unvisited angle from %zu to %zu of %g (%zu).\n", kpart, jpart, gammai, iarr);
+            ++acc->csmu;
+          } else {
+            ftangcons = copysign(stat, zeta);
+            ftangdiss = 0.0;
 
-          double const epsilonster = 1.0e-6;
-          double const ncand = $(bmm_uwrap, double)(bmm_geom2d_dir(xdiffij) - backdir - epsilonster, M_2PI);
-          if (ncand < cand) {
-            cand = ncand;
-            inext = iarr;
+            ++acc->csk;
           }
+
+          taui = ri * ftang;
+          tauj = rj * ftang;
         }
-          // else fprintf(stderr, "Visited angle from %zu to %zu of %g (%zu).\n", kpart, jpart, gammai, iarr);
-      }
 
-      size_t const jpart = agraph->src[kpart].itgt[inext];
+        break;
+      case BMM_DEM_TANG_BEAM:
+        {
+          double const d = bmm_geom2d_norm(xdiffij);
+          double const r = ri + rj;
+          double const r2 = $(bmm_power, double)(r, 2);
 
-      double xdiffij[BMM_NDIM];
-      bmm_geom2d_diff(xdiffij, dem->part.x[jpart], dem->part.x[kpart]);
+          double const lambdaij = bmm_geom2d_dir(xdiffij);
+          double const lambdaji = $(bmm_swrap, double)(lambdaij + M_PI, M_2PI);
+          double const phii = dem->part.phi[ipart];
+          double const phij = dem->part.phi[jpart];
+          double const psii = phii - lambdaij;
+          double const psij = phij - lambdaji;
 
-      double const gammai = $(bmm_swrap, double)(bmm_geom2d_dir(xdiffij), M_2PI);
+          double const dpsii = $(bmm_swrap, double)(psii - dem->pair[ict].cont.src[ipart].psirest[icont][BMM_DEM_END_TAIL], M_2PI);
+          double const dpsij = $(bmm_swrap, double)(psij - dem->pair[ict].cont.src[ipart].psirest[icont][BMM_DEM_END_HEAD], M_2PI);
 
-      backdir = $(bmm_swrap, double)(gammai + M_PI, M_2PI);
+          double zetai = dem->part.r[ipart] * dpsii;
+          double zetaj = dem->part.r[jpart] * dpsij;
 
-      // fprintf(stderr, "Set back to %g (%zu).\n", backdir, inext);
-    }
+          double const proj = bmm_geom2d_dot(xtangij, vdiffij) / d;
+          double const dzetai = ri * (dem->part.omega[ipart] - proj);
+          double const dzetaj = rj * (dem->part.omega[jpart] - proj);
 
-    // fprintf(stderr, "Moved %zu -> %zu.\n", kpart, agraph->src[kpart].itgt[inext]);
-    size_t const jpart = agraph->src[kpart].itgt[inext];
+          double const ftangconsi = dem->pair[ict].tang.params.beam.k * zetai;
+          double const ftangconsj = dem->pair[ict].tang.params.beam.k * zetaj;
 
-    agraph->src[kpart].visited[inext] = true;
+          double const ftangdissi = dem->pair[ict].tang.params.beam.dk * dzetai;
+          double const ftangdissj = dem->pair[ict].tang.params.beam.dk * dzetaj;
 
-    kpart = jpart;
+          double const ftangi = ftangconsi + ftangdissi;
+          double const ftangj = ftangconsj + ftangdissj;
 
-    goto morer;
-  }
+          taui = ri * ftangi;
+          tauj = rj * ftangj;
 
-  // Export.
-  for (size_t iface = 0; iface < nface; ++iface) {
-    for (size_t ivert = 0; ivert < faces->poly[iface].n; ++ivert) {
-      size_t const ipart = faces->poly[iface].ivert[ivert];
+          ftang = (taui + tauj) / d;
 
-      if (fprintf(stream, "%s%zu", ivert == 0 ? "" : " ", ipart) < 0) {
-        BMM_TLE_STDS();
+          if (ict == BMM_DEM_CT_WEAK) {
+            acc->ewcont += (dzetai * dt) * ftangconsi;
+            acc->ewcont += (dzetaj * dt) * ftangconsj;
+            acc->ewcontdis += $(bmm_abs, double)((dzetai * dt) * ftangdissi);
+            acc->ewcontdis += $(bmm_abs, double)((dzetaj * dt) * ftangdissj);
+          } else {
+            acc->escont += (dzetai * dt) * ftangconsi;
+            acc->escont += (dzetaj * dt) * ftangconsj;
+            acc->escontdis += $(bmm_abs, double)((dzetai * dt) * ftangdissi);
+            acc->escontdis += $(bmm_abs, double)((dzetaj * dt) * ftangdissj);
+          }
+        }
 
-        return false;
-      }
+        break;
     }
 
-    if (fprintf(stream, "\n") < 0) {
-      BMM_TLE_STDS();
-
-      return false;
+    if (ict == BMM_DEM_CT_WEAK) {
+      acc->ewcont += dxtang * ftangcons;
+      acc->ewcontdis += $(bmm_abs, double)(dxtang * ftangdiss);
+    } else {
+      acc->escont += dxtang * ftangcons;
+      acc->escontdis += $(bmm_abs, double)(dxtang * ftangdiss);
     }
   }
 
-  free(agraph);
-  free(faces);
+  double ftangij[BMM_NDIM];
+  bmm_geom2d_scale(ftangij, xtangij, -ftang);
 
-  if (fclose(stream) != 0) {
-    BMM_TLE_STDS();
+  bmm_geom2d_addto(acc->f[ipart], ftangij);
+  bmm_geom2d_diffto(acc->f[jpart], ftangij);
 
-    return false;
+  acc->tau[ipart] -= taui;
+  acc->tau[jpart] -= tauj;
+
+  if (acc->sketch != NULL) {
+    bmm_sketch_add(&acc->sketch[BMM_DEM_SKETCH_FNORM], fnorm, 1.0);
+    bmm_sketch_add(&acc->sketch[BMM_DEM_SKETCH_FTANG], ftang, 1.0);
+    bmm_sketch_add(&acc->sketch[BMM_DEM_SKETCH_XI], r - d, 1.0);
   }
 
-  return true;
+  // The moment of the contact force is split evenly between the particles.
+  if (dem->field.sample) {
+    double fij[BMM_NDIM];
+    bmm_geom2d_add(fij, fnormij, ftangij);
+
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      for (size_t jdim = 0; jdim < BMM_NDIM; ++jdim) {
+        double const s = (xdiffij[idim] * fij[jdim]) / 2.0;
+
+        acc->s[ipart][idim][jdim] += s;
+        acc->s[jpart][idim][jdim] += s;
+      }
+  }
 }
 
-// TODO These procedures do not belong here.
+/// The call
+/// `bmm_dem_force_unified(dem, acc, ipart, jpart, icont, ict, xdiffij, kij)`
+/// works like `bmm_dem_force_kernel`,
+/// but uses the force models of the contact type `ict`.
+void bmm_dem_force_unified(struct bmm_dem *const dem,
+    struct bmm_dem_facc *const acc,
+    size_t const ipart, size_t const jpart, size_t const icont,
+    enum bmm_dem_ct const ict,
+    double const *const xdiffij, double const kij) {
+  bmm_dem_force_kernel(dem, acc, ipart, jpart, icont, ict, xdiffij, kij,
+      dem->pair[ict].norm.tag, dem->pair[ict].tang.tag);
+}
 
-static double wkde_eval(double const *restrict const xarr,
-    double const *restrict const warr,
-    size_t const nsample, double const x, double const bandwidth) {
-  double y = 0.0;
+#define SPECIALIZE(norm, tang) \
+  __attribute__ ((__nonnull__)) \
+  static void $(bmm_dem_force_unified, norm, tang)(struct bmm_dem *const dem, \
+      struct bmm_dem_facc *const acc, \
+      size_t const ipart, size_t const jpart, size_t const icont, \
+      enum bmm_dem_ct const ict, \
+      double const *const xdiffij, double const kij) { \
+    bmm_dem_force_kernel(dem, acc, ipart, jpart, icont, ict, xdiffij, kij, \
+        BMM_DEM_NORM_##norm, BMM_DEM_TANG_##tang); \
+  }
 
-  for (size_t i = 0; i < nsample; i++)
-    y += warr[i] * bmm_kernel_epan((x - xarr[i]) / bandwidth) / bandwidth;
+SPECIALIZE(KV, NONE)
+SPECIALIZE(KV, HW)
+SPECIALIZE(KV, CS)
+SPECIALIZE(KV, BEAM)
+SPECIALIZE(BSHP, NONE)
+SPECIALIZE(BSHP, HW)
+SPECIALIZE(BSHP, CS)
 
-  return y;
-}
+#undef SPECIALIZE
 
-static void wkde_sample(double *restrict const yarr,
-    double *restrict const yyarr,
-    double const *restrict const xarr,
-    double const *restrict const warr, size_t const nsample,
-    double const bandwidth,
-    size_t const narr, double const min, double const max) {
-  double const step = (max - min) / (double) (narr - 1);
+/// The call `bmm_dem_force_pick(dem, ict)`
+/// returns the force kernel specialized for the force models
+/// of the contact type `ict` in the simulation `dem`
+/// or `bmm_dem_force_unified` if there is no such kernel.
+__attribute__ ((__nonnull__, __pure__))
+static void (*bmm_dem_force_pick(struct bmm_dem const *const dem,
+    enum bmm_dem_ct const ict))(struct bmm_dem *, struct bmm_dem_facc *,
+    size_t, size_t, size_t, enum bmm_dem_ct, double const *, double) {
+  switch (dem->pair[ict].norm.tag) {
+    case BMM_DEM_NORM_KV:
+      switch (dem->pair[ict].tang.tag) {
+        case BMM_DEM_TANG_NONE:
+          return $(bmm_dem_force_unified, KV, NONE);
+        case BMM_DEM_TANG_HW:
+          return $(bmm_dem_force_unified, KV, HW);
+        case BMM_DEM_TANG_CS:
+          return $(bmm_dem_force_unified, KV, CS);
+        case BMM_DEM_TANG_BEAM:
+          return $(bmm_dem_force_unified, KV, BEAM);
+      }
 
-  for (size_t i = 0; i < narr; i++) {
-    double const x = min + (double) i * step;
+      break;
+    case BMM_DEM_NORM_BSHP:
+      switch (dem->pair[ict].tang.tag) {
+        case BMM_DEM_TANG_NONE:
+          return $(bmm_dem_force_unified, BSHP, NONE);
+        case BMM_DEM_TANG_HW:
+          return $(bmm_dem_force_unified, BSHP, HW);
+        case BMM_DEM_TANG_CS:
+          return $(bmm_dem_force_unified, BSHP, CS);
+      }
 
-    yarr[i] = x;
-    yyarr[i] = wkde_eval(xarr, warr, nsample, x, bandwidth);
+      break;
   }
-}
 
-static double wkde_eval_sorted(double const *restrict const xarr,
-    double const *restrict const warr,
-    size_t const nsample, double const x, double const bandwidth,
-    size_t const iwin, size_t const jwin) {
-  double y = 0.0;
+  return bmm_dem_force_unified;
+}
 
-  for (size_t i = iwin; i < jwin; i++)
-    y += warr[i] * bmm_kernel_epan((x - xarr[i]) / bandwidth) / bandwidth;
+void bmm_dem_force_external(struct bmm_dem *const dem, size_t const ipart) {
+  double const dt = dem->script.dt;
 
-  return y;
-}
+  switch (dem->ext.tag) {
+    case BMM_DEM_EXT_HARM:
+      dem->part.f[ipart][1] += dem->ext.params.harm.k *
+        (dem->opts.box.x[1] / 2.0 - dem->part.x[ipart][1]);
 
-static void wkde_sample_sorted(double *restrict const yarr,
-    double *restrict const yyarr,
-    double const *restrict const xarr,
-    double const *restrict const warr, size_t const nsample,
-    double const bandwidth,
-    size_t const narr, double const min, double const max) {
-  double const step = (max - min) / (double) (narr - 1);
+      break;
+    case BMM_DEM_EXT_GRAVY:
+      {
+        dem->part.f[ipart][1] += dem->part.m[ipart] * dem->ext.params.gravy.g;
 
-  double const win = bandwidth;
+        double const dy = dem->part.v[ipart][1] * dt;
+      }
 
-  double x = min;
+      break;
+    case BMM_DEM_EXT_DRIVE:
+      switch (dem->part.role[ipart]) {
+        case BMM_DEM_ROLE_DRIVEN:
+          {
+            double f[BMM_NDIM];
+            for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+              f[idim] = dem->script.state.crunch.fdrive[idim] /
+                (double) dem->part.nrole[BMM_DEM_ROLE_DRIVEN];
 
-  // TODO Should use another `bsearch`-like function. This is also off by one.
-  size_t iwin = 0;
-  while (iwin < nsample && xarr[iwin] < x - win)
-    ++iwin;
-  size_t jwin = iwin;
-  while (jwin < nsample && xarr[jwin] < x + win)
-    ++jwin;
+            double const dx = dem->part.v[ipart][0] * dt;
+            double const dy = dem->part.v[ipart][1] * dt;
+            dem->est.edrivtang += dx * f[0];
+            dem->est.edrivnorm += dy * f[1];
 
-  for (size_t i = 0; i < narr; i++) {
-    x = min + (double) i * step;
+            for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+              dem->part.f[ipart][idim] += f[idim];
+          }
 
-    yarr[i] = x;
-    yyarr[i] = wkde_eval_sorted(xarr, warr, nsample, x, bandwidth, iwin, jwin);
+          break;
+      }
 
-    while (iwin < nsample && xarr[iwin] < x - win)
-      ++iwin;
-    while (jwin < nsample && xarr[jwin] < x + win)
-      ++jwin;
+      break;
   }
 }
 
-__attribute__ ((__nonnull__, __pure__))
-static int compar(size_t const i, size_t const j, void *const cls) {
-  double const *const *const rw = cls;
-
-  return $(bmm_cmp, double)(rw[0][i], rw[0][j]);
+/// The call `bmm_dem_wall_surf(pn, dem, iwall, x)`
+/// returns the height of the surface of the wall `iwall`
+/// in the simulation `dem` at the horizontal position `x`
+/// and saves the unit normal pointing into the box into `pn`.
+__attribute__ ((__nonnull__))
+static double bmm_dem_wall_surf(double *const pn,
+    struct bmm_dem const *const dem, enum bmm_dem_wall const iwall,
+    double const x) {
+  double const k = M_2PI * (double) dem->opts.wall.njag /
+    dem->opts.box.x[0];
+  double const a = dem->opts.wall.hjag / 2.0;
+  double const phi = k * (x - dem->wall.x[iwall]);
+  double const dh = a * k * cos(phi);
+  double const s = iwall == BMM_DEM_WALL_BOTTOM ? 1.0 : -1.0;
+  double const d = sqrt(1.0 + $(bmm_power, double)(dh, 2));
+
+  pn[0] = -s * dh / d;
+  pn[1] = s / d;
+
+  return dem->wall.y[iwall] + a * sin(phi);
 }
 
+/// The call `bmm_dem_wall_overlap(pn, dem, iwall, ipart)`
+/// returns how far the particle `ipart` in the simulation `dem`
+/// reaches past the surface of the wall `iwall`
+/// along the unit normal saved into `pn`.
+/// The result is only meaningful while it is positive.
 __attribute__ ((__nonnull__))
-static void swap(size_t const i, size_t const j, void *const cls) {
-  double *const *const rw = cls;
+static double bmm_dem_wall_overlap(double *const pn,
+    struct bmm_dem const *const dem, enum bmm_dem_wall const iwall,
+    size_t const ipart) {
+  double const h = bmm_dem_wall_surf(pn, dem, iwall, dem->part.x[ipart][0]);
 
-  for (size_t k = 0; k < 2; ++k) {
-    double const tmp = rw[k][i];
-    rw[k][i] = rw[k][j];
-    rw[k][j] = tmp;
-  }
+  return dem->part.r[ipart] - (dem->part.x[ipart][1] - h) * pn[1];
 }
 
-/// The call `bmm_dem_est_raddist(pr, pg, dem, nr)`
-/// sets `pr` and `pg` of length `nr`
-/// to the radial distribution function of the particles
-/// in the simulation `dem`.
-/// The simulation cell must be full for this to produce an accurate result.
+__attribute__ ((__nonnull__, __pure__))
+static double bmm_dem_est_ewall(struct bmm_dem const *const dem) {
+  double e = 0.0;
+
+  if (dem->wall.on)
+    for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+      for (size_t iwall = 0; iwall < BMM_NWALL; ++iwall) {
+        double n[BMM_NDIM];
+        double const xi = bmm_dem_wall_overlap(n, dem, iwall, ipart);
+
+        if (xi > 0.0)
+          e += (1.0 / 2.0) * dem->opts.wall.k * $(bmm_power, double)(xi, 2);
+      }
+
+  return e;
+}
+
+/// The call `bmm_dem_force_wall(dem, iwall, ipart)`
+/// adds the force between the wall `iwall` and the particle `ipart`
+/// in the simulation `dem` to both of them.
+/// The wall pushes back elastically and viscously,
+/// but only drags along the surface until Coulomb friction gives in.
 __attribute__ ((__nonnull__))
-bool bmm_dem_est_raddist(double *const pr, double *const pg,
-    size_t const nbin, double const rmax,
-    struct bmm_dem const *const dem) {
-  // TODO This is bad and stupid.
+static void bmm_dem_force_wall(struct bmm_dem *const dem,
+    enum bmm_dem_wall const iwall, size_t const ipart) {
+  double n[BMM_NDIM];
+  double const xi = bmm_dem_wall_overlap(n, dem, iwall, ipart);
 
-  // double g[BMM_TRI(BMM_MPART) * 2];
-  size_t nmemb = $(bmm_tri, size_t)(dem->part.n) * 2;
-  double *const w = malloc(nmemb * sizeof *w);
-  if (w == NULL)
-    return false;
-  double *const r = malloc(nmemb * sizeof *r);
-  if (r == NULL) {
-    free(w);
-    return false;
-  }
+  if (!(xi > 0.0))
+    return;
 
-// If you desperately want wrong results...
-// #define NO_WEIGHTS
+  double const t[] = {-n[1], n[0]};
+  double const r = dem->part.r[ipart];
+  double const omega = dem->part.omega[ipart];
 
-  nmemb = 0;
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    if (bmm_dem_inside(dem, ipart))
-      for (size_t jpart = 0; jpart < dem->part.n; ++jpart)
-        if (jpart != ipart && bmm_dem_inside(dem, jpart)) {
-          double const d = bmm_geom2d_cpdist(dem->part.x[ipart],
-              dem->part.x[jpart], dem->opts.box.x, dem->opts.box.per);
-
-          double const v0 = bmm_geom_ballsurf(d, 2);
-          double const v = bmm_geom2d_shellvol(dem->part.x[ipart], d,
-              dem->opts.box.x, dem->opts.box.per);
-
-          r[nmemb] = d;
-#ifdef NO_WEIGHTS
-          w[nmemb] = 1.0;
-#else
-          w[nmemb] = d == 0.0 ? 0.0 : v0 / v;
-#endif
-          ++nmemb;
-        }
+  // The contact point is at $-r n$ from the center.
+  double v[BMM_NDIM];
+  v[0] = dem->part.v[ipart][0] + omega * r * n[1] - dem->wall.v[iwall][0];
+  v[1] = dem->part.v[ipart][1] - omega * r * n[0] - dem->wall.v[iwall][1];
 
-  // We convert `w` from "importance weights"
-  // to "frequency weights" or "analytic weights".
-  double wsum = $(bmm_sum, double)(w, nmemb);
-  for (size_t i = 0; i < nmemb; ++i)
-    w[i] /= wsum;
+  double const vnorm = bmm_geom2d_dot(v, n);
+  double const vtang = bmm_geom2d_dot(v, t);
 
-  double const bw = bmm_ival_midpoint(dem->opts.part.rnew) / 8.0;
+  double const fnorm = fmax(0.0,
+      dem->opts.wall.k * xi - dem->opts.wall.gamma * vnorm);
+  double const ftang = -copysign(fmin(dem->opts.wall.gammat * fabs(vtang),
+        dem->opts.wall.mu * fnorm), vtang);
 
-  double *rw[] = {r, w};
-  bmm_hsort_cls(nmemb, compar, swap, rw);
-  wkde_sample_sorted(pr, pg, r, w, nmemb, bw, nbin, 0.0, rmax);
-  // wkde_sample(pr, pg, r, w, nmemb, bw, nbin, 0.0, rmax);
+  double f[BMM_NDIM];
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    f[idim] = fnorm * n[idim] + ftang * t[idim];
 
-  double const dr = rmax / (double) nbin;
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+    dem->part.f[ipart][idim] += f[idim];
+    dem->wall.f[iwall][idim] -= f[idim];
+  }
 
-  // Ideal gas.
-  // for (size_t i = 0; i < nbin; ++i)
-  //   pg[i] = bmm_geom_ballsurf(pr[i], BMM_NDIM);
+  dem->part.tau[ipart] -= r * ftang;
 
-  // We must renormalize to account for cut off kernels.
-  double total = 0.0;
-  for (size_t i = 0; i < nbin; ++i)
-    total += pg[i] * dr;
-  for (size_t i = 0; i < nbin; ++i)
-    pg[i] /= total;
-  // It is a proper pdf now.
-  for (size_t i = 0; i < nbin; ++i)
-    pg[i] = pr[i] == 0.0 ? 0.0 : pg[i] *
-      (bmm_geom_ballvol(rmax, BMM_NDIM) / bmm_geom_ballsurf(pr[i], BMM_NDIM));
-
-  free(r);
-  free(w);
-
-  return true;
+  double const dt = dem->script.dt;
+  if (fnorm > 0.0)
+    dem->est.ewcontdis += fabs((fnorm - dem->opts.wall.k * xi) * vnorm * dt);
+  dem->est.ewcontdis += fabs(ftang * vtang * dt);
 }
 
-/// The call `bmm_dem_est_mass(dem)`
-/// returns the total mass of the particles
-/// in the simulation `dem`.
-__attribute__ ((__nonnull__, __pure__))
-double bmm_dem_est_mass(struct bmm_dem *const dem) {
-  double m = 0.0;
-
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    m += dem->part.m[ipart];
+/// The call `bmm_dem_force_walls(dem)`
+/// adds the forces between the walls and the particles
+/// in the simulation `dem` to both.
+__attribute__ ((__nonnull__))
+static void bmm_dem_force_walls(struct bmm_dem *const dem) {
+  for (size_t iwall = 0; iwall < BMM_NWALL; ++iwall)
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      dem->wall.f[iwall][idim] = 0.0;
 
-  return m;
+  for (size_t ipart = bmm_dem_role_begin(dem, BMM_DEM_ROLE_FREE);
+      ipart < bmm_dem_role_end(dem, BMM_DEM_ROLE_FREE); ++ipart)
+    if (dem->cache.parted || dem->part.role[ipart] == BMM_DEM_ROLE_FREE)
+      for (size_t iwall = 0; iwall < BMM_NWALL; ++iwall)
+        bmm_dem_force_wall(dem, iwall, ipart);
 }
 
-/// The call `bmm_dem_est_center(pxcenter, dem)`
-/// sets `pxcenter` to the center of the bounding box
-/// in the simulation `dem`.
+/// The call `bmm_dem_wall_step(dem)`
+/// moves the top wall in the simulation `dem`
+/// under the forces from the particles and the driving force,
+/// while the bottom wall stays where it is.
 __attribute__ ((__nonnull__))
-void bmm_dem_est_center(double *const pxcenter,
-    struct bmm_dem *const dem) {
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    pxcenter[idim] = dem->opts.box.x[idim] / 2.0;
-}
+static void bmm_dem_wall_step(struct bmm_dem *const dem) {
+  double const dt = dem->script.dt;
+  enum bmm_dem_wall const iwall = BMM_DEM_WALL_TOP;
 
-/// The call `bmm_dem_est_com(pxcom, dem)`
-/// sets `pxcom` to the center of mass of the particles
-/// in the simulation `dem`.
-__attribute__ ((__nonnull__))
-void bmm_dem_est_com(double *const pxcom,
-    struct bmm_dem *const dem) {
+  double f[BMM_NDIM];
   for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    pxcom[idim] = 0.0;
+    f[idim] = dem->wall.f[iwall][idim];
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+  if (dem->ext.tag == BMM_DEM_EXT_DRIVE) {
     for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-      pxcom[idim] += dem->part.m[ipart] * dem->part.x[ipart][idim];
+      f[idim] += dem->script.state.crunch.fdrive[idim];
 
-  double const m = bmm_dem_est_mass(dem);
+    dem->est.edrivtang += dem->wall.v[iwall][0] * dt *
+      dem->script.state.crunch.fdrive[0];
+    dem->est.edrivnorm += dem->wall.v[iwall][1] * dt *
+      dem->script.state.crunch.fdrive[1];
+  }
 
   for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    pxcom[idim] /= m;
+    dem->wall.v[iwall][idim] += (f[idim] / dem->wall.m[iwall]) * dt;
+
+  dem->wall.x[iwall] = $(bmm_uwrap, double)(dem->wall.x[iwall] +
+      dem->wall.v[iwall][0] * dt, dem->opts.box.x[0]);
+  dem->wall.y[iwall] += dem->wall.v[iwall][1] * dt;
 }
 
-static bool dump_raddist_etc(struct bmm_dem *const dem) {
-  FILE *const stream = fopen("raddist.data", "w");
-  if (stream == NULL) {
-    BMM_TLE_STDS();
+/// The call `bmm_dem_substep(dem)`
+/// checks whether the simulation `dem` integrates strong contacts
+/// on substeps of their own.
+__attribute__ ((__nonnull__, __pure__))
+static bool bmm_dem_substep(struct bmm_dem const *const dem) {
+  return dem->integ.tag == BMM_DEM_INTEG_RESPA;
+}
 
-    return false;
-  }
+/// The call `bmm_dem_force_contacts(dem, f, tau, ictbegin, ictend)`
+/// adds the forces and torques of all the contacts
+/// whose types are from `ictbegin` up to but not including `ictend`
+/// in the simulation `dem` to the columns `f` and `tau`.
+/// The particles are split into as many contiguous blocks
+/// as there are force accumulators and
+/// the blocks are distributed statically over `opts.thread.n` threads.
+/// Each block accumulates into its own columns
+/// that are summed in block order at the end,
+/// so the result only depends on the number of accumulators.
+/// The first block works on the particles directly,
+/// so running with one accumulator is exactly the serial evaluation.
+/// There must be at least one particle for the columns to exist.
+__attribute__ ((__nonnull__))
+static void bmm_dem_force_contacts(struct bmm_dem *const dem,
+    double (*const f)[BMM_NDIM], double *const tau,
+    enum bmm_dem_ct const ictbegin, enum bmm_dem_ct const ictend) {
+  size_t const npart = dem->part.n;
+  size_t const nacc = bmm_dem_nacc(dem);
+  struct bmm_dem_facc *const acc = dem->thread.acc;
+
+  acc[0].f = f;
+  acc[0].tau = tau;
+  acc[0].ewcont = dem->est.ewcont;
+  acc[0].escont = dem->est.escont;
+  acc[0].ewcontdis = dem->est.ewcontdis;
+  acc[0].escontdis = dem->est.escontdis;
+  acc[0].hwgamma = dem->est.hwgamma;
+  acc[0].hwmu = dem->est.hwmu;
+  acc[0].csk = dem->est.csk;
+  acc[0].csmu = dem->est.csmu;
+  acc[0].s = dem->field.s;
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads((int) dem->opts.thread.n)
+#endif
+  {
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (size_t iacc = 0; iacc < nacc; ++iacc) {
+      double const t = bmm_sec_now();
 
-  size_t nbin = 512;
-  double *const r = malloc(nbin * sizeof *r);
-  double *const g = malloc(nbin * sizeof *g);
-  dynamic_assert(r != NULL && g != NULL, "Allocated");
+      acc[iacc].sketch = dem->sketch.sample ? dem->sketch.acc[iacc] : NULL;
 
-  double const rmax = dem->opts.box.x[0] / 4.0;
+      if (iacc != 0) {
+        for (size_t ipart = 0; ipart < npart; ++ipart) {
+          for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+            acc[iacc].f[ipart][idim] = 0.0;
 
-  if (!bmm_dem_est_raddist(r, g, nbin, rmax, dem))
-    return false;
+          acc[iacc].tau[ipart] = 0.0;
+        }
 
-  for (size_t ibin = 0; ibin < nbin; ++ibin)
-    if (fprintf(stream, "%g %g\n", r[ibin], g[ibin]) < 0) {
-      BMM_TLE_STDS();
+        if (dem->field.sample)
+          for (size_t ipart = 0; ipart < npart; ++ipart)
+            for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+              for (size_t jdim = 0; jdim < BMM_NDIM; ++jdim)
+                acc[iacc].s[ipart][idim][jdim] = 0.0;
+
+        acc[iacc].ewcont = 0.0;
+        acc[iacc].escont = 0.0;
+        acc[iacc].ewcontdis = 0.0;
+        acc[iacc].escontdis = 0.0;
+        acc[iacc].hwgamma = 0;
+        acc[iacc].hwmu = 0;
+        acc[iacc].csk = 0;
+        acc[iacc].csmu = 0;
+      }
 
-      return false;
-    }
+      for (enum bmm_dem_ct ict = ictbegin; ict < ictend; ++ict) {
+        void (*const force)(struct bmm_dem *, struct bmm_dem_facc *,
+            size_t, size_t, size_t, enum bmm_dem_ct, double const *, double) =
+          bmm_dem_force_pick(dem, ict);
 
-  // Snip.
+        for (size_t ipart = iacc * npart / nacc;
+            ipart < (iacc + 1) * npart / nacc; ++ipart)
+          for (size_t icont = 0; icont < dem->pair[ict].cont.src[ipart].n; ++icont) {
+            size_t const jpart = dem->pair[ict].cont.src[ipart].itgt[icont];
 
-  double const v = $(bmm_prod, double)(dem->opts.box.x, BMM_NDIM);
-  double const rho = (double) dem->part.n / v;
-  double const dr = rmax / (double) nbin;
-  double a = 0.0;
+            // Sampled steps need the stresses of every contact,
+            // except for those that clumps do not track at all.
+            if (bmm_dem_rigid(dem, ipart, jpart) ||
+                (!dem->field.sample && bmm_dem_sleeping(dem, ipart, jpart)))
+              continue;
 
-  for (size_t ibin = 0; ibin < nbin; ++ibin)
-    a += (g[ibin] * log(g[ibin] + 1.0e-9) - (g[ibin] - 1.0)) * dr;
+            double xdiffij[BMM_NDIM];
+            double const kij = bmm_dem_pdiff(xdiffij, dem,
+                dem->part.x[jpart], dem->part.x[ipart]);
 
-  dem->est.sk = -(rho / 2.0) * a;
+            force(dem, &acc[iacc], ipart, jpart, icont, ict, xdiffij, kij);
+          }
+      }
 
-  // Snap.
+#ifdef _OPENMP
+      bmm_trace_span(&dem->trace, (size_t) omp_get_thread_num(),
+          "contacts", t);
+#else
+      bmm_trace_span(&dem->trace, 0, "contacts", t);
+#endif
+    }
 
-  free(g);
-  free(r);
+    if (nacc > 1) {
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+      for (size_t ipart = 0; ipart < npart; ++ipart)
+        for (size_t jacc = 1; jacc < nacc; ++jacc) {
+          for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+            acc[0].f[ipart][idim] += acc[jacc].f[ipart][idim];
 
-  if (fclose(stream) != 0) {
-    BMM_TLE_STDS();
+          acc[0].tau[ipart] += acc[jacc].tau[ipart];
 
-    return false;
+          if (dem->field.sample)
+            for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+              for (size_t jdim = 0; jdim < BMM_NDIM; ++jdim)
+                acc[0].s[ipart][idim][jdim] +=
+                  acc[jacc].s[ipart][idim][jdim];
+        }
+    }
   }
 
-  return true;
-}
-
-void bmm_dem_opts_def(struct bmm_dem_opts *const opts) {
-  // This is here just to help Valgrind and cover up my mistakes.
-  (void) memset(opts, 0, sizeof *opts);
+  for (size_t jacc = 1; jacc < nacc; ++jacc) {
+    acc[0].ewcont += acc[jacc].ewcont;
+    acc[0].escont += acc[jacc].escont;
+    acc[0].ewcontdis += acc[jacc].ewcontdis;
+    acc[0].escontdis += acc[jacc].escontdis;
+    acc[0].hwgamma += acc[jacc].hwgamma;
+    acc[0].hwmu += acc[jacc].hwmu;
+    acc[0].csk += acc[jacc].csk;
+    acc[0].csmu += acc[jacc].csmu;
+  }
 
-  opts->verbose = false;
+  dem->est.ewcont = acc[0].ewcont;
+  dem->est.escont = acc[0].escont;
+  dem->est.ewcontdis = acc[0].ewcontdis;
+  dem->est.escontdis = acc[0].escontdis;
+  dem->est.hwgamma = acc[0].hwgamma;
+  dem->est.hwmu = acc[0].hwmu;
+  dem->est.csk = acc[0].csk;
+  dem->est.csmu = acc[0].csmu;
+}
 
-  opts->gross.fric = BMM_DEM_TANG_CS;
-  opts->gross.pfac = 0.5;
-  opts->gross.hfac = 1.0;
-  opts->gross.ds = 0.1;
+/// The call `bmm_dem_fuse_pair(dem, acc, ipart, jpart, ineigh)`
+/// works like `bmm_dem_analyze_cached`,
+/// but also adds the forces and torques of the contacts that remain
+/// between the particles `ipart` and `jpart`
+/// to the accumulator `acc` of the simulation `dem`
+/// and returns the number of strong contacts it found.
+__attribute__ ((__nonnull__))
+static size_t bmm_dem_fuse_pair(struct bmm_dem *const dem,
+    struct bmm_dem_facc *const acc, size_t const ipart, size_t const jpart,
+    size_t const ineigh) {
+  if (ipart >= jpart)
+    return bmm_dem_fuse_pair(dem, acc, jpart, ipart, ineigh);
+
+  // Sampled steps need the stresses of every contact,
+  // except for those that clumps do not track at all.
+  if (bmm_dem_rigid(dem, ipart, jpart) ||
+      (!dem->field.sample && bmm_dem_sleeping(dem, ipart, jpart)))
+    return bmm_dem_search_cont(dem, BMM_DEM_CT_STRONG, ipart, jpart) !=
+      SIZE_MAX ? 1 : 0;
 
-  opts->trap.enabled = false;
-#ifdef _GNU_SOURCE
-  opts->trap.mask = FE_DIVBYZERO | FE_INVALID | FE_OVERFLOW | FE_UNDERFLOW;
-#else
-  opts->trap.mask = 0;
-#endif
+  double xdiffij[BMM_NDIM];
+  double const kij = bmm_dem_cache_pdiff(xdiffij, dem, ipart, jpart, ineigh);
 
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    opts->box.x[idim] = 1.0;
+  size_t const icont = bmm_dem_search_cont(dem, BMM_DEM_CT_STRONG, ipart, jpart);
+  if (icont != SIZE_MAX) {
+    if (!bmm_dem_substep(dem))
+      bmm_dem_force_unified(dem, acc, ipart, jpart, icont, BMM_DEM_CT_STRONG,
+          xdiffij, kij);
 
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    opts->box.per[idim] = false;
+    return 1;
+  }
 
-  opts->time.istab = 1000;
+  double const d2 = bmm_geom2d_norm2(xdiffij);
+  double const r2 = $(bmm_power, double)(dem->part.r[ipart] + dem->part.r[jpart], 2);
+  bool const overlap = d2 < r2;
 
-  opts->part.ytens = 1.0;
-  opts->part.ycomp = 1.0;
-  opts->part.nu = 0.5;
-  opts->part.rnew[0] = 1.0;
-  opts->part.rnew[1] = 1.0;
-  opts->part.strnew[0] = 1.0;
-  opts->part.strnew[1] = 1.0;
+  size_t jcont = bmm_dem_search_cont(dem, BMM_DEM_CT_WEAK, ipart, jpart);
+  if (jcont != SIZE_MAX) {
+    if (!overlap) {
+      bmm_dem_remcont(dem, BMM_DEM_CT_WEAK, ipart, jpart, jcont);
 
-  opts->script.n = 0;
+      return 0;
+    }
+  } else {
+    if (!overlap)
+      return 0;
 
-  opts->comm.dt = 1.0;
-  opts->comm.flip = true;
-  opts->comm.flop = true;
-  opts->comm.flap = true;
-  opts->comm.flup = true;
+    jcont = bmm_dem_addcont(dem, BMM_DEM_CT_WEAK, ipart, jpart);
+    if (jcont == SIZE_MAX)
+      return 0;
+  }
 
-  opts->cache.dcutoff = 1.0 / 5.0;
+  bmm_dem_force_unified(dem, acc, ipart, jpart, jcont, BMM_DEM_CT_WEAK,
+      xdiffij, kij);
 
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    opts->cache.ncell[idim] = 5;
+  return 0;
 }
 
-void bmm_dem_def(struct bmm_dem *const dem,
-    struct bmm_dem_opts const *const opts) {
-  // This is here just to help Valgrind and cover up my mistakes.
-  (void) memset(dem, 0, sizeof *dem);
+/// The call `bmm_dem_fuse_lost(dem, ipart, jpart)`
+/// checks whether the strong contact between the particles `ipart` and `jpart`
+/// was left out of the neighbor cache of the simulation `dem`.
+__attribute__ ((__nonnull__, __pure__))
+static bool bmm_dem_fuse_lost(struct bmm_dem const *const dem,
+    size_t const ipart, size_t const jpart) {
+  for (size_t ineigh = dem->cache.neigh[ipart].i;
+      ineigh < dem->cache.neigh[ipart].i + dem->cache.neigh[ipart].n;
+      ++ineigh)
+    if (dem->cache.ineigh[ineigh] == jpart)
+      return false;
 
-  dem->opts = *opts;
+  for (size_t ineigh = dem->cache.neigh[jpart].i;
+      ineigh < dem->cache.neigh[jpart].i + dem->cache.neigh[jpart].n;
+      ++ineigh)
+    if (dem->cache.ineigh[ineigh] == ipart)
+      return false;
 
-  dem->trap.remask = 0;
+  return true;
+}
 
-  dem->bond.ccrcont = 1.5;
+/// The call `bmm_dem_force_fused(dem)`
+/// analyzes the contacts of the simulation `dem` and
+/// adds their forces and torques to the particles in one sweep,
+/// so that the geometry of each pair is only computed once.
+/// This is serial, because contacts are added and removed along the way.
+__attribute__ ((__nonnull__))
+static void bmm_dem_force_fused(struct bmm_dem *const dem) {
+  size_t const npart = dem->part.n;
+
+  // The estimators are also changed by adding and removing contacts,
+  // so the accumulator only collects what the forces add to them.
+  struct bmm_dem_facc acc = {
+    .f = dem->part.f,
+    .tau = dem->part.tau,
+    .ewcont = 0.0,
+    .escont = 0.0,
+    .ewcontdis = 0.0,
+    .escontdis = 0.0,
+    .hwgamma = 0,
+    .hwmu = 0,
+    .csk = 0,
+    .csmu = 0,
+    .s = dem->field.s,
+    .sketch = dem->sketch.sample ? dem->sketch.acc[0] : NULL
+  };
+
+  size_t nstrong = 0;
 
-  dem->integ.tag = BMM_DEM_INTEG_TAYLOR;
-  dem->integ.tag = BMM_DEM_INTEG_VELVET;
-  dem->integ.tag = BMM_DEM_INTEG_BEEMAN;
-  dem->integ.tag = BMM_DEM_INTEG_KURAEV;
-  dem->integ.tag = BMM_DEM_INTEG_EULER;
-  dem->cache.tag = BMM_DEM_CACHE_NONE;
-  dem->cache.tag = BMM_DEM_CACHE_NEIGH;
-  dem->ext.tag = BMM_DEM_EXT_NONE;
-  dem->amb.tag = BMM_DEM_AMB_NONE;
-  dem->pair[BMM_DEM_CT_WEAK].cohesive = false;
-  dem->pair[BMM_DEM_CT_WEAK].norm.tag = BMM_DEM_NORM_BSHP;
-  dem->pair[BMM_DEM_CT_WEAK].tang.tag = BMM_DEM_TANG_CS;
-  dem->pair[BMM_DEM_CT_STRONG].cohesive = true;
-  dem->pair[BMM_DEM_CT_STRONG].norm.tag = BMM_DEM_NORM_KV;
-  dem->pair[BMM_DEM_CT_STRONG].tang.tag = BMM_DEM_TANG_BEAM;
-  dem->yield.tag = BMM_DEM_YIELD_ZE;
+  switch (dem->cache.tag) {
+    case BMM_DEM_CACHE_NONE:
+      for (size_t ipart = 0; ipart < npart; ++ipart)
+        for (size_t jpart = ipart + 1; jpart < npart; ++jpart)
+          nstrong += bmm_dem_fuse_pair(dem, &acc, ipart, jpart, SIZE_MAX);
 
-  switch (dem->amb.tag) {
-    case BMM_DEM_AMB_FAXEN:
-      dem->amb.params.creeping.eta = 1.0e+3;
+      break;
+    case BMM_DEM_CACHE_NEIGH:
+    case BMM_DEM_CACHE_LEVEL:
+      if (dem->opts.cache.ghost)
+        bmm_dem_cache_ghost_move(dem);
+
+      for (size_t ipart = 0; ipart < npart; ++ipart)
+        for (size_t ineigh = dem->cache.neigh[ipart].i;
+            ineigh < dem->cache.neigh[ipart].i + dem->cache.neigh[ipart].n;
+            ++ineigh)
+          nstrong += bmm_dem_fuse_pair(dem, &acc, ipart,
+              dem->cache.ineigh[ineigh], ineigh);
 
       break;
   }
 
-  switch (dem->pair[BMM_DEM_CT_WEAK].norm.tag) {
-    case BMM_DEM_NORM_KV:
-      dem->pair[BMM_DEM_CT_WEAK].norm.params.dashpot.k = 1.0e+6;
-      dem->pair[BMM_DEM_CT_WEAK].norm.params.dashpot.gamma = 1.0e+3;
+  size_t mstrong = 0;
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    mstrong += dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].n;
+
+  // Strong contacts may stretch past the neighbor cutoff,
+  // in which case they still need their forces,
+  // even though they were not analyzed.
+  if (mstrong != nstrong && !bmm_dem_substep(dem))
+    for (size_t ipart = 0; ipart < npart; ++ipart)
+      for (size_t icont = 0;
+          icont < dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].n; ++icont) {
+        size_t const jpart =
+          dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].itgt[icont];
+
+        if (bmm_dem_fuse_lost(dem, ipart, jpart)) {
+          double xdiffij[BMM_NDIM];
+          double const kij = bmm_dem_pdiff(xdiffij, dem,
+              dem->part.x[jpart], dem->part.x[ipart]);
+
+          bmm_dem_force_unified(dem, &acc, ipart, jpart, icont,
+              BMM_DEM_CT_STRONG, xdiffij, kij);
+        }
+      }
 
-      break;
-    case BMM_DEM_NORM_BSHP:
-      dem->pair[BMM_DEM_CT_WEAK].norm.params.viscoel.a = 4.0e-2;
+  dem->est.ewcont += acc.ewcont;
+  dem->est.escont += acc.escont;
+  dem->est.ewcontdis += acc.ewcontdis;
+  dem->est.escontdis += acc.escontdis;
+  dem->est.hwgamma += acc.hwgamma;
+  dem->est.hwmu += acc.hwmu;
+  dem->est.csk += acc.csk;
+  dem->est.csmu += acc.csmu;
+}
 
-      break;
-  }
+/// The call `bmm_dem_comm_due(dem)`
+/// checks whether the simulation `dem` will output a frame
+/// once the current step is over.
+/// This must agree with `bmm_dem_comm` to the last bit.
+__attribute__ ((__nonnull__, __pure__))
+static bool bmm_dem_comm_due(struct bmm_dem const *const dem) {
+  double const t = dem->time.t + dem->script.dt;
 
-  switch (dem->pair[BMM_DEM_CT_WEAK].tang.tag) {
-    case BMM_DEM_TANG_HW:
-      dem->pair[BMM_DEM_CT_WEAK].tang.params.hw.gamma = 1.0e+4;
-      dem->pair[BMM_DEM_CT_WEAK].tang.params.hw.mu = 0.85;
+  return t - dem->comm.tprev - dem->comm.dt >= 0.0;
+}
 
-      break;
-    case BMM_DEM_TANG_CS:
-      dem->pair[BMM_DEM_CT_WEAK].tang.params.cs.k = 1.0e+6;
-      dem->pair[BMM_DEM_CT_WEAK].tang.params.cs.mu = 0.85;
+/// The call `bmm_dem_field_reset(dem)`
+/// starts a new averaging window
+/// for the coarse-grained fields of the simulation `dem`.
+__attribute__ ((__nonnull__))
+static void bmm_dem_field_reset(struct bmm_dem *const dem) {
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    dem->field.ncell[idim] = dem->opts.field.ncell[idim] != 0 ?
+      dem->opts.field.ncell[idim] :
+      dem->opts.cache.ncell[idim] - (dem->opts.box.per[idim] ? 0 : 2);
 
-      break;
-  }
+  dem->field.nsample = 0;
 
-  switch (dem->pair[BMM_DEM_CT_STRONG].norm.tag) {
-    case BMM_DEM_NORM_KV:
-      dem->pair[BMM_DEM_CT_STRONG].norm.params.dashpot.k = 2.0e+8;
-      dem->pair[BMM_DEM_CT_STRONG].norm.params.dashpot.gamma = 4.0e+3;
+  (void) memset(dem->field.cell, 0,
+      $(bmm_prod, size_t)(dem->field.ncell, BMM_NDIM) *
+      sizeof *dem->field.cell);
+}
 
-      break;
-    case BMM_DEM_NORM_BSHP:
-      dem->pair[BMM_DEM_CT_STRONG].norm.params.viscoel.a = 4.0e-2;
+/// The call `bmm_dem_field_sample(dem)`
+/// adds the current state of the particles to the coarse-grained fields
+/// of the simulation `dem`.
+/// Each particle is spread over the grid cells around it
+/// with a product of kernels along each dimension.
+/// The contact stresses need to be accumulated first
+/// by evaluating forces while `field.sample` is set.
+__attribute__ ((__nonnull__))
+static void bmm_dem_field_sample(struct bmm_dem *const dem) {
+  double (*const k)(double) = bmm_kernel(dem->opts.field.kernel);
+  double const bw = dem->opts.field.bw;
+  double const a = bmm_kernel_supp(dem->opts.field.kernel) * bw;
 
-      break;
-  }
+  double h[BMM_NDIM];
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    h[idim] = bw * dem->opts.box.x[idim] / (double) dem->field.ncell[idim];
 
-  switch (dem->pair[BMM_DEM_CT_STRONG].tang.tag) {
-    case BMM_DEM_TANG_BEAM:
-      dem->pair[BMM_DEM_CT_STRONG].tang.params.beam.k = 8.0e+6;
-      dem->pair[BMM_DEM_CT_STRONG].tang.params.beam.dk = 4.0e+2;
-      // This is ideal for `triplet` tests.
-      // dem->pair[BMM_DEM_CT_STRONG].tang.params.beam.dk = 4.0e+1;
-      // dem->pair[BMM_DEM_CT_STRONG].tang.params.beam.dk = 0.0e+1;
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
+    double const m = dem->part.m[ipart];
+    double const *const v = dem->part.v[ipart];
 
-      break;
-  }
+    // The kinetic part uses the full velocities,
+    // so it also picks up the mean flow.
+    double sigma[BMM_NDIM][BMM_NDIM];
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      for (size_t jdim = 0; jdim < BMM_NDIM; ++jdim)
+        sigma[idim][jdim] = dem->field.s[ipart][idim][jdim] -
+          m * v[idim] * v[jdim];
+
+    // Grid cells are centered at half-integers in units of their widths.
+    double y[BMM_NDIM];
+    int ijfirst[BMM_NDIM];
+    size_t nijcell[BMM_NDIM];
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+      y[idim] = dem->part.x[ipart][idim] /
+        (dem->opts.box.x[idim] / (double) dem->field.ncell[idim]) -
+        1.0 / 2.0;
+      ijfirst[idim] = (int) ceil(y[idim] - a);
+      nijcell[idim] = (size_t) ((int) floor(y[idim] + a) - ijfirst[idim] + 1);
+    }
 
-  switch (dem->yield.tag) {
-    case BMM_DEM_YIELD_RANKINE:
-      dem->yield.params.rankine.sigmacrit = 1.0e+8;
+    size_t const nneigh = $(bmm_prod, size_t)(nijcell, BMM_NDIM);
 
-      break;
-    case BMM_DEM_YIELD_TRESCA:
-      dem->yield.params.tresca.taucrit = 1.0e+8;
+    for (size_t ineigh = 0; ineigh < nneigh; ++ineigh) {
+      size_t ijoff[BMM_NDIM];
+      $(bmm_hcd, size_t)(ijoff, ineigh, BMM_NDIM, nijcell);
 
-      break;
-    case BMM_DEM_YIELD_ZE:
-      dem->yield.params.ze.sigmacrit = 5.0e+8;
-      dem->yield.params.ze.taucrit = 5.0e+8;
-      // This is ideal for `beam` tests.
-      // dem->yield.params.ze.sigmacrit = 5.0e+7;
-      // dem->yield.params.ze.taucrit = 5.0e+7;
+      size_t ijcell[BMM_NDIM];
+      double w = 1.0;
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+        int const ij = ijfirst[idim] + (int) ijoff[idim];
+        int const nij = (int) dem->field.ncell[idim];
 
-      break;
+        if (dem->opts.box.per[idim])
+          ijcell[idim] = (size_t) $(bmm_uwrap, int)(ij, nij);
+        else if (ij >= 0 && ij < nij)
+          ijcell[idim] = (size_t) ij;
+        else {
+          w = 0.0;
+
+          break;
+        }
+
+        w *= k((y[idim] - (double) ij) / bw) / h[idim];
+      }
+
+      if (w == 0.0)
+        continue;
+
+      struct bmm_dem_fcell *const cell = &dem->field.cell[$(bmm_unhcd, size_t)(
+          ijcell, BMM_NDIM, dem->field.ncell)];
+
+      cell->rho += w * m;
+
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+        cell->p[idim] += w * m * v[idim];
+
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+        for (size_t jdim = 0; jdim < BMM_NDIM; ++jdim)
+          cell->sigma[idim][jdim] += w * sigma[idim][jdim];
+    }
   }
 
-  // Estimators appeared.
-  dem->est.eambdis = 0.0;
-  dem->est.epotext_d = 0.0;
-  dem->est.eklin_d = 0.0;
-  dem->est.ekrot_d = 0.0;
-  dem->est.ewcont_d = 0.0;
-  dem->est.escont_d = 0.0;
-  dem->est.ewcont = 0.0;
-  dem->est.escont = 0.0;
-  dem->est.edrivtang = 0.0;
-  dem->est.edrivnorm = 0.0;
-  dem->est.ebond = 0.0;
-  dem->est.eyieldis = 0.0;
-  dem->est.ewcontdis = 0.0;
-  dem->est.escontdis = 0.0;
+  ++dem->field.nsample;
+}
+
+void bmm_dem_force(struct bmm_dem *const dem) {
+  double const dt = dem->script.dt;
+
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      dem->part.f[ipart][idim] = 0.0;
+
+    dem->part.tau[ipart] = 0.0;
+  }
+
+  dem->field.sample = dem->opts.field.on &&
+    dem->time.t - dem->field.tprev >= dem->opts.field.dt;
+
+  // Only the contacts of the step that ends in a frame are sketched,
+  // which keeps the cost of sketching out of every other step.
+  dem->sketch.sample = dem->opts.comm.sketch && bmm_dem_comm_due(dem);
+
+  if (dem->field.sample) {
+    dem->field.tprev = dem->time.t;
+
+    for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+        for (size_t jdim = 0; jdim < BMM_NDIM; ++jdim)
+          dem->field.s[ipart][idim][jdim] = 0.0;
+  }
+
+  // This goes for the previous frame, so this is not exactly the right spot.
+  // dem->est.eambdis = 0.0;
+  // dem->est.ewcont = 0.0;
+  // dem->est.escont = 0.0;
+  // dem->est.edrivtang = 0.0;
+  // dem->est.edrivnorm = 0.0;
+  // dem->est.ebond = 0.0;
+  // dem->est.eyieldis = 0.0;
+  // dem->est.ewcontdis = 0.0;
+  // dem->est.escontdis = 0.0;
   dem->est.fback[0] = 0.0;
   dem->est.fback[1] = 0.0;
-  dem->est.chi = (double) NAN;
   dem->est.mueff = (double) NAN;
   dem->est.mueffb = (double) NAN;
   dem->est.vdriv[0] = (double) NAN;
   dem->est.vdriv[1] = (double) NAN;
-  dem->est.hwgamma = 0;
-  dem->est.hwmu = 0;
-  dem->est.csk = 0;
-  dem->est.csmu = 0;
+  dem->est.bshpp = (2.0 / 3.0) * (dem->opts.part.ycomp /
+      (1.0 - $(bmm_power, double)(dem->opts.part.nu, 2)));
 
-  dem->time.t = 0.0;
-  dem->time.istep = 0;
+  // Fused sweeps change contacts,
+  // so they need to happen where the analysis would,
+  // but after the estimators they read have been set up for this step.
+  if (dem->opts.cache.fuse)
+    bmm_dem_force_fused(dem);
+
+  // Direct measurements are only ever looked at in output frames,
+  // so the sweeps are skipped whenever the step does not end in one.
+  if (bmm_dem_comm_due(dem)) {
+    dem->est.epotext_d = bmm_dem_est_epotext(dem);
+    dem->est.eklin_d = bmm_dem_est_eklin(dem);
+    dem->est.ekrot_d = bmm_dem_est_ekrot(dem);
+    dem->est.ewcont_d = bmm_dem_est_econt(dem, BMM_DEM_CT_WEAK) +
+      bmm_dem_est_ewall(dem);
+    dem->est.escont_d = bmm_dem_est_econt(dem, BMM_DEM_CT_STRONG);
+  }
 
-  dem->part.n = 0;
-  dem->part.lnew = 0;
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    bmm_dem_force_ambient(dem, ipart);
 
-  for (size_t ipart = 0; ipart < nmembof(dem->pair[BMM_DEM_CT_STRONG].cont.src); ++ipart)
-    dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].n = 0;
+  if (!dem->opts.cache.fuse && dem->part.n != 0)
+    bmm_dem_force_contacts(dem, dem->part.f, dem->part.tau,
+        BMM_DEM_CT_WEAK, bmm_dem_substep(dem) ? BMM_DEM_CT_STRONG : BMM_NCT);
 
-  dem->script.i = 0;
-  dem->script.tprev = 0.0;
+  if (dem->wall.on)
+    bmm_dem_force_walls(dem);
 
-  dem->comm.tprev = 0.0;
+  size_t const idriven = bmm_dem_role_begin(dem, BMM_DEM_ROLE_DRIVEN);
+  size_t const ndriven = bmm_dem_role_end(dem, BMM_DEM_ROLE_DRIVEN);
 
-  dem->cache.stale = false;
-  dem->cache.i = 0;
-  dem->cache.tpart = 0.0;
-  dem->cache.tprev = 0.0;
+  for (size_t ipart = idriven; ipart < ndriven; ++ipart)
+    if (dem->cache.parted ||
+        dem->part.role[ipart] == BMM_DEM_ROLE_DRIVEN)
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+        dem->est.fback[idim] += dem->part.f[ipart][idim];
 
-  for (size_t icell = 0; icell < nmembof(dem->cache.part); ++icell)
-    dem->cache.part[icell].n = 0;
-}
+  // Strong contacts still push back,
+  // even though their forces are kept apart.
+  if (bmm_dem_substep(dem))
+    for (size_t ipart = idriven; ipart < ndriven; ++ipart)
+      if (dem->cache.parted ||
+          dem->part.role[ipart] == BMM_DEM_ROLE_DRIVEN)
+        for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+          dem->est.fback[idim] += dem->integ.params.respa.f[ipart][idim];
 
-// TODO Relocate these.
+  if (dem->wall.on)
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      dem->est.fback[idim] += dem->wall.f[BMM_DEM_WALL_TOP][idim];
 
-static bool msg_write(void const *buf, size_t const n,
-    __attribute__ ((__unused__)) void *const ptr) {
-  return bmm_io_writeout(buf, n);
-}
+  if (dem->script.state.crunch.fdrive[1] != 0.0)
+    dem->est.mueff = $(bmm_abs, double)(dem->script.state.crunch.fdrive[0] /
+        dem->script.state.crunch.fdrive[1]);
 
-size_t bmm_dem_sniff_size(struct bmm_dem const *const dem,
-    enum bmm_msg_num const num) {
-  switch (num) {
-    case BMM_MSG_NUM_ISTEP:
-      return sizeof dem->time;
-    case BMM_MSG_NUM_OPTS:
-      return sizeof dem->opts;
-    case BMM_MSG_NUM_NEIGH:
-      return sizeof dem->cache + sizeof dem->pair;
-    case BMM_MSG_NUM_PARTS:
-      return sizeof dem->part.n + sizeof dem->part;
-    case BMM_MSG_NUM_EST:
-      return sizeof dem->est;
-  }
+  if (dem->est.fback[1] != 0.0)
+    dem->est.mueffb = $(bmm_abs, double)(dem->est.fback[0] /
+        dem->est.fback[1]);
 
-  dynamic_assert(false, "Unsupported message number");
-}
+  bmm_dem_est_vdc(dem->est.vdriv, dem);
 
-bool bmm_dem_puts_stuff(struct bmm_dem const *const dem,
-    enum bmm_msg_num const num) {
-  switch (num) {
-    case BMM_MSG_NUM_ISTEP:
-      return msg_write(&dem->time, sizeof dem->time, NULL);
-    case BMM_MSG_NUM_OPTS:
-      return msg_write(&dem->opts, sizeof dem->opts, NULL);
-    case BMM_MSG_NUM_NEIGH:
-      return msg_write(&dem->cache, sizeof dem->cache, NULL) &&
-        msg_write(&dem->pair, sizeof dem->pair, NULL);
-    case BMM_MSG_NUM_PARTS:
-      return msg_write(&dem->part.n, sizeof dem->part.n, NULL) &&
-        msg_write(&dem->part, sizeof dem->part, NULL);
-    case BMM_MSG_NUM_EST:
-      return msg_write(&dem->est, sizeof dem->est, NULL);
-  }
+  dem->script.state.crunch.fdrive[0] +=
+    copysign(dem->opts.script.params[dem->script.i].crunch.fadjust[0] * dt,
+        dem->opts.script.params[dem->script.i].crunch.v - dem->est.vdriv[0]);
 
-  dynamic_assert(false, "Unsupported message number");
-}
+  dem->script.state.crunch.fdrive[1] +=
+    copysign(dem->opts.script.params[dem->script.i].crunch.fadjust[1] * dt,
+        dem->est.fback[1] -
+        dem->opts.script.params[dem->script.i].crunch.p *
+        dem->opts.box.x[0] *
+        2.0 * bmm_ival_midpoint(dem->opts.part.rnew));
 
-bool bmm_dem_puts(struct bmm_dem const *const dem,
-    enum bmm_msg_num const num) {
-  struct bmm_msg_spec spec;
-  bmm_msg_spec_def(&spec);
-  spec.msg.size = bmm_dem_sniff_size(dem, num) + BMM_MSG_NUMSIZE;
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    bmm_dem_force_external(dem, ipart);
 
-  return bmm_msg_spec_write(&spec, msg_write, NULL) &&
-    bmm_msg_num_write(&num, msg_write, NULL) &&
-    bmm_dem_puts_stuff(dem, num);
+  if (dem->field.sample) {
+    bmm_dem_field_sample(dem);
+
+    dem->field.sample = false;
+  }
 }
 
-bool bmm_dem_cache_expired(struct bmm_dem const *const dem) {
-  // TODO Use `dem->opts.part.rnew[1]` instead of `dem->part.r[ipart]`.
-  double const r = dem->opts.cache.dcutoff / 2.0;
+void bmm_dem_accel(struct bmm_dem *const dem) {
+  // Fixed particles come last and keep their accelerations,
+  // unless they could not be moved there.
+  size_t const npart = bmm_dem_role_end(dem, BMM_DEM_ROLE_DRIVEN);
+  size_t const ncomp = npart * BMM_NDIM;
+  bool const parted = dem->cache.parted;
+
+  double const *restrict const m = BMM_DEM_ALIGNED(dem->part.m);
+  double const *restrict const j = BMM_DEM_ALIGNED(dem->cache.j);
+  double const *restrict const f = BMM_DEM_ALIGNED((double *) dem->part.f);
+  double const *restrict const tau = BMM_DEM_ALIGNED(dem->part.tau);
+  double *restrict const a = BMM_DEM_ALIGNED((double *) dem->part.a);
+  double *restrict const alpha = BMM_DEM_ALIGNED(dem->part.alpha);
+  bool const *restrict const asleep = BMM_DEM_ALIGNED(dem->sleep.asleep);
+  enum bmm_dem_role const *restrict const role =
+    BMM_DEM_ALIGNED(dem->part.role);
+
+  // These are written as selections instead of branches
+  // to keep the loops free of control flow.
+  // Sleeping particles are held still just like fixed ones.
+  for (size_t icomp = 0; icomp < ncomp; ++icomp) {
+    size_t const ipart = icomp / BMM_NDIM;
+    double const q = f[icomp] / m[ipart];
+
+    a[icomp] = (parted || role[ipart] != BMM_DEM_ROLE_FIXED) &&
+      !asleep[ipart] ? q : a[icomp];
+  }
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    if (bmm_geom2d_cpdist2(dem->part.x[ipart], dem->cache.x[ipart],
-          dem->opts.box.x, dem->opts.box.per) >=
-        $(bmm_power, double)(r - dem->part.r[ipart], 2))
-      return true;
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    double const q = tau[ipart] / j[ipart];
 
-  return false;
+    alpha[ipart] = (parted || role[ipart] != BMM_DEM_ROLE_FIXED) &&
+      !asleep[ipart] ? q : alpha[ipart];
+  }
 }
 
+/// The call `bmm_dem_integ_wrap(dem)`
+/// wraps the positions of all the particles
+/// along the periodic dimensions of the simulation `dem`.
+/// This is kept apart from the integrators
+/// to keep their inner loops free of control flow.
 __attribute__ ((__nonnull__))
-static void bmm_dem_script_balance(struct bmm_dem *const dem) {
-  double xcenter[BMM_NDIM];
-  bmm_dem_est_center(xcenter, dem);
+static void bmm_dem_integ_wrap(struct bmm_dem *const dem) {
+  size_t const npart = dem->part.n;
 
-  double xcom[BMM_NDIM];
-  bmm_dem_est_com(xcom, dem);
+  // The shifts along the x-axis make the dimensions depend on each other.
+  if (bmm_dem_le(dem)) {
+    for (size_t ipart = 0; ipart < npart; ++ipart)
+      bmm_dem_wrap(dem, ipart);
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
-      dem->part.x[ipart][idim] += xcenter[idim] - xcom[idim];
+    return;
+  }
 
-      if (dem->opts.box.per[idim])
-        dem->part.x[ipart][idim] = $(bmm_uwrap, double)(dem->part.x[ipart][idim],
-            dem->opts.box.x[idim]);
+  double (*restrict const x)[BMM_NDIM] = BMM_DEM_ALIGNED(dem->part.x);
+
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    if (dem->opts.box.per[idim]) {
+      double const b = dem->opts.box.x[idim];
+
+      for (size_t ipart = 0; ipart < npart; ++ipart)
+        x[ipart][idim] = $(bmm_uwrap, double)(x[ipart][idim], b);
     }
 }
 
-__attribute__ ((__nonnull__))
-static bool bmm_dem_script_set_density(struct bmm_dem *const dem) {
-  double const vhc = $(bmm_prod, double)(dem->opts.box.x, BMM_NDIM);
+// The following integrators treat the position-like columns
+// as flat arrays of `npart * BMM_NDIM` members,
+// because that is what they are in memory.
 
-  double v = 0.0;
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    v += bmm_geom_ballvol(dem->part.r[ipart], BMM_NDIM);
+void bmm_dem_integ_euler(struct bmm_dem *const dem) {
+  double const dt = dem->script.dt;
 
-  dem->est.chi = v / vhc;
+  if (dt == 0.0)
+    return;
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
-    double const rho = dem->opts.part.rho / dem->est.chi;
+  size_t const npart = dem->part.n;
+  size_t const ncomp = npart * BMM_NDIM;
 
-    dem->part.m[ipart] = rho * bmm_geom_ballvol(dem->part.r[ipart], 3);
+  double *restrict const x = BMM_DEM_ALIGNED((double *) dem->part.x);
+  double *restrict const v = BMM_DEM_ALIGNED((double *) dem->part.v);
+  double const *restrict const a = BMM_DEM_ALIGNED((double *) dem->part.a);
+  double *restrict const phi = BMM_DEM_ALIGNED(dem->part.phi);
+  double *restrict const omega = BMM_DEM_ALIGNED(dem->part.omega);
+  double const *restrict const alpha = BMM_DEM_ALIGNED(dem->part.alpha);
+
+  for (size_t icomp = 0; icomp < ncomp; ++icomp) {
+    x[icomp] += v[icomp] * dt;
+    v[icomp] += a[icomp] * dt;
   }
 
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    bmm_dem_cache_j(dem, ipart);
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    phi[ipart] += omega[ipart] * dt;
+    omega[ipart] += alpha[ipart] * dt;
+  }
 
-  return true;
+  bmm_dem_integ_wrap(dem);
 }
 
-__attribute__ ((__nonnull__))
-static bool bmm_dem_script_create_hc(struct bmm_dem *const dem) {
-  double const etahc = bmm_geom_ballvol(0.5, BMM_NDIM);
-  double const vhc = $(bmm_prod, double)(dem->opts.box.x, BMM_NDIM);
-  double const eta = dem->opts.script.params[dem->script.i].create.eta;
-  double const v = vhc * (etahc / eta);
+void bmm_dem_integ_taylor(struct bmm_dem *const dem) {
+  double const dt = dem->script.dt;
 
-  double const vlim = vhc * eta;
-  // TODO Overlap factor.
-  // double const rspace = bmm_ival_midpoint(dem->opts.part.rnew);
-  double const rspace = dem->opts.part.rnew[1];
+  if (dt == 0.0)
+    return;
 
-  double x[BMM_NDIM];
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    x[idim] = 0.0;
+  double const dt2 = $(bmm_power, double)(dt, 2);
 
-  double vnow = 0.0;
+  size_t const npart = dem->part.n;
+  size_t const ncomp = npart * BMM_NDIM;
 
-  for ever {
-    double const r = bmm_random_get(dem->rng, dem->opts.part.rnew);
-    double const v = bmm_geom_ballvol(r, BMM_NDIM);
+  double *restrict const x = BMM_DEM_ALIGNED((double *) dem->part.x);
+  double *restrict const v = BMM_DEM_ALIGNED((double *) dem->part.v);
+  double const *restrict const a = BMM_DEM_ALIGNED((double *) dem->part.a);
+  double *restrict const phi = BMM_DEM_ALIGNED(dem->part.phi);
+  double *restrict const omega = BMM_DEM_ALIGNED(dem->part.omega);
+  double const *restrict const alpha = BMM_DEM_ALIGNED(dem->part.alpha);
 
-    double const vnext = vnow + v;
+  for (size_t icomp = 0; icomp < ncomp; ++icomp) {
+    x[icomp] += v[icomp] * dt + (1.0 / 2.0) * a[icomp] * dt2;
+    v[icomp] += a[icomp] * dt;
+  }
 
-    if (vnext <= vlim) {
-      size_t ipart = bmm_dem_addpart(dem);
-      if (ipart == SIZE_MAX)
-        return false;
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    phi[ipart] += omega[ipart] * dt + (1.0 / 2.0) * alpha[ipart] * dt2;
+    omega[ipart] += alpha[ipart] * dt;
+  }
 
-      dem->part.r[ipart] = r;
-      dem->part.m[ipart] = dem->opts.part.rho * bmm_geom_ballvol(r, 3);
+  bmm_dem_integ_wrap(dem);
+}
 
-      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-        dem->part.x[ipart][idim] = x[idim] + rspace;
+void bmm_dem_integ_vel(struct bmm_dem *const dem) {
+  double const dt = dem->script.dt;
 
-      x[0] += 2.0 * rspace;
+  if (dt == 0.0)
+    return;
 
-      if (x[0] + 2.0 * rspace >= dem->opts.box.x[0]) {
-        x[0] = 0.0;
-        x[1] += 2.0 * rspace;
-      }
+  double const dt2 = $(bmm_power, double)(dt, 2);
 
-      vnow = vnext;
-    } else
-      break;
-  }
+  size_t const npart = dem->part.n;
+  size_t const ncomp = npart * BMM_NDIM;
 
-  return true;
-}
+  double *restrict const x = BMM_DEM_ALIGNED((double *) dem->part.x);
+  double const *restrict const v = BMM_DEM_ALIGNED((double *) dem->part.v);
+  double const *restrict const a = BMM_DEM_ALIGNED((double *) dem->part.a);
+  double *restrict const ao =
+    BMM_DEM_ALIGNED((double *) dem->integ.params.velvet.ao);
+  double *restrict const phi = BMM_DEM_ALIGNED(dem->part.phi);
+  double const *restrict const omega = BMM_DEM_ALIGNED(dem->part.omega);
+  double const *restrict const alpha = BMM_DEM_ALIGNED(dem->part.alpha);
+  double *restrict const alphao =
+    BMM_DEM_ALIGNED(dem->integ.params.velvet.alphao);
 
-__attribute__ ((__nonnull__))
-static bool bmm_dem_script_create_hex(struct bmm_dem *const dem) {
-  double const etahc = bmm_geom_ballvol(0.5, BMM_NDIM);
-  double const vhc = $(bmm_prod, double)(dem->opts.box.x, BMM_NDIM);
-  double const eta = dem->opts.script.params[dem->script.i].create.eta;
-  double const v = vhc * (etahc / eta);
+  for (size_t icomp = 0; icomp < ncomp; ++icomp) {
+    ao[icomp] = a[icomp];
 
-  double const vlim = vhc * eta;
-  // double const rspace = bmm_ival_midpoint(dem->opts.part.rnew);
-  double const rspace = dem->opts.part.rnew[1];
-  double const dspace = (sqrt(3.0) / 2.0) * rspace;
+    x[icomp] += v[icomp] * dt + (1.0 / 2.0) * a[icomp] * dt2;
+  }
 
-  double x[BMM_NDIM];
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    x[idim] = 0.0;
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    alphao[ipart] = alpha[ipart];
 
-  double vnow = 0.0;
-  bool parity = false;
+    phi[ipart] += omega[ipart] * dt + (1.0 / 2.0) * alpha[ipart] * dt2;
+  }
 
-  for ever {
-    double const r = bmm_random_get(dem->rng, dem->opts.part.rnew);
-    double const v = bmm_geom_ballvol(r, BMM_NDIM);
+  bmm_dem_integ_wrap(dem);
+}
 
-    double const vnext = vnow + v;
+void bmm_dem_integ_vet(struct bmm_dem *const dem) {
+  double const dt = dem->script.dt;
 
-    if (vnext <= vlim) {
-      size_t ipart = bmm_dem_addpart(dem);
-      if (ipart == SIZE_MAX)
-        return false;
+  if (dt == 0.0)
+    return;
 
-      dem->part.r[ipart] = r;
-      dem->part.m[ipart] = dem->opts.part.rho * bmm_geom_ballvol(r, 3);
+  size_t const npart = dem->part.n;
+  size_t const ncomp = npart * BMM_NDIM;
 
-      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-        dem->part.x[ipart][idim] = x[idim] + rspace;
+  double *restrict const v = BMM_DEM_ALIGNED((double *) dem->part.v);
+  double const *restrict const a = BMM_DEM_ALIGNED((double *) dem->part.a);
+  double const *restrict const ao =
+    BMM_DEM_ALIGNED((double *) dem->integ.params.velvet.ao);
+  double *restrict const omega = BMM_DEM_ALIGNED(dem->part.omega);
+  double const *restrict const alpha = BMM_DEM_ALIGNED(dem->part.alpha);
+  double const *restrict const alphao =
+    BMM_DEM_ALIGNED(dem->integ.params.velvet.alphao);
 
-      x[0] += 2.0 * rspace;
+  for (size_t icomp = 0; icomp < ncomp; ++icomp)
+    v[icomp] += (1.0 / 2.0) * (a[icomp] + ao[icomp]) * dt;
 
-      if (x[0] + 2.0 * rspace >= dem->opts.box.x[0]) {
-        x[0] = parity ? 0.0 : rspace;
-        x[1] += 2.0 * dspace;
-        parity = !parity;
-      }
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    omega[ipart] += (1.0 / 2.0) * (alpha[ipart] + alphao[ipart]) * dt;
+}
 
-      vnow = vnext;
-    } else
-      break;
+/// The call `bmm_dem_integ_multi_pred(dem, c)`
+/// predicts the positions and velocities of the simulation `dem`
+/// for the multistep schemes,
+/// whose position predictors and correctors weigh
+/// the change in acceleration by `c` for linear motion.
+__attribute__ ((__nonnull__))
+static void bmm_dem_integ_multi_pred(struct bmm_dem *const dem,
+    double const c) {
+  double const dt = dem->script.dt;
+
+  if (dt == 0.0)
+    return;
+
+  double const dt2 = $(bmm_power, double)(dt, 2);
+
+  // The very old accelerations are not needed anymore,
+  // so the current ones take over their storage.
+  {
+    double (*const p)[BMM_NDIM] = dem->integ.params.beeman.aoo;
+    dem->integ.params.beeman.aoo = dem->integ.params.beeman.ao;
+    dem->integ.params.beeman.ao = p;
+
+    double *const q = dem->integ.params.beeman.alphaoo;
+    dem->integ.params.beeman.alphaoo = dem->integ.params.beeman.alphao;
+    dem->integ.params.beeman.alphao = q;
   }
 
-  return true;
+  size_t const npart = dem->part.n;
+  size_t const ncomp = npart * BMM_NDIM;
+
+  double *restrict const x = BMM_DEM_ALIGNED((double *) dem->part.x);
+  double *restrict const v = BMM_DEM_ALIGNED((double *) dem->part.v);
+  double const *restrict const a = BMM_DEM_ALIGNED((double *) dem->part.a);
+  double *restrict const ao =
+    BMM_DEM_ALIGNED((double *) dem->integ.params.beeman.ao);
+  double const *restrict const aoo =
+    BMM_DEM_ALIGNED((double *) dem->integ.params.beeman.aoo);
+  double *restrict const phi = BMM_DEM_ALIGNED(dem->part.phi);
+  double *restrict const omega = BMM_DEM_ALIGNED(dem->part.omega);
+  double const *restrict const alpha = BMM_DEM_ALIGNED(dem->part.alpha);
+  double *restrict const alphao =
+    BMM_DEM_ALIGNED(dem->integ.params.beeman.alphao);
+  double const *restrict const alphaoo =
+    BMM_DEM_ALIGNED(dem->integ.params.beeman.alphaoo);
+
+  for (size_t icomp = 0; icomp < ncomp; ++icomp) {
+    double const da = a[icomp] - aoo[icomp];
+
+    ao[icomp] = a[icomp];
+
+    x[icomp] += v[icomp] * dt + ((1.0 / 2.0) * a[icomp] + c * da) * dt2;
+    v[icomp] += (a[icomp] + (1.0 / 2.0) * da) * dt;
+  }
+
+  // Rotations always follow the Beeman scheme.
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    double const dalpha = alpha[ipart] - alphaoo[ipart];
+
+    alphao[ipart] = alpha[ipart];
+
+    phi[ipart] += omega[ipart] * dt +
+      ((1.0 / 2.0) * alpha[ipart] + (1.0 / 6.0) * dalpha) * dt2;
+    omega[ipart] += (alpha[ipart] + (1.0 / 2.0) * dalpha) * dt;
+  }
+
+  bmm_dem_integ_wrap(dem);
 }
 
-// TODO Remove or polish this test diamond.
+/// The call `bmm_dem_integ_multi_corr(dem, c, cv)`
+/// corrects the predicted positions and velocities of the simulation `dem`
+/// for the multistep schemes,
+/// whose position and velocity correctors weigh
+/// the second difference of the accelerations by `c` and `cv`
+/// for linear motion.
+/// Correcting the predicted values instead of
+/// starting over from the old ones gives the same result,
+/// because nothing moves the particles in between.
 __attribute__ ((__nonnull__))
-static bool bmm_dem_script_create_testpile(struct bmm_dem *const dem) {
-  double const etahc = bmm_geom_ballvol(0.5, BMM_NDIM);
-  double const vhc = $(bmm_prod, double)(dem->opts.box.x, BMM_NDIM);
-  double const eta = dem->opts.script.params[dem->script.i].test.eta;
-  double const v = vhc * (etahc / eta);
+static void bmm_dem_integ_multi_corr(struct bmm_dem *const dem,
+    double const c, double const cv) {
+  double const dt = dem->script.dt;
 
-  double const vlim = vhc * eta;
-  // double const rspace = bmm_ival_midpoint(dem->opts.part.rnew);
-  double const rspace = dem->opts.part.rnew[1];
-  double const dspace = (sqrt(3.0) / 2.0) * rspace;
+  if (dt == 0.0)
+    return;
 
-  double x[BMM_NDIM];
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    x[idim] = 0.0;
+  double const dt2 = $(bmm_power, double)(dt, 2);
 
-  double vnow = 0.0;
-  bool parity = false;
+  size_t const npart = dem->part.n;
+  size_t const ncomp = npart * BMM_NDIM;
+
+  double *restrict const x = BMM_DEM_ALIGNED((double *) dem->part.x);
+  double *restrict const v = BMM_DEM_ALIGNED((double *) dem->part.v);
+  double const *restrict const a = BMM_DEM_ALIGNED((double *) dem->part.a);
+  double const *restrict const ao =
+    BMM_DEM_ALIGNED((double *) dem->integ.params.beeman.ao);
+  double const *restrict const aoo =
+    BMM_DEM_ALIGNED((double *) dem->integ.params.beeman.aoo);
+  double *restrict const phi = BMM_DEM_ALIGNED(dem->part.phi);
+  double *restrict const omega = BMM_DEM_ALIGNED(dem->part.omega);
+  double const *restrict const alpha = BMM_DEM_ALIGNED(dem->part.alpha);
+  double const *restrict const alphao =
+    BMM_DEM_ALIGNED(dem->integ.params.beeman.alphao);
+  double const *restrict const alphaoo =
+    BMM_DEM_ALIGNED(dem->integ.params.beeman.alphaoo);
+
+  for (size_t icomp = 0; icomp < ncomp; ++icomp) {
+    double const d2a = a[icomp] - 2.0 * ao[icomp] + aoo[icomp];
+
+    x[icomp] += c * d2a * dt2;
+    v[icomp] += cv * d2a * dt;
+  }
 
-  for ever {
-    double const r = bmm_random_get(dem->rng, dem->opts.part.rnew);
-    double const v = bmm_geom_ballvol(r, BMM_NDIM);
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    double const d2alpha =
+      alpha[ipart] - 2.0 * alphao[ipart] + alphaoo[ipart];
 
-    double const vnext = vnow + v;
+    phi[ipart] += (1.0 / 6.0) * d2alpha * dt2;
+    omega[ipart] += (1.0 / 3.0) * d2alpha * dt;
+  }
 
-    if (vnext <= vlim) {
-      size_t ipart = bmm_dem_addpart(dem);
-      if (ipart == SIZE_MAX)
-        return false;
+  bmm_dem_integ_wrap(dem);
+}
 
-      dem->part.r[ipart] = r;
-      dem->part.m[ipart] = dem->opts.part.rho * bmm_geom_ballvol(r, 3);
+void bmm_dem_integ_bee(struct bmm_dem *const dem) {
+  bmm_dem_integ_multi_pred(dem, 1.0 / 6.0);
+}
+
+void bmm_dem_integ_man(struct bmm_dem *const dem) {
+  bmm_dem_integ_multi_corr(dem, 1.0 / 6.0, 1.0 / 3.0);
+}
+
+void bmm_dem_integ_kura(struct bmm_dem *const dem) {
+  bmm_dem_integ_multi_pred(dem, 1.0 / 8.0);
+}
+
+void bmm_dem_integ_ev(struct bmm_dem *const dem) {
+  bmm_dem_integ_multi_corr(dem, 1.0 / 8.0, 3.0 / 8.0);
+}
+
+/// The call `bmm_dem_sleep_rest(dem, ipart)`
+/// brings the particle `ipart` of the simulation `dem` to rest
+/// as it falls asleep,
+/// so that every integrator leaves it where it is.
+__attribute__ ((__nonnull__))
+static void bmm_dem_sleep_rest(struct bmm_dem *const dem, size_t const ipart) {
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+    dem->part.v[ipart][idim] = 0.0;
+    dem->part.a[ipart][idim] = 0.0;
+  }
 
+  dem->part.omega[ipart] = 0.0;
+  dem->part.alpha[ipart] = 0.0;
+
+  switch (dem->integ.tag) {
+    case BMM_DEM_INTEG_VELVET:
       for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-        dem->part.x[ipart][idim] = x[idim] + rspace;
+        dem->integ.params.velvet.ao[ipart][idim] = 0.0;
 
-      x[0] += 2.0 * rspace;
+      dem->integ.params.velvet.alphao[ipart] = 0.0;
 
-      if (x[0] + 2.0 * rspace >= dem->opts.box.x[0] + 2.0 * rspace) {
-        x[0] = parity ? 0.0 : rspace;
-        x[1] += 2.0 * dspace;
-        parity = !parity;
+      break;
+    case BMM_DEM_INTEG_BEEMAN:
+    case BMM_DEM_INTEG_KURAEV:
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+        dem->integ.params.beeman.ao[ipart][idim] = 0.0;
+        dem->integ.params.beeman.aoo[ipart][idim] = 0.0;
       }
 
-      if (fabs(dem->part.x[ipart][0] - dem->opts.box.x[0] / 2.0) +
-          fabs(dem->part.x[ipart][1] - dem->opts.box.x[1] / 2.0) >
-          dem->opts.box.x[0] / 1.9 ||
-          dem->part.x[ipart][1] < dem->opts.box.x[1] / 2.0 - rspace)
-        bmm_dem_rempart(dem, ipart);
-
-      if (fabs(dem->part.x[ipart][1] - dem->opts.box.x[1] / 2.0) < rspace)
-        dem->part.role[ipart] = BMM_DEM_ROLE_FIXED;
+      dem->integ.params.beeman.alphao[ipart] = 0.0;
+      dem->integ.params.beeman.alphaoo[ipart] = 0.0;
 
-      vnow = vnext;
-    } else
       break;
   }
+}
 
-  return true;
+/// The call `bmm_dem_sleep_wake(dem)`
+/// wakes up every particle of the simulation `dem`.
+__attribute__ ((__nonnull__))
+static void bmm_dem_sleep_wake(struct bmm_dem *const dem) {
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
+    dem->sleep.asleep[ipart] = false;
+    dem->sleep.poke[ipart] = false;
+    dem->sleep.nquiet[ipart] = 0;
+  }
+
+  dem->est.nsleep = 0;
+  dem->est.ngsleep = 0;
 }
 
+/// The call `bmm_dem_sleep(dem)`
+/// puts the groups of particles of the simulation `dem`
+/// that have stayed quiet for long enough to sleep and
+/// wakes up the sleeping groups that have been disturbed.
+/// Groups are held together by contacts and
+/// only free particles take part in them,
+/// so walls and driven particles neither sleep nor join groups.
+/// A sleeping group is disturbed when one of its members
+/// gains or loses a contact or
+/// when the force from the awake neighbors of one of its members changes.
 __attribute__ ((__nonnull__))
-static bool bmm_dem_script_create_testblock(struct bmm_dem *const dem) {
-  double const etahc = bmm_geom_ballvol(0.5, BMM_NDIM);
-  double const vhc = $(bmm_prod, double)(dem->opts.box.x, BMM_NDIM);
-  double const eta = dem->opts.script.params[dem->script.i].test.eta;
-  double const v = vhc * (etahc / eta);
+static void bmm_dem_sleep(struct bmm_dem *const dem) {
+  size_t const npart = dem->part.n;
+  size_t const nstep = dem->opts.sleep.nstep;
 
-  double const vlim = vhc * eta;
-  // double const rspace = bmm_ival_midpoint(dem->opts.part.rnew);
-  double const rspace = dem->opts.part.rnew[1];
-  double const dspace = rspace;
+  bool *const asleep = dem->sleep.asleep;
+  size_t *const nquiet = dem->sleep.nquiet;
+  size_t *const iparent = dem->sleep.iparent;
 
-  double x[BMM_NDIM];
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    x[idim] = 0.0;
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    if (dem->part.role[ipart] != BMM_DEM_ROLE_FREE ||
+        dem->clump.ibody[ipart] != SIZE_MAX) {
+      asleep[ipart] = false;
+      dem->sleep.poke[ipart] = false;
+      nquiet[ipart] = 0;
 
-  double vnow = 0.0;
-  bool parity = false;
+      continue;
+    }
 
-  for ever {
-    double const r = bmm_random_get(dem->rng, dem->opts.part.rnew);
-    double const v = bmm_geom_ballvol(r, BMM_NDIM);
+    if (asleep[ipart]) {
+      // The force from awake neighbors is only known
+      // once the particle has spent a step asleep.
+      if (isnan(dem->sleep.fref[ipart][0]))
+        for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+          dem->sleep.fref[ipart][idim] = dem->part.f[ipart][idim];
+      else {
+        double fdiff[BMM_NDIM];
+        bmm_geom2d_diff(fdiff, dem->part.f[ipart], dem->sleep.fref[ipart]);
 
-    double const vnext = vnow + v;
+        if (bmm_geom2d_norm(fdiff) > dem->opts.sleep.f)
+          dem->sleep.poke[ipart] = true;
+      }
+    } else {
+      double const ek = (1.0 / 2.0) * (dem->part.m[ipart] *
+          bmm_geom2d_norm2(dem->part.v[ipart]) + dem->cache.j[ipart] *
+          $(bmm_power, double)(dem->part.omega[ipart], 2));
 
-    if (vnext <= vlim) {
-      size_t ipart = bmm_dem_addpart(dem);
-      if (ipart == SIZE_MAX)
-        return false;
+      nquiet[ipart] = ek < dem->opts.sleep.ek &&
+        bmm_geom2d_norm(dem->part.f[ipart]) < dem->opts.sleep.f ?
+        nquiet[ipart] + 1 : 0;
+    }
+  }
 
-      dem->part.r[ipart] = r;
-      dem->part.m[ipart] = dem->opts.part.rho * bmm_geom_ballvol(r, 3);
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    iparent[ipart] = ipart;
+    dem->sleep.wake[ipart] = false;
+  }
 
-      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-        dem->part.x[ipart][idim] = x[idim] + rspace;
+  // Sleeping particles and quiet ones form groups of their own,
+  // so sleeping groups stay as they are
+  // while their quiet neighbors gather into new ones.
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict)
+    for (size_t ipart = 0; ipart < npart; ++ipart)
+      for (size_t icont = 0; icont < dem->pair[ict].cont.src[ipart].n;
+          ++icont) {
+        size_t const jpart = dem->pair[ict].cont.src[ipart].itgt[icont];
 
-      x[0] += 2.0 * rspace;
+        if (dem->part.role[ipart] == BMM_DEM_ROLE_FREE &&
+            dem->part.role[jpart] == BMM_DEM_ROLE_FREE &&
+            asleep[ipart] == asleep[jpart] &&
+            (asleep[ipart] || (nquiet[ipart] >= nstep && nquiet[jpart] >= nstep)))
+          (void) bmm_dem_djs_union(iparent, ipart, jpart);
+      }
 
-      if (x[0] + 2.0 * rspace >= dem->opts.box.x[0] + 2.0 * rspace) {
-        x[0] = 0.0;
-        x[1] += 2.0 * dspace;
-        parity = !parity;
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    if (dem->sleep.poke[ipart]) {
+      dem->sleep.poke[ipart] = false;
+
+      if (asleep[ipart])
+        dem->sleep.wake[bmm_dem_djs_find(iparent, ipart)] = true;
+    }
+
+  dem->est.nsleep = 0;
+  dem->est.ngsleep = 0;
+
+  size_t nnew = 0;
+
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    if (dem->part.role[ipart] != BMM_DEM_ROLE_FREE)
+      continue;
+
+    size_t const iroot = bmm_dem_djs_find(iparent, ipart);
+
+    if (asleep[ipart]) {
+      if (dem->sleep.wake[iroot]) {
+        asleep[ipart] = false;
+        nquiet[ipart] = 0;
       }
+    } else if (nquiet[ipart] >= nstep) {
+      asleep[ipart] = true;
+      bmm_dem_sleep_rest(dem, ipart);
 
-      if (fabs(dem->part.x[ipart][0] - dem->opts.box.x[0] / 2.0) +
-          fabs(dem->part.x[ipart][1] - dem->opts.box.x[1] / 2.0) >
-          dem->opts.box.x[0] / 1.9 ||
-          dem->part.x[ipart][1] < dem->opts.box.x[1] / 2.0 - rspace)
-        bmm_dem_rempart(dem, ipart);
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+        dem->sleep.fref[ipart][idim] = (double) NAN;
 
-      if (fabs(dem->part.x[ipart][1] - dem->opts.box.x[1] / 2.0) < rspace)
-        dem->part.role[ipart] = BMM_DEM_ROLE_FIXED;
+      ++nnew;
+    }
 
-      vnow = vnext;
-    } else
-      break;
+    if (asleep[ipart]) {
+      ++dem->est.nsleep;
+
+      if (iroot == ipart)
+        ++dem->est.ngsleep;
+    }
   }
 
-  return true;
+  // Contacts with particles that just fell asleep are no longer evaluated,
+  // so their sleeping neighbors need to measure their forces again.
+  if (nnew != 0)
+    for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict)
+      for (size_t ipart = 0; ipart < npart; ++ipart)
+        for (size_t icont = 0; icont < dem->pair[ict].cont.src[ipart].n;
+            ++icont) {
+          size_t const jpart = dem->pair[ict].cont.src[ipart].itgt[icont];
+
+          if (bmm_dem_sleeping(dem, ipart, jpart)) {
+            bool const inew = isnan(dem->sleep.fref[ipart][0]);
+            bool const jnew = isnan(dem->sleep.fref[jpart][0]);
+
+            if (inew != jnew)
+              for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+                dem->sleep.fref[ipart][idim] = (double) NAN;
+                dem->sleep.fref[jpart][idim] = (double) NAN;
+              }
+          }
+        }
 }
 
+/// The call `bmm_dem_clump_form(dem)`
+/// turns the intact fragments of the simulation `dem`
+/// that are made of enough free particles that are neither asleep
+/// nor in clumps already and whose strong contacts are far from yielding
+/// into rigid clumps.
+/// Fragments that span more than half of the box
+/// along periodic dimensions are left alone just as every fragment is
+/// under the Lees--Edwards boundary conditions.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
 __attribute__ ((__nonnull__))
-static bool bmm_dem_script_create_testplane(struct bmm_dem *const dem) {
-  double const vhc = $(bmm_prod, double)(dem->opts.box.x, BMM_NDIM);
-  double const v = vhc;
+static bool bmm_dem_clump_form(struct bmm_dem *const dem) {
+  if (bmm_dem_le(dem))
+    return true;
 
-  double const vlim = vhc;
-  double const rspace = bmm_ival_midpoint(dem->opts.part.rnew);
-  // double const rspace = dem->opts.part.rnew[1];
-  double const dspace = (sqrt(3.0) / 2.0) * rspace;
+  size_t const npart = dem->part.n;
+  size_t const ict = BMM_DEM_CT_STRONG;
+  double const fyield = dem->opts.clump.fyield;
 
-  double x[BMM_NDIM];
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    x[idim] = 0.0;
+  bmm_dem_est_frag(dem);
 
-  double vnow = 0.0;
-  bool parity = false;
+  size_t *const iparent = dem->frag.iparent;
+  size_t const nold = dem->clump.n;
 
-  for ever {
-    double const r = bmm_random_get(dem->rng, dem->opts.part.rnew);
-    double const v = bmm_geom_ballvol(r, BMM_NDIM);
+  size_t nlink = 0;
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    nlink += dem->pair[ict].cont.src[ipart].n;
 
-    double const vnext = vnow + v;
+  bool *const ok = malloc(npart * sizeof *ok);
+  size_t *const ioff = malloc((npart + 1) * sizeof *ioff);
+  size_t *const iadj = malloc($(bmm_max, size_t)(2 * nlink, 1) * sizeof *iadj);
+  size_t *const iqueue = malloc(npart * sizeof *iqueue);
+  double (*const u)[BMM_NDIM] = malloc(npart * sizeof *u);
+  if (ok == NULL || ioff == NULL || iadj == NULL ||
+      iqueue == NULL || u == NULL) {
+    BMM_TLE_STDS();
 
-    if (vnext <= vlim) {
-      size_t ipart = bmm_dem_addpart(dem);
-      if (ipart == SIZE_MAX)
-        return false;
+    free(u);
+    free(iqueue);
+    free(iadj);
+    free(ioff);
+    free(ok);
 
-      dem->part.role[ipart] = BMM_DEM_ROLE_FIXED;
+    return false;
+  }
 
-      dem->part.r[ipart] = r;
-      dem->part.m[ipart] = dem->opts.part.rho * bmm_geom_ballvol(r, 3);
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    ok[ipart] = dem->frag.nmemb[ipart] >= dem->opts.clump.nmin;
 
-      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-        dem->part.x[ipart][idim] = x[idim] + rspace;
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    if (dem->part.role[ipart] != BMM_DEM_ROLE_FREE ||
+        dem->clump.ibody[ipart] != SIZE_MAX ||
+        (dem->opts.sleep.on && dem->sleep.asleep[ipart]))
+      ok[bmm_dem_djs_find(iparent, ipart)] = false;
 
-      x[0] += 2.0 * rspace / 4.0;
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    size_t const iroot = bmm_dem_djs_find(iparent, ipart);
 
-      if (x[0] + 2.0 * rspace >= dem->opts.box.x[0] + 2.0 * rspace) {
-        break;
+    if (ok[iroot])
+      for (size_t icont = 0; icont < dem->pair[ict].cont.src[ipart].n;
+          ++icont) {
+        size_t const jpart = dem->pair[ict].cont.src[ipart].itgt[icont];
+
+        double xdiffij[BMM_NDIM];
+        double const kij = bmm_dem_pdiff(xdiffij, dem,
+            dem->part.x[jpart], dem->part.x[ipart]);
+
+        if (!(bmm_dem_yield_load(dem, ipart, jpart, icont,
+                xdiffij, kij) < fyield)) {
+          ok[iroot] = false;
+
+          break;
+        }
+      }
+  }
+
+  // The strong contacts are stored one way,
+  // so walking the fragments needs them the other way too.
+  for (size_t ipart = 0; ipart <= npart; ++ipart)
+    ioff[ipart] = 0;
+
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    for (size_t icont = 0; icont < dem->pair[ict].cont.src[ipart].n; ++icont) {
+      ++ioff[ipart + 1];
+      ++ioff[dem->pair[ict].cont.src[ipart].itgt[icont] + 1];
+    }
+
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    ioff[ipart + 1] += ioff[ipart];
+
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    dem->clump.nlink[ipart] = 0;
+
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    for (size_t icont = 0; icont < dem->pair[ict].cont.src[ipart].n; ++icont) {
+      size_t const jpart = dem->pair[ict].cont.src[ipart].itgt[icont];
+
+      iadj[ioff[ipart] + dem->clump.nlink[ipart]] = jpart;
+      ++dem->clump.nlink[ipart];
+      iadj[ioff[jpart] + dem->clump.nlink[jpart]] = ipart;
+      ++dem->clump.nlink[jpart];
+    }
+
+  // Positions are unwrapped by walking outwards from the representatives,
+  // which also reveals the fragments that wrap around.
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    u[ipart][0] = (double) NAN;
+
+  for (size_t iroot = 0; iroot < npart; ++iroot) {
+    if (!ok[iroot] || bmm_dem_djs_find(iparent, iroot) != iroot)
+      continue;
+
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      u[iroot][idim] = dem->part.x[iroot][idim];
+
+    size_t nqueue = 0;
+    iqueue[nqueue] = iroot;
+    ++nqueue;
+
+    for (size_t iqueued = 0; iqueued < nqueue; ++iqueued) {
+      size_t const ipart = iqueue[iqueued];
+
+      for (size_t iadjs = ioff[ipart]; iadjs < ioff[ipart + 1]; ++iadjs) {
+        size_t const jpart = iadj[iadjs];
+
+        double xdiffij[BMM_NDIM];
+        (void) bmm_dem_pdiff(xdiffij, dem,
+            dem->part.x[jpart], dem->part.x[ipart]);
+
+        double uj[BMM_NDIM];
+        bmm_geom2d_add(uj, u[ipart], xdiffij);
+
+        if (isnan(u[jpart][0])) {
+          for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+            u[jpart][idim] = uj[idim];
+
+          iqueue[nqueue] = jpart;
+          ++nqueue;
+        } else if (bmm_geom2d_dist2(u[jpart], uj) >
+            $(bmm_power, double)(dem->part.r[jpart], 2))
+          ok[iroot] = false;
+      }
+    }
+
+    // Fragments that reach around far enough to touch their own images
+    // cannot turn as rigid bodies would.
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      if (dem->opts.box.per[idim]) {
+        double umin = (double) INFINITY;
+        double umax = (double) -INFINITY;
+
+        for (size_t iqueued = 0; iqueued < nqueue; ++iqueued) {
+          size_t const ipart = iqueue[iqueued];
+
+          umin = fmin(umin, u[ipart][idim] - dem->part.r[ipart]);
+          umax = fmax(umax, u[ipart][idim] + dem->part.r[ipart]);
+        }
+
+        if (umax - umin > dem->opts.box.x[idim] / 2.0)
+          ok[iroot] = false;
+      }
+  }
+
+  for (size_t iroot = 0; iroot < npart; ++iroot)
+    if (ok[iroot] && bmm_dem_djs_find(iparent, iroot) == iroot) {
+      struct bmm_dem_clump *const body = &dem->clump.body[dem->clump.n];
+
+      body->m = 0.0;
+      body->j = 0.0;
+
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+        body->x[idim] = 0.0;
+        body->v[idim] = 0.0;
+        body->f[idim] = 0.0;
+      }
+
+      body->phi = 0.0;
+      body->omega = 0.0;
+      body->tau = 0.0;
+      body->brk = false;
+
+      dem->clump.ibody[iroot] = dem->clump.n;
+      ++dem->clump.n;
+    }
+
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    size_t const iroot = bmm_dem_djs_find(iparent, ipart);
+
+    if (ok[iroot]) {
+      size_t const ibody = dem->clump.ibody[iroot];
+      struct bmm_dem_clump *const body = &dem->clump.body[ibody];
+      double const m = dem->part.m[ipart];
+
+      dem->clump.ibody[ipart] = ibody;
+
+      body->m += m;
+
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+        body->x[idim] += m * u[ipart][idim];
+        body->v[idim] += m * dem->part.v[ipart][idim];
       }
+    }
+  }
+
+  for (size_t ibody = nold; ibody < dem->clump.n; ++ibody)
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+      dem->clump.body[ibody].x[idim] /= dem->clump.body[ibody].m;
+      dem->clump.body[ibody].v[idim] /= dem->clump.body[ibody].m;
+    }
+
+  // The angular momentum about the center of mass is conserved.
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    if (ok[bmm_dem_djs_find(iparent, ipart)]) {
+      struct bmm_dem_clump *const body =
+        &dem->clump.body[dem->clump.ibody[ipart]];
+      double const m = dem->part.m[ipart];
+
+      bmm_geom2d_diff(dem->clump.d[ipart], u[ipart], body->x);
+      dem->clump.dphi[ipart] = dem->part.phi[ipart];
+
+      double const *const d = dem->clump.d[ipart];
+
+      double v[BMM_NDIM];
+      bmm_geom2d_diff(v, dem->part.v[ipart], body->v);
+
+      body->j += dem->cache.j[ipart] + m * bmm_geom2d_norm2(d);
+      body->omega += dem->cache.j[ipart] * dem->part.omega[ipart] +
+        m * (d[0] * v[1] - d[1] * v[0]);
+    }
+
+  for (size_t ibody = nold; ibody < dem->clump.n; ++ibody)
+    dem->clump.body[ibody].omega /= dem->clump.body[ibody].j;
+
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    if (ok[bmm_dem_djs_find(iparent, ipart)]) {
+      struct bmm_dem_clump const *const body =
+        &dem->clump.body[dem->clump.ibody[ipart]];
+      double const *const d = dem->clump.d[ipart];
+
+      dem->part.v[ipart][0] = body->v[0] - body->omega * d[1];
+      dem->part.v[ipart][1] = body->v[1] + body->omega * d[0];
+      dem->part.omega[ipart] = body->omega;
+    }
+
+  dem->est.nclump = dem->clump.n;
+
+  free(u);
+  free(iqueue);
+  free(iadj);
+  free(ioff);
+  free(ok);
+
+  return true;
+}
+
+/// The call `bmm_dem_clump_arm(d, dem, ipart)`
+/// sets `d` to the offset of the particle `ipart`
+/// from the center of mass of its clump in the simulation `dem`.
+__attribute__ ((__nonnull__))
+static void bmm_dem_clump_arm(double *const d,
+    struct bmm_dem const *const dem, size_t const ipart) {
+  double const phi = dem->clump.body[dem->clump.ibody[ipart]].phi;
+  double const *const d0 = dem->clump.d[ipart];
+
+  d[0] = cos(phi) * d0[0] - sin(phi) * d0[1];
+  d[1] = sin(phi) * d0[0] + cos(phi) * d0[1];
+}
+
+/// The call `bmm_dem_clump_accel(a, dem, ipart)`
+/// sets `a` to the acceleration of the particle `ipart`
+/// that moves along with its clump in the simulation `dem`.
+__attribute__ ((__nonnull__))
+static void bmm_dem_clump_accel(double *const a,
+    struct bmm_dem const *const dem, size_t const ipart) {
+  struct bmm_dem_clump const *const body =
+    &dem->clump.body[dem->clump.ibody[ipart]];
+
+  double d[BMM_NDIM];
+  bmm_dem_clump_arm(d, dem, ipart);
+
+  double const alpha = body->tau / body->j;
+  double const omega2 = $(bmm_power, double)(body->omega, 2);
+
+  a[0] = body->f[0] / body->m - alpha * d[1] - omega2 * d[0];
+  a[1] = body->f[1] / body->m + alpha * d[0] - omega2 * d[1];
+}
+
+/// The call `bmm_dem_clump_slack(g, dem, ipart)`
+/// sets `g` to the share of each strong contact inside the clump
+/// of the particle `ipart` in the simulation `dem`
+/// in the force that the particle gets from outside
+/// beyond what it takes to move along with the clump.
+__attribute__ ((__nonnull__))
+static void bmm_dem_clump_slack(double *const g,
+    struct bmm_dem const *const dem, size_t const ipart) {
+  bool const substep = bmm_dem_substep(dem);
+
+  double a[BMM_NDIM];
+  bmm_dem_clump_accel(a, dem, ipart);
+
+  double const n = (double) $(bmm_max, size_t)(dem->clump.nlink[ipart], 1);
+
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    g[idim] = (dem->part.f[ipart][idim] +
+        (substep ? dem->integ.params.respa.f[ipart][idim] : 0.0) -
+        dem->part.m[ipart] * a[idim]) / n;
+}
+
+/// The call `bmm_dem_clump_step(dem)`
+/// moves the clumps of the simulation `dem` as rigid bodies
+/// under the forces their particles got from outside,
+/// puts their particles where the clumps carry them and
+/// breaks up the clumps whose strong contacts would come close to yielding.
+/// The load on each strong contact inside a clump is estimated
+/// by sharing the force that keeps each of its particles
+/// moving along with the clump evenly among the strong contacts
+/// of the particle inside the clump.
+__attribute__ ((__nonnull__))
+static void bmm_dem_clump_step(struct bmm_dem *const dem) {
+  size_t const npart = dem->part.n;
+  size_t const ict = BMM_DEM_CT_STRONG;
+  double const dt = dem->script.dt;
+  bool const substep = bmm_dem_substep(dem);
+
+  for (size_t ibody = 0; ibody < dem->clump.n; ++ibody) {
+    struct bmm_dem_clump *const body = &dem->clump.body[ibody];
+
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      body->f[idim] = 0.0;
+
+    body->tau = 0.0;
+    body->brk = false;
+  }
+
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    size_t const ibody = dem->clump.ibody[ipart];
+    if (ibody == SIZE_MAX)
+      continue;
+
+    struct bmm_dem_clump *const body = &dem->clump.body[ibody];
+
+    double f[BMM_NDIM];
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      f[idim] = dem->part.f[ipart][idim] +
+        (substep ? dem->integ.params.respa.f[ipart][idim] : 0.0);
+
+    double const tau = dem->part.tau[ipart] +
+      (substep ? dem->integ.params.respa.tau[ipart] : 0.0);
+
+    double d[BMM_NDIM];
+    bmm_dem_clump_arm(d, dem, ipart);
+
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      body->f[idim] += f[idim];
+
+    body->tau += tau + d[0] * f[1] - d[1] * f[0];
+  }
+
+  for (size_t ibody = 0; ibody < dem->clump.n; ++ibody) {
+    struct bmm_dem_clump *const body = &dem->clump.body[ibody];
+
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+      body->v[idim] += (body->f[idim] / body->m) * dt;
+      body->x[idim] += body->v[idim] * dt;
+    }
+
+    body->omega += (body->tau / body->j) * dt;
+    body->phi += body->omega * dt;
+  }
+
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    size_t const ibody = dem->clump.ibody[ipart];
+    if (ibody == SIZE_MAX)
+      continue;
+
+    struct bmm_dem_clump const *const body = &dem->clump.body[ibody];
+
+    double d[BMM_NDIM];
+    bmm_dem_clump_arm(d, dem, ipart);
+
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      dem->part.x[ipart][idim] = body->x[idim] + d[idim];
+
+    dem->part.v[ipart][0] = body->v[0] - body->omega * d[1];
+    dem->part.v[ipart][1] = body->v[1] + body->omega * d[0];
+
+    bmm_dem_wrap(dem, ipart);
+
+    bmm_dem_clump_accel(dem->part.a[ipart], dem, ipart);
+
+    dem->part.phi[ipart] = body->phi + dem->clump.dphi[ipart];
+    dem->part.omega[ipart] = body->omega;
+    dem->part.alpha[ipart] = body->tau / body->j;
+  }
+
+  size_t nbrk = 0;
+
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    for (size_t icont = 0; icont < dem->pair[ict].cont.src[ipart].n; ++icont) {
+      size_t const jpart = dem->pair[ict].cont.src[ipart].itgt[icont];
+
+      if (!bmm_dem_rigid(dem, ipart, jpart) ||
+          dem->clump.body[dem->clump.ibody[ipart]].brk)
+        continue;
+
+      double xdiffij[BMM_NDIM];
+      (void) bmm_dem_pdiff(xdiffij, dem,
+          dem->part.x[jpart], dem->part.x[ipart]);
+
+      double xnormij[BMM_NDIM];
+      bmm_geom2d_scale(xnormij, xdiffij, 1.0 / bmm_geom2d_norm(xdiffij));
+
+      double xtangij[BMM_NDIM];
+      bmm_geom2d_rperp(xtangij, xnormij);
+
+      double gi[BMM_NDIM];
+      bmm_dem_clump_slack(gi, dem, ipart);
+
+      double gj[BMM_NDIM];
+      bmm_dem_clump_slack(gj, dem, jpart);
+
+      double fij[BMM_NDIM];
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+        fij[idim] = (gj[idim] - gi[idim]) / 2.0;
+
+      double const fnormij = -bmm_geom2d_dot(fij, xnormij);
+      double const ftangij = fabs(bmm_geom2d_dot(fij, xtangij));
+
+      if (bmm_dem_yield_crit(dem, ipart, jpart, icont,
+            fnormij, ftangij) > dem->opts.clump.fyield) {
+        dem->clump.body[dem->clump.ibody[ipart]].brk = true;
+        ++nbrk;
+      }
+    }
+
+  // Going backwards only ever moves clumps that have been looked at.
+  if (nbrk != 0)
+    for (size_t ibody = dem->clump.n; ibody-- > 0; )
+      if (dem->clump.body[ibody].brk)
+        bmm_dem_clump_dissolve(dem, ibody);
+}
+
+void bmm_dem_stab(struct bmm_dem *const dem) {
+  // We could reset windings here,
+  // but that would interfere with beam models,
+  // so we relax instead.
+}
+
+void bmm_dem_integ_res(struct bmm_dem *const dem) {
+  double const dt = dem->script.dt;
+
+  if (dt == 0.0)
+    return;
+
+  size_t const npart = dem->part.n;
+
+  // The columns may not even exist yet.
+  if (npart == 0)
+    return;
+
+  size_t const nsub = dem->opts.time.nsub;
+  double const h = dt / (double) nsub;
+
+  // Fixed particles come last and only drift along with the others,
+  // unless they could not be moved there.
+  size_t const nmove = bmm_dem_role_end(dem, BMM_DEM_ROLE_DRIVEN);
+  bool const parted = dem->cache.parted;
+
+  double const *restrict const m = BMM_DEM_ALIGNED(dem->part.m);
+  double const *restrict const j = BMM_DEM_ALIGNED(dem->cache.j);
+  double (*restrict const f)[BMM_NDIM] =
+    BMM_DEM_ALIGNED(dem->integ.params.respa.f);
+  double *restrict const tau = BMM_DEM_ALIGNED(dem->integ.params.respa.tau);
+  bool const *restrict const asleep = BMM_DEM_ALIGNED(dem->sleep.asleep);
+  enum bmm_dem_role const *restrict const role =
+    BMM_DEM_ALIGNED(dem->part.role);
+
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      dem->part.v[ipart][idim] += (1.0 / 2.0) * dem->part.a[ipart][idim] * dt;
+
+    dem->part.omega[ipart] += (1.0 / 2.0) * dem->part.alpha[ipart] * dt;
+  }
+
+  // The contact models estimate work over the current time step,
+  // so it is shortened for the duration of the substeps.
+  dem->script.dt = h;
+
+  for (size_t isub = 0; isub < nsub; ++isub) {
+    for (size_t ipart = 0; ipart < nmove; ++ipart)
+      if ((parted || role[ipart] != BMM_DEM_ROLE_FIXED) && !asleep[ipart]) {
+        for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+          dem->part.v[ipart][idim] += (1.0 / 2.0) *
+            (f[ipart][idim] / m[ipart]) * h;
+
+        dem->part.omega[ipart] += (1.0 / 2.0) * (tau[ipart] / j[ipart]) * h;
+      }
+
+    for (size_t ipart = 0; ipart < npart; ++ipart) {
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+        dem->part.x[ipart][idim] += dem->part.v[ipart][idim] * h;
+
+      bmm_dem_wrap(dem, ipart);
+
+      dem->part.phi[ipart] += dem->part.omega[ipart] * h;
+    }
+
+    for (size_t ipart = 0; ipart < npart; ++ipart) {
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+        f[ipart][idim] = 0.0;
+
+      tau[ipart] = 0.0;
+    }
+
+    bmm_dem_force_contacts(dem, f, tau, BMM_DEM_CT_STRONG, BMM_NCT);
+
+    for (size_t ipart = 0; ipart < nmove; ++ipart)
+      if ((parted || role[ipart] != BMM_DEM_ROLE_FIXED) && !asleep[ipart]) {
+        for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+          dem->part.v[ipart][idim] += (1.0 / 2.0) *
+            (f[ipart][idim] / m[ipart]) * h;
+
+        dem->part.omega[ipart] += (1.0 / 2.0) * (tau[ipart] / j[ipart]) * h;
+      }
+  }
+
+  dem->script.dt = dt;
+}
+
+void bmm_dem_integ_pa(struct bmm_dem *const dem) {
+  double const dt = dem->script.dt;
+
+  if (dt == 0.0)
+    return;
+
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      dem->part.v[ipart][idim] += (1.0 / 2.0) * dem->part.a[ipart][idim] * dt;
+
+    dem->part.omega[ipart] += (1.0 / 2.0) * dem->part.alpha[ipart] * dt;
+  }
+}
+
+/// The call `bmm_dem_rescale(dem, q)`
+/// rescales the acceleration histories of the simulation `dem`
+/// for a time step that is `q` times as long as the previous one.
+/// The multistep schemes treat the difference between
+/// the current and the previous accelerations as
+/// the change in acceleration over one time step,
+/// so that difference is stretched to match.
+__attribute__ ((__nonnull__))
+static void bmm_dem_rescale(struct bmm_dem *const dem, double const q) {
+  switch (dem->integ.tag) {
+    case BMM_DEM_INTEG_BEEMAN:
+    case BMM_DEM_INTEG_KURAEV:
+      for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
+        for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+          dem->integ.params.beeman.ao[ipart][idim] =
+            dem->part.a[ipart][idim] + q *
+            (dem->integ.params.beeman.ao[ipart][idim] -
+             dem->part.a[ipart][idim]);
+
+        dem->integ.params.beeman.alphao[ipart] = dem->part.alpha[ipart] + q *
+          (dem->integ.params.beeman.alphao[ipart] - dem->part.alpha[ipart]);
+      }
+
+      break;
+  }
+}
+
+void bmm_dem_predict(struct bmm_dem *const dem) {
+  switch (dem->integ.tag) {
+    case BMM_DEM_INTEG_VELVET:
+      bmm_dem_integ_vel(dem);
+
+      break;
+    case BMM_DEM_INTEG_BEEMAN:
+      bmm_dem_integ_bee(dem);
+
+      break;
+    case BMM_DEM_INTEG_KURAEV:
+      bmm_dem_integ_kura(dem);
+
+      break;
+    case BMM_DEM_INTEG_RESPA:
+      bmm_dem_integ_res(dem);
+
+      break;
+  }
+}
+
+void bmm_dem_correct(struct bmm_dem *const dem) {
+  switch (dem->integ.tag) {
+    case BMM_DEM_INTEG_EULER:
+      bmm_dem_integ_euler(dem);
+
+      break;
+    case BMM_DEM_INTEG_TAYLOR:
+      bmm_dem_integ_taylor(dem);
+
+      break;
+    case BMM_DEM_INTEG_VELVET:
+      bmm_dem_integ_vet(dem);
+
+      break;
+    case BMM_DEM_INTEG_BEEMAN:
+      bmm_dem_integ_man(dem);
+
+      break;
+    case BMM_DEM_INTEG_KURAEV:
+      bmm_dem_integ_ev(dem);
+
+      break;
+    case BMM_DEM_INTEG_RESPA:
+      bmm_dem_integ_pa(dem);
+
+      break;
+  }
+}
+
+/// The call `bmm_dem_fault_pair(dem, ipart, jpart)`
+/// checks whether the particles `ipart` and `jpart`
+/// are on opposite sides of the fault of the simulation `dem`.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_fault_pair(struct bmm_dem *const dem,
+    size_t const ipart, size_t const jpart) {
+  bool const iind = dem->opts.script.params[dem->script.i].fault.
+    ind(dem->part.x[ipart], &dem->opts);
+
+  bool const jind = dem->opts.script.params[dem->script.i].fault.
+    ind(dem->part.x[jpart], &dem->opts);
+
+  return iind != jind;
+}
+
+void bmm_dem_fault(struct bmm_dem *const dem) {
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
+    unsigned int brk = 0;
+
+    for (size_t icont = 0;
+        icont < dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].n; ++icont)
+      if (bmm_dem_fault_pair(dem, ipart,
+            dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].itgt[icont]))
+        brk |= 1u << icont;
+
+    if (brk != 0)
+      (void) bmm_dem_remconts(dem, BMM_DEM_CT_STRONG, ipart, brk);
+  }
+}
+
+/// The call `bmm_dem_link_near(dem, ipart, jpart)`
+/// checks whether the particles `ipart` and `jpart`
+/// of the simulation `dem` are close enough to be linked.
+__attribute__ ((__nonnull__, __pure__))
+static bool bmm_dem_link_near(struct bmm_dem const *const dem,
+    size_t const ipart, size_t const jpart) {
+  double xdiffij[BMM_NDIM];
+  (void) bmm_dem_pdiff(xdiffij, dem,
+      dem->part.x[jpart], dem->part.x[ipart]);
+
+  double const d2 = bmm_geom2d_norm2(xdiffij);
+
+  double const r = dem->part.r[ipart] + dem->part.r[jpart];
+  double const r2 = $(bmm_power, double)(r, 2);
+
+  return d2 <= r2 * dem->bond.ccrcont;
+}
+
+bool bmm_dem_link_pair(struct bmm_dem *const dem,
+    size_t const ipart, size_t const jpart) {
+  // TODO Settle these order problems.
+  if (ipart >= jpart) {
+    return bmm_dem_link_pair(dem, jpart, ipart);
+  }
+
+  if (!bmm_dem_link_near(dem, ipart, jpart))
+    return true;
+
+  size_t const icont = bmm_dem_search_cont(dem, BMM_DEM_CT_WEAK, ipart, jpart);
+  if (icont != SIZE_MAX)
+    bmm_dem_remcont(dem, BMM_DEM_CT_WEAK, ipart, jpart, icont);
+
+  return bmm_dem_addcont(dem, BMM_DEM_CT_STRONG, ipart, jpart) != SIZE_MAX;
+}
+
+/// Vertices of the triangulation in `bmm_dem_link_tri`.
+struct bmm_dem_tri_vert {
+  /// Position.
+  double x[BMM_NDIM];
+  /// Weight.
+  double w;
+  /// Particle that the vertex stands for or `SIZE_MAX` for none.
+  size_t ipart;
+  /// Whether the vertex is a periodic image.
+  bool image;
+  /// Round to insert the vertex in, with the sparsest one first.
+  size_t iround;
+  /// Key to order insertions within the round by.
+  size_t key;
+};
+
+/// Triangles of the triangulation in `bmm_dem_link_tri`.
+struct bmm_dem_tri {
+  /// Vertices in counterclockwise order
+  /// or `SIZE_MAX` for the first one if the triangle is unused.
+  size_t ivert[3];
+  /// Neighbors across the edges opposite to the vertices
+  /// or `SIZE_MAX` for none.
+  size_t iadj[3];
+  /// Last vertex that found the triangle in conflict with itself.
+  size_t ivisit;
+};
+
+/// Edges of the cavity boundary in `bmm_dem_link_tri`.
+struct bmm_dem_tri_bnd {
+  /// Vertices in counterclockwise order around the cavity.
+  size_t ivert[2];
+  /// Triangle outside the cavity or `SIZE_MAX` for none.
+  size_t iout;
+  /// Triangle that replaces the cavity along the edge.
+  size_t iin;
+};
+
+/// Candidate links in `bmm_dem_link_tri`.
+struct bmm_dem_tri_edge {
+  /// Particles in ascending order.
+  size_t ipart[2];
+  /// Whether the particles are close enough to be linked.
+  bool near;
+};
+
+__attribute__ ((__nonnull__, __pure__))
+static int bmm_dem_tri_vert_cmp(void const *const x, void const *const y) {
+  struct bmm_dem_tri_vert const *const u = x;
+  struct bmm_dem_tri_vert const *const v = y;
+
+  if (u->iround != v->iround)
+    return u->iround > v->iround ? -1 : 1;
+
+  if (u->key != v->key)
+    return u->key < v->key ? -1 : 1;
+
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    if (u->x[idim] != v->x[idim])
+      return u->x[idim] < v->x[idim] ? -1 : 1;
+
+  return 0;
+}
+
+__attribute__ ((__nonnull__, __pure__))
+static int bmm_dem_tri_edge_cmp(void const *const x, void const *const y) {
+  struct bmm_dem_tri_edge const *const u = x;
+  struct bmm_dem_tri_edge const *const v = y;
+
+  for (size_t iend = 0; iend < nmembof(u->ipart); ++iend)
+    if (u->ipart[iend] != v->ipart[iend])
+      return u->ipart[iend] < v->ipart[iend] ? -1 : 1;
+
+  return 0;
+}
+
+/// The call `bmm_dem_tri_verts(vert, dem, margin)`
+/// writes the particles of the simulation `dem` and
+/// those of their periodic images that are
+/// within `margin` of the bounding box into `vert`,
+/// unless it is `NULL`, and returns the number of them.
+__attribute__ ((__nonnull__ (2)))
+static size_t bmm_dem_tri_verts(struct bmm_dem_tri_vert *restrict const vert,
+    struct bmm_dem const *restrict const dem, double const margin) {
+  double const *const xper = dem->opts.box.x;
+  bool const *const per = dem->opts.box.per;
+
+  size_t nvert = 0;
+
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    for (size_t iimg = 0; iimg < 9; ++iimg) {
+      double const k[] = {
+        (double) (iimg % 3) - 1.0,
+        (double) (iimg / 3) - 1.0
+      };
+
+      if ((k[0] != 0.0 && !per[0]) || (k[1] != 0.0 && !per[1]))
+        continue;
+
+      // The images across the y-axis boundary are offset
+      // just like in `bmm_geom2d_lecpdiff`.
+      double x[BMM_NDIM];
+      x[0] = dem->part.x[ipart][0];
+      x[1] = dem->part.x[ipart][1] + k[1] * xper[1];
+      if (per[0])
+        x[0] = $(bmm_uwrap, double)(x[0] + k[1] * dem->le.x, xper[0]) +
+          k[0] * xper[0];
+
+      bool const image = k[0] != 0.0 || k[1] != 0.0;
+
+      if (image) {
+        bool inside = true;
+        for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+          if (!(x[idim] >= -margin && x[idim] < xper[idim] + margin))
+            inside = false;
+
+        if (!inside)
+          continue;
+      }
+
+      if (vert != NULL) {
+        for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+          vert[nvert].x[idim] = x[idim];
+
+        vert[nvert].w = $(bmm_power, double)(dem->part.r[ipart], 2);
+        vert[nvert].ipart = ipart;
+        vert[nvert].image = image;
+
+        // Every round has half as many vertices as the next one.
+        double const a[] = {0.0, 1.0};
+        double const u = bmm_dem_random(dem, BMM_DEM_STREAM_LINK,
+            ipart, iimg, a);
+        vert[nvert].iround = (size_t) floor(-log2(1.0 - u));
+        vert[nvert].key = 0;
+      }
+
+      ++nvert;
+    }
+
+  return nvert;
+}
+
+/// The call `bmm_dem_tri_powin(vert, tri, x, w)`
+/// checks whether the vector `x` with the weight `w`
+/// is in conflict with the triangle `tri` of the vertices `vert`.
+__attribute__ ((__nonnull__, __pure__))
+static bool bmm_dem_tri_powin(struct bmm_dem_tri_vert const *restrict const vert,
+    struct bmm_dem_tri const *restrict const tri,
+    double const *restrict const x, double const w) {
+  struct bmm_dem_tri_vert const *const v0 = &vert[tri->ivert[0]];
+  struct bmm_dem_tri_vert const *const v1 = &vert[tri->ivert[1]];
+  struct bmm_dem_tri_vert const *const v2 = &vert[tri->ivert[2]];
+
+  return bmm_geom2d_powin(v0->x, v0->w, v1->x, v1->w, v2->x, v2->w, x, w) > 0.0;
+}
+
+/// The call `bmm_dem_tri_build(tri, bnd, icav, ifree, vert, nvert)`
+/// builds the regular triangulation of the first `nvert` vertices in `vert`
+/// and returns the number of triangles used,
+/// some of which may be unused.
+/// The vertices are first sorted into their insertion order
+/// and three more are added after them to enclose the others.
+/// The working arrays `tri`, `bnd`, `icav` and `ifree`
+/// must have room for `2 * nvert + 1` or, in the case of `bnd`,
+/// `2 * nvert + 3` members and `vert` for `nvert + 3` members.
+/// Each insertion removes the triangles whose orthogonal circles
+/// contain the new vertex and fills the cavity with a fan around it.
+/// The rounds are randomized and get denser as they go,
+/// while the vertices within them follow a serpentine order of square bins,
+/// so that cavities stay small even for lattices and
+/// the triangle containing the next vertex is found
+/// by walking from the previous one in a few steps.
+__attribute__ ((__nonnull__))
+static size_t bmm_dem_tri_build(struct bmm_dem_tri *restrict const tri,
+    struct bmm_dem_tri_bnd *restrict const bnd,
+    size_t *restrict const icav, size_t *restrict const ifree,
+    struct bmm_dem_tri_vert *restrict const vert, size_t const nvert) {
+  double xmin[BMM_NDIM];
+  double xmax[BMM_NDIM];
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+    xmin[idim] = nvert == 0 ? 0.0 : vert[0].x[idim];
+    xmax[idim] = nvert == 0 ? 0.0 : vert[0].x[idim];
+  }
+
+  for (size_t ivert = 1; ivert < nvert; ++ivert)
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+      xmin[idim] = $(bmm_min, double)(xmin[idim], vert[ivert].x[idim]);
+      xmax[idim] = $(bmm_max, double)(xmax[idim], vert[ivert].x[idim]);
+    }
+
+  double const s = $(bmm_max, double)(xmax[0] - xmin[0], xmax[1] - xmin[1]);
+
+  for (size_t ivert = 0; ivert < nvert; ++ivert) {
+    // There are about two vertices in each bin of each round.
+    double const nround = ldexp((double) nvert, -1 - (int) vert[ivert].iround);
+    size_t const nbin = $(bmm_max, size_t)(1, (size_t) sqrt(nround / 2.0));
+
+    size_t ibin[BMM_NDIM];
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      ibin[idim] = s == 0.0 ? 0 : $(bmm_min, size_t)(nbin - 1,
+          (size_t) ((vert[ivert].x[idim] - xmin[idim]) / s * (double) nbin));
+
+    vert[ivert].key = ibin[1] * nbin +
+      (ibin[1] % 2 == 0 ? ibin[0] : nbin - 1 - ibin[0]);
+  }
+
+  qsort(vert, nvert, sizeof *vert, bmm_dem_tri_vert_cmp);
+
+  // The enclosing triangle is far enough away
+  // not to cut off any edges that are short compared to the extents.
+  double const xmid[] = {
+    (xmin[0] + xmax[0]) / 2.0,
+    (xmin[1] + xmax[1]) / 2.0
+  };
+
+  double const xsup = 64.0 * (s + 1.0);
+
+  double const xend[][BMM_NDIM] = {
+    {xmid[0] - xsup, xmid[1] - xsup},
+    {xmid[0] + xsup, xmid[1] - xsup},
+    {xmid[0], xmid[1] + xsup}
+  };
+
+  for (size_t k = 0; k < 3; ++k) {
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      vert[nvert + k].x[idim] = xend[k][idim];
+
+    vert[nvert + k].w = 0.0;
+    vert[nvert + k].ipart = SIZE_MAX;
+    vert[nvert + k].image = true;
+    vert[nvert + k].iround = 0;
+    vert[nvert + k].key = 0;
+  }
+
+  size_t ntri = 1;
+  size_t nfree = 0;
+
+  for (size_t k = 0; k < 3; ++k) {
+    tri[0].ivert[k] = nvert + k;
+    tri[0].iadj[k] = SIZE_MAX;
+  }
+  tri[0].ivisit = SIZE_MAX;
+
+  size_t ilast = 0;
+
+  for (size_t ivert = 0; ivert < nvert; ++ivert) {
+    double const *const x = vert[ivert].x;
+    double const w = vert[ivert].w;
+
+    // The starting edge is rotated on every step,
+    // so that the walk cannot get stuck going around in circles.
+    size_t itri = ilast;
+    for (size_t istep = 0; ; ++istep) {
+      size_t inext = SIZE_MAX;
+
+      for (size_t k = 0; k < 3; ++k) {
+        size_t const kedge = (k + istep) % 3;
+
+        if (bmm_geom2d_orient(vert[tri[itri].ivert[(kedge + 1) % 3]].x,
+              vert[tri[itri].ivert[(kedge + 2) % 3]].x, x) < 0.0) {
+          inext = tri[itri].iadj[kedge];
+
+          break;
+        }
+      }
+
+      if (inext == SIZE_MAX)
+        break;
+
+      itri = inext;
+    }
+
+    // Vertices that are not in conflict with their own triangle
+    // are hidden by their heavier neighbors.
+    if (!bmm_dem_tri_powin(vert, &tri[itri], x, w))
+      continue;
+
+    size_t ncav = 0;
+    tri[itri].ivisit = ivert;
+    icav[ncav] = itri;
+    ++ncav;
+
+    for (size_t icur = 0; icur < ncav; ++icur)
+      for (size_t k = 0; k < 3; ++k) {
+        size_t const jtri = tri[icav[icur]].iadj[k];
+
+        if (jtri != SIZE_MAX && tri[jtri].ivisit != ivert &&
+            bmm_dem_tri_powin(vert, &tri[jtri], x, w)) {
+          tri[jtri].ivisit = ivert;
+          icav[ncav] = jtri;
+          ++ncav;
+        }
+      }
+
+    // Rounding errors may leave the cavity slightly concave,
+    // in which case it is grown until every edge faces the new vertex.
+    size_t nbnd;
+    for ever {
+      bool grown = false;
+
+      nbnd = 0;
+
+      for (size_t icur = 0; icur < ncav; ++icur)
+        for (size_t k = 0; k < 3; ++k) {
+          size_t const jtri = tri[icav[icur]].iadj[k];
+
+          if (jtri != SIZE_MAX && tri[jtri].ivisit == ivert)
+            continue;
+
+          size_t const ivert0 = tri[icav[icur]].ivert[(k + 1) % 3];
+          size_t const ivert1 = tri[icav[icur]].ivert[(k + 2) % 3];
+
+          if (jtri != SIZE_MAX &&
+              !(bmm_geom2d_orient(vert[ivert0].x, vert[ivert1].x, x) > 0.0)) {
+            tri[jtri].ivisit = ivert;
+            icav[ncav] = jtri;
+            ++ncav;
+
+            grown = true;
+          } else {
+            bnd[nbnd].ivert[0] = ivert0;
+            bnd[nbnd].ivert[1] = ivert1;
+            bnd[nbnd].iout = jtri;
+            ++nbnd;
+          }
+        }
+
+      if (!grown)
+        break;
+    }
+
+    for (size_t icur = 0; icur < ncav; ++icur) {
+      tri[icav[icur]].ivert[0] = SIZE_MAX;
+      ifree[nfree] = icav[icur];
+      ++nfree;
+    }
+
+    for (size_t ibnd = 0; ibnd < nbnd; ++ibnd) {
+      size_t jtri;
+      if (nfree > 0) {
+        --nfree;
+        jtri = ifree[nfree];
+      } else {
+        jtri = ntri;
+        ++ntri;
+      }
+
+      bnd[ibnd].iin = jtri;
+
+      tri[jtri].ivert[0] = bnd[ibnd].ivert[0];
+      tri[jtri].ivert[1] = bnd[ibnd].ivert[1];
+      tri[jtri].ivert[2] = ivert;
+      tri[jtri].iadj[0] = SIZE_MAX;
+      tri[jtri].iadj[1] = SIZE_MAX;
+      tri[jtri].iadj[2] = bnd[ibnd].iout;
+      tri[jtri].ivisit = SIZE_MAX;
+
+      size_t const iout = bnd[ibnd].iout;
+      if (iout != SIZE_MAX)
+        for (size_t k = 0; k < 3; ++k)
+          if (tri[iout].ivert[k] != bnd[ibnd].ivert[0] &&
+              tri[iout].ivert[k] != bnd[ibnd].ivert[1])
+            tri[iout].iadj[k] = jtri;
+    }
+
+    // The fan is stitched together by matching the shared vertices.
+    for (size_t ibnd = 0; ibnd < nbnd; ++ibnd)
+      for (size_t jbnd = 0; jbnd < nbnd; ++jbnd) {
+        if (bnd[jbnd].ivert[0] == bnd[ibnd].ivert[1])
+          tri[bnd[ibnd].iin].iadj[0] = bnd[jbnd].iin;
+
+        if (bnd[jbnd].ivert[1] == bnd[ibnd].ivert[0])
+          tri[bnd[ibnd].iin].iadj[1] = bnd[jbnd].iin;
+      }
+
+    ilast = bnd[0].iin;
+  }
+
+  return ntri;
+}
+
+/// The call `bmm_dem_link_tri(dem)`
+/// links the particles of the simulation `dem`
+/// along the edges of their regular triangulation,
+/// where each particle is weighted by its squared radius.
+/// Periodic images are included within twice the length
+/// of the longest possible link from the bounding box,
+/// so that the edges near the periodic boundaries are not cut short.
+/// The triangulation takes $O(n \\log n)$ time.
+/// Candidate links are checked in parallel and
+/// written into the contact table in particle order afterwards.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_link_tri(struct bmm_dem *const dem) {
+  size_t const npart = dem->part.n;
+
+  if (npart < 2)
+    return true;
+
+  double rmax = 0.0;
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    rmax = $(bmm_max, double)(rmax, dem->part.r[ipart]);
+
+  double const margin = 4.0 * rmax * sqrt(dem->bond.ccrcont);
+
+  size_t const nvert = bmm_dem_tri_verts(NULL, dem, margin);
+  size_t const mtri = 2 * nvert + 1;
+  size_t const medge = 3 * mtri;
+
+  struct bmm_dem_tri_vert *const vert = malloc((nvert + 3) * sizeof *vert);
+  struct bmm_dem_tri *const tri = malloc(mtri * sizeof *tri);
+  struct bmm_dem_tri_bnd *const bnd = malloc((mtri + 2) * sizeof *bnd);
+  size_t *const icav = malloc(mtri * sizeof *icav);
+  size_t *const ifree = malloc(mtri * sizeof *ifree);
+  struct bmm_dem_tri_edge *const edge = malloc(medge * sizeof *edge);
+  if (vert == NULL || tri == NULL || bnd == NULL ||
+      icav == NULL || ifree == NULL || edge == NULL) {
+    BMM_TLE_STDS();
+
+    free(edge);
+    free(ifree);
+    free(icav);
+    free(bnd);
+    free(tri);
+    free(vert);
+
+    return false;
+  }
+
+  (void) bmm_dem_tri_verts(vert, dem, margin);
+
+  size_t const ntri = bmm_dem_tri_build(tri, bnd, icav, ifree, vert, nvert);
+
+  size_t nedge = 0;
+
+  for (size_t itri = 0; itri < ntri; ++itri) {
+    if (tri[itri].ivert[0] == SIZE_MAX)
+      continue;
+
+    for (size_t k = 0; k < 3; ++k) {
+      struct bmm_dem_tri_vert const *const v0 =
+        &vert[tri[itri].ivert[(k + 1) % 3]];
+      struct bmm_dem_tri_vert const *const v1 =
+        &vert[tri[itri].ivert[(k + 2) % 3]];
+
+      if ((v0->image && v1->image) ||
+          v0->ipart == SIZE_MAX || v1->ipart == SIZE_MAX ||
+          v0->ipart == v1->ipart)
+        continue;
+
+      edge[nedge].ipart[0] = $(bmm_min, size_t)(v0->ipart, v1->ipart);
+      edge[nedge].ipart[1] = $(bmm_max, size_t)(v0->ipart, v1->ipart);
+      ++nedge;
+    }
+  }
+
+  // Each edge is seen from both sides and
+  // may also be seen through several periodic images.
+  qsort(edge, nedge, sizeof *edge, bmm_dem_tri_edge_cmp);
+
+  size_t nuniq = 0;
+  for (size_t iedge = 0; iedge < nedge; ++iedge)
+    if (nuniq == 0 || bmm_dem_tri_edge_cmp(&edge[nuniq - 1], &edge[iedge]) != 0) {
+      edge[nuniq] = edge[iedge];
+      ++nuniq;
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) \
+  num_threads((int) dem->opts.thread.n)
+#endif
+  for (size_t iedge = 0; iedge < nuniq; ++iedge)
+    edge[iedge].near = bmm_dem_link_near(dem,
+        edge[iedge].ipart[0], edge[iedge].ipart[1]);
+
+  bool p = true;
+
+  for (size_t iedge = 0; iedge < nuniq; ++iedge)
+    if (edge[iedge].near && !bmm_dem_link_pair(dem,
+          edge[iedge].ipart[0], edge[iedge].ipart[1])) {
+      p = false;
+
+      break;
+    }
+
+  free(edge);
+  free(ifree);
+  free(icav);
+  free(bnd);
+  free(tri);
+  free(vert);
+
+  return p;
+}
+
+bool bmm_dem_link(struct bmm_dem *const dem) {
+  if (dem->bond.tag == BMM_DEM_BOND_DELAUNAY)
+    return bmm_dem_link_tri(dem);
+
+  switch (dem->cache.tag) {
+    case BMM_DEM_CACHE_NONE:
+      for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+        for (size_t jpart = ipart + 1; jpart < dem->part.n; ++jpart)
+          if (!bmm_dem_link_pair(dem, ipart, jpart))
+            return false;
+
+      break;
+    case BMM_DEM_CACHE_NEIGH:
+    case BMM_DEM_CACHE_LEVEL:
+      for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+        for (size_t ineigh = dem->cache.neigh[ipart].i;
+            ineigh < dem->cache.neigh[ipart].i + dem->cache.neigh[ipart].n;
+            ++ineigh)
+          if (!bmm_dem_link_pair(dem, ipart, dem->cache.ineigh[ineigh]))
+            return false;
+
+      break;
+  }
+
+  return true;
+}
+
+bool bmm_dem_uncont(struct bmm_dem *const dem) {
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
+    dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].n = 0;
+    dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].sig = 0;
+  }
+
+  dem->frag.stale = true;
+
+  return true;
+}
+
+// TODO Interval arithmetic.
+// TODO Not quite! Edges may overlap if periodicity is turned on.
+__attribute__ ((__nonnull__, __pure__))
+static bool bmm_dem_inside(struct bmm_dem const *const dem,
+    size_t const ipart) {
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    if (dem->part.x[ipart][idim] < 0.0 ||
+        dem->part.x[ipart][idim] >= dem->opts.box.x[idim])
+      return false;
+
+  return true;
+}
+
+// TODO Not quite! Edges may be excavated if periodicity is turned off.
+__attribute__ ((__nonnull__, __pure__))
+static bool bmm_dem_insider(struct bmm_dem const *const dem,
+    size_t const ipart) {
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    if (dem->part.x[ipart][idim] - dem->part.r[ipart] < 0.0 ||
+        dem->part.x[ipart][idim] + dem->part.r[ipart] >= dem->opts.box.x[idim])
+      return false;
+
+  return true;
+}
+
+__attribute__ ((__nonnull__))
+static bool bmm_dem_script_clip(struct bmm_dem *const dem) {
+  bmm_dem_batch_begin(dem);
+
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    if (!bmm_dem_inside(dem, ipart))
+      bmm_dem_batch_rempart(dem, ipart);
+
+  return bmm_dem_batch_commit(dem);
+}
+
+__attribute__ ((__nonnull__))
+double bmm_dem_bulkmod(struct bmm_dem const *const dem) {
+  return dem->opts.part.ycomp / (3.0 * (1.0 - 2.0 * dem->opts.part.nu));
+}
+
+__attribute__ ((__nonnull__))
+double bmm_dem_shearmod(struct bmm_dem const *const dem) {
+  return dem->opts.part.ycomp / (2.0 * (1.0 + dem->opts.part.nu));
+}
+
+__attribute__ ((__nonnull__))
+double bmm_dem_pwavec(struct bmm_dem const *const dem) {
+  return sqrt((bmm_dem_bulkmod(dem) +
+        (4.0 / 3.0) * bmm_dem_shearmod(dem)) / dem->opts.part.rho);
+}
+
+__attribute__ ((__nonnull__))
+double bmm_dem_swavec(struct bmm_dem const *const dem) {
+  return sqrt(bmm_dem_shearmod(dem) / dem->opts.part.rho);
+}
+
+/// The call `bmm_dem_path_ext(buf, size, dem, str, suffix, ext)`
+/// writes into the buffer `buf` of length `size`
+/// the path of the output file of the simulation `dem`
+/// with the prefix `str`, the suffix `suffix` and the extension `ext`.
+/// If `dem` is part of an ensemble, the path is tagged with its index.
+__attribute__ ((__nonnull__))
+static void bmm_dem_path_ext(char *const buf, size_t const size,
+    struct bmm_dem const *const dem,
+    char const *const str, char const *const suffix, char const *const ext) {
+  if (dem->opts.ens.n == 1)
+    (void) snprintf(buf, size, "./%s%s.%s", str, suffix, ext);
+  else
+    (void) snprintf(buf, size, "./%s%s.%zu.%s", str, suffix,
+        dem->opts.ens.i, ext);
+}
+
+/// The call `bmm_dem_path(buf, size, dem, str, suffix)`
+/// works like `bmm_dem_path_ext`
+/// with the extension of text files.
+__attribute__ ((__nonnull__))
+static void bmm_dem_path(char *const buf, size_t const size,
+    struct bmm_dem const *const dem,
+    char const *const str, char const *const suffix) {
+  bmm_dem_path_ext(buf, size, dem, str, suffix, "data");
+}
+
+static bool export_s(struct bmm_dem const *const dem) {
+  char buf[BUFSIZ];
+  bmm_dem_path(buf, sizeof buf, dem,
+      dem->opts.script.params[dem->script.i].expr.str, "-s");
+
+  FILE *const stream = fopen(buf, "w");
+  if (stream == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  if (fprintf(stream, "%g\n", dem->est.sk) < 0) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  if (fclose(stream) != 0) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return true;
+}
+
+static bool export_chi(struct bmm_dem const *const dem) {
+  char buf[BUFSIZ];
+  bmm_dem_path(buf, sizeof buf, dem,
+      dem->opts.script.params[dem->script.i].expr.str, "-chi");
+
+  FILE *const stream = fopen(buf, "w");
+  if (stream == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  if (fprintf(stream, "%g\n", dem->est.chi) < 0) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  if (fclose(stream) != 0) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return true;
+}
+
+static bool export_x(struct bmm_dem const *const dem) {
+  char buf[BUFSIZ];
+  bmm_dem_path(buf, sizeof buf, dem,
+      dem->opts.script.params[dem->script.i].expr.str, "-x");
+
+  FILE *const stream = fopen(buf, "w");
+  if (stream == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    if (fprintf(stream, "(%g, %g)\n",
+          dem->part.x[ipart][0], dem->part.x[ipart][1]) < 0) {
+      BMM_TLE_STDS();
+
+      return false;
+    }
+
+  if (fclose(stream) != 0) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return true;
+}
+
+static bool export_phi(struct bmm_dem const *const dem) {
+  char buf[BUFSIZ];
+  bmm_dem_path(buf, sizeof buf, dem,
+      dem->opts.script.params[dem->script.i].expr.str, "-phi");
+
+  FILE *const stream = fopen(buf, "w");
+  if (stream == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    if (fprintf(stream, "%g\n", dem->part.phi[ipart]) < 0) {
+      BMM_TLE_STDS();
+
+      return false;
+    }
+
+  if (fclose(stream) != 0) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return true;
+}
+
+static bool export_r(struct bmm_dem const *const dem) {
+  char buf[BUFSIZ];
+  bmm_dem_path(buf, sizeof buf, dem,
+      dem->opts.script.params[dem->script.i].expr.str, "-r");
+
+  FILE *const stream = fopen(buf, "w");
+  if (stream == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    if (fprintf(stream, "%g\n", dem->part.r[ipart]) < 0) {
+      BMM_TLE_STDS();
+
+      return false;
+    }
+
+  if (fclose(stream) != 0) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return true;
+}
+
+static bool export_c(struct bmm_dem const *const dem) {
+  char buf[BUFSIZ];
+  bmm_dem_path(buf, sizeof buf, dem,
+      dem->opts.script.params[dem->script.i].expr.str, "-c");
+
+  FILE *const stream = fopen(buf, "w");
+  if (stream == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    if (fprintf(stream, "%d\n", dem->part.role[ipart]) < 0) {
+      BMM_TLE_STDS();
+
+      return false;
+    }
+
+  if (fclose(stream) != 0) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return true;
+}
+
+/// Column descriptors of binary exports.
+struct bmm_dem_bincol {
+  /// Name padded with zeros.
+  char name[8];
+  /// NumPy type string, such as `<f8`, padded with zeros.
+  char type[4];
+  /// Number of components per row.
+  uint32_t ncomp;
+  /// Number of rows.
+  uint64_t nrow;
+  /// Offset of the first row from the beginning of the file.
+  uint64_t off;
+};
+
+/// The call `bmm_dem_bincol_type(type, kind, size)`
+/// sets `type` to the NumPy type string
+/// of the type kind `kind` whose values take `size` bytes.
+__attribute__ ((__nonnull__))
+static void bmm_dem_bincol_type(char *const type, char const kind,
+    size_t const size) {
+  dynamic_assert(size < 10, "Unsupported size");
+
+  // The literal fills the field exactly, including its zero padding.
+  char buf[sizeof ((struct bmm_dem_bincol *) NULL)->type] = "<f8";
+  buf[0] = bmm_endy_get() == BMM_ENDY_BIG ? '>' : '<';
+  buf[1] = kind;
+  buf[2] = (char) ('0' + size);
+  (void) memcpy(type, buf, sizeof buf);
+}
+
+/// The call `export_bin(dem)`
+/// writes the particles and contacts of the simulation `dem`
+/// into one binary file of typed columns.
+/// The file begins with the magic bytes `BMMX` and
+/// the version number, the number of columns and zero padding
+/// as native 32-bit unsigned integers.
+/// Those are followed by a `struct bmm_dem_bincol` for each column
+/// and the columns themselves, each aligned to eight bytes,
+/// so that every column can be mapped as an array of its own.
+/// Contacts are stored as pairs of particle indices.
+static bool export_bin(struct bmm_dem const *const dem) {
+  size_t const npart = dem->part.n;
+
+  size_t ncont[BMM_NCT];
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict) {
+    ncont[ict] = 0;
+    for (size_t ipart = 0; ipart < npart; ++ipart)
+      ncont[ict] += dem->pair[ict].cont.src[ipart].n;
+  }
+
+  size_t (*const ij[BMM_NCT])[2] = {
+    [BMM_DEM_CT_WEAK] = malloc(ncont[BMM_DEM_CT_WEAK] * sizeof *ij[0]),
+    [BMM_DEM_CT_STRONG] = malloc(ncont[BMM_DEM_CT_STRONG] * sizeof *ij[0])
+  };
+
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict)
+    if (ij[ict] == NULL && ncont[ict] != 0) {
+      BMM_TLE_STDS();
+
+      for (enum bmm_dem_ct jct = 0; jct < BMM_NCT; ++jct)
+        free(ij[jct]);
+
+      return false;
+    }
+
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict) {
+    size_t icont = 0;
+    for (size_t ipart = 0; ipart < npart; ++ipart)
+      for (size_t jcont = 0; jcont < dem->pair[ict].cont.src[ipart].n;
+          ++jcont) {
+        ij[ict][icont][0] = ipart;
+        ij[ict][icont][1] = dem->pair[ict].cont.src[ipart].itgt[jcont];
+        ++icont;
+      }
+  }
+
+  struct {
+    char const *name;
+    char kind;
+    size_t size;
+    size_t ncomp;
+    size_t nrow;
+    void const *ptr;
+  } const cols[] = {
+    {"x", 'f', sizeof **dem->part.x, BMM_NDIM, npart, dem->part.x},
+    {"phi", 'f', sizeof *dem->part.phi, 1, npart, dem->part.phi},
+    {"r", 'f', sizeof *dem->part.r, 1, npart, dem->part.r},
+    {"role", 'i', sizeof *dem->part.role, 1, npart, dem->part.role},
+    {"f", 'f', sizeof **dem->part.f, BMM_NDIM, npart, dem->part.f},
+    {"tau", 'f', sizeof *dem->part.tau, 1, npart, dem->part.tau},
+    {"weak", 'u', sizeof **ij[0], 2, ncont[BMM_DEM_CT_WEAK],
+      ij[BMM_DEM_CT_WEAK]},
+    {"strong", 'u', sizeof **ij[0], 2, ncont[BMM_DEM_CT_STRONG],
+      ij[BMM_DEM_CT_STRONG]}
+  };
+
+  unsigned char const magic[] = {'B', 'M', 'M', 'X'};
+  uint32_t const head[] = {1, nmembof(cols), 0};
+  unsigned char const pad[8] = {0};
+
+  struct bmm_dem_bincol desc[nmembof(cols)];
+  size_t off = sizeof magic + sizeof head + sizeof desc;
+  for (size_t icol = 0; icol < nmembof(cols); ++icol) {
+    (void) memset(&desc[icol], 0, sizeof desc[icol]);
+    (void) strncpy(desc[icol].name, cols[icol].name, sizeof desc[icol].name);
+    bmm_dem_bincol_type(desc[icol].type, cols[icol].kind, cols[icol].size);
+    desc[icol].ncomp = (uint32_t) cols[icol].ncomp;
+    desc[icol].nrow = cols[icol].nrow;
+
+    off = (off + sizeof pad - 1) / sizeof pad * sizeof pad;
+    desc[icol].off = off;
+    off += cols[icol].nrow * cols[icol].ncomp * cols[icol].size;
+  }
+
+  char buf[BUFSIZ];
+  bmm_dem_path_ext(buf, sizeof buf, dem,
+      dem->opts.script.params[dem->script.i].expr.str, "", "bin");
+
+  bool result = true;
+
+  FILE *const stream = fopen(buf, "w");
+  if (stream == NULL) {
+    BMM_TLE_STDS();
+
+    result = false;
+  } else {
+    if (fwrite(magic, sizeof magic, 1, stream) != 1 ||
+        fwrite(head, sizeof head, 1, stream) != 1 ||
+        fwrite(desc, sizeof desc, 1, stream) != 1) {
+      BMM_TLE_STDS();
+
+      result = false;
+    }
+
+    off = sizeof magic + sizeof head + sizeof desc;
+    for (size_t icol = 0; result && icol < nmembof(cols); ++icol) {
+      size_t const npad = (size_t) desc[icol].off - off;
+      size_t const size = cols[icol].nrow * cols[icol].ncomp * cols[icol].size;
+
+      if ((npad != 0 && fwrite(pad, npad, 1, stream) != 1) ||
+          (size != 0 && fwrite(cols[icol].ptr, size, 1, stream) != 1)) {
+        BMM_TLE_STDS();
+
+        result = false;
+      }
+
+      off = (size_t) desc[icol].off + size;
+    }
+
+    if (fclose(stream) != 0) {
+      BMM_TLE_STDS();
+
+      result = false;
+    }
+  }
+
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict)
+    free(ij[ict]);
+
+  return result;
+}
+
+struct agraph {
+  size_t n;
+  struct {
+    size_t n;
+    size_t itgt[BMM_MCONTACT * 2];
+    bool visited[BMM_MCONTACT * 2];
+  } src[];
+};
+
+static bool export_f(struct bmm_dem const *const dem) {
+  char buf[BUFSIZ];
+  bmm_dem_path(buf, sizeof buf, dem,
+      dem->opts.script.params[dem->script.i].expr.str, "-f");
+
+  FILE *const stream = fopen(buf, "w");
+  if (stream == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  // Bidirectionalization of the strong contact graph.
+  // Following great programming conventions, I copied this from below.
+  struct agraph *const agraph = malloc(sizeof *agraph +
+      dem->part.n * sizeof *agraph->src);
+  if (agraph == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+  agraph->n = dem->part.n;
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    agraph->src[ipart].n = 0;
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    for (size_t icont = 0; icont < dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].n; ++icont) {
+      size_t const jpart = dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].itgt[icont];
+
+      double d[BMM_NDIM];
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+        d[idim] = $(bmm_abs, double)
+          (dem->part.x[jpart][idim] - dem->part.x[ipart][idim]);
+
+      // No winding.
+      if (d[0] < dem->opts.box.x[0] / 2.0 &&
+          d[1] < dem->opts.box.x[1] / 2.0) {
+        size_t const jcont = agraph->src[jpart].n;
+        agraph->src[jpart].itgt[jcont] = ipart;
+        ++agraph->src[jpart].n;
+
+        // This makes them bidirectional.
+        size_t const kcont = agraph->src[ipart].n;
+        agraph->src[ipart].itgt[kcont] = jpart;
+        ++agraph->src[ipart].n;
+      }
+    }
+
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    if (agraph->src[ipart].n == 0)
+      if (fprintf(stream, "%zu\n", ipart) < 0) {
+        BMM_TLE_STDS();
+
+        return false;
+      }
+
+  free(agraph);
+
+  if (fclose(stream) != 0) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return true;
+}
+
+/// The call `bmm_dem_poly_flat(dem, ipart, jpart)`
+/// checks whether the strong contact between the particles `ipart` and `jpart`
+/// in the simulation `dem` stays in one piece without winding
+/// around periodic boundaries.
+__attribute__ ((__nonnull__, __pure__))
+static bool bmm_dem_poly_flat(struct bmm_dem const *const dem,
+    size_t const ipart, size_t const jpart) {
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    if (!($(bmm_abs, double)(dem->part.x[jpart][idim] -
+            dem->part.x[ipart][idim]) < dem->opts.box.x[idim] / 2.0))
+      return false;
+
+  return true;
+}
+
+/// The call `bmm_dem_poly_half(x)`
+/// returns zero if the direction `x` points into the upper half-plane
+/// that begins from the positive horizontal axis and
+/// one if it points into the lower half-plane.
+__attribute__ ((__nonnull__, __pure__))
+static int bmm_dem_poly_half(double const *const x) {
+  return x[1] > 0.0 || (x[1] == 0.0 && x[0] > 0.0) ? 0 : 1;
+}
+
+/// The call `bmm_dem_poly_before(x, y)`
+/// checks whether the direction `x` comes before the direction `y`
+/// when going counterclockwise from the positive horizontal axis.
+/// This only needs signs of products instead of angles.
+__attribute__ ((__nonnull__, __pure__))
+static bool bmm_dem_poly_before(double const *const x, double const *const y) {
+  int const hx = bmm_dem_poly_half(x);
+  int const hy = bmm_dem_poly_half(y);
+
+  return hx != hy ? hx < hy : x[0] * y[1] - x[1] * y[0] > 0.0;
+}
+
+bool bmm_dem_est_poly(struct bmm_dem_poly *const poly,
+    struct bmm_dem const *const dem) {
+  size_t const npart = dem->part.n;
+
+  double const (*const x)[BMM_NDIM] = (double const (*)[BMM_NDIM]) dem->part.x;
+
+  poly->n = 0;
+  poly->i = NULL;
+  poly->ivert = NULL;
+
+  // The half-edges of each edge are next to each other,
+  // so that flipping the lowest bit of one gives the other.
+  // Those leaving each particle are packed together in `ihalf`,
+  // beginning from `irot` of the particle.
+  size_t nedge = 0;
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    for (size_t icont = 0;
+        icont < dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].n; ++icont)
+      if (bmm_dem_poly_flat(dem, ipart,
+            dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].itgt[icont]))
+        ++nedge;
+
+  size_t const nhalf = 2 * nedge;
+
+  size_t *const irot = calloc(npart + 1, sizeof *irot);
+  size_t *const icomp = malloc(npart * sizeof *icomp);
+  size_t *const ioff = calloc(npart + 1, sizeof *ioff);
+  size_t *const itgt = malloc(nhalf * sizeof *itgt);
+  size_t *const ihalf = malloc(nhalf * sizeof *ihalf);
+  size_t *const irank = malloc(nhalf * sizeof *irank);
+  size_t *const ibyc = malloc(nhalf * sizeof *ibyc);
+  size_t *const ivert = malloc(nhalf * sizeof *ivert);
+  size_t *const nvert = malloc(nhalf * sizeof *nvert);
+  bool *const visited = malloc(nhalf * sizeof *visited);
+  size_t *const nfill = calloc(npart, sizeof *nfill);
+  size_t *const npoly = calloc(npart, sizeof *npoly);
+
+  bool result = irot != NULL && icomp != NULL && ioff != NULL &&
+    nfill != NULL && npoly != NULL &&
+    (nhalf == 0 || (itgt != NULL && ihalf != NULL && irank != NULL &&
+                    ibyc != NULL && ivert != NULL && nvert != NULL &&
+                    visited != NULL));
+
+  if (!result)
+    BMM_TLE_STDS();
+  else {
+    for (size_t ipart = 0; ipart < npart; ++ipart)
+      icomp[ipart] = ipart;
+
+    size_t iedge = 0;
+    for (size_t ipart = 0; ipart < npart; ++ipart)
+      for (size_t icont = 0;
+          icont < dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].n; ++icont) {
+        size_t const jpart =
+          dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].itgt[icont];
+
+        if (bmm_dem_poly_flat(dem, ipart, jpart)) {
+          itgt[2 * iedge] = jpart;
+          itgt[2 * iedge + 1] = ipart;
+          ++irot[ipart + 1];
+          ++irot[jpart + 1];
+
+          (void) bmm_dem_djs_union(icomp, ipart, jpart);
+
+          ++iedge;
+        }
+      }
+
+    for (size_t ipart = 0; ipart < npart; ++ipart)
+      irot[ipart + 1] += irot[ipart];
+
+    // The rotation system is sorted counterclockwise around each particle
+    // by inserting the half-edges one by one.
+    for (size_t ihead = 0; ihead < nhalf; ++ihead) {
+      size_t const ipart = itgt[ihead ^ 1];
+      size_t const ibegin = irot[ipart];
+
+      double xdiff[BMM_NDIM];
+      bmm_geom2d_diff(xdiff, x[itgt[ihead]], x[ipart]);
+
+      size_t jrot = ibegin + nfill[ipart];
+      ++nfill[ipart];
+      for (; jrot > ibegin; --jrot) {
+        double ydiff[BMM_NDIM];
+        bmm_geom2d_diff(ydiff, x[itgt[ihalf[jrot - 1]]], x[ipart]);
+
+        if (!bmm_dem_poly_before(xdiff, ydiff))
+          break;
+
+        ihalf[jrot] = ihalf[jrot - 1];
+      }
+
+      ihalf[jrot] = ihead;
+    }
+
+    for (size_t ipart = 0; ipart < npart; ++ipart)
+      for (size_t jrot = irot[ipart]; jrot < irot[ipart + 1]; ++jrot)
+        irank[ihalf[jrot]] = jrot - irot[ipart];
+
+    // Components are numbered in the order of their first particles and
+    // their half-edges are gathered together in `ibyc`.
+    size_t ncomp = 0;
+    for (size_t ipart = 0; ipart < npart; ++ipart) {
+      size_t const iroot = bmm_dem_djs_find(icomp, ipart);
+
+      icomp[ipart] = iroot == ipart ? ncomp++ : icomp[iroot];
+    }
+
+    for (size_t ihead = 0; ihead < nhalf; ++ihead)
+      ++ioff[icomp[itgt[ihead ^ 1]] + 1];
+
+    for (size_t jcomp = 0; jcomp < ncomp; ++jcomp)
+      ioff[jcomp + 1] += ioff[jcomp];
+
+    for (size_t ihead = 0; ihead < nhalf; ++ihead) {
+      size_t const jcomp = icomp[itgt[ihead ^ 1]];
+
+      ibyc[ioff[jcomp] + npoly[jcomp]] = ihead;
+      ++npoly[jcomp];
+
+      visited[ihead] = false;
+    }
+
+    // Each component traces its faces into its own span of `ivert`,
+    // which is just large enough, because every half-edge is on one face.
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1) \
+  num_threads((int) dem->opts.thread.n)
+#endif
+    for (size_t jcomp = 0; jcomp < ncomp; ++jcomp) {
+      size_t nface = 0;
+      size_t jvert = ioff[jcomp];
+
+      for (size_t jbyc = ioff[jcomp]; jbyc < ioff[jcomp + 1]; ++jbyc) {
+        size_t const ifirst = ibyc[jbyc];
+        if (visited[ifirst])
+          continue;
+
+        // The face on the left of each half-edge is traced
+        // by turning clockwise from the twin at every particle.
+        size_t const kvert = jvert;
+        double area = 0.0;
+        size_t ihead = ifirst;
+        do {
+          visited[ihead] = true;
+
+          size_t const ipart = itgt[ihead ^ 1];
+          size_t const jpart = itgt[ihead];
+          ivert[jvert] = ipart;
+          ++jvert;
+
+          area += x[ipart][0] * x[jpart][1] - x[jpart][0] * x[ipart][1];
+
+          size_t const nrot = irot[jpart + 1] - irot[jpart];
+          ihead = ihalf[irot[jpart] + (irank[ihead ^ 1] + nrot - 1) % nrot];
+        } while (ihead != ifirst);
+
+        // Only the outer faces are kept and
+        // they are reversed to wind counterclockwise like the rest.
+        if (area / 2.0 < 1.0e-12) {
+          for (size_t ilo = kvert + 1, ihi = jvert - 1; ilo < ihi;
+              ++ilo, --ihi) {
+            size_t const tmp = ivert[ilo];
+            ivert[ilo] = ivert[ihi];
+            ivert[ihi] = tmp;
+          }
+
+          nvert[ioff[jcomp] + nface] = jvert - kvert;
+          ++nface;
+        } else
+          jvert = kvert;
+      }
+
+      npoly[jcomp] = nface;
+    }
+
+    for (size_t jcomp = 0; jcomp < ncomp; ++jcomp)
+      poly->n += npoly[jcomp];
+
+    poly->i = malloc((poly->n + 1) * sizeof *poly->i);
+    poly->ivert = malloc($(bmm_max, size_t)(1, nhalf) * sizeof *poly->ivert);
+    if (poly->i == NULL || poly->ivert == NULL) {
+      BMM_TLE_STDS();
+
+      bmm_dem_poly_free(poly);
+
+      result = false;
+    } else {
+      size_t ipoly = 0;
+      poly->i[0] = 0;
+      for (size_t jcomp = 0; jcomp < ncomp; ++jcomp) {
+        size_t jvert = ioff[jcomp];
+
+        for (size_t iface = 0; iface < npoly[jcomp]; ++iface) {
+          size_t const n = nvert[ioff[jcomp] + iface];
+
+          (void) memcpy(&poly->ivert[poly->i[ipoly]], &ivert[jvert],
+              n * sizeof *poly->ivert);
+          poly->i[ipoly + 1] = poly->i[ipoly] + n;
+          ++ipoly;
+
+          jvert += n;
+        }
+      }
+    }
+  }
+
+  free(npoly);
+  free(nfill);
+  free(visited);
+  free(nvert);
+  free(ivert);
+  free(ibyc);
+  free(irank);
+  free(ihalf);
+  free(itgt);
+  free(ioff);
+  free(icomp);
+  free(irot);
+
+  return result;
+}
+
+void bmm_dem_poly_free(struct bmm_dem_poly *const poly) {
+  free(poly->ivert);
+  free(poly->i);
+
+  poly->n = 0;
+  poly->i = NULL;
+  poly->ivert = NULL;
+}
+
+static bool export_p(struct bmm_dem const *const dem) {
+  struct bmm_dem_poly poly;
+  if (!bmm_dem_est_poly(&poly, dem))
+    return false;
+
+  char buf[BUFSIZ];
+  bmm_dem_path(buf, sizeof buf, dem,
+      dem->opts.script.params[dem->script.i].expr.str, "-p");
+
+  FILE *const stream = fopen(buf, "w");
+  if (stream == NULL) {
+    BMM_TLE_STDS();
+
+    bmm_dem_poly_free(&poly);
+
+    return false;
+  }
+
+  for (size_t ipoly = 0; ipoly < poly.n; ++ipoly) {
+    for (size_t ivert = poly.i[ipoly]; ivert < poly.i[ipoly + 1]; ++ivert)
+      if (fprintf(stream, "%s%zu", ivert == poly.i[ipoly] ? "" : " ",
+            poly.ivert[ivert]) < 0) {
+        BMM_TLE_STDS();
+
+        bmm_dem_poly_free(&poly);
+
+        return false;
+      }
+
+    if (fprintf(stream, "\n") < 0) {
+      BMM_TLE_STDS();
+
+      bmm_dem_poly_free(&poly);
+
+      return false;
+    }
+  }
+
+  bmm_dem_poly_free(&poly);
+
+  if (fclose(stream) != 0) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return true;
+}
+
+/// The call `bmm_dem_est_raddist_cells(pijcell, pnijcell, dem, ipart, dmax)`
+/// sets `pijcell` and `pnijcell`
+/// to the first neighbor cell and the number of neighbor cells
+/// along each dimension that cover the ball of radius `dmax`
+/// around the particle `ipart` in the simulation `dem`.
+/// If a periodic dimension is covered entirely,
+/// its first neighbor cell is `SIZE_MAX` and
+/// its cells should be visited from the beginning.
+__attribute__ ((__nonnull__))
+static void bmm_dem_est_raddist_cells(size_t *restrict const pijcell,
+    size_t *restrict const pnijcell,
+    struct bmm_dem const *const dem, size_t const ipart, double const dmax) {
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+    size_t const ncell = dem->opts.cache.ncell[idim];
+    size_t const nin = ncell - 2;
+    size_t const ijcell = dem->cache.ijcell[ipart][idim];
+
+    // The particles may have moved since they were binned,
+    // but never by more than one neighbor cell,
+    // so one extra layer of neighbor cells is enough to cover them.
+    size_t const k = (size_t) ceil(dmax /
+        (dem->opts.box.x[idim] / (double) nin)) + 1;
+
+    if (dem->opts.box.per[idim]) {
+      // The offset images make the x-axis window uneven across the boundary.
+      if (2 * k + 1 >= nin || (idim == 0 && bmm_dem_le(dem))) {
+        pijcell[idim] = SIZE_MAX;
+        pnijcell[idim] = nin;
+      } else {
+        pijcell[idim] = (ijcell - 1 + nin - k) % nin;
+        pnijcell[idim] = 2 * k + 1;
+      }
+    } else {
+      size_t const ijmin = ijcell > k ? ijcell - k : 0;
+      size_t const ijmax = $(bmm_min, size_t)(ijcell + k, ncell - 1);
+
+      pijcell[idim] = ijmin;
+      pnijcell[idim] = ijmax - ijmin + 1;
+    }
+  }
+}
+
+/// The call `bmm_dem_est_raddist(pr, pg, nbin, rmax, dem)`
+/// sets `pr` and `pg` of length `nbin`
+/// to the radial distribution function of the particles
+/// in the simulation `dem` up to the distance `rmax`.
+/// The simulation cell must be full for this to produce an accurate result.
+///
+/// Only the pairs that are close enough to contribute are visited
+/// by going through the neighbor cells around each particle.
+/// Their distances are binned onto a grid that is fine enough
+/// to resolve the kernel and the kernel is then convolved over the grid.
+/// The neighbor cache needs to be fresh
+/// for every particle to be in some neighbor cell.
+__attribute__ ((__nonnull__))
+bool bmm_dem_est_raddist(double *const pr, double *const pg,
+    size_t const nbin, double const rmax,
+    struct bmm_dem const *const dem) {
+  if (dem->cache.stale) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Stale neighbor cache");
+
+    return false;
+  }
+
+  enum bmm_kernel const k = BMM_KERNEL_EPAN;
+  double const bw = bmm_ival_midpoint(dem->opts.part.rnew) / 8.0;
+  double const dmax = rmax + bmm_kernel_supp(k) * bw;
+  double const step = rmax / (double) (nbin - 1);
+
+  // The grid is refined until there are several points per bandwidth
+  // and padded to hold everything within the support of the kernel.
+  size_t const nref = $(bmm_max, size_t)(1, (size_t) ceil(8.0 * step / bw));
+  double const dx = step / (double) nref;
+  size_t const npad = (size_t) ceil(bmm_kernel_supp(k) * bw / dx);
+  size_t const ngrid = (nbin - 1) * nref + 1 + 2 * npad;
+  double const x0 = -(double) npad * dx;
+
+  double *const c = calloc(ngrid, sizeof *c);
+  if (c == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  double *const y = malloc(ngrid * sizeof *y);
+  if (y == NULL) {
+    BMM_TLE_STDS();
+
+    free(c);
+
+    return false;
+  }
+
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
+    if (!bmm_dem_inside(dem, ipart))
+      continue;
+
+    size_t ijfirst[BMM_NDIM];
+    size_t nijcell[BMM_NDIM];
+    bmm_dem_est_raddist_cells(ijfirst, nijcell, dem, ipart, dmax);
+
+    size_t const nneigh = $(bmm_prod, size_t)(nijcell, BMM_NDIM);
+
+    for (size_t ineigh = 0; ineigh < nneigh; ++ineigh) {
+      size_t ijcell[BMM_NDIM];
+      $(bmm_hcd, size_t)(ijcell, ineigh, BMM_NDIM, nijcell);
+
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+        if (dem->opts.box.per[idim])
+          ijcell[idim] = 1 + (ijfirst[idim] == SIZE_MAX ? ijcell[idim] :
+              (ijfirst[idim] + ijcell[idim]) %
+              (dem->opts.cache.ncell[idim] - 2));
+        else
+          ijcell[idim] += ijfirst[idim];
+
+      size_t const icell = $(bmm_unhcd, size_t)(ijcell,
+          BMM_NDIM, dem->opts.cache.ncell);
+
+      for (size_t igroup = 0; igroup < dem->cache.part[icell].n; ++igroup) {
+        size_t const jpart = bmm_dem_cache_jpart(dem, icell, igroup);
+
+        if (jpart == ipart || !bmm_dem_inside(dem, jpart))
+          continue;
+
+        double const d = sqrt(bmm_dem_pdist2(dem,
+              dem->part.x[ipart], dem->part.x[jpart]));
+
+        if (d == 0.0 || d >= dmax)
+          continue;
+
+        double const v0 = bmm_geom_ballsurf(d, 2);
+        double const v = bmm_geom2d_shellvol(dem->part.x[ipart], d,
+            dem->opts.box.x, dem->opts.box.per);
+
+        bmm_kde_bin(c, ngrid, x0, dx, d, v0 / v);
+      }
+    }
+  }
+
+  bmm_kde_conv(y, c, ngrid, dx, k, bw);
+
+  for (size_t ibin = 0; ibin < nbin; ++ibin) {
+    pr[ibin] = (double) ibin * step;
+    pg[ibin] = y[npad + ibin * nref];
+  }
+
+  free(y);
+  free(c);
+
+  double const dr = rmax / (double) nbin;
+
+  // We must renormalize to account for cut off kernels.
+  double total = 0.0;
+  for (size_t i = 0; i < nbin; ++i)
+    total += pg[i] * dr;
+  for (size_t i = 0; i < nbin; ++i)
+    pg[i] /= total;
+  // It is a proper pdf now.
+  for (size_t i = 0; i < nbin; ++i)
+    pg[i] = pr[i] == 0.0 ? 0.0 : pg[i] *
+      (bmm_geom_ballvol(rmax, BMM_NDIM) / bmm_geom_ballsurf(pr[i], BMM_NDIM));
+
+  return true;
+}
+
+/// The call `bmm_dem_est_mass(dem)`
+/// returns the total mass of the particles
+/// in the simulation `dem`.
+__attribute__ ((__nonnull__, __pure__))
+double bmm_dem_est_mass(struct bmm_dem *const dem) {
+  double m = 0.0;
+
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    m += dem->part.m[ipart];
+
+  return m;
+}
+
+/// The call `bmm_dem_est_center(pxcenter, dem)`
+/// sets `pxcenter` to the center of the bounding box
+/// in the simulation `dem`.
+__attribute__ ((__nonnull__))
+void bmm_dem_est_center(double *const pxcenter,
+    struct bmm_dem *const dem) {
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    pxcenter[idim] = dem->opts.box.x[idim] / 2.0;
+}
+
+/// The call `bmm_dem_est_com(pxcom, dem)`
+/// sets `pxcom` to the center of mass of the particles
+/// in the simulation `dem`.
+__attribute__ ((__nonnull__))
+void bmm_dem_est_com(double *const pxcom,
+    struct bmm_dem *const dem) {
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    pxcom[idim] = 0.0;
+
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      pxcom[idim] += dem->part.m[ipart] * dem->part.x[ipart][idim];
+
+  double const m = bmm_dem_est_mass(dem);
+
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    pxcom[idim] /= m;
+}
+
+void bmm_dem_est_frag(struct bmm_dem *const dem) {
+  size_t const npart = dem->part.n;
+
+  if (dem->frag.stale) {
+    for (size_t ipart = 0; ipart < npart; ++ipart)
+      dem->frag.iparent[ipart] = ipart;
+
+    for (size_t ipart = 0; ipart < npart; ++ipart)
+      for (size_t icont = 0;
+          icont < dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].n; ++icont)
+        (void) bmm_dem_djs_union(dem->frag.iparent, ipart,
+            dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].itgt[icont]);
+
+    dem->frag.stale = false;
+  }
+
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    dem->frag.nmemb[ipart] = 0;
+
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    ++dem->frag.nmemb[bmm_dem_djs_find(dem->frag.iparent, ipart)];
+
+  dem->frag.est.n = 0;
+  dem->frag.est.nmax = 0;
+
+  for (size_t ibin = 0; ibin < BMM_NFRAGBIN; ++ibin)
+    dem->frag.est.nsize[ibin] = 0;
+
+  for (size_t ipart = 0; ipart < npart; ++ipart) {
+    size_t const n = dem->frag.nmemb[ipart];
+
+    if (n != 0) {
+      ++dem->frag.est.n;
+      dem->frag.est.nmax = $(bmm_max, size_t)(dem->frag.est.nmax, n);
+
+      size_t ibin = 0;
+      while (ibin < BMM_NFRAGBIN - 1 && n >> (ibin + 1) != 0)
+        ++ibin;
+
+      ++dem->frag.est.nsize[ibin];
+    }
+  }
+}
+
+static bool dump_raddist_etc(struct bmm_dem *const dem) {
+  char buf[BUFSIZ];
+  bmm_dem_path(buf, sizeof buf, dem, "raddist", "");
+
+  FILE *const stream = fopen(buf, "w");
+  if (stream == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  size_t nbin = 512;
+  double *const r = malloc(nbin * sizeof *r);
+  double *const g = malloc(nbin * sizeof *g);
+  dynamic_assert(r != NULL && g != NULL, "Allocated");
+
+  double const rmax = dem->opts.box.x[0] / 4.0;
+
+  if (!bmm_dem_est_raddist(r, g, nbin, rmax, dem))
+    return false;
+
+  for (size_t ibin = 0; ibin < nbin; ++ibin)
+    if (fprintf(stream, "%g %g\n", r[ibin], g[ibin]) < 0) {
+      BMM_TLE_STDS();
+
+      return false;
+    }
+
+  // Snip.
+
+  double const v = $(bmm_prod, double)(dem->opts.box.x, BMM_NDIM);
+  double const rho = (double) dem->part.n / v;
+  double const dr = rmax / (double) nbin;
+  double a = 0.0;
+
+  for (size_t ibin = 0; ibin < nbin; ++ibin)
+    a += (g[ibin] * log(g[ibin] + 1.0e-9) - (g[ibin] - 1.0)) * dr;
+
+  dem->est.sk = -(rho / 2.0) * a;
+
+  // Snap.
+
+  free(g);
+  free(r);
+
+  if (fclose(stream) != 0) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return true;
+}
+
+void bmm_dem_opts_def(struct bmm_dem_opts *const opts) {
+  // This is here just to help Valgrind and cover up my mistakes.
+  (void) memset(opts, 0, sizeof *opts);
+
+  opts->verbose = false;
+
+  opts->gross.fric = BMM_DEM_TANG_CS;
+  opts->gross.pfac = 0.5;
+  opts->gross.hfac = 1.0;
+  opts->gross.ds = 0.1;
+
+  opts->trap.enabled = false;
+#ifdef _GNU_SOURCE
+  opts->trap.mask = FE_DIVBYZERO | FE_INVALID | FE_OVERFLOW | FE_UNDERFLOW;
+#else
+  opts->trap.mask = 0;
+#endif
+
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    opts->box.x[idim] = 1.0;
+
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    opts->box.per[idim] = false;
+
+  opts->time.istab = 1000;
+  opts->time.adapt = false;
+  opts->time.cadapt = 1.0 / 10.0;
+  opts->time.integ = BMM_DEM_INTEG_EULER;
+  opts->time.nsub = 1;
+
+  opts->nonlin.tol = 0.0;
+
+  opts->bond.tag = BMM_DEM_BOND_NONE;
+
+  opts->sleep.on = false;
+  opts->sleep.ek = 1.0e-12;
+  opts->sleep.f = 1.0e-6;
+  opts->sleep.nstep = 100;
+
+  opts->clump.on = false;
+  opts->clump.nmin = 16;
+  opts->clump.fyield = 0.5;
+  opts->clump.nstep = 1000;
+
+  opts->wall.on = false;
+  opts->wall.njag = 0;
+  opts->wall.hjag = 0.0;
+  opts->wall.k = 1.0e+6;
+  opts->wall.gamma = 1.0e+3;
+  opts->wall.gammat = 1.0e+3;
+  opts->wall.mu = 0.85;
+
+  opts->part.ytens = 1.0;
+  opts->part.ycomp = 1.0;
+  opts->part.nu = 0.5;
+  opts->part.rnew[0] = 1.0;
+  opts->part.rnew[1] = 1.0;
+  opts->part.strnew[0] = 1.0;
+  opts->part.strnew[1] = 1.0;
+  opts->part.ncap = 0;
+
+  opts->script.n = 0;
+
+  opts->comm.dt = 1.0;
+  opts->comm.cadence.on = false;
+  opts->comm.cadence.fmin = 0.125;
+  opts->comm.cadence.fmax = 8.0;
+  opts->comm.nkey = 1;
+  opts->comm.nbit = 0;
+  opts->comm.zip = 0;
+  opts->comm.shuffle = false;
+  opts->comm.lit = false;
+  opts->comm.cols = false;
+  opts->comm.async = false;
+  opts->comm.lag = BMM_AIO_LAG_BLOCK;
+  opts->comm.pub = NULL;
+  opts->comm.prof = false;
+  opts->comm.stats = false;
+  opts->comm.sketch = false;
+  opts->comm.frag = false;
+  opts->comm.flip = true;
+  opts->comm.flop = true;
+  opts->comm.flap = true;
+  opts->comm.flup = true;
+
+  opts->expr.bin = false;
+
+  opts->field.on = false;
+  opts->field.kernel = BMM_KERNEL_EPAN;
+  opts->field.bw = 1.0;
+  opts->field.dt = 0.0;
+
+  opts->ckpt.path = NULL;
+  opts->ckpt.dt = INFINITY;
+  opts->ckpt.resume = NULL;
+  opts->ckpt.fork = false;
+
+  opts->cache.tag = BMM_DEM_CACHE_NEIGH;
+  opts->cache.dcutoff = 1.0 / 5.0;
+  opts->cache.reorder = BMM_DEM_ORDER_NONE;
+  opts->cache.incr = false;
+  opts->cache.ghost = false;
+  opts->cache.spec = false;
+  opts->cache.fuse = false;
+  opts->cache.tune = false;
+  opts->cache.ntune = 64;
+
+  opts->thread.n = 1;
+  opts->thread.nacc = 0;
+  opts->thread.pin = BMM_DEM_PIN_NONE;
+  opts->thread.huge = false;
+
+  opts->perf.nstep = 0;
+
+  opts->trace.nev = 0;
+
+  opts->plug.n = 0;
+
+  opts->ens.n = 1;
+  opts->ens.i = 0;
+
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    opts->cache.ncell[idim] = 5;
+
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    opts->field.ncell[idim] = 0;
+}
+
+/// The call `bmm_dem_tune_def(dem)`
+/// lists the candidate cutoffs for tuning the neighbor cache
+/// of the simulation `dem`.
+/// The candidates are multiples of the largest particle radius,
+/// which are left out if they would not leave room
+/// for three cells in every dimension.
+__attribute__ ((__nonnull__))
+static void bmm_dem_tune_def(struct bmm_dem *const dem) {
+  static double const leeway[] = {2.5, 3.0, 4.0, 5.0, 6.0};
+  static_assert(nmembof(leeway) == BMM_NTUNE, "Wrong number of candidates");
+
+  dem->tune.done = false;
+  dem->tune.icand = 0;
+  dem->tune.istep = 0;
+  dem->tune.tstart = 0.0;
+  dem->tune.ibest = SIZE_MAX;
+
+  for (size_t icand = 0; icand < BMM_NTUNE; ++icand) {
+    double const dcutoff = leeway[icand] * dem->opts.part.rnew[1];
+
+    bool fits = true;
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      if (3.0 * dcutoff > dem->opts.box.x[idim])
+        fits = false;
+
+    dem->tune.dcutoff[icand] = fits ? dcutoff : 0.0;
+    dem->tune.t[icand] = INFINITY;
+  }
+}
+
+bool bmm_dem_def(struct bmm_dem *const dem,
+    struct bmm_dem_opts const *const opts) {
+  // This is here just to help Valgrind and cover up my mistakes.
+  (void) memset(dem, 0, sizeof *dem);
+
+  if (opts->thread.n == 0 || opts->thread.n > BMM_MTHREAD) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Unsupported number of threads");
+
+    return false;
+  }
+
+  if (opts->thread.nacc > BMM_MTHREAD) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Unsupported number of accumulators");
+
+    return false;
+  }
+
+  if (opts->comm.nkey == 0) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Unsupported keyframe interval");
+
+    return false;
+  }
+
+  if (!(opts->comm.nbit == 0 ||
+        opts->comm.nbit == 16 || opts->comm.nbit == 32)) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Unsupported quantization");
+
+    return false;
+  }
+
+  if (!(opts->comm.cadence.fmin > 0.0 && opts->comm.cadence.fmin <= 1.0 &&
+        opts->comm.cadence.fmax >= 1.0)) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Unsupported output time step bounds");
+
+    return false;
+  }
+
+  if (opts->comm.zip > 9) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Unsupported compression level");
+
+    return false;
+  }
+
+  if (opts->comm.lit && opts->comm.zip != 0) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP,
+        "Literal-terminated messages cannot be compressed");
+
+    return false;
+  }
+
+  if (opts->comm.pub != NULL && opts->comm.async) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Publishing is asynchronous already");
+
+    return false;
+  }
+
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    if (opts->field.ncell[idim] > BMM_MCELL) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Unsupported field grid");
+
+      return false;
+    }
+
+  dem->opts = *opts;
+
+  dem->trap.remask = 0;
+
+  dem->nonlin.nsqrt = opts->nonlin.tol == 0.0 ? SIZE_MAX :
+    bmm_fp_fsqrtn(opts->nonlin.tol);
+
+  dem->bond.tag = opts->bond.tag;
+  dem->bond.ccrcont = 1.5;
+
+  dem->integ.tag = BMM_DEM_INTEG_TAYLOR;
+  dem->integ.tag = BMM_DEM_INTEG_VELVET;
+  dem->integ.tag = BMM_DEM_INTEG_BEEMAN;
+  dem->integ.tag = BMM_DEM_INTEG_KURAEV;
+  dem->integ.tag = dem->opts.time.integ;
+  if (dem->opts.time.nsub > 1)
+    dem->integ.tag = BMM_DEM_INTEG_RESPA;
+  dem->cache.tag = dem->opts.cache.tag;
+  dem->ext.tag = BMM_DEM_EXT_NONE;
+  dem->amb.tag = BMM_DEM_AMB_NONE;
+  dem->pair[BMM_DEM_CT_WEAK].cohesive = false;
+  dem->pair[BMM_DEM_CT_WEAK].norm.tag = BMM_DEM_NORM_BSHP;
+  dem->pair[BMM_DEM_CT_WEAK].tang.tag = BMM_DEM_TANG_CS;
+  dem->pair[BMM_DEM_CT_STRONG].cohesive = true;
+  dem->pair[BMM_DEM_CT_STRONG].norm.tag = BMM_DEM_NORM_KV;
+  dem->pair[BMM_DEM_CT_STRONG].tang.tag = BMM_DEM_TANG_BEAM;
+  dem->yield.tag = BMM_DEM_YIELD_ZE;
+
+  switch (dem->amb.tag) {
+    case BMM_DEM_AMB_FAXEN:
+      dem->amb.params.creeping.eta = 1.0e+3;
+
+      break;
+  }
+
+  switch (dem->pair[BMM_DEM_CT_WEAK].norm.tag) {
+    case BMM_DEM_NORM_KV:
+      dem->pair[BMM_DEM_CT_WEAK].norm.params.dashpot.k = 1.0e+6;
+      dem->pair[BMM_DEM_CT_WEAK].norm.params.dashpot.gamma = 1.0e+3;
+
+      break;
+    case BMM_DEM_NORM_BSHP:
+      dem->pair[BMM_DEM_CT_WEAK].norm.params.viscoel.a = 4.0e-2;
+
+      break;
+  }
+
+  switch (dem->pair[BMM_DEM_CT_WEAK].tang.tag) {
+    case BMM_DEM_TANG_HW:
+      dem->pair[BMM_DEM_CT_WEAK].tang.params.hw.gamma = 1.0e+4;
+      dem->pair[BMM_DEM_CT_WEAK].tang.params.hw.mu = 0.85;
+
+      break;
+    case BMM_DEM_TANG_CS:
+      dem->pair[BMM_DEM_CT_WEAK].tang.params.cs.k = 1.0e+6;
+      dem->pair[BMM_DEM_CT_WEAK].tang.params.cs.mu = 0.85;
+
+      break;
+  }
+
+  switch (dem->pair[BMM_DEM_CT_STRONG].norm.tag) {
+    case BMM_DEM_NORM_KV:
+      dem->pair[BMM_DEM_CT_STRONG].norm.params.dashpot.k = 2.0e+8;
+      dem->pair[BMM_DEM_CT_STRONG].norm.params.dashpot.gamma = 4.0e+3;
+
+      break;
+    case BMM_DEM_NORM_BSHP:
+      dem->pair[BMM_DEM_CT_STRONG].norm.params.viscoel.a = 4.0e-2;
+
+      break;
+  }
+
+  switch (dem->pair[BMM_DEM_CT_STRONG].tang.tag) {
+    case BMM_DEM_TANG_BEAM:
+      dem->pair[BMM_DEM_CT_STRONG].tang.params.beam.k = 8.0e+6;
+      dem->pair[BMM_DEM_CT_STRONG].tang.params.beam.dk = 4.0e+2;
+      // This is ideal for `triplet` tests.
+      // dem->pair[BMM_DEM_CT_STRONG].tang.params.beam.dk = 4.0e+1;
+      // dem->pair[BMM_DEM_CT_STRONG].tang.params.beam.dk = 0.0e+1;
+
+      break;
+  }
+
+  switch (dem->yield.tag) {
+    case BMM_DEM_YIELD_RANKINE:
+      dem->yield.params.rankine.sigmacrit = 1.0e+8;
+
+      break;
+    case BMM_DEM_YIELD_TRESCA:
+      dem->yield.params.tresca.taucrit = 1.0e+8;
+
+      break;
+    case BMM_DEM_YIELD_ZE:
+      dem->yield.params.ze.sigmacrit = 5.0e+8;
+      dem->yield.params.ze.taucrit = 5.0e+8;
+      // This is ideal for `beam` tests.
+      // dem->yield.params.ze.sigmacrit = 5.0e+7;
+      // dem->yield.params.ze.taucrit = 5.0e+7;
+
+      break;
+  }
+
+  // Estimators appeared.
+  dem->est.eambdis = 0.0;
+  dem->est.epotext_d = 0.0;
+  dem->est.eklin_d = 0.0;
+  dem->est.ekrot_d = 0.0;
+  dem->est.ewcont_d = 0.0;
+  dem->est.escont_d = 0.0;
+  dem->est.ewcont = 0.0;
+  dem->est.escont = 0.0;
+  dem->est.edrivtang = 0.0;
+  dem->est.edrivnorm = 0.0;
+  dem->est.ebond = 0.0;
+  dem->est.eyieldis = 0.0;
+  dem->est.ewcontdis = 0.0;
+  dem->est.escontdis = 0.0;
+  dem->est.fback[0] = 0.0;
+  dem->est.fback[1] = 0.0;
+  dem->est.chi = (double) NAN;
+  dem->est.mueff = (double) NAN;
+  dem->est.mueffb = (double) NAN;
+  dem->est.vdriv[0] = (double) NAN;
+  dem->est.vdriv[1] = (double) NAN;
+  dem->est.hwgamma = 0;
+  dem->est.hwmu = 0;
+  dem->est.csk = 0;
+  dem->est.csmu = 0;
+  dem->est.nsleep = 0;
+  dem->est.ngsleep = 0;
+  dem->est.nclump = 0;
+  dem->est.nsketch = 0;
+  for (enum bmm_dem_sketch isketch = 0; isketch < BMM_DEM_NSKETCH; ++isketch)
+    for (size_t iquant = 0; iquant < BMM_NQUANT; ++iquant)
+      dem->est.quant[isketch][iquant] = (double) NAN;
+
+  dem->time.t = 0.0;
+  dem->time.istep = 0;
+
+  dem->le.v = 0.0;
+  dem->le.x = 0.0;
+
+  dem->wall.on = false;
+  for (size_t iwall = 0; iwall < BMM_NWALL; ++iwall) {
+    dem->wall.y[iwall] = 0.0;
+    dem->wall.x[iwall] = 0.0;
+    dem->wall.m[iwall] = (double) INFINITY;
+
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+      dem->wall.v[iwall][idim] = 0.0;
+      dem->wall.f[iwall][idim] = 0.0;
+    }
+  }
+
+  dem->clump.n = 0;
+
+  dem->part.n = 0;
+  dem->part.ncap = 0;
+  dem->part.lnew = 0;
+
+  dem->script.i = 0;
+  dem->script.tprev = 0.0;
+  dem->script.dt = 0.0;
+  dem->script.entered = false;
+  dem->script.conv.n = 0;
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    dem->script.state.crunch.fdrive[idim] = 0.0;
+
+  dem->comm.tprev = 0.0;
+  dem->comm.dt = opts->comm.dt;
+  dem->comm.cadence.ek = (double) NAN;
+  dem->comm.cadence.mueff = (double) NAN;
+  dem->comm.cadence.nyield = 0;
+  dem->comm.cadence.lost = false;
+  dem->comm.ikey = 0;
+  dem->comm.npart = 0;
+  bmm_zip_def(&dem->comm.zip);
+  bmm_lit_def(&dem->comm.lit);
+
+  dem->ckpt.tprev = 0.0;
+  dem->ckpt.pid = 0;
+
+  bmm_dem_tune_def(dem);
+
+  for (enum bmm_dem_phase iphase = 0; iphase < BMM_NPHASE; ++iphase)
+    dem->prof.t[iphase] = 0.0;
+
+  dem->prof.nbuild = 0;
+  dem->prof.nupdate = 0;
+  dem->prof.nadd = 0;
+  dem->prof.nrem = 0;
+  dem->prof.nyield = 0;
+
+  dem->stats.nbyte = 0;
+  dem->stats.twait = 0.0;
+  dem->stats.prev.t = bmm_sec_now();
+  dem->stats.prev.tsim = 0.0;
+  dem->stats.prev.istep = 0;
+  dem->stats.prev.nbuild = 0;
+  dem->stats.prev.nbyte = 0;
+  dem->stats.prev.twait = 0.0;
+  dem->stats.est.vstep = 0.0;
+  dem->stats.est.vtsim = 0.0;
+  dem->stats.est.vbuild = 0.0;
+  dem->stats.est.vbyte = 0.0;
+  dem->stats.est.fwait = 0.0;
+  dem->stats.est.nneigh = 0.0;
+  dem->stats.est.ncont = 0.0;
+  dem->stats.est.nrss = 0.0;
+
+  dem->perf.on = false;
+  for (size_t ithread = 0; ithread < BMM_MTHREAD; ++ithread)
+    for (enum bmm_dem_ctr ictr = 0; ictr < BMM_NCTR; ++ictr)
+      dem->perf.fd[ithread][ictr] = -1;
+
+  dem->trace.ncap = 0;
+  dem->trace.nthread = 0;
+
+  dem->plug.host.n = 0;
+  dem->plug.snap = NULL;
+  dem->plug.ncap = 0;
+  for (size_t icol = 0; icol < nmembof(dem->plug.col); ++icol)
+    dem->plug.col[icol] = NULL;
+
+  dem->field.sample = false;
+  dem->field.tprev = -INFINITY;
+  bmm_dem_field_reset(dem);
+
+  dem->sketch.sample = false;
+  dem->sketch.acc = NULL;
+
+  dem->frag.stale = true;
+
+  dem->spec.busy = false;
+  dem->spec.failed = false;
+  dem->spec.ibuild = 0;
+  dem->spec.ibuildsnap = 0;
+  dem->spec.istep = 0;
+  dem->spec.istepsnap = 0;
+  dem->spec.tsnap = 0.0;
+  dem->spec.nlead = 1;
+  dem->spec.shadow = NULL;
+
+  dem->cache.stale = false;
+  dem->cache.sorted = false;
+  dem->cache.i = 0;
+  dem->cache.tpart = 0.0;
+  dem->cache.tprev = 0.0;
+  dem->cache.xle = 0.0;
+
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+    dem->cache.stencil.ncell[idim] = 0;
+    dem->cache.stencil.per[idim] = false;
+  }
+
+  dem->cache.stencil.ncap = 0;
+  dem->cache.stencil.nupper = NULL;
+  dem->cache.stencil.iupper = NULL;
+  dem->cache.stencil.nlower = NULL;
+  dem->cache.stencil.ilower = NULL;
+
+  dem->cache.ghost.xle = 0.0;
+  dem->cache.ghost.dle = 0.0;
+  dem->cache.ghost.ncap = 0;
+  dem->cache.ghost.x = NULL;
+  dem->cache.ghost.k = NULL;
+  dem->cache.ghost.xoff = NULL;
+  dem->cache.ghost.kneigh = NULL;
+
+  dem->cache.level.n = 0;
+  dem->cache.level.ncap = 0;
+  dem->cache.level.part = NULL;
+  dem->cache.level.ilevel = NULL;
+  dem->cache.level.icell = NULL;
+  dem->cache.level.ipart = NULL;
+
+  for (size_t icell = 0; icell < nmembof(dem->cache.part); ++icell) {
+    dem->cache.part[icell].n = 0;
+    dem->cache.part[icell].i = 0;
+  }
+
+  dem->cache.nneigh = 0;
+  dem->cache.ncapneigh = 0;
+
+  dem->cache.nbin = malloc(opts->thread.n * sizeof *dem->cache.nbin);
+  if (dem->cache.nbin == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  if (opts->comm.sketch) {
+    size_t const nacc = bmm_dem_nacc(dem);
+
+    dem->sketch.acc = malloc(nacc * sizeof *dem->sketch.acc);
+    if (dem->sketch.acc == NULL) {
+      BMM_TLE_STDS();
+
+      return false;
+    }
+
+    for (size_t iacc = 0; iacc < nacc; ++iacc)
+      for (enum bmm_dem_sketch isketch = 0; isketch < BMM_DEM_NSKETCH;
+          ++isketch)
+        bmm_sketch_def(&dem->sketch.acc[iacc][isketch]);
+  }
+
+  return bmm_dem_reserve(dem, opts->part.ncap);
+}
+
+void bmm_dem_free(struct bmm_dem *const dem) {
+  bmm_dem_spec_free(dem);
+
+  free(dem->sketch.acc);
+
+  for (size_t icol = 0; icol < nmembof(dem->plug.col); ++icol)
+    free(dem->plug.col[icol]);
+  free(dem->plug.snap);
+
+  free(dem->part.l);
+  free(dem->part.role);
+  free(dem->part.r);
+  free(dem->part.m);
+  free(dem->part.jred);
+  free(dem->part.x);
+  free(dem->part.v);
+  free(dem->part.a);
+  free(dem->part.phi);
+  free(dem->part.omega);
+  free(dem->part.alpha);
+  free(dem->part.f);
+  free(dem->part.tau);
+
+  switch (dem->integ.tag) {
+    case BMM_DEM_INTEG_VELVET:
+      free(dem->integ.params.velvet.ao);
+      free(dem->integ.params.velvet.alphao);
+
+      break;
+    case BMM_DEM_INTEG_BEEMAN:
+    case BMM_DEM_INTEG_KURAEV:
+      free(dem->integ.params.beeman.ao);
+      free(dem->integ.params.beeman.aoo);
+      free(dem->integ.params.beeman.alphao);
+      free(dem->integ.params.beeman.alphaoo);
+
+      break;
+    case BMM_DEM_INTEG_RESPA:
+      free(dem->integ.params.respa.f);
+      free(dem->integ.params.respa.tau);
+
+      break;
+  }
+
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict)
+    free(dem->pair[ict].cont.src);
+
+  free(dem->cache.j);
+  free(dem->cache.x);
+  free(dem->cache.ijcell);
+  free(dem->cache.xrel);
+  free(dem->cache.icell);
+  free(dem->cache.ipart);
+  free(dem->cache.neigh);
+  free(dem->cache.ineigh);
+  free(dem->cache.nbin);
+  free(dem->cache.stencil.nupper);
+  free(dem->cache.stencil.iupper);
+  free(dem->cache.stencil.nlower);
+  free(dem->cache.stencil.ilower);
+  free(dem->cache.ghost.x);
+  free(dem->cache.ghost.k);
+  free(dem->cache.ghost.xoff);
+  free(dem->cache.ghost.kneigh);
+  free(dem->cache.level.part);
+  free(dem->cache.level.ilevel);
+  free(dem->cache.level.icell);
+  free(dem->cache.level.ipart);
+
+  free(dem->comm.x);
+  free(dem->comm.phi);
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict)
+    free(dem->comm.src[ict]);
+  bmm_lit_free(&dem->comm.lit);
+  bmm_zip_free(&dem->comm.zip);
+
+  for (size_t iacc = 1; iacc < bmm_dem_nacc(dem); ++iacc) {
+    free(dem->thread.acc[iacc].f);
+    free(dem->thread.acc[iacc].tau);
+    free(dem->thread.acc[iacc].s);
+  }
+
+  free(dem->field.s);
+
+  free(dem->frag.nmemb);
+
+  free(dem->sleep.wake);
+
+  free(dem->clump.body);
+  free(dem->clump.ibody);
+  free(dem->clump.d);
+  free(dem->clump.dphi);
+  free(dem->clump.nlink);
+  free(dem->sleep.iparent);
+  free(dem->sleep.fref);
+  free(dem->sleep.nquiet);
+  free(dem->sleep.poke);
+  free(dem->sleep.asleep);
+
+  free(dem->batch.rem);
+  free(dem->batch.brk);
+  free(dem->frag.iparent);
+
+  dem->part.n = 0;
+  dem->part.ncap = 0;
+
+  dem->cache.nneigh = 0;
+  dem->cache.ncapneigh = 0;
+}
+
+// TODO Relocate these.
+
+/// Destination of the frame being written or `NULL` to write directly.
+static struct bmm_aio *msgaio = NULL;
+
+/// Publisher of the frame being written or `NULL` to write directly.
+static struct bmm_pub *msgpub = NULL;
+
+/// Whether the message being written has a high priority.
+static bool msgprio = false;
+
+/// Compressor of the frame being written or `NULL` to leave it alone.
+static struct bmm_zip *msgzip = NULL;
+
+/// Payload of the message being compressed or `NULL` if there is none.
+static struct bmm_zip *msgraw = NULL;
+
+/// Encoder of the frame being written or `NULL` to size messages instead.
+static struct bmm_lit *msglit = NULL;
+
+/// Body of the message being encoded or `NULL` if there is none.
+static struct bmm_lit *msgbody = NULL;
+
+/// Tracer of the frame being written or `NULL` to leave it untraced.
+static struct bmm_trace *msgtrace = NULL;
+
+/// Number of bytes sent so far or `NULL` to leave them uncounted.
+static size_t *msgnbyte = NULL;
+
+static bool msg_write(void const *buf, size_t const n,
+    __attribute__ ((__unused__)) void *const ptr) {
+  // Empty columns may not even be allocated.
+  if (n == 0)
+    return true;
+
+  if (msgraw != NULL)
+    return bmm_zip_put(msgraw, buf, n);
+
+  if (msgbody != NULL) {
+    struct bmm_lit *const lit = msgbody;
+
+    msgbody = NULL;
+    bool const result = bmm_lit_put(lit, buf, n, msg_write, NULL);
+    msgbody = lit;
+
+    return result;
+  }
+
+  if (msgnbyte != NULL)
+    *msgnbyte += n;
+
+  return msgpub != NULL ? bmm_pub_write(msgpub, buf, n) :
+    msgaio != NULL ? (msgprio ? bmm_aio_prio_write(msgaio, buf, n) :
+        bmm_aio_write(msgaio, buf, n)) :
+    bmm_io_writeout(buf, n);
+}
+
+static_assert(sizeof (double) == sizeof (uint64_t),
+    "Unsupported floating-point format");
+
+/// The call `bmm_dem_comm_xor(x, y)`
+/// returns the bitwise exclusive or of the representations of `x` and `y`.
+/// Nearby values share their leading bits,
+/// so the result is mostly zeros and compresses well.
+__attribute__ ((__const__))
+static uint64_t bmm_dem_comm_xor(double const x, double const y) {
+  uint64_t i;
+  (void) memcpy(&i, &x, sizeof i);
+
+  uint64_t j;
+  (void) memcpy(&j, &y, sizeof j);
+
+  return i ^ j;
+}
+
+/// The call `bmm_dem_comm_changed(dem, ict, ipart)`
+/// checks whether the contacts of type `ict` of the particle `ipart`
+/// in the simulation `dem` differ from those in the previous frame.
+__attribute__ ((__nonnull__, __pure__))
+static bool bmm_dem_comm_changed(struct bmm_dem const *const dem,
+    enum bmm_dem_ct const ict, size_t const ipart) {
+  size_t const ncont = dem->pair[ict].cont.src[ipart].n;
+
+  return ncont != dem->comm.src[ict][ipart].n ||
+    memcmp(dem->pair[ict].cont.src[ipart].itgt,
+        dem->comm.src[ict][ipart].itgt,
+        ncont * sizeof *dem->comm.src[ict][ipart].itgt) != 0;
+}
+
+/// The call `bmm_dem_comm_quant(x, a, b, nbit)`
+/// writes `x` quantized to `nbit` bits from `a` to `b`.
+static bool bmm_dem_comm_quant(double const x,
+    double const a, double const b, size_t const nbit) {
+  uint32_t const k = bmm_fp_quant(x, a, b, nbit);
+
+  if (nbit <= 16) {
+    uint16_t const khalf = (uint16_t) k;
+
+    return msg_write(&khalf, sizeof khalf, NULL);
+  } else
+    return msg_write(&k, sizeof k, NULL);
+}
+
+/// This structure points to the data of one column of a table message.
+struct bmm_dem_col {
+  /// Name.
+  char const *name;
+  /// Type of the words.
+  enum bmm_col_type type;
+  /// Number of words per row.
+  size_t n;
+  /// Data.
+  void const *ptr;
+};
+
+// Roles and counts are sent as they are held.
+static_assert(sizeof (enum bmm_dem_role) == sizeof (uint32_t),
+    "Unsupported role type");
+static_assert(sizeof (size_t) == sizeof (uint64_t), "Unsupported size type");
+
+/// The call `bmm_dem_comm_cols(tab, ptr, cols, ncol)`
+/// adds the `ncol` columns `cols` to `tab` and
+/// points each `ptr[icol]` to the data of the column `icol`.
+__attribute__ ((__nonnull__))
+static void bmm_dem_comm_cols(struct bmm_col_tab *const tab,
+    void const **const ptr,
+    struct bmm_dem_col const *const cols, size_t const ncol) {
+  for (size_t icol = 0; icol < ncol; ++icol) {
+    ptr[tab->ncol] = cols[icol].ptr;
+    bmm_col_tab_add(tab, cols[icol].name, cols[icol].type, cols[icol].n);
+  }
+}
+
+/// The call `bmm_dem_comm_tab(dem, num, tab, ptr)`
+/// describes the columns of the table message `num`
+/// of the simulation `dem` in `tab`,
+/// points each `ptr[icol]` to the data of the column `icol` and
+/// returns the number of rows.
+__attribute__ ((__nonnull__))
+static size_t bmm_dem_comm_tab(struct bmm_dem const *const dem,
+    enum bmm_msg_num const num, struct bmm_col_tab *const tab,
+    void const **const ptr) {
+  bmm_col_tab_def(tab, num);
+
+  switch (num) {
+    case BMM_MSG_NUM_CPARTS:
+      {
+        struct bmm_dem_col const cols[] = {
+          {"l", BMM_COL_TYPE_U64, 1, dem->part.l},
+          {"role", BMM_COL_TYPE_U32, 1, dem->part.role},
+          {"r", BMM_COL_TYPE_F64, 1, dem->part.r},
+          {"m", BMM_COL_TYPE_F64, 1, dem->part.m},
+          {"jred", BMM_COL_TYPE_F64, 1, dem->part.jred},
+          {"x", BMM_COL_TYPE_F64, BMM_NDIM, dem->part.x},
+          {"v", BMM_COL_TYPE_F64, BMM_NDIM, dem->part.v},
+          {"a", BMM_COL_TYPE_F64, BMM_NDIM, dem->part.a},
+          {"phi", BMM_COL_TYPE_F64, 1, dem->part.phi},
+          {"omega", BMM_COL_TYPE_F64, 1, dem->part.omega},
+          {"alpha", BMM_COL_TYPE_F64, 1, dem->part.alpha},
+          {"f", BMM_COL_TYPE_F64, BMM_NDIM, dem->part.f},
+          {"tau", BMM_COL_TYPE_F64, 1, dem->part.tau}
+        };
+
+        bmm_dem_comm_cols(tab, ptr, cols, nmembof(cols));
+      }
+
+      return dem->part.n;
+    case BMM_MSG_NUM_CEST:
+      {
+        struct bmm_dem_col const cols[] = {
+          {"eambdis", BMM_COL_TYPE_F64, 1, &dem->est.eambdis},
+          {"epotext_d", BMM_COL_TYPE_F64, 1, &dem->est.epotext_d},
+          {"eklin_d", BMM_COL_TYPE_F64, 1, &dem->est.eklin_d},
+          {"ekrot_d", BMM_COL_TYPE_F64, 1, &dem->est.ekrot_d},
+          {"ewcont_d", BMM_COL_TYPE_F64, 1, &dem->est.ewcont_d},
+          {"escont_d", BMM_COL_TYPE_F64, 1, &dem->est.escont_d},
+          {"ewcont", BMM_COL_TYPE_F64, 1, &dem->est.ewcont},
+          {"escont", BMM_COL_TYPE_F64, 1, &dem->est.escont},
+          {"edrivnorm", BMM_COL_TYPE_F64, 1, &dem->est.edrivnorm},
+          {"edrivtang", BMM_COL_TYPE_F64, 1, &dem->est.edrivtang},
+          {"ebond", BMM_COL_TYPE_F64, 1, &dem->est.ebond},
+          {"eyieldis", BMM_COL_TYPE_F64, 1, &dem->est.eyieldis},
+          {"ewcontdis", BMM_COL_TYPE_F64, 1, &dem->est.ewcontdis},
+          {"escontdis", BMM_COL_TYPE_F64, 1, &dem->est.escontdis},
+          {"fback", BMM_COL_TYPE_F64, BMM_NDIM, dem->est.fback},
+          {"vfix", BMM_COL_TYPE_F64, BMM_NDIM, dem->est.vfix},
+          {"vdriv", BMM_COL_TYPE_F64, BMM_NDIM, dem->est.vdriv},
+          {"chi", BMM_COL_TYPE_F64, 1, &dem->est.chi},
+          {"sk", BMM_COL_TYPE_F64, 1, &dem->est.sk},
+          {"mueff", BMM_COL_TYPE_F64, 1, &dem->est.mueff},
+          {"mueffb", BMM_COL_TYPE_F64, 1, &dem->est.mueffb},
+          {"hwgamma", BMM_COL_TYPE_U64, 1, &dem->est.hwgamma},
+          {"hwmu", BMM_COL_TYPE_U64, 1, &dem->est.hwmu},
+          {"csk", BMM_COL_TYPE_U64, 1, &dem->est.csk},
+          {"csmu", BMM_COL_TYPE_U64, 1, &dem->est.csmu},
+          {"bshpp", BMM_COL_TYPE_F64, 1, &dem->est.bshpp},
+          {"nsleep", BMM_COL_TYPE_U64, 1, &dem->est.nsleep},
+          {"ngsleep", BMM_COL_TYPE_U64, 1, &dem->est.ngsleep},
+          {"nclump", BMM_COL_TYPE_U64, 1, &dem->est.nclump},
+          {"nsketch", BMM_COL_TYPE_U64, 1, &dem->est.nsketch},
+          {"qfnorm", BMM_COL_TYPE_F64, BMM_NQUANT,
+            dem->est.quant[BMM_DEM_SKETCH_FNORM]},
+          {"qftang", BMM_COL_TYPE_F64, BMM_NQUANT,
+            dem->est.quant[BMM_DEM_SKETCH_FTANG]},
+          {"qxi", BMM_COL_TYPE_F64, BMM_NQUANT,
+            dem->est.quant[BMM_DEM_SKETCH_XI]}
+        };
+
+        bmm_dem_comm_cols(tab, ptr, cols, nmembof(cols));
+      }
+
+      // The estimators form a table of their own with just one row.
+      return 1;
+  }
+
+  dynamic_assert(false, "Unsupported message number");
+}
+
+/// The call `bmm_dem_comm_schema(dem, schema)`
+/// describes every table message of the simulation `dem` in `schema`.
+__attribute__ ((__nonnull__))
+static void bmm_dem_comm_schema(struct bmm_dem const *const dem,
+    struct bmm_col_schema *const schema) {
+  enum bmm_msg_num const nums[] = {BMM_MSG_NUM_CPARTS, BMM_MSG_NUM_CEST};
+  static_assert(nmembof(nums) <= BMM_COL_MTAB, "Too many tables");
+
+  void const *ptr[BMM_COL_MCOL];
+
+  for (size_t itab = 0; itab < nmembof(nums); ++itab)
+    (void) bmm_dem_comm_tab(dem, nums[itab], &schema->tab[itab], ptr);
+
+  schema->ntab = nmembof(nums);
+}
+
+size_t bmm_dem_sniff_size(struct bmm_dem const *const dem,
+    enum bmm_msg_num const num) {
+  size_t const npart = dem->part.n;
+
+  switch (num) {
+    case BMM_MSG_NUM_ISTEP:
+      return sizeof dem->time;
+    case BMM_MSG_NUM_OPTS:
+      return sizeof dem->opts;
+    case BMM_MSG_NUM_SCHEMA:
+      {
+        struct bmm_col_schema schema;
+        bmm_dem_comm_schema(dem, &schema);
+
+        return bmm_col_schema_size(&schema);
+      }
+    case BMM_MSG_NUM_CPARTS:
+    case BMM_MSG_NUM_CEST:
+      {
+        struct bmm_col_tab tab;
+        void const *ptr[BMM_COL_MCOL];
+        size_t const nrow = bmm_dem_comm_tab(dem, num, &tab, ptr);
+
+        return bmm_col_tab_size(&tab, nrow);
+      }
+    case BMM_MSG_NUM_NEIGH:
+      {
+        size_t size = sizeof dem->part.n + sizeof dem->cache.nneigh +
+          sizeof dem->cache.tag + sizeof dem->cache.stale +
+          sizeof dem->cache.i + sizeof dem->cache.tpart +
+          sizeof dem->cache.tprev +
+          npart * sizeof *dem->cache.j +
+          npart * sizeof *dem->cache.x +
+          npart * sizeof *dem->cache.ijcell +
+          npart * sizeof *dem->cache.icell +
+          sizeof dem->cache.part +
+          npart * sizeof *dem->cache.ipart +
+          npart * sizeof *dem->cache.neigh +
+          dem->cache.nneigh * sizeof *dem->cache.ineigh;
+
+        for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict)
+          size += npart * sizeof *dem->pair[ict].cont.src +
+            sizeof dem->pair[ict].cohesive +
+            sizeof dem->pair[ict].norm + sizeof dem->pair[ict].tang;
+
+        return size;
+      }
+    case BMM_MSG_NUM_PARTS:
+      return sizeof dem->part.n + sizeof dem->part.lnew +
+        npart * sizeof *dem->part.l +
+        npart * sizeof *dem->part.role +
+        npart * sizeof *dem->part.r +
+        npart * sizeof *dem->part.m +
+        npart * sizeof *dem->part.jred +
+        npart * sizeof *dem->part.x +
+        npart * sizeof *dem->part.v +
+        npart * sizeof *dem->part.a +
+        npart * sizeof *dem->part.phi +
+        npart * sizeof *dem->part.omega +
+        npart * sizeof *dem->part.alpha +
+        npart * sizeof *dem->part.f +
+        npart * sizeof *dem->part.tau;
+    case BMM_MSG_NUM_QPARTS:
+      return sizeof dem->part.n + sizeof dem->opts.comm.nbit +
+        BMM_NDIM * 2 * sizeof (double) +
+        npart * sizeof *dem->part.role +
+        npart * sizeof *dem->part.r +
+        npart * BMM_NDIM * (dem->opts.comm.nbit / CHAR_BIT) +
+        npart * sizeof (uint16_t);
+    case BMM_MSG_NUM_DPARTS:
+      return sizeof dem->part.n +
+        npart * sizeof *dem->part.role +
+        npart * BMM_NDIM * sizeof (uint64_t) +
+        npart * sizeof (uint64_t);
+    case BMM_MSG_NUM_DCONTS:
+      {
+        size_t size = sizeof dem->part.n;
+
+        for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict) {
+          size += sizeof (size_t);
+
+          for (size_t ipart = 0; ipart < npart; ++ipart)
+            if (bmm_dem_comm_changed(dem, ict, ipart))
+              size += sizeof ipart +
+                sizeof dem->pair[ict].cont.src[ipart].n +
+                dem->pair[ict].cont.src[ipart].n *
+                sizeof *dem->pair[ict].cont.src[ipart].itgt;
+        }
+
+        return size;
+      }
+    case BMM_MSG_NUM_EST:
+      return sizeof dem->est;
+    case BMM_MSG_NUM_FIELD:
+      return sizeof dem->field.ncell + sizeof dem->field.nsample +
+        $(bmm_prod, size_t)(dem->field.ncell, BMM_NDIM) *
+        sizeof *dem->field.cell;
+    case BMM_MSG_NUM_PROF:
+      return sizeof dem->prof;
+    case BMM_MSG_NUM_FRAG:
+      return sizeof dem->frag.est;
+    case BMM_MSG_NUM_PERF:
+      return sizeof dem->perf.est;
+    case BMM_MSG_NUM_STATS:
+      return sizeof dem->stats.est;
+  }
+
+  dynamic_assert(false, "Unsupported message number");
+}
+
+bool bmm_dem_puts_stuff(struct bmm_dem const *const dem,
+    enum bmm_msg_num const num) {
+  size_t const npart = dem->part.n;
+
+  switch (num) {
+    case BMM_MSG_NUM_ISTEP:
+      return msg_write(&dem->time, sizeof dem->time, NULL);
+    case BMM_MSG_NUM_OPTS:
+      return msg_write(&dem->opts, sizeof dem->opts, NULL);
+    case BMM_MSG_NUM_SCHEMA:
+      {
+        struct bmm_col_schema schema;
+        bmm_dem_comm_schema(dem, &schema);
+
+        return bmm_col_schema_write(&schema, msg_write, NULL);
+      }
+    case BMM_MSG_NUM_CPARTS:
+    case BMM_MSG_NUM_CEST:
+      {
+        struct bmm_col_tab tab;
+        void const *ptr[BMM_COL_MCOL];
+        size_t const nrow = bmm_dem_comm_tab(dem, num, &tab, ptr);
+
+        if (!msg_write(&nrow, sizeof nrow, NULL))
+          return false;
+
+        for (size_t icol = 0; icol < tab.ncol; ++icol)
+          if (!msg_write(ptr[icol], nrow * tab.col[icol].n *
+                bmm_col_size(tab.col[icol].type), NULL))
+            return false;
+      }
+
+      return true;
+    case BMM_MSG_NUM_NEIGH:
+      if (!(msg_write(&dem->part.n, sizeof dem->part.n, NULL) &&
+            msg_write(&dem->cache.nneigh, sizeof dem->cache.nneigh, NULL) &&
+            msg_write(&dem->cache.tag, sizeof dem->cache.tag, NULL) &&
+            msg_write(&dem->cache.stale, sizeof dem->cache.stale, NULL) &&
+            msg_write(&dem->cache.i, sizeof dem->cache.i, NULL) &&
+            msg_write(&dem->cache.tpart, sizeof dem->cache.tpart, NULL) &&
+            msg_write(&dem->cache.tprev, sizeof dem->cache.tprev, NULL) &&
+            msg_write(dem->cache.j, npart * sizeof *dem->cache.j, NULL) &&
+            msg_write(dem->cache.x, npart * sizeof *dem->cache.x, NULL) &&
+            msg_write(dem->cache.ijcell,
+              npart * sizeof *dem->cache.ijcell, NULL) &&
+            msg_write(dem->cache.icell,
+              npart * sizeof *dem->cache.icell, NULL) &&
+            msg_write(dem->cache.part, sizeof dem->cache.part, NULL) &&
+            msg_write(dem->cache.ipart,
+              npart * sizeof *dem->cache.ipart, NULL) &&
+            msg_write(dem->cache.neigh,
+              npart * sizeof *dem->cache.neigh, NULL) &&
+            msg_write(dem->cache.ineigh,
+              dem->cache.nneigh * sizeof *dem->cache.ineigh, NULL)))
+        return false;
+
+      for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict)
+        if (!(msg_write(dem->pair[ict].cont.src,
+                npart * sizeof *dem->pair[ict].cont.src, NULL) &&
+              msg_write(&dem->pair[ict].cohesive,
+                sizeof dem->pair[ict].cohesive, NULL) &&
+              msg_write(&dem->pair[ict].norm,
+                sizeof dem->pair[ict].norm, NULL) &&
+              msg_write(&dem->pair[ict].tang,
+                sizeof dem->pair[ict].tang, NULL)))
+          return false;
+
+      return true;
+    case BMM_MSG_NUM_PARTS:
+      return msg_write(&dem->part.n, sizeof dem->part.n, NULL) &&
+        msg_write(&dem->part.lnew, sizeof dem->part.lnew, NULL) &&
+        msg_write(dem->part.l, npart * sizeof *dem->part.l, NULL) &&
+        msg_write(dem->part.role, npart * sizeof *dem->part.role, NULL) &&
+        msg_write(dem->part.r, npart * sizeof *dem->part.r, NULL) &&
+        msg_write(dem->part.m, npart * sizeof *dem->part.m, NULL) &&
+        msg_write(dem->part.jred, npart * sizeof *dem->part.jred, NULL) &&
+        msg_write(dem->part.x, npart * sizeof *dem->part.x, NULL) &&
+        msg_write(dem->part.v, npart * sizeof *dem->part.v, NULL) &&
+        msg_write(dem->part.a, npart * sizeof *dem->part.a, NULL) &&
+        msg_write(dem->part.phi, npart * sizeof *dem->part.phi, NULL) &&
+        msg_write(dem->part.omega, npart * sizeof *dem->part.omega, NULL) &&
+        msg_write(dem->part.alpha, npart * sizeof *dem->part.alpha, NULL) &&
+        msg_write(dem->part.f, npart * sizeof *dem->part.f, NULL) &&
+        msg_write(dem->part.tau, npart * sizeof *dem->part.tau, NULL);
+    case BMM_MSG_NUM_QPARTS:
+      {
+        // Particles may leave the bounding box along aperiodic dimensions,
+        // so those are quantized over the extent of the particles instead.
+        double xlim[BMM_NDIM][2];
+        for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+          xlim[idim][0] = 0.0;
+          xlim[idim][1] = dem->opts.box.x[idim];
+
+          if (!dem->opts.box.per[idim] && npart != 0) {
+            xlim[idim][0] = dem->part.x[0][idim];
+            xlim[idim][1] = dem->part.x[0][idim];
+            for (size_t ipart = 1; ipart < npart; ++ipart) {
+              xlim[idim][0] = fmin(xlim[idim][0], dem->part.x[ipart][idim]);
+              xlim[idim][1] = fmax(xlim[idim][1], dem->part.x[ipart][idim]);
+            }
+
+            if (!(xlim[idim][1] > xlim[idim][0]))
+              xlim[idim][1] = xlim[idim][0] + dem->opts.box.x[idim];
+          }
+        }
+
+        if (!(msg_write(&dem->part.n, sizeof dem->part.n, NULL) &&
+              msg_write(&dem->opts.comm.nbit,
+                sizeof dem->opts.comm.nbit, NULL) &&
+              msg_write(xlim, sizeof xlim, NULL) &&
+              msg_write(dem->part.role,
+                npart * sizeof *dem->part.role, NULL) &&
+              msg_write(dem->part.r, npart * sizeof *dem->part.r, NULL)))
+          return false;
+
+        for (size_t ipart = 0; ipart < npart; ++ipart)
+          for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+            if (!bmm_dem_comm_quant(dem->part.x[ipart][idim],
+                  xlim[idim][0], xlim[idim][1], dem->opts.comm.nbit))
+              return false;
+      }
+
+      for (size_t ipart = 0; ipart < npart; ++ipart)
+        if (!bmm_dem_comm_quant($(bmm_uwrap, double)(dem->part.phi[ipart], M_2PI),
+              0.0, M_2PI, 16))
+          return false;
+
+      return true;
+    case BMM_MSG_NUM_DPARTS:
+      if (!(msg_write(&dem->part.n, sizeof dem->part.n, NULL) &&
+            msg_write(dem->part.role, npart * sizeof *dem->part.role, NULL)))
+        return false;
+
+      for (size_t ipart = 0; ipart < npart; ++ipart) {
+        uint64_t buf[BMM_NDIM + 1];
+        for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+          buf[idim] = bmm_dem_comm_xor(dem->part.x[ipart][idim],
+              dem->comm.x[ipart][idim]);
+        buf[BMM_NDIM] = bmm_dem_comm_xor(dem->part.phi[ipart],
+            dem->comm.phi[ipart]);
+
+        if (!msg_write(buf, sizeof buf, NULL))
+          return false;
+      }
+
+      return true;
+    case BMM_MSG_NUM_DCONTS:
+      if (!msg_write(&dem->part.n, sizeof dem->part.n, NULL))
+        return false;
+
+      for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict) {
+        size_t nchange = 0;
+        for (size_t ipart = 0; ipart < npart; ++ipart)
+          if (bmm_dem_comm_changed(dem, ict, ipart))
+            ++nchange;
+
+        if (!msg_write(&nchange, sizeof nchange, NULL))
+          return false;
+
+        for (size_t ipart = 0; ipart < npart; ++ipart)
+          if (bmm_dem_comm_changed(dem, ict, ipart))
+            if (!(msg_write(&ipart, sizeof ipart, NULL) &&
+                  msg_write(&dem->pair[ict].cont.src[ipart].n,
+                    sizeof dem->pair[ict].cont.src[ipart].n, NULL) &&
+                  msg_write(dem->pair[ict].cont.src[ipart].itgt,
+                    dem->pair[ict].cont.src[ipart].n *
+                    sizeof *dem->pair[ict].cont.src[ipart].itgt, NULL)))
+              return false;
+      }
+
+      return true;
+    case BMM_MSG_NUM_EST:
+      return msg_write(&dem->est, sizeof dem->est, NULL);
+    case BMM_MSG_NUM_FIELD:
+      if (!(msg_write(dem->field.ncell, sizeof dem->field.ncell, NULL) &&
+            msg_write(&dem->field.nsample, sizeof dem->field.nsample, NULL)))
+        return false;
+
+      // The sums are turned into averages on the way out.
+      {
+        double const nsample =
+          (double) $(bmm_max, size_t)(1, dem->field.nsample);
+
+        size_t const ncell = $(bmm_prod, size_t)(dem->field.ncell, BMM_NDIM);
+        for (size_t icell = 0; icell < ncell; ++icell) {
+          struct bmm_dem_fcell cell = dem->field.cell[icell];
+
+          cell.rho /= nsample;
+
+          for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+            cell.p[idim] /= nsample;
+
+          for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+            for (size_t jdim = 0; jdim < BMM_NDIM; ++jdim)
+              cell.sigma[idim][jdim] /= nsample;
+
+          if (!msg_write(&cell, sizeof cell, NULL))
+            return false;
+        }
+      }
+
+      return true;
+    case BMM_MSG_NUM_PROF:
+      return msg_write(&dem->prof, sizeof dem->prof, NULL);
+    case BMM_MSG_NUM_FRAG:
+      return msg_write(&dem->frag.est, sizeof dem->frag.est, NULL);
+    case BMM_MSG_NUM_PERF:
+      return msg_write(&dem->perf.est, sizeof dem->perf.est, NULL);
+    case BMM_MSG_NUM_STATS:
+      return msg_write(&dem->stats.est, sizeof dem->stats.est, NULL);
+  }
+
+  dynamic_assert(false, "Unsupported message number");
+}
+
+/// The call `bmm_dem_prio(num)`
+/// returns the priority of messages with the number `num`.
+/// Progress reports have a high priority,
+/// so that they can overtake bulk data on the way out.
+__attribute__ ((__const__))
+static enum bmm_msg_prio bmm_dem_prio(enum bmm_msg_num const num) {
+  switch (num) {
+    case BMM_MSG_NUM_EST:
+    case BMM_MSG_NUM_PROF:
+    case BMM_MSG_NUM_PERF:
+    case BMM_MSG_NUM_STATS:
+    case BMM_MSG_NUM_CEST:
+      return BMM_MSG_PRIO_HIGH;
+    default:
+      return BMM_MSG_PRIO_LOW;
+  }
+}
+
+/// The call `bmm_dem_puts_(dem, num, prio)`
+/// works like `bmm_dem_puts(dem, num)`,
+/// but does not route the message by its priority `prio`.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_puts_(struct bmm_dem const *const dem,
+    enum bmm_msg_num const num, enum bmm_msg_prio const prio) {
+  // There is no need to know in advance how large the message is.
+  if (msglit != NULL) {
+    struct bmm_lit *const lit = msglit;
+
+    struct bmm_msg_spec spec;
+    bmm_msg_spec_def(&spec);
+    spec.prio = prio;
+    bmm_lit_spec(&spec);
+
+    if (!bmm_msg_spec_write(&spec, msg_write, NULL))
+      return false;
+
+    bmm_lit_begin(lit, &spec);
+
+    msgbody = lit;
+    bool const result = bmm_msg_num_write(&num, msg_write, NULL) &&
+      bmm_dem_puts_stuff(dem, num);
+    msgbody = NULL;
+
+    return result && bmm_lit_end(lit, msg_write, NULL);
+  }
+
+  size_t const size = bmm_dem_sniff_size(dem, num);
+
+  // Small messages would only grow
+  // and urgent ones are not worth the wait.
+  if (msgzip != NULL && size >= BMM_ZIP_MINSIZE &&
+      prio == BMM_MSG_PRIO_LOW) {
+    struct bmm_zip *const zip = msgzip;
+    bmm_zip_clear(zip);
+
+    msgzip = NULL;
+    msgraw = zip;
+    bool const result = bmm_dem_puts_stuff(dem, num);
+    msgraw = NULL;
+    msgzip = zip;
+
+    return result && bmm_zip_write(zip, num, (int) dem->opts.comm.zip,
+        dem->opts.comm.shuffle, msg_write, NULL);
+  }
+
+  struct bmm_msg_spec spec;
+  bmm_msg_spec_def(&spec);
+  spec.prio = prio;
+  spec.msg.size = size + BMM_MSG_NUMSIZE;
+
+  return bmm_msg_spec_write(&spec, msg_write, NULL) &&
+    bmm_msg_num_write(&num, msg_write, NULL) &&
+    bmm_dem_puts_stuff(dem, num);
+}
+
+bool bmm_dem_puts(struct bmm_dem const *const dem,
+    enum bmm_msg_num const num) {
+  enum bmm_msg_prio const prio = bmm_dem_prio(num);
+
+  double const t = bmm_sec_now();
+
+  msgprio = prio == BMM_MSG_PRIO_HIGH;
+  bool const result = bmm_dem_puts_(dem, num, prio);
+  msgprio = false;
+
+  char const *str;
+  if (msgtrace != NULL && bmm_msg_to_str(&str, num))
+    bmm_trace_span(msgtrace, 0, str, t);
+
+  return result;
+}
+
+/// The call `bmm_dem_ckpt_path(buf, size, dem, str)`
+/// writes into the buffer `buf` of length `size`
+/// the checkpoint path `str` of the simulation `dem`,
+/// tagged with its index if it is a member of an ensemble.
+__attribute__ ((__nonnull__))
+static void bmm_dem_ckpt_path(char *const buf, size_t const size,
+    struct bmm_dem const *const dem, char const *const str) {
+  if (dem->opts.ens.n == 1)
+    (void) snprintf(buf, size, "%s", str);
+  else
+    (void) snprintf(buf, size, "%s.%zu", str, dem->opts.ens.i);
+}
+
+/// The call `bmm_dem_ckpt_put(stream, ptr, size)`
+/// writes `size` bytes from `ptr` into the checkpoint `stream`.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_ckpt_put(FILE *const stream,
+    void const *const ptr, size_t const size) {
+  if (size != 0 && fwrite(ptr, size, 1, stream) != 1) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return true;
+}
+
+/// The call `bmm_dem_ckpt_get(stream, ptr, size)`
+/// reads `size` bytes into `ptr` from the checkpoint `stream`.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_ckpt_get(FILE *const stream,
+    void *const ptr, size_t const size) {
+  if (size != 0 && fread(ptr, size, 1, stream) != 1) {
+    if (ferror(stream))
+      BMM_TLE_STDS();
+    else
+      BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Checkpoint truncated");
+
+    return false;
+  }
+
+  return true;
+}
+
+/// The call `bmm_dem_ckpt_head(stream, save)`
+/// writes or checks the header of the checkpoint `stream`
+/// depending on whether `save` is set.
+/// The header makes sure the checkpoint was written
+/// with the same format, endianness and limits.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_ckpt_head(FILE *const stream, bool const save) {
+  // The version needs to be bumped whenever the body changes.
+  unsigned char const magic[] = {'B', 'M', 'M', 'C'};
+  uint32_t const head[] = {
+    5, (uint32_t) bmm_endy_get(),
+    sizeof (size_t), sizeof (double),
+    BMM_NDIM, BMM_NCT, BMM_MCONTACT, BMM_MLINK, BMM_MCELL
+  };
+
+  if (save)
+    return bmm_dem_ckpt_put(stream, magic, sizeof magic) &&
+      bmm_dem_ckpt_put(stream, head, sizeof head);
+
+  unsigned char buf[sizeof magic];
+  if (!bmm_dem_ckpt_get(stream, buf, sizeof buf))
+    return false;
+
+  if (memcmp(buf, magic, sizeof magic) != 0) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Not a checkpoint");
+
+    return false;
+  }
+
+  // The endianness is the second field,
+  // so the version can only be trusted once that matches.
+  uint32_t other[nmembof(head)];
+  if (!bmm_dem_ckpt_get(stream, other, sizeof other))
+    return false;
+
+  if (other[1] != head[1]) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Checkpoint endianness mismatch");
+
+    return false;
+  }
+
+  if (other[0] != head[0]) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Checkpoint version %" PRIu32
+        " unsupported", other[0]);
+
+    return false;
+  }
+
+  if (memcmp(other, head, sizeof head) != 0) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Checkpoint limits mismatch");
+
+    return false;
+  }
+
+  return true;
+}
+
+/// The call `bmm_dem_ckpt_body(dem, stream, save)`
+/// writes or reads the state of the simulation `dem`
+/// into or from the checkpoint `stream`
+/// depending on whether `save` is set.
+/// Only live particles and contacts are included,
+/// while caches are left to be rebuilt.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_ckpt_body(struct bmm_dem *const dem,
+    FILE *const stream, bool const save) {
+#define XFER(ptr, size) \
+  begin \
+    if (!(save ? bmm_dem_ckpt_put(stream, (ptr), (size)) : \
+          bmm_dem_ckpt_get(stream, (ptr), (size)))) \
+      return false; \
+  end
+
+  size_t npart = dem->part.n;
+  XFER(&npart, sizeof npart);
+
+  if (!save && !bmm_dem_reserve(dem, npart))
+    return false;
+
+  dem->part.n = npart;
+
+  if (!save)
+    for (size_t ipart = 0; ipart < npart; ++ipart)
+      dem->batch.rem[ipart] = false;
+
+  enum bmm_dem_integ integ = dem->integ.tag;
+  XFER(&integ, sizeof integ);
+
+  if (integ != dem->integ.tag) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Checkpoint integrator mismatch");
+
+    return false;
+  }
+
+  XFER(&dem->ext, sizeof dem->ext);
+  XFER(&dem->amb, sizeof dem->amb);
+
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict) {
+    XFER(&dem->pair[ict].cohesive, sizeof dem->pair[ict].cohesive);
+    XFER(&dem->pair[ict].norm, sizeof dem->pair[ict].norm);
+    XFER(&dem->pair[ict].tang, sizeof dem->pair[ict].tang);
+  }
+
+  XFER(&dem->bond, sizeof dem->bond);
+  XFER(&dem->yield, sizeof dem->yield);
+  XFER(&dem->time, sizeof dem->time);
+  XFER(&dem->le, sizeof dem->le);
+  XFER(&dem->wall, sizeof dem->wall);
+  XFER(&dem->script, sizeof dem->script);
+  XFER(&dem->comm.tprev, sizeof dem->comm.tprev);
+
+  // This keeps checkpoints without adaptive output as they were.
+  if (dem->opts.comm.cadence.on) {
+    XFER(&dem->comm.dt, sizeof dem->comm.dt);
+    XFER(&dem->comm.cadence, sizeof dem->comm.cadence);
+  }
+
+  XFER(&dem->est, sizeof dem->est);
+  XFER(&dem->field.tprev, sizeof dem->field.tprev);
+  XFER(&dem->field.nsample, sizeof dem->field.nsample);
+  XFER(dem->field.ncell, sizeof dem->field.ncell);
+  XFER(dem->field.cell, $(bmm_prod, size_t)(dem->field.ncell, BMM_NDIM) *
+      sizeof *dem->field.cell);
+  XFER(&dem->part.lnew, sizeof dem->part.lnew);
+
+#define COLUMN(x) XFER((x), npart * sizeof *(x))
+
+  COLUMN(dem->part.l);
+  COLUMN(dem->part.role);
+
+  if (!save) {
+    for (size_t irole = 0; irole < nmembof(dem->part.nrole); ++irole)
+      dem->part.nrole[irole] = 0;
+
+    for (size_t ipart = 0; ipart < npart; ++ipart)
+      ++dem->part.nrole[dem->part.role[ipart]];
+  }
+  COLUMN(dem->part.r);
+  COLUMN(dem->part.m);
+  COLUMN(dem->part.jred);
+  COLUMN(dem->part.x);
+  COLUMN(dem->part.v);
+  COLUMN(dem->part.a);
+  COLUMN(dem->part.phi);
+  COLUMN(dem->part.omega);
+  COLUMN(dem->part.alpha);
+  COLUMN(dem->part.f);
+  COLUMN(dem->part.tau);
+  COLUMN(dem->sleep.asleep);
+  COLUMN(dem->sleep.poke);
+  COLUMN(dem->sleep.nquiet);
+  COLUMN(dem->sleep.fref);
+  COLUMN(dem->clump.ibody);
+  COLUMN(dem->clump.d);
+  COLUMN(dem->clump.dphi);
+  COLUMN(dem->clump.nlink);
+
+  XFER(&dem->clump.n, sizeof dem->clump.n);
+
+  if (dem->clump.n > npart) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Checkpoint has too many clumps");
+
+    return false;
+  }
+
+  XFER(dem->clump.body, dem->clump.n * sizeof *dem->clump.body);
+
+  switch (dem->integ.tag) {
+    case BMM_DEM_INTEG_VELVET:
+      COLUMN(dem->integ.params.velvet.ao);
+      COLUMN(dem->integ.params.velvet.alphao);
+
+      break;
+    case BMM_DEM_INTEG_BEEMAN:
+    case BMM_DEM_INTEG_KURAEV:
+      COLUMN(dem->integ.params.beeman.ao);
+      COLUMN(dem->integ.params.beeman.aoo);
+      COLUMN(dem->integ.params.beeman.alphao);
+      COLUMN(dem->integ.params.beeman.alphaoo);
+
+      break;
+    case BMM_DEM_INTEG_RESPA:
+      COLUMN(dem->integ.params.respa.f);
+      COLUMN(dem->integ.params.respa.tau);
+
+      break;
+  }
+
+#undef COLUMN
+
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict)
+    for (size_t ipart = 0; ipart < npart; ++ipart) {
+      struct bmm_dem_pair *const pair = &dem->pair[ict];
+
+      size_t ncont = pair->cont.src[ipart].n;
+      XFER(&ncont, sizeof ncont);
+
+      if (ncont > BMM_MCONTACT) {
+        BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Checkpoint corrupted");
+
+        return false;
+      }
+
+      pair->cont.src[ipart].n = ncont;
+
+      XFER(&pair->cont.src[ipart].sig, sizeof pair->cont.src[ipart].sig);
+      XFER(pair->cont.src[ipart].itgt,
+          ncont * sizeof *pair->cont.src[ipart].itgt);
+      XFER(pair->cont.src[ipart].drest,
+          ncont * sizeof *pair->cont.src[ipart].drest);
+      XFER(pair->cont.src[ipart].psirest,
+          $(bmm_min, size_t)(ncont, BMM_MLINK) *
+          sizeof *pair->cont.src[ipart].psirest);
+      XFER(pair->cont.src[ipart].strength,
+          ncont * sizeof *pair->cont.src[ipart].strength);
+      XFER(pair->cont.src[ipart].tfat,
+          ncont * sizeof *pair->cont.src[ipart].tfat);
+    }
+
+  // Counters come from labels and steps, so the key is the whole state.
+  XFER(&dem->seed, sizeof dem->seed);
+
+#undef XFER
+
+  // Fragments are cheaper to find again than to store.
+  if (!save)
+    dem->frag.stale = true;
+
+  return true;
+}
+
+bool bmm_dem_save(struct bmm_dem const *const dem, char const *const path) {
+  char buf[BUFSIZ];
+  if ((size_t) snprintf(buf, sizeof buf, "%s.tmp", path) >= sizeof buf) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Checkpoint path too long");
+
+    return false;
+  }
+
+  FILE *const stream = fopen(buf, "wb");
+  if (stream == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  // Nothing is written through this,
+  // but reading and writing share the same walk over the state.
+  struct bmm_dem *const mdem = (struct bmm_dem *) dem;
+
+  if (!bmm_dem_ckpt_head(stream, true) ||
+      !bmm_dem_ckpt_body(mdem, stream, true)) {
+    (void) fclose(stream);
+    (void) remove(buf);
+
+    return false;
+  }
+
+  // The old checkpoint is only replaced once the new one is on disk,
+  // so an interruption at any point leaves one intact.
+  if (fflush(stream) == EOF || fsync(fileno(stream)) == -1) {
+    BMM_TLE_STDS();
+
+    (void) fclose(stream);
+    (void) remove(buf);
+
+    return false;
+  }
+
+  if (fclose(stream) == EOF) {
+    BMM_TLE_STDS();
+
+    (void) remove(buf);
+
+    return false;
+  }
+
+  if (rename(buf, path) == -1) {
+    BMM_TLE_STDS();
+
+    (void) remove(buf);
+
+    return false;
+  }
+
+  return true;
+}
+
+/// The call `bmm_dem_ckpt_read(dem, stream)`
+/// reads the state of the simulation `dem`
+/// from the whole checkpoint `stream`.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_ckpt_read(struct bmm_dem *const dem, FILE *const stream) {
+  if (!bmm_dem_ckpt_head(stream, false) ||
+      !bmm_dem_ckpt_body(dem, stream, false))
+    return false;
+
+  // Caches are derived from the state and
+  // the next frame needs to stand on its own.
+  dem->cache.stale = true;
+  dem->cache.parted = false;
+  dem->comm.ikey = 0;
+  dem->ckpt.tprev = dem->time.t;
+
+  return true;
+}
+
+bool bmm_dem_load(struct bmm_dem *const dem, char const *const path) {
+  FILE *const stream = fopen(path, "rb");
+  if (stream == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  if (!bmm_dem_ckpt_read(dem, stream)) {
+    (void) fclose(stream);
+
+    return false;
+  }
+
+  if (fclose(stream) == EOF) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return true;
+}
+
+/// The call `bmm_dem_snap(pbuf, psize, dem)`
+/// saves the simulation `dem` as a checkpoint
+/// into a new buffer of size `*psize` that is stored in `pbuf`.
+/// If the operation is successful,
+/// the buffer must be freed by the caller.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_snap(char **const pbuf, size_t *const psize,
+    struct bmm_dem const *const dem) {
+  FILE *const stream = open_memstream(pbuf, psize);
+  if (stream == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  // See `bmm_dem_save`.
+  struct bmm_dem *const mdem = (struct bmm_dem *) dem;
+
+  bool const result = bmm_dem_ckpt_head(stream, true) &&
+    bmm_dem_ckpt_body(mdem, stream, true);
+
+  // The buffer only becomes valid once the stream is closed.
+  if (fclose(stream) == EOF) {
+    BMM_TLE_STDS();
+
+    free(*pbuf);
+
+    return false;
+  }
+
+  if (!result) {
+    free(*pbuf);
+
+    return false;
+  }
+
+  return true;
+}
+
+bool bmm_dem_cache_expired(struct bmm_dem const *const dem) {
+  // Pairs across the y-axis boundary also drift apart
+  // as the periodic images slide past each other.
+  double const dle = bmm_dem_le(dem) ?
+    $(bmm_abs, double)($(bmm_swrap, double)(dem->le.x - dem->cache.xle,
+          dem->opts.box.x[0])) : 0.0;
+
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
+    double const d = bmm_dem_cache_allowance(dem, ipart) - dle;
+
+    if (d <= 0.0 ||
+        bmm_dem_pdist2(dem, dem->part.x[ipart], dem->cache.x[ipart]) >=
+        $(bmm_power, double)(d, 2))
+      return true;
+  }
+
+  return false;
+}
+
+/// The call `bmm_dem_adapt(dem)`
+/// returns the longest time step the simulation `dem` can take
+/// without resolving the oscillations of its stiffest contact or
+/// the escape of its fastest particle from the neighbor cache too coarsely.
+__attribute__ ((__nonnull__, __pure__))
+static double bmm_dem_adapt(struct bmm_dem const *const dem) {
+  double dt = INFINITY;
+
+  // Each contact is treated as a harmonic oscillator
+  // with the reduced mass of the pair.
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict)
+    for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+      for (size_t icont = 0; icont < dem->pair[ict].cont.src[ipart].n; ++icont) {
+        size_t const jpart = dem->pair[ict].cont.src[ipart].itgt[icont];
+
+        // Contacts inside clumps do not oscillate.
+        if (bmm_dem_rigid(dem, ipart, jpart))
+          continue;
+
+        double k = 0.0;
+
+        switch (dem->pair[ict].norm.tag) {
+          case BMM_DEM_NORM_KV:
+            k = dem->pair[ict].norm.params.dashpot.k;
+
+            break;
+          case BMM_DEM_NORM_BSHP:
+            {
+              double const ri = dem->part.r[ipart];
+              double const rj = dem->part.r[jpart];
+              double const xi = ri + rj -
+                sqrt(bmm_dem_pdist2(dem, dem->part.x[ipart], dem->part.x[jpart]));
+
+              // This is the derivative of the elastic part of the force.
+              if (xi > 0.0)
+                k = (3.0 / 2.0) * dem->est.bshpp *
+                  bmm_dem_sqrt(dem, $(bmm_resum2, double)(ri, rj) * xi);
+            }
+
+            break;
+        }
+
+        switch (dem->pair[ict].tang.tag) {
+          case BMM_DEM_TANG_CS:
+            k = fmax(k, dem->pair[ict].tang.params.cs.k);
+
+            break;
+          case BMM_DEM_TANG_BEAM:
+            k = fmax(k, dem->pair[ict].tang.params.beam.k);
+
+            break;
+        }
+
+        // Substeps only need to resolve strong contacts one at a time.
+        double const q = ict == BMM_DEM_CT_STRONG && bmm_dem_substep(dem) ?
+          (double) dem->opts.time.nsub : 1.0;
+
+        if (k > 0.0)
+          dt = fmin(dt, q * sqrt($(bmm_resum2, double)(dem->part.m[ipart],
+                  dem->part.m[jpart]) / k));
+      }
+
+  // Weak contacts that have not formed yet may still form
+  // between the lightest particles before the next time step.
+  if (dem->pair[BMM_DEM_CT_WEAK].norm.tag == BMM_DEM_NORM_KV &&
+      dem->pair[BMM_DEM_CT_WEAK].norm.params.dashpot.k > 0.0) {
+    double m = INFINITY;
+    for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+      m = fmin(m, dem->part.m[ipart]);
+
+    dt = fmin(dt, sqrt((m / 2.0) / dem->pair[BMM_DEM_CT_WEAK].norm.params.dashpot.k));
+  }
+
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
+    double const v = bmm_geom2d_norm(dem->part.v[ipart]);
+    double const d = bmm_dem_cache_allowance(dem, ipart);
+
+    if (v > 0.0 && d > 0.0)
+      dt = fmin(dt, d / v);
+  }
+
+  return dem->opts.time.cadapt * dt;
+}
+
+__attribute__ ((__nonnull__))
+static void bmm_dem_script_balance(struct bmm_dem *const dem) {
+  double xcenter[BMM_NDIM];
+  bmm_dem_est_center(xcenter, dem);
+
+  double xcom[BMM_NDIM];
+  bmm_dem_est_com(xcom, dem);
+
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+      dem->part.x[ipart][idim] += xcenter[idim] - xcom[idim];
+
+      if (dem->opts.box.per[idim])
+        dem->part.x[ipart][idim] = $(bmm_uwrap, double)(dem->part.x[ipart][idim],
+            dem->opts.box.x[idim]);
+    }
+}
+
+__attribute__ ((__nonnull__))
+static bool bmm_dem_script_set_density(struct bmm_dem *const dem) {
+  double const vhc = $(bmm_prod, double)(dem->opts.box.x, BMM_NDIM);
+
+  double v = 0.0;
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    v += bmm_geom_ballvol(dem->part.r[ipart], BMM_NDIM);
+
+  dem->est.chi = v / vhc;
+
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
+    double const rho = dem->opts.part.rho / dem->est.chi;
+
+    dem->part.m[ipart] = rho * bmm_geom_ballvol(dem->part.r[ipart], 3);
+  }
+
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    bmm_dem_cache_j(dem, ipart);
+
+  return true;
+}
+
+__attribute__ ((__nonnull__))
+static bool bmm_dem_script_create_hc(struct bmm_dem *const dem) {
+  double const etahc = bmm_geom_ballvol(0.5, BMM_NDIM);
+  double const vhc = $(bmm_prod, double)(dem->opts.box.x, BMM_NDIM);
+  double const eta = dem->opts.script.params[dem->script.i].create.eta;
+  double const v = vhc * (etahc / eta);
+
+  double const vlim = vhc * eta;
+  // TODO Overlap factor.
+  // double const rspace = bmm_ival_midpoint(dem->opts.part.rnew);
+  double const rspace = dem->opts.part.rnew[1];
+
+  double x[BMM_NDIM];
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    x[idim] = 0.0;
+
+  double vnow = 0.0;
+
+  for ever {
+    double const r = bmm_dem_random(dem, BMM_DEM_STREAM_RADIUS,
+        dem->part.lnew, 0, dem->opts.part.rnew);
+    double const v = bmm_geom_ballvol(r, BMM_NDIM);
+
+    double const vnext = vnow + v;
+
+    if (vnext <= vlim) {
+      size_t ipart = bmm_dem_addpart(dem);
+      if (ipart == SIZE_MAX)
+        return false;
+
+      dem->part.r[ipart] = r;
+      dem->part.m[ipart] = dem->opts.part.rho * bmm_geom_ballvol(r, 3);
+
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+        dem->part.x[ipart][idim] = x[idim] + rspace;
+
+      x[0] += 2.0 * rspace;
+
+      if (x[0] + 2.0 * rspace >= dem->opts.box.x[0]) {
+        x[0] = 0.0;
+        x[1] += 2.0 * rspace;
+      }
+
+      vnow = vnext;
+    } else
+      break;
+  }
+
+  return true;
+}
+
+__attribute__ ((__nonnull__))
+static bool bmm_dem_script_create_hex(struct bmm_dem *const dem) {
+  double const etahc = bmm_geom_ballvol(0.5, BMM_NDIM);
+  double const vhc = $(bmm_prod, double)(dem->opts.box.x, BMM_NDIM);
+  double const eta = dem->opts.script.params[dem->script.i].create.eta;
+  double const v = vhc * (etahc / eta);
+
+  double const vlim = vhc * eta;
+  // double const rspace = bmm_ival_midpoint(dem->opts.part.rnew);
+  double const rspace = dem->opts.part.rnew[1];
+  double const dspace = (sqrt(3.0) / 2.0) * rspace;
+
+  double x[BMM_NDIM];
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    x[idim] = 0.0;
+
+  double vnow = 0.0;
+  bool parity = false;
+
+  for ever {
+    double const r = bmm_dem_random(dem, BMM_DEM_STREAM_RADIUS,
+        dem->part.lnew, 0, dem->opts.part.rnew);
+    double const v = bmm_geom_ballvol(r, BMM_NDIM);
+
+    double const vnext = vnow + v;
+
+    if (vnext <= vlim) {
+      size_t ipart = bmm_dem_addpart(dem);
+      if (ipart == SIZE_MAX)
+        return false;
+
+      dem->part.r[ipart] = r;
+      dem->part.m[ipart] = dem->opts.part.rho * bmm_geom_ballvol(r, 3);
+
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+        dem->part.x[ipart][idim] = x[idim] + rspace;
+
+      x[0] += 2.0 * rspace;
+
+      if (x[0] + 2.0 * rspace >= dem->opts.box.x[0]) {
+        x[0] = parity ? 0.0 : rspace;
+        x[1] += 2.0 * dspace;
+        parity = !parity;
+      }
+
+      vnow = vnext;
+    } else
+      break;
+  }
+
+  return true;
+}
+
+// TODO Remove or polish this test diamond.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_script_create_testpile(struct bmm_dem *const dem) {
+  double const etahc = bmm_geom_ballvol(0.5, BMM_NDIM);
+  double const vhc = $(bmm_prod, double)(dem->opts.box.x, BMM_NDIM);
+  double const eta = dem->opts.script.params[dem->script.i].test.eta;
+  double const v = vhc * (etahc / eta);
+
+  double const vlim = vhc * eta;
+  // double const rspace = bmm_ival_midpoint(dem->opts.part.rnew);
+  double const rspace = dem->opts.part.rnew[1];
+  double const dspace = (sqrt(3.0) / 2.0) * rspace;
+
+  double x[BMM_NDIM];
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    x[idim] = 0.0;
+
+  double vnow = 0.0;
+  bool parity = false;
+
+  for ever {
+    double const r = bmm_dem_random(dem, BMM_DEM_STREAM_RADIUS,
+        dem->part.lnew, 0, dem->opts.part.rnew);
+    double const v = bmm_geom_ballvol(r, BMM_NDIM);
+
+    double const vnext = vnow + v;
+
+    if (vnext <= vlim) {
+      size_t ipart = bmm_dem_addpart(dem);
+      if (ipart == SIZE_MAX)
+        return false;
+
+      dem->part.r[ipart] = r;
+      dem->part.m[ipart] = dem->opts.part.rho * bmm_geom_ballvol(r, 3);
+
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+        dem->part.x[ipart][idim] = x[idim] + rspace;
+
+      x[0] += 2.0 * rspace;
+
+      if (x[0] + 2.0 * rspace >= dem->opts.box.x[0] + 2.0 * rspace) {
+        x[0] = parity ? 0.0 : rspace;
+        x[1] += 2.0 * dspace;
+        parity = !parity;
+      }
+
+      if (fabs(dem->part.x[ipart][0] - dem->opts.box.x[0] / 2.0) +
+          fabs(dem->part.x[ipart][1] - dem->opts.box.x[1] / 2.0) >
+          dem->opts.box.x[0] / 1.9 ||
+          dem->part.x[ipart][1] < dem->opts.box.x[1] / 2.0 - rspace)
+        bmm_dem_rempart(dem, ipart);
+
+      if (fabs(dem->part.x[ipart][1] - dem->opts.box.x[1] / 2.0) < rspace)
+        bmm_dem_setrole(dem, ipart, BMM_DEM_ROLE_FIXED);
+
+      vnow = vnext;
+    } else
+      break;
+  }
+
+  return true;
+}
+
+__attribute__ ((__nonnull__))
+static bool bmm_dem_script_create_testblock(struct bmm_dem *const dem) {
+  double const etahc = bmm_geom_ballvol(0.5, BMM_NDIM);
+  double const vhc = $(bmm_prod, double)(dem->opts.box.x, BMM_NDIM);
+  double const eta = dem->opts.script.params[dem->script.i].test.eta;
+  double const v = vhc * (etahc / eta);
+
+  double const vlim = vhc * eta;
+  // double const rspace = bmm_ival_midpoint(dem->opts.part.rnew);
+  double const rspace = dem->opts.part.rnew[1];
+  double const dspace = rspace;
+
+  double x[BMM_NDIM];
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    x[idim] = 0.0;
+
+  double vnow = 0.0;
+  bool parity = false;
+
+  for ever {
+    double const r = bmm_dem_random(dem, BMM_DEM_STREAM_RADIUS,
+        dem->part.lnew, 0, dem->opts.part.rnew);
+    double const v = bmm_geom_ballvol(r, BMM_NDIM);
+
+    double const vnext = vnow + v;
+
+    if (vnext <= vlim) {
+      size_t ipart = bmm_dem_addpart(dem);
+      if (ipart == SIZE_MAX)
+        return false;
+
+      dem->part.r[ipart] = r;
+      dem->part.m[ipart] = dem->opts.part.rho * bmm_geom_ballvol(r, 3);
+
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+        dem->part.x[ipart][idim] = x[idim] + rspace;
+
+      x[0] += 2.0 * rspace;
+
+      if (x[0] + 2.0 * rspace >= dem->opts.box.x[0] + 2.0 * rspace) {
+        x[0] = 0.0;
+        x[1] += 2.0 * dspace;
+        parity = !parity;
+      }
+
+      if (fabs(dem->part.x[ipart][0] - dem->opts.box.x[0] / 2.0) +
+          fabs(dem->part.x[ipart][1] - dem->opts.box.x[1] / 2.0) >
+          dem->opts.box.x[0] / 1.9 ||
+          dem->part.x[ipart][1] < dem->opts.box.x[1] / 2.0 - rspace)
+        bmm_dem_rempart(dem, ipart);
+
+      if (fabs(dem->part.x[ipart][1] - dem->opts.box.x[1] / 2.0) < rspace)
+        bmm_dem_setrole(dem, ipart, BMM_DEM_ROLE_FIXED);
+
+      vnow = vnext;
+    } else
+      break;
+  }
+
+  return true;
+}
+
+__attribute__ ((__nonnull__))
+static bool bmm_dem_script_create_testplane(struct bmm_dem *const dem) {
+  double const vhc = $(bmm_prod, double)(dem->opts.box.x, BMM_NDIM);
+  double const v = vhc;
+
+  double const vlim = vhc;
+  double const rspace = bmm_ival_midpoint(dem->opts.part.rnew);
+  // double const rspace = dem->opts.part.rnew[1];
+  double const dspace = (sqrt(3.0) / 2.0) * rspace;
+
+  double x[BMM_NDIM];
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    x[idim] = 0.0;
+
+  double vnow = 0.0;
+  bool parity = false;
+
+  for ever {
+    double const r = bmm_dem_random(dem, BMM_DEM_STREAM_RADIUS,
+        dem->part.lnew, 0, dem->opts.part.rnew);
+    double const v = bmm_geom_ballvol(r, BMM_NDIM);
+
+    double const vnext = vnow + v;
+
+    if (vnext <= vlim) {
+      size_t ipart = bmm_dem_addpart(dem);
+      if (ipart == SIZE_MAX)
+        return false;
+
+      bmm_dem_setrole(dem, ipart, BMM_DEM_ROLE_FIXED);
+
+      dem->part.r[ipart] = r;
+      dem->part.m[ipart] = dem->opts.part.rho * bmm_geom_ballvol(r, 3);
+
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+        dem->part.x[ipart][idim] = x[idim] + rspace;
+
+      x[0] += 2.0 * rspace / 4.0;
+
+      if (x[0] + 2.0 * rspace >= dem->opts.box.x[0] + 2.0 * rspace) {
+        break;
+      }
+
+      vnow = vnext;
+    } else
+      break;
+  }
+
+  return true;
+}
+
+// TODO Remove or polish this test beam.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_script_create_testbeam(struct bmm_dem *const dem) {
+  double const etahc = bmm_geom_ballvol(0.5, BMM_NDIM);
+  double const vhc = $(bmm_prod, double)(dem->opts.box.x, BMM_NDIM);
+  double const eta = dem->opts.script.params[dem->script.i].test.eta;
+  double const v = vhc * (etahc / eta);
+
+  double const vlim = vhc * eta;
+  // double const rspace = bmm_ival_midpoint(dem->opts.part.rnew);
+  double const rspace = dem->opts.part.rnew[1];
+  double const dspace = (sqrt(3.0) / 2.0) * rspace;
+
+  double x[BMM_NDIM];
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    x[idim] = 0.0;
+
+  double vnow = 0.0;
+  bool parity = false;
+
+  for ever {
+    double const r = bmm_dem_random(dem, BMM_DEM_STREAM_RADIUS,
+        dem->part.lnew, 0, dem->opts.part.rnew);
+    double const v = bmm_geom_ballvol(r, BMM_NDIM);
+
+    double const vnext = vnow + v;
+
+    if (vnext <= vlim) {
+      size_t ipart = bmm_dem_addpart(dem);
+      if (ipart == SIZE_MAX)
+        return false;
+
+      dem->part.r[ipart] = r;
+      dem->part.m[ipart] = dem->opts.part.rho * bmm_geom_ballvol(r, 3);
+
+      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+        dem->part.x[ipart][idim] = x[idim] + rspace;
+
+      x[0] += 2.0 * rspace;
+
+      if (x[0] + 2.0 * rspace >= dem->opts.box.x[0]) {
+        x[0] = parity ? 0.0 : rspace;
+        x[1] += 2.0 * dspace;
+        parity = !parity;
+      }
+
+      if (dem->part.x[ipart][1] > dem->opts.script.params[dem->script.i].test.layers * rspace ||
+          dem->part.x[ipart][0] + 4.0 * rspace > dem->opts.script.params[dem->script.i].test.slices * rspace)
+        bmm_dem_rempart(dem, ipart);
+
+      if (dem->part.x[ipart][0] > dem->opts.box.x[0] - 4.0 * rspace)
+        bmm_dem_rempart(dem, ipart);
+
+      if (dem->part.x[ipart][0] < 4.0 * rspace)
+        bmm_dem_setrole(dem, ipart, BMM_DEM_ROLE_FIXED);
+      // This one is funny.
+      // else dem->part.v[ipart][0] = 1.0e+2;
+
+      vnow = vnext;
+    } else
+      break;
+  }
+
+  for (size_t i = 0; i < 14; ++i) {
+    size_t ipart = bmm_dem_addpart(dem);
+    if (ipart == SIZE_MAX)
+      return false;
+
+    size_t const l = dem->part.l[ipart];
+
+    double const r = bmm_dem_random(dem, BMM_DEM_STREAM_RADIUS,
+        l, 0, dem->opts.part.rnew);
+    double const v = bmm_geom_ballvol(r, BMM_NDIM);
+
+    dem->part.r[ipart] = r;
+    dem->part.m[ipart] = dem->opts.part.rho * bmm_geom_ballvol(r, 3);
+
+    double a[2];
+    a[0] = 0.0;
+    a[1] = dem->opts.box.x[0];
+    dem->part.x[ipart][0] = bmm_dem_random(dem, BMM_DEM_STREAM_POS,
+        l, 0, a);
+    a[0] = 0.0;
+    a[1] = sqrt(2.0 * dem->opts.box.x[1]);
+    dem->part.x[ipart][1] =
+      bmm_dem_random(dem, BMM_DEM_STREAM_POS, l, 1, a) *
+      bmm_dem_random(dem, BMM_DEM_STREAM_POS, l, 2, a) -
+      $(bmm_power, double)(bmm_ival_length(a), 2);
+
+    bmm_dem_setrole(dem, ipart, BMM_DEM_ROLE_FIXED);
+  }
+
+  return true;
+}
+
+__attribute__ ((__nonnull__))
+static void bmm_dem_script_perturb(struct bmm_dem *const dem) {
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      dem->part.x[ipart][idim] += bmm_dem_random(dem, BMM_DEM_STREAM_PERTURB,
+          dem->part.l[ipart], idim, dem->opts.part.rnew) / 2.0;
+}
+
+/// This structure holds the sort key and volume of a candidate
+/// accepted during the final attempt of `bmm_dem_script_create_pack`.
+struct bmm_dem_pack {
+  double u;
+  double v;
+};
+
+__attribute__ ((__nonnull__, __pure__))
+static int bmm_dem_pack_cmp(void const *const x, void const *const y) {
+  double const u = ((struct bmm_dem_pack const *) x)->u;
+  double const w = ((struct bmm_dem_pack const *) y)->u;
+
+  return u < w ? -1 : u > w ? 1 : 0;
+}
+
+/// The call `bmm_dem_script_create_pack(dem)`
+/// fills the bounding box of the simulation `dem`
+/// by random sequential addition,
+/// until either the target packing fraction is reached or
+/// every neighbor cell has had its share of attempts.
+/// The cells are at least as wide as the largest particle,
+/// so cells of the same parity along every axis
+/// can try their candidates in parallel without conflicts.
+/// Each candidate only depends on its cell and attempt,
+/// so the packing does not depend on the number of threads.
+/// The candidates of the final attempt are accepted in random order
+/// until the target is met and
+/// the particles are then inserted in one batch.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_script_create_pack(struct bmm_dem *const dem) {
+  double const eta = dem->opts.script.params[dem->script.i].pack.eta;
+  size_t const ntry = dem->opts.script.params[dem->script.i].pack.ntry;
+  double const *const rnew = dem->opts.part.rnew;
+
+  if (!(rnew[0] > 0.0)) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Unsupported radius range");
+
+    return false;
+  }
+
+  // Periodic axes need an even number of cells to keep the parity.
+  size_t ncell[BMM_NDIM];
+  double wcell[BMM_NDIM];
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+    bool const per = dem->opts.box.per[idim];
+
+    size_t const n = (size_t) (dem->opts.box.x[idim] / (2.0 * rnew[1]));
+    ncell[idim] = per ? n - n % 2 : n;
+    if (ncell[idim] < (per ? 2 : 1)) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Bounding box too small");
+
+      return false;
+    }
+
+    wcell[idim] = dem->opts.box.x[idim] / (double) ncell[idim];
+  }
+
+  size_t const ncellt = $(bmm_prod, size_t)(ncell, BMM_NDIM);
+
+  // Centers that are two minimum radii apart
+  // fit at most once in each square with that diagonal.
+  size_t mgroup = 1;
+  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+    mgroup *= (size_t) ceil(wcell[idim] * M_SQRT2 / (2.0 * rnew[0])) + 1;
+
+  size_t *const n = malloc(ncellt * sizeof *n);
+  double *const u = malloc(ncellt * sizeof *u);
+  double *const v = malloc(ncellt * sizeof *v);
+  double *const r = malloc(ncellt * mgroup * sizeof *r);
+  double (*const x)[BMM_NDIM] = malloc(ncellt * mgroup * sizeof *x);
+  struct bmm_dem_pack *const last = malloc(ncellt * sizeof *last);
+  if (n == NULL || u == NULL || v == NULL ||
+      r == NULL || x == NULL || last == NULL) {
+    BMM_TLE_STDS();
+
+    free(last);
+    free(x);
+    free(r);
+    free(v);
+    free(u);
+    free(n);
+
+    return false;
+  }
+
+  for (size_t icell = 0; icell < ncellt; ++icell) {
+    n[icell] = 0;
+    v[icell] = 0.0;
+  }
+
+  double const vtgt = eta * $(bmm_prod, double)(dem->opts.box.x, BMM_NDIM);
+  double vnow = 0.0;
+
+  size_t const ncolor = (size_t) 1 << BMM_NDIM;
+  size_t const nneigh = BMM_NEIGH_NMAX(BMM_NDIM);
+  size_t const nside[] = {3, 3};
+  static_assert(nmembof(nside) == BMM_NDIM, "Wrong number of sides");
+
+  for (size_t itry = 0; itry < ntry && vnow < vtgt; ++itry) {
+    // Negative keys mark cells that did not accept anything this time.
+    for (size_t icell = 0; icell < ncellt; ++icell)
+      u[icell] = -1.0;
+
+    for (size_t icolor = 0; icolor < ncolor; ++icolor) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) \
+  num_threads((int) dem->opts.thread.n)
+#endif
+      for (size_t icell = 0; icell < ncellt; ++icell) {
+        size_t ijcell[BMM_NDIM];
+        $(bmm_hcd, size_t)(ijcell, icell, BMM_NDIM, ncell);
+
+        size_t jcolor = 0;
+        for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+          jcolor |= (ijcell[idim] % 2) << idim;
+
+        if (jcolor != icolor || n[icell] == mgroup)
+          continue;
+
+        size_t const m = itry * (BMM_NDIM + 2);
+
+        double const rnow = bmm_dem_random(dem, BMM_DEM_STREAM_PACK,
+            icell, m, rnew);
+
+        double xnow[BMM_NDIM];
+        bool accept = true;
+        for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+          double const a[] = {
+            (double) ijcell[idim] * wcell[idim],
+            (double) (ijcell[idim] + 1) * wcell[idim]
+          };
+          xnow[idim] = bmm_dem_random(dem, BMM_DEM_STREAM_PACK,
+              icell, m + 2 + idim, a);
+
+          if (!dem->opts.box.per[idim] &&
+              (xnow[idim] < rnow || xnow[idim] > dem->opts.box.x[idim] - rnow))
+            accept = false;
+        }
+
+        for (size_t ineigh = 0; accept && ineigh < nneigh; ++ineigh) {
+          size_t ijoff[BMM_NDIM];
+          $(bmm_hcd, size_t)(ijoff, ineigh, BMM_NDIM, nside);
+
+          size_t ijneigh[BMM_NDIM];
+          bool inside = true;
+          for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+            size_t const ij = ijcell[idim] + ijoff[idim];
+
+            if (dem->opts.box.per[idim])
+              ijneigh[idim] = $(bmm_dec, size_t)(ij, 0, ncell[idim]);
+            else if (ij >= 1 && ij <= ncell[idim])
+              ijneigh[idim] = ij - 1;
+            else
+              inside = false;
+          }
+
+          if (!inside)
+            continue;
+
+          size_t const jcell = $(bmm_unhcd, size_t)(ijneigh, BMM_NDIM, ncell);
+
+          for (size_t igroup = 0; igroup < n[jcell]; ++igroup) {
+            size_t const i = jcell * mgroup + igroup;
+
+            if (bmm_dem_pdist2(dem, xnow, x[i]) <
+                $(bmm_power, double)(rnow + r[i], 2)) {
+              accept = false;
+
+              break;
+            }
+          }
+        }
+
+        if (accept) {
+          size_t const i = icell * mgroup + n[icell];
+
+          r[i] = rnow;
+          for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+            x[i][idim] = xnow[idim];
+
+          u[icell] = bmm_dem_random(dem, BMM_DEM_STREAM_PACK,
+              icell, m + 1, (double const[]) {0.0, 1.0});
+          v[icell] += bmm_geom_ballvol(rnow, BMM_NDIM);
+          ++n[icell];
+        }
+      }
+    }
+
+    vnow = 0.0;
+    for (size_t icell = 0; icell < ncellt; ++icell)
+      vnow += v[icell];
+  }
+
+  // The final attempt may overshoot the target,
+  // so its candidates are only kept up to a random cut.
+  double ucut = INFINITY;
+
+  if (vnow > vtgt) {
+    size_t nlast = 0;
+    for (size_t icell = 0; icell < ncellt; ++icell)
+      if (u[icell] >= 0.0) {
+        last[nlast].u = u[icell];
+        last[nlast].v = bmm_geom_ballvol(r[icell * mgroup + n[icell] - 1],
+            BMM_NDIM);
+        vnow -= last[nlast].v;
+        ++nlast;
+      }
+
+    qsort(last, nlast, sizeof *last, bmm_dem_pack_cmp);
+
+    for (size_t ilast = 0; ilast < nlast; ++ilast) {
+      if (vnow + last[ilast].v > vtgt) {
+        ucut = last[ilast].u;
+
+        break;
+      }
+
+      vnow += last[ilast].v;
+    }
+  }
+
+  size_t nnew = 0;
+  for (size_t icell = 0; icell < ncellt; ++icell)
+    nnew += n[icell];
+
+  bool const result = bmm_dem_reserve(dem, dem->part.n + nnew);
+
+  if (result)
+    for (size_t icell = 0; icell < ncellt; ++icell)
+      for (size_t igroup = 0; igroup < n[icell]; ++igroup) {
+        if (igroup == n[icell] - 1 && u[icell] >= ucut)
+          break;
+
+        size_t const i = icell * mgroup + igroup;
+
+        size_t const ipart = bmm_dem_addpart(dem);
+
+        dem->part.r[ipart] = r[i];
+        dem->part.m[ipart] = dem->opts.part.rho * bmm_geom_ballvol(r[i], 3);
+
+        for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+          dem->part.x[ipart][idim] = x[i][idim];
+      }
+
+  free(last);
+  free(x);
+  free(r);
+  free(v);
+  free(u);
+  free(n);
+
+  return result;
+}
+
+__attribute__ ((__nonnull__))
+static bool bmm_dem_script_create_gas(struct bmm_dem *const dem) {
+  double const unit[] = {0.0, 1.0};
+
+  for (size_t ipart = 0; ipart < 64; ++ipart) {
+    size_t const jpart = bmm_dem_addpart(dem);
+    if (jpart == SIZE_MAX)
+      return false;
+
+    dem->part.r[jpart] = 0.03;
+    dem->part.m[jpart] = 1.0;
+
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+      dem->part.x[jpart][idim] += bmm_dem_random(dem, BMM_DEM_STREAM_POS,
+          dem->part.l[jpart], idim, unit) * dem->opts.box.x[idim];
+
+      dem->part.omega[jpart] += (double) (rand() % 512 - 256);
+  }
+
+  return true;
+}
+
+__attribute__ ((__nonnull__))
+static bool bmm_dem_script_create_couple(struct bmm_dem *const dem) {
+  size_t jpart;
+
+  double const scale = dem->opts.box.x[0];
+
+  jpart = bmm_dem_addpart(dem);
+  if (jpart == SIZE_MAX)
+    return false;
+
+  dem->part.r[jpart] = 0.015 * scale;
+  dem->part.m[jpart] = dem->opts.part.rho * bmm_geom_ballvol(dem->part.r[jpart], 3);
+  dem->part.x[jpart][0] += 0.45 * scale;
+  dem->part.x[jpart][1] += 0.12 * scale;
+  dem->part.v[jpart][0] += 0.0e+1 * scale;
+  dem->part.omega[jpart] += 1.0e+4;
+
+  jpart = bmm_dem_addpart(dem);
+  if (jpart == SIZE_MAX)
+    return false;
+
+  dem->part.r[jpart] = 0.03 * scale;
+  dem->part.m[jpart] = dem->opts.part.rho * bmm_geom_ballvol(dem->part.r[jpart], 3);
+  dem->part.x[jpart][0] += 0.55 * scale;
+  dem->part.x[jpart][1] += 0.12 * scale;
+  dem->part.v[jpart][0] -= 0.0e+1 * scale;
+  dem->part.omega[jpart] += 1.0e+4;
+
+  return true;
+}
+
+__attribute__ ((__nonnull__))
+static bool bmm_dem_script_create_triplet(struct bmm_dem *const dem) {
+  size_t jpart;
+
+  jpart = bmm_dem_addpart(dem);
+  if (jpart == SIZE_MAX)
+    return false;
+
+  double const scale = dem->opts.box.x[0];
+
+  dem->part.r[jpart] = 0.03 * scale;
+  dem->part.m[jpart] = dem->opts.part.rho * bmm_geom_ballvol(dem->part.r[jpart], 3);
+  dem->part.x[jpart][0] += 0.45 * scale;
+  dem->part.x[jpart][1] += 0.25 * scale;
+  dem->part.v[jpart][0] += 3.0e+1 * scale;
+  dem->part.omega[jpart] += 3.0e+4;
+
+  jpart = bmm_dem_addpart(dem);
+  if (jpart == SIZE_MAX)
+    return false;
+
+  dem->part.r[jpart] = 0.03 * scale;
+  dem->part.m[jpart] = dem->opts.part.rho * bmm_geom_ballvol(dem->part.r[jpart], 3);
+  dem->part.x[jpart][0] += 0.55 * scale;
+  dem->part.x[jpart][1] += 0.25 * scale;
+  dem->part.v[jpart][0] -= 3.0e+1 * scale;
+  dem->part.omega[jpart] += 3.0e+4;
+
+  jpart = bmm_dem_addpart(dem);
+  if (jpart == SIZE_MAX)
+    return false;
+
+  dem->part.r[jpart] = 0.02 * scale;
+  dem->part.m[jpart] = dem->opts.part.rho * bmm_geom_ballvol(dem->part.r[jpart], 3);
+  dem->part.x[jpart][0] += 0.5 * scale;
+  dem->part.x[jpart][1] += 0.25 * scale;
+  dem->part.v[jpart][0] -= 0.0e+1 * scale;
+  dem->part.omega[jpart] += -3.0e+4;
+
+  return true;
+}
+
+/// The call `bmm_dem_step(dem)`
+/// advances the simulation `dem` by one step.
+/// Make sure the simulation has not ended prior to the call
+/// by calling `bmm_dem_script_ongoing` or `bmm_dem_script_trans`.
+/// The call `bmm_dem_perf_read(dem, n)`
+/// sums the counts of the hardware performance counters
+/// of every thread of the simulation `dem` into `n`.
+__attribute__ ((__nonnull__))
+static void bmm_dem_perf_read(struct bmm_dem const *const dem,
+    uint64_t *const n) {
+  for (enum bmm_dem_ctr ictr = 0; ictr < BMM_NCTR; ++ictr)
+    n[ictr] = 0;
+
+#ifdef __linux__
+  for (size_t ithread = 0; ithread < dem->opts.thread.n; ++ithread) {
+    // Groups are read as their size followed by the counts
+    // of those members that could be opened.
+    uint64_t buf[1 + BMM_NCTR];
+    if (read(dem->perf.fd[ithread][0], buf, sizeof buf) <
+        (ssize_t) sizeof *buf)
+      continue;
+
+    size_t ival = 0;
+    for (enum bmm_dem_ctr ictr = 0; ictr < BMM_NCTR; ++ictr)
+      if (dem->perf.fd[ithread][ictr] != -1) {
+        if (ival < buf[0])
+          n[ictr] += buf[1 + ival];
+
+        ++ival;
+      }
+  }
+#endif
+}
+
+/// The call `bmm_dem_perf_close(dem)`
+/// closes the hardware performance counters of the simulation `dem`.
+/// If no window was completed,
+/// the partial window is kept in its place.
+__attribute__ ((__nonnull__))
+static void bmm_dem_perf_close(struct bmm_dem *const dem) {
+  if (dem->perf.on && dem->perf.est.nstep == 0 && dem->perf.istep != 0) {
+    dem->perf.est.nstep = dem->perf.istep;
+    (void) memcpy(dem->perf.est.n, dem->perf.n, sizeof dem->perf.n);
+  }
+
+  dem->perf.on = false;
+
+  for (size_t ithread = 0; ithread < BMM_MTHREAD; ++ithread)
+    for (enum bmm_dem_ctr ictr = 0; ictr < BMM_NCTR; ++ictr)
+      if (dem->perf.fd[ithread][ictr] != -1) {
+        (void) close(dem->perf.fd[ithread][ictr]);
+        dem->perf.fd[ithread][ictr] = -1;
+      }
+}
+
+/// The call `bmm_dem_perf_open(dem)`
+/// tries to open hardware performance counters
+/// for each thread of the simulation `dem`
+/// if they were requested.
+/// Each thread counts its own events in user space.
+/// Events that the processor does not support are left out,
+/// but the cycle counter that leads each group is required.
+/// If the operation is successful,
+/// `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_perf_open(struct bmm_dem *const dem) {
+  if (dem->opts.perf.nstep == 0)
+    return true;
+
+#ifdef __linux__
+  static struct {
+    uint32_t type;
+    uint64_t config;
+  } const event[BMM_NCTR] = {
+    [BMM_DEM_CTR_CYCLE] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    [BMM_DEM_CTR_INSTR] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    [BMM_DEM_CTR_L1DMISS] = {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    [BMM_DEM_CTR_LLCMISS] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    [BMM_DEM_CTR_BRMISS] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}
+  };
+
+  int nerr = 0;
+
+  // The threading runtime keeps reusing the same threads,
+  // so each one opens the counters that follow it.
+#ifdef _OPENMP
+#pragma omp parallel num_threads((int) dem->opts.thread.n) reduction(max:nerr)
+#endif
+  {
+#ifdef _OPENMP
+    size_t const ithread = (size_t) omp_get_thread_num();
+#else
+    size_t const ithread = 0;
+#endif
+
+    int *const fd = dem->perf.fd[ithread];
+
+    for (enum bmm_dem_ctr ictr = 0; ictr < BMM_NCTR; ++ictr) {
+      struct perf_event_attr attr;
+      (void) memset(&attr, 0, sizeof attr);
+      attr.size = sizeof attr;
+      attr.type = event[ictr].type;
+      attr.config = event[ictr].config;
+      attr.read_format = PERF_FORMAT_GROUP;
+      attr.disabled = ictr == 0;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+
+      fd[ictr] = (int) syscall(SYS_perf_event_open, &attr, 0, -1,
+          ictr == 0 ? -1 : fd[0], 0);
+
+      if (fd[ictr] == -1 && ictr == 0) {
+        nerr = errno;
+
+        break;
+      }
+    }
+
+    if (fd[0] != -1 &&
+        (ioctl(fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) == -1 ||
+         ioctl(fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) == -1))
+      nerr = errno;
+  }
+
+  if (nerr != 0) {
+    bmm_dem_perf_close(dem);
+
+    errno = nerr;
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  dem->perf.on = true;
+  dem->perf.istep = 0;
+  dem->perf.est.nstep = 0;
+  (void) memset(dem->perf.n, 0, sizeof dem->perf.n);
+  (void) memset(dem->perf.est.n, 0, sizeof dem->perf.est.n);
+  bmm_dem_perf_read(dem, dem->perf.nprev);
+
+  return true;
+#else
+  BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Performance counters are not supported");
+
+  return false;
+#endif
+}
+
+/// The call `bmm_dem_perf_step(dem)`
+/// counts one more step into the current window
+/// of the hardware performance counters of the simulation `dem`
+/// and closes the window once it is full.
+__attribute__ ((__nonnull__))
+static void bmm_dem_perf_step(struct bmm_dem *const dem) {
+  if (!dem->perf.on)
+    return;
+
+  ++dem->perf.istep;
+
+  if (dem->perf.istep >= dem->opts.perf.nstep) {
+    dem->perf.est.nstep = dem->perf.istep;
+    (void) memcpy(dem->perf.est.n, dem->perf.n, sizeof dem->perf.n);
+    (void) memset(dem->perf.n, 0, sizeof dem->perf.n);
+    dem->perf.istep = 0;
+  }
+}
+
+/// The call `bmm_dem_prof_now(dem)`
+/// returns the present time
+/// for timing the phases of the simulation `dem`
+/// and makes the hardware performance counters start from the present too.
+__attribute__ ((__nonnull__))
+static double bmm_dem_prof_now(struct bmm_dem *const dem) {
+  if (dem->perf.on)
+    bmm_dem_perf_read(dem, dem->perf.nprev);
+
+  return bmm_sec_now();
+}
+
+/// The call `bmm_dem_prof_lap(dem, iphase, t)`
+/// charges the time since `*t` to the phase `iphase`
+/// of the simulation `dem` and moves `*t` to the present.
+/// The same goes for the counts of the hardware performance counters.
+__attribute__ ((__nonnull__))
+static void bmm_dem_prof_lap(struct bmm_dem *const dem,
+    enum bmm_dem_phase const iphase, double *const t) {
+  double const tnow = bmm_sec_now();
+
+  dem->prof.t[iphase] += tnow - *t;
+  *t = tnow;
+
+  if (dem->perf.on) {
+    uint64_t n[BMM_NCTR];
+    bmm_dem_perf_read(dem, n);
+
+    for (enum bmm_dem_ctr ictr = 0; ictr < BMM_NCTR; ++ictr) {
+      dem->perf.n[iphase][ictr] += n[ictr] - dem->perf.nprev[ictr];
+      dem->perf.nprev[ictr] = n[ictr];
+    }
+  }
+}
+
+/// The call `bmm_dem_tune_cost(dem)`
+/// returns the time the simulation `dem` has spent
+/// on the phases that depend on the neighbor cutoff.
+__attribute__ ((__nonnull__, __pure__))
+static double bmm_dem_tune_cost(struct bmm_dem const *const dem) {
+  return dem->prof.t[BMM_DEM_PHASE_CACHE] +
+    dem->prof.t[BMM_DEM_PHASE_ANALYZE] +
+    dem->prof.t[BMM_DEM_PHASE_FORCE];
+}
+
+/// The call `bmm_dem_tune(dem)`
+/// moves the tuning of the neighbor cache of the simulation `dem` along
+/// before the next step.
+/// Each candidate cutoff is timed for `opts.cache.ntune` steps,
+/// including the rebuild it forces,
+/// after which the fastest one is kept for the rest of the simulation.
+/// Since any cutoff that covers the particles gives the same neighbors,
+/// the timed steps are ordinary steps of the simulation.
+__attribute__ ((__nonnull__))
+static void bmm_dem_tune(struct bmm_dem *const dem) {
+  if (!dem->opts.cache.tune || dem->tune.done || dem->part.n == 0)
+    return;
+
+  if (dem->tune.istep == dem->opts.cache.ntune) {
+    dem->tune.t[dem->tune.icand] = (bmm_dem_tune_cost(dem) -
+        dem->tune.tstart) / (double) dem->opts.cache.ntune;
+
+    dem->tune.ibest = dem->tune.ibest == SIZE_MAX ||
+      dem->tune.t[dem->tune.icand] < dem->tune.t[dem->tune.ibest] ?
+      dem->tune.icand : dem->tune.ibest;
+
+    ++dem->tune.icand;
+    dem->tune.istep = 0;
+  }
+
+  if (dem->tune.istep == 0) {
+    while (dem->tune.icand < BMM_NTUNE &&
+        dem->tune.dcutoff[dem->tune.icand] == 0.0)
+      ++dem->tune.icand;
+
+    size_t const icand = dem->tune.icand < BMM_NTUNE ?
+      dem->tune.icand : dem->tune.ibest;
+
+    if (icand != SIZE_MAX) {
+      bmm_dem_opts_set_dcutoff(&dem->opts, dem->tune.dcutoff[icand]);
+
+      dem->cache.stale = true;
+    }
+
+    if (dem->tune.icand == BMM_NTUNE) {
+      dem->tune.done = true;
+
+      return;
+    }
+
+    dem->tune.tstart = bmm_dem_tune_cost(dem);
+  }
+
+  ++dem->tune.istep;
+}
+
+/// The call `bmm_dem_wall_place(dem)`
+/// removes the layers of particles at the bottom and the top
+/// of the simulation `dem` and puts rigid walls in their place,
+/// giving the top wall the mass of the particles it replaces.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_wall_place(struct bmm_dem *const dem) {
+  double const h = dem->opts.script.params[dem->script.i].precrunch.nlayer *
+    2.0 * bmm_ival_midpoint(dem->opts.part.rnew);
+
+  double m = 0.0;
+  double ymin = (double) INFINITY;
+  double ymax = (double) -INFINITY;
+
+  bmm_dem_batch_begin(dem);
+
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart) {
+    double const y = dem->part.x[ipart][1];
+    double const r = dem->part.r[ipart];
+
+    if (y > dem->opts.box.x[1] - h) {
+      m += dem->part.m[ipart];
+
+      bmm_dem_batch_rempart(dem, ipart);
+    } else if (y < h)
+      bmm_dem_batch_rempart(dem, ipart);
+    else {
+      ymin = fmin(ymin, y - r);
+      ymax = fmax(ymax, y + r);
+    }
+  }
+
+  if (!bmm_dem_batch_commit(dem))
+    return false;
+
+  if (dem->part.n == 0) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Nothing left between the walls");
+
+    return false;
+  }
+
+  // An empty layer is as heavy as a full one would be.
+  if (m == 0.0)
+    m = dem->opts.part.rho *
+      bmm_geom_ballvol(bmm_ival_midpoint(dem->opts.part.rnew), 3) *
+      dem->opts.box.x[0] / (2.0 * bmm_ival_midpoint(dem->opts.part.rnew));
+
+  dem->wall.on = true;
+  dem->wall.y[BMM_DEM_WALL_BOTTOM] = ymin - dem->opts.wall.hjag / 2.0;
+  dem->wall.y[BMM_DEM_WALL_TOP] = ymax + dem->opts.wall.hjag / 2.0;
+  dem->wall.m[BMM_DEM_WALL_BOTTOM] = (double) INFINITY;
+  dem->wall.m[BMM_DEM_WALL_TOP] = m;
+
+  for (size_t iwall = 0; iwall < BMM_NWALL; ++iwall) {
+    dem->wall.x[iwall] = 0.0;
+
+    for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+      dem->wall.v[iwall][idim] = 0.0;
+      dem->wall.f[iwall][idim] = 0.0;
+    }
+  }
+
+  return true;
+}
+
+/// The call `bmm_dem_script_enter(dem)`
+/// sets up the current stage of the simulation `dem`
+/// before its first step.
+/// Every mode does all of its work here,
+/// so the steps themselves do not need to dispatch on the mode.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_script_enter(struct bmm_dem *const dem) {
+  switch (dem->opts.script.mode[dem->script.i]) {
+    case BMM_DEM_MODE_IDLE:
+      break;
+    case BMM_DEM_MODE_SET_DENSITY:
+      bmm_dem_script_set_density(dem);
+
+      break;
+    case BMM_DEM_MODE_CREATE_HC:
+      if (!bmm_dem_script_create_hc(dem))
+        return false;
+
+      bmm_dem_script_perturb(dem);
+
+      bmm_dem_script_balance(dem);
+
+      break;
+    case BMM_DEM_MODE_CREATE_HEX:
+      if (!bmm_dem_script_create_hex(dem))
+        return false;
+
+      bmm_dem_script_perturb(dem);
+
+      bmm_dem_script_balance(dem);
+
+      break;
+    case BMM_DEM_MODE_CREATE_PLANE:
+      if (!bmm_dem_script_create_testplane(dem))
+        return false;
+
+      bmm_dem_script_perturb(dem);
+
+      break;
+    case BMM_DEM_MODE_CREATE_PILE:
+      // if (!bmm_dem_script_create_testpile(dem))
+      //   return false;
+
+      bmm_dem_batch_begin(dem);
+
+      if (!bmm_dem_script_create_testblock(dem) ||
+          !bmm_dem_batch_commit(dem))
+        return false;
+
+      bmm_dem_script_perturb(dem);
+
+      bmm_dem_script_balance(dem);
+
+      break;
+    case BMM_DEM_MODE_CREATE_BEAM:
+      bmm_dem_batch_begin(dem);
+
+      if (!bmm_dem_script_create_testbeam(dem) ||
+          !bmm_dem_batch_commit(dem))
+        return false;
+
+      bmm_dem_script_perturb(dem);
+
+      bmm_dem_script_balance(dem);
+
+      break;
+    case BMM_DEM_MODE_CREATE_GAS:
+      if (!bmm_dem_script_create_gas(dem))
+        return false;
+
+      bmm_dem_script_balance(dem);
+
+      break;
+    case BMM_DEM_MODE_CREATE_PACK:
+      if (!bmm_dem_script_create_pack(dem))
+        return false;
+
+      bmm_dem_script_balance(dem);
+
+      break;
+    case BMM_DEM_MODE_CREATE_COUPLE:
+      if (!bmm_dem_script_create_couple(dem))
+        return false;
+
+      bmm_dem_script_balance(dem);
+
+      break;
+    case BMM_DEM_MODE_CREATE_TRIPLET:
+      if (!bmm_dem_script_create_triplet(dem))
+        return false;
+
+      bmm_dem_script_balance(dem);
+
+      dem->yield.tag = BMM_DEM_YIELD_NONE;
+
+      break;
+    case BMM_DEM_MODE_GRAVY:
+      dem->ext.tag = BMM_DEM_EXT_GRAVY;
+      dem->ext.params.gravy.g =
+        -dem->opts.script.params[dem->script.i].gravy.g;
+
+      break;
+    case BMM_DEM_MODE_SEDIMENT:
+      dem->ext.tag = BMM_DEM_EXT_HARM;
+      dem->ext.params.harm.k =
+        dem->opts.script.params[dem->script.i].sediment.kcohes;
+
+      break;
+    case BMM_DEM_MODE_PRESET0:
+      dem->amb.tag = BMM_DEM_AMB_FAXEN;
+      dem->amb.params.creeping.eta = dem->opts.script.params[dem->script.i].preset.eta;
+      dem->ext.tag = BMM_DEM_EXT_NONE;
+      dem->pair[BMM_DEM_CT_WEAK].cohesive = false;
+      dem->pair[BMM_DEM_CT_WEAK].norm.tag = BMM_DEM_NORM_KV;
+      dem->pair[BMM_DEM_CT_WEAK].norm.params.dashpot.k = dem->opts.script.params[dem->script.i].preset.kn;
+      dem->pair[BMM_DEM_CT_WEAK].norm.params.dashpot.gamma = dem->opts.script.params[dem->script.i].preset.gamman;
+      dem->pair[BMM_DEM_CT_WEAK].tang.tag = BMM_DEM_TANG_NONE;
+      dem->pair[BMM_DEM_CT_STRONG].cohesive = true;
+      dem->pair[BMM_DEM_CT_STRONG].norm.tag = BMM_DEM_NORM_KV;
+      dem->pair[BMM_DEM_CT_STRONG].norm.params.dashpot.k = dem->opts.script.params[dem->script.i].preset.kn;
+      dem->pair[BMM_DEM_CT_STRONG].norm.params.dashpot.gamma = dem->opts.script.params[dem->script.i].preset.gamman;
+      dem->pair[BMM_DEM_CT_STRONG].tang.tag = BMM_DEM_TANG_NONE;
+      dem->yield.tag = BMM_DEM_YIELD_NONE;
+
+      break;
+    case BMM_DEM_MODE_CLIP:
+      if (!bmm_dem_script_clip(dem))
+        return false;
+
+      break;
+    case BMM_DEM_MODE_PRESET1:
+      dem->amb.tag = BMM_DEM_AMB_FAXEN;
+      dem->amb.params.creeping.eta = dem->opts.script.params[dem->script.i].preset.eta2;
+      dem->pair[BMM_DEM_CT_WEAK].cohesive = false;
+      dem->pair[BMM_DEM_CT_WEAK].norm.tag = BMM_DEM_NORM_BSHP;
+      dem->pair[BMM_DEM_CT_WEAK].norm.params.viscoel.a = dem->opts.script.params[dem->script.i].preset.a;
+      dem->pair[BMM_DEM_CT_WEAK].norm.tag = BMM_DEM_NORM_KV;
+      dem->pair[BMM_DEM_CT_WEAK].norm.params.dashpot.k = dem->opts.script.params[dem->script.i].preset.kn;
+      dem->pair[BMM_DEM_CT_WEAK].norm.params.dashpot.gamma = dem->opts.script.params[dem->script.i].preset.gamman;
+      dem->pair[BMM_DEM_CT_WEAK].tang.tag = dem->opts.script.params[dem->script.i].preset.fric;
+      switch (dem->pair[BMM_DEM_CT_WEAK].tang.tag) {
+        case BMM_DEM_TANG_HW:
+          dem->pair[BMM_DEM_CT_WEAK].tang.params.hw.gamma = dem->opts.script.params[dem->script.i].preset.gammat;
+          dem->pair[BMM_DEM_CT_WEAK].tang.params.hw.mu = dem->opts.script.params[dem->script.i].preset.mu;
+
+          break;
+        case BMM_DEM_TANG_CS:
+          dem->pair[BMM_DEM_CT_WEAK].tang.params.cs.k = dem->opts.script.params[dem->script.i].preset.kt;
+          dem->pair[BMM_DEM_CT_WEAK].tang.params.cs.mu = dem->opts.script.params[dem->script.i].preset.mu;
+
+          break;
+      }
+      dem->pair[BMM_DEM_CT_STRONG].cohesive = true;
+      dem->pair[BMM_DEM_CT_STRONG].norm.tag = BMM_DEM_NORM_KV;
+      dem->pair[BMM_DEM_CT_STRONG].norm.params.dashpot.k = dem->opts.script.params[dem->script.i].preset.barkn;
+      dem->pair[BMM_DEM_CT_STRONG].norm.params.dashpot.gamma = dem->opts.script.params[dem->script.i].preset.bargamman;
+      dem->pair[BMM_DEM_CT_STRONG].tang.tag = BMM_DEM_TANG_BEAM;
+      dem->pair[BMM_DEM_CT_STRONG].tang.params.beam.k = dem->opts.script.params[dem->script.i].preset.barkt;
+      dem->pair[BMM_DEM_CT_STRONG].tang.params.beam.dk = dem->opts.script.params[dem->script.i].preset.bargammat;
+      dem->yield.tag = BMM_DEM_YIELD_NONE;
+
+      break;
+    case BMM_DEM_MODE_PRESET2:
+      dem->ext.tag = BMM_DEM_EXT_NONE;
+      dem->amb.tag = BMM_DEM_AMB_FAXEN;
+      dem->amb.params.creeping.eta = dem->opts.script.params[dem->script.i].preset.eta3;
+      dem->amb.tag = BMM_DEM_AMB_NONE;
+      dem->yield.tag = BMM_DEM_YIELD_ZE;
+      dem->yield.params.ze.sigmacrit = dem->opts.script.params[dem->script.i].preset.sigmacrit;
+      dem->yield.params.ze.taucrit = dem->opts.script.params[dem->script.i].preset.taucrit;
+      dem->yield.params.ze.sigmacritt = dem->opts.script.params[dem->script.i].preset.sigmacritt;
+      dem->yield.params.ze.taucritt = dem->opts.script.params[dem->script.i].preset.taucritt;
+
+      break;
+    case BMM_DEM_MODE_LINK:
+      if (!bmm_dem_link(dem))
+        return false;
+
+      break;
+    case BMM_DEM_MODE_FAULT:
+      bmm_dem_fault(dem);
+
+      break;
+    case BMM_DEM_MODE_SEPARATE:
+      // TODO Maybe implement.
+
+      break;
+    case BMM_DEM_MODE_EXPORT:
+      {
+        double const t = bmm_sec_now();
+
+        if (dem->opts.script.params[dem->script.i].expr.entropic) {
+          dump_raddist_etc(dem);
+
+          if (!export_s(dem) || !export_chi(dem)) {
+            BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Nope");
+
+            return false;
+          }
+        }
+
+        if (dem->opts.expr.bin ? !export_bin(dem) || !export_p(dem) :
+            !export_x(dem) || !export_phi(dem) ||
+            !export_r(dem) || !export_c(dem) ||
+            !export_f(dem) || !export_p(dem)) {
+          BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Big nope");
+
+          return false;
+        }
+
+        bmm_trace_span(&dem->trace, 0, "export", t);
+      }
+
+      break;
+    case BMM_DEM_MODE_PRECRUNCH:
+      if (dem->opts.wall.on) {
+        if (!dem->wall.on && !bmm_dem_wall_place(dem))
+          return false;
+
+        break;
+      }
+
+      for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+        if (dem->part.x[ipart][1] > dem->opts.box.x[1] -
+            dem->opts.script.params[dem->script.i].precrunch.nlayer *
+            2.0 * bmm_ival_midpoint(dem->opts.part.rnew))
+          bmm_dem_setrole(dem, ipart, BMM_DEM_ROLE_DRIVEN);
+
+      for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+        if (dem->part.x[ipart][1] <
+            dem->opts.script.params[dem->script.i].precrunch.nlayer *
+            2.0 * bmm_ival_midpoint(dem->opts.part.rnew))
+          bmm_dem_setrole(dem, ipart, BMM_DEM_ROLE_FIXED);
+
+      break;
+    case BMM_DEM_MODE_ZEROEST:
+      dem->est.eambdis = 0.0;
+      dem->est.edrivtang = 0.0;
+      dem->est.edrivnorm = 0.0;
+      dem->est.ebond = 0.0;
+      dem->est.eyieldis = 0.0;
+      dem->est.ewcontdis = 0.0;
+      dem->est.escontdis = 0.0;
+      dem->est.hwgamma = 0;
+      dem->est.hwmu = 0;
+      dem->est.csk = 0;
+      dem->est.csmu = 0;
+
+      break;
+    case BMM_DEM_MODE_CRUNCH:
+      // The driving force carries over from one stage to the next.
+      dem->ext.tag = BMM_DEM_EXT_DRIVE;
+
+      for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+        if (dem->part.role[ipart] == BMM_DEM_ROLE_FIXED) {
+          for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+            dem->part.a[ipart][idim] = 0.0;
+
+          dem->part.alpha[ipart] = 0.0;
+
+          for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+            dem->part.v[ipart][idim] = 0.0;
+
+          dem->part.omega[ipart] = 0.0;
+        }
+
+      break;
+    case BMM_DEM_MODE_LESHEAR:
+      if (!(dem->opts.box.per[0] && dem->opts.box.per[1])) {
+        BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Lees--Edwards box not periodic");
+
+        return false;
+      }
+
+      {
+        double const v = dem->opts.script.params[dem->script.i].leshear.v;
+
+        // The linear velocity profile is imposed right away,
+        // so that the shear does not need to diffuse in from the boundary.
+        if (v != dem->le.v) {
+          for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+            dem->part.v[ipart][0] += (v - dem->le.v) *
+              (dem->part.x[ipart][1] / dem->opts.box.x[1] - 1.0 / 2.0);
+
+          dem->le.v = v;
+        }
+      }
+
+      break;
+    case BMM_DEM_MODE_STORE:
+      {
+        char buf[BUFSIZ];
+        bmm_dem_ckpt_path(buf, sizeof buf, dem,
+            dem->opts.ckpt.path != NULL ? dem->opts.ckpt.path : "a.out");
+
+        if (!bmm_dem_save(dem, buf))
+          return false;
+      }
+
+      break;
+    case BMM_DEM_MODE_LOAD:
+      {
+        char buf[BUFSIZ];
+        bmm_dem_ckpt_path(buf, sizeof buf, dem,
+            dem->opts.ckpt.path != NULL ? dem->opts.ckpt.path : "a.out");
+
+        if (!bmm_dem_load(dem, buf))
+          return false;
+      }
+
+      break;
+  }
+
+
+  return true;
+}
+
+bool bmm_dem_step(struct bmm_dem *const dem) {
+  bmm_dem_tune(dem);
+
+  if (!dem->script.entered) {
+    // Stages may change the masses of particles behind the back of the clumps.
+    bmm_dem_clump_dissolve_all(dem);
+
+    if (!bmm_dem_script_enter(dem))
+      return false;
+
+    dem->script.entered = true;
+
+    // Stages may move particles around behind the back of the contacts.
+    bmm_dem_sleep_wake(dem);
+  }
+
+  double const tstep = bmm_sec_now();
+
+  double t = bmm_dem_prof_now(dem);
+
+  if (dem->opts.cache.spec && !bmm_dem_spec_poll(dem))
+    return false;
+
+  if (dem->cache.stale || bmm_dem_cache_expired(dem)) {
+    // Partial updates would need to know which cells the images slid past.
+    if (!dem->cache.stale && dem->opts.cache.incr && !bmm_dem_le(dem)) {
+      if (!bmm_dem_cache_update(dem))
+        return false;
+
+      bmm_trace_span(&dem->trace, 0, "update", t);
+      ++dem->prof.nupdate;
+    } else {
+      if (!bmm_dem_cache_build(dem))
+        return false;
 
-      vnow = vnext;
-    } else
-      break;
+      bmm_trace_span(&dem->trace, 0, "build", t);
+      dem->cache.tprev = dem->time.t;
+      ++dem->prof.nbuild;
+    }
   }
 
-  return true;
-}
-
-// TODO Remove or polish this test beam.
-__attribute__ ((__nonnull__))
-static bool bmm_dem_script_create_testbeam(struct bmm_dem *const dem) {
-  double const etahc = bmm_geom_ballvol(0.5, BMM_NDIM);
-  double const vhc = $(bmm_prod, double)(dem->opts.box.x, BMM_NDIM);
-  double const eta = dem->opts.script.params[dem->script.i].test.eta;
-  double const v = vhc * (etahc / eta);
+  if (dem->opts.cache.spec && !dem->spec.busy && bmm_dem_spec_due(dem) &&
+      !bmm_dem_spec_start(dem))
+    return false;
 
-  double const vlim = vhc * eta;
-  // double const rspace = bmm_ival_midpoint(dem->opts.part.rnew);
-  double const rspace = dem->opts.part.rnew[1];
-  double const dspace = (sqrt(3.0) / 2.0) * rspace;
+  bmm_dem_prof_lap(dem, BMM_DEM_PHASE_CACHE, &t);
 
-  double x[BMM_NDIM];
-  for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-    x[idim] = 0.0;
+  {
+    double dt = dem->opts.script.dt[dem->script.i];
 
-  double vnow = 0.0;
-  bool parity = false;
+    if (dem->opts.time.adapt) {
+      dt = fmin(dt, bmm_dem_adapt(dem));
 
-  for ever {
-    double const r = bmm_random_get(dem->rng, dem->opts.part.rnew);
-    double const v = bmm_geom_ballvol(r, BMM_NDIM);
+      if (dem->script.dt != 0.0 && dt != dem->script.dt)
+        bmm_dem_rescale(dem, dt / dem->script.dt);
+    }
 
-    double const vnext = vnow + v;
+    dem->script.dt = dt;
+  }
 
-    if (vnext <= vlim) {
-      size_t ipart = bmm_dem_addpart(dem);
-      if (ipart == SIZE_MAX)
-        return false;
+  bmm_dem_predict(dem);
+  bmm_dem_prof_lap(dem, BMM_DEM_PHASE_INTEG, &t);
+  bmm_dem_yield(dem);
+  if (!dem->opts.cache.fuse)
+    bmm_dem_analyze(dem);
+  bmm_dem_prof_lap(dem, BMM_DEM_PHASE_ANALYZE, &t);
+  bmm_dem_force(dem);
+  bmm_dem_prof_lap(dem, BMM_DEM_PHASE_FORCE, &t);
+  bmm_dem_accel(dem);
+  bmm_dem_correct(dem);
 
-      dem->part.r[ipart] = r;
-      dem->part.m[ipart] = dem->opts.part.rho * bmm_geom_ballvol(r, 3);
+  if (dem->clump.n != 0)
+    bmm_dem_clump_step(dem);
 
-      for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-        dem->part.x[ipart][idim] = x[idim] + rspace;
+  if (dem->wall.on)
+    bmm_dem_wall_step(dem);
 
-      x[0] += 2.0 * rspace;
+  if (dem->opts.sleep.on)
+    bmm_dem_sleep(dem);
 
-      if (x[0] + 2.0 * rspace >= dem->opts.box.x[0]) {
-        x[0] = parity ? 0.0 : rspace;
-        x[1] += 2.0 * dspace;
-        parity = !parity;
-      }
+  if (dem->opts.clump.on && dem->time.istep % dem->opts.clump.nstep == 0 &&
+      !bmm_dem_clump_form(dem))
+    return false;
 
-      if (dem->part.x[ipart][1] > dem->opts.script.params[dem->script.i].test.layers * rspace ||
-          dem->part.x[ipart][0] + 4.0 * rspace > dem->opts.script.params[dem->script.i].test.slices * rspace)
-        bmm_dem_rempart(dem, ipart);
+  if (dem->time.istep % dem->opts.time.istab == 0)
+    bmm_dem_stab(dem);
 
-      if (dem->part.x[ipart][0] > dem->opts.box.x[0] - 4.0 * rspace)
-        bmm_dem_rempart(dem, ipart);
+  bmm_dem_prof_lap(dem, BMM_DEM_PHASE_INTEG, &t);
+  bmm_dem_perf_step(dem);
 
-      if (dem->part.x[ipart][0] < 4.0 * rspace)
-        dem->part.role[ipart] = BMM_DEM_ROLE_FIXED;
-      // This one is funny.
-      // else dem->part.v[ipart][0] = 1.0e+2;
+  if (dem->le.v != 0.0)
+    dem->le.x = $(bmm_uwrap, double)(dem->le.x +
+        dem->le.v * dem->script.dt, dem->opts.box.x[0]);
 
-      vnow = vnext;
-    } else
-      break;
-  }
+  dem->time.t += dem->script.dt;
+  ++dem->time.istep;
 
-  for (size_t i = 0; i < 14; ++i) {
-    size_t ipart = bmm_dem_addpart(dem);
-    if (ipart == SIZE_MAX)
-      return false;
+  bmm_trace_span(&dem->trace, 0, "step", tstep);
 
-    double const r = bmm_random_get(dem->rng, dem->opts.part.rnew);
-    double const v = bmm_geom_ballvol(r, BMM_NDIM);
+  return true;
+}
 
-    dem->part.r[ipart] = r;
-    dem->part.m[ipart] = dem->opts.part.rho * bmm_geom_ballvol(r, 3);
+static bool pregarbage(struct bmm_dem *const dem) {
+  char buf[BUFSIZ];
+  bmm_dem_path(buf, sizeof buf, dem, "est", "");
 
-    double a[2];
-    a[0] = 0.0;
-    a[1] = dem->opts.box.x[0];
-    dem->part.x[ipart][0] = bmm_random_get(dem->rng, a);
-    a[0] = 0.0;
-    a[1] = sqrt(2.0 * dem->opts.box.x[1]);
-    dem->part.x[ipart][1] =
-      bmm_random_get(dem->rng, a) * bmm_random_get(dem->rng, a) -
-      $(bmm_power, double)(bmm_ival_length(a), 2);
+  dem->comm.estream = fopen(buf, "w");
+  if (dem->comm.estream == NULL) {
+    BMM_TLE_STDS();
 
-    dem->part.role[ipart] = BMM_DEM_ROLE_FIXED;
+    return false;
   }
 
+  // Nothing in here can be dropped, so this always waits.
+  if (dem->opts.comm.async &&
+      !bmm_aio_start(&dem->comm.estaio, dem->comm.estream, BMM_AIO_LAG_BLOCK))
+    return false;
+
   return true;
 }
 
-__attribute__ ((__nonnull__))
-static void bmm_dem_script_perturb(struct bmm_dem *const dem) {
-  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-      dem->part.x[ipart][idim] += bmm_random_get(dem->rng,
-          dem->opts.part.rnew) / 2.0;
-}
+static bool garbage(struct bmm_dem *const dem) {
+  double const eambdis = dem->est.eambdis;
+  double const epotext = dem->est.epotext_d;
+  double const eklin = dem->est.eklin_d;
+  double const ekrot = dem->est.ekrot_d;
+  double const ewcont = dem->est.ewcont_d;
+  double const escont = dem->est.escont_d;
+  double const edrivnorm = dem->est.edrivnorm;
+  double const edrivtang = dem->est.edrivtang;
+  double const ebond = dem->est.ebond;
+  double const eyieldis = dem->est.eyieldis;
+  double const ewcontdis = dem->est.ewcontdis;
+  double const escontdis = dem->est.escontdis;
+  double const pos = eklin + ekrot + ewcont + escont + epotext;
+  double const dis = eambdis + ewcontdis + escontdis + eyieldis;
+  double const neg = ebond + edrivnorm + edrivtang;
+  double const eee = pos + dis - neg;
+
+  if (dem->opts.script.mode[dem->script.i] == BMM_DEM_MODE_CRUNCH &&
+      dem->opts.script.params[dem->script.i].crunch.measure) {
+    char buf[BUFSIZ];
+    int const n = snprintf(buf, sizeof buf,
+        "%g %g %g %g %g %g %g %g %g %g %g %g %g %g %g\n",
+        dem->time.t,
+        eklin + ekrot, ewcont + escont, epotext,
+        eambdis, ewcontdis + escontdis, eyieldis,
+        ebond, edrivnorm + edrivtang,
+        dem->est.mueff, dem->est.mueffb,
+        dem->est.vdriv[0], dem->est.vdriv[1],
+        dem->script.state.crunch.fdrive[0], dem->script.state.crunch.fdrive[1]);
+    if (n < 0) {
+      BMM_TLE_STDS();
 
-__attribute__ ((__nonnull__))
-static bool bmm_dem_script_create_gas(struct bmm_dem *const dem) {
-  for (size_t ipart = 0; ipart < 64; ++ipart) {
-    size_t const jpart = bmm_dem_addpart(dem);
-    if (jpart == SIZE_MAX)
       return false;
+    }
 
-    dem->part.r[jpart] = 0.03;
-    dem->part.m[jpart] = 1.0;
+    if ((size_t) n >= sizeof buf) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Line too long");
 
-    for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-      dem->part.x[jpart][idim] += gsl_rng_uniform(dem->rng) * dem->opts.box.x[idim];
+      return false;
+    }
 
-      dem->part.omega[jpart] += (double) (rand() % 512 - 256);
+    if (dem->opts.comm.async) {
+      if (!(bmm_aio_begin(&dem->comm.estaio) == BMM_AIO_BEGIN_READY &&
+            bmm_aio_write(&dem->comm.estaio, buf, (size_t) n) &&
+            bmm_aio_end(&dem->comm.estaio)))
+        return false;
+    } else if (fputs(buf, dem->comm.estream) == EOF) {
+      BMM_TLE_STDS();
+
+      return false;
+    }
   }
 
   return true;
 }
 
+/// The call `bmm_dem_est_sync(dem)`
+/// makes sure the estimator output of the simulation `dem`
+/// reaches its storage device.
+/// Asynchronous output is left for its writer thread to synchronize,
+/// so this only waits when the output is synchronous.
+/// Estimator lines are otherwise left buffered,
+/// which is why this is only done at stage boundaries and checkpoints.
 __attribute__ ((__nonnull__))
-static bool bmm_dem_script_create_couple(struct bmm_dem *const dem) {
-  size_t jpart;
+static bool bmm_dem_est_sync(struct bmm_dem *const dem) {
+  return dem->opts.comm.async ? bmm_aio_sync(&dem->comm.estaio) :
+    bmm_io_sync(dem->comm.estream);
+}
 
-  double const scale = dem->opts.box.x[0];
+static bool postgarbage(struct bmm_dem *const dem) {
+  // Nothing was opened if the run failed to start.
+  if (dem->comm.estream == NULL)
+    return true;
 
-  jpart = bmm_dem_addpart(dem);
-  if (jpart == SIZE_MAX)
+  if (!bmm_dem_est_sync(dem))
     return false;
 
-  dem->part.r[jpart] = 0.015 * scale;
-  dem->part.m[jpart] = dem->opts.part.rho * bmm_geom_ballvol(dem->part.r[jpart], 3);
-  dem->part.x[jpart][0] += 0.45 * scale;
-  dem->part.x[jpart][1] += 0.12 * scale;
-  dem->part.v[jpart][0] += 0.0e+1 * scale;
-  dem->part.omega[jpart] += 1.0e+4;
-
-  jpart = bmm_dem_addpart(dem);
-  if (jpart == SIZE_MAX)
+  if (dem->opts.comm.async && !bmm_aio_stop(&dem->comm.estaio))
     return false;
 
-  dem->part.r[jpart] = 0.03 * scale;
-  dem->part.m[jpart] = dem->opts.part.rho * bmm_geom_ballvol(dem->part.r[jpart], 3);
-  dem->part.x[jpart][0] += 0.55 * scale;
-  dem->part.x[jpart][1] += 0.12 * scale;
-  dem->part.v[jpart][0] -= 0.0e+1 * scale;
-  dem->part.omega[jpart] += 1.0e+4;
+  FILE *const stream = dem->comm.estream;
+  dem->comm.estream = NULL;
+
+  if (fclose(stream) != 0) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
 
   return true;
 }
 
+/// The call `bmm_dem_comm_keep(dem)`
+/// remembers the positions, angles and contacts
+/// of the simulation `dem` for the next difference frame.
 __attribute__ ((__nonnull__))
-static bool bmm_dem_script_create_triplet(struct bmm_dem *const dem) {
-  size_t jpart;
-
-  jpart = bmm_dem_addpart(dem);
-  if (jpart == SIZE_MAX)
-    return false;
-
-  double const scale = dem->opts.box.x[0];
+static void bmm_dem_comm_keep(struct bmm_dem *const dem) {
+  size_t const npart = dem->part.n;
 
-  dem->part.r[jpart] = 0.03 * scale;
-  dem->part.m[jpart] = dem->opts.part.rho * bmm_geom_ballvol(dem->part.r[jpart], 3);
-  dem->part.x[jpart][0] += 0.45 * scale;
-  dem->part.x[jpart][1] += 0.25 * scale;
-  dem->part.v[jpart][0] += 3.0e+1 * scale;
-  dem->part.omega[jpart] += 3.0e+4;
+  dem->comm.npart = npart;
 
-  jpart = bmm_dem_addpart(dem);
-  if (jpart == SIZE_MAX)
-    return false;
+  // The columns may not even exist yet.
+  if (npart == 0)
+    return;
 
-  dem->part.r[jpart] = 0.03 * scale;
-  dem->part.m[jpart] = dem->opts.part.rho * bmm_geom_ballvol(dem->part.r[jpart], 3);
-  dem->part.x[jpart][0] += 0.55 * scale;
-  dem->part.x[jpart][1] += 0.25 * scale;
-  dem->part.v[jpart][0] -= 3.0e+1 * scale;
-  dem->part.omega[jpart] += 3.0e+4;
+  (void) memcpy(dem->comm.x, dem->part.x, npart * sizeof *dem->comm.x);
+  (void) memcpy(dem->comm.phi, dem->part.phi, npart * sizeof *dem->comm.phi);
 
-  jpart = bmm_dem_addpart(dem);
-  if (jpart == SIZE_MAX)
-    return false;
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict)
+    for (size_t ipart = 0; ipart < npart; ++ipart) {
+      size_t const ncont = dem->pair[ict].cont.src[ipart].n;
 
-  dem->part.r[jpart] = 0.02 * scale;
-  dem->part.m[jpart] = dem->opts.part.rho * bmm_geom_ballvol(dem->part.r[jpart], 3);
-  dem->part.x[jpart][0] += 0.5 * scale;
-  dem->part.x[jpart][1] += 0.25 * scale;
-  dem->part.v[jpart][0] -= 0.0e+1 * scale;
-  dem->part.omega[jpart] += -3.0e+4;
+      dem->comm.src[ict][ipart].n = ncont;
+      (void) memcpy(dem->comm.src[ict][ipart].itgt,
+          dem->pair[ict].cont.src[ipart].itgt,
+          ncont * sizeof *dem->comm.src[ict][ipart].itgt);
+    }
+}
 
-  return true;
+/// The call `bmm_dem_comm_prio(dem)`
+/// writes out the progress reports of the simulation `dem`,
+/// which still go out when the rest of the frame is dropped.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_comm_prio(struct bmm_dem *const dem) {
+  return bmm_dem_puts(dem, dem->opts.comm.cols ?
+      BMM_MSG_NUM_CEST : BMM_MSG_NUM_EST) &&
+    (!dem->opts.comm.prof || bmm_dem_puts(dem, BMM_MSG_NUM_PROF)) &&
+    (dem->opts.perf.nstep == 0 || bmm_dem_puts(dem, BMM_MSG_NUM_PERF)) &&
+    (!dem->opts.comm.stats || bmm_dem_puts(dem, BMM_MSG_NUM_STATS));
 }
 
-/// The call `bmm_dem_step(dem)`
-/// advances the simulation `dem` by one step.
-/// Make sure the simulation has not ended prior to the call
-/// by calling `bmm_dem_script_ongoing` or `bmm_dem_script_trans`.
-bool bmm_dem_step(struct bmm_dem *const dem) {
-  switch (dem->opts.script.mode[dem->script.i]) {
-    case BMM_DEM_MODE_IDLE:
-      break;
-    case BMM_DEM_MODE_SET_DENSITY:
-      bmm_dem_script_set_density(dem);
+/// The call `bmm_dem_comm_frame(dem)`
+/// writes out one frame of the simulation `dem`.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_comm_frame(struct bmm_dem *const dem) {
+  if (!bmm_dem_puts(dem, BMM_MSG_NUM_ISTEP))
+    return false;
 
-      break;
-    case BMM_DEM_MODE_CREATE_HC:
-      if (!bmm_dem_script_create_hc(dem))
-        return false;
+  // Difference frames only make sense
+  // if the particles are still the same ones.
+  bool const key = dem->comm.ikey == 0 || dem->part.n != dem->comm.npart;
 
-      bmm_dem_script_perturb(dem);
+  if (!bmm_dem_puts(dem, key ? BMM_MSG_NUM_NEIGH : BMM_MSG_NUM_DCONTS))
+    return false;
 
-      bmm_dem_script_balance(dem);
+  // Quantized frames are always complete,
+  // because differences between them would drift.
+  if (!bmm_dem_puts(dem, dem->opts.comm.nbit != 0 ? BMM_MSG_NUM_QPARTS :
+        !key ? BMM_MSG_NUM_DPARTS :
+        dem->opts.comm.cols ? BMM_MSG_NUM_CPARTS : BMM_MSG_NUM_PARTS))
+    return false;
 
-      break;
-    case BMM_DEM_MODE_CREATE_HEX:
-      if (!bmm_dem_script_create_hex(dem))
-        return false;
+  if (!bmm_dem_comm_prio(dem))
+    return false;
 
-      bmm_dem_script_perturb(dem);
+  if (dem->opts.field.on && !bmm_dem_puts(dem, BMM_MSG_NUM_FIELD))
+    return false;
 
-      bmm_dem_script_balance(dem);
+  if (dem->opts.comm.frag) {
+    bmm_dem_est_frag(dem);
 
-      break;
-    case BMM_DEM_MODE_CREATE_PLANE:
-      if (!bmm_dem_script_create_testplane(dem))
-        return false;
+    if (!bmm_dem_puts(dem, BMM_MSG_NUM_FRAG))
+      return false;
+  }
 
-      bmm_dem_script_perturb(dem);
+  if (dem->opts.comm.nkey > 1)
+    bmm_dem_comm_keep(dem);
 
-      break;
-    case BMM_DEM_MODE_CREATE_PILE:
-      // if (!bmm_dem_script_create_testpile(dem))
-      //   return false;
+  dem->comm.ikey = key ? 1 : dem->comm.ikey + 1;
+  if (dem->comm.ikey == dem->opts.comm.nkey)
+    dem->comm.ikey = 0;
 
-      if (!bmm_dem_script_create_testblock(dem))
-        return false;
+  return true;
+}
 
-      bmm_dem_script_perturb(dem);
+/// The call `bmm_dem_comm_head(dem)`
+/// writes out the options of the simulation `dem`,
+/// followed by the schema of its table messages if it sends them.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_comm_head(struct bmm_dem *const dem) {
+  return bmm_dem_puts(dem, BMM_MSG_NUM_OPTS) &&
+    (!dem->opts.comm.cols || bmm_dem_puts(dem, BMM_MSG_NUM_SCHEMA));
+}
 
-      bmm_dem_script_balance(dem);
+/// The call `bmm_dem_comm_publish(dem)`
+/// publishes the current frame of the simulation `dem`,
+/// preceded by its options if `first` is set.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_comm_publish(struct bmm_dem *const dem,
+    bool const first) {
+  // The options are kept for late subscribers,
+  // so they go out as a frame of their own.
+  msgpub = &dem->comm.pub;
+  bool const result = (!first ||
+      (bmm_dem_comm_head(dem) && bmm_pub_end(&dem->comm.pub))) &&
+    bmm_dem_comm_frame(dem) && bmm_pub_end(&dem->comm.pub);
+  msgpub = NULL;
 
-      break;
-    case BMM_DEM_MODE_CREATE_BEAM:
-      if (!bmm_dem_script_create_testbeam(dem))
-        return false;
+  return result;
+}
 
-      bmm_dem_script_perturb(dem);
+/// The call `bmm_dem_comm_send(dem)`
+/// sends the current frame of the simulation `dem`,
+/// preceded by its options if this is the first frame.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_comm_send(struct bmm_dem *const dem) {
+  // TODO Nope.
+  static bool first = true;
 
-      bmm_dem_script_balance(dem);
+  if (dem->opts.comm.pub != NULL) {
+    bool const result = bmm_dem_comm_publish(dem, first);
+    first = false;
 
-      break;
-    case BMM_DEM_MODE_CREATE_GAS:
-      if (!bmm_dem_script_create_gas(dem))
-        return false;
+    return result;
+  }
 
-      bmm_dem_script_balance(dem);
+  if (first) {
+    // This goes out directly before any frames,
+    // so it never races the writer thread.
+    if (!bmm_dem_comm_head(dem))
+      return false;
+
+    first = false;
+  }
 
-      break;
-    case BMM_DEM_MODE_CREATE_COUPLE:
-      if (!bmm_dem_script_create_couple(dem))
-        return false;
+  if (dem->opts.comm.async) {
+    bool send = true;
 
-      bmm_dem_script_balance(dem);
+    // A long wait here means that the writer thread is falling behind.
+    double const t = bmm_sec_now();
+    enum bmm_aio_begin const state = bmm_aio_begin(&dem->comm.aio);
+    dem->stats.twait += bmm_sec_now() - t;
+    bmm_trace_span(&dem->trace, 0, "wait", t);
 
-      break;
-    case BMM_DEM_MODE_CREATE_TRIPLET:
-      if (!bmm_dem_script_create_triplet(dem))
+    switch (state) {
+      case BMM_AIO_BEGIN_ERROR:
         return false;
+      case BMM_AIO_BEGIN_READY:
+        break;
+      case BMM_AIO_BEGIN_SKIP:
+        send = false;
 
-      bmm_dem_script_balance(dem);
-
-      dem->yield.tag = BMM_DEM_YIELD_NONE;
+        // Whatever comes next must not depend on what was skipped.
+        dem->comm.ikey = 0;
+        dem->comm.cadence.lost = true;
 
-      break;
-    case BMM_DEM_MODE_GRAVY:
-      dem->ext.tag = BMM_DEM_EXT_GRAVY;
-      dem->ext.params.gravy.g =
-        -dem->opts.script.params[dem->script.i].gravy.g;
+        break;
+      case BMM_AIO_BEGIN_LOST:
+        // Whatever comes next must not depend on what was lost.
+        dem->comm.ikey = 0;
+        dem->comm.cadence.lost = true;
 
-      break;
-    case BMM_DEM_MODE_SEDIMENT:
-      dem->ext.tag = BMM_DEM_EXT_HARM;
-      dem->ext.params.harm.k =
-        dem->opts.script.params[dem->script.i].sediment.kcohes;
+        break;
+    }
 
-      break;
-    case BMM_DEM_MODE_PRESET0:
-      dem->amb.tag = BMM_DEM_AMB_FAXEN;
-      dem->amb.params.creeping.eta = dem->opts.script.params[dem->script.i].preset.eta;
-      dem->ext.tag = BMM_DEM_EXT_NONE;
-      dem->pair[BMM_DEM_CT_WEAK].cohesive = false;
-      dem->pair[BMM_DEM_CT_WEAK].norm.tag = BMM_DEM_NORM_KV;
-      dem->pair[BMM_DEM_CT_WEAK].norm.params.dashpot.k = dem->opts.script.params[dem->script.i].preset.kn;
-      dem->pair[BMM_DEM_CT_WEAK].norm.params.dashpot.gamma = dem->opts.script.params[dem->script.i].preset.gamman;
-      dem->pair[BMM_DEM_CT_WEAK].tang.tag = BMM_DEM_TANG_NONE;
-      dem->pair[BMM_DEM_CT_STRONG].cohesive = true;
-      dem->pair[BMM_DEM_CT_STRONG].norm.tag = BMM_DEM_NORM_KV;
-      dem->pair[BMM_DEM_CT_STRONG].norm.params.dashpot.k = dem->opts.script.params[dem->script.i].preset.kn;
-      dem->pair[BMM_DEM_CT_STRONG].norm.params.dashpot.gamma = dem->opts.script.params[dem->script.i].preset.gamman;
-      dem->pair[BMM_DEM_CT_STRONG].tang.tag = BMM_DEM_TANG_NONE;
-      dem->yield.tag = BMM_DEM_YIELD_NONE;
+    msgaio = &dem->comm.aio;
+    bool const result = send ? bmm_dem_comm_frame(dem) :
+      bmm_dem_comm_prio(dem);
+    msgaio = NULL;
 
-      break;
-    case BMM_DEM_MODE_CLIP:
-      bmm_dem_script_clip(dem);
+    if (!(result && (!send || bmm_aio_end(&dem->comm.aio)) &&
+          bmm_aio_prio_end(&dem->comm.aio)))
+      return false;
+  } else {
+    if (!bmm_dem_comm_frame(dem))
+      return false;
 
-      break;
-    case BMM_DEM_MODE_PRESET1:
-      dem->amb.tag = BMM_DEM_AMB_FAXEN;
-      dem->amb.params.creeping.eta = dem->opts.script.params[dem->script.i].preset.eta2;
-      dem->pair[BMM_DEM_CT_WEAK].cohesive = false;
-      dem->pair[BMM_DEM_CT_WEAK].norm.tag = BMM_DEM_NORM_BSHP;
-      dem->pair[BMM_DEM_CT_WEAK].norm.params.viscoel.a = dem->opts.script.params[dem->script.i].preset.a;
-      dem->pair[BMM_DEM_CT_WEAK].norm.tag = BMM_DEM_NORM_KV;
-      dem->pair[BMM_DEM_CT_WEAK].norm.params.dashpot.k = dem->opts.script.params[dem->script.i].preset.kn;
-      dem->pair[BMM_DEM_CT_WEAK].norm.params.dashpot.gamma = dem->opts.script.params[dem->script.i].preset.gamman;
-      dem->pair[BMM_DEM_CT_WEAK].tang.tag = dem->opts.script.params[dem->script.i].preset.fric;
-      switch (dem->pair[BMM_DEM_CT_WEAK].tang.tag) {
-        case BMM_DEM_TANG_HW:
-          dem->pair[BMM_DEM_CT_WEAK].tang.params.hw.gamma = dem->opts.script.params[dem->script.i].preset.gammat;
-          dem->pair[BMM_DEM_CT_WEAK].tang.params.hw.mu = dem->opts.script.params[dem->script.i].preset.mu;
+    // The output buffer is large enough to hold whole frames,
+    // so they go out in one piece instead of lingering.
+    double const t = bmm_sec_now();
+    if (fflush(stdout) == EOF) {
+      BMM_TLE_STDS();
 
-          break;
-        case BMM_DEM_TANG_CS:
-          dem->pair[BMM_DEM_CT_WEAK].tang.params.cs.k = dem->opts.script.params[dem->script.i].preset.kt;
-          dem->pair[BMM_DEM_CT_WEAK].tang.params.cs.mu = dem->opts.script.params[dem->script.i].preset.mu;
+      return false;
+    }
+    dem->stats.twait += bmm_sec_now() - t;
+  }
 
-          break;
-      }
-      dem->pair[BMM_DEM_CT_STRONG].cohesive = true;
-      dem->pair[BMM_DEM_CT_STRONG].norm.tag = BMM_DEM_NORM_KV;
-      dem->pair[BMM_DEM_CT_STRONG].norm.params.dashpot.k = dem->opts.script.params[dem->script.i].preset.barkn;
-      dem->pair[BMM_DEM_CT_STRONG].norm.params.dashpot.gamma = dem->opts.script.params[dem->script.i].preset.bargamman;
-      dem->pair[BMM_DEM_CT_STRONG].tang.tag = BMM_DEM_TANG_BEAM;
-      dem->pair[BMM_DEM_CT_STRONG].tang.params.beam.k = dem->opts.script.params[dem->script.i].preset.barkt;
-      dem->pair[BMM_DEM_CT_STRONG].tang.params.beam.dk = dem->opts.script.params[dem->script.i].preset.bargammat;
-      dem->yield.tag = BMM_DEM_YIELD_NONE;
+  return true;
+}
 
-      break;
-    case BMM_DEM_MODE_PRESET2:
-      dem->ext.tag = BMM_DEM_EXT_NONE;
-      dem->amb.tag = BMM_DEM_AMB_FAXEN;
-      dem->amb.params.creeping.eta = dem->opts.script.params[dem->script.i].preset.eta3;
-      dem->amb.tag = BMM_DEM_AMB_NONE;
-      dem->yield.tag = BMM_DEM_YIELD_ZE;
-      dem->yield.params.ze.sigmacrit = dem->opts.script.params[dem->script.i].preset.sigmacrit;
-      dem->yield.params.ze.taucrit = dem->opts.script.params[dem->script.i].preset.taucrit;
-      dem->yield.params.ze.sigmacritt = dem->opts.script.params[dem->script.i].preset.sigmacritt;
-      dem->yield.params.ze.taucritt = dem->opts.script.params[dem->script.i].preset.taucritt;
+/// The call `bmm_dem_stats_update(dem)`
+/// closes the current window of throughput and resource usage
+/// of the simulation `dem` and starts the next one.
+__attribute__ ((__nonnull__))
+static void bmm_dem_stats_update(struct bmm_dem *const dem) {
+  double const t = bmm_sec_now();
+  double const dt = t - dem->stats.prev.t;
+
+  if (dt > 0.0) {
+    dem->stats.est.vstep =
+      (double) (dem->time.istep - dem->stats.prev.istep) / dt;
+    dem->stats.est.vtsim = (dem->time.t - dem->stats.prev.tsim) / dt;
+    dem->stats.est.vbuild =
+      (double) (dem->prof.nbuild - dem->stats.prev.nbuild) / dt;
+    dem->stats.est.vbyte =
+      (double) (dem->stats.nbyte - dem->stats.prev.nbyte) / dt;
+    dem->stats.est.fwait = (dem->stats.twait - dem->stats.prev.twait) / dt;
+  }
 
-      break;
-    case BMM_DEM_MODE_LINK:
-      if (!bmm_dem_link(dem))
-        return false;
+  size_t ncont = 0;
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict)
+    for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+      ncont += dem->pair[ict].cont.src[ipart].n;
+
+  dem->stats.est.nneigh = (double) dem->cache.nneigh;
+  dem->stats.est.ncont = (double) ncont;
+
+  // The maximum resident set size is in kibibytes on Linux.
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != -1)
+    dem->stats.est.nrss = (double) usage.ru_maxrss * 1024.0;
+
+  dem->stats.prev.t = t;
+  dem->stats.prev.tsim = dem->time.t;
+  dem->stats.prev.istep = dem->time.istep;
+  dem->stats.prev.nbuild = dem->prof.nbuild;
+  dem->stats.prev.nbyte = dem->stats.nbyte;
+  dem->stats.prev.twait = dem->stats.twait;
+}
 
-      break;
-    case BMM_DEM_MODE_FAULT:
-      bmm_dem_fault(dem);
+/// The call `bmm_dem_plug_snap(dem)`
+/// copies the particles and contacts of the simulation `dem`
+/// into the snapshot for its plugins.
+/// Nothing may be reading the snapshot during the call.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_plug_snap(struct bmm_dem *const dem) {
+  if (dem->plug.snap == NULL) {
+    dem->plug.snap = malloc(sizeof *dem->plug.snap);
+    if (dem->plug.snap == NULL) {
+      BMM_TLE_STDS();
 
-      break;
-    case BMM_DEM_MODE_SEPARATE:
-      // TODO Maybe implement.
+      return false;
+    }
+  }
 
-      break;
-    case BMM_DEM_MODE_EXPORT:
-      if (dem->opts.script.params[dem->script.i].expr.entropic) {
-        dump_raddist_etc(dem);
+  struct bmm_dem *const snap = dem->plug.snap;
+  size_t const npart = dem->part.n;
+  bool const grow = npart > dem->plug.ncap;
+  size_t const nnew = grow ? dem->part.ncap : dem->plug.ncap;
+
+  *snap = *dem;
+
+  size_t icol = 0;
+
+#define SNAP(x) \
+  begin \
+    if (grow) { \
+      void *const ptr = realloc(dem->plug.col[icol], nnew * sizeof *dem->x); \
+      if (ptr == NULL) { \
+        BMM_TLE_STDS(); \
+        \
+        return false; \
+      } \
+      dem->plug.col[icol] = ptr; \
+    } \
+    \
+    if (npart != 0) \
+      (void) memcpy(dem->plug.col[icol], dem->x, npart * sizeof *dem->x); \
+    snap->x = dem->plug.col[icol]; \
+    \
+    ++icol; \
+  end
+
+  SNAP(part.l);
+  SNAP(part.role);
+  SNAP(part.r);
+  SNAP(part.m);
+  SNAP(part.jred);
+  SNAP(part.x);
+  SNAP(part.v);
+  SNAP(part.a);
+  SNAP(part.phi);
+  SNAP(part.omega);
+  SNAP(part.alpha);
+  SNAP(part.f);
+  SNAP(part.tau);
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict)
+    SNAP(pair[ict].cont.src);
 
-        if (!export_s(dem) || !export_chi(dem)) {
-          BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Nope");
+#undef SNAP
 
-          return false;
-        }
-      }
+  dynamic_assert(icol == nmembof(dem->plug.col), "Missing columns");
 
-      if (!export_x(dem) || !export_phi(dem) ||
-          !export_r(dem) || !export_c(dem) ||
-          !export_f(dem) || !export_p(dem)) {
-        BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Big nope");
+  dem->plug.ncap = nnew;
+  snap->part.ncap = nnew;
 
-        return false;
-      }
+  return true;
+}
 
-      break;
-    case BMM_DEM_MODE_PRECRUNCH:
-      for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-        if (dem->part.x[ipart][1] > dem->opts.box.x[1] -
-            dem->opts.script.params[dem->script.i].precrunch.nlayer *
-            2.0 * bmm_ival_midpoint(dem->opts.part.rnew))
-          dem->part.role[ipart] = BMM_DEM_ROLE_DRIVEN;
+/// The call `bmm_dem_plug(dem, ev)`
+/// runs the hooks of the plugins of the simulation `dem`
+/// for the event `ev`,
+/// taking a snapshot for them first if any of them runs on a worker thread.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_plug(struct bmm_dem *const dem,
+    enum bmm_plug_ev const ev) {
+  if (dem->plug.host.n == 0)
+    return true;
 
-      for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-        if (dem->part.x[ipart][1] <
-            dem->opts.script.params[dem->script.i].precrunch.nlayer *
-            2.0 * bmm_ival_midpoint(dem->opts.part.rnew))
-          dem->part.role[ipart] = BMM_DEM_ROLE_FIXED;
+  bool const async = bmm_plug_async(&dem->plug.host, ev);
 
-      break;
-    case BMM_DEM_MODE_ZEROEST:
-      dem->est.eambdis = 0.0;
-      dem->est.edrivtang = 0.0;
-      dem->est.edrivnorm = 0.0;
-      dem->est.ebond = 0.0;
-      dem->est.eyieldis = 0.0;
-      dem->est.ewcontdis = 0.0;
-      dem->est.escontdis = 0.0;
-      dem->est.hwgamma = 0;
-      dem->est.hwmu = 0;
-      dem->est.csk = 0;
-      dem->est.csmu = 0;
+  if (async && (!bmm_plug_wait(&dem->plug.host) || !bmm_dem_plug_snap(dem)))
+    return false;
 
-      break;
-    case BMM_DEM_MODE_CRUNCH:
-      {
-        static size_t stage = 0;
-        if (stage != dem->script.i) {
-          if (stage == 0)
-            for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-              dem->script.state.crunch.fdrive[idim] = 0.0;
+  return bmm_plug_call(&dem->plug.host, ev, dem,
+      async ? dem->plug.snap : NULL);
+}
 
-          stage = dem->script.i;
+// TODO This looks just like `bmm_dem_script_trans`.
+/// The call `bmm_dem_sketch_flush(dem)`
+/// merges the sketches of the force accumulators of the simulation `dem`
+/// in block order, so that the result only depends on their number,
+/// writes their quantiles into the estimators and empties them.
+__attribute__ ((__nonnull__))
+static void bmm_dem_sketch_flush(struct bmm_dem *const dem) {
+  static double const q[BMM_NQUANT] = {
+    0.01, 0.05, 0.25, 0.5, 0.75, 0.95, 0.99
+  };
+
+  size_t const nacc = bmm_dem_nacc(dem);
+  struct bmm_sketch (*const acc)[BMM_DEM_NSKETCH] = dem->sketch.acc;
+
+  for (enum bmm_dem_sketch isketch = 0; isketch < BMM_DEM_NSKETCH;
+      ++isketch) {
+    for (size_t jacc = 1; jacc < nacc; ++jacc) {
+      bmm_sketch_merge(&acc[0][isketch], &acc[jacc][isketch]);
+      bmm_sketch_def(&acc[jacc][isketch]);
+    }
 
-          dem->ext.tag = BMM_DEM_EXT_DRIVE;
+    for (size_t iquant = 0; iquant < BMM_NQUANT; ++iquant)
+      dem->est.quant[isketch][iquant] =
+        bmm_sketch_quant(&acc[0][isketch], q[iquant]);
+  }
 
-          dem->script.state.crunch.ndrive = 0;
-          for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-            if (dem->part.role[ipart] == BMM_DEM_ROLE_DRIVEN)
-              ++dem->script.state.crunch.ndrive;
+  dem->est.nsketch = (size_t) acc[0][BMM_DEM_SKETCH_FNORM].w;
 
-          dem->script.state.crunch.nfix = 0;
-          for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
-            if (dem->part.role[ipart] == BMM_DEM_ROLE_FIXED) {
-              ++dem->script.state.crunch.nfix;
+  for (enum bmm_dem_sketch isketch = 0; isketch < BMM_DEM_NSKETCH;
+      ++isketch)
+    bmm_sketch_def(&acc[0][isketch]);
 
-              for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-                dem->part.a[ipart][idim] = 0.0;
+  dem->sketch.sample = false;
+}
 
-              dem->part.alpha[ipart] = 0.0;
+/// The call `bmm_dem_comm_jump(x, y)`
+/// returns the relative change from `y` to `x`,
+/// which is zero if either of them is not finite.
+__attribute__ ((__const__))
+static double bmm_dem_comm_jump(double const x, double const y) {
+  if (!(isfinite(x) && isfinite(y)))
+    return 0.0;
 
-              for (size_t idim = 0; idim < BMM_NDIM; ++idim)
-                dem->part.v[ipart][idim] = 0.0;
+  double const z = fmax(fabs(x), fabs(y));
 
-              dem->part.omega[ipart] = 0.0;
-            }
-        }
-      }
+  return z == 0.0 ? 0.0 : fabs(x - y) / z;
+}
 
-      break;
-    case BMM_DEM_MODE_STORE:
-      {
-        FILE *const stream = fopen("a.out", "w");
-        if (stream == NULL) {
-          BMM_TLE_STDS();
-          abort();
-        }
-        if (fwrite(dem, sizeof *dem, 1, stream) != 1) {
-          BMM_TLE_STDS();
-          abort();
-        }
-        if (fclose(stream) != 0) {
-          BMM_TLE_STDS();
-          abort();
-        }
-      }
+/// The call `bmm_dem_comm_cadence(dem)`
+/// adjusts the output time step of the simulation `dem`
+/// once a frame has gone out.
+/// The time step is doubled when the consumer falls behind,
+/// halved when the kinetic energy or the effective friction factor jumps
+/// or strong contacts yield in numbers and
+/// doubled when nothing of the sort happens,
+/// always staying within the bounds set by the options.
+__attribute__ ((__nonnull__))
+static void bmm_dem_comm_cadence(struct bmm_dem *const dem) {
+  double const ek = dem->est.eklin_d + dem->est.ekrot_d;
+  double const mueff = dem->est.mueff;
 
-      break;
-    case BMM_DEM_MODE_LOAD:
-      {
-        FILE *const stream = fopen("a.out", "r");
-        if (stream == NULL) {
-          BMM_TLE_STDS();
-          abort();
-        }
-        if (fread(dem, sizeof *dem, 1, stream) != 1) {
-          BMM_TLE_STDS();
-          abort();
-        }
-        if (fclose(stream) != 0) {
-          BMM_TLE_STDS();
-          abort();
-        }
+  double const a = fmax(bmm_dem_comm_jump(ek, dem->comm.cadence.ek),
+      bmm_dem_comm_jump(mueff, dem->comm.cadence.mueff));
 
-        gsl_rng_type const *const t = gsl_rng_env_setup();
-        if (t == NULL) {
-          BMM_TLE_STDS();
+  // Yielding is too sporadic to compare from one frame to the next,
+  // so it is measured against the strong contacts that are still there.
+  size_t const nyield = dem->prof.nyield - dem->comm.cadence.nyield;
 
-          return false;
-        }
+  size_t ncont = nyield;
+  for (size_t ipart = 0; ipart < dem->part.n; ++ipart)
+    ncont += dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].n;
+
+  double const fyield = ncont == 0 ? 0.0 : (double) nyield / (double) ncont;
+
+  // Backpressure wins, because frames that cannot be delivered
+  // do not show anything, however busy the simulation is.
+  double f = 1.0;
+  if (dem->comm.cadence.lost || dem->stats.est.fwait > BMM_CADENCEWAIT)
+    f = 2.0;
+  else if (a > BMM_CADENCEHI || fyield > BMM_CADENCEYIELD)
+    f = 0.5;
+  else if (a < BMM_CADENCELO && nyield == 0)
+    f = 2.0;
+
+  dem->comm.dt = $(bmm_clamp, double)(dem->comm.dt * f,
+      dem->opts.comm.dt * dem->opts.comm.cadence.fmin,
+      dem->opts.comm.dt * dem->opts.comm.cadence.fmax);
+
+  dem->comm.cadence.ek = ek;
+  dem->comm.cadence.mueff = mueff;
+  dem->comm.cadence.nyield = dem->prof.nyield;
+  dem->comm.cadence.lost = false;
+}
 
-        dem->rng = gsl_rng_alloc(t);
-        if (dem->rng == NULL) {
-          BMM_TLE_STDS();
+bool bmm_dem_comm(struct bmm_dem *const dem) {
+  double const toff = dem->time.t - dem->comm.tprev - dem->comm.dt;
 
-          return false;
-        }
-      }
+  if (toff >= 0.0) {
+    dem->comm.tprev = dem->time.t;
 
-      break;
-  }
+    double t = bmm_dem_prof_now(dem);
+
+    bmm_dem_stats_update(dem);
+
+    if (dem->opts.comm.sketch)
+      bmm_dem_sketch_flush(dem);
+
+    // Members of ensembles would interleave their messages,
+    // so they only keep their estimators.
+    if (dem->opts.ens.n == 1) {
+      msgzip = dem->opts.comm.zip != 0 ? &dem->comm.zip : NULL;
+      msglit = dem->opts.comm.lit ? &dem->comm.lit : NULL;
+      msgtrace = bmm_trace_on(&dem->trace) ? &dem->trace : NULL;
+      msgnbyte = &dem->stats.nbyte;
+      double const tsend = bmm_sec_now();
+      bool const result = bmm_dem_comm_send(dem);
+      bmm_trace_span(&dem->trace, 0, "frame", tsend);
+      msgnbyte = NULL;
+      msgtrace = NULL;
+      msglit = NULL;
+      msgzip = NULL;
+
+      if (!result)
+        return false;
+    }
 
-  if (dem->cache.stale || bmm_dem_cache_expired(dem)) {
-    if (!bmm_dem_cache_build(dem))
+    if (!bmm_dem_plug(dem, BMM_PLUG_EV_FRAME))
       return false;
 
-    dem->cache.tprev = dem->time.t;
-  }
+    if (dem->opts.comm.cadence.on)
+      bmm_dem_comm_cadence(dem);
 
-  bmm_dem_predict(dem);
-  bmm_dem_analyze(dem);
-  bmm_dem_force(dem);
-  bmm_dem_accel(dem);
-  bmm_dem_correct(dem);
+    bmm_dem_prof_lap(dem, BMM_DEM_PHASE_COMM, &t);
 
-  if (dem->time.istep % dem->opts.time.istab == 0)
-    bmm_dem_stab(dem);
+    if (dem->opts.field.on)
+      bmm_dem_field_reset(dem);
 
-  dem->time.t += dem->opts.script.dt[dem->script.i];
-  ++dem->time.istep;
+    if (!garbage(dem)) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Nope");
+
+      abort();
+    }
+
+    bmm_dem_prof_lap(dem, BMM_DEM_PHASE_GARBAGE, &t);
+  }
 
   return true;
 }
 
-static FILE *stream;
+static double abserr(size_t const i, double const z, void const *const cls) {
+  double const *const t = cls;
+
+  return z + fabs(t[i]);
+}
 
-static bool pregarbage(struct bmm_dem const *const dem) {
-  stream = fopen("est.data", "w");
-  if (stream == NULL) {
+/// The call `bmm_dem_prof_print(dem)`
+/// prints the profiling data of the simulation `dem`
+/// into the standard error stream.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_prof_print(struct bmm_dem const *const dem) {
+  if (fprintf(stderr, "Phases: Cache %g s, Analyze %g s, Force %g s, "
+        "Integrate %g s, Communicate %g s, Estimate %g s\n",
+        dem->prof.t[BMM_DEM_PHASE_CACHE], dem->prof.t[BMM_DEM_PHASE_ANALYZE],
+        dem->prof.t[BMM_DEM_PHASE_FORCE], dem->prof.t[BMM_DEM_PHASE_INTEG],
+        dem->prof.t[BMM_DEM_PHASE_COMM],
+        dem->prof.t[BMM_DEM_PHASE_GARBAGE]) < 0) {
     BMM_TLE_STDS();
 
     return false;
   }
 
-  return true;
-}
+  if (fprintf(stderr, "Events: Builds %zu, Updates %zu, "
+        "Additions %zu, Removals %zu, Yields %zu\n",
+        dem->prof.nbuild, dem->prof.nupdate,
+        dem->prof.nadd, dem->prof.nrem, dem->prof.nyield) < 0) {
+    BMM_TLE_STDS();
 
-static bool garbage(struct bmm_dem const *const dem) {
-  double const eambdis = dem->est.eambdis;
-  double const epotext = dem->est.epotext_d;
-  double const eklin = dem->est.eklin_d;
-  double const ekrot = dem->est.ekrot_d;
-  double const ewcont = dem->est.ewcont_d;
-  double const escont = dem->est.escont_d;
-  double const edrivnorm = dem->est.edrivnorm;
-  double const edrivtang = dem->est.edrivtang;
-  double const ebond = dem->est.ebond;
-  double const eyieldis = dem->est.eyieldis;
-  double const ewcontdis = dem->est.ewcontdis;
-  double const escontdis = dem->est.escontdis;
-  double const pos = eklin + ekrot + ewcont + escont + epotext;
-  double const dis = eambdis + ewcontdis + escontdis + eyieldis;
-  double const neg = ebond + edrivnorm + edrivtang;
-  double const eee = pos + dis - neg;
+    return false;
+  }
 
-  if (dem->opts.script.mode[dem->script.i] == BMM_DEM_MODE_CRUNCH &&
-      dem->opts.script.params[dem->script.i].crunch.measure)
-    if (fprintf(stream, "%g %g %g %g %g %g %g %g %g %g %g %g %g %g %g\n",
-          dem->time.t,
-          eklin + ekrot, ewcont + escont, epotext,
-          eambdis, ewcontdis + escontdis, eyieldis,
-          ebond, edrivnorm + edrivtang,
-          dem->est.mueff, dem->est.mueffb,
-          dem->est.vdriv[0], dem->est.vdriv[1],
-          dem->script.state.crunch.fdrive[0], dem->script.state.crunch.fdrive[1]) < 0 ||
-        fflush(stream) == EOF) {
+  if (dem->opts.perf.nstep == 0)
+    return true;
+
+  static char const *const phase[BMM_NPHASE] = {
+    [BMM_DEM_PHASE_CACHE] = "Cache",
+    [BMM_DEM_PHASE_ANALYZE] = "Analyze",
+    [BMM_DEM_PHASE_FORCE] = "Force",
+    [BMM_DEM_PHASE_INTEG] = "Integrate",
+    [BMM_DEM_PHASE_COMM] = "Communicate",
+    [BMM_DEM_PHASE_GARBAGE] = "Estimate"
+  };
+
+  if (fprintf(stderr, "Counters: Over %" PRIu64 " steps\n",
+        dem->perf.est.nstep) < 0) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  for (enum bmm_dem_phase iphase = 0; iphase < BMM_NPHASE; ++iphase) {
+    uint64_t const *const n = dem->perf.est.n[iphase];
+
+    if (fprintf(stderr, "%s: Cycles %" PRIu64 ", Instructions %" PRIu64
+          " (%g per cycle), L1D Misses %" PRIu64 ", LLC Misses %" PRIu64
+          ", Branch Misses %" PRIu64 "\n", phase[iphase],
+          n[BMM_DEM_CTR_CYCLE], n[BMM_DEM_CTR_INSTR],
+          n[BMM_DEM_CTR_CYCLE] == 0 ? 0.0 :
+          (double) n[BMM_DEM_CTR_INSTR] / (double) n[BMM_DEM_CTR_CYCLE],
+          n[BMM_DEM_CTR_L1DMISS], n[BMM_DEM_CTR_LLCMISS],
+          n[BMM_DEM_CTR_BRMISS]) < 0) {
       BMM_TLE_STDS();
 
       return false;
     }
+  }
 
   return true;
 }
 
-static bool postgarbage(struct bmm_dem const *const dem) {
-  if (fclose(stream) != 0) {
+/// The call `bmm_dem_stats_print(dem)`
+/// prints the throughput and resource usage
+/// over the latest complete window of the simulation `dem`
+/// into the standard error stream.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_stats_print(struct bmm_dem const *const dem) {
+  if (fprintf(stderr, "Throughput: Steps %g / s, Time %g / s, "
+        "Builds %g / s, Output %g B / s, Waiting %g\n"
+        "Usage: Neighbors %g, Contacts %g, Peak Memory %g B\n",
+        dem->stats.est.vstep, dem->stats.est.vtsim,
+        dem->stats.est.vbuild, dem->stats.est.vbyte, dem->stats.est.fwait,
+        dem->stats.est.nneigh, dem->stats.est.ncont,
+        dem->stats.est.nrss) < 0) {
     BMM_TLE_STDS();
 
     return false;
@@ -4043,53 +11383,63 @@ static bool postgarbage(struct bmm_dem const *const dem) {
   return true;
 }
 
-// TODO This looks just like `bmm_dem_script_trans`.
-bool bmm_dem_comm(struct bmm_dem *const dem) {
-  // TODO Make a mechanism to automate retransmission of differences only.
+/// The call `bmm_dem_trace_dump(dem)`
+/// writes the events traced so far in the simulation `dem`
+/// into a trace file, if tracing is on.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_trace_dump(struct bmm_dem const *const dem) {
+  if (!bmm_trace_on(&dem->trace))
+    return true;
 
-  double const toff = dem->time.t - dem->comm.tprev - dem->opts.comm.dt;
+  char buf[BUFSIZ];
+  bmm_dem_path_ext(buf, sizeof buf, dem, "trace", "", "json");
 
-  if (toff >= 0.0) {
-    dem->comm.tprev = dem->time.t;
+  FILE *const stream = fopen(buf, "w");
+  if (stream == NULL) {
+    BMM_TLE_STDS();
 
-    // TODO Nope.
-    static bool first = true;
-    if (first) {
-      if (!bmm_dem_puts(dem, BMM_MSG_NUM_OPTS))
-        return false;
+    return false;
+  }
 
-      first = false;
-    }
+  bool const result = bmm_trace_dump(&dem->trace, stream);
 
-    if (!bmm_dem_puts(dem, BMM_MSG_NUM_ISTEP))
-      return false;
+  if (fclose(stream) == EOF) {
+    BMM_TLE_STDS();
 
-    if (!bmm_dem_puts(dem, BMM_MSG_NUM_NEIGH))
-      return false;
+    return false;
+  }
 
-    if (!bmm_dem_puts(dem, BMM_MSG_NUM_PARTS))
-      return false;
+  return result;
+}
 
-    if (!bmm_dem_puts(dem, BMM_MSG_NUM_EST))
-      return false;
+bool bmm_dem_report(struct bmm_dem const *const dem) {
+  if (dem->opts.verbose && dem->opts.cache.tune) {
+    if (!dem->tune.done || dem->tune.ibest == SIZE_MAX) {
+      if (fprintf(stderr, "Tuned Cutoff: %s\n",
+            dem->tune.done ? "None" : "Unfinished") < 0) {
+        BMM_TLE_STDS();
 
-    if (!garbage(dem)) {
-      BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Nope");
+        return false;
+      }
+    } else if (fprintf(stderr, "Tuned Cutoff: %g (%zu x %zu cells, "
+          "%g s per step)\n",
+          dem->tune.dcutoff[dem->tune.ibest],
+          dem->opts.cache.ncell[0], dem->opts.cache.ncell[1],
+          dem->tune.t[dem->tune.ibest]) < 0) {
+      BMM_TLE_STDS();
 
-      abort();
+      return false;
     }
   }
 
-  return true;
-}
-
-static double abserr(size_t const i, double const z, void const *const cls) {
-  double const *const t = cls;
+  if (dem->opts.verbose && dem->opts.comm.pub != NULL &&
+      fprintf(stderr, "Subscribers: %zu (%zu frames dropped)\n",
+        dem->comm.pub.nsub, dem->comm.pub.ndrop) < 0) {
+    BMM_TLE_STDS();
 
-  return z + fabs(t[i]);
-}
+    return false;
+  }
 
-bool bmm_dem_report(struct bmm_dem const *const dem) {
   if (dem->opts.verbose) {
     if (fprintf(stderr, "Time Error: %g\n",
           $(bmm_foldl_cls, double)(dem->opts.script.n,
@@ -4110,6 +11460,9 @@ bool bmm_dem_report(struct bmm_dem const *const dem) {
       return false;
     }
 
+    if (!bmm_dem_prof_print(dem))
+      return false;
+
     switch (dem->pair[BMM_DEM_CT_WEAK].tang.tag) {
       case BMM_DEM_TANG_HW:
         if (fprintf(stderr, "HW Dynamic Fraction: %g\n",
@@ -4137,9 +11490,91 @@ bool bmm_dem_report(struct bmm_dem const *const dem) {
   return true;
 }
 
+/// The call `bmm_dem_ckpt_wait(dem, block)`
+/// reaps the process writing the previous checkpoint of the simulation `dem`
+/// if there is one and it has finished or `block` is set.
+/// If the process is still running or finished successfully,
+/// `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_ckpt_wait(struct bmm_dem *const dem, bool const block) {
+  if (dem->ckpt.pid == 0)
+    return true;
+
+  int status;
+  pid_t const pid = waitpid(dem->ckpt.pid, &status, block ? 0 : WNOHANG);
+  if (pid == -1) {
+    BMM_TLE_STDS();
+
+    dem->ckpt.pid = 0;
+
+    return false;
+  }
+
+  if (pid == 0)
+    return true;
+
+  dem->ckpt.pid = 0;
+
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_ASYNC, "Failed to write checkpoint");
+
+    return false;
+  }
+
+  return true;
+}
+
+/// The call `bmm_dem_ckpt(dem)`
+/// synchronizes the estimator output of the simulation `dem`,
+/// saves the simulation into its checkpoint path
+/// and remembers when it did so.
+/// If forking is enabled,
+/// the saving is left to a copy-on-write child process
+/// whose completion is caught as `SIGCHLD`.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_ckpt(struct bmm_dem *const dem) {
+  if (!bmm_dem_est_sync(dem))
+    return false;
+
+  char buf[BUFSIZ];
+  bmm_dem_ckpt_path(buf, sizeof buf, dem, dem->opts.ckpt.path);
+
+  // Members of ensembles share the process and its signals,
+  // so they always save in place.
+  if (dem->opts.ckpt.fork && dem->opts.ens.n == 1) {
+    // Only one writer runs at a time,
+    // so checkpoints replace each other in order.
+    if (!bmm_dem_ckpt_wait(dem, true))
+      return false;
+
+    pid_t const pid = fork();
+    if (pid == -1) {
+      BMM_TLE_STDS();
+
+      return false;
+    }
+
+    // The child must not flush anything it inherited from the parent.
+    if (pid == 0)
+      _exit(bmm_dem_save(dem, buf) ? EXIT_SUCCESS : EXIT_FAILURE);
+
+    dem->ckpt.pid = pid;
+  } else if (!bmm_dem_save(dem, buf))
+    return false;
+
+  dem->ckpt.tprev = dem->time.t;
+
+  return true;
+}
+
 static bool bmm_dem_run_(struct bmm_dem *const dem) {
-  int const sigs[] = {SIGUSR1, SIGUSR2, SIGINT, SIGQUIT, SIGTERM, SIGPIPE};
-  if (bmm_sig_register(sigs, nmembof(sigs)) != SIZE_MAX) {
+  // Members of ensembles share the signal handlers of the ensemble.
+  bool const memb = dem->opts.ens.n != 1;
+
+  int const sigs[] = {SIGUSR1, SIGUSR2, SIGINT, SIGQUIT, SIGTERM, SIGPIPE,
+    SIGCHLD};
+  if (!memb && bmm_sig_register(sigs, nmembof(sigs)) != SIZE_MAX) {
     BMM_TLE_STDS();
 
     return false;
@@ -4148,15 +11583,52 @@ static bool bmm_dem_run_(struct bmm_dem *const dem) {
   if (!pregarbage(dem))
     BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Nope");
 
+  if (dem->opts.ckpt.resume != NULL) {
+    char buf[BUFSIZ];
+    bmm_dem_ckpt_path(buf, sizeof buf, dem, dem->opts.ckpt.resume);
+
+    if (!bmm_dem_load(dem, buf))
+      return false;
+  }
+
+  // Throughput is only measured from here on.
+  bmm_dem_stats_update(dem);
+
+  if (!bmm_dem_plug(dem, BMM_PLUG_EV_STAGE))
+    return false;
+
   for ever {
+    // Every member needs to see the signal,
+    // so members leave it for the others to see as well.
+    if (memb && bmm_sig_set()) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_ASYNC, "Interrupted");
+
+      return false;
+    }
+
     int signum;
-    if (bmm_sig_use(&signum))
+    if (!memb && bmm_sig_use(&signum))
       switch (signum) {
         case SIGUSR1:
         case SIGUSR2:
           fprintf(stderr, "Time: %g, Script: %zu / %zu\n",
               dem->time.t, dem->script.i + 1, dem->opts.script.n);
 
+          if (!bmm_dem_prof_print(dem) || !bmm_dem_stats_print(dem))
+            return false;
+
+          if (signum == SIGUSR2 && !bmm_dem_trace_dump(dem))
+            return false;
+
+          if (signum == SIGUSR1 && dem->opts.ckpt.path != NULL &&
+              !bmm_dem_ckpt(dem))
+            return false;
+
+          break;
+        case SIGCHLD:
+          if (!bmm_dem_ckpt_wait(dem, false))
+            return false;
+
           break;
         case SIGINT:
         case SIGQUIT:
@@ -4176,13 +11648,42 @@ static bool bmm_dem_run_(struct bmm_dem *const dem) {
     if (!bmm_dem_step(dem))
       return false;
 
+    if (!bmm_dem_plug(dem, BMM_PLUG_EV_STEP))
+      return false;
+
+    if (dem->opts.ckpt.path != NULL &&
+        dem->time.t - dem->ckpt.tprev >= dem->opts.ckpt.dt &&
+        !bmm_dem_ckpt(dem))
+      return false;
+
+    size_t const istage = dem->script.i;
+
     if (!bmm_dem_script_trans(dem))
       return true;
+
+    if (dem->script.i != istage &&
+        (!bmm_dem_est_sync(dem) || !bmm_dem_plug(dem, BMM_PLUG_EV_STAGE)))
+      return false;
   }
 
   return true;
 }
 
+size_t bmm_dem_run_for(struct bmm_dem *const dem, size_t const nstep) {
+  for (size_t istep = 0; istep < nstep; ++istep) {
+    if (!bmm_dem_script_ongoing(dem))
+      return istep;
+
+    if (!bmm_dem_step(dem))
+      return SIZE_MAX;
+
+    if (!bmm_dem_script_trans(dem))
+      return istep + 1;
+  }
+
+  return nstep;
+}
+
 bool bmm_dem_trap_on(struct bmm_dem *const dem) {
   if (dem->opts.trap.enabled) {
 #ifdef _GNU_SOURCE
@@ -4220,12 +11721,107 @@ bool bmm_dem_trap_off(struct bmm_dem *const dem) {
   return true;
 }
 
+/// The call `bmm_dem_pin(dem)`
+/// tries to pin each thread of the simulation `dem` to its own processor
+/// among those the process is allowed to run on
+/// and to move the particle arrays onto the memory nodes of the threads.
+/// The pinning lasts over later parallel regions,
+/// because the threading runtime keeps reusing the same threads for them.
+/// Threads that are started before this call are not pinned.
+/// If the operation is successful,
+/// `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_pin(struct bmm_dem *const dem) {
+  if (dem->opts.thread.pin == BMM_DEM_PIN_NONE)
+    return true;
+
+#ifdef _GNU_SOURCE
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof set, &set) == -1) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  int icpu[CPU_SETSIZE];
+  size_t ncpu = 0;
+  for (int i = 0; i < CPU_SETSIZE; ++i)
+    if (CPU_ISSET(i, &set)) {
+      icpu[ncpu] = i;
+      ++ncpu;
+    }
+
+  if (ncpu == 0) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "No processors to pin threads to");
+
+    return false;
+  }
+
+  size_t const nthread = dem->opts.thread.n;
+  bool const spread = dem->opts.thread.pin == BMM_DEM_PIN_SPREAD;
+  int nerr = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads((int) nthread) reduction(|:nerr)
+#endif
+  {
+#ifdef _OPENMP
+    size_t const ithread = (size_t) omp_get_thread_num();
+#else
+    size_t const ithread = 0;
+#endif
+
+    // With more threads than processors, the threads wrap around.
+    size_t const jcpu = spread && nthread <= ncpu ?
+      ithread * ncpu / nthread : ithread % ncpu;
+
+    cpu_set_t one;
+    CPU_ZERO(&one);
+    CPU_SET(icpu[jcpu], &one);
+    nerr |= pthread_setaffinity_np(pthread_self(), sizeof one, &one);
+  }
+
+  if (nerr != 0) {
+    errno = nerr;
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return bmm_dem_recap(dem, dem->part.ncap);
+#else
+  BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Pinning threads is not supported");
+
+  return false;
+#endif
+}
+
 bool bmm_dem_run(struct bmm_dem *const dem) {
 // #define POST_DEBUG
 #ifndef POST_DEBUG
   bmm_dem_trap_on(dem);
 
-  bool const run = bmm_dem_run_(dem);
+  bool const async = dem->opts.comm.async;
+  bool const pub = dem->opts.comm.pub != NULL;
+  bool const start = (!async ||
+      bmm_aio_start(&dem->comm.aio, stdout, dem->opts.comm.lag)) &&
+    (!pub || bmm_pub_start(&dem->comm.pub, dem->opts.comm.pub));
+  bool const pin = start && bmm_dem_pin(dem);
+  bool const perf = pin && bmm_dem_perf_open(dem);
+  bool const trace = perf &&
+    bmm_trace_start(&dem->trace, dem->opts.thread.n, dem->opts.trace.nev);
+  bool const plug = trace && bmm_plug_load(&dem->plug.host,
+      dem->opts.plug.path, dem->opts.plug.n, dem);
+  bool const run = plug && bmm_dem_run_(dem);
+  bool const unload = !plug || bmm_plug_unload(&dem->plug.host);
+  bool const dump = !trace || bmm_dem_trace_dump(dem);
+  bmm_trace_stop(&dem->trace);
+  bmm_dem_perf_close(dem);
+  bool const ckpt = bmm_dem_ckpt_wait(dem, true);
+  bool const stop = !start ||
+    ((!async || bmm_aio_stop(&dem->comm.aio)) &&
+     (!pub || bmm_pub_stop(&dem->comm.pub)));
   bool const report = bmm_dem_report(dem);
 
   bmm_dem_trap_off(dem);
@@ -4235,10 +11831,13 @@ bool bmm_dem_run(struct bmm_dem *const dem) {
 
 #else
   bool const run = true;
+  bool const unload = true;
+  bool const dump = true;
+  bool const ckpt = true;
+  bool const stop = true;
   bool const report = true;
 
   // Uh oh!
-  gsl_rng *const rng = dem->rng;
   FILE *const strim = fopen("a.out", "r");
   if (strim == NULL) {
     BMM_TLE_STDS();
@@ -4252,35 +11851,194 @@ bool bmm_dem_run(struct bmm_dem *const dem) {
     BMM_TLE_STDS();
     abort();
   }
-  dem->rng = rng;
 #endif
 
-  return run && report;
+  return run && unload && dump && ckpt && stop && report;
 }
 
+/// The call `bmm_dem_run_with_(dem)`
+/// runs the simulation `dem`
+/// with a random number generator
+/// that is seeded according to its ensemble membership.
+__attribute__ ((__nonnull__))
 static bool bmm_dem_run_with_(struct bmm_dem *const dem) {
-  gsl_rng_type const *const t = gsl_rng_env_setup();
-  if (t == NULL) {
+  dem->seed = (uint64_t) gsl_rng_default_seed + dem->opts.ens.i;
+
+  return bmm_dem_run(dem);
+}
+
+/// The call `bmm_dem_run_with__(opts)`
+/// works like `bmm_dem_run_with(opts)`,
+/// but does not set up the environment.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_run_with__(struct bmm_dem_opts const *const opts) {
+  struct bmm_dem *const dem = malloc(sizeof *dem);
+  if (dem == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  bool const result = bmm_dem_def(dem, opts) && bmm_dem_run_with_(dem);
+
+  bmm_dem_free(dem);
+
+  free(dem);
+
+  return result;
+}
+
+bool bmm_dem_run_with(struct bmm_dem_opts const *const opts) {
+  if (opts->ens.n != 1) {
+    struct bmm_dem_opts *const ens = malloc(opts->ens.n * sizeof *ens);
+    if (ens == NULL) {
+      BMM_TLE_STDS();
+
+      return false;
+    }
+
+    for (size_t imemb = 0; imemb < opts->ens.n; ++imemb)
+      ens[imemb] = *opts;
+
+    bool const result = bmm_dem_run_ens(ens, opts->ens.n);
+
+    free(ens);
+
+    return result;
+  }
+
+  // This only reads the default seed.
+  if (gsl_rng_env_setup() == NULL) {
     BMM_TLE_STDS();
 
     return false;
   }
 
-  dem->rng = gsl_rng_alloc(t);
-  if (dem->rng == NULL) {
+  return bmm_dem_run_with__(opts);
+}
+
+/// The call `bmm_dem_run_snap(opts, buf, size)`
+/// works like `bmm_dem_run_with__(opts)`,
+/// but resumes from the checkpoint in the buffer `buf` of size `size`
+/// instead of starting over and keeps the random seed it carries.
+__attribute__ ((__nonnull__))
+static bool bmm_dem_run_snap(struct bmm_dem_opts const *const opts,
+    char const *const buf, size_t const size) {
+  struct bmm_dem *const dem = malloc(sizeof *dem);
+  if (dem == NULL) {
     BMM_TLE_STDS();
 
     return false;
   }
 
-  bool const result = bmm_dem_run(dem);
+  bool result = bmm_dem_def(dem, opts);
+
+  if (result) {
+    // Nothing is written through this either.
+    FILE *const stream = fmemopen((char *) buf, size, "rb");
+    if (stream == NULL) {
+      BMM_TLE_STDS();
+
+      result = false;
+    } else {
+      result = bmm_dem_ckpt_read(dem, stream);
+
+      if (fclose(stream) == EOF && result) {
+        BMM_TLE_STDS();
+
+        result = false;
+      }
+    }
+  }
+
+  result = result && bmm_dem_run(dem);
 
-  gsl_rng_free(dem->rng);
+  bmm_dem_free(dem);
+
+  free(dem);
 
   return result;
 }
 
-bool bmm_dem_run_with(struct bmm_dem_opts const *const opts) {
+/// The call `bmm_dem_run_membs(opts, n, buf, size)`
+/// runs `n` members with the simulation options in the array `opts`,
+/// starting each from the checkpoint in the buffer `buf` of size `size`
+/// or from scratch if `buf` is `NULL`.
+__attribute__ ((__nonnull__ (1)))
+static bool bmm_dem_run_membs(struct bmm_dem_opts const *const opts,
+    size_t const n, char const *const buf, size_t const size) {
+  int const sigs[] = {SIGINT, SIGQUIT, SIGTERM, SIGPIPE};
+  if (bmm_sig_register(sigs, nmembof(sigs)) != SIZE_MAX) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  size_t nfail = 0;
+
+  // Members take wildly different amounts of time,
+  // so they are handed out one at a time to whichever thread is free.
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1) reduction(+:nfail) \
+  num_threads((int) opts[0].thread.n)
+#endif
+  for (size_t imemb = 0; imemb < n; ++imemb) {
+    struct bmm_dem_opts memb = opts[imemb];
+    memb.thread.n = 1;
+    memb.thread.pin = BMM_DEM_PIN_NONE;
+    memb.comm.async = false;
+    memb.comm.pub = NULL;
+    memb.ens.n = n;
+    memb.ens.i = imemb;
+
+    // Errors are local to threads, so each member reports its own.
+    if (!(buf == NULL ? bmm_dem_run_with__(&memb) :
+          bmm_dem_run_snap(&memb, buf, size))) {
+      bmm_tle_put();
+
+      ++nfail;
+    }
+  }
+
+  if (nfail != 0) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "%zu of %zu members failed", nfail, n);
+
+    return false;
+  }
+
+  return true;
+}
+
+bool bmm_dem_run_ens(struct bmm_dem_opts const *const opts, size_t const n) {
+  // This is not thread-safe, so it happens before the members start.
+  if (gsl_rng_env_setup() == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return bmm_dem_run_membs(opts, n, NULL, 0);
+}
+
+bool bmm_dem_run_sweep(struct bmm_dem_opts const *const opts, size_t const n,
+    size_t const nprefix) {
+  if (nprefix > opts[0].script.n) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Sweep prefix longer than script");
+
+    return false;
+  }
+
+  if (gsl_rng_env_setup() == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  struct bmm_dem_opts prefix = opts[0];
+  prefix.script.n = nprefix;
+  prefix.ens.n = 1;
+  prefix.ens.i = 0;
+
   struct bmm_dem *const dem = malloc(sizeof *dem);
   if (dem == NULL) {
     BMM_TLE_STDS();
@@ -4288,11 +12046,39 @@ bool bmm_dem_run_with(struct bmm_dem_opts const *const opts) {
     return false;
   }
 
-  bmm_dem_def(dem, opts);
+  char *buf;
+  size_t size;
+  bool const result = bmm_dem_def(dem, &prefix) && bmm_dem_run_with_(dem) &&
+    bmm_dem_snap(&buf, &size, dem);
 
-  bool const result = bmm_dem_run_with_(dem);
+  bmm_dem_free(dem);
 
   free(dem);
 
-  return result;
+  if (!result)
+    return false;
+
+  // The variants start where the prefix left off,
+  // so they have nothing to resume from.
+  struct bmm_dem_opts *const membs = malloc(n * sizeof *membs);
+  if (membs == NULL) {
+    BMM_TLE_STDS();
+
+    free(buf);
+
+    return false;
+  }
+
+  for (size_t imemb = 0; imemb < n; ++imemb) {
+    membs[imemb] = opts[imemb];
+    membs[imemb].ckpt.resume = NULL;
+  }
+
+  bool const run = bmm_dem_run_membs(membs, n, buf, size);
+
+  free(membs);
+
+  free(buf);
+
+  return run;
 }
@@ -3,17 +3,28 @@
 #ifndef BMM_DEM_H
 #define BMM_DEM_H
 
-#include <gsl/gsl_rng.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
 
+#include "aio.h"
 #include "conf.h"
 #include "cpp.h"
 #include "geom2d.h"
 #include "ext.h"
 #include "fp.h"
 #include "io.h"
+#include "kernel.h"
+#include "lit.h"
 #include "msg.h"
+#include "neigh.h"
+#include "plug.h"
+#include "pub.h"
+#include "sketch.h"
+#include "trace.h"
+#include "zip.h"
 
 /// Special particle properties.
 enum bmm_dem_role {
@@ -22,14 +33,61 @@ enum bmm_dem_role {
   /// Fixed particle.
   BMM_DEM_ROLE_FIXED,
   /// Driven particle.
-  BMM_DEM_ROLE_DRIVEN
+  BMM_DEM_ROLE_DRIVEN,
+  /// Number of roles.
+  BMM_DEM_NROLE
 };
 
 /// Cache policies.
 enum bmm_dem_cache {
   BMM_DEM_CACHE_NONE,
   /// Neighbor cell caching.
-  BMM_DEM_CACHE_NEIGH
+  BMM_DEM_CACHE_NEIGH,
+  /// Neighbor cell caching with one lattice for each radius class,
+  /// so that small particles do not search as far as large ones.
+  BMM_DEM_CACHE_LEVEL
+};
+
+/// Orders to keep particles in.
+enum bmm_dem_order {
+  /// Whichever order they were created in.
+  BMM_DEM_ORDER_NONE,
+  /// Along the Hilbert curve of their neighbor cells.
+  BMM_DEM_ORDER_HILBERT,
+  /// In the order of their neighbor cells,
+  /// so that each cell covers a contiguous range of particles.
+  BMM_DEM_ORDER_CELL
+};
+
+/// Ways to pin threads to processors.
+enum bmm_dem_pin {
+  /// Let the operating system move them around.
+  BMM_DEM_PIN_NONE,
+  /// Onto consecutive processors,
+  /// so that neighboring threads share caches and memory nodes.
+  BMM_DEM_PIN_CLOSE,
+  /// Onto processors spread evenly over those available,
+  /// so that threads span as many memory nodes as possible.
+  BMM_DEM_PIN_SPREAD
+};
+
+/// Streams of random numbers,
+/// which keep different kinds of draws independent of each other.
+enum bmm_dem_stream {
+  /// Radii of new particles.
+  BMM_DEM_STREAM_RADIUS,
+  /// Positions of new particles.
+  BMM_DEM_STREAM_POS,
+  /// Perturbations of positions.
+  BMM_DEM_STREAM_PERTURB,
+  /// Velocities of new particles.
+  BMM_DEM_STREAM_VEL,
+  /// Strengths of new links.
+  BMM_DEM_STREAM_STRENGTH,
+  /// Candidates for random sequential addition.
+  BMM_DEM_STREAM_PACK,
+  /// Insertion rounds of triangulated links.
+  BMM_DEM_STREAM_LINK
 };
 
 /// Contact types for pairs of particles.
@@ -42,6 +100,18 @@ enum bmm_dem_ct {
   BMM_NCT
 };
 
+/// Contact quantities whose distributions are sketched.
+enum bmm_dem_sketch {
+  /// Normal force.
+  BMM_DEM_SKETCH_FNORM,
+  /// Tangential force.
+  BMM_DEM_SKETCH_FTANG,
+  /// Overlap.
+  BMM_DEM_SKETCH_XI,
+  /// Number of sketched quantities.
+  BMM_DEM_NSKETCH
+};
+
 /// Endpoints for pairs of particles.
 enum bmm_dem_end {
   /// Back end.
@@ -52,6 +122,50 @@ enum bmm_dem_end {
   BMM_NEND
 };
 
+/// Rigid walls.
+enum bmm_dem_wall {
+  /// Fixed wall at the bottom.
+  BMM_DEM_WALL_BOTTOM,
+  /// Driven wall at the top.
+  BMM_DEM_WALL_TOP,
+  /// Number of walls.
+  BMM_NWALL
+};
+
+/// Phases of a step for profiling.
+enum bmm_dem_phase {
+  /// Rebuilding or updating the neighbor cache.
+  BMM_DEM_PHASE_CACHE,
+  /// Analyzing contacts.
+  BMM_DEM_PHASE_ANALYZE,
+  /// Evaluating forces.
+  BMM_DEM_PHASE_FORCE,
+  /// Integrating.
+  BMM_DEM_PHASE_INTEG,
+  /// Sending messages.
+  BMM_DEM_PHASE_COMM,
+  /// Writing estimators.
+  BMM_DEM_PHASE_GARBAGE,
+  /// Number of phases.
+  BMM_NPHASE
+};
+
+/// Hardware events to count for profiling.
+enum bmm_dem_ctr {
+  /// Processor cycles.
+  BMM_DEM_CTR_CYCLE,
+  /// Retired instructions.
+  BMM_DEM_CTR_INSTR,
+  /// Level 1 data cache read misses.
+  BMM_DEM_CTR_L1DMISS,
+  /// Last level cache misses.
+  BMM_DEM_CTR_LLCMISS,
+  /// Mispredicted branches.
+  BMM_DEM_CTR_BRMISS,
+  /// Number of events.
+  BMM_NCTR
+};
+
 /// Integration schemes.
 enum bmm_dem_integ {
   /// Forward Euler scheme.
@@ -63,7 +177,11 @@ enum bmm_dem_integ {
   /// Beeman (modified) scheme.
   BMM_DEM_INTEG_BEEMAN,
   /// Kuraev (modified) scheme.
-  BMM_DEM_INTEG_KURAEV
+  BMM_DEM_INTEG_KURAEV,
+  /// Reversible reference system propagator algorithm (r-RESPA),
+  /// with strong contacts on velocity Verlet substeps
+  /// inside a velocity Verlet step for everything else.
+  BMM_DEM_INTEG_RESPA
 };
 
 /// External force schemes.
@@ -132,7 +250,11 @@ enum bmm_dem_tang {
 
 /// Bonding criteria.
 enum bmm_dem_bond {
-  BMM_DEM_BOND_NONE
+  BMM_DEM_BOND_NONE,
+  /// Only along the edges of the regular triangulation,
+  /// which is weighted by the squared radii of the particles
+  /// and reduces to the Delaunay triangulation for equal radii.
+  BMM_DEM_BOND_DELAUNAY
 };
 
 /// Yield criteria.
@@ -165,6 +287,8 @@ enum bmm_dem_mode {
   BMM_DEM_MODE_SET_DENSITY,
   /// Create a fixed number of particles, sparse in the y-direction.
   BMM_DEM_MODE_CREATE_GAS,
+  /// Fill the box with a random packing in one batch.
+  BMM_DEM_MODE_CREATE_PACK,
   /// Test systems.
   BMM_DEM_MODE_CREATE_COUPLE,
   BMM_DEM_MODE_CREATE_TRIPLET,
@@ -191,6 +315,9 @@ enum bmm_dem_mode {
   /// Start forcing the top in the x-direction.
   BMM_DEM_MODE_PRECRUNCH,
   BMM_DEM_MODE_CRUNCH,
+  /// Shear the periodic images in the x-direction
+  /// by following the Lees--Edwards boundary conditions.
+  BMM_DEM_MODE_LESHEAR,
   /// Zero estimators.
   BMM_DEM_MODE_ZEROEST,
   /// Debug utilities.
@@ -222,6 +349,17 @@ struct bmm_dem_opts {
     /// Exception mask.
     int mask;
   } trap;
+  /// Nonlinear contact laws.
+  struct {
+    /// Relative error that the square roots in them may have
+    /// or zero to evaluate them exactly.
+    double tol;
+  } nonlin;
+  /// Weak-to-strong bonding criteria.
+  struct {
+    /// Bonding criterion.
+    enum bmm_dem_bond tag;
+  } bond;
   /// Bounding box.
   struct {
     /// Extents.
@@ -236,11 +374,72 @@ struct bmm_dem_opts {
     /// Fault jag height.
     double hjag;
   } fault;
+  /// Rigid walls.
+  struct {
+    /// Let `BMM_DEM_MODE_PRECRUNCH` replace the layers of particles
+    /// it would fix and drive with rigid walls.
+    bool on;
+    /// Wall jag count.
+    size_t njag;
+    /// Wall jag height.
+    double hjag;
+    /// Normal elasticity.
+    double k;
+    /// Normal viscosity.
+    double gamma;
+    /// Tangential viscosity.
+    double gammat;
+    /// Coulomb friction parameter.
+    double mu;
+  } wall;
   /// Timekeeping.
   struct {
     /// Stabilization frequency (frame rule).
     size_t istab;
+    /// Integration scheme.
+    enum bmm_dem_integ integ;
+    /// Adapt the time step to the stiffest contact and the fastest particle,
+    /// using the time step of the current stage as a ceiling.
+    bool adapt;
+    /// Fraction of the oscillation period of the stiffest contact and
+    /// the time it takes the fastest particle to escape the neighbor cache
+    /// that adaptive time steps are allowed to take.
+    double cadapt;
+    /// Number of substeps to integrate strong contacts on.
+    /// If this is greater than one, `BMM_DEM_INTEG_RESPA` is used.
+    size_t nsub;
   } time;
+  /// Sleeping of quiescent groups.
+  struct {
+    /// Let groups of free particles that stay quiet fall asleep,
+    /// so that they are neither integrated nor
+    /// have their mutual contacts analyzed or evaluated.
+    bool on;
+    /// Kinetic energy below which a particle counts as quiet.
+    double ek;
+    /// Net force below which a particle counts as quiet and
+    /// change in the force from its awake neighbors
+    /// that wakes it and its group up again.
+    double f;
+    /// Number of consecutive quiet steps before a particle may fall asleep.
+    size_t nstep;
+  } sleep;
+  /// Rigid clumps.
+  struct {
+    /// Integrate intact fragments of free particles as rigid bodies,
+    /// so that the strong contacts inside them are not evaluated.
+    bool on;
+    /// Number of particles in the smallest fragment to clump.
+    size_t nmin;
+    /// Fraction of the yield criterion
+    /// that every strong contact inside a fragment needs to stay below
+    /// for the fragment to clump and
+    /// that the estimated load on any of them may reach
+    /// before the clump is broken up again.
+    double fyield;
+    /// Number of steps between attempts to clump fragments.
+    size_t nstep;
+  } clump;
   /// Particles.
   struct {
     /// True mass density.
@@ -255,6 +454,8 @@ struct bmm_dem_opts {
     double rnew[2];
     /// Link strengths expressed as the width of the uniform distribution.
     double strnew[2];
+    /// Number of particles to initially reserve room for.
+    size_t ncap;
   } part;
   /// Script to follow.
   struct {
@@ -266,6 +467,22 @@ struct bmm_dem_opts {
     double tspan[BMM_MSTAGE];
     /// Time steps.
     double dt[BMM_MSTAGE];
+    /// Convergence criteria that may end stages before their timespans.
+    /// Every criterion that is not ignored must hold for the stage to end.
+    struct {
+      /// Number of steps between checks or zero to never check.
+      size_t nstep;
+      /// Number of consecutive checks the criteria must hold over.
+      size_t nwin;
+      /// Largest kinetic energy per particle or zero to ignore.
+      double ek;
+      /// Largest standard deviation of the effective macroscopic
+      /// friction factor over the checks or zero to ignore.
+      double dmueff;
+      /// Largest relative spread of the number of contacts
+      /// over the checks or zero to ignore.
+      double dncont;
+    } conv[BMM_MSTAGE];
     /// Parameters.
     union {
       /// For `BMM_DEM_MODE_CREATE`.
@@ -275,6 +492,13 @@ struct bmm_dem_opts {
         /// Spacing factor.
         double cspace;
       } create;
+      /// For `BMM_DEM_MODE_CREATE_PACK`.
+      struct {
+        /// Target packing fraction.
+        double eta;
+        /// Number of attempts per neighbor cell.
+        size_t ntry;
+      } pack;
       /// For `BMM_DEM_MODE_CREATE_*`.
       struct {
         /// Target packing fraction.
@@ -300,6 +524,11 @@ struct bmm_dem_opts {
         /// Pressure target.
         double p;
       } crunch;
+      /// For `BMM_DEM_MODE_LESHEAR`.
+      struct {
+        /// Velocity of the periodic images above the box.
+        double v;
+      } leshear;
       /// For `BMM_DEM_MODE_FAULT`.
       struct {
         /// Fault shape (via indication).
@@ -356,6 +585,46 @@ struct bmm_dem_opts {
   struct {
     /// Time step.
     double dt;
+    /// Adaptive cadence.
+    struct {
+      /// Whether the time step follows activity and backpressure.
+      bool on;
+      /// Smallest time step as a fraction of `dt`.
+      double fmin;
+      /// Largest time step as a multiple of `dt`.
+      double fmax;
+    } cadence;
+    /// Number of frames per keyframe.
+    /// Frames between keyframes only carry differences.
+    size_t nkey;
+    /// Number of bits per quantized position coordinate
+    /// or zero for full precision.
+    size_t nbit;
+    /// Compression level of large messages or zero for none.
+    size_t zip;
+    /// Shuffle the bytes of large messages before compressing them.
+    bool shuffle;
+    /// Terminate messages with a literal instead of sizing them beforehand.
+    bool lit;
+    /// Describe particles and estimators with a schema
+    /// and send them in columns that can be read selectively.
+    bool cols;
+    /// Write output on a separate thread.
+    bool async;
+    /// Policy for when the consumer of asynchronous output falls behind.
+    enum bmm_aio_lag lag;
+    /// Address to publish output at
+    /// or `NULL` to write it into the standard output.
+    char const *pub;
+    /// Send profiling data with every frame.
+    bool prof;
+    /// Send throughput and resource usage with every frame.
+    bool stats;
+    /// Sketch the distributions of contact forces and overlaps
+    /// for every frame.
+    bool sketch;
+    /// Send fragment statistics with every frame.
+    bool frag;
     /// Send this.
     bool flip;
     /// Send that.
@@ -365,15 +634,106 @@ struct bmm_dem_opts {
     /// Send those.
     bool flup;
   } comm;
+  /// Checkpointing.
+  struct {
+    /// Where to save checkpoints or `NULL` if nowhere.
+    char const *path;
+    /// Time between checkpoints.
+    double dt;
+    /// Checkpoint to resume from or `NULL` if none.
+    char const *resume;
+    /// Write checkpoints from a forked copy while stepping continues.
+    bool fork;
+  } ckpt;
+  /// Exports.
+  struct {
+    /// Write the particles and contacts into one binary columnar file
+    /// instead of separate text files.
+    bool bin;
+  } expr;
+  /// Coarse-grained fields.
+  struct {
+    /// Estimate the fields and send them with every frame.
+    bool on;
+    /// Number of grid cells for each dimension
+    /// or zero to follow the interior neighbor cells.
+    size_t ncell[BMM_NDIM];
+    /// Coarse-graining kernel.
+    enum bmm_kernel kernel;
+    /// Bandwidth of the kernel in grid cell widths.
+    double bw;
+    /// Time between samples or zero to sample every step.
+    /// Strong contacts that are integrated on substeps are left out.
+    double dt;
+  } field;
   /// Neighbor cache tuning.
   struct {
+    /// Caching scheme.
+    enum bmm_dem_cache tag;
     /// Number of neighbor cells for each dimension.
     /// There are always at least $3^d$ neighbor cells,
     /// because those outside the bounding extend to infinity.
     size_t ncell[BMM_NDIM];
     /// Maximum distance for qualifying as a neighbor.
     double dcutoff;
+    /// Order to put particles in on every rebuild.
+    enum bmm_dem_order reorder;
+    /// Update the cache partially when only a few particles have moved.
+    bool incr;
+    /// Follow cached neighbors across periodic boundaries as ghost images.
+    bool ghost;
+    /// Rebuild the neighbor cache on a helper thread
+    /// from a snapshot taken shortly before it is predicted to expire.
+    /// This is only done when particles are not reordered.
+    bool spec;
+    /// Analyze contacts and evaluate their forces in one sweep.
+    bool fuse;
+    /// Pick the cutoff and the number of neighbor cells
+    /// by timing a few candidates at the start of the simulation.
+    bool tune;
+    /// Number of steps to time each candidate for.
+    size_t ntune;
   } cache;
+  /// Threading.
+  struct {
+    /// Number of threads to evaluate forces and build caches with.
+    /// In ensembles these threads run whole members instead.
+    size_t n;
+    /// Number of blocks of particles that accumulate forces separately
+    /// or zero for one for each thread.
+    /// Forces only depend on this and not on the number of threads.
+    size_t nacc;
+    /// Processor affinity of the threads.
+    enum bmm_dem_pin pin;
+    /// Back large particle arrays with transparent huge pages.
+    bool huge;
+  } thread;
+  /// Hardware performance counters.
+  struct {
+    /// Number of steps to aggregate the counts of each phase over
+    /// or zero to leave the counters off.
+    size_t nstep;
+  } perf;
+  /// Timeline tracing.
+  struct {
+    /// Number of the most recent events to keep for each thread
+    /// or zero to leave tracing off.
+    size_t nev;
+  } trace;
+  /// In-situ analysis plugins.
+  struct {
+    /// Number of plugins.
+    size_t n;
+    /// Shared objects to load the plugins from.
+    char const *path[BMM_MPLUG];
+  } plug;
+  /// Ensemble membership.
+  struct {
+    /// Number of members or one if this is not part of an ensemble.
+    size_t n;
+    /// Index of this member, which also offsets the random seed.
+    size_t i;
+  } ens;
 };
 
 struct bmm_dem_pair {
@@ -390,6 +750,10 @@ struct bmm_dem_pair {
     struct {
       /// Number of targets.
       size_t n;
+      /// Signature of the target indices
+      /// with one bit set for each target index modulo 64.
+      /// This lets most lookups fail without searching.
+      uint64_t sig;
       /// Target indices.
       size_t itgt[BMM_MCONTACT];
       /// Rest distances.
@@ -400,7 +764,7 @@ struct bmm_dem_pair {
       double strength[BMM_MCONTACT];
       /// Fatigue time (very small).
       size_t tfat[BMM_MCONTACT];
-    } src[BMM_MPART];
+    } *src;
   } cont;
   /// Only contact or more.
   bool cohesive;
@@ -455,15 +819,92 @@ struct bmm_dem_pair {
   } tang;
 };
 
+/// Force accumulator.
+/// Each block of particles gets one of these,
+/// so that contacts can be evaluated without racing to update particles.
+struct bmm_dem_facc {
+  /// Forces.
+  double (*f)[BMM_NDIM];
+  /// Torques.
+  double *tau;
+  /// Weak contact energy.
+  double ewcont;
+  /// Strong contact energy.
+  double escont;
+  /// Energy dissipated in weak contact.
+  double ewcontdis;
+  /// Energy dissipated in strong contact.
+  double escontdis;
+  /// Model usage.
+  size_t hwgamma;
+  size_t hwmu;
+  size_t csk;
+  size_t csmu;
+  /// Contact stresses, which are only accumulated while sampling fields.
+  double (*s)[BMM_NDIM][BMM_NDIM];
+  /// Sketches of the contact distributions,
+  /// which are only filled on sampled steps and `NULL` otherwise.
+  struct bmm_sketch *sketch;
+};
+
+/// Rigid body made of particles held together by strong contacts.
+struct bmm_dem_clump {
+  /// Mass.
+  double m;
+  /// Moment of inertia.
+  double j;
+  /// Center of mass.
+  double x[BMM_NDIM];
+  /// Velocity.
+  double v[BMM_NDIM];
+  /// Orientation relative to the one it was made in.
+  double phi;
+  /// Angular velocity.
+  double omega;
+  /// Net external force.
+  double f[BMM_NDIM];
+  /// Net external torque.
+  double tau;
+  /// Whether it is about to be broken up.
+  bool brk;
+};
+
+/// Coarse-grained fields in one grid cell.
+struct bmm_dem_fcell {
+  /// Mass density.
+  double rho;
+  /// Momentum density.
+  double p[BMM_NDIM];
+  /// Stress with tension being positive.
+  double sigma[BMM_NDIM][BMM_NDIM];
+};
+
+/// Outlines of fragments held together by strong contacts.
+struct bmm_dem_poly {
+  /// Number of polygons.
+  size_t n;
+  /// Offsets of the first vertices of the polygons and
+  /// one offset past the last vertex of the last polygon.
+  size_t *i;
+  /// Particle indices of the vertices in counterclockwise order.
+  size_t *ivert;
+};
+
 struct bmm_dem {
   struct bmm_dem_opts opts;
-  /// Random number generator state.
-  gsl_rng *rng;
+  /// Key of the counter-based random number generator.
+  uint64_t seed;
   /// Floating-point exceptions.
   struct {
     /// Original mask to restore.
     int remask;
   } trap;
+  /// Nonlinear contact laws.
+  struct {
+    /// Number of steps to approximate square roots with
+    /// or `SIZE_MAX` to evaluate them exactly.
+    size_t nsqrt;
+  } nonlin;
   /// Predictor data.
   struct {
     /// Integration scheme.
@@ -473,29 +914,34 @@ struct bmm_dem {
       /// For `BMM_DEM_INTEG_VELVET`.
       struct {
         /// Old accelerations.
-        double ao[BMM_MPART][BMM_NDIM];
+        double (*ao)[BMM_NDIM];
         /// Old angular accelerations.
-        double alphao[BMM_MPART];
+        double *alphao;
       } velvet;
-      /// For `BMM_DEM_INTEG_BEEMAN`.
+      /// For `BMM_DEM_INTEG_BEEMAN` and `BMM_DEM_INTEG_KURAEV`.
+      /// The correctors only move the predicted positions and velocities
+      /// by the difference the new accelerations make,
+      /// so the old positions and velocities need not be kept.
+      /// The very old accelerations are only in use between
+      /// the predictor and the corrector and
+      /// trade places with the old accelerations instead of being copied.
       struct {
-        /// Old displacements.
-        double xo[BMM_MPART][BMM_NDIM];
-        /// Old velocities.
-        double vo[BMM_MPART][BMM_NDIM];
         /// Old accelerations.
-        double ao[BMM_MPART][BMM_NDIM];
+        double (*ao)[BMM_NDIM];
         /// Very old accelerations.
-        double aoo[BMM_MPART][BMM_NDIM];
-        /// Old angular displacements.
-        double phio[BMM_MPART];
-        /// Old angular velocities.
-        double omegao[BMM_MPART];
+        double (*aoo)[BMM_NDIM];
         /// Old angular accelerations.
-        double alphao[BMM_MPART];
+        double *alphao;
         /// Very old angular accelerations.
-        double alphaoo[BMM_MPART];
+        double *alphaoo;
       } beeman;
+      /// For `BMM_DEM_INTEG_RESPA`.
+      struct {
+        /// Forces due to strong contacts.
+        double (*f)[BMM_NDIM];
+        /// Torques due to strong contacts.
+        double *tau;
+      } respa;
     } params;
   } integ;
   /// External forces.
@@ -575,57 +1021,110 @@ struct bmm_dem {
     /// Step.
     size_t istep;
   } time;
+  /// Lees--Edwards boundary conditions.
+  /// These are only in effect when the box is periodic in every direction.
+  struct {
+    /// Velocity of the periodic images above the box.
+    double v;
+    /// Offset of the periodic images above the box.
+    double x;
+  } le;
+  /// Rigid walls.
+  /// The surface of each wall is at the height
+  /// $y + (h / 2) \sin(2 \pi n (x - x_0) / w)$,
+  /// where $h$ and $n$ are the jag height and count and $w$ is the box width.
+  struct {
+    /// Whether the walls are in place.
+    bool on;
+    /// Mean heights $y$ of the surfaces.
+    double y[BMM_NWALL];
+    /// Offsets $x_0$ of the jags.
+    double x[BMM_NWALL];
+    /// Velocities.
+    double v[BMM_NWALL][BMM_NDIM];
+    /// Masses.
+    double m[BMM_NWALL];
+    /// Forces from the particles.
+    double f[BMM_NWALL][BMM_NDIM];
+  } wall;
   /// Particles.
   struct {
     /// Number of particles.
     size_t n;
+    /// Number of particles there is room for.
+    size_t ncap;
     /// Next unused label.
     size_t lnew;
     /// Labels.
-    size_t l[BMM_MPART];
+    size_t *l;
     /// Roles.
-    enum bmm_dem_role role[BMM_MPART];
+    enum bmm_dem_role *role;
+    /// Number of particles with each role.
+    size_t nrole[BMM_DEM_NROLE];
     /// Radii.
-    double r[BMM_MPART];
+    double *r;
     /// Masses.
-    double m[BMM_MPART];
+    double *m;
     /// Reduced moments of inertia.
-    double jred[BMM_MPART];
+    double *jred;
     /// Positions.
-    double x[BMM_MPART][BMM_NDIM];
+    double (*x)[BMM_NDIM];
     /// Velocities.
-    double v[BMM_MPART][BMM_NDIM];
+    double (*v)[BMM_NDIM];
     /// Accelerations.
-    double a[BMM_MPART][BMM_NDIM];
+    double (*a)[BMM_NDIM];
     /// Angles.
-    double phi[BMM_MPART];
+    double *phi;
     /// Angular velocities.
-    double omega[BMM_MPART];
+    double *omega;
     /// Angular accelerations.
-    double alpha[BMM_MPART];
+    double *alpha;
     /// Forces.
-    double f[BMM_MPART][BMM_NDIM];
+    double (*f)[BMM_NDIM];
     /// Torques.
-    double tau[BMM_MPART];
+    double *tau;
   } part;
+  /// Batch of removals.
+  struct {
+    /// Whether the batch is open.
+    bool open;
+    /// Number of particles marked for removal.
+    size_t nrem;
+    /// Whether each particle is marked for removal.
+    bool *rem;
+    /// Which strong contacts of each particle are marked for removal,
+    /// with one bit set for each contact index.
+    /// This is only valid while the contacts are being swept.
+    unsigned int *brk;
+  } batch;
   /// Script state.
   struct {
     /// Current stage (may be one past the end to signal the end).
     size_t i;
+    /// Current time step.
+    double dt;
     /// Previous transition time.
     double tprev;
+    /// Whether the current stage has been set up.
+    bool entered;
     /// Transition times (away from states).
     double ttrans[BMM_MSTAGE];
-    /// Transition time offsets (positive means transition was late).
+    /// Transition time offsets (positive means transition was late
+    /// and negative means the stage converged early).
     double toff[BMM_MSTAGE];
+    /// Checks of the convergence criteria of the current stage.
+    struct {
+      /// Number of consecutive checks that have held.
+      size_t n;
+      /// Sum and sum of squares of the effective macroscopic friction factor.
+      double mueff[2];
+      /// Smallest and largest number of contacts.
+      size_t ncont[2];
+    } conv;
     /// State of the current mode (should be a union, but is not).
     struct {
       /// For `BMM_DEM_MODE_CRUNCH`.
       struct {
-        /// Number of fixed particles.
-        size_t nfix;
-        /// Number of driven particles.
-        size_t ndrive;
         /// Total driving force.
         double fdrive[BMM_NDIM];
       } crunch;
@@ -635,7 +1134,73 @@ struct bmm_dem {
   struct {
     /// Previous message time.
     double tprev;
+    /// Current time step,
+    /// which only departs from `opts.comm.dt` if the cadence is adaptive.
+    double dt;
+    /// Activity indicators and backpressure as of the previous frame.
+    struct {
+      /// Kinetic energy.
+      double ek;
+      /// Effective macroscopic friction factor.
+      double mueff;
+      /// Number of strong contacts yielded so far.
+      size_t nyield;
+      /// Whether frames have been dropped since.
+      bool lost;
+    } cadence;
+    /// Number of frames since the previous keyframe.
+    size_t ikey;
+    /// Number of particles in the previous frame.
+    size_t npart;
+    /// Positions in the previous frame.
+    double (*x)[BMM_NDIM];
+    /// Angles in the previous frame.
+    double *phi;
+    /// Contacts in the previous frame.
+    struct {
+      /// Number of targets.
+      size_t n;
+      /// Target indices.
+      size_t itgt[BMM_MCONTACT];
+    } *src[BMM_NCT];
+    /// Asynchronous writer for the standard output.
+    struct bmm_aio aio;
+    /// Estimator output.
+    FILE *estream;
+    /// Asynchronous writer for estimator output.
+    struct bmm_aio estaio;
+    /// Payload of the message being compressed.
+    struct bmm_zip zip;
+    /// Encoder of literal-terminated messages.
+    struct bmm_lit lit;
+    /// Publisher of output.
+    struct bmm_pub pub;
   } comm;
+  /// Neighbor cache tuning.
+  struct {
+    /// Whether the tuning is over.
+    bool done;
+    /// Candidate being timed.
+    size_t icand;
+    /// Number of steps taken with the candidate.
+    size_t istep;
+    /// Time spent on the candidate before its first step.
+    double tstart;
+    /// Cutoffs of the candidates or zero for those that do not fit.
+    double dcutoff[BMM_NTUNE];
+    /// Time per step spent on the cache, contacts and forces
+    /// with each candidate.
+    double t[BMM_NTUNE];
+    /// Candidate that was picked or `SIZE_MAX` if none was.
+    size_t ibest;
+  } tune;
+  /// Checkpointing.
+  struct {
+    /// Previous checkpoint time.
+    double tprev;
+    /// Process writing the previous checkpoint or zero if none.
+    pid_t pid;
+  } ckpt;
   /// Estimator cache.
   /// This is only used for programmer laziness.
   struct {
@@ -691,7 +1256,189 @@ struct bmm_dem {
     size_t csmu;
     /// BSHP prefactor.
     double bshpp;
+    /// Number of sleeping particles.
+    size_t nsleep;
+    /// Number of sleeping groups.
+    size_t ngsleep;
+    /// Number of rigid clumps.
+    size_t nclump;
+    /// Number of contacts in the quantile sketches.
+    size_t nsketch;
+    /// Quantiles of each sketched contact quantity
+    /// at the levels 0.01, 0.05, 0.25, 0.5, 0.75, 0.95 and 0.99
+    /// over the contacts of the last step before the frame
+    /// or `NAN` if there were none or sketching is off.
+    double quant[BMM_DEM_NSKETCH][BMM_NQUANT];
   } est;
+  /// Profiling data.
+  /// This is only used for performance monitoring.
+  struct {
+    /// Time spent in each phase.
+    double t[BMM_NPHASE];
+    /// Number of full neighbor cache updates.
+    size_t nbuild;
+    /// Number of partial neighbor cache updates.
+    size_t nupdate;
+    /// Number of contacts added.
+    size_t nadd;
+    /// Number of contacts removed.
+    size_t nrem;
+    /// Number of strong contacts yielded.
+    size_t nyield;
+  } prof;
+  /// Hardware performance counters.
+  /// This is only used for performance monitoring.
+  struct {
+    /// Whether the counters are open.
+    bool on;
+    /// Counters of each thread or -1 for those that could not be opened.
+    /// The first counter of each thread leads the group of the others.
+    int fd[BMM_MTHREAD][BMM_NCTR];
+    /// Counts summed over the threads at the end of the previous phase.
+    uint64_t nprev[BMM_NCTR];
+    /// Counts of each phase so far in the current window.
+    uint64_t n[BMM_NPHASE][BMM_NCTR];
+    /// Number of steps so far in the current window.
+    size_t istep;
+    /// Counts of the last complete window.
+    struct {
+      /// Number of steps in the window.
+      uint64_t nstep;
+      /// Counts of each phase.
+      uint64_t n[BMM_NPHASE][BMM_NCTR];
+    } est;
+  } perf;
+  /// Throughput and resource usage.
+  /// This is only used for performance monitoring.
+  struct {
+    /// Number of bytes sent so far.
+    size_t nbyte;
+    /// Time spent waiting for the consumer of the output so far.
+    double twait;
+    /// Totals at the end of the previous window.
+    struct {
+      /// Wall clock time.
+      double t;
+      /// Simulation time.
+      double tsim;
+      /// Step index.
+      size_t istep;
+      /// Number of full neighbor cache updates.
+      size_t nbuild;
+      /// Number of bytes sent.
+      size_t nbyte;
+      /// Time spent waiting for the consumer of the output.
+      double twait;
+    } prev;
+    /// Rates over the previous window and current counts.
+    struct {
+      /// Steps per second.
+      double vstep;
+      /// Simulation time per second.
+      double vtsim;
+      /// Full neighbor cache updates per second.
+      double vbuild;
+      /// Bytes sent per second.
+      double vbyte;
+      /// Fraction of the wall clock time
+      /// spent waiting for the consumer of the output.
+      double fwait;
+      /// Number of neighbors.
+      double nneigh;
+      /// Number of contacts.
+      double ncont;
+      /// Peak resident set size in bytes.
+      double nrss;
+    } est;
+  } stats;
+  /// Timeline of steps, cache rebuilds, stage transitions and messages.
+  /// This is only used for performance monitoring.
+  struct bmm_trace trace;
+  /// In-situ analysis plugins.
+  struct {
+    /// Loaded plugins.
+    struct bmm_plug host;
+    /// Snapshot for the plugins that run on worker threads
+    /// or `NULL` if none has been taken yet.
+    /// Only the particles and contacts are copied into it,
+    /// so the other arrays it points to are still being changed
+    /// and must not be touched.
+    struct bmm_dem *snap;
+    /// Number of particles the arrays of the snapshot have room for.
+    size_t ncap;
+    /// Arrays of the snapshot,
+    /// one for each particle array and contact type.
+    void *col[13 + BMM_NCT];
+  } plug;
+  /// Fragments held together by strong contacts.
+  struct {
+    /// Whether strong contacts or particles have been removed
+    /// since the disjoint sets were last rebuilt.
+    bool stale;
+    /// Disjoint sets with the parent of each particle.
+    size_t *iparent;
+    /// Number of particles in each set, indexed by representative.
+    size_t *nmemb;
+    /// Estimators.
+    struct {
+      /// Number of fragments.
+      size_t n;
+      /// Number of particles in the largest fragment.
+      size_t nmax;
+      /// Number of fragments with at least `2^k` and
+      /// less than `2^(k + 1)` particles for each bin `k`.
+      size_t nsize[BMM_NFRAGBIN];
+    } est;
+  } frag;
+  /// Sleeping groups.
+  struct {
+    /// Whether each particle is asleep.
+    bool *asleep;
+    /// Whether each particle has been disturbed since the last check.
+    bool *poke;
+    /// Number of consecutive quiet steps of each particle.
+    size_t *nquiet;
+    /// Force each sleeping particle got from its awake neighbors
+    /// on its first step asleep or not-a-number before that.
+    double (*fref)[BMM_NDIM];
+    /// Disjoint sets with the parent of each particle,
+    /// joining sleeping particles and quiet particles separately.
+    size_t *iparent;
+    /// Whether each set is to be woken up, indexed by representative.
+    bool *wake;
+  } sleep;
+  /// Rigid clumps.
+  struct {
+    /// Number of clumps.
+    size_t n;
+    /// Clumps, with room for as many as there is for particles.
+    struct bmm_dem_clump *body;
+    /// Clump of each particle or `SIZE_MAX` if it is not in one.
+    size_t *ibody;
+    /// Offset of each particle from the center of mass of its clump
+    /// in the orientation the clump was made in.
+    double (*d)[BMM_NDIM];
+    /// Orientation of each particle relative to its clump.
+    double *dphi;
+    /// Number of strong contacts each particle has inside its clump.
+    size_t *nlink;
+  } clump;
+  /// Coarse-grained fields.
+  struct {
+    /// Whether the current force evaluation is being sampled.
+    bool sample;
+    /// Previous sample time.
+    double tprev;
+    /// Number of samples in the current averaging window.
+    size_t nsample;
+    /// Number of grid cells for each dimension in the current window.
+    size_t ncell[BMM_NDIM];
+    /// Contact stresses of the particles,
+    /// which are halves of the moments of their contact forces.
+    double (*s)[BMM_NDIM][BMM_NDIM];
+    /// Sums of the samples over the current window.
+    struct bmm_dem_fcell cell[BMM_POW(BMM_MCELL, BMM_NDIM)];
+  } field;
   /// Neighbor cache.
   /// This is only used for performance optimization.
   struct {
@@ -705,30 +1452,178 @@ struct bmm_dem {
     double tpart;
     /// Time of previous full update.
     double tprev;
+    /// Lees--Edwards offset at the previous full update.
+    double xle;
     /// Moments of inertia.
-    double j[BMM_MPART];
+    double *j;
     /// Previous positions.
-    double x[BMM_MPART][BMM_NDIM];
+    double (*x)[BMM_NDIM];
     /// Which neighbor cell each particle was in previously.
-    size_t ijcell[BMM_MPART][BMM_NDIM];
+    size_t (*ijcell)[BMM_NDIM];
+    /// Previous positions relative to the lower corners
+    /// of their neighbor cells in single precision.
+    /// This is only used when `BMM_MIXED` is set.
+    float (*xrel)[BMM_NDIM];
     /// Which neighbor cell each particle was in previously, with vengeance.
-    size_t icell[BMM_MPART];
+    size_t *icell;
     /// Which particles were previously in each neighbor cell.
+    /// The particles of all the cells are packed into `ipart`.
     struct {
       /// Number of particles.
       size_t n;
-      /// Particle indices.
-      size_t i[BMM_MGROUP];
+      /// Offset of the first particle in `ipart`.
+      size_t i;
     } part[BMM_POW(BMM_MCELL, BMM_NDIM)];
+    /// Particle indices of the neighbor cells in cell order.
+    size_t *ipart;
+    /// Whether the particles themselves are in cell order,
+    /// in which case `ipart` is the identity permutation.
+    bool sorted;
+    /// Whether the particles are partitioned by role,
+    /// in which case each role occupies one contiguous range.
+    bool parted;
+    /// Neighborhoods of the neighbor cells,
+    /// which are tabulated once for each lattice.
+    /// The tables are only allocated for the cells of the current lattice,
+    /// so that the simulation does not carry them for every possible one.
+    struct {
+      /// Number of cells in each dimension the tables were built for
+      /// or zeros if they have not been built yet.
+      size_t ncell[BMM_NDIM];
+      /// Periodicity the tables were built for.
+      bool per[BMM_NDIM];
+      /// Number of cells the tables have room for.
+      size_t ncap;
+      /// Number of cells in the upper half of each neighborhood.
+      size_t *nupper;
+      /// Cells in the upper half of each neighborhood.
+      size_t (*iupper)[BMM_NEIGH_NMAX(BMM_NDIM)];
+      /// Number of cells in the lower half of each neighborhood.
+      size_t *nlower;
+      /// Cells in the lower half of each neighborhood.
+      size_t (*ilower)[BMM_NEIGH_NMAX(BMM_NDIM)];
+    } stencil;
+    /// How many particles each thread put into each neighbor cell.
+    size_t (*nbin)[BMM_POW(BMM_MCELL, BMM_NDIM)];
+    /// Number of neighbors.
+    size_t nneigh;
+    /// Number of neighbors there is room for.
+    size_t ncapneigh;
     /// Which neighbors each particle previously had.
     /// This only covers half of the Moore neighborhood of a particle.
+    /// The neighbors of all the particles are packed into `ineigh`.
     struct {
       /// Number of neighbors.
       size_t n;
-      /// Neighbor indices.
-      size_t i[BMM_MGROUP * (BMM_POW(3, BMM_NDIM) / 2 + 1)];
-    } neigh[BMM_MPART];
+      /// Offset of the first neighbor in `ineigh`.
+      size_t i;
+    } *neigh;
+    /// Neighbor indices in particle order.
+    size_t *ineigh;
+    /// Ghost images of the neighbors,
+    /// which are only used with `opts.cache.ghost`.
+    /// Each neighbor keeps the periodic image it had when it was cached,
+    /// so that the pair can be followed with plain differences
+    /// until the cache expires.
+    struct {
+      /// Offset of the periodic images above the box
+      /// when the images were taken.
+      double xle;
+      /// How far the periodic images above the box have slid since then.
+      double dle;
+      /// Number of neighbors there is room for.
+      size_t ncap;
+      /// Positions followed continuously from the cached positions.
+      double (*x)[BMM_NDIM];
+      /// Number of periodic images along the y-axis
+      /// each particle has crossed since its position was cached.
+      double *k;
+      /// Offset from each neighbor to its ghost image,
+      /// oriented from the smaller particle index to the larger one.
+      /// This is zero for neighbors that do not straddle a periodic boundary.
+      double (*xoff)[BMM_NDIM];
+      /// Number of periodic images along the y-axis
+      /// between each neighbor and its ghost image.
+      double *kneigh;
+    } ghost;
+    /// Neighbor cells on several levels,
+    /// which are only used with `BMM_DEM_CACHE_LEVEL`.
+    /// Each level holds the particles of one radius class
+    /// in cells that are just wide enough for them,
+    /// with the largest particles on the first level.
+    struct {
+      /// Number of levels.
+      size_t n;
+      /// Half the neighbor cutoff on each level.
+      double reach[BMM_MLEVEL];
+      /// Number of cells in each dimension on each level.
+      size_t ncell[BMM_MLEVEL][BMM_NDIM];
+      /// Index of the first cell of each level,
+      /// followed by the total number of cells.
+      size_t ifirst[BMM_MLEVEL + 1];
+      /// Number of cells there is room for.
+      size_t ncap;
+      /// Which particles are in each cell.
+      /// The particles of all the cells are packed into `ipart`.
+      struct {
+        /// Number of particles.
+        size_t n;
+        /// Offset of the first particle in `ipart`.
+        size_t i;
+      } *part;
+      /// Which level each particle is on.
+      size_t *ilevel;
+      /// Which cell each particle is in.
+      size_t *icell;
+      /// Particle indices in cell order.
+      size_t *ipart;
+    } level;
   } cache;
+  /// Speculative neighbor cache rebuilds,
+  /// which are only used with `opts.cache.spec`.
+  /// This is only used for performance optimization.
+  struct {
+    /// Whether the helper thread is running.
+    bool busy;
+    /// Whether the helper thread failed.
+    /// This is only written by the helper thread and
+    /// only read once it has been joined.
+    bool failed;
+    /// Helper thread.
+    pthread_t thread;
+    /// Number of full neighbor cache updates so far.
+    size_t ibuild;
+    /// Value of `ibuild` when the snapshot was taken,
+    /// which tells whether the cache has been rebuilt since.
+    size_t ibuildsnap;
+    /// Step the current cache was taken on.
+    size_t istep;
+    /// Step the snapshot was taken on.
+    size_t istepsnap;
+    /// Time the snapshot was taken at.
+    double tsnap;
+    /// Number of steps to take the snapshot ahead of the predicted expiry.
+    size_t nlead;
+    /// Simulation holding the snapshot of the particles
+    /// and the neighbor cache the helper thread builds from it.
+    /// Only the parts needed to build the cache are set up.
+    struct bmm_dem *shadow;
+  } spec;
+  /// Force accumulators for each block of particles.
+  /// This is only used for performance optimization.
+  struct {
+    /// The first accumulator aliases the particles and estimators,
+    /// while the others own their force and torque columns.
+    struct bmm_dem_facc acc[BMM_MTHREAD];
+  } thread;
+  /// Contact distributions.
+  struct {
+    /// Whether the current step is sampled.
+    bool sample;
+    /// Sketches of each force accumulator,
+    /// which are only allocated with `opts.comm.sketch`.
+    struct bmm_sketch (*acc)[BMM_DEM_NSKETCH];
+  } sketch;
 };
 
 /// The call `bmm_dem_script_addstage(opts)`
@@ -748,28 +1643,111 @@ __attribute__ ((__nonnull__, __pure__))
 bool bmm_dem_script_ongoing(struct bmm_dem const *);
 
 /// The call `bmm_dem_script_trans(dem)`
-/// transitions the simulation `dem` to the next state and
+/// transitions the simulation `dem` to the next state,
+/// if the timespan of the current stage has elapsed or
+/// its convergence criteria have been met, and
 /// checks whether the simulation did not end while doing so.
 /// Make sure the simulation has not ended prior to the call
 /// by calling `bmm_dem_script_ongoing`.
 __attribute__ ((__nonnull__))
 bool bmm_dem_script_trans(struct bmm_dem *);
 
+/// The call `bmm_dem_cache_reserve(dem, nneigh)`
+/// tries to make room for at least `nneigh` neighbors
+/// in the neighbor cache of the simulation `dem`.
+/// If the operation is successful,
+/// `true` is returned.
+/// Otherwise `false` is returned and
+/// the neighbor cache is left with its old capacity.
+/// All newly reserved storage is zeroed.
+__attribute__ ((__nonnull__))
+bool bmm_dem_cache_reserve(struct bmm_dem *, size_t);
+
 /// The call `bmm_dem_cache_build(dem)`
 /// tries to cache everything that supports caching
 /// in the simulation `dem`.
-/// If there is enough capacity and the operation is successful,
+/// If the operation is successful,
 /// `true` is returned.
 /// Otherwise `false` is returned and
 /// the cache is left in an undefined state.
 __attribute__ ((__nonnull__))
 bool bmm_dem_cache_build(struct bmm_dem *);
 
+/// The call `bmm_dem_cache_update(dem)`
+/// tries to bring the expired cache of the simulation `dem` up to date
+/// by only recaching the particles that have moved far enough and
+/// searching again the neighbors of the cells they left or entered.
+/// If too many particles have moved,
+/// the cache is rebuilt by calling `bmm_dem_cache_build` instead.
+/// If the operation is successful,
+/// `true` is returned.
+/// Otherwise `false` is returned and
+/// the cache is left in an undefined state.
+__attribute__ ((__nonnull__))
+bool bmm_dem_cache_update(struct bmm_dem *);
+
+/// The call `bmm_dem_reserve(dem, npart)`
+/// tries to make room for at least `npart` particles
+/// in the simulation `dem`.
+/// If the operation is successful,
+/// `true` is returned.
+/// Otherwise `false` is returned and
+/// the simulation is left with its old capacity.
+/// All newly reserved storage is zeroed.
+__attribute__ ((__nonnull__))
+bool bmm_dem_reserve(struct bmm_dem *, size_t);
+
+/// The call `bmm_dem_random(dem, istream, l, m, a)`
+/// returns a uniformly distributed number on the interval `a`
+/// for the particle with the label `l` in the simulation `dem`.
+/// The number only depends on the seed, the stream `istream`,
+/// the labels `l` and `m` and the current step,
+/// so it is the same regardless of which thread or process draws it.
+/// The label `m` tells apart several draws for one particle,
+/// such as the components of a vector or the partners of a pair.
+__attribute__ ((__nonnull__, __pure__))
+double bmm_dem_random(struct bmm_dem const *, enum bmm_dem_stream,
+    size_t, size_t, double const *);
+
+/// The call `bmm_dem_setrole(dem, ipart, role)`
+/// assigns the role `role` to the particle `ipart`
+/// in the simulation `dem`,
+/// keeping track of how many particles have each role.
+/// Changing the role marks the neighbor cache as stale,
+/// so that the particles are partitioned by role again
+/// when the cache is next built.
+__attribute__ ((__nonnull__))
+void bmm_dem_setrole(struct bmm_dem *, size_t, enum bmm_dem_role);
+
+/// The call `bmm_dem_role_begin(dem, role)`
+/// returns the index of the first particle with the role `role`
+/// in the simulation `dem`.
+/// Particles are kept partitioned by role,
+/// with free particles first, driven ones second and fixed ones last,
+/// so that the particles with each role form one contiguous range and
+/// the particles that move precede all the fixed ones.
+/// The partition is only guaranteed to hold
+/// while the neighbor cache is not stale.
+/// If the particles are not partitioned,
+/// such as when there are too many contacts to remap them,
+/// the range covers all the particles and
+/// the role of each particle has to be checked individually.
+__attribute__ ((__nonnull__, __pure__))
+size_t bmm_dem_role_begin(struct bmm_dem const *, enum bmm_dem_role);
+
+/// The call `bmm_dem_role_end(dem, role)`
+/// returns the index one past the last particle with the role `role`
+/// in the simulation `dem`.
+/// See `bmm_dem_role_begin`.
+__attribute__ ((__nonnull__, __pure__))
+size_t bmm_dem_role_end(struct bmm_dem const *, enum bmm_dem_role);
+
 /// The call `bmm_dem_addpart(dem)`
 /// tries to place a new particle with unit radius and unit mass
 /// at rest at the origin
 /// in the simulation `dem`.
-/// If there is enough capacity and the operation is successful,
+/// Storage is grown with `bmm_dem_reserve` as necessary.
+/// If there is enough memory and the operation is successful,
 /// the index of the new particle is returned.
 /// Otherwise `SIZE_MAX` is returned.
 /// Note that placing new particles triggers rebuilding all caches
@@ -777,14 +1755,57 @@ bool bmm_dem_cache_build(struct bmm_dem *);
 __attribute__ ((__nonnull__))
 size_t bmm_dem_addpart(struct bmm_dem *);
 
+/// The call `bmm_dem_batch_begin(dem)`
+/// opens a batch of removals in the simulation `dem`.
+/// Particles can be added as usual while the batch is open.
+__attribute__ ((__nonnull__))
+void bmm_dem_batch_begin(struct bmm_dem *);
+
+/// The call `bmm_dem_batch_rempart(dem, ipart)`
+/// marks the particle with the index `ipart`
+/// in the simulation `dem` for removal
+/// once the open batch is committed.
+/// Indices stay the same until then.
+__attribute__ ((__nonnull__))
+void bmm_dem_batch_rempart(struct bmm_dem *, size_t);
+
+/// The call `bmm_dem_batch_commit(dem)`
+/// closes the open batch of the simulation `dem`
+/// by removing the marked particles and their contacts in one pass.
+/// The remaining particles keep their relative order,
+/// but their indices may be reassigned in the process.
+/// If there is enough memory and the operation is successful,
+/// `true` is returned.
+/// Otherwise `false` is returned and the marks are cleared.
+/// Note that removing particles triggers rebuilding all caches
+/// by calling `bmm_dem_cache_build`.
+__attribute__ ((__nonnull__))
+bool bmm_dem_batch_commit(struct bmm_dem *);
+
 /// The call `bmm_dem_rempart(dem, ipart)`
 /// removes the particle with the index `ipart`
-/// in the simulation `dem`.
+/// in the simulation `dem` along with its contacts.
+/// If a batch is open, this works like `bmm_dem_batch_rempart`.
+/// Otherwise the removal is committed right away,
+/// so removing many particles is best done in a batch.
 /// Indices may be reassigned in the process.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
 /// Note that removing particles triggers rebuilding all caches
 /// by calling `bmm_dem_cache_build`.
 __attribute__ ((__nonnull__))
-void bmm_dem_rempart(struct bmm_dem *, size_t);
+bool bmm_dem_rempart(struct bmm_dem *, size_t);
+
+/// The call `bmm_dem_addcont(dem, ict, ipart, jpart)`
+/// places a new contact of the type `ict`
+/// between the particles `ipart` and `jpart`
+/// in the simulation `dem`,
+/// taking the one with the smaller index as its source.
+/// If there is room for the contact,
+/// its index among the contacts of the source is returned.
+/// Otherwise `SIZE_MAX` is returned.
+__attribute__ ((__nonnull__))
+size_t bmm_dem_addcont(struct bmm_dem *, enum bmm_dem_ct, size_t, size_t);
 
 /// The call `bmm_dem_force_pair(dem, ipart, jpart)`
 /// calculates the forces between the particles `ipart` and `jpart`
@@ -798,10 +1819,21 @@ __attribute__ ((__nonnull__))
 void bmm_dem_opts_def(struct bmm_dem_opts *);
 
 /// The call `bmm_dem_def(dem, opts)`
-/// writes the default simulation state into `dem`
-/// with the simulation options `opts`.
+/// tries to write the default simulation state into `dem`
+/// with the simulation options `opts`
+/// and reserve room for `opts->part.ncap` particles.
+/// If the operation is successful,
+/// `true` is returned.
+/// Otherwise `false` is returned.
+/// In either case the resources must be released
+/// by calling `bmm_dem_free`.
 __attribute__ ((__nonnull__))
-void bmm_dem_def(struct bmm_dem *, struct bmm_dem_opts const *);
+bool bmm_dem_def(struct bmm_dem *, struct bmm_dem_opts const *);
+
+/// The call `bmm_dem_free(dem)`
+/// releases the resources held by the simulation `dem`.
+__attribute__ ((__nonnull__))
+void bmm_dem_free(struct bmm_dem *);
 
 __attribute__ ((__nonnull__))
 bool bmm_dem_step(struct bmm_dem *);
@@ -840,15 +1872,133 @@ bool bmm_dem_trap_off(struct bmm_dem *);
 __attribute__ ((__nonnull__))
 bool bmm_dem_run(struct bmm_dem *);
 
+/// The call `bmm_dem_run_for(dem, nstep)`
+/// takes up to `nstep` steps with the simulation state `dem`
+/// without handling messages, signals or plugins,
+/// so that the caller can inspect the state in between.
+/// If the operation is successful,
+/// the number of steps taken is returned,
+/// which is less than `nstep` only if the script ran out.
+/// Otherwise `SIZE_MAX` is returned.
+__attribute__ ((__nonnull__))
+size_t bmm_dem_run_for(struct bmm_dem *, size_t);
+
 /// The call `bmm_dem_run_with(opts)`
 /// processes all incoming messages and
 /// handles signals with the simulation options `opts`.
 __attribute__ ((__nonnull__))
 bool bmm_dem_run_with(struct bmm_dem_opts const *);
 
+/// The call `bmm_dem_run_ens(opts, n)`
+/// runs an ensemble of `n` members
+/// with the simulation options in the array `opts`,
+/// taking members as threads become free.
+/// There are `opts[0].thread.n` such threads and
+/// each member runs serially on one of them,
+/// writing only its own estimators and exports
+/// into files tagged with its index.
+/// Members do not send messages or take asynchronous output.
+/// If every member is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_dem_run_ens(struct bmm_dem_opts const *, size_t);
+
+/// The call `bmm_dem_run_sweep(opts, n, nprefix)`
+/// runs a sweep over `n` variants
+/// with the simulation options in the array `opts`,
+/// whose first `nprefix` stages are assumed to be the same.
+/// Those stages are run only once as an ordinary simulation with `opts[0]`,
+/// after which every variant resumes from an in-memory checkpoint
+/// as a member of an ensemble (see `bmm_dem_run_ens`)
+/// and runs its remaining stages.
+/// Every variant inherits the random seed of the shared stages.
+/// If the shared stages and every variant are successful,
+/// `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_dem_run_sweep(struct bmm_dem_opts const *, size_t, size_t);
+
 __attribute__ ((__nonnull__))
 void bmm_dem_opts_set_rnew(struct bmm_dem_opts *, double const *);
 
+/// The call `bmm_dem_opts_set_dcutoff(opts, dcutoff)`
+/// sets the neighbor cutoff of the options `opts` to `dcutoff` and
+/// derives from it the number of neighbor cells that fit in the box,
+/// up to `BMM_MCELL`.
+__attribute__ ((__nonnull__))
+void bmm_dem_opts_set_dcutoff(struct bmm_dem_opts *, double);
+
+/// The call `bmm_dem_save(dem, path)`
+/// saves the state of the simulation `dem` into the checkpoint `path`.
+/// The checkpoint is first written beside `path` and
+/// then moved over it, so an old checkpoint is never left half-overwritten.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_dem_save(struct bmm_dem const *, char const *);
+
+/// The call `bmm_dem_load(dem, path)`
+/// restores the state of the simulation `dem` from the checkpoint `path`.
+/// The simulation must have been set up with the same options.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_dem_load(struct bmm_dem *, char const *);
+
+/// The call `bmm_dem_analyze(dem)`
+/// adds and removes contacts between neighbors in the simulation `dem`.
+__attribute__ ((__nonnull__))
+void bmm_dem_analyze(struct bmm_dem *);
+
+/// The call `bmm_dem_force(dem)`
+/// evaluates the forces and torques on every particle
+/// in the simulation `dem`.
+__attribute__ ((__nonnull__))
+void bmm_dem_force(struct bmm_dem *);
+
+/// The call `bmm_dem_predict(dem)`
+/// takes the integration step that comes before evaluating forces
+/// in the simulation `dem`.
+__attribute__ ((__nonnull__))
+void bmm_dem_predict(struct bmm_dem *);
+
+/// The call `bmm_dem_correct(dem)`
+/// takes the integration step that comes after evaluating forces
+/// in the simulation `dem`.
+__attribute__ ((__nonnull__))
+void bmm_dem_correct(struct bmm_dem *);
+
+/// The call `bmm_dem_est_raddist(pr, pg, nbin, rmax, dem)`
+/// sets the arrays `pr` and `pg` of length `nbin`
+/// to the radial distribution function of the simulation `dem`
+/// up to the distance `rmax`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_dem_est_raddist(double *, double *, size_t, double,
+    struct bmm_dem const *);
+
+/// The call `bmm_dem_est_poly(poly, dem)`
+/// traces the outline of every fragment of the simulation `dem` into `poly`.
+/// Contacts that wind around periodic boundaries are left out and
+/// dangling chains of particles appear twice, once on each side.
+/// The outlines must later be freed with `bmm_dem_poly_free`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_dem_est_poly(struct bmm_dem_poly *, struct bmm_dem const *);
+
+/// The call `bmm_dem_est_frag(dem)`
+/// updates the fragment estimators of the simulation `dem`,
+/// rebuilding its disjoint sets first if they went stale.
+__attribute__ ((__nonnull__))
+void bmm_dem_est_frag(struct bmm_dem *);
+
+/// The call `bmm_dem_poly_free(poly)`
+/// releases the outlines `poly`.
+__attribute__ ((__nonnull__))
+void bmm_dem_poly_free(struct bmm_dem_poly *);
+
 // TODO These are questionable to expose.
 
 size_t bmm_dem_sniff_size(struct bmm_dem const *const dem,
@@ -1,3 +1,61 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
 #include "endy.h"
 
 extern inline enum bmm_endy bmm_endy_get(void);
+
+void bmm_endy_swap(void *const ptr, size_t const n, size_t const size) {
+  unsigned char *const buf = ptr;
+
+  // The common word sizes are spelled out,
+  // so that the compiler can turn them into vector shuffles.
+  switch (size) {
+    case 1:
+      return;
+    case 2:
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for (size_t i = 0; i < n; ++i) {
+        uint16_t x;
+        (void) memcpy(&x, &buf[i * sizeof x], sizeof x);
+        x = __builtin_bswap16(x);
+        (void) memcpy(&buf[i * sizeof x], &x, sizeof x);
+      }
+
+      return;
+    case 4:
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for (size_t i = 0; i < n; ++i) {
+        uint32_t x;
+        (void) memcpy(&x, &buf[i * sizeof x], sizeof x);
+        x = __builtin_bswap32(x);
+        (void) memcpy(&buf[i * sizeof x], &x, sizeof x);
+      }
+
+      return;
+    case 8:
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for (size_t i = 0; i < n; ++i) {
+        uint64_t x;
+        (void) memcpy(&x, &buf[i * sizeof x], sizeof x);
+        x = __builtin_bswap64(x);
+        (void) memcpy(&buf[i * sizeof x], &x, sizeof x);
+      }
+
+      return;
+  }
+
+  for (size_t i = 0; i < n; ++i)
+    for (size_t j = 0; j < size / 2; ++j) {
+      unsigned char const c = buf[i * size + j];
+      buf[i * size + j] = buf[i * size + size - 1 - j];
+      buf[i * size + size - 1 - j] = c;
+    }
+}
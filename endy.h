@@ -4,6 +4,7 @@
 #define BMM_ENDY_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "ext.h"
@@ -58,4 +59,11 @@ inline enum bmm_endy bmm_endy_get(void) {
 #endif
 }
 
+/// The call `bmm_endy_swap(buf, n, size)`
+/// reverses the order of the bytes in each of the `n` words
+/// of `size` bytes in the buffer `buf`,
+/// converting them between little-endian and big-endian.
+__attribute__ ((__nonnull__))
+void bmm_endy_swap(void *, size_t, size_t);
+
 #endif
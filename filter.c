@@ -1,18 +1,38 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "common.h"
 #include "conf.h"
 #include "filter.h"
 #include "fp.h"
 #include "io.h"
+#include "lit.h"
 #include "msg.h"
 #include "sig.h"
+#include "sock.h"
+#include "store.h"
 #include "tle.h"
+#include "zip.h"
 
 void bmm_filter_opts_def(struct bmm_filter_opts *const opts) {
   opts->verbose = false;
+  opts->zcopy = true;
+  opts->store = false;
+  opts->sub = NULL;
+  opts->load = NULL;
+  opts->every = 1;
+  opts->from = -INFINITY;
+  opts->to = INFINITY;
+  opts->ntee = 0;
 
   for (size_t imsg = 0; imsg < BMM_MMSG; ++imsg)
     opts->mask[imsg] = false;
@@ -21,6 +41,24 @@ void bmm_filter_opts_def(struct bmm_filter_opts *const opts) {
 void bmm_filter_def(struct bmm_filter *const filter,
     struct bmm_filter_opts const *const opts) {
   filter->opts = *opts;
+  filter->path = BMM_FILTER_PATH_STDIO;
+  filter->pipeout = false;
+  filter->null = -1;
+  filter->peek[0] = -1;
+  filter->peek[1] = -1;
+  filter->nhdr = 0;
+  filter->body = NULL;
+  filter->ncapbody = 0;
+  bmm_lit_def(&filter->lit);
+  filter->frame = true;
+  filter->nframe = 0;
+
+  for (size_t itee = 0; itee < BMM_MTEE; ++itee) {
+    filter->out[itee].fd = -1;
+    filter->out[itee].pipe = false;
+    filter->out[itee].frame = true;
+  }
+
   filter->passed = 0;
   filter->stopped = 0;
 }
@@ -30,68 +68,686 @@ static bool pass(struct bmm_filter const *const filter,
   return filter->opts.mask[(size_t) num];
 }
 
+/// The call `direct(filter)`
+/// checks whether the filter state `filter`
+/// moves payloads behind the backs of the standard streams.
+static bool direct(struct bmm_filter const *const filter) {
+  return filter->path == BMM_FILTER_PATH_PIPE ||
+    filter->path == BMM_FILTER_PATH_FILE;
+}
+
 static enum bmm_io_read msg_read(void *buf, size_t const n,
-    __attribute__ ((__unused__)) void *const ptr) {
-  return bmm_io_readin(buf, n);
+    void *const ptr) {
+  struct bmm_filter *const filter = ptr;
+
+  if (bmm_lit_ongoing(&filter->lit))
+    return bmm_lit_read(&filter->lit, buf, n);
+
+  if (filter->path == BMM_FILTER_PATH_STORE)
+    return bmm_store_read(&filter->reader, buf, n);
+
+  // The standard streams must not buffer anything
+  // when the payloads are moved behind their backs.
+  return direct(filter) ?
+    bmm_io_read(STDIN_FILENO, buf, n) : bmm_io_readin(buf, n);
+}
+
+/// The call `msg_peek(buf, n, ptr)`
+/// looks ahead in the standard input
+/// when payloads are moved behind the backs of the standard streams.
+static size_t msg_peek(void *const buf, size_t const n,
+    void *const ptr) {
+  struct bmm_filter const *const filter = ptr;
+
+  if (filter->path == BMM_FILTER_PATH_PIPE) {
+    // Whatever is duplicated has to be drained right away.
+    size_t const m = bmm_io_tee(filter->peek[1], STDIN_FILENO, n);
+
+    return m != 0 &&
+      bmm_io_read(filter->peek[0], buf, m) == BMM_IO_READ_SUCCESS ? m : 0;
+  }
+
+  off_t const off = lseek(STDIN_FILENO, 0, SEEK_CUR);
+  if (off == -1)
+    return 0;
+
+  ssize_t const m = pread(STDIN_FILENO, buf, n, off);
+
+  return m == -1 ? 0 : (size_t) m;
 }
 
 static bool msg_write(void const *buf, size_t const n,
-    __attribute__ ((__unused__)) void *const ptr) {
-  return bmm_io_writeout(buf, n);
+    void *const ptr) {
+  struct bmm_filter *const filter = ptr;
+
+  // Headers are held back until it is known where the message goes.
+  if (n > sizeof filter->hdr - filter->nhdr) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Header too long");
+
+    return false;
+  }
+
+  (void) memcpy(&filter->hdr[filter->nhdr], buf, n);
+  filter->nhdr += n;
+
+  return true;
+}
+
+/// The call `bmm_filter_write(filter, buf, n)`
+/// writes `n` bytes from `buf` into the standard output.
+__attribute__ ((__nonnull__))
+static bool bmm_filter_write(struct bmm_filter const *const filter,
+    void const *const buf, size_t const n) {
+  return direct(filter) ?
+    bmm_io_write(STDOUT_FILENO, buf, n) : bmm_io_writeout(buf, n);
+}
+
+/// The call `bmm_filter_sub(filter)`
+/// subscribes to the publisher of `filter`,
+/// telling it which messages to send, and
+/// puts the connection in place of the standard input.
+__attribute__ ((__nonnull__))
+static bool bmm_filter_sub(struct bmm_filter const *const filter) {
+  int const fd = bmm_sock_connect(filter->opts.sub);
+  if (fd == -1)
+    return false;
+
+  // The publisher has to send everything that any output wants.
+  unsigned char buf[BMM_MMSG];
+  for (size_t imsg = 0; imsg < BMM_MMSG; ++imsg) {
+    buf[imsg] = filter->opts.mask[imsg] ? 1 : 0;
+
+    for (size_t itee = 0; itee < filter->opts.ntee; ++itee)
+      if (filter->opts.tee[itee].mask[imsg])
+        buf[imsg] = 1;
+  }
+
+  if (!bmm_sock_send(fd, buf, sizeof buf) ||
+      dup2(fd, STDIN_FILENO) == -1) {
+    BMM_TLE_STDS();
+
+    (void) close(fd);
+
+    return false;
+  }
+
+  if (close(fd) == -1) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return true;
+}
+
+/// The call `bmm_filter_load(filter)`
+/// opens the container of `filter` and
+/// seeks to the first frame within the time window.
+__attribute__ ((__nonnull__))
+static bool bmm_filter_load(struct bmm_filter *const filter) {
+  struct bmm_store_reader *const reader = &filter->reader;
+
+  if (!bmm_store_open(reader, filter->opts.load))
+    return false;
+
+  size_t iframe = 0;
+  while (iframe < reader->nframe &&
+      reader->entry[reader->frame[iframe]].t < filter->opts.from)
+    ++iframe;
+
+  if (iframe != 0 && !bmm_store_seek(reader, iframe)) {
+    (void) bmm_store_close(reader);
+
+    return false;
+  }
+
+  filter->path = BMM_FILTER_PATH_STORE;
+
+  return true;
+}
+
+/// The call `bmm_filter_tee(filter)`
+/// opens the additional outputs of `filter`.
+__attribute__ ((__nonnull__))
+static bool bmm_filter_tee(struct bmm_filter *const filter) {
+  for (size_t itee = 0; itee < filter->opts.ntee; ++itee) {
+    struct bmm_filter_out *const out = &filter->out[itee];
+
+    out->fd = open(filter->opts.tee[itee].path,
+        O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (out->fd == -1) {
+      BMM_TLE_STDS();
+
+      return false;
+    }
+
+    struct stat st;
+    if (fstat(out->fd, &st) == -1) {
+      BMM_TLE_STDS();
+
+      return false;
+    }
+
+    out->pipe = S_ISFIFO(st.st_mode);
+  }
+
+  return true;
+}
+
+bool bmm_filter_open(struct bmm_filter *const filter) {
+  if (filter->opts.sub != NULL && filter->opts.load != NULL) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_PARSE, "Cannot subscribe and load at once");
+
+    return false;
+  }
+
+  if (filter->opts.sub != NULL && !bmm_filter_sub(filter))
+    return false;
+
+  if (filter->opts.load != NULL && !bmm_filter_load(filter))
+    return false;
+
+  if (!bmm_filter_tee(filter))
+    return false;
+
+  if (filter->opts.store)
+    return bmm_store_begin(&filter->writer, stdout);
+
+  if (!filter->opts.zcopy || filter->path == BMM_FILTER_PATH_STORE)
+    return true;
+
+#ifdef _GNU_SOURCE
+
+  struct stat stin;
+  struct stat stout;
+  if (fstat(STDIN_FILENO, &stin) == -1 ||
+      fstat(STDOUT_FILENO, &stout) == -1) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  filter->pipeout = S_ISFIFO(stout.st_mode);
+
+  if (S_ISFIFO(stin.st_mode)) {
+    filter->null = open("/dev/null", O_WRONLY);
+    if (filter->null == -1) {
+      BMM_TLE_STDS();
+
+      return false;
+    }
+
+    if (pipe(filter->peek) == -1) {
+      BMM_TLE_STDS();
+
+      return false;
+    }
+
+    filter->path = BMM_FILTER_PATH_PIPE;
+  } else if (S_ISREG(stin.st_mode)) {
+    // Sending into a file that is open for appending is not supported.
+    if (!filter->pipeout) {
+      int const flags = fcntl(STDOUT_FILENO, F_GETFL);
+      if (flags == -1) {
+        BMM_TLE_STDS();
+
+        return false;
+      }
+
+      if ((flags & O_APPEND) != 0)
+        return true;
+    }
+
+    filter->path = BMM_FILTER_PATH_FILE;
+  }
+#endif
+
+  return true;
+}
+
+bool bmm_filter_close(struct bmm_filter *const filter) {
+  bool result = true;
+
+  free(filter->body);
+  filter->body = NULL;
+  filter->ncapbody = 0;
+
+  bmm_lit_free(&filter->lit);
+  bmm_lit_def(&filter->lit);
+
+  if (filter->opts.store && !bmm_store_end(&filter->writer))
+    result = false;
+
+  if (filter->path == BMM_FILTER_PATH_STORE &&
+      !bmm_store_close(&filter->reader))
+    result = false;
+
+  if (filter->null != -1) {
+    if (close(filter->null) == -1) {
+      BMM_TLE_STDS();
+
+      result = false;
+    }
+
+    filter->null = -1;
+  }
+
+  for (size_t ipeek = 0; ipeek < nmembof(filter->peek); ++ipeek)
+    if (filter->peek[ipeek] != -1) {
+      if (close(filter->peek[ipeek]) == -1) {
+        BMM_TLE_STDS();
+
+        result = false;
+      }
+
+      filter->peek[ipeek] = -1;
+    }
+
+  for (size_t itee = 0; itee < BMM_MTEE; ++itee)
+    if (filter->out[itee].fd != -1) {
+      if (close(filter->out[itee].fd) == -1) {
+        BMM_TLE_STDS();
+
+        result = false;
+      }
+
+      filter->out[itee].fd = -1;
+    }
+
+  return result;
+}
+
+/// The call `bmm_filter_reserve(filter, size)`
+/// makes room for a payload of `size` bytes in `filter`.
+__attribute__ ((__nonnull__))
+static bool bmm_filter_reserve(struct bmm_filter *const filter,
+    size_t const size) {
+  if (size > filter->ncapbody) {
+    unsigned char *const ptr = realloc(filter->body, size);
+    if (ptr == NULL) {
+      BMM_TLE_STDS();
+
+      return false;
+    }
+
+    filter->body = ptr;
+    filter->ncapbody = size;
+  }
+
+  return true;
+}
+
+/// The call `bmm_filter_take(filter, size)`
+/// reads a payload of `size` bytes from the input into `filter`.
+__attribute__ ((__nonnull__))
+static bool bmm_filter_take(struct bmm_filter *const filter,
+    size_t const size) {
+  if (!bmm_filter_reserve(filter, size))
+    return false;
+
+  switch (msg_read(filter->body, size, filter)) {
+    case BMM_IO_READ_EOF:
+      BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+    case BMM_IO_READ_ERROR:
+      return false;
+  }
+
+  return true;
+}
+
+/// The call `bmm_filter_give(filter, num, size)`
+/// writes the payload of `size` bytes that is held in `filter`
+/// into the container or the standard output.
+__attribute__ ((__nonnull__))
+static bool bmm_filter_give(struct bmm_filter *const filter,
+    enum bmm_msg_num const num, size_t const size) {
+  if (filter->opts.store) {
+    size_t const nhdr = filter->nhdr;
+    filter->nhdr = 0;
+
+    return bmm_store_put(&filter->writer, num,
+        filter->hdr, nhdr, filter->body, size);
+  }
+
+  return bmm_filter_write(filter, filter->body, size);
+}
+
+/// The call `bmm_filter_keep(filter, num, size)`
+/// moves a payload of `size` bytes
+/// from the standard input into the container.
+__attribute__ ((__nonnull__))
+static bool bmm_filter_keep(struct bmm_filter *const filter,
+    enum bmm_msg_num const num, size_t const size) {
+  return bmm_filter_take(filter, size) && bmm_filter_give(filter, num, size);
+}
+
+/// The call `bmm_filter_pass(filter, size)`
+/// moves a payload of `size` bytes
+/// from the standard input into the standard output.
+__attribute__ ((__nonnull__))
+static bool bmm_filter_pass(struct bmm_filter *const filter,
+    size_t const size) {
+  switch (filter->path) {
+    case BMM_FILTER_PATH_STORE:
+      // There is no point in holding the whole payload at once.
+      for (size_t n = 0; n < size; n += BUFSIZ) {
+        size_t const m = $(bmm_min, size_t)(size - n, BUFSIZ);
+        if (!bmm_filter_take(filter, m) || !bmm_io_writeout(filter->body, m))
+          return false;
+      }
+
+      return true;
+    case BMM_FILTER_PATH_STDIO:
+      return bmm_io_redirio(size);
+    case BMM_FILTER_PATH_PIPE:
+      return bmm_io_splice(STDOUT_FILENO, STDIN_FILENO, size) == size;
+    case BMM_FILTER_PATH_FILE:
+      return (filter->pipeout ?
+          bmm_io_splice(STDOUT_FILENO, STDIN_FILENO, size) :
+          bmm_io_sendfile(STDOUT_FILENO, STDIN_FILENO, size)) == size;
+  }
+
+  dynamic_assert(false, "Nonexhaustive switch");
+}
+
+/// The call `bmm_filter_stop(filter, size)`
+/// discards a payload of `size` bytes from the standard input.
+__attribute__ ((__nonnull__))
+static enum bmm_io_read bmm_filter_stop(struct bmm_filter *const filter,
+    size_t const size) {
+  size_t n = 0;
+
+  errno = 0;
+
+  switch (filter->path) {
+    case BMM_FILTER_PATH_STDIO:
+      return bmm_io_fastfwin(size);
+    case BMM_FILTER_PATH_PIPE:
+      n = bmm_io_splice(filter->null, STDIN_FILENO, size);
+
+      break;
+    case BMM_FILTER_PATH_FILE:
+      n = bmm_io_seek(STDIN_FILENO, size);
+
+      break;
+    case BMM_FILTER_PATH_STORE:
+      return bmm_store_fastfw(&filter->reader, size);
+  }
+
+  if (n == size)
+    return BMM_IO_READ_SUCCESS;
+  else if (errno == 0)
+    return BMM_IO_READ_EOF;
+  else
+    return BMM_IO_READ_ERROR;
+}
+
+/// The call `bmm_filter_fork(filter, main, want, num, size)`
+/// moves a payload of `size` bytes from the standard input
+/// into the standard output if `main` is set and
+/// into each additional output `itee` for which `want[itee]` is set.
+__attribute__ ((__nonnull__))
+static bool bmm_filter_fork(struct bmm_filter *const filter,
+    bool const main, bool const *const want,
+    enum bmm_msg_num const num, size_t const size) {
+  int fd[BMM_MTEE + 1];
+  size_t nfd = 0;
+  bool zcopy = filter->path == BMM_FILTER_PATH_PIPE;
+
+  for (size_t itee = 0; itee < filter->opts.ntee; ++itee)
+    if (want[itee]) {
+      fd[nfd] = filter->out[itee].fd;
+      ++nfd;
+
+      if (!filter->out[itee].pipe)
+        zcopy = false;
+    }
+
+  if (main) {
+    fd[nfd] = STDOUT_FILENO;
+    ++nfd;
+
+    if (filter->opts.store || !filter->pipeout)
+      zcopy = false;
+  }
+
+  if (!zcopy) {
+    if (!bmm_filter_take(filter, size))
+      return false;
+
+    for (size_t itee = 0; itee < filter->opts.ntee; ++itee)
+      if (want[itee] &&
+          !bmm_io_write(filter->out[itee].fd, filter->body, size))
+        return false;
+
+    return !main || bmm_filter_give(filter, num, size);
+  }
+
+  if (nfd == 1)
+    return bmm_io_splice(fd[0], STDIN_FILENO, size) == size;
+
+  // Every output but the last one gets a duplicate of the contents
+  // of the input pipe and the last one consumes them,
+  // unless some output is too full to take everything,
+  // in which case the rest is copied through user space.
+  size_t ndup[BMM_MTEE + 1];
+
+  for (size_t progress = 0; progress < size; ) {
+    errno = 0;
+
+    size_t const n = bmm_io_tee(fd[0], STDIN_FILENO, size - progress);
+    if (n == 0) {
+      if (errno == 0)
+        BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+      else
+        BMM_TLE_STDS();
+
+      return false;
+    }
+
+    ndup[0] = n;
+
+    bool whole = true;
+    for (size_t ifd = 1; ifd < nfd - 1; ++ifd) {
+      ndup[ifd] = bmm_io_tee(fd[ifd], STDIN_FILENO, n);
+
+      if (ndup[ifd] != n)
+        whole = false;
+    }
+
+    if (whole) {
+      if (bmm_io_splice(fd[nfd - 1], STDIN_FILENO, n) != n) {
+        BMM_TLE_STDS();
+
+        return false;
+      }
+    } else {
+      if (!bmm_filter_take(filter, n))
+        return false;
+
+      for (size_t ifd = 0; ifd < nfd - 1; ++ifd)
+        if (!bmm_io_write(fd[ifd], &filter->body[ndup[ifd]], n - ndup[ifd]))
+          return false;
+
+      if (!bmm_io_write(fd[nfd - 1], filter->body, n))
+        return false;
+    }
+
+    progress += n;
+  }
+
+  return true;
 }
 
 enum bmm_io_read bmm_filter_step(struct bmm_filter *const filter) {
   struct bmm_msg_spec spec;
-  switch (bmm_msg_spec_read(&spec, msg_read, NULL)) {
+  switch (bmm_msg_spec_read(&spec, msg_read, filter)) {
     case BMM_IO_READ_ERROR:
       return BMM_IO_READ_ERROR;
     case BMM_IO_READ_EOF:
       return BMM_IO_READ_EOF;
   }
 
+  // Literal-terminated messages have to be decoded whole to find their ends,
+  // after which they can just as well go on with their sizes known.
+  bool const lit = spec.tag == BMM_MSG_TAG_LT;
+  if (lit) {
+    switch (bmm_lit_open(&filter->lit, &spec, msg_read,
+          direct(filter) ? msg_peek : NULL, filter)) {
+      case BMM_IO_READ_EOF:
+        BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+      case BMM_IO_READ_ERROR:
+        return BMM_IO_READ_ERROR;
+    }
+
+    if (filter->lit.nraw < BMM_MSG_NUMSIZE) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Message too short");
+
+      return BMM_IO_READ_ERROR;
+    }
+
+    spec.tag = BMM_MSG_TAG_SP;
+    spec.msg.size = filter->lit.nraw;
+  }
+
   enum bmm_msg_num num;
-  switch (bmm_msg_num_read(&num, msg_read, NULL)) {
+  switch (bmm_msg_num_read(&num, msg_read, filter)) {
     case BMM_IO_READ_EOF:
       BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
     case BMM_IO_READ_ERROR:
       return BMM_IO_READ_ERROR;
   }
 
-  if (pass(filter, num)) {
-    if (!bmm_msg_spec_write(&spec, msg_write, NULL) ||
-        !bmm_msg_num_write(&num, msg_write, NULL))
+  size_t size = spec.msg.size - BMM_MSG_NUMSIZE;
+
+  // Compressed messages are judged by the message they wrap,
+  // which is known from their header alone.
+  bool zip = false;
+  struct bmm_zip_head head;
+  if (num == BMM_MSG_NUM_ZIP) {
+    if (size < BMM_ZIP_HEADSIZE) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Compressed message too short");
+
       return BMM_IO_READ_ERROR;
+    }
 
-    switch (spec.tag) {
-      case BMM_MSG_TAG_SP:
-        if (!bmm_io_redirio(spec.msg.size - BMM_MSG_NUMSIZE))
-          return BMM_IO_READ_ERROR;
+    switch (bmm_zip_head_read(&head, msg_read, filter)) {
+      case BMM_IO_READ_EOF:
+        BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+      case BMM_IO_READ_ERROR:
+        return BMM_IO_READ_ERROR;
+    }
+
+    zip = true;
+    size -= BMM_ZIP_HEADSIZE;
+  }
+
+  enum bmm_msg_num const inner = zip ? head.num : num;
+
+  // Frames are judged by the time in the message that begins them,
+  // which is the first member of its payload.
+  bool held = false;
+  if (lit || inner == BMM_MSG_NUM_ISTEP) {
+    if (!bmm_filter_take(filter, size))
+      return BMM_IO_READ_ERROR;
+
+    held = true;
+  }
+
+  if (inner == BMM_MSG_NUM_ISTEP) {
+    if (zip || size < sizeof (double)) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Malformed frame");
+
+      return BMM_IO_READ_ERROR;
+    }
+
+    double t;
+    (void) memcpy(&t, filter->body, sizeof t);
+
+    if (t > filter->opts.to)
+      return BMM_IO_READ_EOF;
+
+    bool const window = t >= filter->opts.from;
+
+    filter->frame = window && filter->nframe % filter->opts.every == 0;
+
+    for (size_t itee = 0; itee < filter->opts.ntee; ++itee)
+      filter->out[itee].frame = window &&
+        filter->nframe % filter->opts.tee[itee].every == 0;
+
+    if (window)
+      ++filter->nframe;
+  }
+
+  bool const main = filter->frame && pass(filter, inner);
+
+  bool want[BMM_MTEE];
+  size_t nwant = 0;
+  for (size_t itee = 0; itee < filter->opts.ntee; ++itee) {
+    want[itee] = filter->out[itee].frame &&
+      filter->opts.tee[itee].mask[(size_t) inner];
+
+    if (want[itee])
+      ++nwant;
+  }
+
+  if (main || nwant != 0) {
+    filter->nhdr = 0;
+
+    if (!bmm_msg_spec_write(&spec, msg_write, filter) ||
+        !bmm_msg_num_write(&num, msg_write, filter) ||
+        (zip && !bmm_zip_head_write(&head, msg_write, filter)))
+      return BMM_IO_READ_ERROR;
 
-        break;
-      case BMM_MSG_TAG_LT:
-        BMM_TLE_EXTS(BMM_TLE_NUM_UNIMPL, "Not implemented");
+    for (size_t itee = 0; itee < filter->opts.ntee; ++itee)
+      if (want[itee] &&
+          !bmm_io_write(filter->out[itee].fd, filter->hdr, filter->nhdr))
+        return BMM_IO_READ_ERROR;
 
+    // Containers take the header along with the payload.
+    if (main && !filter->opts.store) {
+      if (!bmm_filter_write(filter, filter->hdr, filter->nhdr))
         return BMM_IO_READ_ERROR;
+
+      filter->nhdr = 0;
     }
 
-    ++filter->passed;
-  } else {
-    switch (spec.tag) {
-      case BMM_MSG_TAG_SP:
-        switch (bmm_io_fastfwin(spec.msg.size - BMM_MSG_NUMSIZE)) {
-          case BMM_IO_READ_EOF:
-            BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
-          case BMM_IO_READ_ERROR:
-            return BMM_IO_READ_ERROR;
-        }
-
-        break;
-      case BMM_MSG_TAG_LT:
-        BMM_TLE_EXTS(BMM_TLE_NUM_UNIMPL, "Not implemented");
+    if (held) {
+      for (size_t itee = 0; itee < filter->opts.ntee; ++itee)
+        if (want[itee] &&
+            !bmm_io_write(filter->out[itee].fd, filter->body, size))
+          return BMM_IO_READ_ERROR;
 
+      if (main && !bmm_filter_give(filter, num, size))
         return BMM_IO_READ_ERROR;
+    } else if (nwant != 0) {
+      if (!bmm_filter_fork(filter, main, want, inner, size))
+        return BMM_IO_READ_ERROR;
+    } else if (!(filter->opts.store ?
+          bmm_filter_keep(filter, inner, size) :
+          bmm_filter_pass(filter, size)))
+      return BMM_IO_READ_ERROR;
+
+    // Urgent messages and the frames before new ones
+    // are not left sitting in the output buffer.
+    if (main && (spec.prio == BMM_MSG_PRIO_HIGH ||
+          inner == BMM_MSG_NUM_ISTEP) && !filter->opts.store &&
+        !direct(filter) && fflush(stdout) == EOF) {
+      BMM_TLE_STDS();
+
+      return BMM_IO_READ_ERROR;
     }
 
+    ++filter->passed;
+  } else {
+    if (!held)
+      switch (bmm_filter_stop(filter, size)) {
+        case BMM_IO_READ_EOF:
+          BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+        case BMM_IO_READ_ERROR:
+          return BMM_IO_READ_ERROR;
+      }
+
     ++filter->stopped;
   }
 
@@ -145,10 +801,14 @@ static bool bmm_filter_run_(struct bmm_filter *const filter) {
 }
 
 bool bmm_filter_run(struct bmm_filter *const filter) {
+  if (!bmm_filter_open(filter))
+    return false;
+
   bool const run = bmm_filter_run_(filter);
+  bool const clean = bmm_filter_close(filter);
   bool const report = bmm_filter_report(filter);
 
-  return run && report;
+  return run && clean && report;
 }
 
 bool bmm_filter_run_with(struct bmm_filter_opts const *const opts) {
@@ -9,16 +9,86 @@
 #include "conf.h"
 #include "ext.h"
 #include "io.h"
+#include "lit.h"
+#include "msg.h"
+#include "store.h"
+#include "zip.h"
+
+/// Additional outputs, which pass messages independently of the first one.
+struct bmm_filter_tee {
+  /// Path to write to.
+  char const *path;
+  /// Number of frames to read for every frame passed.
+  size_t every;
+  bool mask[BMM_MMSG];
+};
 
 /// This structure contains filter options such as the whitelist.
 struct bmm_filter_opts {
   bool verbose;
+  bool zcopy;
+  bool store;
+  /// Address of the publisher to subscribe to
+  /// instead of reading the standard input or `NULL`.
+  char const *sub;
+  /// Path of the container to read instead of the standard input or `NULL`.
+  char const *load;
+  /// Number of frames to read for every frame passed.
+  size_t every;
+  /// Time at which frames begin to pass.
+  double from;
+  /// Time after which nothing passes and the filter stops.
+  double to;
   bool mask[BMM_MMSG];
+  /// Additional outputs.
+  struct bmm_filter_tee tee[BMM_MTEE];
+  /// Number of additional outputs.
+  size_t ntee;
+};
+
+/// Ways to move payloads.
+enum bmm_filter_path {
+  /// Copy everything through the standard streams.
+  BMM_FILTER_PATH_STDIO,
+  /// Splice everything out of the standard input, which is a pipe.
+  BMM_FILTER_PATH_PIPE,
+  /// Send or seek through the standard input, which is a regular file.
+  BMM_FILTER_PATH_FILE,
+  /// Copy everything out of a container into the standard output.
+  BMM_FILTER_PATH_STORE
+};
+
+/// State of additional outputs.
+struct bmm_filter_out {
+  /// File descriptor.
+  int fd;
+  /// Whether the file descriptor is a pipe.
+  bool pipe;
+  /// Whether the messages of the current frame may pass.
+  bool frame;
 };
 
 /// This structure holds some filter statistics.
 struct bmm_filter {
   struct bmm_filter_opts opts;
+  enum bmm_filter_path path;
+  bool pipeout;
+  int null;
+  /// Pipe for looking ahead in the standard input when it is a pipe.
+  int peek[2];
+  struct bmm_store_writer writer;
+  struct bmm_store_reader reader;
+  /// Whether the messages of the current frame may pass.
+  bool frame;
+  /// Number of frames within the time window so far.
+  size_t nframe;
+  struct bmm_filter_out out[BMM_MTEE];
+  unsigned char hdr[BMM_MSG_HEADSIZE + BMM_MSG_NUMSIZE + BMM_ZIP_HEADSIZE];
+  size_t nhdr;
+  unsigned char *body;
+  size_t ncapbody;
+  /// Decoded body of the current literal-terminated message.
+  struct bmm_lit lit;
   size_t passed;
   size_t stopped;
 };
@@ -35,6 +105,26 @@ void bmm_filter_opts_def(struct bmm_filter_opts *);
 __attribute__ ((__nonnull__))
 void bmm_filter_def(struct bmm_filter *, struct bmm_filter_opts const *);
 
+/// The call `bmm_filter_open(filter)`
+/// chooses how the filter state `filter` moves payloads.
+/// If the options name a container to load,
+/// reading begins from the first frame within the time window.
+/// Additional outputs are opened as files and
+/// fed without copying whenever they and the standard input are pipes.
+/// If the options ask for a container,
+/// one is started in the standard output.
+/// Otherwise payloads are moved without copying whenever
+/// the standard input is a pipe or a regular file
+/// unless the options forbid it.
+/// Otherwise the standard streams are used.
+__attribute__ ((__nonnull__))
+bool bmm_filter_open(struct bmm_filter *);
+
+/// The call `bmm_filter_close(filter)`
+/// releases the resources acquired by `bmm_filter_open`.
+__attribute__ ((__nonnull__))
+bool bmm_filter_close(struct bmm_filter *);
+
 /// The call `bmm_filter_step(filter)`
 /// processes one incoming message with the filter state `filter`.
 __attribute__ ((__nonnull__))
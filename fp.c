@@ -1,4 +1,5 @@
 #include <stddef.h>
+#include <stdint.h>
 
 #include "fp.h"
 
@@ -25,6 +26,16 @@ extern inline double bmm_fp_lerp(double, double, double, double, double);
 
 extern inline double bmm_fp_lorp(double, double, double, double, double);
 
+extern inline uint32_t bmm_fp_quant(double, double, double, size_t);
+
+extern inline double bmm_fp_dequant(uint32_t, double, double, size_t);
+
+extern inline size_t bmm_fp_fsqrtn(double);
+
+extern inline double bmm_fp_fsqrt(double, size_t);
+
+extern inline double bmm_fp_psum(double const *, size_t);
+
 extern inline double bmm_fp_percent(double, double);
 
 extern inline double bmm_fp_min(double const *, size_t);
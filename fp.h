@@ -5,6 +5,8 @@
 
 #include <math.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "common.h"
 #include "ext.h"
@@ -136,6 +138,87 @@ inline double bmm_fp_lorp(double const x,
   return log(bmm_fp_lerp(exp(x), exp(x0), exp(x1), exp(y0), exp(y1)));
 }
 
+/// The call `bmm_fp_quant(x, a, b, nbit)`
+/// returns the index of the bin containing `x`
+/// among the `2^nbit` equal bins that partition the interval from `a` to `b`.
+/// Values outside the interval are clamped into the first or last bin.
+__attribute__ ((__const__, __pure__))
+inline uint32_t bmm_fp_quant(double const x,
+    double const a, double const b, size_t const nbit) {
+  dynamic_assert(nbit <= 32, "Too many bits");
+
+  double const y = ldexp((x - a) / (b - a), (int) nbit);
+  double const ymax = ldexp(1.0, (int) nbit) - 1.0;
+
+  return (uint32_t) (!(y > 0.0) ? 0.0 : y >= ymax ? ymax : floor(y));
+}
+
+/// The call `bmm_fp_dequant(k, a, b, nbit)`
+/// returns the middle of the bin `k` and
+/// is thus the approximate inverse of `bmm_fp_quant`.
+__attribute__ ((__const__, __pure__))
+inline double bmm_fp_dequant(uint32_t const k,
+    double const a, double const b, size_t const nbit) {
+  return a + (b - a) * ldexp((double) k + 0.5, -(int) nbit);
+}
+
+/// The call `bmm_fp_fsqrtn(tol)`
+/// returns the number of steps `bmm_fp_fsqrt` needs to take
+/// to keep its relative error below `tol`,
+/// although it can never get below machine precision.
+__attribute__ ((__const__, __pure__))
+inline size_t bmm_fp_fsqrtn(double const tol) {
+  // The initial guess is off by at most this much and
+  // every step squares the error and then some.
+  double e = 3.5e-2;
+  size_t n = 0;
+
+  while (e > tol && n < 4) {
+    e = (3.0 / 2.0) * e * e + (1.0 / 2.0) * e * e * e;
+    ++n;
+  }
+
+  return n;
+}
+
+/// The call `bmm_fp_fsqrt(x, n)` approximates the square root of `x`
+/// by taking `n` Newton steps towards its reciprocal
+/// from a guess based on the representation of `x`.
+/// Unlike `sqrt`, this neither sets `errno` nor
+/// handles negative or special values,
+/// so it can be inlined and vectorized freely.
+__attribute__ ((__const__, __pure__))
+inline double bmm_fp_fsqrt(double const x, size_t const n) {
+  uint64_t k;
+  (void) memcpy(&k, &x, sizeof k);
+  k = UINT64_C(0x5fe6eb50c7b537a9) - (k >> 1);
+
+  double y;
+  (void) memcpy(&y, &k, sizeof y);
+
+  for (size_t i = 0; i < n; ++i)
+    y *= 3.0 / 2.0 - (1.0 / 2.0) * x * y * y;
+
+  return x > 0.0 ? x * y : 0.0;
+}
+
+/// The call `bmm_fp_psum(x, n)`
+/// returns the sum of the `n` numbers in `x`
+/// by halving the range until single numbers are left.
+/// The order of additions only depends on `n`,
+/// so the result is reproducible
+/// and its rounding error grows logarithmically in `n`.
+__attribute__ ((__nonnull__, __pure__))
+inline double bmm_fp_psum(double const *const x, size_t const n) {
+  if (n == 0)
+    return 0.0;
+
+  if (n == 1)
+    return x[0];
+
+  return bmm_fp_psum(x, n / 2) + bmm_fp_psum(&x[n / 2], n - n / 2);
+}
+
 /// The call `bmm_fp_percent(x, y)`
 /// returns the approximate percentage of `x` in `y`.
 __attribute__ ((__const__, __pure__))
@@ -60,6 +60,13 @@ extern inline double bmm_geom2d_dist(double const *restrict,
 extern inline double bmm_geom2d_angle(double const *restrict,
     double const *restrict);
 
+extern inline double bmm_geom2d_orient(double const *restrict,
+    double const *restrict, double const *restrict);
+
+extern inline double bmm_geom2d_powin(double const *restrict, double,
+    double const *restrict, double, double const *restrict, double,
+    double const *restrict, double);
+
 extern inline void bmm_geom2d_pdiff(double *restrict,
     double const *restrict, double const *restrict, double const *restrict);
 
@@ -85,6 +92,23 @@ extern inline double bmm_geom2d_cpdist(double const *restrict,
 extern inline double bmm_geom2d_cpangle(double const *restrict,
     double const *restrict, double const *restrict, bool const *restrict);
 
+extern inline double bmm_geom2d_lecpdiff(double *restrict,
+    double const *restrict, double const *restrict,
+    double const *restrict, bool const *restrict, double);
+
+extern inline double bmm_geom2d_lecpdist2(double const *restrict,
+    double const *restrict, double const *restrict, bool const *restrict,
+    double);
+
+extern inline void bmm_geom2d_lecpdist2s(double *restrict,
+    double const *restrict, double const (*restrict)[2],
+    size_t const *restrict, size_t,
+    double const *restrict, bool const *restrict, double);
+
+extern inline void bmm_geom2d_offdist2fs(float *restrict,
+    float const *restrict, float const (*restrict)[2],
+    size_t const *restrict, size_t, float const *restrict);
+
 extern inline void bmm_geom2d_refl(double *restrict,
     double const *restrict, double const *restrict, int);
 
@@ -217,6 +217,52 @@ inline double bmm_geom2d_angle(double const *restrict const x0,
   return bmm_geom2d_dir(x);
 }
 
+/// The call `bmm_geom2d_orient(x0, x1, x2)`
+/// returns twice the signed area of the triangle
+/// with the vertices `x0`, `x1` and `x2`,
+/// which is positive when they go around counterclockwise.
+__attribute__ ((__nonnull__, __pure__))
+inline double bmm_geom2d_orient(double const *restrict const x0,
+    double const *restrict const x1, double const *restrict const x2) {
+  double x01[2];
+  bmm_geom2d_diff(x01, x1, x0);
+
+  double x02[2];
+  bmm_geom2d_diff(x02, x2, x0);
+
+  return x01[0] * x02[1] - x01[1] * x02[0];
+}
+
+/// The call `bmm_geom2d_powin(x0, w0, x1, w1, x2, w2, x, w)`
+/// returns a number that is positive when the vector `x` with the weight `w`
+/// lies inside the orthogonal circle of the vectors
+/// `x0`, `x1` and `x2` with the weights `w0`, `w1` and `w2`,
+/// negative when it lies outside and zero when it lies on it.
+/// The triangle `x0`, `x1` and `x2` must go around counterclockwise.
+/// With zero weights this is the circumcircle of the triangle.
+__attribute__ ((__nonnull__, __pure__))
+inline double bmm_geom2d_powin(double const *restrict const x0,
+    double const w0, double const *restrict const x1, double const w1,
+    double const *restrict const x2, double const w2,
+    double const *restrict const x, double const w) {
+  double y0[2];
+  bmm_geom2d_diff(y0, x0, x);
+
+  double y1[2];
+  bmm_geom2d_diff(y1, x1, x);
+
+  double y2[2];
+  bmm_geom2d_diff(y2, x2, x);
+
+  double const z0 = bmm_geom2d_norm2(y0) - w0 + w;
+  double const z1 = bmm_geom2d_norm2(y1) - w1 + w;
+  double const z2 = bmm_geom2d_norm2(y2) - w2 + w;
+
+  return z0 * (y1[0] * y2[1] - y1[1] * y2[0]) +
+    z1 * (y2[0] * y0[1] - y2[1] * y0[0]) +
+    z2 * (y0[0] * y1[1] - y0[1] * y1[0]);
+}
+
 /// The call `bmm_geom2d_pdiff(xdiff, x0, x1, xper)`
 /// sets the vector `xdiff` to the `xper`-periodic difference
 /// between the vectors `x0` and `x1`
@@ -325,6 +371,142 @@ inline double bmm_geom2d_cpangle(double const *restrict const x0,
   return bmm_geom2d_dir(x);
 }
 
+/// The call `bmm_geom2d_lecpdiff(xdiff, x0, x1, xper, per, xle)`
+/// sets the vector `xdiff` to the `per`-conditional `xper`-periodic difference
+/// between the vectors `x0` and `x1`
+/// by following the minimum image convention
+/// in a Lees--Edwards box, whose periodic images along the second axis
+/// are offset by `xle` along the first axis,
+/// and returns the number of images the difference crossed
+/// along the second axis.
+/// The offset only makes sense when the box is periodic along both axes.
+__attribute__ ((__nonnull__))
+inline double bmm_geom2d_lecpdiff(double *restrict const xdiff,
+    double const *restrict const x0, double const *restrict const x1,
+    double const *restrict const xper, bool const *restrict const per,
+    double const xle) {
+  bmm_geom2d_diff(xdiff, x0, x1);
+
+  double k = 0.0;
+
+  if (per[1]) {
+    double const y = $(bmm_swrap, double)(xdiff[1], xper[1]);
+    k = round((xdiff[1] - y) / xper[1]);
+    xdiff[1] = y;
+    xdiff[0] -= k * xle;
+  }
+
+  if (per[0])
+    xdiff[0] = $(bmm_swrap, double)(xdiff[0], xper[0]);
+
+  return k;
+}
+
+/// The call `bmm_geom2d_lecpdist2(x0, x1, xper, per, xle)`
+/// returns the `per`-conditional `xper`-periodic distance $r^2$
+/// between the vectors `x0` and `x1`
+/// by following the minimum image convention
+/// in a Lees--Edwards box with the offset `xle`.
+__attribute__ ((__nonnull__, __pure__))
+inline double bmm_geom2d_lecpdist2(double const *restrict const x0,
+    double const *restrict const x1, double const *restrict const xper,
+    bool const *restrict const per, double const xle) {
+  double x[2];
+  (void) bmm_geom2d_lecpdiff(x, x0, x1, xper, per, xle);
+
+  return bmm_geom2d_norm2(x);
+}
+
+/// The call `bmm_geom2d_lecpdist2s(d2, x0, x, ix, n, xper, per, xle)`
+/// sets each `d2[k]` with `k < n`
+/// to the `per`-conditional `xper`-periodic distance $r^2$
+/// between the vectors `x[ix[k]]` and `x0`
+/// by following the minimum image convention
+/// in a Lees--Edwards box with the offset `xle`.
+/// If `ix` is `NULL`, the vectors `x[k]` are used instead,
+/// which saves gathering them when they are already contiguous.
+/// This works like `bmm_geom2d_lecpdist2` on every vector,
+/// but without branching on `per`,
+/// so that the loop can be vectorized.
+__attribute__ ((__nonnull__ (1, 2, 3, 6, 7)))
+inline void bmm_geom2d_lecpdist2s(double *restrict const d2,
+    double const *restrict const x0, double const (*restrict const x)[2],
+    size_t const *restrict const ix, size_t const n,
+    double const *restrict const xper, bool const *restrict const per,
+    double const xle) {
+  // Wrapping is scaled by zero along aperiodic axes.
+  double const m0 = per[0] ? 1.0 : 0.0;
+  double const m1 = per[1] ? 1.0 : 0.0;
+
+  if (ix == NULL) {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for (size_t k = 0; k < n; ++k) {
+      double const dy = x[k][1] - x0[1];
+      double const j = m1 * floor(dy / xper[1] + 0.5);
+      double const dx = x[k][0] - x0[0] - j * xle;
+      double const i = m0 * floor(dx / xper[0] + 0.5);
+
+      d2[k] = $(bmm_power, double)(dx - i * xper[0], 2) +
+        $(bmm_power, double)(dy - j * xper[1], 2);
+    }
+  } else {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for (size_t k = 0; k < n; ++k) {
+      double const dy = x[ix[k]][1] - x0[1];
+      double const j = m1 * floor(dy / xper[1] + 0.5);
+      double const dx = x[ix[k]][0] - x0[0] - j * xle;
+      double const i = m0 * floor(dx / xper[0] + 0.5);
+
+      d2[k] = $(bmm_power, double)(dx - i * xper[0], 2) +
+        $(bmm_power, double)(dy - j * xper[1], 2);
+    }
+  }
+}
+
+/// The call `bmm_geom2d_offdist2fs(d2, x0, x, ix, n, xoff)`
+/// sets each `d2[k]` with `k < n`
+/// to the distance $r^2$ between the vectors `x[ix[k]] + xoff` and `x0`
+/// in single precision.
+/// If `ix` is `NULL`, the vectors `x[k]` are used instead.
+/// This works like `bmm_geom2d_lecpdist2s` on vectors
+/// that are given relative to a common origin with the offset `xoff`
+/// already resolved,
+/// so that twice as many of them fit into each vector register.
+__attribute__ ((__nonnull__ (1, 2, 3, 6)))
+inline void bmm_geom2d_offdist2fs(float *restrict const d2,
+    float const *restrict const x0, float const (*restrict const x)[2],
+    size_t const *restrict const ix, size_t const n,
+    float const *restrict const xoff) {
+  float const x00 = x0[0] - xoff[0];
+  float const x01 = x0[1] - xoff[1];
+
+  if (ix == NULL) {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for (size_t k = 0; k < n; ++k) {
+      float const dx = x[k][0] - x00;
+      float const dy = x[k][1] - x01;
+
+      d2[k] = dx * dx + dy * dy;
+    }
+  } else {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for (size_t k = 0; k < n; ++k) {
+      float const dx = x[ix[k]][0] - x00;
+      float const dy = x[ix[k]][1] - x01;
+
+      d2[k] = dx * dx + dy * dy;
+    }
+  }
+}
+
 #define BMM_GEOM2D_MASK_NOAXES 0
 #define BMM_GEOM2D_MASK_XAXIS (BMM_MASKBITS(0))
 #define BMM_GEOM2D_MASK_YAXIS (BMM_MASKBITS(1))
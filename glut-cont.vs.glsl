@@ -0,0 +1,63 @@
+#version 440 core
+
+out vec4 fColor;
+
+// Every texel holds one double or one size.
+uniform usamplerBuffer x;
+uniform usamplerBuffer f;
+uniform usamplerBuffer cont;
+
+uniform vec4 view;
+uniform vec2 box;
+uniform int color;
+uniform float cmax;
+uniform vec3 cflat;
+uniform int npart;
+uniform int mcont;
+uniform int stride;
+uniform int itgt;
+
+vec3 heat(float s) {
+  float t = clamp(s, 0.0f, 1.0f);
+
+  return vec3(t, 4.0f * t * (1.0f - t), 1.0f - t);
+}
+
+vec2 fetch(usamplerBuffer s, int i) {
+  return vec2(float(packDouble2x32(texelFetch(s, 2 * i).xy)),
+      float(packDouble2x32(texelFetch(s, 2 * i + 1).xy)));
+}
+
+void main(void) {
+  int ipart = gl_InstanceID / mcont;
+  int icont = gl_InstanceID % mcont;
+  int ibase = ipart * stride;
+
+  uint n = texelFetch(cont, ibase).x;
+  int jpart = int(texelFetch(cont, ibase + itgt + icont).x);
+
+  // Missing contacts are moved out of the clip volume.
+  if (uint(icont) >= n || jpart >= npart) {
+    gl_Position = vec4(2.0f, 2.0f, 2.0f, 1.0f);
+    fColor = vec4(0.0f);
+
+    return;
+  }
+
+  vec2 xi = fetch(x, ipart);
+  vec2 xj = fetch(x, jpart);
+
+  vec2 d = xj - xi;
+  d.x -= box.x * round(d.x / box.x);
+
+  vec2 y = gl_VertexID == 0 ? xi : xi + d;
+
+  gl_Position = vec4(2.0f * (y - view.xy) / view.zw - 1.0f, 0.0f, 1.0f);
+
+  // Force chains are traced by the weaker end of each contact.
+  if (color == 2)
+    fColor = vec4(heat(min(length(fetch(f, ipart)),
+            length(fetch(f, jpart))) / cmax), 1.0f);
+  else
+    fColor = vec4(cflat, 1.0f);
+}
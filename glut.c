@@ -5,6 +5,7 @@
 #include <GL/glut.h>
 #endif
 
+#include <limits.h>
 #include <math.h>
 #include <setjmp.h>
 #include <signal.h>
@@ -14,52 +15,481 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
+#include <time.h>
 
+#include "gl.h"
 #include "gl2.h"
 #include "glut.h"
 
+#include "common.h"
 #include "conf.h"
 // TODO Undepend.
 #include "dem.h"
+#include "endy.h"
 #include "ext.h"
 #include "io.h"
+#include "lit.h"
+#include "map.h"
 #include "msg.h"
 #include "sig.h"
 #include "tle.h"
+#include "zip.h"
+
+/// Number of corners in the outline of a particle.
+#define BMM_GLUT_NCORNER 16
+
+/// Alignment of the columns in a frame,
+/// which is enough for any texture buffer offset.
+#define BMM_GLUT_ALIGN ((size_t) 256)
+
+/// The call `BMM_GLUT_SIZEOF(x)`
+/// expands to the size of the member `x` of a simulation
+/// without needing one.
+#define BMM_GLUT_SIZEOF(x) (sizeof (((struct bmm_dem *) NULL)->x))
+
+/// Columns of a frame.
+enum bmm_glut_col {
+  BMM_GLUT_COL_X,
+  BMM_GLUT_COL_R,
+  BMM_GLUT_COL_PHI,
+  BMM_GLUT_COL_V,
+  BMM_GLUT_COL_F,
+  BMM_GLUT_COL_ROLE,
+  /// Contacts of the first type,
+  /// followed by those of the other types.
+  BMM_GLUT_COL_CONT,
+  BMM_GLUT_NCOL = BMM_GLUT_COL_CONT + BMM_NCT
+};
+
+/// Contacts are read into texture buffers as they are.
+static_assert(BMM_GLUT_SIZEOF(pair[0].cont.src[0]) % sizeof (uint64_t) == 0,
+    "Unaligned contacts");
+static_assert(sizeof (size_t) == sizeof (uint64_t), "Unsupported size");
+static_assert(BMM_GLUT_SIZEOF(part.role[0]) == sizeof (GLint),
+    "Unsupported role");
 
 /// This is necessary since GLUT does not support passing in closures.
 static struct bmm_glut *bmm_glut;
 
 void bmm_glut_opts_def(struct bmm_glut_opts *const opts) {
-  opts->vpath = "bmm-glut.vs.glsl";
-  opts->fpath = "bmm-glut.fs.glsl";
+  opts->vpath = "glut.vs.glsl";
+  opts->fpath = "glut.fs.glsl";
+  opts->cvpath = "glut-cont.vs.glsl";
+  opts->color = BMM_GLUT_COLOR_ROLE;
+  opts->cmax = 1.0;
 }
 
 void bmm_glut_def(struct bmm_glut *const glut,
     struct bmm_glut_opts const *const opts) {
   glut->opts = *opts;
   glut->prog = NULL;
+  glut->result = true;
+  glut->eof = false;
   glut->vshader = 0;
   glut->fshader = 0;
   glut->program = 0;
+  glut->cvshader = 0;
+  glut->cprogram = 0;
+  glut->varray = 0;
+  glut->cvarray = 0;
+  glut->vcorner = 0;
+  glut->vframe = 0;
+  for (size_t itex = 0; itex < nmembof(glut->tex); ++itex)
+    glut->tex[itex] = 0;
+  glut->ptr = NULL;
+  glut->ncap = 0;
+  glut->stride = 0;
+  for (size_t islot = 0; islot < BMM_GLUT_NSLOT; ++islot) {
+    glut->slot[islot].fence = 0;
+    glut->slot[islot].npart = 0;
+    glut->slot[islot].ncont = SIZE_MAX;
+  }
+  glut->iwrite = SIZE_MAX;
+  glut->iready = SIZE_MAX;
+  bmm_dem_opts_def(&glut->dopts);
+  glut->width = 640;
+  glut->height = 480;
+  glut->qzoom = 1.0;
+  glut->rorigin[0] = 0.0;
+  glut->rorigin[1] = 0.0;
+  glut->color = opts->color;
+  glut->cmax = opts->cmax;
+  glut->cont = true;
 }
 
+/// Mapping of the standard input if it is a regular file.
+static struct bmm_map *msgmap = NULL;
+
+/// Payload of the compressed message being read.
+static struct bmm_zip msgzip = {
+  .raw = NULL, .nraw = 0, .ncapraw = 0, .iraw = 0, .tmp = NULL, .ncaptmp = 0
+};
+
+/// Body of the literal-terminated message being read.
+static struct bmm_lit msglit = {
+  .nterm = 0, .nmatch = 0,
+  .raw = NULL, .nraw = 0, .ncapraw = 0, .iraw = 0, .tmp = NULL
+};
+
 static enum bmm_io_read msg_read(void *buf, size_t const n,
     __attribute__ ((__unused__)) void *const ptr) {
+  if (bmm_zip_ongoing(&msgzip))
+    return bmm_zip_read(&msgzip, buf, n);
+
+  if (bmm_lit_ongoing(&msglit))
+    return bmm_lit_read(&msglit, buf, n);
+
+  if (msgmap != NULL)
+    return bmm_map_read(msgmap, buf, n);
+
   return bmm_io_readin(buf, n);
 }
 
-static bool bmm_glut_open(struct bmm_glut *const glut) {
+static enum bmm_io_read msg_fastfw(size_t const n) {
+  if (bmm_zip_ongoing(&msgzip))
+    return bmm_zip_fastfw(&msgzip, n);
+
+  if (bmm_lit_ongoing(&msglit))
+    return bmm_lit_fastfw(&msglit, n);
+
+  if (msgmap != NULL)
+    return bmm_map_fastfw(msgmap, n);
+
+  return bmm_io_fastfwin(n);
+}
+
+/// The call `bmm_glut_read(buf, n)`
+/// reads `n` bytes into `buf` or skips them if `buf` is `NULL`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+static bool bmm_glut_read(void *const buf, size_t const n) {
+  if (n == 0)
+    return true;
+
+  switch (buf == NULL ? msg_fastfw(n) : msg_read(buf, n, NULL)) {
+    case BMM_IO_READ_EOF:
+      BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+    case BMM_IO_READ_ERROR:
+      return false;
+  }
 
   return true;
 }
 
-static bool bmm_glut_close(struct bmm_glut *const glut) {
+/// The call `bmm_glut_size(icol)`
+/// returns the size of one particle in the column `icol`.
+__attribute__ ((__const__, __pure__))
+static size_t bmm_glut_size(enum bmm_glut_col const icol) {
+  switch (icol) {
+    case BMM_GLUT_COL_X:
+      return BMM_GLUT_SIZEOF(part.x[0]);
+    case BMM_GLUT_COL_R:
+      return BMM_GLUT_SIZEOF(part.r[0]);
+    case BMM_GLUT_COL_PHI:
+      return BMM_GLUT_SIZEOF(part.phi[0]);
+    case BMM_GLUT_COL_V:
+      return BMM_GLUT_SIZEOF(part.v[0]);
+    case BMM_GLUT_COL_F:
+      return BMM_GLUT_SIZEOF(part.f[0]);
+    case BMM_GLUT_COL_ROLE:
+      return BMM_GLUT_SIZEOF(part.role[0]);
+  }
+
+  return BMM_GLUT_SIZEOF(pair[0].cont.src[0]);
+}
+
+/// The call `bmm_glut_off(ncap, icol)`
+/// returns the offset of the column `icol`
+/// in a frame with room for `ncap` particles.
+/// Passing `BMM_GLUT_NCOL` for `icol` gives the size of the frame.
+__attribute__ ((__const__, __pure__))
+static size_t bmm_glut_off(size_t const ncap, size_t const icol) {
+  size_t off = 0;
+
+  for (size_t jcol = 0; jcol < icol; ++jcol) {
+    size_t const size = ncap * bmm_glut_size((enum bmm_glut_col) jcol);
+
+    off += (size + BMM_GLUT_ALIGN - 1) / BMM_GLUT_ALIGN * BMM_GLUT_ALIGN;
+  }
+
+  return off;
+}
+
+/// The call `bmm_glut_unmap(glut)`
+/// releases the frames in flight of `glut`.
+__attribute__ ((__nonnull__))
+static void bmm_glut_unmap(struct bmm_glut *const glut) {
+  for (size_t islot = 0; islot < BMM_GLUT_NSLOT; ++islot) {
+    if (glut->slot[islot].fence != 0)
+      glDeleteSync(glut->slot[islot].fence);
+
+    glut->slot[islot].fence = 0;
+    glut->slot[islot].npart = 0;
+    glut->slot[islot].ncont = SIZE_MAX;
+  }
+
+  if (glut->vframe != 0) {
+    glBindBuffer(GL_ARRAY_BUFFER, glut->vframe);
+    (void) glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glDeleteBuffers(1, &glut->vframe);
+  }
+
+  glut->vframe = 0;
+  glut->ptr = NULL;
+  glut->ncap = 0;
+  glut->stride = 0;
+  glut->iwrite = SIZE_MAX;
+  glut->iready = SIZE_MAX;
+}
+
+/// The call `bmm_glut_reserve(glut, npart)`
+/// makes room for at least `npart` particles in every frame of `glut`.
+/// If the room runs out, the frames in flight are thrown away.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_glut_reserve(struct bmm_glut *const glut, size_t const npart) {
+  if (npart <= glut->ncap)
+    return true;
+
+  size_t const ncap = $(bmm_max, size_t)(npart,
+      glut->ncap > SIZE_MAX / 2 ? SIZE_MAX : glut->ncap * 2);
+
+  // The offsets are sums of products, so these bounds keep them finite.
+  if (ncap > INT_MAX / BMM_MCONTACT ||
+      ncap > (size_t) PTRDIFF_MAX / BMM_GLUT_NCOL / BMM_GLUT_NSLOT /
+      bmm_glut_size(BMM_GLUT_COL_CONT)) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_GL, "Too many particles");
+
+    return false;
+  }
+
+  size_t const stride = bmm_glut_off(ncap, BMM_GLUT_NCOL);
+
+  // Waiting for the renderer here is fine, because this is rare.
+  glFinish();
+
+  bmm_glut_unmap(glut);
+
+  GLbitfield const flags =
+    GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  GLsizeiptr const size = (GLsizeiptr) (BMM_GLUT_NSLOT * stride);
+
+  glGenBuffers(1, &glut->vframe);
+  glBindBuffer(GL_ARRAY_BUFFER, glut->vframe);
+  glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+
+  void *const ptr = glGetError() != GL_NO_ERROR ? NULL :
+    glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  if (ptr == NULL) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_GL, "Failed to allocate buffer");
+
+    glDeleteBuffers(1, &glut->vframe);
+    glut->vframe = 0;
+
+    return false;
+  }
+
+  glut->ptr = ptr;
+  glut->ncap = ncap;
+  glut->stride = stride;
 
   return true;
 }
 
+/// The call `bmm_glut_begin(glut)`
+/// returns the frame being written in `glut`,
+/// waiting for the renderer to let go of it if necessary.
+/// If the operation fails, `NULL` is returned.
+__attribute__ ((__nonnull__))
+static unsigned char *bmm_glut_begin(struct bmm_glut *const glut) {
+  if (glut->iwrite == SIZE_MAX) {
+    size_t const islot = glut->iready == SIZE_MAX ? 0 :
+      (glut->iready + 1) % BMM_GLUT_NSLOT;
+    struct bmm_glut_slot *const slot = &glut->slot[islot];
+
+    // The renderer is only ever on one of the other frames,
+    // so this frame was drawn at least two frames ago.
+    if (slot->fence != 0) {
+      for ever {
+        GLenum const status = glClientWaitSync(slot->fence,
+            GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        if (status == GL_WAIT_FAILED) {
+          BMM_TLE_EXTS(BMM_TLE_NUM_GL, "Failed to wait for renderer");
+
+          return NULL;
+        }
+
+        if (status != GL_TIMEOUT_EXPIRED)
+          break;
+      }
+
+      glDeleteSync(slot->fence);
+      slot->fence = 0;
+    }
+
+    slot->npart = 0;
+    slot->ncont = SIZE_MAX;
+
+    glut->iwrite = islot;
+  }
+
+  return glut->ptr + glut->iwrite * glut->stride;
+}
+
+/// The call `bmm_glut_opts(glut, size)`
+/// reads the options of the simulation in a message of size `size`.
+__attribute__ ((__nonnull__))
+static enum bmm_io_read bmm_glut_opts(struct bmm_glut *const glut,
+    size_t const size) {
+  if (size != sizeof glut->dopts) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Size mismatch");
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  return bmm_glut_read(&glut->dopts, sizeof glut->dopts) ?
+    BMM_IO_READ_SUCCESS : BMM_IO_READ_ERROR;
+}
+
+/// The call `bmm_glut_neigh(glut, size)`
+/// reads the contacts in a message of size `size`
+/// into the frame being written in `glut`
+/// and skips the rest of the neighbor cache.
+__attribute__ ((__nonnull__))
+static enum bmm_io_read bmm_glut_neigh(struct bmm_glut *const glut,
+    size_t const size) {
+  size_t npart;
+  size_t nneigh;
+  if (!(bmm_glut_read(&npart, sizeof npart) &&
+        bmm_glut_read(&nneigh, sizeof nneigh) &&
+        bmm_glut_reserve(glut, npart)))
+    return BMM_IO_READ_ERROR;
+
+  if (nneigh > size / BMM_GLUT_SIZEOF(cache.ineigh[0])) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Size mismatch");
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  size_t const nhead =
+    BMM_GLUT_SIZEOF(cache.tag) + BMM_GLUT_SIZEOF(cache.stale) +
+    BMM_GLUT_SIZEOF(cache.i) + BMM_GLUT_SIZEOF(cache.tpart) +
+    BMM_GLUT_SIZEOF(cache.tprev) +
+    npart * BMM_GLUT_SIZEOF(cache.j[0]) +
+    npart * BMM_GLUT_SIZEOF(cache.x[0]) +
+    npart * BMM_GLUT_SIZEOF(cache.ijcell[0]) +
+    npart * BMM_GLUT_SIZEOF(cache.icell[0]) +
+    BMM_GLUT_SIZEOF(cache.part) +
+    npart * BMM_GLUT_SIZEOF(cache.ipart[0]) +
+    npart * BMM_GLUT_SIZEOF(cache.neigh[0]) +
+    nneigh * BMM_GLUT_SIZEOF(cache.ineigh[0]);
+  size_t const ntail = BMM_GLUT_SIZEOF(pair[0].cohesive) +
+    BMM_GLUT_SIZEOF(pair[0].norm) + BMM_GLUT_SIZEOF(pair[0].tang);
+  size_t const ncont = npart * bmm_glut_size(BMM_GLUT_COL_CONT);
+
+  if (size != sizeof npart + sizeof nneigh + nhead +
+      BMM_NCT * (ncont + ntail)) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Size mismatch");
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  unsigned char *const frame = bmm_glut_begin(glut);
+  if (frame == NULL || !bmm_glut_read(NULL, nhead))
+    return BMM_IO_READ_ERROR;
+
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict)
+    if (!(bmm_glut_read(frame +
+            bmm_glut_off(glut->ncap, BMM_GLUT_COL_CONT + ict), ncont) &&
+          bmm_glut_read(NULL, ntail)))
+      return BMM_IO_READ_ERROR;
+
+  glut->slot[glut->iwrite].ncont = npart;
+
+  return BMM_IO_READ_SUCCESS;
+}
+
+/// The call `bmm_glut_parts(glut, size)`
+/// reads the columns to draw from a message of size `size`
+/// into the frame being written in `glut`,
+/// skips the other columns and
+/// hands the frame over to the renderer.
+__attribute__ ((__nonnull__))
+static enum bmm_io_read bmm_glut_parts(struct bmm_glut *const glut,
+    size_t const size) {
+  size_t npart;
+  if (!(bmm_glut_read(&npart, sizeof npart) &&
+        bmm_glut_reserve(glut, npart)))
+    return BMM_IO_READ_ERROR;
+
+  // Columns that are not drawn have `BMM_GLUT_NCOL` in place of an index.
+  struct {
+    size_t icol;
+    size_t size;
+  } const cols[] = {
+    {BMM_GLUT_NCOL, BMM_GLUT_SIZEOF(part.lnew)},
+    {BMM_GLUT_NCOL, npart * BMM_GLUT_SIZEOF(part.l[0])},
+    {BMM_GLUT_COL_ROLE, npart * BMM_GLUT_SIZEOF(part.role[0])},
+    {BMM_GLUT_COL_R, npart * BMM_GLUT_SIZEOF(part.r[0])},
+    {BMM_GLUT_NCOL, npart * BMM_GLUT_SIZEOF(part.m[0])},
+    {BMM_GLUT_NCOL, npart * BMM_GLUT_SIZEOF(part.jred[0])},
+    {BMM_GLUT_COL_X, npart * BMM_GLUT_SIZEOF(part.x[0])},
+    {BMM_GLUT_COL_V, npart * BMM_GLUT_SIZEOF(part.v[0])},
+    {BMM_GLUT_NCOL, npart * BMM_GLUT_SIZEOF(part.a[0])},
+    {BMM_GLUT_COL_PHI, npart * BMM_GLUT_SIZEOF(part.phi[0])},
+    {BMM_GLUT_NCOL, npart * BMM_GLUT_SIZEOF(part.omega[0])},
+    {BMM_GLUT_NCOL, npart * BMM_GLUT_SIZEOF(part.alpha[0])},
+    {BMM_GLUT_COL_F, npart * BMM_GLUT_SIZEOF(part.f[0])},
+    {BMM_GLUT_NCOL, npart * BMM_GLUT_SIZEOF(part.tau[0])}
+  };
+
+  size_t nrem = size - sizeof npart;
+  for (size_t icol = 0; icol < nmembof(cols); ++icol)
+    nrem -= cols[icol].size;
+
+  if (size < sizeof npart || nrem != 0) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Size mismatch");
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  unsigned char *const frame = bmm_glut_begin(glut);
+  if (frame == NULL)
+    return BMM_IO_READ_ERROR;
+
+  // The columns are read straight into the mapping,
+  // so nothing goes over the particles one by one.
+  for (size_t icol = 0; icol < nmembof(cols); ++icol)
+    if (!bmm_glut_read(cols[icol].icol == BMM_GLUT_NCOL ? NULL :
+          frame + bmm_glut_off(glut->ncap, cols[icol].icol),
+          cols[icol].size))
+      return BMM_IO_READ_ERROR;
+
+  struct bmm_glut_slot *const slot = &glut->slot[glut->iwrite];
+  slot->npart = npart;
+  if (slot->ncont != npart)
+    slot->ncont = SIZE_MAX;
+
+  glut->iready = glut->iwrite;
+  glut->iwrite = SIZE_MAX;
+
+  glutPostRedisplay();
+
+  return BMM_IO_READ_SUCCESS;
+}
+
 enum bmm_io_read bmm_glut_step(struct bmm_glut *const glut) {
+  // Whatever was left of the previous message is not read from.
+  bmm_zip_clear(&msgzip);
+  bmm_lit_clear(&msglit);
+
   struct bmm_msg_spec spec;
   switch (bmm_msg_spec_read(&spec, msg_read, NULL)) {
     case BMM_IO_READ_ERROR:
@@ -74,10 +504,24 @@ enum bmm_io_read bmm_glut_step(struct bmm_glut *const glut) {
     return BMM_IO_READ_ERROR;
   }
 
-  if (spec.tag != BMM_MSG_TAG_SP) {
-    BMM_TLE_EXTS(BMM_TLE_NUM_UNIMPL, "Unsupported tag");
+  // Literal-terminated messages are decoded first,
+  // so that they can be read like any other once their size is known.
+  if (spec.tag == BMM_MSG_TAG_LT) {
+    switch (bmm_lit_open(&msglit, &spec, msg_read, NULL, NULL)) {
+      case BMM_IO_READ_EOF:
+        BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+      case BMM_IO_READ_ERROR:
+        return BMM_IO_READ_ERROR;
+    }
+
+    if (msglit.nraw < BMM_MSG_NUMSIZE) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Message too short");
 
-    return BMM_IO_READ_ERROR;
+      return BMM_IO_READ_ERROR;
+    }
+
+    spec.tag = BMM_MSG_TAG_SP;
+    spec.msg.size = msglit.nraw;
   }
 
   enum bmm_msg_num num;
@@ -88,96 +532,484 @@ enum bmm_io_read bmm_glut_step(struct bmm_glut *const glut) {
       return BMM_IO_READ_ERROR;
   }
 
+  size_t size = spec.msg.size - BMM_MSG_NUMSIZE;
+
+  // Compressed messages are unwrapped and then read like any other.
+  if (num == BMM_MSG_NUM_ZIP) {
+    switch (bmm_zip_open(&msgzip, &num, &size, size, spec.endy,
+          msg_read, NULL)) {
+      case BMM_IO_READ_EOF:
+        BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+      case BMM_IO_READ_ERROR:
+        return BMM_IO_READ_ERROR;
+    }
+
+    if (num == BMM_MSG_NUM_ZIP) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Nested compressed message");
+
+      return BMM_IO_READ_ERROR;
+    }
+  }
+
   switch (num) {
+    case BMM_MSG_NUM_OPTS:
+      return bmm_glut_opts(glut, size);
+    case BMM_MSG_NUM_NEIGH:
+      return bmm_glut_neigh(glut, size);
     case BMM_MSG_NUM_PARTS:
-      {
-        size_t npart;
-
-        switch (msg_read(&npart, sizeof npart, NULL)) {
-          case BMM_IO_READ_EOF:
-            BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
-          case BMM_IO_READ_ERROR:
-            return BMM_IO_READ_ERROR;
-        }
+      return bmm_glut_parts(glut, size);
+  }
 
-        double parts[BMM_MPART];
+  // Everything else is skipped over by its size,
+  // which works for difference and quantized frames alike.
+  return bmm_glut_read(NULL, size) ?
+    BMM_IO_READ_SUCCESS : BMM_IO_READ_ERROR;
+}
 
-        switch (msg_read(parts, sizeof parts, NULL)) {
-          case BMM_IO_READ_EOF:
-            BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
-          case BMM_IO_READ_ERROR:
-            return BMM_IO_READ_ERROR;
-        }
-      }
+static bool bmm_glut_open(struct bmm_glut *const glut) {
+  if (!bmm_gl2_build(&glut->vshader, &glut->fshader, &glut->program,
+        glut->opts.vpath, glut->opts.fpath))
+    return false;
 
-      break;
-    default:
-      dynamic_assert(false, "Unsupported message number");
+  if (!(bmm_gl2_compile(&glut->cvshader, GL_VERTEX_SHADER,
+          glut->opts.cvpath) &&
+        bmm_gl2_link(&glut->cprogram, glut->cvshader, glut->fshader)))
+    return false;
+
+  // Each corner is a direction from the center,
+  // which comes first and has none.
+  GLfloat corner[BMM_GLUT_NCORNER + 2][2];
+  corner[0][0] = 0.0f;
+  corner[0][1] = 0.0f;
+  for (size_t icorner = 0; icorner <= BMM_GLUT_NCORNER; ++icorner) {
+    float const a = (float) (icorner % BMM_GLUT_NCORNER) *
+      ((float) M_2PI / (float) BMM_GLUT_NCORNER);
+
+    corner[icorner + 1][0] = cosf(a);
+    corner[icorner + 1][1] = sinf(a);
   }
 
-  return BMM_IO_READ_SUCCESS;
+  glGenVertexArrays(1, &glut->varray);
+  glBindVertexArray(glut->varray);
+
+  if (!bmm_gl2_buffer(&glut->vcorner, GL_ARRAY_BUFFER, GL_STATIC_DRAW,
+        corner, (GLsizei) sizeof corner)) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_GL, "Failed to allocate buffer");
+
+    glBindVertexArray(0);
+
+    return false;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glBindVertexBuffer(0, glut->vcorner, 0, sizeof *corner);
+  glVertexAttribFormat(0, 2, GL_FLOAT, GL_FALSE, 0);
+  glVertexAttribBinding(0, 0);
+  glEnableVertexAttribArray(0);
+
+  // The columns of each frame are bound when drawing,
+  // while the attribute at each location only takes its own column.
+  struct {
+    GLint n;
+    GLenum type;
+  } const attrs[] = {
+    [BMM_GLUT_COL_X] = {BMM_NDIM, GL_DOUBLE},
+    [BMM_GLUT_COL_R] = {1, GL_DOUBLE},
+    [BMM_GLUT_COL_PHI] = {1, GL_DOUBLE},
+    [BMM_GLUT_COL_V] = {BMM_NDIM, GL_DOUBLE},
+    [BMM_GLUT_COL_F] = {BMM_NDIM, GL_DOUBLE},
+    [BMM_GLUT_COL_ROLE] = {1, GL_INT}
+  };
+
+  for (size_t iattr = 0; iattr < nmembof(attrs); ++iattr) {
+    GLuint const iloc = (GLuint) iattr + 1;
+
+    if (attrs[iattr].type == GL_INT)
+      glVertexAttribIFormat(iloc, attrs[iattr].n, attrs[iattr].type, 0);
+    else
+      glVertexAttribFormat(iloc, attrs[iattr].n, attrs[iattr].type,
+          GL_FALSE, 0);
+
+    glVertexAttribBinding(iloc, iloc);
+    glVertexBindingDivisor(iloc, 3);
+    glEnableVertexAttribArray(iloc);
+  }
+
+  glBindVertexArray(0);
+
+  // Contacts fetch everything from textures.
+  glGenVertexArrays(1, &glut->cvarray);
+
+  glGenTextures((GLsizei) nmembof(glut->tex), glut->tex);
+
+  glUseProgram(glut->cprogram);
+  glUniform1i(glGetUniformLocation(glut->cprogram, "x"), 0);
+  glUniform1i(glGetUniformLocation(glut->cprogram, "f"), 1);
+  glUniform1i(glGetUniformLocation(glut->cprogram, "cont"), 2);
+  glUseProgram(0);
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  glClearColor3fv(glBlack);
+
+  return true;
+}
+
+static void bmm_glut_close(struct bmm_glut *const glut) {
+  bmm_glut_unmap(glut);
+
+  if (glut->tex[0] != 0)
+    glDeleteTextures((GLsizei) nmembof(glut->tex), glut->tex);
+
+  if (glut->vcorner != 0)
+    glDeleteBuffers(1, &glut->vcorner);
+
+  if (glut->cvarray != 0)
+    glDeleteVertexArrays(1, &glut->cvarray);
+
+  if (glut->varray != 0)
+    glDeleteVertexArrays(1, &glut->varray);
+
+  if (glut->cprogram != 0)
+    glDeleteProgram(glut->cprogram);
+
+  if (glut->cvshader != 0)
+    glDeleteShader(glut->cvshader);
+
+  if (glut->program != 0)
+    glDeleteProgram(glut->program);
+
+  if (glut->fshader != 0)
+    glDeleteShader(glut->fshader);
+
+  if (glut->vshader != 0)
+    glDeleteShader(glut->vshader);
+}
+
+/// The call `bmm_glut_proj(glut, xproj, yproj, wproj, hproj)`
+/// sets `xproj` and `yproj` to the lower left corner and
+/// `wproj` and `hproj` to the width and height
+/// of the region of the simulation box that the view of `glut` shows,
+/// keeping the aspect ratio of the window.
+static void bmm_glut_proj(struct bmm_glut const *const glut,
+    double *const xproj, double *const yproj,
+    double *const wproj, double *const hproj) {
+  double const w = glut->dopts.box.x[0];
+  double const h = glut->dopts.box.x[1];
+  double const q = (double) glut->width / (double) glut->height;
+  double const z = glut->qzoom;
+
+  bool const pwide = w > h * q;
+
+  double const wzoom = w / z;
+  double const hzoom = h / z;
+  double const weither = pwide ? wzoom : hzoom * q;
+  double const heither = pwide ? wzoom / q : hzoom;
+
+  *wproj = weither;
+  *hproj = heither;
+  *xproj = glut->rorigin[0] - (weither - wzoom) * 0.5;
+  *yproj = glut->rorigin[1] - (heither - hzoom) * 0.5;
+}
+
+/// The call `bmm_glut_zoom(glut, q)`
+/// zooms the view of `glut` by the factor `q` around its center.
+static void bmm_glut_zoom(struct bmm_glut *const glut, double const q) {
+  double xproj;
+  double yproj;
+  double wproj;
+  double hproj;
+  bmm_glut_proj(glut, &xproj, &yproj, &wproj, &hproj);
+
+  double const x = xproj + wproj * 0.5;
+  double const y = yproj + hproj * 0.5;
+
+  glut->qzoom *= q;
+
+  bmm_glut_proj(glut, &xproj, &yproj, &wproj, &hproj);
+
+  glut->rorigin[0] += x - (xproj + wproj * 0.5);
+  glut->rorigin[1] += y - (yproj + hproj * 0.5);
+}
+
+/// The call `bmm_glut_move(glut, x, y)`
+/// moves the view of `glut` by `x` widths and `y` heights.
+static void bmm_glut_move(struct bmm_glut *const glut,
+    double const x, double const y) {
+  double xproj;
+  double yproj;
+  double wproj;
+  double hproj;
+  bmm_glut_proj(glut, &xproj, &yproj, &wproj, &hproj);
+
+  glut->rorigin[0] += x * wproj;
+  glut->rorigin[1] += y * hproj;
+}
+
+/// The call `bmm_glut_tex(glut, itex, base, icol, n)`
+/// points the texture `itex` of `glut` at the column `icol`
+/// of the frame at the offset `base` with room for `n` particles.
+static void bmm_glut_tex(struct bmm_glut const *const glut,
+    size_t const itex, size_t const base, size_t const icol, size_t const n) {
+  glActiveTexture(GL_TEXTURE0 + (GLenum) $(bmm_min, size_t)(itex, 2));
+  glBindTexture(GL_TEXTURE_BUFFER, glut->tex[itex]);
+  glTexBufferRange(GL_TEXTURE_BUFFER, GL_RG32UI, glut->vframe,
+      (GLintptr) (base + bmm_glut_off(glut->ncap, icol)),
+      (GLsizeiptr) (n * bmm_glut_size((enum bmm_glut_col) icol)));
+}
+
+/// The call `bmm_glut_draw(glut, islot)`
+/// draws the particles and contacts of the frame `islot` of `glut`.
+static void bmm_glut_draw(struct bmm_glut const *const glut,
+    size_t const islot) {
+  struct bmm_glut_slot const *const slot = &glut->slot[islot];
+  size_t const npart = slot->npart;
+  if (npart == 0)
+    return;
+
+  size_t const base = islot * glut->stride;
+
+  double xproj;
+  double yproj;
+  double wproj;
+  double hproj;
+  bmm_glut_proj(glut, &xproj, &yproj, &wproj, &hproj);
+
+  GLfloat const view[] = {
+    (GLfloat) xproj, (GLfloat) yproj, (GLfloat) wproj, (GLfloat) hproj
+  };
+  GLfloat const box[] = {
+    (GLfloat) glut->dopts.box.x[0], (GLfloat) glut->dopts.box.x[1]
+  };
+
+  if (glut->cont && slot->ncont == npart) {
+    GLuint const program = glut->cprogram;
+
+    glUseProgram(program);
+
+    glUniform4fv(glGetUniformLocation(program, "view"), 1, view);
+    glUniform2fv(glGetUniformLocation(program, "box"), 1, box);
+    glUniform1i(glGetUniformLocation(program, "color"), (GLint) glut->color);
+    glUniform1f(glGetUniformLocation(program, "cmax"), (GLfloat) glut->cmax);
+    glUniform1i(glGetUniformLocation(program, "npart"), (GLint) npart);
+    glUniform1i(glGetUniformLocation(program, "mcont"), BMM_MCONTACT);
+    glUniform1i(glGetUniformLocation(program, "stride"),
+        (GLint) (bmm_glut_size(BMM_GLUT_COL_CONT) / sizeof (uint64_t)));
+    glUniform1i(glGetUniformLocation(program, "itgt"),
+        (GLint) (offsetof(__typeof__ (*((struct bmm_dem *) NULL)->pair[0].cont.src),
+            itgt) / sizeof (uint64_t)));
+
+    bmm_glut_tex(glut, 0, base, BMM_GLUT_COL_X, npart);
+    bmm_glut_tex(glut, 1, base, BMM_GLUT_COL_F, npart);
+
+    glBindVertexArray(glut->cvarray);
+
+    for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict) {
+      glUniform3fv(glGetUniformLocation(program, "cflat"), 1,
+          ict == BMM_DEM_CT_STRONG ? glGreen : glRed);
+
+      bmm_glut_tex(glut, 2 + ict, base, BMM_GLUT_COL_CONT + ict, npart);
+
+      glDrawArraysInstanced(GL_LINES, 0, 2,
+          (GLsizei) (npart * BMM_MCONTACT));
+    }
+
+    glBindVertexArray(0);
+  }
+
+  {
+    GLuint const program = glut->program;
+
+    glUseProgram(program);
+
+    glUniform4fv(glGetUniformLocation(program, "view"), 1, view);
+    glUniform2fv(glGetUniformLocation(program, "box"), 1, box);
+    glUniform1i(glGetUniformLocation(program, "color"), (GLint) glut->color);
+    glUniform1f(glGetUniformLocation(program, "cmax"), (GLfloat) glut->cmax);
+    glUniform1i(glGetUniformLocation(program, "free"), BMM_DEM_ROLE_FREE);
+    glUniform3fv(glGetUniformLocation(program, "cfree"), 1, glYellow);
+    glUniform3fv(glGetUniformLocation(program, "cother"), 1, glWhite);
+
+    glBindVertexArray(glut->varray);
+
+    for (size_t icol = 0; icol < BMM_GLUT_COL_CONT; ++icol)
+      glBindVertexBuffer((GLuint) icol + 1, glut->vframe,
+          (GLintptr) (base + bmm_glut_off(glut->ncap, icol)),
+          (GLsizei) bmm_glut_size((enum bmm_glut_col) icol));
+
+    glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, BMM_GLUT_NCORNER + 2,
+        (GLsizei) (3 * npart));
+
+    glBindVertexArray(0);
+  }
+
+  glUseProgram(0);
+}
+
+static void bmm_glut_exit(void) {
+  bmm_glut_close(bmm_glut);
+
+  free(bmm_glut->prog);
+  bmm_glut->prog = NULL;
+}
+
+/// The call `bmm_glut_quit(result)`
+/// leaves the main loop with the outcome `result`.
+static void bmm_glut_quit(bool const result) {
+  if (!result)
+    bmm_glut->result = false;
+
+#ifdef FREE
+  glutLeaveMainLoop();
+#else
+  bmm_glut_exit();
+
+  longjmp(bmm_glut->env, 1);
+#endif
 }
 
-static bool bmm_glut_run_(struct bmm_glut *const glut) {
+static void ifunc(void) {
+  int signum;
+  if (bmm_sig_use(&signum))
+    switch (signum) {
+      case SIGINT:
+      case SIGQUIT:
+      case SIGTERM:
+      case SIGPIPE:
+        BMM_TLE_EXTS(BMM_TLE_NUM_ASYNC, "Interrupted");
+
+        bmm_glut_quit(false);
+
+        return;
+    }
+
+  // Once the input runs out, this only keeps an eye on signals.
+  if (bmm_glut->eof) {
+    struct timespec const t = {.tv_sec = 0, .tv_nsec = 10000000};
+    (void) nanosleep(&t, NULL);
+
+    return;
+  }
+
+  // Messages are read until a frame is complete or
+  // no more arrive in a while, so that events are never kept waiting.
   for ever {
-    int signum;
-    if (bmm_sig_use(&signum))
-      switch (signum) {
-        case SIGINT:
-        case SIGQUIT:
-        case SIGTERM:
-        case SIGPIPE:
-          BMM_TLE_EXTS(BMM_TLE_NUM_ASYNC, "Interrupted");
-
-          return false;
+    if (msgmap == NULL) {
+      struct timeval timeout = {.tv_sec = 0, .tv_usec = 10000};
+      switch (bmm_io_waitin(&timeout)) {
+        case BMM_IO_WAIT_ERROR:
+          bmm_glut_quit(false);
+
+          return;
+        case BMM_IO_WAIT_TIMEOUT:
+          return;
       }
+    }
+
+    size_t const iready = bmm_glut->iready;
 
-    switch (bmm_glut_step(glut)) {
+    switch (bmm_glut_step(bmm_glut)) {
       case BMM_IO_READ_ERROR:
-        return false;
+        bmm_glut_quit(false);
+
+        return;
       case BMM_IO_READ_EOF:
-        return true;
+        bmm_glut->eof = true;
+
+        return;
     }
-  }
-}
 
-static void ifunc(void) {
+    if (bmm_glut->iready != iready)
+      return;
+  }
 }
 
 static void render(void) {
-}
+  glClear(GL_COLOR_BUFFER_BIT);
 
-static void reshape(int const w, int const h) {
-}
+  size_t const islot = bmm_glut->iready;
 
-static void bmm_glut_exit(void) {
-  if (bmm_glut->program != 0)
-    glDeleteProgram(bmm_glut->program);
+  if (islot != SIZE_MAX) {
+    bmm_glut_draw(bmm_glut, islot);
 
-  if (bmm_glut->fshader != 0)
-    glDeleteShader(bmm_glut->fshader);
+    // The writer waits on this before reusing the frame.
+    struct bmm_glut_slot *const slot = &bmm_glut->slot[islot];
+    if (slot->fence != 0)
+      glDeleteSync(slot->fence);
 
-  if (bmm_glut->vshader != 0)
-    glDeleteShader(bmm_glut->vshader);
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
 
-  free(bmm_glut->prog);
+  glutSwapBuffers();
+}
+
+static void reshape(int const w, int const h) {
+  bmm_glut->width = w;
+  bmm_glut->height = h > 0 ? h : 1;
+
+  glViewport(0, 0, w, h);
+
+  glutPostRedisplay();
 }
 
 static void kfunc(unsigned char const key, int const x, int const y) {
   switch (key) {
     case '\x1b':
     case 'q':
-#ifdef FREE
-      glutLeaveMainLoop();
-#else
-      bmm_glut_exit();
+      bmm_glut_quit(true);
 
-      longjmp(bmm_glut->env, 1);
-#endif
+      return;
+    case '+':
+      bmm_glut_zoom(bmm_glut, 1.5);
+      break;
+    case '-':
+      bmm_glut_zoom(bmm_glut, 1.0 / 1.5);
+      break;
+    case '0':
+      bmm_glut->qzoom = 1.0;
+      bmm_glut->rorigin[0] = 0.0;
+      bmm_glut->rorigin[1] = 0.0;
+      break;
+    case 'c':
+      bmm_glut->color = (bmm_glut->color + 1) % BMM_GLUT_NCOLOR;
+      break;
+    case '[':
+      bmm_glut->cmax *= 0.5;
+      break;
+    case ']':
+      bmm_glut->cmax *= 2.0;
+      break;
+    case 'w':
+      bmm_glut->cont = !bmm_glut->cont;
+      break;
+    default:
+      return;
   }
+
+  glutPostRedisplay();
 }
 
 static void sfunc(int const key, int const x, int const y) {
+  switch (key) {
+    case GLUT_KEY_LEFT:
+      bmm_glut_move(bmm_glut, -0.25, 0.0);
+      break;
+    case GLUT_KEY_RIGHT:
+      bmm_glut_move(bmm_glut, 0.25, 0.0);
+      break;
+    case GLUT_KEY_DOWN:
+      bmm_glut_move(bmm_glut, 0.0, -0.25);
+      break;
+    case GLUT_KEY_UP:
+      bmm_glut_move(bmm_glut, 0.0, 0.25);
+      break;
+    default:
+      return;
+  }
+
+  glutPostRedisplay();
 }
 
 static void mfunc(int const button, int const state, int const x, int const y) {
@@ -188,6 +1020,9 @@ static void mfunc(int const button, int const state, int const x, int const y) {
 #ifdef FREE
 static void mwfunc(int const wheel, int const dir, int const x, int const y) {
   // There is the wheel number, direction is +/- 1, and x and y are the mouse coordinates.
+  bmm_glut_zoom(bmm_glut, dir > 0 ? 1.5 : 1.0 / 1.5);
+
+  glutPostRedisplay();
 }
 #endif
 
@@ -219,10 +1054,14 @@ bool bmm_glut_run(struct bmm_glut *const glut) {
 
 #ifdef FREE
   glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
+
+  // Persistent mappings need OpenGL 4.4.
+  glutInitContextVersion(4, 4);
+  glutInitContextProfile(GLUT_CORE_PROFILE);
 #endif
 
   glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE);
-  glutInitWindowSize(640, 480);
+  glutInitWindowSize(glut->width, glut->height);
   int const window = glutCreateWindow(BMM_SHORT);
   glutSetWindow(window);
 
@@ -230,9 +1069,17 @@ bool bmm_glut_run(struct bmm_glut *const glut) {
   glutIdleFunc(ifunc);
   glutReshapeFunc(reshape);
 
-  glewInit();
-  if (!GLEW_VERSION_3_3) {
-    BMM_TLE_EXTS(BMM_TLE_NUM_GL, "Failed to initialize OpenGL 3.3");
+  glewExperimental = GL_TRUE;
+  if (glewInit() != GLEW_OK || !GLEW_VERSION_4_4) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_GL, "Failed to initialize OpenGL 4.4");
+
+    free(bmm_glut->prog);
+
+    return false;
+  }
+
+  if (!bmm_glut_open(glut)) {
+    bmm_glut_exit();
 
     return false;
   }
@@ -251,12 +1098,43 @@ bool bmm_glut_run(struct bmm_glut *const glut) {
   bmm_glut_exit();
 #endif
 
-  return true;
+  return glut->result;
 }
 
-bool bmm_glut_run_with(struct bmm_glut_opts const *const opts) {
+/// The call `bmm_glut_run_with_(opts)`
+/// works like `bmm_glut_run_with(opts)`,
+/// but does not release the payload of compressed messages.
+__attribute__ ((__nonnull__))
+static bool bmm_glut_run_with_(struct bmm_glut_opts const *const opts) {
   struct bmm_glut glut;
   bmm_glut_def(&glut, opts);
 
-  return bmm_glut_run(&glut);
+  struct bmm_map map;
+  if (!bmm_map_open(&map, STDIN_FILENO))
+    return false;
+
+  if (map.ptr == NULL)
+    return bmm_glut_run(&glut);
+
+  msgmap = &map;
+
+  bool result = bmm_glut_run(&glut);
+
+  msgmap = NULL;
+
+  if (!bmm_map_close(&map))
+    result = false;
+
+  return result;
+}
+
+bool bmm_glut_run_with(struct bmm_glut_opts const *const opts) {
+  bool const result = bmm_glut_run_with_(opts);
+
+  bmm_zip_free(&msgzip);
+  bmm_zip_def(&msgzip);
+  bmm_lit_free(&msglit);
+  bmm_lit_def(&msglit);
+
+  return result;
 }
@@ -1,8 +1,8 @@
-#version 330 core
+#version 440 core
 
-in vec3 fColor;
+in vec4 fColor;
 out vec4 color;
 
 void main(void) {
-  color = vec4(fColor, 1.0f);
+  color = fColor;
 }
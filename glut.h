@@ -9,13 +9,50 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "dem.h"
 #include "ext.h"
 #include "io.h"
 
+/// Number of frames in flight.
+#define BMM_GLUT_NSLOT 3
+
+/// Fields to color particles by.
+enum bmm_glut_color {
+  /// Role.
+  BMM_GLUT_COLOR_ROLE,
+  /// Speed.
+  BMM_GLUT_COLOR_SPEED,
+  /// Magnitude of force,
+  /// which also colors contacts as force chains.
+  BMM_GLUT_COLOR_FORCE,
+  /// Angle.
+  BMM_GLUT_COLOR_ANGLE,
+  /// Number of fields.
+  BMM_GLUT_NCOLOR
+};
+
 /// This structure contains graphics options.
 struct bmm_glut_opts {
   char const *vpath;
   char const *fpath;
+  /// Vertex shader for contacts,
+  /// which shares the fragment shader with particles.
+  char const *cvpath;
+  /// Field to color particles by.
+  enum bmm_glut_color color;
+  /// Value of the field that gets the hottest color.
+  double cmax;
+};
+
+/// This structure tracks one of the frames in flight.
+struct bmm_glut_slot {
+  /// Fence that is signaled once the renderer is done with the frame
+  /// or zero if there is nothing to wait for.
+  GLsync fence;
+  /// Number of particles.
+  size_t npart;
+  /// Number of particles the contacts were written for.
+  size_t ncont;
 };
 
 /// This structure tracks resources.
@@ -23,9 +60,47 @@ struct bmm_glut {
   struct bmm_glut_opts opts;
   char *prog;
   jmp_buf env;
+  /// Whether the viewer has succeeded so far.
+  bool result;
+  /// Whether the input has ended.
+  bool eof;
   GLuint vshader;
   GLuint fshader;
   GLuint program;
+  GLuint cvshader;
+  GLuint cprogram;
+  GLuint varray;
+  GLuint cvarray;
+  /// Buffer of corners shared by every particle.
+  GLuint vcorner;
+  /// Persistently mapped buffer of frames in flight.
+  GLuint vframe;
+  /// Texture views of positions, forces and contacts of each type.
+  GLuint tex[2 + BMM_NCT];
+  /// Mapping of `vframe`.
+  unsigned char *ptr;
+  /// Number of particles there is room for in each frame.
+  size_t ncap;
+  /// Number of bytes in each frame.
+  size_t stride;
+  /// Frames in flight.
+  struct bmm_glut_slot slot[BMM_GLUT_NSLOT];
+  /// Index of the frame being written or `SIZE_MAX` if there is none.
+  size_t iwrite;
+  /// Index of the newest complete frame or `SIZE_MAX` if there is none.
+  size_t iready;
+  /// Options of the simulation being viewed.
+  struct bmm_dem_opts dopts;
+  int width;
+  int height;
+  double qzoom;
+  double rorigin[2];
+  /// Field to color particles by.
+  enum bmm_glut_color color;
+  /// Value of the field that gets the hottest color.
+  double cmax;
+  /// Whether contacts are drawn.
+  bool cont;
 };
 
 /// The call `bmm_glut_opts_def(opts)`
@@ -40,18 +115,21 @@ __attribute__ ((__nonnull__))
 void bmm_glut_def(struct bmm_glut *, struct bmm_glut_opts const *);
 
 /// The call `bmm_glut_step(glut)`
-/// processes one iglutoming message with the graphics state `glut`.
+/// processes one incoming message with the graphics state `glut`.
+/// Particle frames are read straight into the frame being written
+/// and the contacts of keyframes along with them,
+/// while difference and quantized frames are skipped.
 __attribute__ ((__nonnull__))
 enum bmm_io_read bmm_glut_step(struct bmm_glut *);
 
 /// The call `bmm_glut_run(glut)`
-/// processes all iglutoming messages and
+/// processes all incoming messages and
 /// handles signals with the graphics state `glut`.
 __attribute__ ((__nonnull__))
 bool bmm_glut_run(struct bmm_glut *);
 
 /// The call `bmm_glut_run_with(opts)`
-/// processes all iglutoming messages and
+/// processes all incoming messages and
 /// handles signals with the graphics options `opts`.
 __attribute__ ((__nonnull__))
 bool bmm_glut_run_with(struct bmm_glut_opts const *);
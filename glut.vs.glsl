@@ -1,15 +1,52 @@
-#version 330 core
+#version 440 core
 
-layout (location = 0) in vec3 position;
-layout (location = 2) in vec2 texCoords;
-layout (location = 3) in mat4 instanceMatrix;
+layout (location = 0) in vec2 corner;
+layout (location = 1) in vec2 x;
+layout (location = 2) in float r;
+layout (location = 3) in float phi;
+layout (location = 4) in vec2 v;
+layout (location = 5) in vec2 f;
+layout (location = 6) in int role;
 
-out vec2 TexCoords;
+out vec4 fColor;
 
-uniform mat4 projection;
-uniform mat4 view;
+uniform vec4 view;
+uniform vec2 box;
+uniform int color;
+uniform float cmax;
+uniform int free;
+uniform vec3 cfree;
+uniform vec3 cother;
+
+vec3 heat(float s) {
+  float t = clamp(s, 0.0f, 1.0f);
+
+  return vec3(t, 4.0f * t * (1.0f - t), 1.0f - t);
+}
 
 void main(void) {
-  gl_Position = projection * view * instanceMatrix * vec4(position, 1.0f);
-  TexCoords = texCoords;
+  float off = float(gl_InstanceID % 3 - 1);
+  vec2 y = x + vec2(off * box.x, 0.0f) + r * corner;
+
+  gl_Position = vec4(2.0f * (y - view.xy) / view.zw - 1.0f, 0.0f, 1.0f);
+
+  vec3 c;
+  switch (color) {
+    case 1:
+      c = heat(length(v) / cmax);
+      break;
+    case 2:
+      c = heat(length(f) / cmax);
+      break;
+    case 3:
+      c = heat(fract(phi / 6.2831853f));
+      break;
+    default:
+      c = role == free ? cfree : cother;
+  }
+
+  // The rim is darker, so that touching particles stay apart.
+  float rim = dot(corner, corner);
+
+  fColor = vec4(c * (1.0f - 0.25f * rim), off == 0.0f ? 1.0f : 0.5f);
 }
@@ -1,14 +1,57 @@
+#include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/select.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifdef _GNU_SOURCE
+#include <sys/sendfile.h>
+#endif
 
 #include "io.h"
 #include "tle.h"
 
 extern inline bool bmm_io_read_to_bool(enum bmm_io_read);
 
+/// Alignment of the buffers of the standard input and output.
+#define BMM_IO_ALIGN 4096
+
+static _Alignas(BMM_IO_ALIGN) char bmm_io_bufin[BMM_IO_BUFSIZE];
+
+static _Alignas(BMM_IO_ALIGN) char bmm_io_bufout[BMM_IO_BUFSIZE];
+
+bool bmm_io_setbufio(void) {
+  if (setvbuf(stdin, bmm_io_bufin, _IOFBF, sizeof bmm_io_bufin) != 0 ||
+      setvbuf(stdout, bmm_io_bufout, _IOFBF, sizeof bmm_io_bufout) != 0) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Failed to set up buffers");
+
+    return false;
+  }
+
+  return true;
+}
+
+bool bmm_io_sync(FILE *const stream) {
+  if (fflush(stream) == EOF) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  if (fsync(fileno(stream)) == -1 && errno != EINVAL && errno != EROFS) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return true;
+}
+
 enum bmm_io_wait bmm_io_wait(int const fd, struct timeval *const timeout) {
   fd_set fds;
   FD_ZERO(&fds);
@@ -28,7 +71,7 @@ enum bmm_io_wait bmm_io_wait(int const fd, struct timeval *const timeout) {
 size_t bmm_io_redir(FILE *const out, FILE *const in, size_t const size) {
   size_t progress = 0;
 
-  unsigned char buf[BUFSIZ];
+  unsigned char buf[BMM_IO_CHUNKSIZE];
 
   while (progress < size) {
     size_t const ndiff = size - progress;
@@ -38,7 +81,7 @@ size_t bmm_io_redir(FILE *const out, FILE *const in, size_t const size) {
     if (nread == 0)
       break;
 
-    size_t const nwritten = fwrite(buf, 1, nmemb, out);
+    size_t const nwritten = fwrite(buf, 1, nread, out);
     if (nwritten < nread)
       break;
 
@@ -51,7 +94,7 @@ size_t bmm_io_redir(FILE *const out, FILE *const in, size_t const size) {
 size_t bmm_io_fastfw(FILE *const stream, size_t const size) {
   size_t progress = 0;
 
-  unsigned char buf[BUFSIZ];
+  unsigned char buf[BMM_IO_CHUNKSIZE];
 
   while (progress < size) {
     size_t const ndiff = size - progress;
@@ -67,6 +110,155 @@ size_t bmm_io_fastfw(FILE *const stream, size_t const size) {
   return progress;
 }
 
+enum bmm_io_read bmm_io_read(int const fd,
+    void *const ptr, size_t const size) {
+  unsigned char *const buf = ptr;
+
+  size_t progress = 0;
+
+  while (progress < size) {
+    ssize_t const nread = read(fd, &buf[progress], size - progress);
+    if (nread == -1) {
+      if (errno == EINTR)
+        continue;
+
+      return BMM_IO_READ_ERROR;
+    }
+
+    if (nread == 0)
+      return BMM_IO_READ_EOF;
+
+    progress += (size_t) nread;
+  }
+
+  return BMM_IO_READ_SUCCESS;
+}
+
+bool bmm_io_write(int const fd, void const *const ptr, size_t const size) {
+  unsigned char const *const buf = ptr;
+
+  size_t progress = 0;
+
+  while (progress < size) {
+    ssize_t const nwritten = write(fd, &buf[progress], size - progress);
+    if (nwritten == -1) {
+      if (errno == EINTR)
+        continue;
+
+      return false;
+    }
+
+    progress += (size_t) nwritten;
+  }
+
+  return true;
+}
+
+// The kernel moves at most this many bytes at a time anyway.
+#define BMM_IO_MCHUNK ((size_t) 0x7ffff000)
+
+size_t bmm_io_splice(int const out, int const in, size_t const size) {
+#ifdef _GNU_SOURCE
+  size_t progress = 0;
+
+  while (progress < size) {
+    size_t const ndiff = size - progress;
+    size_t const nmemb = ndiff < BMM_IO_MCHUNK ? ndiff : BMM_IO_MCHUNK;
+
+    ssize_t const nmoved = splice(in, NULL, out, NULL, nmemb,
+        SPLICE_F_MOVE | SPLICE_F_MORE);
+    if (nmoved == -1) {
+      if (errno == EINTR)
+        continue;
+
+      break;
+    }
+
+    if (nmoved == 0)
+      break;
+
+    progress += (size_t) nmoved;
+  }
+
+  return progress;
+#else
+  errno = ENOSYS;
+
+  return 0;
+#endif
+}
+
+size_t bmm_io_tee(int const out, int const in, size_t const size) {
+#ifdef _GNU_SOURCE
+  size_t const nmemb = size < BMM_IO_MCHUNK ? size : BMM_IO_MCHUNK;
+
+  for ever {
+    ssize_t const nmoved = tee(in, out, nmemb, 0);
+    if (nmoved == -1) {
+      if (errno == EINTR)
+        continue;
+
+      return 0;
+    }
+
+    return (size_t) nmoved;
+  }
+#else
+  errno = ENOSYS;
+
+  return 0;
+#endif
+}
+
+size_t bmm_io_sendfile(int const out, int const in, size_t const size) {
+#ifdef _GNU_SOURCE
+  size_t progress = 0;
+
+  while (progress < size) {
+    size_t const ndiff = size - progress;
+    size_t const nmemb = ndiff < BMM_IO_MCHUNK ? ndiff : BMM_IO_MCHUNK;
+
+    ssize_t const nmoved = sendfile(out, in, NULL, nmemb);
+    if (nmoved == -1) {
+      if (errno == EINTR)
+        continue;
+
+      break;
+    }
+
+    if (nmoved == 0)
+      break;
+
+    progress += (size_t) nmoved;
+  }
+
+  return progress;
+#else
+  errno = ENOSYS;
+
+  return 0;
+#endif
+}
+
+size_t bmm_io_seek(int const fd, size_t const size) {
+  struct stat st;
+  if (fstat(fd, &st) == -1)
+    return 0;
+
+  off_t const pos = lseek(fd, 0, SEEK_CUR);
+  if (pos == -1 || pos > st.st_size)
+    return 0;
+
+  // Seeking past the end would succeed, so this is clamped by hand.
+  size_t const nrem = (size_t) (st.st_size - pos);
+  size_t const nmemb = size < nrem ? size : nrem;
+
+  if (lseek(fd, (off_t) nmemb, SEEK_CUR) == -1)
+    return 0;
+
+  return nmemb;
+}
+
 enum bmm_io_wait bmm_io_waitin(struct timeval *);
 
 extern inline bool bmm_io_redirio(size_t);
@@ -11,6 +11,12 @@
 
 #include "ext.h"
 
+/// Number of bytes in the buffers of the standard input and output.
+#define BMM_IO_BUFSIZE ((size_t) 1 << 20)
+
+/// Number of bytes to move at a time when redirecting or fast-forwarding.
+#define BMM_IO_CHUNKSIZE ((size_t) 1 << 16)
+
 /// This enumeration is returned by waiting operations.
 enum bmm_io_wait {
   BMM_IO_WAIT_ERROR,
@@ -39,6 +45,23 @@ inline bool bmm_io_read_to_bool(enum bmm_io_read const result) {
   dynamic_assert(false, "Nonexhaustive switch");
 }
 
+/// The call `bmm_io_setbufio()`
+/// gives the standard input and output
+/// buffers of `BMM_IO_BUFSIZE` bytes aligned to page boundaries,
+/// so that messages are read and written in large blocks.
+/// It must be called before either of them is used.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+bool bmm_io_setbufio(void);
+
+/// The call `bmm_io_sync(stream)`
+/// flushes `stream` and waits for its file to reach the storage device.
+/// Streams that cannot be synchronized, such as pipes, are only flushed.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_io_sync(FILE *);
+
 /// The call `bmm_io_wait(fd, timeout)`
 /// waits for input from the file descriptor `fd` or times out after `timeout`.
 /// The remaining time is written into `timeout`.
@@ -57,6 +80,48 @@ size_t bmm_io_redir(FILE *, FILE *, size_t);
 __attribute__ ((__nonnull__))
 size_t bmm_io_fastfw(FILE *, size_t);
 
+/// The call `bmm_io_read(fd, ptr, size)`
+/// reads `size` bytes from the file descriptor `fd` into `ptr`
+/// without any buffering.
+__attribute__ ((__nonnull__))
+enum bmm_io_read bmm_io_read(int, void *, size_t);
+
+/// The call `bmm_io_write(fd, ptr, size)`
+/// writes `size` bytes from `ptr` into the file descriptor `fd`
+/// without any buffering.
+__attribute__ ((__nonnull__))
+bool bmm_io_write(int, void const *, size_t);
+
+/// The call `bmm_io_splice(out, in, size)`
+/// moves `size` bytes from the file descriptor `in` to `out`
+/// without copying them through user space.
+/// At least one of the file descriptors must be a pipe.
+/// The return value is the number of bytes moved.
+size_t bmm_io_splice(int, int, size_t);
+
+/// The call `bmm_io_tee(out, in, size)`
+/// duplicates at most `size` bytes from the pipe `in` into the pipe `out`
+/// without consuming them or copying them through user space.
+/// The return value is the number of bytes duplicated,
+/// which is less than `size` when the pipes cannot hold more and
+/// zero when there is nothing left to duplicate or an error occurs.
+size_t bmm_io_tee(int, int, size_t);
+
+/// The call `bmm_io_sendfile(out, in, size)`
+/// moves `size` bytes from the file descriptor `in` to `out`
+/// without copying them through user space.
+/// The file descriptor `in` must be a regular file.
+/// The return value is the number of bytes moved.
+size_t bmm_io_sendfile(int, int, size_t);
+
+/// The call `bmm_io_seek(fd, size)`
+/// skips `size` bytes forward in the file descriptor `fd`
+/// without reading them.
+/// The file descriptor `fd` must be a regular file.
+/// The return value is the number of bytes skipped,
+/// which is less than `size` when the end of the file is reached.
+size_t bmm_io_seek(int, size_t);
+
 /// The call `bmm_io_waitin(timeout)`
 /// waits for input from the standard input or times out after `timeout`.
 __attribute__ ((__nonnull__))
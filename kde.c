@@ -0,0 +1,33 @@
+#include <math.h>
+#include <stddef.h>
+
+#include "kde.h"
+#include "kernel.h"
+
+extern inline void bmm_kde_bin(double *, size_t,
+    double, double, double, double);
+
+void bmm_kde_conv(double *restrict const py, double const *restrict const pc,
+    size_t const m, double const dx, enum bmm_kernel const k,
+    double const h) {
+  double (*const f)(double) = bmm_kernel(k);
+
+  double const lag = bmm_kernel_supp(k) * h / dx;
+  size_t const nlag = m == 0 ? 0 :
+    lag >= (double) (m - 1) ? m - 1 : (size_t) lag;
+
+  double const y = f(0.0) / h;
+  for (size_t i = 0; i < m; ++i)
+    py[i] = y * pc[i];
+
+  // The kernels are symmetric,
+  // so each lag is evaluated once and applied in both directions.
+  for (size_t ilag = 1; ilag <= nlag; ++ilag) {
+    double const ylag = f((double) ilag * dx / h) / h;
+
+    for (size_t i = ilag; i < m; ++i) {
+      py[i] += ylag * pc[i - ilag];
+      py[i - ilag] += ylag * pc[i];
+    }
+  }
+}
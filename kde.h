@@ -0,0 +1,47 @@
+/// Binned kernel density estimation.
+
+#ifndef BMM_KDE_H
+#define BMM_KDE_H
+
+#include <math.h>
+#include <stddef.h>
+
+#include "ext.h"
+#include "kernel.h"
+
+/// The call `bmm_kde_bin(pc, m, x0, dx, x, w)`
+/// adds the sample `x` with the weight `w`
+/// to the grid `pc` of `m` points spaced `dx` apart starting from `x0`
+/// by splitting the weight linearly between the two nearest points.
+/// Any part of the weight that would go outside the grid is discarded.
+__attribute__ ((__nonnull__))
+inline void bmm_kde_bin(double *const pc, size_t const m,
+    double const x0, double const dx, double const x, double const w) {
+  double const t = (x - x0) / dx;
+
+  if (!(t > -1.0 && t < (double) m))
+    return;
+
+  double const tfloor = floor(t);
+  double const f = t - tfloor;
+
+  if (tfloor >= 0.0)
+    pc[(size_t) tfloor] += (1.0 - f) * w;
+
+  if (tfloor + 1.0 < (double) m)
+    pc[(size_t) (tfloor + 1.0)] += f * w;
+}
+
+/// The call `bmm_kde_conv(py, pc, m, dx, k, h)`
+/// sets `py` to the kernel density estimate
+/// with the kernel `k` and the bandwidth `h`
+/// on the grid of `m` points spaced `dx` apart,
+/// where the samples have already been binned into `pc`
+/// by calling `bmm_kde_bin`.
+/// The kernel is convolved directly on the grid,
+/// so the cost is proportional to `m` times the ratio of `h` to `dx`.
+__attribute__ ((__nonnull__))
+void bmm_kde_conv(double *restrict, double const *restrict, size_t,
+    double, enum bmm_kernel, double);
+
+#endif
@@ -13,3 +13,7 @@ extern inline double bmm_kernel_cos(double);
 extern inline double bmm_kernel_gaussian(double);
 
 extern inline double bmm_kernel_logistic(double);
+
+extern inline double (*bmm_kernel(enum bmm_kernel))(double);
+
+extern inline double bmm_kernel_supp(enum bmm_kernel);
@@ -100,4 +100,26 @@ inline double (*bmm_kernel(enum bmm_kernel const k))(double) {
   return bmm_kernels[k];
 }
 
+/// The call `bmm_kernel_supp(k)`
+/// returns the half-width of the support of the kernel `k` or,
+/// if the support is the entire real line,
+/// the half-width outside of which the kernel is negligible.
+__attribute__ ((__const__, __pure__))
+inline double bmm_kernel_supp(enum bmm_kernel const k) {
+  switch (k) {
+    case BMM_KERNEL_RECT:
+    case BMM_KERNEL_TRI:
+    case BMM_KERNEL_EPAN:
+    case BMM_KERNEL_BIWEIGHT:
+    case BMM_KERNEL_COS:
+      return 1.0;
+    case BMM_KERNEL_GAUSSIAN:
+      return 8.0;
+    case BMM_KERNEL_LOGISTIC:
+      return 32.0;
+  }
+
+  return NAN;
+}
+
 #endif
@@ -0,0 +1,340 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "ext.h"
+#include "io.h"
+#include "lit.h"
+#include "msg.h"
+#include "tle.h"
+
+static_assert(sizeof BMM_LIT_TERM - 1 == (size_t) 1 << BMM_LIT_ETERM,
+    "Literal length mismatch");
+
+/// The call `bmm_lit_reserve(lit, n)`
+/// makes sure that the decoded body in `lit` has room for `n` bytes.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_lit_reserve(struct bmm_lit *const lit, size_t const n) {
+  size_t const ncap = lit->ncapraw;
+
+  if (n <= ncap)
+    return true;
+
+  size_t const nnew = $(bmm_max, size_t)(n,
+      ncap > SIZE_MAX / 2 ? SIZE_MAX : ncap * 2);
+
+  unsigned char *const buf = realloc(lit->raw, nnew);
+  if (buf == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  lit->raw = buf;
+  lit->ncapraw = nnew;
+
+  return true;
+}
+
+/// The call `bmm_lit_find(buf, n, term, nterm)`
+/// returns the position of the first occurrence of the literal `term`
+/// of length `nterm` in the buffer `buf`
+/// that begins before `n` or `n` if there is none.
+/// The buffer must hold at least `n + nterm` bytes.
+__attribute__ ((__nonnull__, __pure__))
+static size_t bmm_lit_find(unsigned char const *const buf, size_t const n,
+    unsigned char const *const term, size_t const nterm) {
+  size_t i = 0;
+
+  while (i < n) {
+    unsigned char const *const p = memchr(&buf[i], term[0], n - i);
+    if (p == NULL)
+      return n;
+
+    i = (size_t) (p - buf);
+
+    if (memcmp(p, term, nterm) == 0)
+      return i;
+
+    ++i;
+  }
+
+  return n;
+}
+
+void bmm_lit_def(struct bmm_lit *const lit) {
+  lit->nterm = 0;
+  lit->nmatch = 0;
+  lit->raw = NULL;
+  lit->nraw = 0;
+  lit->ncapraw = 0;
+  lit->iraw = 0;
+  lit->tmp = NULL;
+}
+
+void bmm_lit_free(struct bmm_lit *const lit) {
+  free(lit->tmp);
+  free(lit->raw);
+}
+
+void bmm_lit_spec(struct bmm_msg_spec *const spec) {
+  spec->tag = BMM_MSG_TAG_LT;
+  spec->msg.term.e = BMM_LIT_ETERM;
+  (void) memcpy(spec->msg.term.buf, BMM_LIT_TERM, sizeof BMM_LIT_TERM - 1);
+}
+
+void bmm_lit_begin(struct bmm_lit *const lit,
+    struct bmm_msg_spec const *const spec) {
+  size_t const nterm = $(bmm_power, size_t)(2, spec->msg.term.e);
+
+  (void) memcpy(lit->term, spec->msg.term.buf, nterm);
+  lit->nterm = nterm;
+  lit->nmatch = 0;
+
+  // This is the failure function of the Knuth--Morris--Pratt algorithm.
+  lit->fail[0] = 0;
+  for (size_t i = 1, j = 0; i < nterm; ++i) {
+    while (j > 0 && lit->term[i] != lit->term[j])
+      j = lit->fail[j - 1];
+
+    if (lit->term[i] == lit->term[j])
+      ++j;
+
+    lit->fail[i] = j;
+  }
+}
+
+bool bmm_lit_put(struct bmm_lit *const lit, void const *const ptr,
+    size_t const n, bmm_msg_writer const f, void *const fptr) {
+  unsigned char const *const buf = ptr;
+  unsigned char const esc = BMM_LIT_ESC;
+
+  size_t ifrom = 0;
+  size_t i = 0;
+
+  while (i < n) {
+    // Nothing needs to be looked at before the next possible occurrence.
+    if (lit->nmatch == 0) {
+      unsigned char const *const p = memchr(&buf[i], lit->term[0], n - i);
+      if (p == NULL)
+        break;
+
+      i = (size_t) (p - buf);
+    }
+
+    while (lit->nmatch > 0 && buf[i] != lit->term[lit->nmatch])
+      lit->nmatch = lit->fail[lit->nmatch - 1];
+
+    if (buf[i] == lit->term[lit->nmatch])
+      ++lit->nmatch;
+
+    ++i;
+
+    if (lit->nmatch == lit->nterm) {
+      if (!f(&buf[ifrom], i - ifrom, fptr) || !f(&esc, 1, fptr))
+        return false;
+
+      ifrom = i;
+      lit->nmatch = 0;
+    }
+  }
+
+  return ifrom == n || f(&buf[ifrom], n - ifrom, fptr);
+}
+
+bool bmm_lit_end(struct bmm_lit *const lit,
+    bmm_msg_writer const f, void *const ptr) {
+  unsigned char const c = BMM_LIT_END;
+
+  lit->nmatch = 0;
+
+  return f(lit->term, lit->nterm, ptr) && f(&c, 1, ptr);
+}
+
+void bmm_lit_clear(struct bmm_lit *const lit) {
+  lit->nraw = 0;
+  lit->iraw = 0;
+}
+
+enum bmm_io_read bmm_lit_open(struct bmm_lit *const lit,
+    struct bmm_msg_spec const *const spec,
+    bmm_msg_reader const f, bmm_lit_peeker const g, void *const ptr) {
+  bmm_lit_clear(lit);
+
+  if (spec->tag != BMM_MSG_TAG_LT) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Message not literal-terminated");
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  size_t const nterm = $(bmm_power, size_t)(2, spec->msg.term.e);
+  unsigned char const *const term = spec->msg.term.buf;
+
+  // The body is not exposed before it is complete,
+  // because the reader may well be asking whether it is.
+  size_t nraw = 0;
+
+  if (g != NULL && lit->tmp == NULL) {
+    lit->tmp = malloc(BMM_LIT_MPEEK);
+    if (lit->tmp == NULL) {
+      BMM_TLE_STDS();
+
+      return BMM_IO_READ_ERROR;
+    }
+  }
+
+  // Without looking ahead,
+  // only as much can be read as could still be the end.
+  unsigned char buf[BMM_MSG_PRESIZE + 1];
+  size_t nbuf = 0;
+
+  for ever {
+    size_t const n = g != NULL && nbuf == 0 ?
+      g(lit->tmp, BMM_LIT_MPEEK, ptr) : 0;
+
+    if (n > nterm) {
+      // Occurrences can only be judged
+      // once the octet after them is in sight.
+      size_t const nscan = n - nterm;
+      size_t const i = bmm_lit_find(lit->tmp, nscan, term, nterm);
+
+      if (!bmm_lit_reserve(lit, nraw + i + nterm))
+        return BMM_IO_READ_ERROR;
+
+      (void) memcpy(&lit->raw[nraw], lit->tmp, i);
+      nraw += i;
+
+      bool done = false;
+      if (i < nscan)
+        switch (lit->tmp[i + nterm]) {
+          case BMM_LIT_ESC:
+            (void) memcpy(&lit->raw[nraw], term, nterm);
+            nraw += nterm;
+
+            break;
+          case BMM_LIT_END:
+            done = true;
+
+            break;
+          default:
+            BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Invalid escape");
+
+            return BMM_IO_READ_ERROR;
+        }
+
+      switch (f(lit->tmp, i < nscan ? i + nterm + 1 : nscan, ptr)) {
+        case BMM_IO_READ_ERROR:
+          return BMM_IO_READ_ERROR;
+        case BMM_IO_READ_EOF:
+          return BMM_IO_READ_EOF;
+      }
+
+      if (done) {
+        lit->nraw = nraw;
+
+        return BMM_IO_READ_SUCCESS;
+      }
+
+      continue;
+    }
+
+    switch (f(&buf[nbuf], nterm + 1 - nbuf, ptr)) {
+      case BMM_IO_READ_ERROR:
+        return BMM_IO_READ_ERROR;
+      case BMM_IO_READ_EOF:
+        return BMM_IO_READ_EOF;
+    }
+
+    size_t i = 0;
+    while (i <= nterm &&
+        memcmp(&buf[i], term, $(bmm_min, size_t)(nterm, nterm + 1 - i)) != 0)
+      ++i;
+
+    if (!bmm_lit_reserve(lit, nraw + $(bmm_max, size_t)(i, nterm)))
+      return BMM_IO_READ_ERROR;
+
+    if (i > 0) {
+      (void) memcpy(&lit->raw[nraw], buf, i);
+      nraw += i;
+
+      nbuf = nterm + 1 - i;
+      (void) memmove(buf, &buf[i], nbuf);
+
+      continue;
+    }
+
+    switch (buf[nterm]) {
+      case BMM_LIT_ESC:
+        (void) memcpy(&lit->raw[nraw], term, nterm);
+        nraw += nterm;
+
+        nbuf = 0;
+
+        break;
+      case BMM_LIT_END:
+        lit->nraw = nraw;
+
+        return BMM_IO_READ_SUCCESS;
+      default:
+        BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Invalid escape");
+
+        return BMM_IO_READ_ERROR;
+    }
+  }
+}
+
+bool bmm_lit_ongoing(struct bmm_lit const *const lit) {
+  return lit->iraw < lit->nraw;
+}
+
+enum bmm_io_read bmm_lit_read(struct bmm_lit *const lit,
+    void *const buf, size_t const n) {
+  if (n > lit->nraw - lit->iraw)
+    return BMM_IO_READ_EOF;
+
+  if (n != 0)
+    (void) memcpy(buf, &lit->raw[lit->iraw], n);
+  lit->iraw += n;
+
+  return BMM_IO_READ_SUCCESS;
+}
+
+enum bmm_io_read bmm_lit_fastfw(struct bmm_lit *const lit, size_t const n) {
+  if (n > lit->nraw - lit->iraw)
+    return BMM_IO_READ_EOF;
+
+  lit->iraw += n;
+
+  return BMM_IO_READ_SUCCESS;
+}
+
+size_t bmm_lit_scan(struct bmm_msg_spec const *const spec,
+    void const *const ptr, size_t const n) {
+  unsigned char const *const buf = ptr;
+
+  size_t const nterm = $(bmm_power, size_t)(2, spec->msg.term.e);
+  unsigned char const *const term = spec->msg.term.buf;
+
+  size_t i = 0;
+
+  while (n - i > nterm) {
+    size_t const nscan = n - i - nterm;
+    size_t const j = bmm_lit_find(&buf[i], nscan, term, nterm);
+    if (j == nscan)
+      return SIZE_MAX;
+
+    i += j + nterm;
+
+    if (buf[i] != BMM_LIT_ESC)
+      return buf[i] == BMM_LIT_END ? i + 1 : SIZE_MAX;
+
+    ++i;
+  }
+
+  return SIZE_MAX;
+}
@@ -0,0 +1,145 @@
+/// Literal-terminated messages.
+///
+/// The body of a literal-terminated message ends with its literal
+/// followed by `BMM_LIT_END`, and
+/// every occurrence of the literal within the body
+/// is followed by `BMM_LIT_ESC`,
+/// so that bodies can be written before their sizes are known.
+/// Occurrences are found from left to right without overlapping,
+/// which makes the first byte of the body its message number
+/// no matter what the literal is.
+/// The literal should not begin with any of its proper suffixes,
+/// or else bodies that end with a part of it
+/// could not be told apart from their ends.
+///
+///     | Header          | Body
+///     | Flags | Literal | Number | Data | Literal | Esc | ... | Literal | End
+
+#ifndef BMM_LIT_H
+#define BMM_LIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ext.h"
+#include "io.h"
+#include "msg.h"
+
+/// Octet that follows escaped occurrences of the literal.
+#define BMM_LIT_ESC 0
+
+/// Octet that follows the literal at the end of the body.
+#define BMM_LIT_END 1
+
+/// Literal that is used unless something else is asked for,
+/// along with the binary logarithm of its length.
+#define BMM_LIT_TERM "\xfe" "bmmend" "\xff"
+#define BMM_LIT_ETERM 3
+
+/// Maximum number of octets to look ahead when scanning for the end.
+#define BMM_LIT_MPEEK 65536
+
+/// Assuming `bmm_lit_peeker f`, the call `f(buf, n, ptr)`
+/// copies at most `n` bytes that are about to be read into the buffer `buf`
+/// without consuming them and returns how many there were.
+/// The additional `ptr` can be used for passing in a closure.
+typedef size_t (*bmm_lit_peeker)(void *, size_t, void *);
+
+/// This structure holds the state of the encoder and
+/// the decoded body of one message.
+struct bmm_lit {
+  /// Literal.
+  unsigned char term[BMM_MSG_PRESIZE];
+  /// Number of octets in the literal.
+  size_t nterm;
+  /// Length of the longest proper prefix of the literal
+  /// that is also a suffix of each of its prefixes.
+  size_t fail[BMM_MSG_PRESIZE];
+  /// Number of octets of the literal matched by the encoder so far.
+  size_t nmatch;
+  /// Decoded body.
+  unsigned char *raw;
+  /// Number of decoded bytes.
+  size_t nraw;
+  /// Number of decoded bytes there is room for.
+  size_t ncapraw;
+  /// Position of the reader in the decoded body.
+  size_t iraw;
+  /// Octets looked ahead at.
+  unsigned char *tmp;
+};
+
+/// The call `bmm_lit_def(lit)`
+/// writes the default state into `lit`.
+__attribute__ ((__nonnull__))
+void bmm_lit_def(struct bmm_lit *);
+
+/// The call `bmm_lit_free(lit)`
+/// releases the resources held by `lit`.
+__attribute__ ((__nonnull__))
+void bmm_lit_free(struct bmm_lit *);
+
+/// The call `bmm_lit_spec(spec)`
+/// makes the message specification `spec` literal-terminated
+/// with the default literal.
+__attribute__ ((__nonnull__))
+void bmm_lit_spec(struct bmm_msg_spec *);
+
+/// The call `bmm_lit_begin(lit, spec)`
+/// starts encoding a body
+/// with the literal of the message specification `spec`.
+__attribute__ ((__nonnull__))
+void bmm_lit_begin(struct bmm_lit *, struct bmm_msg_spec const *);
+
+/// The call `bmm_lit_put(lit, buf, n, f, ptr)`
+/// encodes `n` bytes from the buffer `buf`
+/// and writes them by sequentially calling `f(buf, n, ptr)`.
+__attribute__ ((__nonnull__ (1, 4)))
+bool bmm_lit_put(struct bmm_lit *, void const *, size_t,
+    bmm_msg_writer, void *);
+
+/// The call `bmm_lit_end(lit, f, ptr)`
+/// finishes encoding a body by calling `f(buf, n, ptr)`.
+__attribute__ ((__nonnull__ (1, 2)))
+bool bmm_lit_end(struct bmm_lit *, bmm_msg_writer, void *);
+
+/// The call `bmm_lit_clear(lit)`
+/// forgets the decoded body in `lit`.
+__attribute__ ((__nonnull__))
+void bmm_lit_clear(struct bmm_lit *);
+
+/// The call `bmm_lit_open(lit, spec, f, g, ptr)`
+/// reads the body of a message with the specification `spec`
+/// by sequentially calling `f(buf, n, ptr)` and decodes it into `lit`.
+/// Nothing after the end of the body is read.
+/// If `g` is not `NULL`, it is called as `g(buf, n, ptr)`
+/// to look far enough ahead to scan for the end in large chunks.
+/// The body can then be consumed by calling `bmm_lit_read`.
+__attribute__ ((__nonnull__ (1, 2, 3)))
+enum bmm_io_read bmm_lit_open(struct bmm_lit *, struct bmm_msg_spec const *,
+    bmm_msg_reader, bmm_lit_peeker, void *);
+
+/// The call `bmm_lit_ongoing(lit)`
+/// checks whether the decoded body in `lit` has not been consumed yet.
+__attribute__ ((__nonnull__, __pure__))
+bool bmm_lit_ongoing(struct bmm_lit const *);
+
+/// The call `bmm_lit_read(lit, buf, n)`
+/// reads `n` bytes from the decoded body in `lit` into the buffer `buf`.
+__attribute__ ((__nonnull__ (1)))
+enum bmm_io_read bmm_lit_read(struct bmm_lit *, void *, size_t);
+
+/// The call `bmm_lit_fastfw(lit, n)`
+/// skips `n` bytes of the decoded body in `lit`.
+__attribute__ ((__nonnull__))
+enum bmm_io_read bmm_lit_fastfw(struct bmm_lit *, size_t);
+
+/// The call `bmm_lit_scan(spec, buf, n)`
+/// returns the length of the encoded body
+/// of a message with the specification `spec`
+/// that begins the buffer `buf` of length `n`,
+/// including its end, or `SIZE_MAX` if the end is not there.
+__attribute__ ((__nonnull__, __pure__))
+size_t bmm_lit_scan(struct bmm_msg_spec const *, void const *, size_t);
+
+#endif
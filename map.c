@@ -0,0 +1,121 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "ext.h"
+#include "io.h"
+#include "map.h"
+#include "tle.h"
+
+/// The call `bmm_map_map(map, size)`
+/// replaces the mapping of `map` with one of `size` bytes.
+__attribute__ ((__nonnull__))
+static bool bmm_map_map(struct bmm_map *const map, size_t const size) {
+  void *const ptr = mmap(NULL, size, PROT_READ, MAP_SHARED, map->fd, 0);
+  if (ptr == MAP_FAILED) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  // Messages are mostly consumed from front to back.
+  (void) posix_madvise(ptr, size, POSIX_MADV_SEQUENTIAL);
+
+  if (map->ptr != NULL)
+    if (munmap((void *) map->ptr, map->size) == -1) {
+      BMM_TLE_STDS();
+
+      (void) munmap(ptr, size);
+
+      return false;
+    }
+
+  map->ptr = ptr;
+  map->size = size;
+
+  return true;
+}
+
+bool bmm_map_open(struct bmm_map *const map, int const fd) {
+  map->fd = fd;
+  map->ptr = NULL;
+  map->size = 0;
+  map->pos = 0;
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  if (!S_ISREG(st.st_mode) || st.st_size == 0)
+    return true;
+
+  off_t const pos = lseek(fd, 0, SEEK_CUR);
+  if (pos == -1) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  if (!bmm_map_map(map, (size_t) st.st_size))
+    return false;
+
+  map->pos = pos > st.st_size ? map->size : (size_t) pos;
+
+  return true;
+}
+
+bool bmm_map_close(struct bmm_map *const map) {
+  if (map->ptr == NULL)
+    return true;
+
+  bool result = true;
+
+  if (munmap((void *) map->ptr, map->size) == -1) {
+    BMM_TLE_STDS();
+
+    result = false;
+  }
+
+  if (lseek(map->fd, (off_t) map->pos, SEEK_SET) == -1) {
+    BMM_TLE_STDS();
+
+    result = false;
+  }
+
+  map->ptr = NULL;
+
+  return result;
+}
+
+enum bmm_io_read bmm_map_more(struct bmm_map *const map, size_t const size) {
+  // The file may still be growing if someone is writing into it.
+  struct stat st;
+  if (fstat(map->fd, &st) == -1) {
+    BMM_TLE_STDS();
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  if ((size_t) st.st_size > map->size)
+    if (!bmm_map_map(map, (size_t) st.st_size))
+      return BMM_IO_READ_ERROR;
+
+  if (size > map->size - map->pos)
+    return BMM_IO_READ_EOF;
+
+  return BMM_IO_READ_SUCCESS;
+}
+
+extern inline enum bmm_io_read bmm_map_peek(struct bmm_map *,
+    void const **, size_t);
+
+extern inline enum bmm_io_read bmm_map_fastfw(struct bmm_map *, size_t);
+
+extern inline enum bmm_io_read bmm_map_read(struct bmm_map *, void *, size_t);
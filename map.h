@@ -0,0 +1,94 @@
+/// Memory-mapped input.
+
+#ifndef BMM_MAP_H
+#define BMM_MAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "ext.h"
+#include "io.h"
+
+/// Mapping state.
+struct bmm_map {
+  /// File descriptor.
+  int fd;
+  /// Contents or `NULL` if nothing is mapped.
+  unsigned char const *ptr;
+  /// Number of bytes mapped.
+  size_t size;
+  /// Number of bytes consumed.
+  size_t pos;
+};
+
+/// The call `bmm_map_open(map, fd)`
+/// maps the file descriptor `fd` into `map` if it is a regular file and
+/// positions `map` at the current file offset.
+/// If `fd` is not a regular file or is empty,
+/// nothing is mapped and `map->ptr` is left as `NULL`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_map_open(struct bmm_map *, int);
+
+/// The call `bmm_map_close(map)`
+/// unmaps `map` and moves the file offset to where reading stopped.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_map_close(struct bmm_map *);
+
+/// The call `bmm_map_more(map, size)`
+/// remaps `map` if the file has grown
+/// until there are at least `size` bytes left or
+/// the end of the file is reached.
+__attribute__ ((__nonnull__))
+enum bmm_io_read bmm_map_more(struct bmm_map *, size_t);
+
+/// The call `bmm_map_peek(map, ptr, size)`
+/// points `ptr` to the next `size` bytes of `map` without consuming them.
+/// The pointer is valid until the next operation on `map`.
+__attribute__ ((__nonnull__))
+inline enum bmm_io_read bmm_map_peek(struct bmm_map *const map,
+    void const **const ptr, size_t const size) {
+  if (size > map->size - map->pos) {
+    enum bmm_io_read const result = bmm_map_more(map, size);
+    if (result != BMM_IO_READ_SUCCESS)
+      return result;
+  }
+
+  *ptr = &map->ptr[map->pos];
+
+  return BMM_IO_READ_SUCCESS;
+}
+
+/// The call `bmm_map_fastfw(map, size)`
+/// consumes `size` bytes of `map` without looking at them.
+__attribute__ ((__nonnull__))
+inline enum bmm_io_read bmm_map_fastfw(struct bmm_map *const map,
+    size_t const size) {
+  void const *ptr;
+  enum bmm_io_read const result = bmm_map_peek(map, &ptr, size);
+  if (result == BMM_IO_READ_SUCCESS)
+    map->pos += size;
+
+  return result;
+}
+
+/// The call `bmm_map_read(map, ptr, size)`
+/// consumes `size` bytes of `map` by copying them into `ptr`.
+__attribute__ ((__nonnull__))
+inline enum bmm_io_read bmm_map_read(struct bmm_map *const map,
+    void *const ptr, size_t const size) {
+  void const *src;
+  enum bmm_io_read const result = bmm_map_peek(map, &src, size);
+  if (result == BMM_IO_READ_SUCCESS) {
+    (void) memcpy(ptr, src, size);
+    map->pos += size;
+  }
+
+  return result;
+}
+
+#endif
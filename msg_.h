@@ -2,7 +2,19 @@ BMM_MSG_DECLARE(NOP, 0)
 BMM_MSG_DECLARE(ISTEP, 10)
 BMM_MSG_DECLARE(NSTEP, 60)
 BMM_MSG_DECLARE(OPTS, 80)
+BMM_MSG_DECLARE(SCHEMA, 81)
 BMM_MSG_DECLARE(NPART, 142)
 BMM_MSG_DECLARE(PARTS, 144)
+BMM_MSG_DECLARE(QPARTS, 145)
+BMM_MSG_DECLARE(DPARTS, 146)
+BMM_MSG_DECLARE(CPARTS, 147)
 BMM_MSG_DECLARE(NEIGH, 168)
+BMM_MSG_DECLARE(DCONTS, 170)
 BMM_MSG_DECLARE(EST, 185)
+BMM_MSG_DECLARE(FIELD, 186)
+BMM_MSG_DECLARE(PROF, 187)
+BMM_MSG_DECLARE(FRAG, 188)
+BMM_MSG_DECLARE(CEST, 189)
+BMM_MSG_DECLARE(PERF, 190)
+BMM_MSG_DECLARE(STATS, 191)
+BMM_MSG_DECLARE(ZIP, 240)
@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <math.h>
 #include <netcdf.h>
 #include <signal.h>
@@ -5,17 +6,26 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "col.h"
+#include "common.h"
 #include "conf.h"
 // TODO Undepend.
 #include "dem.h"
+#include "endy.h"
 #include "ext.h"
+#include "fp.h"
 #include "io.h"
+#include "lit.h"
+#include "map.h"
 #include "msg.h"
 #include "nc.h"
 #include "sig.h"
+#include "store.h"
 #include "tle.h"
+#include "zip.h"
 
 void bmm_nc_opts_def(struct bmm_nc_opts *const opts) {
   opts->conv = BMM_NC_CONV_AMBER;
@@ -25,6 +35,13 @@ void bmm_nc_opts_def(struct bmm_nc_opts *const opts) {
   opts->q = true;
   opts->v = false;
   opts->f = false;
+  opts->store = NULL;
+  opts->frame = 0;
+  opts->nbatch = 64;
+  opts->natom = 0;
+  opts->deflate = 1;
+  opts->shuffle = true;
+  opts->single = true;
 }
 
 // Must have `NDIM == 3` for OVITO.
@@ -37,17 +54,123 @@ void bmm_nc_def(struct bmm_nc *const nc,
   // nc->npart = 0;
   nc->npart = 1;
   nc->iframe = 0;
+  nc->natom = 0;
+  nc->nbatch = 0;
+  nc->nroom = 0;
+  nc->t = 0.0;
+  nc->defined = false;
+  nc->coords = NULL;
+  nc->times = NULL;
 }
 
+/// Container to read messages from instead of the standard input.
+static struct bmm_store_reader *msgstore = NULL;
+
+/// Mapping of the standard input if it is a regular file.
+static struct bmm_map *msgmap = NULL;
+
+/// Payload of the compressed message being read.
+static struct bmm_zip msgzip = {
+  .raw = NULL, .nraw = 0, .ncapraw = 0, .iraw = 0, .tmp = NULL, .ncaptmp = 0
+};
+
+/// Body of the literal-terminated message being read.
+static struct bmm_lit msglit = {
+  .nterm = 0, .nmatch = 0,
+  .raw = NULL, .nraw = 0, .ncapraw = 0, .iraw = 0, .tmp = NULL
+};
+
+/// Whether the message being read has the other byte order.
+static bool msgswap = false;
+
+/// Most recent description of the table messages.
+static struct bmm_col_schema msgschema = {.ntab = 0};
+
 static enum bmm_io_read msg_read(void *buf, size_t const n,
     __attribute__ ((__unused__)) void *const ptr) {
+  if (bmm_zip_ongoing(&msgzip))
+    return bmm_zip_read(&msgzip, buf, n);
+
+  if (bmm_lit_ongoing(&msglit))
+    return bmm_lit_read(&msglit, buf, n);
+
+  if (msgstore != NULL)
+    return bmm_store_read(msgstore, buf, n);
+
+  if (msgmap != NULL)
+    return bmm_map_read(msgmap, buf, n);
+
   return bmm_io_readin(buf, n);
 }
 
-static bool bmm_nc_open(struct bmm_nc *const nc) {
+static enum bmm_io_read msg_fastfw(size_t const n) {
+  if (bmm_zip_ongoing(&msgzip))
+    return bmm_zip_fastfw(&msgzip, n);
+
+  if (bmm_lit_ongoing(&msglit))
+    return bmm_lit_fastfw(&msglit, n);
+
+  if (msgstore != NULL)
+    return bmm_store_fastfw(msgstore, n);
+
+  if (msgmap != NULL)
+    return bmm_map_fastfw(msgmap, n);
+
+  return bmm_io_fastfwin(n);
+}
+
+static enum bmm_io_read msg_skip(size_t const n,
+    __attribute__ ((__unused__)) void *const ptr) {
+  return msg_fastfw(n);
+}
+
+/// The call `msg_swap(buf, n, size)`
+/// converts the `n` words of `size` bytes in the buffer `buf`
+/// from the byte order of the message being read to that of the system.
+static void msg_swap(void *const buf, size_t const n, size_t const size) {
+  if (msgswap)
+    bmm_endy_swap(buf, n, size);
+}
+
+/// The call `bmm_nc_chunk(nc, varid, chunks)`
+/// chunks and compresses the variable `varid`
+/// if the options ask for compression.
+static bool bmm_nc_chunk(struct bmm_nc const *const nc,
+    int const varid, size_t const *const chunks) {
+  if (nc->opts.deflate == 0)
+    return true;
+
+  int nerr;
+
+  nerr = nc_def_var_chunking(nc->ncid, varid, NC_CHUNKED, chunks);
+  if (nerr != NC_NOERR) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_NC, "%s", nc_strerror(nerr));
+
+    return false;
+  }
+
+  nerr = nc_def_var_deflate(nc->ncid, varid,
+      nc->opts.shuffle ? 1 : 0, 1, (int) nc->opts.deflate);
+  if (nerr != NC_NOERR) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_NC, "%s", nc_strerror(nerr));
+
+    return false;
+  }
+
+  return true;
+}
+
+/// The call `bmm_nc_define(nc)`
+/// creates the file and defines its contents
+/// once the number of atoms is known.
+static bool bmm_nc_define(struct bmm_nc *const nc) {
   int nerr;
 
-  nerr = nc_create(nc->opts.path, NC_CLOBBER | NC_64BIT_OFFSET, &nc->ncid);
+  // Compression is only available in the NetCDF-4 format.
+  int const mode = nc->opts.deflate == 0 ?
+    NC_CLOBBER | NC_64BIT_OFFSET : NC_CLOBBER | NC_NETCDF4;
+
+  nerr = nc_create(nc->opts.path, mode, &nc->ncid);
   if (nerr != NC_NOERR) {
     BMM_TLE_EXTS(BMM_TLE_NUM_NC, "%s", nc_strerror(nerr));
 
@@ -104,7 +227,7 @@ static bool bmm_nc_open(struct bmm_nc *const nc) {
     return false;
   }
 
-  nerr = nc_def_dim(nc->ncid, "atom", BMM_MPART, &nc->id_atom);
+  nerr = nc_def_dim(nc->ncid, "atom", nc->natom, &nc->id_atom);
   if (nerr != NC_NOERR) {
     BMM_TLE_EXTS(BMM_TLE_NUM_NC, "%s", nc_strerror(nerr));
 
@@ -143,14 +266,23 @@ static bool bmm_nc_open(struct bmm_nc *const nc) {
     return false;
   }
 
+  nc_type const type = nc->opts.single ? NC_FLOAT : NC_DOUBLE;
+
+  // Chunks span one batch of frames, so each batch is compressed once.
+  size_t chunks[3];
+
   dimids[0] = nc->id_frame;
-  nerr = nc_def_var(nc->ncid, "time", NC_FLOAT, 1, dimids, &nc->varid_time);
+  nerr = nc_def_var(nc->ncid, "time", type, 1, dimids, &nc->varid_time);
   if (nerr != NC_NOERR) {
     BMM_TLE_EXTS(BMM_TLE_NUM_NC, "%s", nc_strerror(nerr));
 
     return false;
   }
 
+  chunks[0] = nc->opts.nbatch;
+  if (!bmm_nc_chunk(nc, nc->varid_time, chunks))
+    return false;
+
   char const time[] = "second";
   nerr = nc_put_att_text(nc->ncid, nc->varid_time,
       "units", strlen(time), time);
@@ -164,13 +296,19 @@ static bool bmm_nc_open(struct bmm_nc *const nc) {
   dimids[1] = nc->id_atom;
   dimids[2] = nc->id_spatial;
   nerr = nc_def_var(nc->ncid,
-      "coordinates", NC_FLOAT, 3, dimids, &nc->varid_coords);
+      "coordinates", type, 3, dimids, &nc->varid_coords);
   if (nerr != NC_NOERR) {
     BMM_TLE_EXTS(BMM_TLE_NUM_NC, "%s", nc_strerror(nerr));
 
     return false;
   }
 
+  chunks[0] = nc->opts.nbatch;
+  chunks[1] = nc->natom;
+  chunks[2] = NDIM;
+  if (!bmm_nc_chunk(nc, nc->varid_coords, chunks))
+    return false;
+
   char const coords[] = "meter";
   nerr = nc_put_att_text(nc->ncid, nc->varid_coords,
       "units", strlen(coords), coords);
@@ -183,7 +321,7 @@ static bool bmm_nc_open(struct bmm_nc *const nc) {
   dimids[0] = nc->id_frame;
   dimids[1] = nc->id_cspatial;
   nerr = nc_def_var(nc->ncid,
-      "cell_lengths", NC_FLOAT, 2, dimids, &nc->varid_clens);
+      "cell_lengths", type, 2, dimids, &nc->varid_clens);
   if (nerr != NC_NOERR) {
     BMM_TLE_EXTS(BMM_TLE_NUM_NC, "%s", nc_strerror(nerr));
 
@@ -203,13 +341,18 @@ static bool bmm_nc_open(struct bmm_nc *const nc) {
   dimids[1] = nc->id_atom;
   // Must have `name = "radius"` for OVITO.
   nerr = nc_def_var(nc->ncid,
-      "radius", NC_FLOAT, 2, dimids, &nc->varid_radii);
+      "radius", type, 2, dimids, &nc->varid_radii);
   if (nerr != NC_NOERR) {
     BMM_TLE_EXTS(BMM_TLE_NUM_NC, "%s", nc_strerror(nerr));
 
     return false;
   }
 
+  chunks[0] = nc->opts.nbatch;
+  chunks[1] = nc->natom;
+  if (!bmm_nc_chunk(nc, nc->varid_radii, chunks))
+    return false;
+
   char const radii[] = "meter";
   nerr = nc_put_att_text(nc->ncid, nc->varid_radii,
       "units", strlen(radii), radii);
@@ -240,23 +383,185 @@ static bool bmm_nc_open(struct bmm_nc *const nc) {
     return false;
   }
 
+  nc->defined = true;
+
   return true;
 }
 
-static bool bmm_nc_close(struct bmm_nc *const nc) {
+/// The call `bmm_nc_flush(nc)`
+/// writes the frames buffered in `nc` with one call per variable.
+static bool bmm_nc_flush(struct bmm_nc *const nc) {
+  if (!nc->defined) {
+    // The atom dimension is sized to the largest frame in the first batch,
+    // because it cannot change after the fact.
+    nc->natom = nc->nroom != 0 ? nc->nroom : 1;
+
+    if (!bmm_nc_define(nc))
+      return false;
+  }
+
+  if (nc->nbatch == 0)
+    return true;
+
   int nerr;
 
-  nerr = nc_close(nc->ncid);
+  size_t start[3];
+  size_t count[3];
+
+  start[0] = nc->iframe;
+  count[0] = nc->nbatch;
+  nerr = nc_put_vara_double(nc->ncid, nc->varid_time,
+      start, count, nc->times);
+  if (nerr != NC_NOERR) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_NC, "%s", nc_strerror(nerr));
+
+    return false;
+  }
+
+  start[0] = nc->iframe;
+  start[1] = 0;
+  start[2] = 0;
+  count[0] = nc->nbatch;
+  count[1] = nc->natom;
+  count[2] = NDIM;
+  nerr = nc_put_vara_double(nc->ncid, nc->varid_coords,
+      start, count, &nc->coords[0][0]);
   if (nerr != NC_NOERR) {
     BMM_TLE_EXTS(BMM_TLE_NUM_NC, "%s", nc_strerror(nerr));
 
     return false;
   }
 
+  nc->iframe += nc->nbatch;
+  nc->nbatch = 0;
+
+  return true;
+}
+
+/// The call `bmm_nc_grow(nc, nroom)`
+/// makes room for `nroom` atoms in each buffered frame of `nc`,
+/// spreading out the frames that are already buffered and
+/// filling the new rows with `NAN`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+static bool bmm_nc_grow(struct bmm_nc *const nc, size_t const nroom) {
+  if (nroom > SIZE_MAX / (nc->opts.nbatch * sizeof *nc->coords)) {
+    errno = ENOMEM;
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  double (*const coords)[NDIM] = realloc(nc->coords,
+      nc->opts.nbatch * nroom * sizeof *coords);
+  if (coords == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  // The frames are moved back to front,
+  // so that none is overwritten before it has been moved.
+  for (size_t ibatch = nc->nbatch; ibatch-- > 0; ) {
+    (void) memmove(&coords[ibatch * nroom], &coords[ibatch * nc->nroom],
+        nc->nroom * sizeof *coords);
+
+    for (size_t iatom = nc->nroom; iatom < nroom; ++iatom)
+      for (size_t idim = 0; idim < NDIM; ++idim)
+        coords[ibatch * nroom + iatom][idim] = NAN;
+  }
+
+  nc->coords = coords;
+  nc->nroom = nroom;
+
+  return true;
+}
+
+static bool bmm_nc_open(struct bmm_nc *const nc) {
+  if (nc->opts.nbatch == 0) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Empty batch");
+
+    return false;
+  }
+
+  nc->times = malloc(nc->opts.nbatch * sizeof *nc->times);
+  if (nc->times == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  // The coordinates are allocated as frames come in,
+  // unless the number of atoms is known in advance.
+  if (nc->opts.natom != 0 && !bmm_nc_grow(nc, nc->opts.natom)) {
+    free(nc->times);
+
+    return false;
+  }
+
+  return true;
+}
+
+static bool bmm_nc_close(struct bmm_nc *const nc) {
+  bool result = bmm_nc_flush(nc);
+
+  free(nc->times);
+  free(nc->coords);
+
+  if (nc->defined) {
+    int const nerr = nc_close(nc->ncid);
+    if (nerr != NC_NOERR) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_NC, "%s", nc_strerror(nerr));
+
+      result = false;
+    }
+  }
+
+  return result;
+}
+
+/// The call `bmm_nc_frame(nc, npart)`
+/// returns room for the coordinates of the next frame
+/// with `npart` particles,
+/// which has to be filled up to `nc->nroom` atoms
+/// and then committed with `bmm_nc_put_frame`.
+/// Frames are buffered with room for as many atoms as the largest one,
+/// which can only grow until the atom dimension has been fixed.
+/// If there is no room for the frame, `NULL` is returned.
+static double (*bmm_nc_frame(struct bmm_nc *const nc,
+      size_t const npart))[NDIM] {
+  if (npart > nc->nroom || nc->coords == NULL) {
+    if (nc->defined || nc->opts.natom != 0) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Too many particles");
+
+      return NULL;
+    }
+
+    if (!bmm_nc_grow(nc, $(bmm_max, size_t)(npart, 1)))
+      return NULL;
+  }
+
+  return &nc->coords[nc->nbatch * nc->nroom];
+}
+
+/// The call `bmm_nc_put_frame(nc)`
+/// commits the next frame at the time of the latest step and
+/// writes out the batch it completes.
+static bool bmm_nc_put_frame(struct bmm_nc *const nc) {
+  nc->times[nc->nbatch] = nc->t;
+  ++nc->nbatch;
+
+  if (nc->nbatch == nc->opts.nbatch)
+    return bmm_nc_flush(nc);
+
   return true;
 }
 
 enum bmm_io_read bmm_nc_step(struct bmm_nc *const nc) {
+  // Whatever was left of the previous message is not read from.
+  bmm_zip_clear(&msgzip);
+  bmm_lit_clear(&msglit);
+
   struct bmm_msg_spec spec;
   switch (bmm_msg_spec_read(&spec, msg_read, NULL)) {
     case BMM_IO_READ_ERROR:
@@ -265,16 +570,35 @@ enum bmm_io_read bmm_nc_step(struct bmm_nc *const nc) {
       return BMM_IO_READ_EOF;
   }
 
-  if (spec.endy != bmm_endy_get()) {
+  // Payloads are converted as they are read
+  // unless there is no telling how.
+  enum bmm_endy const endy = bmm_endy_get();
+  if (spec.endy != endy && endy == BMM_ENDY_MIDDLE) {
     BMM_TLE_EXTS(BMM_TLE_NUM_UNIMPL, "Unsupported endianness");
 
     return BMM_IO_READ_ERROR;
   }
 
-  if (spec.tag != BMM_MSG_TAG_SP) {
-    BMM_TLE_EXTS(BMM_TLE_NUM_UNIMPL, "Unsupported tag");
+  msgswap = spec.endy != endy;
 
-    return BMM_IO_READ_ERROR;
+  // Literal-terminated messages are decoded first,
+  // so that they can be read like any other once their size is known.
+  if (spec.tag == BMM_MSG_TAG_LT) {
+    switch (bmm_lit_open(&msglit, &spec, msg_read, NULL, NULL)) {
+      case BMM_IO_READ_EOF:
+        BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+      case BMM_IO_READ_ERROR:
+        return BMM_IO_READ_ERROR;
+    }
+
+    if (msglit.nraw < BMM_MSG_NUMSIZE) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Message too short");
+
+      return BMM_IO_READ_ERROR;
+    }
+
+    spec.tag = BMM_MSG_TAG_SP;
+    spec.msg.size = msglit.nraw;
   }
 
   enum bmm_msg_num num;
@@ -285,7 +609,46 @@ enum bmm_io_read bmm_nc_step(struct bmm_nc *const nc) {
       return BMM_IO_READ_ERROR;
   }
 
+  // Compressed messages are unwrapped and then read like any other.
+  if (num == BMM_MSG_NUM_ZIP) {
+    size_t size = spec.msg.size - BMM_MSG_NUMSIZE;
+
+    switch (bmm_zip_open(&msgzip, &num, &size, size, spec.endy,
+          msg_read, NULL)) {
+      case BMM_IO_READ_EOF:
+        BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+      case BMM_IO_READ_ERROR:
+        return BMM_IO_READ_ERROR;
+    }
+
+    if (num == BMM_MSG_NUM_ZIP) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Nested compressed message");
+
+      return BMM_IO_READ_ERROR;
+    }
+  }
+
   switch (num) {
+    case BMM_MSG_NUM_ISTEP:
+      // The time comes first and the step number is not stored.
+      switch (msg_read(&nc->t, sizeof nc->t, NULL)) {
+        case BMM_IO_READ_EOF:
+          BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+        case BMM_IO_READ_ERROR:
+          return BMM_IO_READ_ERROR;
+      }
+
+      msg_swap(&nc->t, 1, sizeof nc->t);
+
+      switch (msg_fastfw(sizeof ((struct bmm_dem *) NULL)->time -
+            sizeof nc->t)) {
+        case BMM_IO_READ_EOF:
+          BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+        case BMM_IO_READ_ERROR:
+          return BMM_IO_READ_ERROR;
+      }
+
+      break;
     case BMM_MSG_NUM_PARTS:
       {
         switch (msg_read(&nc->npart, sizeof nc->npart, NULL)) {
@@ -295,57 +658,235 @@ enum bmm_io_read bmm_nc_step(struct bmm_nc *const nc) {
             return BMM_IO_READ_ERROR;
         }
 
-        double parts[BMM_MPART][2];
+        msg_swap(&nc->npart, 1, sizeof nc->npart);
+
+        size_t const npart = nc->npart;
+
+        struct bmm_dem const *const dem = NULL;
+
+        // Labels, roles, radii, masses and moments of inertia
+        // are not stored.
+        switch (msg_fastfw(sizeof dem->part.lnew +
+              npart * (sizeof *dem->part.l + sizeof *dem->part.role +
+                sizeof *dem->part.r + sizeof *dem->part.m +
+                sizeof *dem->part.jred))) {
+          case BMM_IO_READ_EOF:
+            BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+          case BMM_IO_READ_ERROR:
+            return BMM_IO_READ_ERROR;
+        }
+
+        double (*const x)[BMM_NDIM] = malloc(npart * sizeof *x);
+        if (npart != 0 && x == NULL) {
+          BMM_TLE_STDS();
+
+          return BMM_IO_READ_ERROR;
+        }
 
-        switch (msg_read(parts, sizeof parts, NULL)) {
+        switch (msg_read(x, npart * sizeof *x, NULL)) {
           case BMM_IO_READ_EOF:
             BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
           case BMM_IO_READ_ERROR:
+            free(x);
+
             return BMM_IO_READ_ERROR;
         }
 
-        int nerr;
+        msg_swap(x, npart * BMM_NDIM, sizeof **x);
+
+        double (*const data)[NDIM] = bmm_nc_frame(nc, npart);
+        if (data == NULL) {
+          free(x);
 
-        size_t index[1];
+          return BMM_IO_READ_ERROR;
+        }
+
+        // TODO Use `_FillValue`.
+        for (size_t ipart = 0; ipart < nc->nroom; ++ipart)
+          for (size_t idim = 0; idim < NDIM; ++idim)
+            data[ipart][idim] = ipart >= npart ? NAN :
+              idim >= BMM_NDIM ? 0.0 : x[ipart][idim];
 
-        static float bogus_time = 0.0f;
-        bogus_time += 1.0f;
+        free(x);
 
-        index[0] = nc->iframe;
-        nerr = nc_put_var1_float(nc->ncid, nc->varid_time,
-            index, &bogus_time);
-        if (nerr != NC_NOERR) {
-          BMM_TLE_EXTS(BMM_TLE_NUM_NC, "%s", nc_strerror(nerr));
+        // Neither are velocities, accelerations, angles,
+        // angular velocities, angular accelerations, forces or torques.
+        switch (msg_fastfw(npart * (sizeof *dem->part.v +
+                sizeof *dem->part.a + sizeof *dem->part.phi +
+                sizeof *dem->part.omega + sizeof *dem->part.alpha +
+                sizeof *dem->part.f + sizeof *dem->part.tau))) {
+          case BMM_IO_READ_EOF:
+            BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+          case BMM_IO_READ_ERROR:
+            return BMM_IO_READ_ERROR;
+        }
 
+        if (!bmm_nc_put_frame(nc))
           return BMM_IO_READ_ERROR;
+      }
+
+      break;
+    case BMM_MSG_NUM_QPARTS:
+      {
+        size_t npart;
+        size_t nbit;
+        double xlim[BMM_NDIM][2];
+
+        struct {
+          void *ptr;
+          size_t size;
+          size_t width;
+        } const cols[] = {
+          {&npart, sizeof npart, sizeof npart},
+          {&nbit, sizeof nbit, sizeof nbit},
+          {xlim, sizeof xlim, sizeof **xlim}
+        };
+
+        for (size_t icol = 0; icol < nmembof(cols); ++icol) {
+          switch (msg_read(cols[icol].ptr, cols[icol].size, NULL)) {
+            case BMM_IO_READ_EOF:
+              BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+            case BMM_IO_READ_ERROR:
+              return BMM_IO_READ_ERROR;
+          }
+
+          msg_swap(cols[icol].ptr, cols[icol].size / cols[icol].width,
+              cols[icol].width);
         }
 
-        float data[BMM_MPART][NDIM];
+        if (!(nbit == 16 || nbit == 32)) {
+          BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Unsupported frame");
 
-        // TODO Use `_FillValue`.
-        for (size_t ipart = 0; ipart < BMM_MPART; ++ipart)
+          return BMM_IO_READ_ERROR;
+        }
+
+        nc->npart = npart;
+
+        // Roles and radii are not stored.
+        switch (msg_fastfw(npart *
+              (sizeof (enum bmm_dem_role) + sizeof (double)))) {
+          case BMM_IO_READ_EOF:
+            BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+          case BMM_IO_READ_ERROR:
+            return BMM_IO_READ_ERROR;
+        }
+
+        double (*const data)[NDIM] = bmm_nc_frame(nc, npart);
+        if (data == NULL)
+          return BMM_IO_READ_ERROR;
+
+        for (size_t ipart = 0; ipart < nc->nroom; ++ipart)
           for (size_t idim = 0; idim < NDIM; ++idim)
-            data[ipart][idim] = ipart >= nc->npart ?
-              NAN : (float) parts[ipart][idim];
-
-        size_t start[3];
-        size_t count[3];
-
-        start[0] = nc->iframe;
-        start[1] = 0;
-        start[2] = 0;
-        count[0] = 1;
-        count[1] = BMM_MPART;
-        count[2] = NDIM;
-        nerr = nc_put_vara_float(nc->ncid, nc->varid_coords,
-            start, count, &data[0][0]);
-        if (nerr != NC_NOERR) {
-          BMM_TLE_EXTS(BMM_TLE_NUM_NC, "%s", nc_strerror(nerr));
+            data[ipart][idim] = ipart >= npart ? NAN : 0.0;
+
+        for (size_t ipart = 0; ipart < npart; ++ipart)
+          for (size_t idim = 0; idim < BMM_NDIM; ++idim) {
+            uint32_t k;
+
+            if (nbit == 16) {
+              uint16_t khalf;
+              switch (msg_read(&khalf, sizeof khalf, NULL)) {
+                case BMM_IO_READ_EOF:
+                  BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+                case BMM_IO_READ_ERROR:
+                  return BMM_IO_READ_ERROR;
+              }
+
+              msg_swap(&khalf, 1, sizeof khalf);
+
+              k = khalf;
+            } else {
+              switch (msg_read(&k, sizeof k, NULL)) {
+                case BMM_IO_READ_EOF:
+                  BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+                case BMM_IO_READ_ERROR:
+                  return BMM_IO_READ_ERROR;
+              }
+
+              msg_swap(&k, 1, sizeof k);
+            }
+
+            data[ipart][idim] = bmm_fp_dequant(k,
+                xlim[idim][0], xlim[idim][1], nbit);
+          }
+
+        // Angles are not stored either.
+        switch (msg_fastfw(npart * sizeof (uint16_t))) {
+          case BMM_IO_READ_EOF:
+            BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+          case BMM_IO_READ_ERROR:
+            return BMM_IO_READ_ERROR;
+        }
+
+        if (!bmm_nc_put_frame(nc))
+          return BMM_IO_READ_ERROR;
+      }
+
+      break;
+    case BMM_MSG_NUM_SCHEMA:
+      return bmm_col_schema_read(&msgschema, spec.msg.size - BMM_MSG_NUMSIZE,
+          msgswap, msg_read, NULL);
+    case BMM_MSG_NUM_CPARTS:
+      {
+        struct bmm_col_tab const *const tab =
+          bmm_col_schema_find(&msgschema, num);
+        if (tab == NULL) {
+          BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Table without schema");
 
           return BMM_IO_READ_ERROR;
         }
 
-        ++nc->iframe;
+        size_t npart;
+        switch (msg_read(&npart, sizeof npart, NULL)) {
+          case BMM_IO_READ_EOF:
+            BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+          case BMM_IO_READ_ERROR:
+            return BMM_IO_READ_ERROR;
+        }
+
+        msg_swap(&npart, 1, sizeof npart);
+
+        nc->npart = npart;
+
+        double (*const data)[NDIM] = bmm_nc_frame(nc, npart);
+        if (data == NULL)
+          return BMM_IO_READ_ERROR;
+
+        double (*const x)[BMM_NDIM] = malloc(npart * sizeof *x);
+        if (npart != 0 && x == NULL) {
+          BMM_TLE_STDS();
+
+          return BMM_IO_READ_ERROR;
+        }
+
+        // Only the positions are stored, so everything else is skipped.
+        for (size_t ipart = 0; ipart < npart; ++ipart)
+          for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+            x[ipart][idim] = NAN;
+
+        struct bmm_col_want const want[] = {
+          {"x", BMM_COL_TYPE_F64, BMM_NDIM, x}
+        };
+
+        switch (bmm_col_tab_read(tab, npart, want, nmembof(want), msgswap,
+              msg_read, msg_skip, NULL)) {
+          case BMM_IO_READ_EOF:
+            BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+          case BMM_IO_READ_ERROR:
+            free(x);
+
+            return BMM_IO_READ_ERROR;
+        }
+
+        for (size_t ipart = 0; ipart < nc->nroom; ++ipart)
+          for (size_t idim = 0; idim < NDIM; ++idim)
+            data[ipart][idim] = ipart >= npart ? NAN :
+              idim >= BMM_NDIM ? 0.0 : x[ipart][idim];
+
+        free(x);
+
+        if (!bmm_nc_put_frame(nc))
+          return BMM_IO_READ_ERROR;
       }
 
       break;
@@ -398,9 +939,64 @@ bool bmm_nc_run(struct bmm_nc *const nc) {
   return run;
 }
 
-bool bmm_nc_run_with(struct bmm_nc_opts const *const opts) {
+static bool bmm_nc_run_map(struct bmm_nc *const nc) {
+  struct bmm_map map;
+  if (!bmm_map_open(&map, STDIN_FILENO))
+    return false;
+
+  if (map.ptr == NULL)
+    return bmm_nc_run(nc);
+
+  msgmap = &map;
+
+  bool result = bmm_nc_run(nc);
+
+  msgmap = NULL;
+
+  if (!bmm_map_close(&map))
+    result = false;
+
+  return result;
+}
+
+/// The call `bmm_nc_run_with_(opts)`
+/// works like `bmm_nc_run_with(opts)`,
+/// but does not release the payload of compressed messages.
+__attribute__ ((__nonnull__))
+static bool bmm_nc_run_with_(struct bmm_nc_opts const *const opts) {
   struct bmm_nc nc;
   bmm_nc_def(&nc, opts);
 
-  return bmm_nc_run(&nc);
+  if (opts->store == NULL)
+    return bmm_nc_run_map(&nc);
+
+  struct bmm_store_reader store;
+  if (!bmm_store_open(&store, opts->store))
+    return false;
+
+  bool result = opts->frame == 0 || bmm_store_seek(&store, opts->frame);
+
+  if (result) {
+    msgstore = &store;
+
+    result = bmm_nc_run(&nc);
+
+    msgstore = NULL;
+  }
+
+  if (!bmm_store_close(&store))
+    result = false;
+
+  return result;
+}
+
+bool bmm_nc_run_with(struct bmm_nc_opts const *const opts) {
+  bool const result = bmm_nc_run_with_(opts);
+
+  bmm_zip_free(&msgzip);
+  bmm_zip_def(&msgzip);
+  bmm_lit_free(&msglit);
+  bmm_lit_def(&msglit);
+
+  return result;
 }
@@ -24,6 +24,13 @@ struct bmm_nc_opts {
   bool q;
   bool v;
   bool f;
+  char const *store;
+  size_t frame;
+  size_t nbatch;
+  size_t natom;
+  unsigned int deflate;
+  bool shuffle;
+  bool single;
 };
 
 /// This structure tracks resources.
@@ -31,6 +38,13 @@ struct bmm_nc {
   struct bmm_nc_opts opts;
   size_t npart;
   size_t iframe;
+  size_t natom;
+  size_t nbatch;
+  size_t nroom;
+  double t;
+  bool defined;
+  double (*coords)[3];
+  double *times;
   int ncid;
   int id_frame;
   int id_spatial;
@@ -32,3 +32,49 @@ extern inline size_t bmm_neigh_icpij(size_t const *restrict,
 
 extern inline size_t bmm_neigh_icpi(size_t,
     size_t, size_t, size_t const *, bool const *, int);
+
+size_t bmm_neigh_ticp(size_t *restrict const pn, size_t *restrict const picell,
+    size_t const nstride,
+    size_t const ndim, size_t const *restrict const nper,
+    bool const *const per, int const mask) {
+  size_t *const ijcell = alloca(ndim * sizeof *ijcell);
+  size_t *const pijoff = alloca(ndim * sizeof *pijoff);
+
+  size_t const ncell = $(bmm_prod, size_t)(nper, ndim);
+  size_t const nquery = $(bmm_power, size_t)(3, ndim);
+  size_t const kquery = nquery / 2;
+
+  dynamic_assert(nstride >= nquery, "Too small stride");
+
+  // The queries are made in order, so that the neighborhoods
+  // match those of the procedures that find one cell at a time.
+  for (size_t icell = 0; icell < ncell; ++icell) {
+    $(bmm_hcd, size_t)(ijcell, icell, ndim, nper);
+
+    size_t nneigh = 0;
+
+    for (size_t iquery = 0; iquery < nquery; ++iquery) {
+      int const part = iquery < kquery ? BMM_NEIGH_MASK_RLOWERH :
+        iquery > kquery ? BMM_NEIGH_MASK_RUPPERH : BMM_NEIGH_MASK_SINGLE;
+
+      if (!BMM_MASKANY(mask, part) ||
+          !bmm_neigh_qijcpij(pijoff, ijcell, iquery, ndim, nper, per))
+        continue;
+
+      for (size_t idim = 0; idim < ndim; ++idim)
+        if (per[idim])
+          pijoff[idim] = $(bmm_dec, size_t)(ijcell[idim] + pijoff[idim],
+              1, nper[idim] - 1);
+        else
+          pijoff[idim] = ijcell[idim] + pijoff[idim] - 1;
+
+      picell[icell * nstride + nneigh] =
+        $(bmm_unhcd, size_t)(pijoff, ndim, nper);
+      ++nneigh;
+    }
+
+    pn[icell] = nneigh;
+  }
+
+  return ncell;
+}
@@ -10,13 +10,15 @@
 ///     Query : 'q' ;
 ///     Number : 'n' ;
 ///     Iterator : ;
+///     Table : 't' ;
 ///     Index : 'i' ;
 ///     IndexVector : 'ij' ;
 ///     CondPeriodic : 'cp' ;
 ///     Periodic : 'p' ;
 ///     Free : ;
 ///
-///     proc : (Query output | Number | Iterator output) bounds input ;
+///     proc : (Query output | Number | Iterator output) bounds input
+///       | Table output bounds ;
 ///     input : type ;
 ///     output : type ;
 ///     type : Index | IndexVector ;
@@ -321,4 +323,24 @@ inline size_t bmm_neigh_icpi(size_t const icell,
   return $(bmm_unhcd, size_t)(pijcell, ndim, nper);
 }
 
+/// The maximal number of cells in the neighborhood of a cell
+/// in a `ndim`-dimensional lattice,
+/// which is the suitable stride for the tables of `bmm_neigh_ticp`.
+#define BMM_NEIGH_NMAX(ndim) (BMM_POW(3, ndim))
+
+/// The call `bmm_neigh_ticp(pn, picell, nstride, ndim, nper, per, mask)`
+/// tabulates the `mask`-masked neighborhoods
+/// of every cell in a `per`-conditionally periodic `nper`-wide
+/// `ndim`-dimensional lattice and returns the number of cells.
+/// The number of cells in the neighborhood of the cell `icell` is
+/// stored into `pn[icell]` and their indices are stored in order into
+/// `picell[icell * nstride]`, `picell[icell * nstride + 1]` and so on,
+/// just like `bmm_neigh_icpi` would produce them.
+/// The stride `nstride` needs to be at least `BMM_NEIGH_NMAX(ndim)`.
+/// Building such a table once allows iterating over neighborhoods
+/// with lookups instead of repeatedly solving which cells they contain.
+__attribute__ ((__nonnull__))
+size_t bmm_neigh_ticp(size_t *restrict, size_t *restrict, size_t,
+    size_t, size_t const *restrict, bool const *, int);
+
 #endif
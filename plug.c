@@ -0,0 +1,308 @@
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "conf.h"
+#include "ext.h"
+#include "plug.h"
+#include "tle.h"
+
+__attribute__ ((__nonnull__))
+static void *bmm_plug_run(void *const ptr) {
+  struct bmm_plug_lib *const lib = ptr;
+
+  (void) pthread_mutex_lock(&lib->mutex);
+
+  for ever {
+    while (!lib->busy && !lib->quit)
+      (void) pthread_cond_wait(&lib->cfull, &lib->mutex);
+
+    if (!lib->busy)
+      break;
+
+    enum bmm_plug_ev const ev = lib->ev;
+    struct bmm_dem const *const snap = lib->snap;
+
+    (void) pthread_mutex_unlock(&lib->mutex);
+
+    bool const result = lib->hooks.hook[ev](snap, lib->hooks.ptr);
+
+    (void) pthread_mutex_lock(&lib->mutex);
+
+    if (!result)
+      lib->failed = true;
+
+    lib->busy = false;
+    (void) pthread_cond_signal(&lib->cempty);
+  }
+
+  (void) pthread_mutex_unlock(&lib->mutex);
+
+  return NULL;
+}
+
+/// The call `bmm_plug_start(lib)`
+/// starts the worker thread of the plugin `lib`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_plug_start(struct bmm_plug_lib *const lib) {
+  lib->busy = false;
+  lib->quit = false;
+  lib->failed = false;
+
+  int nerr;
+
+  nerr = pthread_mutex_init(&lib->mutex, NULL);
+  if (nerr != 0) {
+    errno = nerr;
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  nerr = pthread_cond_init(&lib->cfull, NULL);
+  if (nerr != 0) {
+    errno = nerr;
+    BMM_TLE_STDS();
+
+    (void) pthread_mutex_destroy(&lib->mutex);
+
+    return false;
+  }
+
+  nerr = pthread_cond_init(&lib->cempty, NULL);
+  if (nerr != 0) {
+    errno = nerr;
+    BMM_TLE_STDS();
+
+    (void) pthread_cond_destroy(&lib->cfull);
+    (void) pthread_mutex_destroy(&lib->mutex);
+
+    return false;
+  }
+
+  // Signals are left for the simulation thread to handle,
+  // so the worker thread starts with all of them blocked.
+  sigset_t set;
+  (void) sigfillset(&set);
+
+  sigset_t oldset;
+  (void) pthread_sigmask(SIG_SETMASK, &set, &oldset);
+
+  nerr = pthread_create(&lib->thread, NULL, bmm_plug_run, lib);
+
+  (void) pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+  if (nerr != 0) {
+    errno = nerr;
+    BMM_TLE_STDS();
+
+    (void) pthread_cond_destroy(&lib->cempty);
+    (void) pthread_cond_destroy(&lib->cfull);
+    (void) pthread_mutex_destroy(&lib->mutex);
+
+    return false;
+  }
+
+  return true;
+}
+
+/// The call `bmm_plug_stop(lib)`
+/// lets the worker thread of the plugin `lib` finish
+/// whatever it is doing and then stops it.
+/// If no hook failed on the worker thread, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_plug_stop(struct bmm_plug_lib *const lib) {
+  (void) pthread_mutex_lock(&lib->mutex);
+
+  lib->quit = true;
+  (void) pthread_cond_signal(&lib->cfull);
+
+  (void) pthread_mutex_unlock(&lib->mutex);
+
+  (void) pthread_join(lib->thread, NULL);
+
+  (void) pthread_cond_destroy(&lib->cempty);
+  (void) pthread_cond_destroy(&lib->cfull);
+  (void) pthread_mutex_destroy(&lib->mutex);
+
+  return !lib->failed;
+}
+
+/// The call `bmm_plug_close(lib)`
+/// unloads the plugin `lib`, whose worker thread is already stopped.
+__attribute__ ((__nonnull__))
+static void bmm_plug_close(struct bmm_plug_lib *const lib) {
+  if (lib->hooks.fini != NULL)
+    lib->hooks.fini(lib->hooks.ptr);
+
+  (void) dlclose(lib->handle);
+}
+
+/// The call `bmm_plug_open(lib, path, dem)`
+/// loads the shared object `path` as the plugin `lib`
+/// for the simulation `dem`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__ (1, 2)))
+static bool bmm_plug_open(struct bmm_plug_lib *const lib,
+    char const *const path, struct bmm_dem const *const dem) {
+  lib->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (lib->handle == NULL) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Cannot load plugin: %s", dlerror());
+
+    return false;
+  }
+
+  // Converting between object and function pointers
+  // is what the interface of `dlsym` demands.
+  bool (*init)(struct bmm_plug_hooks *, struct bmm_dem const *);
+  *(void **) &init = dlsym(lib->handle, "bmm_plug_init");
+  if (init == NULL) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Cannot find plugin entry: %s", dlerror());
+
+    (void) dlclose(lib->handle);
+
+    return false;
+  }
+
+  lib->hooks.async = false;
+  for (enum bmm_plug_ev ev = 0; ev < BMM_NPLUGEV; ++ev)
+    lib->hooks.hook[ev] = NULL;
+  lib->hooks.fini = NULL;
+  lib->hooks.ptr = NULL;
+
+  if (!init(&lib->hooks, dem)) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Plugin '%s' refused to start", path);
+
+    (void) dlclose(lib->handle);
+
+    return false;
+  }
+
+  if (lib->hooks.async && !bmm_plug_start(lib)) {
+    bmm_plug_close(lib);
+
+    return false;
+  }
+
+  return true;
+}
+
+bool bmm_plug_load(struct bmm_plug *const plug,
+    char const *const *const path, size_t const n,
+    struct bmm_dem const *const dem) {
+  plug->n = 0;
+
+  if (n > BMM_MPLUG) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Too many plugins");
+
+    return false;
+  }
+
+  for (size_t ilib = 0; ilib < n; ++ilib) {
+    if (!bmm_plug_open(&plug->lib[ilib], path[ilib], dem)) {
+      (void) bmm_plug_unload(plug);
+
+      return false;
+    }
+
+    plug->n = ilib + 1;
+  }
+
+  return true;
+}
+
+bool bmm_plug_unload(struct bmm_plug *const plug) {
+  bool result = true;
+
+  // Plugins are unloaded in reverse,
+  // in case the later ones lean on the earlier ones.
+  for (size_t ilib = plug->n; ilib-- > 0; ) {
+    struct bmm_plug_lib *const lib = &plug->lib[ilib];
+
+    if (lib->hooks.async && !bmm_plug_stop(lib)) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Plugin hook failed");
+
+      result = false;
+    }
+
+    bmm_plug_close(lib);
+  }
+
+  plug->n = 0;
+
+  return result;
+}
+
+bool bmm_plug_async(struct bmm_plug const *const plug,
+    enum bmm_plug_ev const ev) {
+  for (size_t ilib = 0; ilib < plug->n; ++ilib)
+    if (plug->lib[ilib].hooks.async && plug->lib[ilib].hooks.hook[ev] != NULL)
+      return true;
+
+  return false;
+}
+
+bool bmm_plug_wait(struct bmm_plug *const plug) {
+  bool result = true;
+
+  for (size_t ilib = 0; ilib < plug->n; ++ilib) {
+    struct bmm_plug_lib *const lib = &plug->lib[ilib];
+
+    if (!lib->hooks.async)
+      continue;
+
+    (void) pthread_mutex_lock(&lib->mutex);
+
+    while (lib->busy)
+      (void) pthread_cond_wait(&lib->cempty, &lib->mutex);
+
+    if (lib->failed)
+      result = false;
+
+    (void) pthread_mutex_unlock(&lib->mutex);
+  }
+
+  if (!result)
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Plugin hook failed");
+
+  return result;
+}
+
+bool bmm_plug_call(struct bmm_plug *const plug, enum bmm_plug_ev const ev,
+    struct bmm_dem const *const dem, struct bmm_dem const *const snap) {
+  for (size_t ilib = 0; ilib < plug->n; ++ilib) {
+    struct bmm_plug_lib *const lib = &plug->lib[ilib];
+
+    if (lib->hooks.hook[ev] == NULL)
+      continue;
+
+    if (lib->hooks.async) {
+      dynamic_assert(snap != NULL, "Missing snapshot");
+
+      (void) pthread_mutex_lock(&lib->mutex);
+
+      while (lib->busy)
+        (void) pthread_cond_wait(&lib->cempty, &lib->mutex);
+
+      lib->ev = ev;
+      lib->snap = snap;
+      lib->busy = true;
+      (void) pthread_cond_signal(&lib->cfull);
+
+      (void) pthread_mutex_unlock(&lib->mutex);
+    } else if (!lib->hooks.hook[ev](dem, lib->hooks.ptr)) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Plugin hook failed");
+
+      return false;
+    }
+  }
+
+  return true;
+}
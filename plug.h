@@ -0,0 +1,136 @@
+/// In-situ analysis plugins.
+///
+/// Plugins are shared objects that export a function called `bmm_plug_init`,
+/// which fills in the hooks of the plugin when it is loaded.
+/// Each hook gets a read-only view of the simulation,
+/// so analyses can run on the data as it is
+/// instead of going through serialization, a pipe and deserialization.
+/// Hooks run either on the simulation thread
+/// or on a worker thread of their own,
+/// in which case they see a snapshot that the caller takes for them
+/// and the caller only waits if the worker is still busy with the previous one.
+
+#ifndef BMM_PLUG_H
+#define BMM_PLUG_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "conf.h"
+
+struct bmm_dem;
+
+/// Events plugins can hook into.
+enum bmm_plug_ev {
+  /// A step was taken.
+  BMM_PLUG_EV_STEP,
+  /// A frame was output.
+  BMM_PLUG_EV_FRAME,
+  /// A stage began.
+  BMM_PLUG_EV_STAGE,
+  BMM_NPLUGEV
+};
+
+/// Hooks of a plugin.
+struct bmm_plug_hooks {
+  /// Whether the hooks run on a worker thread with a snapshot
+  /// instead of on the simulation thread.
+  bool async;
+  /// Hook for each event or `NULL` if the plugin does not care about it.
+  /// If a hook returns `false`, the simulation stops.
+  bool (*hook[BMM_NPLUGEV])(struct bmm_dem const *, void *);
+  /// Hook for unloading the plugin or `NULL` if there is nothing to do.
+  void (*fini)(void *);
+  /// State that is passed to every hook.
+  void *ptr;
+};
+
+/// The call `bmm_plug_init(hooks, dem)`
+/// fills in the hooks `hooks` for the simulation `dem`,
+/// which is not yet running,
+/// and returns `true` if the plugin is ready to run.
+/// The hooks are cleared before the call.
+/// This is not defined here, but by each plugin,
+/// which is looked up by name when the plugin is loaded.
+__attribute__ ((__nonnull__ (1)))
+bool bmm_plug_init(struct bmm_plug_hooks *, struct bmm_dem const *);
+
+/// Loaded plugins.
+struct bmm_plug_lib {
+  /// Handle of the shared object.
+  void *handle;
+  /// Hooks.
+  struct bmm_plug_hooks hooks;
+  /// Worker thread, which only exists for asynchronous plugins.
+  pthread_t thread;
+  /// Lock for everything below.
+  pthread_mutex_t mutex;
+  /// Signal for the worker that there is something to do.
+  pthread_cond_t cfull;
+  /// Signal for the caller that the worker is idle.
+  pthread_cond_t cempty;
+  /// Whether the worker has an event to handle.
+  bool busy;
+  /// Whether the worker should stop.
+  bool quit;
+  /// Whether a hook has failed on the worker.
+  bool failed;
+  /// Event for the worker.
+  enum bmm_plug_ev ev;
+  /// Snapshot for the worker.
+  struct bmm_dem const *snap;
+};
+
+/// Plugin host state.
+struct bmm_plug {
+  /// Number of plugins.
+  size_t n;
+  /// Plugins.
+  struct bmm_plug_lib lib[BMM_MPLUG];
+};
+
+/// The call `bmm_plug_load(plug, path, n, dem)`
+/// loads the `n` shared objects in `path` as plugins into `plug`
+/// for the simulation `dem`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned and nothing is left loaded.
+__attribute__ ((__nonnull__ (1, 2)))
+bool bmm_plug_load(struct bmm_plug *, char const *const *, size_t,
+    struct bmm_dem const *);
+
+/// The call `bmm_plug_unload(plug)`
+/// waits for the worker threads of `plug` to finish
+/// and then unloads every plugin in it.
+/// If no hook failed on a worker thread, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_plug_unload(struct bmm_plug *);
+
+/// The call `bmm_plug_async(plug, ev)`
+/// checks whether any plugin in `plug` hooks into the event `ev`
+/// on a worker thread and thus needs a snapshot.
+__attribute__ ((__nonnull__, __pure__))
+bool bmm_plug_async(struct bmm_plug const *, enum bmm_plug_ev);
+
+/// The call `bmm_plug_wait(plug)`
+/// waits until every worker thread of `plug` is idle,
+/// so that the snapshot they were given can be taken again.
+/// If no hook failed on a worker thread, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_plug_wait(struct bmm_plug *);
+
+/// The call `bmm_plug_call(plug, ev, dem, snap)`
+/// runs the hooks of `plug` for the event `ev`,
+/// passing the simulation `dem` to the hooks on the calling thread
+/// and the snapshot `snap` to the hooks on worker threads.
+/// The snapshot may only be `NULL` if `bmm_plug_async` says it is not needed
+/// and must stay intact until the next call to `bmm_plug_wait`.
+/// If every hook on the calling thread succeeds, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__ (1, 3)))
+bool bmm_plug_call(struct bmm_plug *, enum bmm_plug_ev,
+    struct bmm_dem const *, struct bmm_dem const *);
+
+#endif
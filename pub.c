@@ -0,0 +1,512 @@
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "aio.h"
+#include "conf.h"
+#include "ext.h"
+#include "io.h"
+#include "lit.h"
+#include "msg.h"
+#include "pub.h"
+#include "sock.h"
+#include "tle.h"
+#include "zip.h"
+
+static_assert(BMM_MFRAME >= 2, "Too few frames");
+
+/// Messages that are kept for subscribers that arrive late.
+static bool const bmm_pub_sticky[BMM_MMSG] = {
+  [BMM_MSG_NUM_OPTS] = true,
+  [BMM_MSG_NUM_SCHEMA] = true
+};
+
+/// This structure tracks how far into a frame a reader is.
+struct bmm_pub_cursor {
+  /// Frame.
+  struct bmm_aio_frame const *frame;
+  /// Position of the reader.
+  size_t i;
+};
+
+static enum bmm_io_read bmm_pub_read(void *const buf, size_t const n,
+    void *const ptr) {
+  struct bmm_pub_cursor *const cursor = ptr;
+
+  if (n > cursor->frame->n - cursor->i)
+    return BMM_IO_READ_EOF;
+
+  (void) memcpy(buf, &cursor->frame->buf[cursor->i], n);
+  cursor->i += n;
+
+  return BMM_IO_READ_SUCCESS;
+}
+
+/// The call `bmm_pub_grow(frame, buf, n)`
+/// appends `n` bytes from `buf` to `frame`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned and `errno` is set.
+__attribute__ ((__nonnull__))
+static bool bmm_pub_grow(struct bmm_aio_frame *const frame,
+    void const *const buf, size_t const n) {
+  if (n > frame->ncap - frame->n) {
+    if (n > SIZE_MAX - frame->n) {
+      errno = ENOMEM;
+
+      return false;
+    }
+
+    size_t const nnew = frame->n + n;
+    size_t const ncap = frame->ncap > SIZE_MAX / 2 ? SIZE_MAX :
+      frame->ncap * 2 < nnew ? nnew : frame->ncap * 2;
+
+    unsigned char *const ptr = realloc(frame->buf, ncap);
+    if (ptr == NULL)
+      return false;
+
+    frame->buf = ptr;
+    frame->ncap = ncap;
+  }
+
+  (void) memcpy(&frame->buf[frame->n], buf, n);
+  frame->n += n;
+
+  return true;
+}
+
+/// The call `bmm_pub_pick(dst, prio, pdiff, src, mask)`
+/// appends every message in `src` whose number is set in `mask` to `dst`,
+/// looking into compressed messages for the number they wrap, and
+/// sets `pdiff` if any of them only carries differences.
+/// High-priority messages are appended to `prio` instead
+/// unless it is `NULL` or already full.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned and `errno` is set.
+__attribute__ ((__nonnull__ (1, 3, 4, 5)))
+static bool bmm_pub_pick(struct bmm_aio_frame *const dst,
+    struct bmm_aio_frame *const prio, bool *const pdiff,
+    struct bmm_aio_frame const *const src, bool const *const mask) {
+  struct bmm_pub_cursor cursor = {.frame = src, .i = 0};
+
+  while (cursor.i < src->n) {
+    size_t const ibegin = cursor.i;
+
+    // Frames are put together from whole messages,
+    // so none of this can fail halfway through.
+    struct bmm_msg_spec spec;
+    (void) bmm_msg_spec_read(&spec, bmm_pub_read, &cursor);
+
+    // Literals never hide the message number,
+    // but compressed bodies are always sized.
+    size_t const iend = cursor.i + (spec.tag == BMM_MSG_TAG_LT ?
+        bmm_lit_scan(&spec, &src->buf[cursor.i], src->n - cursor.i) :
+        spec.msg.size);
+
+    enum bmm_msg_num num;
+    (void) bmm_msg_num_read(&num, bmm_pub_read, &cursor);
+
+    if (spec.tag != BMM_MSG_TAG_LT && num == BMM_MSG_NUM_ZIP) {
+      struct bmm_zip_head head;
+      (void) bmm_zip_head_read(&head, bmm_pub_read, &cursor);
+
+      num = head.num;
+    }
+
+    if (mask[(size_t) num]) {
+      size_t const n = iend - ibegin;
+
+      if (prio != NULL && spec.prio == BMM_MSG_PRIO_HIGH) {
+        // Subscribers that do not keep up lose new reports,
+        // but only once something is already waiting.
+        if ((prio->n == 0 || n <= BMM_MPRIO - prio->n) &&
+            !bmm_pub_grow(prio, &src->buf[ibegin], n))
+          return false;
+      } else {
+        if (!bmm_pub_grow(dst, &src->buf[ibegin], n))
+          return false;
+
+        if (num == BMM_MSG_NUM_DPARTS || num == BMM_MSG_NUM_DCONTS)
+          *pdiff = true;
+      }
+    }
+
+    cursor.i = iend;
+  }
+
+  return true;
+}
+
+__attribute__ ((__nonnull__))
+static void *bmm_pub_run_sub(void *const ptr) {
+  struct bmm_pub_sub *const sub = ptr;
+  struct bmm_pub *const pub = sub->pub;
+
+  unsigned char buf[BMM_MMSG];
+  bool result = bmm_io_read(sub->fd, buf, sizeof buf) == BMM_IO_READ_SUCCESS;
+
+  (void) pthread_mutex_lock(&pub->mutex);
+
+  if (result) {
+    for (size_t imsg = 0; imsg < BMM_MMSG; ++imsg)
+      sub->mask[imsg] = buf[imsg] != 0;
+
+    // Nothing has been queued yet,
+    // so the options go in front of everything else.
+    bool diff = false;
+    result = bmm_pub_pick(&sub->frame[sub->ifirst], NULL, &diff,
+        &pub->opts, sub->mask);
+    if (result && sub->frame[sub->ifirst].n != 0) {
+      sub->diff[sub->ifirst] = false;
+      ++sub->nfull;
+    }
+
+    sub->ready = true;
+    sub->resync = true;
+  }
+
+  while (result) {
+    while (sub->nfull == 0 && sub->prio.n == 0 && !pub->quit)
+      (void) pthread_cond_wait(&sub->cfull, &pub->mutex);
+
+    if (sub->prio.n != 0) {
+      struct bmm_aio_frame const frame = sub->pout;
+      sub->pout = sub->prio;
+      sub->prio = frame;
+      sub->prio.n = 0;
+
+      (void) pthread_mutex_unlock(&pub->mutex);
+
+      result = bmm_sock_send(sub->fd, sub->pout.buf, sub->pout.n);
+
+      (void) pthread_mutex_lock(&pub->mutex);
+
+      continue;
+    }
+
+    if (sub->nfull == 0)
+      break;
+
+    struct bmm_aio_frame const frame = sub->out;
+    sub->out = sub->frame[sub->ifirst];
+    sub->frame[sub->ifirst] = frame;
+    sub->ifirst = (sub->ifirst + 1) % BMM_MFRAME;
+    --sub->nfull;
+
+    (void) pthread_mutex_unlock(&pub->mutex);
+
+    // Subscribers that go away are simply forgotten.
+    result = bmm_sock_send(sub->fd, sub->out.buf, sub->out.n);
+
+    (void) pthread_mutex_lock(&pub->mutex);
+  }
+
+  sub->done = true;
+
+  (void) pthread_mutex_unlock(&pub->mutex);
+
+  return NULL;
+}
+
+/// The call `bmm_pub_reap(pub, sub)`
+/// waits for the writer thread of `sub` to finish and
+/// frees its slot in `pub`.
+__attribute__ ((__nonnull__))
+static void bmm_pub_reap(struct bmm_pub *const pub,
+    struct bmm_pub_sub *const sub) {
+  (void) pthread_join(sub->thread, NULL);
+  (void) pthread_cond_destroy(&sub->cfull);
+  (void) close(sub->fd);
+
+  for (size_t iframe = 0; iframe < BMM_MFRAME; ++iframe)
+    free(sub->frame[iframe].buf);
+  free(sub->out.buf);
+  free(sub->prio.buf);
+  free(sub->pout.buf);
+
+  pub->ndrop += sub->ndrop;
+
+  sub->fd = -1;
+}
+
+/// The call `bmm_pub_join(pub, fd)`
+/// sets up a subscriber for the connection `fd` in a free slot of `pub`.
+/// If there is no room, `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_pub_join(struct bmm_pub *const pub, int const fd) {
+  for (size_t isub = 0; isub < BMM_MSUB; ++isub) {
+    struct bmm_pub_sub *const sub = &pub->sub[isub];
+
+    if (sub->fd != -1 && sub->done)
+      bmm_pub_reap(pub, sub);
+
+    if (sub->fd != -1)
+      continue;
+
+    sub->pub = pub;
+    sub->fd = fd;
+    sub->ready = false;
+    sub->done = false;
+    sub->resync = true;
+    sub->ifirst = 0;
+    sub->nfull = 0;
+    sub->ndrop = 0;
+
+    for (size_t iframe = 0; iframe < BMM_MFRAME; ++iframe) {
+      sub->frame[iframe].n = 0;
+      sub->frame[iframe].ncap = 0;
+      sub->frame[iframe].buf = NULL;
+    }
+
+    struct bmm_aio_frame *const frames[] = {
+      &sub->out, &sub->prio, &sub->pout
+    };
+    for (size_t iframe = 0; iframe < nmembof(frames); ++iframe) {
+      frames[iframe]->n = 0;
+      frames[iframe]->ncap = 0;
+      frames[iframe]->buf = NULL;
+    }
+
+    if (pthread_cond_init(&sub->cfull, NULL) != 0) {
+      sub->fd = -1;
+
+      return false;
+    }
+
+    if (pthread_create(&sub->thread, NULL, bmm_pub_run_sub, sub) != 0) {
+      (void) pthread_cond_destroy(&sub->cfull);
+
+      sub->fd = -1;
+
+      return false;
+    }
+
+    ++pub->nsub;
+
+    return true;
+  }
+
+  return false;
+}
+
+__attribute__ ((__nonnull__))
+static void *bmm_pub_run(void *const ptr) {
+  struct bmm_pub *const pub = ptr;
+
+  for ever {
+    int const fd = accept(pub->fd, NULL, NULL);
+    if (fd == -1) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+
+      // This is how stopping wakes this thread up.
+      break;
+    }
+
+    (void) pthread_mutex_lock(&pub->mutex);
+
+    bool const joined = !pub->quit && bmm_pub_join(pub, fd);
+
+    (void) pthread_mutex_unlock(&pub->mutex);
+
+    if (!joined)
+      (void) close(fd);
+  }
+
+  return NULL;
+}
+
+bool bmm_pub_start(struct bmm_pub *const pub, char const *const addr) {
+  pub->addr = addr;
+  pub->quit = false;
+  pub->nsub = 0;
+  pub->ndrop = 0;
+
+  for (size_t isub = 0; isub < BMM_MSUB; ++isub)
+    pub->sub[isub].fd = -1;
+
+  pub->opts.n = 0;
+  pub->opts.ncap = 0;
+  pub->opts.buf = NULL;
+
+  pub->cur.n = 0;
+  pub->cur.ncap = 0;
+  pub->cur.buf = NULL;
+
+  pub->fd = bmm_sock_listen(addr);
+  if (pub->fd == -1)
+    return false;
+
+  int nerr;
+
+  nerr = pthread_mutex_init(&pub->mutex, NULL);
+  if (nerr != 0) {
+    errno = nerr;
+    BMM_TLE_STDS();
+
+    (void) close(pub->fd);
+    (void) bmm_sock_unlink(addr);
+
+    return false;
+  }
+
+  // Signals are left for the calling thread to handle,
+  // so the other threads start with all of them blocked.
+  sigset_t set;
+  (void) sigfillset(&set);
+
+  sigset_t oldset;
+  (void) pthread_sigmask(SIG_SETMASK, &set, &oldset);
+
+  nerr = pthread_create(&pub->thread, NULL, bmm_pub_run, pub);
+
+  (void) pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+  if (nerr != 0) {
+    errno = nerr;
+    BMM_TLE_STDS();
+
+    (void) pthread_mutex_destroy(&pub->mutex);
+    (void) close(pub->fd);
+    (void) bmm_sock_unlink(addr);
+
+    return false;
+  }
+
+  return true;
+}
+
+bool bmm_pub_stop(struct bmm_pub *const pub) {
+  (void) pthread_mutex_lock(&pub->mutex);
+
+  pub->quit = true;
+
+  for (size_t isub = 0; isub < BMM_MSUB; ++isub) {
+    struct bmm_pub_sub *const sub = &pub->sub[isub];
+
+    if (sub->fd != -1) {
+      (void) pthread_cond_signal(&sub->cfull);
+
+      // Subscribers that never said what they want would be waited for.
+      if (!sub->ready)
+        (void) shutdown(sub->fd, SHUT_RDWR);
+    }
+  }
+
+  (void) pthread_mutex_unlock(&pub->mutex);
+
+  (void) shutdown(pub->fd, SHUT_RDWR);
+  (void) pthread_join(pub->thread, NULL);
+
+  // Nothing joins any more subscribers now.
+  for (size_t isub = 0; isub < BMM_MSUB; ++isub)
+    if (pub->sub[isub].fd != -1)
+      bmm_pub_reap(pub, &pub->sub[isub]);
+
+  (void) pthread_mutex_destroy(&pub->mutex);
+
+  free(pub->cur.buf);
+  free(pub->opts.buf);
+
+  bool result = true;
+
+  if (close(pub->fd) == -1) {
+    BMM_TLE_STDS();
+
+    result = false;
+  }
+
+  if (!bmm_sock_unlink(pub->addr))
+    result = false;
+
+  return result;
+}
+
+bool bmm_pub_write(struct bmm_pub *const pub,
+    void const *const buf, size_t const n) {
+  if (!bmm_pub_grow(&pub->cur, buf, n)) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return true;
+}
+
+bool bmm_pub_end(struct bmm_pub *const pub) {
+  bool result = true;
+
+  (void) pthread_mutex_lock(&pub->mutex);
+
+  bool diff = false;
+  struct bmm_aio_frame opts = {.n = 0, .ncap = 0, .buf = NULL};
+  result = bmm_pub_pick(&opts, NULL, &diff, &pub->cur, bmm_pub_sticky);
+  if (opts.n != 0) {
+    free(pub->opts.buf);
+    pub->opts = opts;
+  } else
+    free(opts.buf);
+
+  for (size_t isub = 0; result && isub < BMM_MSUB; ++isub) {
+    struct bmm_pub_sub *const sub = &pub->sub[isub];
+
+    if (sub->fd == -1 || !sub->ready || sub->done)
+      continue;
+
+    // Dropping a frame also drops the differences that come after it.
+    if (sub->nfull == BMM_MFRAME) {
+      do {
+        sub->ifirst = (sub->ifirst + 1) % BMM_MFRAME;
+        --sub->nfull;
+        ++sub->ndrop;
+      } while (sub->nfull != 0 && sub->diff[sub->ifirst]);
+
+      if (sub->nfull == 0)
+        sub->resync = true;
+    }
+
+    size_t const iframe = (sub->ifirst + sub->nfull) % BMM_MFRAME;
+    struct bmm_aio_frame *const frame = &sub->frame[iframe];
+    frame->n = 0;
+
+    size_t const nprio = sub->prio.n;
+
+    bool fdiff = false;
+    result = bmm_pub_pick(frame, &sub->prio, &fdiff, &pub->cur, sub->mask);
+    if (!result)
+      continue;
+
+    if (sub->prio.n != nprio)
+      (void) pthread_cond_signal(&sub->cfull);
+
+    if (frame->n == 0)
+      continue;
+
+    if (fdiff && sub->resync) {
+      ++sub->ndrop;
+
+      continue;
+    }
+
+    sub->resync = false;
+    sub->diff[iframe] = fdiff;
+    ++sub->nfull;
+
+    (void) pthread_cond_signal(&sub->cfull);
+  }
+
+  (void) pthread_mutex_unlock(&pub->mutex);
+
+  pub->cur.n = 0;
+
+  if (!result)
+    BMM_TLE_STDS();
+
+  return result;
+}
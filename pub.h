@@ -0,0 +1,123 @@
+/// Published output.
+///
+/// A publisher listens on a socket and
+/// sends every output frame to each subscriber that is connected,
+/// so that several consumers can follow the same simulation.
+/// A subscriber begins by sending `BMM_MMSG` octets,
+/// the one at the index `num` being nonzero
+/// if it wants the messages with the number `num`.
+/// It then gets the most recent options and
+/// the frames from the next keyframe onwards.
+/// Each subscriber has its own bounded queue.
+/// When that is full, the oldest pending frame is dropped
+/// along with the difference frames that depended on it,
+/// so a slow subscriber never slows the simulation or the others down.
+/// High-priority messages skip the queue and
+/// go out before any pending frame,
+/// unless more than `BMM_MPRIO` bytes of them are already waiting.
+
+#ifndef BMM_PUB_H
+#define BMM_PUB_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "aio.h"
+#include "conf.h"
+
+struct bmm_pub;
+
+/// Subscriber state.
+struct bmm_pub_sub {
+  /// Publisher.
+  struct bmm_pub *pub;
+  /// Connection or `-1` if the slot is free.
+  int fd;
+  /// Writer thread.
+  pthread_t thread;
+  /// Whether the subscriber has said what it wants.
+  bool ready;
+  /// Whether the writer thread has finished and can be joined.
+  bool done;
+  /// Which messages the subscriber wants.
+  bool mask[BMM_MMSG];
+  /// Whether frames are skipped until the next keyframe.
+  bool resync;
+  /// Signal for the writer that there is something to write.
+  pthread_cond_t cfull;
+  /// Ring of pending frames.
+  struct bmm_aio_frame frame[BMM_MFRAME];
+  /// Whether each pending frame depends on the one before it.
+  bool diff[BMM_MFRAME];
+  /// Index of the oldest pending frame.
+  size_t ifirst;
+  /// Number of pending frames.
+  size_t nfull;
+  /// Frame being written, which the writer thread owns.
+  struct bmm_aio_frame out;
+  /// High-priority messages waiting to go ahead of the pending frames.
+  struct bmm_aio_frame prio;
+  /// High-priority messages being written, which the writer thread owns.
+  struct bmm_aio_frame pout;
+  /// Number of frames dropped.
+  size_t ndrop;
+};
+
+/// Publisher state.
+struct bmm_pub {
+  /// Address being listened at.
+  char const *addr;
+  /// Listening socket.
+  int fd;
+  /// Thread accepting new subscribers.
+  pthread_t thread;
+  /// Lock for everything below.
+  pthread_mutex_t mutex;
+  /// Whether everything should stop.
+  bool quit;
+  /// Subscribers.
+  struct bmm_pub_sub sub[BMM_MSUB];
+  /// Most recent options for subscribers that arrive late.
+  struct bmm_aio_frame opts;
+  /// Frame being filled by the producer, which it owns.
+  struct bmm_aio_frame cur;
+  /// Number of subscribers so far.
+  size_t nsub;
+  /// Number of frames dropped for subscribers that have left.
+  size_t ndrop;
+};
+
+/// The call `bmm_pub_start(pub, addr)`
+/// starts publishing at the address `addr`,
+/// which is understood by `bmm_sock_listen`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_pub_start(struct bmm_pub *, char const *);
+
+/// The call `bmm_pub_stop(pub)`
+/// waits for every subscriber to receive its pending frames,
+/// disconnects them and stops listening.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_pub_stop(struct bmm_pub *);
+
+/// The call `bmm_pub_write(pub, buf, n)`
+/// appends `n` bytes from `buf` to the current frame,
+/// which must only consist of whole messages once it is finished.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_pub_write(struct bmm_pub *, void const *, size_t);
+
+/// The call `bmm_pub_end(pub)`
+/// hands the messages each subscriber wants from the current frame
+/// over to its writer thread and begins a new frame.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_pub_end(struct bmm_pub *);
+
+#endif
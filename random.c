@@ -1,5 +1,16 @@
 #include <gsl/gsl_rng.h>
+#include <stdint.h>
 
 #include "random.h"
 
 extern inline double bmm_random_get(gsl_rng *, double const *);
+
+extern inline uint64_t bmm_random_mulhilo(uint64_t *, uint64_t, uint64_t);
+
+extern inline void bmm_random_philox(uint64_t *,
+    uint64_t const *, uint64_t const *);
+
+extern inline double bmm_random_ctr(uint64_t const *, uint64_t const *);
+
+extern inline double bmm_random_getctr(uint64_t const *,
+    uint64_t const *, double const *);
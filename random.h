@@ -4,6 +4,8 @@
 #define BMM_RANDOM_H
 
 #include <gsl/gsl_rng.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #include "ext.h"
 
@@ -12,4 +14,96 @@ inline double bmm_random_get(gsl_rng *const rng, double const *const x) {
   return gsl_rng_uniform(rng) * (x[1] - x[0]) + x[0];
 }
 
+/// The call `bmm_random_mulhilo(hi, a, b)`
+/// returns the low word of the product of `a` and `b`
+/// and saves the high word in `hi`.
+__attribute__ ((__nonnull__))
+inline uint64_t bmm_random_mulhilo(uint64_t *const hi,
+    uint64_t const a, uint64_t const b) {
+#ifdef __SIZEOF_INT128__
+  __extension__ unsigned __int128 const p = (unsigned __int128) a * b;
+
+  *hi = (uint64_t) (p >> 64);
+
+  return (uint64_t) p;
+#else
+  uint64_t const m = UINT64_C(0xffffffff);
+
+  uint64_t const p00 = (a & m) * (b & m);
+  uint64_t const p01 = (a & m) * (b >> 32);
+  uint64_t const p10 = (a >> 32) * (b & m);
+  uint64_t const p11 = (a >> 32) * (b >> 32);
+
+  uint64_t const q = (p00 >> 32) + (p01 & m) + (p10 & m);
+
+  *hi = p11 + (p01 >> 32) + (p10 >> 32) + (q >> 32);
+
+  return a * b;
+#endif
+}
+
+/// Number of rounds in the counter-based generator.
+#define BMM_RANDOM_NROUND 10
+
+/// The call `bmm_random_philox(y, x, k)`
+/// applies the Philox-4x64 bijection with `BMM_RANDOM_NROUND` rounds
+/// to the counter `x` under the key `k` and saves the result in `y`.
+/// Each distinct counter and key produces an independent block of words,
+/// so any thread can generate any value without shared state.
+/// The words `x` and `y` may alias.
+__attribute__ ((__nonnull__))
+inline void bmm_random_philox(uint64_t *const y,
+    uint64_t const *const x, uint64_t const *const k) {
+  uint64_t z[4];
+  for (size_t i = 0; i < nmembof(z); ++i)
+    z[i] = x[i];
+
+  uint64_t l[2];
+  for (size_t i = 0; i < nmembof(l); ++i)
+    l[i] = k[i];
+
+  for (size_t iround = 0; iround < BMM_RANDOM_NROUND; ++iround) {
+    if (iround != 0) {
+      l[0] += UINT64_C(0x9e3779b97f4a7c15);
+      l[1] += UINT64_C(0xbb67ae8584caa73b);
+    }
+
+    uint64_t h0;
+    uint64_t const p0 =
+      bmm_random_mulhilo(&h0, UINT64_C(0xd2e7470ee14c6c93), z[0]);
+    uint64_t h1;
+    uint64_t const p1 =
+      bmm_random_mulhilo(&h1, UINT64_C(0xca5a826395121157), z[2]);
+
+    uint64_t const w[] = {h1 ^ z[1] ^ l[0], p1, h0 ^ z[3] ^ l[1], p0};
+    for (size_t i = 0; i < nmembof(z); ++i)
+      z[i] = w[i];
+  }
+
+  for (size_t i = 0; i < nmembof(z); ++i)
+    y[i] = z[i];
+}
+
+/// The call `bmm_random_ctr(x, k)`
+/// returns a uniformly distributed double-precision floating-point number
+/// on the half-open interval `[0, 1)`
+/// that is uniquely determined by the counter `x` and the key `k`.
+__attribute__ ((__nonnull__, __pure__))
+inline double bmm_random_ctr(uint64_t const *const x,
+    uint64_t const *const k) {
+  uint64_t y[4];
+  bmm_random_philox(y, x, k);
+
+  return (double) (y[0] >> 11) * 0x1.0p-53;
+}
+
+/// The call `bmm_random_getctr(x, k, a)`
+/// returns a uniformly distributed number on the interval `a`
+/// that is uniquely determined by the counter `x` and the key `k`.
+__attribute__ ((__nonnull__, __pure__))
+inline double bmm_random_getctr(uint64_t const *const x,
+    uint64_t const *const k, double const *const a) {
+  return bmm_random_ctr(x, k) * (a[1] - a[0]) + a[0];
+}
+
 #endif
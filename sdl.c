@@ -1,26 +1,67 @@
+#include <GL/glew.h>
+
 #include <GL/gl.h>
 #include <GL/glut.h>
 #include <SDL2/SDL.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
+#include <zlib.h>
 
+#include "col.h"
 #include "common.h"
 #include "dem.h"
 #include "endy.h"
 #include "ext.h"
 #include "fp.h"
 #include "gl.h"
+#include "gl2.h"
 #include "io.h"
+#include "lit.h"
+#include "map.h"
 #include "msg.h"
 #include "sdl.h"
+#include "store.h"
 #include "tle.h"
+#include "zip.h"
+
+/// Number of corners in the outline of a particle.
+#define BMM_SDL_NCORNER 8
 
 static SDL_Window *window;
 static SDL_GLContext glcontext;
 
+/// Container to read messages from instead of the standard input.
+static struct bmm_store_reader *msgstore = NULL;
+
+/// Mapping of the standard input if it is a regular file.
+static struct bmm_map *msgmap = NULL;
+
+/// Payload of the compressed message being read.
+static struct bmm_zip msgzip = {
+  .raw = NULL, .nraw = 0, .ncapraw = 0, .iraw = 0, .tmp = NULL, .ncaptmp = 0
+};
+
+/// Body of the literal-terminated message being read.
+static struct bmm_lit msglit = {
+  .nterm = 0, .nmatch = 0,
+  .raw = NULL, .nraw = 0, .ncapraw = 0, .iraw = 0, .tmp = NULL
+};
+
+/// Whether the message being read has the other byte order.
+static bool msgswap = false;
+
+/// Most recent description of the table messages.
+static struct bmm_col_schema msgschema = {.ntab = 0};
+
 extern inline void bmm_sdl_t_to_timeval(struct timeval *, Uint32);
 
 extern inline Uint32 bmm_sdl_t_from_timeval(struct timeval const *);
@@ -37,106 +78,1539 @@ void glString(char const *str, int const x, int const y,
 
 static enum bmm_io_read msg_read(void *buf, size_t const n,
     __attribute__ ((__unused__)) void *const ptr) {
+  // Empty columns may not even be allocated.
+  if (n == 0)
+    return BMM_IO_READ_SUCCESS;
+
+  if (bmm_zip_ongoing(&msgzip))
+    return bmm_zip_read(&msgzip, buf, n);
+
+  if (bmm_lit_ongoing(&msglit))
+    return bmm_lit_read(&msglit, buf, n);
+
+  if (msgstore != NULL)
+    return bmm_store_read(msgstore, buf, n);
+
+  if (msgmap != NULL)
+    return bmm_map_read(msgmap, buf, n);
+
   return bmm_io_readin(buf, n);
 }
 
+static enum bmm_io_read msg_fastfw(size_t const n) {
+  if (bmm_zip_ongoing(&msgzip))
+    return bmm_zip_fastfw(&msgzip, n);
+
+  if (bmm_lit_ongoing(&msglit))
+    return bmm_lit_fastfw(&msglit, n);
+
+  if (msgstore != NULL)
+    return bmm_store_fastfw(msgstore, n);
+
+  if (msgmap != NULL)
+    return bmm_map_fastfw(msgmap, n);
+
+  return bmm_io_fastfwin(n);
+}
+
+static enum bmm_io_read msg_skip(size_t const n,
+    __attribute__ ((__unused__)) void *const ptr) {
+  return msg_fastfw(n);
+}
+
+/// The call `msg_swap(buf, n, size)`
+/// converts the `n` words of `size` bytes in the buffer `buf`
+/// from the byte order of the message being read to that of the system.
+static void msg_swap(void *const buf, size_t const n, size_t const size) {
+  if (msgswap)
+    bmm_endy_swap(buf, n, size);
+}
+
+// Records of counts, indices and coordinates are converted as uniform words.
+static_assert(sizeof (size_t) == sizeof (double) &&
+    sizeof (uint64_t) == sizeof (double), "Unsupported word sizes");
+
+/// The call `bmm_dem_gets_npart(dem, num, size)`
+/// reads the number of particles heading the message `num` of size `size`,
+/// along with the number of neighbors if there are some,
+/// makes room for them in the simulation `dem` and
+/// checks that the rest of the message has the expected size.
+static enum bmm_io_read bmm_dem_gets_npart(struct bmm_dem *const dem,
+    enum bmm_msg_num const num, size_t const size) {
+  size_t npart;
+  switch (msg_read(&npart, sizeof npart, NULL)) {
+    case BMM_IO_READ_ERROR:
+      return BMM_IO_READ_ERROR;
+    case BMM_IO_READ_EOF:
+      return BMM_IO_READ_EOF;
+  }
+
+  msg_swap(&npart, 1, sizeof npart);
+
+  if (!bmm_dem_reserve(dem, npart))
+    return BMM_IO_READ_ERROR;
+
+  dem->part.n = npart;
+
+  if (num == BMM_MSG_NUM_NEIGH) {
+    size_t nneigh;
+    switch (msg_read(&nneigh, sizeof nneigh, NULL)) {
+      case BMM_IO_READ_ERROR:
+        return BMM_IO_READ_ERROR;
+      case BMM_IO_READ_EOF:
+        return BMM_IO_READ_EOF;
+    }
+
+    msg_swap(&nneigh, 1, sizeof nneigh);
+
+    if (!bmm_dem_cache_reserve(dem, nneigh))
+      return BMM_IO_READ_ERROR;
+
+    dem->cache.nneigh = nneigh;
+  }
+
+  if (bmm_dem_sniff_size(dem, num) != size) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Size mismatch");
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  return BMM_IO_READ_SUCCESS;
+}
+
+/// The call `bmm_dem_gets_diff(dem, num, size)`
+/// reads the number of particles heading the difference message `num`
+/// of size `size`, checks that they match the particles
+/// already in the simulation `dem` and
+/// skips the rest of the message if they do not.
+static enum bmm_io_read bmm_dem_gets_diff(struct bmm_dem *const dem,
+    enum bmm_msg_num const num, size_t const size) {
+  size_t npart;
+  if (size < sizeof npart) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Size mismatch");
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  switch (msg_read(&npart, sizeof npart, NULL)) {
+    case BMM_IO_READ_ERROR:
+      return BMM_IO_READ_ERROR;
+    case BMM_IO_READ_EOF:
+      return BMM_IO_READ_EOF;
+  }
+
+  msg_swap(&npart, 1, sizeof npart);
+
+  if (npart != dem->part.n) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Difference without keyframe");
+
+    (void) msg_fastfw(size - sizeof npart);
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  if (num == BMM_MSG_NUM_DPARTS && bmm_dem_sniff_size(dem, num) != size) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Size mismatch");
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  return BMM_IO_READ_SUCCESS;
+}
+
+/// The call `bmm_dem_gets_dequant(x, a, b, nbit)`
+/// reads a number quantized to `nbit` bits from `a` to `b` into `x`.
+static bool bmm_dem_gets_dequant(double *const x,
+    double const a, double const b, size_t const nbit) {
+  uint32_t k;
+
+  if (nbit <= 16) {
+    uint16_t khalf;
+    switch (msg_read(&khalf, sizeof khalf, NULL)) {
+      case BMM_IO_READ_EOF:
+        BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+      case BMM_IO_READ_ERROR:
+        return false;
+    }
+
+    msg_swap(&khalf, 1, sizeof khalf);
+
+    k = khalf;
+  } else {
+    switch (msg_read(&k, sizeof k, NULL)) {
+      case BMM_IO_READ_EOF:
+        BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+      case BMM_IO_READ_ERROR:
+        return false;
+    }
+
+    msg_swap(&k, 1, sizeof k);
+  }
+
+  *x = bmm_fp_dequant(k, a, b, nbit);
+
+  return true;
+}
+
+/// The call `bmm_dem_gets_within(buf, n, size, nrem)`
+/// reads `n` bytes of words of `size` bytes into `buf`
+/// if there are at least that many of
+/// the `nrem` bytes remaining and then takes them off `nrem`.
+static bool bmm_dem_gets_within(void *const buf, size_t const n,
+    size_t const size, size_t *const nrem) {
+  if (n > *nrem) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Size mismatch");
+
+    return false;
+  }
+
+  switch (msg_read(buf, n, NULL)) {
+    case BMM_IO_READ_EOF:
+      BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+    case BMM_IO_READ_ERROR:
+      return false;
+  }
+
+  msg_swap(buf, n / size, size);
+
+  *nrem -= n;
+
+  return true;
+}
+
+/// The call `bmm_dem_gets_tab(dem, num, size)`
+/// reads the columns that are looked at here
+/// from the table message `num` of size `size`
+/// into the simulation `dem` and skips the others.
+static enum bmm_io_read bmm_dem_gets_tab(struct bmm_dem *const dem,
+    enum bmm_msg_num const num, size_t const size) {
+  struct bmm_col_tab const *const tab = bmm_col_schema_find(&msgschema, num);
+  if (tab == NULL) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Table without schema");
+
+    (void) msg_fastfw(size);
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  size_t nrow;
+  if (size < sizeof nrow) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Size mismatch");
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  switch (msg_read(&nrow, sizeof nrow, NULL)) {
+    case BMM_IO_READ_ERROR:
+      return BMM_IO_READ_ERROR;
+    case BMM_IO_READ_EOF:
+      return BMM_IO_READ_EOF;
+  }
+
+  msg_swap(&nrow, 1, sizeof nrow);
+
+  if (bmm_col_tab_size(tab, nrow) != size) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Size mismatch");
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  switch (num) {
+    case BMM_MSG_NUM_CPARTS:
+      {
+        if (!bmm_dem_reserve(dem, nrow))
+          return BMM_IO_READ_ERROR;
+
+        dem->part.n = nrow;
+
+        struct bmm_col_want const want[] = {
+          {"role", BMM_COL_TYPE_U32, 1, dem->part.role},
+          {"r", BMM_COL_TYPE_F64, 1, dem->part.r},
+          {"x", BMM_COL_TYPE_F64, BMM_NDIM, dem->part.x},
+          {"phi", BMM_COL_TYPE_F64, 1, dem->part.phi}
+        };
+
+        return bmm_col_tab_read(tab, nrow, want, nmembof(want), msgswap,
+            msg_read, msg_skip, NULL);
+      }
+    case BMM_MSG_NUM_CEST:
+      {
+        if (nrow != 1) {
+          BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Size mismatch");
+
+          return BMM_IO_READ_ERROR;
+        }
+
+        struct bmm_col_want const want[] = {
+          {"eambdis", BMM_COL_TYPE_F64, 1, &dem->est.eambdis},
+          {"epotext_d", BMM_COL_TYPE_F64, 1, &dem->est.epotext_d},
+          {"eklin_d", BMM_COL_TYPE_F64, 1, &dem->est.eklin_d},
+          {"ekrot_d", BMM_COL_TYPE_F64, 1, &dem->est.ekrot_d},
+          {"ewcont_d", BMM_COL_TYPE_F64, 1, &dem->est.ewcont_d},
+          {"escont_d", BMM_COL_TYPE_F64, 1, &dem->est.escont_d},
+          {"edrivnorm", BMM_COL_TYPE_F64, 1, &dem->est.edrivnorm},
+          {"edrivtang", BMM_COL_TYPE_F64, 1, &dem->est.edrivtang},
+          {"ebond", BMM_COL_TYPE_F64, 1, &dem->est.ebond},
+          {"eyieldis", BMM_COL_TYPE_F64, 1, &dem->est.eyieldis},
+          {"ewcontdis", BMM_COL_TYPE_F64, 1, &dem->est.ewcontdis},
+          {"escontdis", BMM_COL_TYPE_F64, 1, &dem->est.escontdis},
+          {"fback", BMM_COL_TYPE_F64, BMM_NDIM, dem->est.fback},
+          {"vdriv", BMM_COL_TYPE_F64, BMM_NDIM, dem->est.vdriv},
+          {"chi", BMM_COL_TYPE_F64, 1, &dem->est.chi},
+          {"mueff", BMM_COL_TYPE_F64, 1, &dem->est.mueff},
+          {"mueffb", BMM_COL_TYPE_F64, 1, &dem->est.mueffb}
+        };
+
+        return bmm_col_tab_read(tab, nrow, want, nmembof(want), msgswap,
+            msg_read, msg_skip, NULL);
+      }
+  }
+
+  dynamic_assert(false, "Unsupported message number");
+}
+
 enum bmm_io_read bmm_dem_gets_stuff(struct bmm_dem *const dem,
-    enum bmm_msg_num const num) {
+    enum bmm_msg_num const num, size_t const size) {
   switch (num) {
     case BMM_MSG_NUM_ISTEP:
-      return msg_read(&dem->time, sizeof dem->time, NULL);
     case BMM_MSG_NUM_OPTS:
-      return msg_read(&dem->opts, sizeof dem->opts, NULL);
+    case BMM_MSG_NUM_EST:
+    case BMM_MSG_NUM_PROF:
+    case BMM_MSG_NUM_FRAG:
+    case BMM_MSG_NUM_PERF:
+    case BMM_MSG_NUM_STATS:
+      if (bmm_dem_sniff_size(dem, num) != size) {
+        BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Size mismatch");
+
+        return BMM_IO_READ_ERROR;
+      }
+
+      break;
     case BMM_MSG_NUM_NEIGH:
-      switch (msg_read(&dem->cache, sizeof dem->cache, NULL)) {
+    case BMM_MSG_NUM_PARTS:
+    case BMM_MSG_NUM_QPARTS:
+      switch (bmm_dem_gets_npart(dem, num, size)) {
         case BMM_IO_READ_ERROR:
           return BMM_IO_READ_ERROR;
         case BMM_IO_READ_EOF:
           return BMM_IO_READ_EOF;
       }
 
-      return msg_read(&dem->pair, sizeof dem->pair, NULL);
-    case BMM_MSG_NUM_PARTS:
-      switch (msg_read(&dem->part.n, sizeof dem->part.n, NULL)) {
+      break;
+    case BMM_MSG_NUM_DPARTS:
+    case BMM_MSG_NUM_DCONTS:
+      switch (bmm_dem_gets_diff(dem, num, size)) {
         case BMM_IO_READ_ERROR:
           return BMM_IO_READ_ERROR;
         case BMM_IO_READ_EOF:
           return BMM_IO_READ_EOF;
       }
 
-      return msg_read(&dem->part, sizeof dem->part, NULL);
-    case BMM_MSG_NUM_EST:
-      return msg_read(&dem->est, sizeof dem->est, NULL);
+      break;
   }
 
-  dynamic_assert(false, "Unsupported message number");
-}
+  size_t const npart = dem->part.n;
+
+  switch (num) {
+    case BMM_MSG_NUM_ISTEP:
+      switch (msg_read(&dem->time, sizeof dem->time, NULL)) {
+        case BMM_IO_READ_ERROR:
+          return BMM_IO_READ_ERROR;
+        case BMM_IO_READ_EOF:
+          return BMM_IO_READ_EOF;
+      }
+
+      msg_swap(&dem->time.t, 1, sizeof dem->time.t);
+      msg_swap(&dem->time.istep, 1, sizeof dem->time.istep);
+
+      return BMM_IO_READ_SUCCESS;
+    case BMM_MSG_NUM_OPTS:
+      switch (msg_read(&dem->opts, sizeof dem->opts, NULL)) {
+        case BMM_IO_READ_ERROR:
+          return BMM_IO_READ_ERROR;
+        case BMM_IO_READ_EOF:
+          return BMM_IO_READ_EOF;
+      }
+
+      // The options are a memory image full of enumerations and pointers,
+      // so only the members that are looked at here are converted.
+      msg_swap(dem->opts.box.x, BMM_NDIM, sizeof *dem->opts.box.x);
+      msg_swap(dem->opts.cache.ncell, BMM_NDIM,
+          sizeof *dem->opts.cache.ncell);
+      msg_swap(&dem->opts.cache.dcutoff, 1, sizeof dem->opts.cache.dcutoff);
+      msg_swap(&dem->opts.comm.nbit, 1, sizeof dem->opts.comm.nbit);
+
+      return BMM_IO_READ_SUCCESS;
+    case BMM_MSG_NUM_SCHEMA:
+      return bmm_col_schema_read(&msgschema, size, msgswap, msg_read, NULL);
+    case BMM_MSG_NUM_CPARTS:
+    case BMM_MSG_NUM_CEST:
+      return bmm_dem_gets_tab(dem, num, size);
+    case BMM_MSG_NUM_NEIGH:
+      {
+        struct {
+          void *ptr;
+          size_t size;
+          size_t width;
+        } const cols[] = {
+          {&dem->cache.tag, sizeof dem->cache.tag, sizeof dem->cache.tag},
+          {&dem->cache.stale, sizeof dem->cache.stale,
+            sizeof dem->cache.stale},
+          {&dem->cache.i, sizeof dem->cache.i, sizeof dem->cache.i},
+          {&dem->cache.tpart, sizeof dem->cache.tpart,
+            sizeof dem->cache.tpart},
+          {&dem->cache.tprev, sizeof dem->cache.tprev,
+            sizeof dem->cache.tprev},
+          {dem->cache.j, npart * sizeof *dem->cache.j, sizeof *dem->cache.j},
+          {dem->cache.x, npart * sizeof *dem->cache.x,
+            sizeof **dem->cache.x},
+          {dem->cache.ijcell, npart * sizeof *dem->cache.ijcell,
+            sizeof **dem->cache.ijcell},
+          {dem->cache.icell, npart * sizeof *dem->cache.icell,
+            sizeof *dem->cache.icell},
+          {dem->cache.part, sizeof dem->cache.part,
+            sizeof dem->cache.part->n},
+          {dem->cache.ipart, npart * sizeof *dem->cache.ipart,
+            sizeof *dem->cache.ipart},
+          {dem->cache.neigh, npart * sizeof *dem->cache.neigh,
+            sizeof dem->cache.neigh->n},
+          {dem->cache.ineigh, dem->cache.nneigh * sizeof *dem->cache.ineigh,
+            sizeof *dem->cache.ineigh}
+        };
+
+        for (size_t icol = 0; icol < nmembof(cols); ++icol) {
+          switch (msg_read(cols[icol].ptr, cols[icol].size, NULL)) {
+            case BMM_IO_READ_EOF:
+              BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+            case BMM_IO_READ_ERROR:
+              return BMM_IO_READ_ERROR;
+          }
+
+          msg_swap(cols[icol].ptr, cols[icol].size / cols[icol].width,
+              cols[icol].width);
+        }
+
+        for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict) {
+          // Force schemes are converted separately from their parameters,
+          // which is why they are not split into words here.
+          struct {
+            void *ptr;
+            size_t size;
+            size_t width;
+          } const cols[] = {
+            {dem->pair[ict].cont.src,
+              npart * sizeof *dem->pair[ict].cont.src,
+              sizeof dem->pair[ict].cont.src->n},
+            {&dem->pair[ict].cohesive, sizeof dem->pair[ict].cohesive,
+              sizeof dem->pair[ict].cohesive},
+            {&dem->pair[ict].norm, sizeof dem->pair[ict].norm, 1},
+            {&dem->pair[ict].tang, sizeof dem->pair[ict].tang, 1}
+          };
+
+          for (size_t icol = 0; icol < nmembof(cols); ++icol) {
+            switch (msg_read(cols[icol].ptr, cols[icol].size, NULL)) {
+              case BMM_IO_READ_EOF:
+                BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+              case BMM_IO_READ_ERROR:
+                return BMM_IO_READ_ERROR;
+            }
+
+            msg_swap(cols[icol].ptr, cols[icol].size / cols[icol].width,
+                cols[icol].width);
+          }
+
+          msg_swap(&dem->pair[ict].norm.tag, 1,
+              sizeof dem->pair[ict].norm.tag);
+          msg_swap(&dem->pair[ict].norm.params,
+              sizeof dem->pair[ict].norm.params / sizeof (double),
+              sizeof (double));
+          msg_swap(&dem->pair[ict].tang.tag, 1,
+              sizeof dem->pair[ict].tang.tag);
+          msg_swap(&dem->pair[ict].tang.params,
+              sizeof dem->pair[ict].tang.params / sizeof (double),
+              sizeof (double));
+        }
+      }
+
+      return BMM_IO_READ_SUCCESS;
+    case BMM_MSG_NUM_PARTS:
+      {
+        struct {
+          void *ptr;
+          size_t size;
+          size_t width;
+        } const cols[] = {
+          {&dem->part.lnew, sizeof dem->part.lnew, sizeof dem->part.lnew},
+          {dem->part.l, npart * sizeof *dem->part.l, sizeof *dem->part.l},
+          {dem->part.role, npart * sizeof *dem->part.role,
+            sizeof *dem->part.role},
+          {dem->part.r, npart * sizeof *dem->part.r, sizeof *dem->part.r},
+          {dem->part.m, npart * sizeof *dem->part.m, sizeof *dem->part.m},
+          {dem->part.jred, npart * sizeof *dem->part.jred,
+            sizeof *dem->part.jred},
+          {dem->part.x, npart * sizeof *dem->part.x, sizeof **dem->part.x},
+          {dem->part.v, npart * sizeof *dem->part.v, sizeof **dem->part.v},
+          {dem->part.a, npart * sizeof *dem->part.a, sizeof **dem->part.a},
+          {dem->part.phi, npart * sizeof *dem->part.phi,
+            sizeof *dem->part.phi},
+          {dem->part.omega, npart * sizeof *dem->part.omega,
+            sizeof *dem->part.omega},
+          {dem->part.alpha, npart * sizeof *dem->part.alpha,
+            sizeof *dem->part.alpha},
+          {dem->part.f, npart * sizeof *dem->part.f, sizeof **dem->part.f},
+          {dem->part.tau, npart * sizeof *dem->part.tau,
+            sizeof *dem->part.tau}
+        };
+
+        for (size_t icol = 0; icol < nmembof(cols); ++icol) {
+          switch (msg_read(cols[icol].ptr, cols[icol].size, NULL)) {
+            case BMM_IO_READ_EOF:
+              BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+            case BMM_IO_READ_ERROR:
+              return BMM_IO_READ_ERROR;
+          }
+
+          msg_swap(cols[icol].ptr, cols[icol].size / cols[icol].width,
+              cols[icol].width);
+        }
+      }
+
+      return BMM_IO_READ_SUCCESS;
+    case BMM_MSG_NUM_QPARTS:
+      {
+        size_t nbit;
+        double xlim[BMM_NDIM][2];
+
+        struct {
+          void *ptr;
+          size_t size;
+          size_t width;
+        } const cols[] = {
+          {&nbit, sizeof nbit, sizeof nbit},
+          {xlim, sizeof xlim, sizeof **xlim},
+          {dem->part.role, npart * sizeof *dem->part.role,
+            sizeof *dem->part.role},
+          {dem->part.r, npart * sizeof *dem->part.r, sizeof *dem->part.r}
+        };
+
+        for (size_t icol = 0; icol < nmembof(cols); ++icol) {
+          switch (msg_read(cols[icol].ptr, cols[icol].size, NULL)) {
+            case BMM_IO_READ_EOF:
+              BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+            case BMM_IO_READ_ERROR:
+              return BMM_IO_READ_ERROR;
+          }
+
+          msg_swap(cols[icol].ptr, cols[icol].size / cols[icol].width,
+              cols[icol].width);
+        }
+
+        // The size was already checked against the options,
+        // so the two must agree.
+        if (nbit != dem->opts.comm.nbit) {
+          BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Quantization mismatch");
+
+          return BMM_IO_READ_ERROR;
+        }
+
+        for (size_t ipart = 0; ipart < npart; ++ipart)
+          for (size_t idim = 0; idim < BMM_NDIM; ++idim)
+            if (!bmm_dem_gets_dequant(&dem->part.x[ipart][idim],
+                  xlim[idim][0], xlim[idim][1], nbit))
+              return BMM_IO_READ_ERROR;
+
+        for (size_t ipart = 0; ipart < npart; ++ipart)
+          if (!bmm_dem_gets_dequant(&dem->part.phi[ipart], 0.0, M_2PI, 16))
+            return BMM_IO_READ_ERROR;
+      }
+
+      return BMM_IO_READ_SUCCESS;
+    case BMM_MSG_NUM_DPARTS:
+      switch (msg_read(dem->part.role, npart * sizeof *dem->part.role, NULL)) {
+        case BMM_IO_READ_EOF:
+          BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+        case BMM_IO_READ_ERROR:
+          return BMM_IO_READ_ERROR;
+      }
+
+      msg_swap(dem->part.role, npart, sizeof *dem->part.role);
+
+      for (size_t ipart = 0; ipart < npart; ++ipart) {
+        uint64_t buf[BMM_NDIM + 1];
+        switch (msg_read(buf, sizeof buf, NULL)) {
+          case BMM_IO_READ_EOF:
+            BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+          case BMM_IO_READ_ERROR:
+            return BMM_IO_READ_ERROR;
+        }
+
+        msg_swap(buf, nmembof(buf), sizeof *buf);
+
+        // The differences are taken between representations,
+        // so this reproduces the values exactly.
+        double *const y[] = {
+          &dem->part.x[ipart][0], &dem->part.x[ipart][1], &dem->part.phi[ipart]
+        };
+        static_assert(nmembof(y) == nmembof(buf), "Mismatched columns");
+
+        for (size_t iy = 0; iy < nmembof(y); ++iy) {
+          uint64_t i;
+          (void) memcpy(&i, y[iy], sizeof i);
+          i ^= buf[iy];
+          (void) memcpy(y[iy], &i, sizeof i);
+        }
+      }
+
+      return BMM_IO_READ_SUCCESS;
+    case BMM_MSG_NUM_DCONTS:
+      {
+        size_t nrem = size - sizeof dem->part.n;
+
+        for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict) {
+          size_t nchange;
+          if (!bmm_dem_gets_within(&nchange, sizeof nchange, sizeof nchange,
+                &nrem))
+            return BMM_IO_READ_ERROR;
+
+          for (size_t ichange = 0; ichange < nchange; ++ichange) {
+            size_t ipart;
+            if (!bmm_dem_gets_within(&ipart, sizeof ipart, sizeof ipart, &nrem))
+              return BMM_IO_READ_ERROR;
+
+            size_t ncont;
+            if (!bmm_dem_gets_within(&ncont, sizeof ncont, sizeof ncont, &nrem))
+              return BMM_IO_READ_ERROR;
+
+            if (ipart >= npart || ncont > BMM_MCONTACT) {
+              BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Invalid contact");
+
+              return BMM_IO_READ_ERROR;
+            }
+
+            dem->pair[ict].cont.src[ipart].n = ncont;
+            if (!bmm_dem_gets_within(dem->pair[ict].cont.src[ipart].itgt,
+                  ncont * sizeof *dem->pair[ict].cont.src[ipart].itgt,
+                  sizeof *dem->pair[ict].cont.src[ipart].itgt, &nrem))
+              return BMM_IO_READ_ERROR;
+          }
+        }
+
+        if (nrem != 0) {
+          BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Size mismatch");
+
+          return BMM_IO_READ_ERROR;
+        }
+      }
+
+      return BMM_IO_READ_SUCCESS;
+    case BMM_MSG_NUM_EST:
+      switch (msg_read(&dem->est, sizeof dem->est, NULL)) {
+        case BMM_IO_READ_ERROR:
+          return BMM_IO_READ_ERROR;
+        case BMM_IO_READ_EOF:
+          return BMM_IO_READ_EOF;
+      }
+
+      msg_swap(&dem->est, sizeof dem->est / sizeof (double), sizeof (double));
+
+      return BMM_IO_READ_SUCCESS;
+    case BMM_MSG_NUM_FIELD:
+      {
+        size_t nrem = size;
+        if (!(bmm_dem_gets_within(dem->field.ncell,
+                sizeof dem->field.ncell, sizeof *dem->field.ncell, &nrem) &&
+              bmm_dem_gets_within(&dem->field.nsample,
+                sizeof dem->field.nsample, sizeof dem->field.nsample,
+                &nrem)))
+          return BMM_IO_READ_ERROR;
+
+        size_t const ncell = $(bmm_prod, size_t)(dem->field.ncell, BMM_NDIM);
+        if (ncell > nmembof(dem->field.cell) ||
+            ncell * sizeof *dem->field.cell != nrem) {
+          BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Size mismatch");
+
+          return BMM_IO_READ_ERROR;
+        }
+
+        if (!bmm_dem_gets_within(dem->field.cell, nrem, sizeof (double),
+              &nrem))
+          return BMM_IO_READ_ERROR;
+      }
+
+      return BMM_IO_READ_SUCCESS;
+    case BMM_MSG_NUM_PROF:
+      switch (msg_read(&dem->prof, sizeof dem->prof, NULL)) {
+        case BMM_IO_READ_ERROR:
+          return BMM_IO_READ_ERROR;
+        case BMM_IO_READ_EOF:
+          return BMM_IO_READ_EOF;
+      }
+
+      msg_swap(&dem->prof, sizeof dem->prof / sizeof (double),
+          sizeof (double));
+
+      return BMM_IO_READ_SUCCESS;
+    case BMM_MSG_NUM_FRAG:
+      switch (msg_read(&dem->frag.est, sizeof dem->frag.est, NULL)) {
+        case BMM_IO_READ_ERROR:
+          return BMM_IO_READ_ERROR;
+        case BMM_IO_READ_EOF:
+          return BMM_IO_READ_EOF;
+      }
+
+      msg_swap(&dem->frag.est, sizeof dem->frag.est / sizeof (size_t),
+          sizeof (size_t));
+
+      return BMM_IO_READ_SUCCESS;
+    case BMM_MSG_NUM_PERF:
+      switch (msg_read(&dem->perf.est, sizeof dem->perf.est, NULL)) {
+        case BMM_IO_READ_ERROR:
+          return BMM_IO_READ_ERROR;
+        case BMM_IO_READ_EOF:
+          return BMM_IO_READ_EOF;
+      }
+
+      msg_swap(&dem->perf.est, sizeof dem->perf.est / sizeof (uint64_t),
+          sizeof (uint64_t));
+
+      return BMM_IO_READ_SUCCESS;
+    case BMM_MSG_NUM_STATS:
+      switch (msg_read(&dem->stats.est, sizeof dem->stats.est, NULL)) {
+        case BMM_IO_READ_ERROR:
+          return BMM_IO_READ_ERROR;
+        case BMM_IO_READ_EOF:
+          return BMM_IO_READ_EOF;
+      }
+
+      msg_swap(&dem->stats.est, sizeof dem->stats.est / sizeof (double),
+          sizeof (double));
+
+      return BMM_IO_READ_SUCCESS;
+  }
+
+  dynamic_assert(false, "Unsupported message number");
+}
+
+enum bmm_io_read bmm_dem_gets(struct bmm_dem *const dem,
+    enum bmm_msg_num *const num) {
+  // Whatever was left of the previous message is not read from.
+  bmm_zip_clear(&msgzip);
+  bmm_lit_clear(&msglit);
+
+  struct bmm_msg_spec spec;
+  switch (bmm_msg_spec_read(&spec, msg_read, NULL)) {
+    case BMM_IO_READ_ERROR:
+      return BMM_IO_READ_ERROR;
+    case BMM_IO_READ_EOF:
+      return BMM_IO_READ_EOF;
+  }
+
+  // Payloads are converted as they are read
+  // unless there is no telling how.
+  enum bmm_endy const endy = bmm_endy_get();
+  if (spec.endy != endy && endy == BMM_ENDY_MIDDLE) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNIMPL, "Unsupported endianness");
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  msgswap = spec.endy != endy;
+
+  // Literal-terminated messages are decoded first,
+  // so that they can be read like any other once their size is known.
+  if (spec.tag == BMM_MSG_TAG_LT) {
+    switch (bmm_lit_open(&msglit, &spec, msg_read, NULL, NULL)) {
+      case BMM_IO_READ_EOF:
+        BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+      case BMM_IO_READ_ERROR:
+        return BMM_IO_READ_ERROR;
+    }
+
+    if (msglit.nraw < BMM_MSG_NUMSIZE) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Message too short");
+
+      return BMM_IO_READ_ERROR;
+    }
+
+    spec.tag = BMM_MSG_TAG_SP;
+    spec.msg.size = msglit.nraw;
+  }
+
+  switch (bmm_msg_num_read(num, msg_read, NULL)) {
+    case BMM_IO_READ_ERROR:
+      return BMM_IO_READ_ERROR;
+    case BMM_IO_READ_EOF:
+      return BMM_IO_READ_EOF;
+  }
+
+  size_t size = spec.msg.size - BMM_MSG_NUMSIZE;
+
+  // Compressed messages are unwrapped and then read like any other.
+  if (*num == BMM_MSG_NUM_ZIP) {
+    switch (bmm_zip_open(&msgzip, num, &size, size, spec.endy,
+          msg_read, NULL)) {
+      case BMM_IO_READ_EOF:
+        BMM_TLE_EXTS(BMM_TLE_NUM_IO, "Unexpected end");
+      case BMM_IO_READ_ERROR:
+        return BMM_IO_READ_ERROR;
+    }
+
+    if (*num == BMM_MSG_NUM_ZIP) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Nested compressed message");
+
+      return BMM_IO_READ_ERROR;
+    }
+  }
+
+  return bmm_dem_gets_stuff(dem, *num, size);
+}
+
+void bmm_sdl_opts_def(struct bmm_sdl_opts *const opts) {
+  opts->width = 640;
+  opts->height = 480;
+  opts->fps = 16;
+  opts->ms = 0;
+  opts->zoomfac = 1.5;
+  opts->store = NULL;
+  opts->frame = 0;
+  opts->vpath = "sdl.vs.glsl";
+  opts->fpath = "sdl.fs.glsl";
+  opts->lod = 1.0;
+  opts->video = NULL;
+  opts->every = 1;
+  opts->hist = 0;
+}
+
+bool bmm_sdl_def(struct bmm_sdl *const sdl,
+    struct bmm_sdl_opts const *const opts) {
+  sdl->opts = *opts;
+  sdl->width = (int) opts->width;
+  sdl->height = (int) opts->height;
+  sdl->qaspect = (double) opts->width / (double) opts->height;
+  sdl->qzoom = 1.0;
+  sdl->rorigin[0] = 0.0;
+  sdl->rorigin[1] = 0.0;
+  sdl->fps = opts->fps;
+  sdl->itarget = SIZE_MAX;
+  sdl->stale = true;
+  sdl->active = true;
+  sdl->blend = true;
+  sdl->diag = true;
+  sdl->lod = true;
+  sdl->inst.on = false;
+  sdl->inst.vshader = 0;
+  sdl->inst.fshader = 0;
+  sdl->inst.program = 0;
+  sdl->inst.varray = 0;
+  sdl->inst.vcorner = 0;
+  sdl->inst.vpart = 0;
+  // Videos should not skip the frames the renderer falls behind on.
+  sdl->read.lossy = msgstore == NULL && msgmap == NULL &&
+    opts->video == NULL;
+  sdl->read.quit = false;
+  sdl->read.done = false;
+  sdl->read.fresh = false;
+  sdl->read.live = false;
+  sdl->read.iback = 0;
+  sdl->read.imid = 1;
+  sdl->read.ifront = 2;
+  sdl->rec.stream = NULL;
+  sdl->rec.fdraw = 0;
+  sdl->rec.fread = 0;
+  sdl->rec.rcolor = 0;
+  sdl->rec.rdepth = 0;
+  sdl->rec.rread = 0;
+  sdl->rec.pixels = NULL;
+  sdl->rec.iframe = 0;
+  sdl->hist.nmax = opts->hist << 20;
+  sdl->hist.nbyte = 0;
+  sdl->hist.n = 0;
+  sdl->hist.ncap = 0;
+  sdl->hist.ifirst = 0;
+  sdl->hist.frame = NULL;
+  bmm_zip_def(&sdl->hist.pack);
+  bmm_zip_def(&sdl->hist.unpack);
+  sdl->hist.buf = NULL;
+  sdl->hist.ncapbuf = 0;
+  sdl->hist.iview = 0;
+  sdl->hist.nview = 0;
+  sdl->dem = &sdl->read.buf[sdl->read.ifront];
+
+  struct bmm_dem_opts defopts;
+  bmm_dem_opts_def(&defopts);
+
+  // Every simulation is set up even if one fails,
+  // so that all of them can be released the same way.
+  bool result = bmm_dem_def(&sdl->read.parse, &defopts);
+  for (size_t ibuf = 0; ibuf < nmembof(sdl->read.buf); ++ibuf)
+    if (!bmm_dem_def(&sdl->read.buf[ibuf], &defopts))
+      result = false;
+  if (!bmm_dem_def(&sdl->hist.view, &defopts))
+    result = false;
+
+  return result;
+}
+
+void bmm_sdl_free(struct bmm_sdl *const sdl) {
+  for (size_t iframe = 0; iframe < sdl->hist.n; ++iframe)
+    free(sdl->hist.frame[(sdl->hist.ifirst + iframe) % sdl->hist.ncap].buf);
+  free(sdl->hist.frame);
+  bmm_zip_free(&sdl->hist.pack);
+  bmm_zip_free(&sdl->hist.unpack);
+  free(sdl->hist.buf);
+  bmm_dem_free(&sdl->hist.view);
+
+  for (size_t ibuf = 0; ibuf < nmembof(sdl->read.buf); ++ibuf)
+    bmm_dem_free(&sdl->read.buf[ibuf]);
+
+  bmm_dem_free(&sdl->read.parse);
+}
+
+/// The call `bmm_sdl_snap(dst, src)`
+/// copies the parts of the simulation `src` that the viewer draws
+/// into the simulation `dst`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_sdl_snap(struct bmm_dem *const dst,
+    struct bmm_dem const *const src) {
+  size_t const npart = src->part.n;
+
+  if (!(bmm_dem_reserve(dst, npart) &&
+        bmm_dem_cache_reserve(dst, src->cache.nneigh)))
+    return false;
+
+  // The allocations of the snapshot follow its own options,
+  // so the options that govern them are kept as they are.
+  struct bmm_dem_opts opts = src->opts;
+  opts.thread = dst->opts.thread;
+  opts.field.on = dst->opts.field.on;
+  dst->opts = opts;
+
+  dst->time = src->time;
+  dst->est = src->est;
+  dst->prof = src->prof;
+  dst->frag.est = src->frag.est;
+
+  dst->field.nsample = src->field.nsample;
+  (void) memcpy(dst->field.ncell, src->field.ncell, sizeof dst->field.ncell);
+  (void) memcpy(dst->field.cell, src->field.cell,
+      $(bmm_prod, size_t)(src->field.ncell, BMM_NDIM) *
+      sizeof *dst->field.cell);
+
+  dst->part.n = npart;
+  dst->part.lnew = src->part.lnew;
+
+  struct {
+    void *dst;
+    void const *src;
+    size_t size;
+  } const cols[] = {
+    {dst->part.l, src->part.l, sizeof *dst->part.l},
+    {dst->part.role, src->part.role, sizeof *dst->part.role},
+    {dst->part.r, src->part.r, sizeof *dst->part.r},
+    {dst->part.m, src->part.m, sizeof *dst->part.m},
+    {dst->part.jred, src->part.jred, sizeof *dst->part.jred},
+    {dst->part.x, src->part.x, sizeof *dst->part.x},
+    {dst->part.v, src->part.v, sizeof *dst->part.v},
+    {dst->part.a, src->part.a, sizeof *dst->part.a},
+    {dst->part.phi, src->part.phi, sizeof *dst->part.phi},
+    {dst->part.omega, src->part.omega, sizeof *dst->part.omega},
+    {dst->part.alpha, src->part.alpha, sizeof *dst->part.alpha},
+    {dst->part.f, src->part.f, sizeof *dst->part.f},
+    {dst->part.tau, src->part.tau, sizeof *dst->part.tau},
+    {dst->cache.x, src->cache.x, sizeof *dst->cache.x},
+    {dst->cache.neigh, src->cache.neigh, sizeof *dst->cache.neigh}
+  };
+
+  for (size_t icol = 0; icol < nmembof(cols); ++icol)
+    if (npart != 0)
+      (void) memcpy(cols[icol].dst, cols[icol].src, npart * cols[icol].size);
+
+  dst->cache.tag = src->cache.tag;
+  dst->cache.stale = src->cache.stale;
+  dst->cache.i = src->cache.i;
+  dst->cache.tpart = src->cache.tpart;
+  dst->cache.tprev = src->cache.tprev;
+  dst->cache.nneigh = src->cache.nneigh;
+  if (src->cache.nneigh != 0)
+    (void) memcpy(dst->cache.ineigh, src->cache.ineigh,
+        src->cache.nneigh * sizeof *dst->cache.ineigh);
+
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict) {
+    if (npart != 0)
+      (void) memcpy(dst->pair[ict].cont.src, src->pair[ict].cont.src,
+          npart * sizeof *dst->pair[ict].cont.src);
+
+    dst->pair[ict].cohesive = src->pair[ict].cohesive;
+    dst->pair[ict].norm = src->pair[ict].norm;
+    dst->pair[ict].tang = src->pair[ict].tang;
+  }
+
+  return true;
+}
+
+/// The call `bmm_sdl_hist_cols(cols, dem)`
+/// stores into `cols` the addresses and sizes
+/// of the particle columns of the simulation `dem`
+/// that the viewer draws
+/// and returns their number,
+/// which is at most `BMM_SDL_MCOL`.
+__attribute__ ((__nonnull__))
+static size_t bmm_sdl_hist_cols(struct bmm_sdl_col *const cols,
+    struct bmm_dem const *const dem) {
+  size_t icol = 0;
+
+#define COL(p) \
+  begin \
+    cols[icol].ptr = (p); \
+    cols[icol].size = sizeof *(p); \
+    ++icol; \
+  end
+
+  COL(dem->part.l);
+  COL(dem->part.role);
+  COL(dem->part.r);
+  COL(dem->part.m);
+  COL(dem->part.jred);
+  COL(dem->part.x);
+  COL(dem->part.v);
+  COL(dem->part.a);
+  COL(dem->part.phi);
+  COL(dem->part.omega);
+  COL(dem->part.alpha);
+  COL(dem->part.f);
+  COL(dem->part.tau);
+  COL(dem->cache.x);
+  COL(dem->cache.neigh);
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict)
+    COL(dem->pair[ict].cont.src);
+
+#undef COL
+
+  return icol;
+}
+
+/// The call `bmm_sdl_hist_pack(zip, dem)`
+/// packs the parts of the simulation `dem` that the viewer draws
+/// into the uncompressed payload of `zip`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_sdl_hist_pack(struct bmm_zip *const zip,
+    struct bmm_dem const *const dem) {
+  size_t const npart = dem->part.n;
+
+  bmm_zip_clear(zip);
+
+#define PUT(p, n) \
+  begin \
+    if (!bmm_zip_put(zip, (p), (n))) \
+      return false; \
+  end
+
+  PUT(&dem->opts, sizeof dem->opts);
+  PUT(&dem->time, sizeof dem->time);
+  PUT(&dem->est, sizeof dem->est);
+  PUT(&dem->prof, sizeof dem->prof);
+  PUT(&dem->frag.est, sizeof dem->frag.est);
+  PUT(&dem->field.nsample, sizeof dem->field.nsample);
+  PUT(dem->field.ncell, sizeof dem->field.ncell);
+  PUT(&dem->part.n, sizeof dem->part.n);
+  PUT(&dem->part.lnew, sizeof dem->part.lnew);
+  PUT(&dem->cache.tag, sizeof dem->cache.tag);
+  PUT(&dem->cache.stale, sizeof dem->cache.stale);
+  PUT(&dem->cache.i, sizeof dem->cache.i);
+  PUT(&dem->cache.tpart, sizeof dem->cache.tpart);
+  PUT(&dem->cache.tprev, sizeof dem->cache.tprev);
+  PUT(&dem->cache.nneigh, sizeof dem->cache.nneigh);
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict) {
+    PUT(&dem->pair[ict].cohesive, sizeof dem->pair[ict].cohesive);
+    PUT(&dem->pair[ict].norm, sizeof dem->pair[ict].norm);
+    PUT(&dem->pair[ict].tang, sizeof dem->pair[ict].tang);
+  }
+
+  PUT(dem->field.cell, $(bmm_prod, size_t)(dem->field.ncell, BMM_NDIM) *
+      sizeof *dem->field.cell);
+
+  struct bmm_sdl_col cols[BMM_SDL_MCOL];
+  size_t const ncol = bmm_sdl_hist_cols(cols, dem);
+  for (size_t icol = 0; icol < ncol; ++icol)
+    PUT(cols[icol].ptr, npart * cols[icol].size);
+
+  PUT(dem->cache.ineigh, dem->cache.nneigh * sizeof *dem->cache.ineigh);
+
+#undef PUT
+
+  return true;
+}
+
+/// The call `bmm_sdl_hist_unpack(dem, zip)`
+/// unpacks the uncompressed payload of `zip`
+/// packed by `bmm_sdl_hist_pack` into the simulation `dem`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_sdl_hist_unpack(struct bmm_dem *const dem,
+    struct bmm_zip *const zip) {
+#define GET(p, n) \
+  begin \
+    if (bmm_zip_read(zip, (p), (n)) != BMM_IO_READ_SUCCESS) { \
+      BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Truncated frame in history"); \
+      \
+      return false; \
+    } \
+  end
+
+  // The allocations of the snapshot follow its own options,
+  // so the options that govern them are kept as they are.
+  struct bmm_dem_opts opts;
+  GET(&opts, sizeof opts);
+  opts.thread = dem->opts.thread;
+  opts.field.on = dem->opts.field.on;
+  dem->opts = opts;
+
+  GET(&dem->time, sizeof dem->time);
+  GET(&dem->est, sizeof dem->est);
+  GET(&dem->prof, sizeof dem->prof);
+  GET(&dem->frag.est, sizeof dem->frag.est);
+  GET(&dem->field.nsample, sizeof dem->field.nsample);
+  GET(dem->field.ncell, sizeof dem->field.ncell);
+
+  size_t npart;
+  GET(&npart, sizeof npart);
+  GET(&dem->part.lnew, sizeof dem->part.lnew);
+  GET(&dem->cache.tag, sizeof dem->cache.tag);
+  GET(&dem->cache.stale, sizeof dem->cache.stale);
+  GET(&dem->cache.i, sizeof dem->cache.i);
+  GET(&dem->cache.tpart, sizeof dem->cache.tpart);
+  GET(&dem->cache.tprev, sizeof dem->cache.tprev);
+
+  size_t nneigh;
+  GET(&nneigh, sizeof nneigh);
+  for (enum bmm_dem_ct ict = 0; ict < BMM_NCT; ++ict) {
+    GET(&dem->pair[ict].cohesive, sizeof dem->pair[ict].cohesive);
+    GET(&dem->pair[ict].norm, sizeof dem->pair[ict].norm);
+    GET(&dem->pair[ict].tang, sizeof dem->pair[ict].tang);
+  }
+
+  if (!(bmm_dem_reserve(dem, npart) && bmm_dem_cache_reserve(dem, nneigh)))
+    return false;
+
+  dem->part.n = npart;
+  dem->cache.nneigh = nneigh;
+
+  GET(dem->field.cell, $(bmm_prod, size_t)(dem->field.ncell, BMM_NDIM) *
+      sizeof *dem->field.cell);
+
+  struct bmm_sdl_col cols[BMM_SDL_MCOL];
+  size_t const ncol = bmm_sdl_hist_cols(cols, dem);
+  for (size_t icol = 0; icol < ncol; ++icol)
+    GET(cols[icol].ptr, npart * cols[icol].size);
+
+  GET(dem->cache.ineigh, nneigh * sizeof *dem->cache.ineigh);
+
+#undef GET
+
+  return true;
+}
+
+/// The call `bmm_sdl_hist_put(sdl, dem)`
+/// compresses the frame in the simulation `dem`
+/// and adds it to the history of the viewer `sdl`,
+/// throwing away the oldest frames to make room for it.
+/// Frames that would not fit on their own are not kept.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+/// This is only called by the reader thread.
+__attribute__ ((__nonnull__))
+static bool bmm_sdl_hist_put(struct bmm_sdl *const sdl,
+    struct bmm_dem const *const dem) {
+  struct bmm_sdl_hist *const hist = &sdl->hist;
+
+  if (!bmm_sdl_hist_pack(&hist->pack, dem))
+    return false;
+
+  // Shuffling groups the bytes of floating-point numbers,
+  // of which the sign and exponent bytes barely change.
+  unsigned char const *zbuf;
+  size_t n;
+  if (!bmm_zip_deflate(&hist->pack, Z_BEST_SPEED, true, &zbuf, &n))
+    return false;
+
+  if (n > hist->nmax)
+    return true;
+
+  unsigned char *const buf = malloc(n);
+  if (buf == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  (void) memcpy(buf, zbuf, n);
+
+  (void) pthread_mutex_lock(&sdl->read.mutex);
+
+  while (hist->n != 0 && hist->nbyte + n > hist->nmax) {
+    hist->nbyte -= hist->frame[hist->ifirst].n;
+    free(hist->frame[hist->ifirst].buf);
+
+    hist->ifirst = (hist->ifirst + 1) % hist->ncap;
+    --hist->n;
+  }
+
+  if (hist->n == hist->ncap) {
+    size_t const ncap = hist->ncap == 0 ? 64 : hist->ncap * 2;
+
+    struct bmm_sdl_frame *const frame = malloc(ncap * sizeof *frame);
+    if (frame == NULL) {
+      BMM_TLE_STDS();
+
+      (void) pthread_mutex_unlock(&sdl->read.mutex);
+
+      free(buf);
+
+      return false;
+    }
+
+    // The frames are straightened out, so that the oldest comes first.
+    for (size_t iframe = 0; iframe < hist->n; ++iframe)
+      frame[iframe] = hist->frame[(hist->ifirst + iframe) % hist->ncap];
+
+    free(hist->frame);
+    hist->frame = frame;
+    hist->ncap = ncap;
+    hist->ifirst = 0;
+  }
+
+  struct bmm_sdl_frame *const frame =
+    &hist->frame[(hist->ifirst + hist->n) % hist->ncap];
+  frame->istep = dem->time.istep;
+  frame->nraw = hist->pack.nraw;
+  frame->n = n;
+  frame->buf = buf;
+
+  hist->nbyte += n;
+  ++hist->n;
+
+  (void) pthread_mutex_unlock(&sdl->read.mutex);
+
+  return true;
+}
+
+/// The call `bmm_sdl_hist_seek(sdl, seek)`
+/// unpacks the frame from the history of the viewer `sdl`
+/// that `seek` picks relative to the frame being drawn
+/// and draws it instead.
+/// If there is no such frame, nothing changes.
+/// Either way the viewer is paused, so that the frame stays put.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_sdl_hist_seek(struct bmm_sdl *const sdl,
+    enum bmm_sdl_seek const seek) {
+  struct bmm_sdl_hist *const hist = &sdl->hist;
+  size_t const istep = sdl->dem->time.istep;
+
+  sdl->active = false;
+
+  (void) pthread_mutex_lock(&sdl->read.mutex);
+
+  size_t const n = hist->n;
+
+  // Frames are in the order they were read,
+  // so the steps only ever increase from the oldest to the newest.
+  size_t iview = SIZE_MAX;
+  switch (seek) {
+    case BMM_SDL_SEEK_FIRST:
+      if (n != 0)
+        iview = 0;
+
+      break;
+    case BMM_SDL_SEEK_PREV:
+      for (size_t iframe = n; iframe-- > 0; )
+        if (hist->frame[(hist->ifirst + iframe) % hist->ncap].istep < istep) {
+          iview = iframe;
+
+          break;
+        }
+
+      break;
+    case BMM_SDL_SEEK_NEXT:
+      for (size_t iframe = 0; iframe < n; ++iframe)
+        if (hist->frame[(hist->ifirst + iframe) % hist->ncap].istep > istep) {
+          iview = iframe;
+
+          break;
+        }
+
+      break;
+    case BMM_SDL_SEEK_LAST:
+      if (n != 0)
+        iview = n - 1;
+
+      break;
+  }
+
+  if (iview == SIZE_MAX) {
+    (void) pthread_mutex_unlock(&sdl->read.mutex);
+
+    return true;
+  }
+
+  struct bmm_sdl_frame const frame =
+    hist->frame[(hist->ifirst + iview) % hist->ncap];
+
+  if (frame.n > hist->ncapbuf) {
+    unsigned char *const buf = realloc(hist->buf, frame.n);
+    if (buf == NULL) {
+      BMM_TLE_STDS();
+
+      (void) pthread_mutex_unlock(&sdl->read.mutex);
+
+      return false;
+    }
+
+    hist->buf = buf;
+    hist->ncapbuf = frame.n;
+  }
+
+  (void) memcpy(hist->buf, frame.buf, frame.n);
+
+  (void) pthread_mutex_unlock(&sdl->read.mutex);
+
+  if (!(bmm_zip_inflate(&hist->unpack, true, hist->buf, frame.n, frame.nraw) &&
+        bmm_sdl_hist_unpack(&hist->view, &hist->unpack)))
+    return false;
+
+  hist->iview = iview;
+  hist->nview = n;
+
+  sdl->dem = &hist->view;
+
+  return true;
+}
+
+/// The call `bmm_sdl_read_run(ptr)`
+/// reads messages for the viewer `ptr` until it is told to stop
+/// or the input runs out,
+/// handing every complete frame over to the renderer.
+__attribute__ ((__nonnull__))
+static void *bmm_sdl_read_run(void *const ptr) {
+  struct bmm_sdl *const sdl = ptr;
+  struct bmm_sdl_read *const reader = &sdl->read;
+
+  // The reader may only be cancelled while it waits for input,
+  // because that is the only place where it holds nothing.
+  (void) pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+  for ever {
+    (void) pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+
+    enum bmm_msg_num num;
+    enum bmm_io_read const result = bmm_dem_gets(&reader->parse, &num);
+
+    (void) pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+    if (result != BMM_IO_READ_SUCCESS)
+      break;
+
+    if (reader->lossy &&
+        (num == BMM_MSG_NUM_EST || num == BMM_MSG_NUM_CEST ||
+         num == BMM_MSG_NUM_PROF)) {
+      (void) pthread_mutex_lock(&reader->mutex);
+
+      reader->est = reader->parse.est;
+      reader->prof = reader->parse.prof;
+      reader->live = true;
+
+      (void) pthread_mutex_unlock(&reader->mutex);
+
+      continue;
+    }
+
+    if (!(num == BMM_MSG_NUM_PARTS || num == BMM_MSG_NUM_QPARTS ||
+          num == BMM_MSG_NUM_DPARTS || num == BMM_MSG_NUM_CPARTS))
+      continue;
+
+    if (!bmm_sdl_snap(&reader->buf[reader->iback], &reader->parse))
+      break;
+
+    if (sdl->hist.nmax != 0 && !bmm_sdl_hist_put(sdl, &reader->parse))
+      break;
+
+    (void) pthread_mutex_lock(&reader->mutex);
+
+    if (!reader->lossy)
+      while (reader->fresh && !reader->quit)
+        (void) pthread_cond_wait(&reader->ctaken, &reader->mutex);
+
+    bool const quit = reader->quit;
+
+    if (!quit) {
+      size_t const ibuf = reader->imid;
+      reader->imid = reader->iback;
+      reader->iback = ibuf;
+      reader->fresh = true;
+
+      (void) pthread_cond_signal(&reader->cready);
+    }
+
+    (void) pthread_mutex_unlock(&reader->mutex);
+
+    if (quit)
+      break;
+  }
+
+  (void) pthread_mutex_lock(&reader->mutex);
+
+  reader->done = true;
+  (void) pthread_cond_signal(&reader->cready);
+
+  (void) pthread_mutex_unlock(&reader->mutex);
+
+  return NULL;
+}
+
+/// The call `bmm_sdl_read_start(sdl)`
+/// starts the reader thread of the viewer `sdl`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_sdl_read_start(struct bmm_sdl *const sdl) {
+  int nerr;
+
+  nerr = pthread_mutex_init(&sdl->read.mutex, NULL);
+  if (nerr != 0) {
+    errno = nerr;
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  nerr = pthread_cond_init(&sdl->read.ctaken, NULL);
+  if (nerr != 0) {
+    errno = nerr;
+    BMM_TLE_STDS();
+
+    (void) pthread_mutex_destroy(&sdl->read.mutex);
+
+    return false;
+  }
+
+  nerr = pthread_cond_init(&sdl->read.cready, NULL);
+  if (nerr != 0) {
+    errno = nerr;
+    BMM_TLE_STDS();
+
+    (void) pthread_cond_destroy(&sdl->read.ctaken);
+    (void) pthread_mutex_destroy(&sdl->read.mutex);
+
+    return false;
+  }
+
+  // Signals are left for the rendering thread to handle,
+  // so the reader thread starts with all of them blocked.
+  sigset_t set;
+  (void) sigfillset(&set);
+
+  sigset_t oldset;
+  (void) pthread_sigmask(SIG_SETMASK, &set, &oldset);
+
+  nerr = pthread_create(&sdl->read.thread, NULL, bmm_sdl_read_run, sdl);
+
+  (void) pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+  if (nerr != 0) {
+    errno = nerr;
+    BMM_TLE_STDS();
+
+    (void) pthread_cond_destroy(&sdl->read.cready);
+    (void) pthread_cond_destroy(&sdl->read.ctaken);
+    (void) pthread_mutex_destroy(&sdl->read.mutex);
+
+    return false;
+  }
+
+  return true;
+}
+
+/// The call `bmm_sdl_read_stop(sdl)`
+/// stops the reader thread of the viewer `sdl`,
+/// even if it is waiting for input.
+__attribute__ ((__nonnull__))
+static void bmm_sdl_read_stop(struct bmm_sdl *const sdl) {
+  (void) pthread_mutex_lock(&sdl->read.mutex);
+
+  sdl->read.quit = true;
+  (void) pthread_cond_signal(&sdl->read.ctaken);
+
+  bool const done = sdl->read.done;
+
+  (void) pthread_mutex_unlock(&sdl->read.mutex);
+
+  // Cancellations are deferred until the reader waits for input again,
+  // so this never interrupts it in the middle of a handover.
+  if (!done)
+    (void) pthread_cancel(sdl->read.thread);
+
+  (void) pthread_join(sdl->read.thread, NULL);
 
-enum bmm_io_read bmm_dem_gets(struct bmm_dem *const dem,
-    enum bmm_msg_num *const num) {
-  struct bmm_msg_spec spec;
-  switch (bmm_msg_spec_read(&spec, msg_read, NULL)) {
-    case BMM_IO_READ_ERROR:
-      return BMM_IO_READ_ERROR;
-    case BMM_IO_READ_EOF:
-      return BMM_IO_READ_EOF;
-  }
+  (void) pthread_cond_destroy(&sdl->read.cready);
+  (void) pthread_cond_destroy(&sdl->read.ctaken);
+  (void) pthread_mutex_destroy(&sdl->read.mutex);
+}
 
-  if (spec.endy != bmm_endy_get()) {
-    BMM_TLE_EXTS(BMM_TLE_NUM_UNIMPL, "Unsupported endianness");
+/// The call `bmm_sdl_read_take(sdl)`
+/// swaps the newest complete frame in for drawing in the viewer `sdl`
+/// if there is one,
+/// brings its progress reports up to date and
+/// returns whether anything changed.
+__attribute__ ((__nonnull__))
+static bool bmm_sdl_read_take(struct bmm_sdl *const sdl) {
+  (void) pthread_mutex_lock(&sdl->read.mutex);
 
-    return BMM_IO_READ_ERROR;
-  }
+  bool const fresh = sdl->read.fresh;
 
-  if (spec.tag != BMM_MSG_TAG_SP) {
-    BMM_TLE_EXTS(BMM_TLE_NUM_UNIMPL, "Unsupported tag");
+  if (fresh) {
+    size_t const ibuf = sdl->read.ifront;
+    sdl->read.ifront = sdl->read.imid;
+    sdl->read.imid = ibuf;
+    sdl->read.fresh = false;
 
-    return BMM_IO_READ_ERROR;
+    (void) pthread_cond_signal(&sdl->read.ctaken);
   }
 
-  switch (bmm_msg_num_read(num, msg_read, NULL)) {
-    case BMM_IO_READ_ERROR:
-      return BMM_IO_READ_ERROR;
-    case BMM_IO_READ_EOF:
-      return BMM_IO_READ_EOF;
+  bool const live = sdl->read.live;
+
+  if (live) {
+    sdl->read.buf[sdl->read.ifront].est = sdl->read.est;
+    sdl->read.buf[sdl->read.ifront].prof = sdl->read.prof;
+    sdl->read.live = false;
   }
 
-  if (bmm_dem_sniff_size(dem, *num) != spec.msg.size - BMM_MSG_NUMSIZE) {
-    BMM_TLE_EXTS(BMM_TLE_NUM_UNKNOWN, "Size mismatch");
+  (void) pthread_mutex_unlock(&sdl->read.mutex);
 
-    return BMM_IO_READ_ERROR;
-  }
+  sdl->dem = &sdl->read.buf[sdl->read.ifront];
 
-  return bmm_dem_gets_stuff(dem, *num);
+  return fresh || live;
 }
 
-void bmm_sdl_opts_def(struct bmm_sdl_opts *const opts) {
-  opts->width = 640;
-  opts->height = 480;
-  opts->fps = 16;
-  opts->ms = 0;
-  opts->zoomfac = 1.5;
-}
+/// The call `bmm_sdl_read_wait(sdl)`
+/// waits until there is a new frame for the viewer `sdl`,
+/// swaps it in for drawing and returns `true`
+/// or returns `false` if the reader stops before that.
+__attribute__ ((__nonnull__))
+static bool bmm_sdl_read_wait(struct bmm_sdl *const sdl) {
+  (void) pthread_mutex_lock(&sdl->read.mutex);
 
-void bmm_sdl_def(struct bmm_sdl *const sdl,
-    struct bmm_sdl_opts const *const opts) {
-  sdl->opts = *opts;
-  sdl->width = (int) opts->width;
-  sdl->height = (int) opts->height;
-  sdl->qaspect = (double) opts->width / (double) opts->height;
-  sdl->qzoom = 1.0;
-  sdl->rorigin[0] = 0.0;
-  sdl->rorigin[1] = 0.0;
-  sdl->fps = opts->fps;
-  sdl->itarget = SIZE_MAX;
-  sdl->stale = true;
-  sdl->active = true;
-  sdl->blend = true;
-  sdl->diag = true;
+  while (!sdl->read.fresh && !sdl->read.done)
+    (void) pthread_cond_wait(&sdl->read.cready, &sdl->read.mutex);
 
-  struct bmm_dem_opts defopts;
-  bmm_dem_opts_def(&defopts);
-  bmm_dem_def(&sdl->dem, &defopts);
+  (void) pthread_mutex_unlock(&sdl->read.mutex);
+
+  return bmm_sdl_read_take(sdl);
 }
 
 static Uint32 bmm_sdl_tstep(struct bmm_sdl const *const sdl) {
@@ -149,8 +1623,8 @@ static Uint32 bmm_sdl_tstep(struct bmm_sdl const *const sdl) {
 static void bmm_sdl_proj(struct bmm_sdl const *const sdl,
     double *const xproj, double *const yproj,
     double *const wproj, double *const hproj) {
-  double const w = sdl->dem.opts.box.x[0];
-  double const h = sdl->dem.opts.box.x[1];
+  double const w = sdl->dem->opts.box.x[0];
+  double const h = sdl->dem->opts.box.x[1];
   double const q = sdl->qaspect;
   double const z = sdl->qzoom;
   double const xorigin = sdl->rorigin[0];
@@ -246,6 +1720,309 @@ void bmm_dem_ijcellx(size_t *const pijcell,
   }
 }
 
+/// Attributes of a particle for the instanced renderer.
+struct bmm_sdl_vpart {
+  /// Position, radius and angle.
+  GLfloat part[4];
+  /// Whether the particle is free.
+  GLfloat free;
+  /// Periodic image as a multiple of the box width.
+  GLfloat off;
+};
+
+/// The call `bmm_sdl_inst_free(sdl)`
+/// releases the resources of the instanced renderer of `sdl`.
+__attribute__ ((__nonnull__))
+static void bmm_sdl_inst_free(struct bmm_sdl *const sdl) {
+  if (sdl->inst.vpart != 0)
+    glDeleteBuffers(1, &sdl->inst.vpart);
+
+  if (sdl->inst.vcorner != 0)
+    glDeleteBuffers(1, &sdl->inst.vcorner);
+
+  if (sdl->inst.varray != 0)
+    glDeleteVertexArrays(1, &sdl->inst.varray);
+
+  if (sdl->inst.program != 0)
+    glDeleteProgram(sdl->inst.program);
+
+  if (sdl->inst.fshader != 0)
+    glDeleteShader(sdl->inst.fshader);
+
+  if (sdl->inst.vshader != 0)
+    glDeleteShader(sdl->inst.vshader);
+
+  sdl->inst.on = false;
+  sdl->inst.vshader = 0;
+  sdl->inst.fshader = 0;
+  sdl->inst.program = 0;
+  sdl->inst.varray = 0;
+  sdl->inst.vcorner = 0;
+  sdl->inst.vpart = 0;
+}
+
+/// The call `bmm_sdl_inst_def(sdl)`
+/// sets up the instanced renderer of `sdl` for the current context.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_sdl_inst_def(struct bmm_sdl *const sdl) {
+  if (glewInit() != GLEW_OK || !GLEW_VERSION_3_3) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_GL, "Failed to initialize OpenGL 3.3");
+
+    return false;
+  }
+
+  if (!bmm_gl2_build(&sdl->inst.vshader, &sdl->inst.fshader,
+        &sdl->inst.program, sdl->opts.vpath, sdl->opts.fpath))
+    return false;
+
+  // Each corner is a direction and a weight
+  // that picks either the hole or the rim.
+  GLfloat corner[2 * (BMM_SDL_NCORNER + 1)][3];
+  for (size_t icorner = 0; icorner <= BMM_SDL_NCORNER; ++icorner) {
+    float const a = (float) (icorner % BMM_SDL_NCORNER) *
+      ((float) M_2PI / (float) BMM_SDL_NCORNER);
+
+    for (size_t iend = 0; iend < 2; ++iend) {
+      corner[2 * icorner + iend][0] = cosf(a);
+      corner[2 * icorner + iend][1] = sinf(a);
+      corner[2 * icorner + iend][2] = (float) iend;
+    }
+  }
+
+  glGenVertexArrays(1, &sdl->inst.varray);
+  glBindVertexArray(sdl->inst.varray);
+
+  if (!bmm_gl2_buffer(&sdl->inst.vcorner, GL_ARRAY_BUFFER, GL_STATIC_DRAW,
+        corner, (GLsizei) sizeof corner)) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_GL, "Failed to allocate buffer");
+
+    glBindVertexArray(0);
+
+    return false;
+  }
+
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof *corner, NULL);
+
+  // Storage for this is allocated when drawing.
+  glGenBuffers(1, &sdl->inst.vpart);
+  glBindBuffer(GL_ARRAY_BUFFER, sdl->inst.vpart);
+
+  // Every particle is repeated for three periodic images.
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE,
+      sizeof (struct bmm_sdl_vpart),
+      (GLvoid const *) offsetof(struct bmm_sdl_vpart, part));
+  glVertexAttribDivisor(1, 1);
+
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE,
+      sizeof (struct bmm_sdl_vpart),
+      (GLvoid const *) offsetof(struct bmm_sdl_vpart, free));
+  glVertexAttribDivisor(2, 1);
+
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE,
+      sizeof (struct bmm_sdl_vpart),
+      (GLvoid const *) offsetof(struct bmm_sdl_vpart, off));
+  glVertexAttribDivisor(3, 1);
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  sdl->inst.uview = glGetUniformLocation(sdl->inst.program, "view");
+  sdl->inst.ubox = glGetUniformLocation(sdl->inst.program, "box");
+  sdl->inst.uskew = glGetUniformLocation(sdl->inst.program, "skew");
+  sdl->inst.ucfree = glGetUniformLocation(sdl->inst.program, "cfree");
+  sdl->inst.ucother = glGetUniformLocation(sdl->inst.program, "cother");
+
+  sdl->inst.on = true;
+
+  return true;
+}
+
+/// The call `bmm_sdl_seen(xproj, yproj, wproj, hproj, x, y, r)`
+/// checks whether a disk with a radius of `r` centered at `x` and `y`
+/// overlaps the projection
+/// with a corner at `xproj` and `yproj`,
+/// a width of `wproj` and a height of `hproj`.
+__attribute__ ((__const__, __pure__))
+static bool bmm_sdl_seen(double const xproj, double const yproj,
+    double const wproj, double const hproj,
+    double const x, double const y, double const r) {
+  return x + r >= xproj && x - r <= xproj + wproj &&
+    y + r >= yproj && y - r <= yproj + hproj;
+}
+
+/// The call `bmm_sdl_rpix(sdl, wproj)`
+/// returns the average radius of the particles of `sdl` in pixels
+/// in a projection with a width of `wproj`.
+__attribute__ ((__nonnull__, __pure__))
+static double bmm_sdl_rpix(struct bmm_sdl const *const sdl,
+    double const wproj) {
+  size_t const npart = sdl->dem->part.n;
+  if (npart == 0)
+    return INFINITY;
+
+  double rsum = 0.0;
+  for (size_t ipart = 0; ipart < npart; ++ipart)
+    rsum += sdl->dem->part.r[ipart];
+
+  return rsum / (double) npart * (double) sdl->width / wproj;
+}
+
+/// The call `bmm_sdl_draw_inst(sdl, xproj, yproj, wproj, hproj)`
+/// draws every particle of `sdl` and its periodic images
+/// that overlap the projection
+/// with a corner at `xproj` and `yproj`,
+/// a width of `wproj` and a height of `hproj`
+/// with one instanced call.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_sdl_draw_inst(struct bmm_sdl const *const sdl,
+    double const xproj, double const yproj,
+    double const wproj, double const hproj) {
+  size_t const npart = sdl->dem->part.n;
+  if (npart == 0)
+    return true;
+
+  if (npart > (size_t) INT_MAX / 3)
+    return false;
+
+  GLsizeiptr const size =
+    (GLsizeiptr) (3 * npart * sizeof (struct bmm_sdl_vpart));
+
+  // Orphaning the old storage keeps the previous frame from stalling this one.
+  glBindBuffer(GL_ARRAY_BUFFER, sdl->inst.vpart);
+  glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+
+  struct bmm_sdl_vpart *const vpart = glMapBufferRange(GL_ARRAY_BUFFER,
+      0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  if (vpart == NULL) {
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return false;
+  }
+
+  // Only the images that can be seen are handed over.
+  size_t ninst = 0;
+  for (int ioff = -1; ioff < 2; ++ioff) {
+    double const xoff = (double) ioff * sdl->dem->opts.box.x[0];
+
+    for (size_t ipart = 0; ipart < npart; ++ipart) {
+      double const x = sdl->dem->part.x[ipart][0] + xoff;
+      double const y = sdl->dem->part.x[ipart][1];
+      double const r = sdl->dem->part.r[ipart];
+
+      if (!bmm_sdl_seen(xproj, yproj, wproj, hproj, x, y, r))
+        continue;
+
+      vpart[ninst].part[0] = (GLfloat) sdl->dem->part.x[ipart][0];
+      vpart[ninst].part[1] = (GLfloat) y;
+      vpart[ninst].part[2] = (GLfloat) r;
+      vpart[ninst].part[3] = (GLfloat) sdl->dem->part.phi[ipart];
+      vpart[ninst].free =
+        sdl->dem->part.role[ipart] == BMM_DEM_ROLE_FREE ? 1.0f : 0.0f;
+      vpart[ninst].off = (GLfloat) ioff;
+      ++ninst;
+    }
+  }
+
+  if (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE) {
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return false;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  if (ninst == 0)
+    return true;
+
+  glUseProgram(sdl->inst.program);
+
+  glUniform4f(sdl->inst.uview, (GLfloat) xproj, (GLfloat) yproj,
+      (GLfloat) wproj, (GLfloat) hproj);
+  glUniform2f(sdl->inst.ubox, (GLfloat) sdl->dem->opts.box.x[0],
+      (GLfloat) sdl->dem->opts.box.x[1]);
+  glUniform1f(sdl->inst.uskew, sdl->blend ? 1.0f : 0.0f);
+  glUniform3fv(sdl->inst.ucfree, 1, glYellow);
+  glUniform3fv(sdl->inst.ucother, 1, glWhite);
+
+  glBindVertexArray(sdl->inst.varray);
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 2 * (BMM_SDL_NCORNER + 1),
+      (GLsizei) ninst);
+  glBindVertexArray(0);
+
+  glUseProgram(0);
+
+  return true;
+}
+
+/// The call `bmm_sdl_draw_lod(sdl, xproj, yproj, wproj, hproj)`
+/// draws the packing fractions of the particles of `sdl`
+/// in the interior neighbor cells and their periodic images
+/// that overlap the projection
+/// with a corner at `xproj` and `yproj`,
+/// a width of `wproj` and a height of `hproj`.
+__attribute__ ((__nonnull__))
+static void bmm_sdl_draw_lod(struct bmm_sdl const *const sdl,
+    double const xproj, double const yproj,
+    double const wproj, double const hproj) {
+  size_t const ncx = sdl->dem->opts.cache.ncell[0] - 2;
+  size_t const ncy = sdl->dem->opts.cache.ncell[1] - 2;
+
+  double const w = sdl->dem->opts.box.x[0] / (double) ncx;
+  double const h = sdl->dem->opts.box.x[1] / (double) ncy;
+
+  // The tiles are the interior cells of the neighbor cache,
+  // which are also what `bmm_dem_ijcellx` assigns particles to.
+  double chi[BMM_POW(BMM_MCELL, BMM_NDIM)];
+  for (size_t icell = 0; icell < ncx * ncy; ++icell)
+    chi[icell] = 0.0;
+
+  for (size_t ipart = 0; ipart < sdl->dem->part.n; ++ipart) {
+    size_t ijcell[BMM_NDIM];
+    bmm_dem_ijcellx(ijcell, sdl->dem, sdl->dem->part.x[ipart]);
+
+    size_t const icellx = $(bmm_min, size_t)(
+        $(bmm_max, size_t)(ijcell[0], 1) - 1, ncx - 1);
+    size_t const icelly = $(bmm_min, size_t)(
+        $(bmm_max, size_t)(ijcell[1], 1) - 1, ncy - 1);
+
+    double const r = sdl->dem->part.r[ipart];
+    chi[icellx * ncy + icelly] += M_PI * r * r;
+  }
+
+  GLfloat tint[4];
+  (void) memcpy(tint, glWhite, sizeof glWhite);
+
+  for (int ioff = -1; ioff < 2; ++ioff) {
+    double const xoff = (double) ioff * sdl->dem->opts.box.x[0];
+
+    for (size_t icellx = 0; icellx < ncx; ++icellx)
+      for (size_t icelly = 0; icelly < ncy; ++icelly) {
+        double const x = (double) icellx * w + xoff;
+        double const y = (double) icelly * h;
+
+        if (!bmm_sdl_seen(xproj - w, yproj - h, wproj + w, hproj + h,
+              x, y, 0.0))
+          continue;
+
+        tint[3] = (GLfloat) $(bmm_min, double)(
+            chi[icellx * ncy + icelly] / (w * h), 1.0);
+        if (ioff != 0)
+          tint[3] *= 0.5f;
+        glColor4fv(tint);
+
+        glRectd(x, y, x + w, y + h);
+      }
+  }
+}
+
 static void bmm_sdl_draw(struct bmm_sdl const *const sdl) {
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
@@ -271,24 +2048,34 @@ static void bmm_sdl_draw(struct bmm_sdl const *const sdl) {
   glRectf(xproj, yproj, xproj + wproj, yproj + hproj);
   */
 
-  size_t const ncorner = 8;
+  size_t const ncorner = BMM_SDL_NCORNER;
+
+  size_t const ncx = sdl->dem->opts.cache.ncell[0] - 2;
+  size_t const ncy = sdl->dem->opts.cache.ncell[1] - 2;
 
-  size_t const ncx = sdl->dem.opts.cache.ncell[0] - 2;
-  size_t const ncy = sdl->dem.opts.cache.ncell[1] - 2;
+  double const w = sdl->dem->opts.box.x[0] / (double) ncx;
+  double const h = sdl->dem->opts.box.x[1] / (double) ncy;
 
-  double const w = sdl->dem.opts.box.x[0] / (double) ncx;
-  double const h = sdl->dem.opts.box.x[1] / (double) ncy;
+  // Connected components are not drawn at the moment,
+  // so there is no point in building their mappings either.
+  bool const comps = false && sdl->blend;
+  size_t const nind = comps ? sdl->dem->part.n : 0;
 
   // Bidirectional mappings.
   struct {
     size_t n;
     size_t itgt[BMM_MCONTACT];
-  } ind[BMM_MPART];
-  for (size_t ipart = 0; ipart < sdl->dem.part.n; ++ipart)
+  } *const ind = malloc(nind * sizeof *ind);
+  if (ind == NULL && nind != 0) {
+    BMM_TLE_STDS();
+
+    return;
+  }
+  for (size_t ipart = 0; ipart < nind; ++ipart)
     ind[ipart].n = 0;
-  for (size_t ipart = 0; ipart < sdl->dem.part.n; ++ipart)
-    for (size_t icont = 0; icont < sdl->dem.pair[BMM_DEM_CT_STRONG].cont.src[ipart].n; ++icont) {
-      size_t const jpart = sdl->dem.pair[BMM_DEM_CT_STRONG].cont.src[ipart].itgt[icont];
+  for (size_t ipart = 0; ipart < nind; ++ipart)
+    for (size_t icont = 0; icont < sdl->dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].n; ++icont) {
+      size_t const jpart = sdl->dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].itgt[icont];
 
       size_t const jcont = ind[jpart].n;
       ind[jpart].itgt[jcont] = ipart;
@@ -300,50 +2087,66 @@ static void bmm_sdl_draw(struct bmm_sdl const *const sdl) {
       ++ind[ipart].n;
     }
 
-  // Particles.
-  for (double off = -1; off < 2; ++off) {
-    for (size_t ipart = 0; ipart < sdl->dem.part.n; ++ipart) {
-      double const x = sdl->dem.part.x[ipart][0];
-      double const y = sdl->dem.part.x[ipart][1];
-      double const r = sdl->dem.part.r[ipart];
-      double const a = sdl->dem.part.phi[ipart];
+  // Particles that would be smaller than pixels are replaced by tiles.
+  bool const lod = sdl->lod && bmm_sdl_rpix(sdl, wproj) < sdl->opts.lod;
+  if (lod)
+    bmm_sdl_draw_lod(sdl, xproj, yproj, wproj, hproj);
+
+  // Particles are drawn all at once if possible.
+  bool const inst = !lod && sdl->inst.on &&
+    bmm_sdl_draw_inst(sdl, xproj, yproj, wproj, hproj);
 
-      double const xoff = x + off * sdl->dem.opts.box.x[0];
+  // Lines may reach out of particles as far as the cutoff distance.
+  double const dreach = sdl->dem->opts.cache.dcutoff;
+
+  for (double off = -1; off < 2 && !lod; ++off) {
+    for (size_t ipart = 0; ipart < sdl->dem->part.n; ++ipart) {
+      double const x = sdl->dem->part.x[ipart][0];
+      double const y = sdl->dem->part.x[ipart][1];
+      double const r = sdl->dem->part.r[ipart];
+      double const a = sdl->dem->part.phi[ipart];
+
+      double const xoff = x + off * sdl->dem->opts.box.x[0];
+
+      if (!bmm_sdl_seen(xproj, yproj, wproj, hproj, xoff, y, r + dreach))
+        continue;
 
       GLfloat blent[4];
-      memcpy(blent, sdl->dem.part.role[ipart] == BMM_DEM_ROLE_FREE ?
+      memcpy(blent, sdl->dem->part.role[ipart] == BMM_DEM_ROLE_FREE ?
           glYellow : glWhite, sizeof glBlack);
       blent[3] = 1.0f;
       GLfloat nope[4];
       memcpy(nope, blent, sizeof glBlack);
       nope[3] = 0.0f;
-      double t = fabs(xoff / sdl->dem.opts.box.x[0] - 0.5) - 0.5;
+      double t = fabs(xoff / sdl->dem->opts.box.x[0] - 0.5) - 0.5;
       blent[3] = 1.0f - (float) t;
       // Visualize windings.
-      // blent[2] = bmm_fp_lerp(sdl->dem.part.phi[ipart], -M_PI, M_PI, 1.0, 0.0);
+      // blent[2] = bmm_fp_lerp(sdl->dem->part.phi[ipart], -M_PI, M_PI, 1.0, 0.0);
       glColor4fv(blent);
 
-      if (sdl->blend)
-        glSkewedAnnulus((float) xoff, (float) y,
-            (float) r, (float) (r * 0.25), (float) (r * 0.5),
-            (float) a, ncorner);
-      else
-        glDisk((float) xoff, (float) y, (float) r, ncorner);
+      if (!inst) {
+        if (sdl->blend)
+          glSkewedAnnulus((float) xoff, (float) y,
+              (float) r, (float) (r * 0.25), (float) (r * 0.5),
+              (float) a, ncorner);
+        else
+          glDisk((float) xoff, (float) y, (float) r, ncorner);
+      }
 
       // Cached ghosts.
       if (sdl->blend) {
         double x0[BMM_NDIM];
         double x1[BMM_NDIM];
 
-        (void) memcpy(x0, sdl->dem.part.x[ipart], sizeof x0);
-        (void) memcpy(x1, sdl->dem.cache.x[ipart], sizeof x1);
+        (void) memcpy(x0, sdl->dem->part.x[ipart], sizeof x0);
+        (void) memcpy(x1, sdl->dem->cache.x[ipart], sizeof x1);
 
         double dx[BMM_NDIM];
-        dx[0] = x0[0] + $(bmm_swrap, double)(x1[0] - x0[0], sdl->dem.opts.box.x[0]);
+        dx[0] = x0[0] + $(bmm_swrap, double)(x1[0] - x0[0], sdl->dem->opts.box.x[0]);
         dx[1] = x1[1];
 
-        x0[0] += off * sdl->dem.opts.box.x[0];
-        dx[0] += off * sdl->dem.opts.box.x[0];
+        x0[0] += off * sdl->dem->opts.box.x[0];
+        dx[0] += off * sdl->dem->opts.box.x[0];
 
         glBegin(GL_LINES);
         glVertex2dv(x0);
@@ -360,21 +2163,21 @@ static void bmm_sdl_draw(struct bmm_sdl const *const sdl) {
         blent[3] = 1.0f - (float) t;
         glColor4fv(blent);
 
-        for (size_t icont = 0; icont < sdl->dem.pair[BMM_DEM_CT_WEAK].cont.src[ipart].n; ++icont) {
-          size_t const jpart = sdl->dem.pair[BMM_DEM_CT_WEAK].cont.src[ipart].itgt[icont];
+        for (size_t icont = 0; icont < sdl->dem->pair[BMM_DEM_CT_WEAK].cont.src[ipart].n; ++icont) {
+          size_t const jpart = sdl->dem->pair[BMM_DEM_CT_WEAK].cont.src[ipart].itgt[icont];
 
           double x0[BMM_NDIM];
           double x1[BMM_NDIM];
 
-          (void) memcpy(x0, sdl->dem.part.x[ipart], sizeof x0);
-          (void) memcpy(x1, sdl->dem.part.x[jpart], sizeof x1);
+          (void) memcpy(x0, sdl->dem->part.x[ipart], sizeof x0);
+          (void) memcpy(x1, sdl->dem->part.x[jpart], sizeof x1);
 
           double dx[BMM_NDIM];
-          dx[0] = x0[0] + $(bmm_swrap, double)(x1[0] - x0[0], sdl->dem.opts.box.x[0]);
+          dx[0] = x0[0] + $(bmm_swrap, double)(x1[0] - x0[0], sdl->dem->opts.box.x[0]);
           dx[1] = x1[1];
 
-          x0[0] += off * sdl->dem.opts.box.x[0];
-          dx[0] += off * sdl->dem.opts.box.x[0];
+          x0[0] += off * sdl->dem->opts.box.x[0];
+          dx[0] += off * sdl->dem->opts.box.x[0];
 
           glBegin(GL_LINES);
           glVertex2dv(x0);
@@ -389,21 +2192,21 @@ static void bmm_sdl_draw(struct bmm_sdl const *const sdl) {
         blent[3] = 1.0f - (float) t;
         glColor4fv(blent);
 
-        for (size_t icont = 0; icont < sdl->dem.pair[BMM_DEM_CT_STRONG].cont.src[ipart].n; ++icont) {
-          size_t const jpart = sdl->dem.pair[BMM_DEM_CT_STRONG].cont.src[ipart].itgt[icont];
+        for (size_t icont = 0; icont < sdl->dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].n; ++icont) {
+          size_t const jpart = sdl->dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].itgt[icont];
 
           double x0[BMM_NDIM];
           double x1[BMM_NDIM];
 
-          (void) memcpy(x0, sdl->dem.part.x[ipart], sizeof x0);
-          (void) memcpy(x1, sdl->dem.part.x[jpart], sizeof x1);
+          (void) memcpy(x0, sdl->dem->part.x[ipart], sizeof x0);
+          (void) memcpy(x1, sdl->dem->part.x[jpart], sizeof x1);
 
           double dx[BMM_NDIM];
-          dx[0] = x0[0] + $(bmm_swrap, double)(x1[0] - x0[0], sdl->dem.opts.box.x[0]);
+          dx[0] = x0[0] + $(bmm_swrap, double)(x1[0] - x0[0], sdl->dem->opts.box.x[0]);
           dx[1] = x1[1];
 
-          x0[0] += off * sdl->dem.opts.box.x[0];
-          dx[0] += off * sdl->dem.opts.box.x[0];
+          x0[0] += off * sdl->dem->opts.box.x[0];
+          dx[0] += off * sdl->dem->opts.box.x[0];
 
           glBegin(GL_LINES);
           glVertex2dv(x0);
@@ -425,21 +2228,23 @@ static void bmm_sdl_draw(struct bmm_sdl const *const sdl) {
         continue;
 
       glBegin(GL_LINES);
-      for (size_t ineigh = 0; ineigh < sdl->dem.cache.neigh[ipart].n; ++ineigh) {
-        size_t const jpart = sdl->dem.cache.neigh[ipart].i[ineigh];
+      for (size_t ineigh = sdl->dem->cache.neigh[ipart].i;
+          ineigh < sdl->dem->cache.neigh[ipart].i + sdl->dem->cache.neigh[ipart].n;
+          ++ineigh) {
+        size_t const jpart = sdl->dem->cache.ineigh[ineigh];
 
         double x0[BMM_NDIM];
         double x1[BMM_NDIM];
 
-        (void) memcpy(x0, sdl->dem.part.x[ipart], sizeof x0);
-        (void) memcpy(x1, sdl->dem.part.x[jpart], sizeof x1);
+        (void) memcpy(x0, sdl->dem->part.x[ipart], sizeof x0);
+        (void) memcpy(x1, sdl->dem->part.x[jpart], sizeof x1);
 
         double dx[BMM_NDIM];
-        dx[0] = x0[0] + $(bmm_swrap, double)(x1[0] - x0[0], sdl->dem.opts.box.x[0]);
+        dx[0] = x0[0] + $(bmm_swrap, double)(x1[0] - x0[0], sdl->dem->opts.box.x[0]);
         dx[1] = x1[1];
 
-        x0[0] += off * sdl->dem.opts.box.x[0];
-        dx[0] += off * sdl->dem.opts.box.x[0];
+        x0[0] += off * sdl->dem->opts.box.x[0];
+        dx[0] += off * sdl->dem->opts.box.x[0];
 
         glVertex2dv(x0);
         glVertex2dv(dx);
@@ -451,25 +2256,31 @@ static void bmm_sdl_draw(struct bmm_sdl const *const sdl) {
         blent[3] /= 8.0f;
         glColor4fv(blent);
 
-        glDisk(sdl->dem.part.x[ipart][0], sdl->dem.part.x[ipart][1],
-            sdl->dem.opts.cache.dcutoff, ncorner);
+        glDisk(sdl->dem->part.x[ipart][0], sdl->dem->part.x[ipart][1],
+            sdl->dem->opts.cache.dcutoff, ncorner);
       }
     }
 
     // Beams.
     if (!sdl->blend) {
       glBegin(GL_QUADS);
-      for (size_t ipart = 0; ipart < sdl->dem.part.n; ++ipart)
-        for (size_t icont = 0; icont < sdl->dem.pair[BMM_DEM_CT_STRONG].cont.src[ipart].n; ++icont) {
-          size_t const jpart = sdl->dem.pair[BMM_DEM_CT_STRONG].cont.src[ipart].itgt[icont];
+      for (size_t ipart = 0; ipart < sdl->dem->part.n; ++ipart)
+        for (size_t icont = 0; icont < sdl->dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].n; ++icont) {
+          size_t const jpart = sdl->dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].itgt[icont];
+
+          if (!bmm_sdl_seen(xproj, yproj, wproj, hproj,
+                sdl->dem->part.x[ipart][0] + off * sdl->dem->opts.box.x[0],
+                sdl->dem->part.x[ipart][1],
+                sdl->dem->part.r[ipart] + dreach))
+            continue;
 
           double xdiffji[BMM_NDIM];
-          bmm_geom2d_cpdiff(xdiffji, sdl->dem.part.x[ipart], sdl->dem.part.x[jpart],
-              sdl->dem.opts.box.x, sdl->dem.opts.box.per);
+          bmm_geom2d_cpdiff(xdiffji, sdl->dem->part.x[ipart], sdl->dem->part.x[jpart],
+              sdl->dem->opts.box.x, sdl->dem->opts.box.per);
 
           double const d2 = bmm_geom2d_norm2(xdiffji);
-          double const ri = sdl->dem.part.r[ipart];
-          double const rj = sdl->dem.part.r[jpart];
+          double const ri = sdl->dem->part.r[ipart];
+          double const rj = sdl->dem->part.r[jpart];
           double const d = sqrt(d2);
 
           double xnormji[BMM_NDIM];
@@ -487,35 +2298,35 @@ static void bmm_sdl_draw(struct bmm_sdl const *const sdl) {
           bmm_geom2d_scale(x2, xtangji, rj);
           bmm_geom2d_scale(x3, x2, -1.0);
 
-          bmm_geom2d_addto(x0, sdl->dem.part.x[ipart]);
-          bmm_geom2d_addto(x1, sdl->dem.part.x[ipart]);
-          bmm_geom2d_addto(x2, sdl->dem.part.x[jpart]);
-          bmm_geom2d_addto(x3, sdl->dem.part.x[jpart]);
+          bmm_geom2d_addto(x0, sdl->dem->part.x[ipart]);
+          bmm_geom2d_addto(x1, sdl->dem->part.x[ipart]);
+          bmm_geom2d_addto(x2, sdl->dem->part.x[jpart]);
+          bmm_geom2d_addto(x3, sdl->dem->part.x[jpart]);
 
           double dx[BMM_NDIM];
-          dx[0] = x0[0] + $(bmm_swrap, double)(x1[0] - x0[0], sdl->dem.opts.box.x[0]);
+          dx[0] = x0[0] + $(bmm_swrap, double)(x1[0] - x0[0], sdl->dem->opts.box.x[0]);
           dx[1] = x1[1];
 
           double dy[BMM_NDIM];
-          dy[0] = x0[0] + $(bmm_swrap, double)(x2[0] - x0[0], sdl->dem.opts.box.x[0]);
+          dy[0] = x0[0] + $(bmm_swrap, double)(x2[0] - x0[0], sdl->dem->opts.box.x[0]);
           dy[1] = x2[1];
 
           double dz[BMM_NDIM];
-          dz[0] = x0[0] + $(bmm_swrap, double)(x3[0] - x0[0], sdl->dem.opts.box.x[0]);
+          dz[0] = x0[0] + $(bmm_swrap, double)(x3[0] - x0[0], sdl->dem->opts.box.x[0]);
           dz[1] = x3[1];
 
-          x0[0] += off * sdl->dem.opts.box.x[0];
-          dx[0] += off * sdl->dem.opts.box.x[0];
-          dy[0] += off * sdl->dem.opts.box.x[0];
-          dz[0] += off * sdl->dem.opts.box.x[0];
+          x0[0] += off * sdl->dem->opts.box.x[0];
+          dx[0] += off * sdl->dem->opts.box.x[0];
+          dy[0] += off * sdl->dem->opts.box.x[0];
+          dz[0] += off * sdl->dem->opts.box.x[0];
 
           GLfloat blent[4];
-          memcpy(blent, sdl->dem.part.role[ipart] == BMM_DEM_ROLE_FREE ?
+          memcpy(blent, sdl->dem->part.role[ipart] == BMM_DEM_ROLE_FREE ?
               glYellow : glWhite, sizeof glBlack);
           blent[3] = 0.5f;
 
           GLfloat blunt[4];
-          memcpy(blunt, sdl->dem.part.role[jpart] == BMM_DEM_ROLE_FREE ?
+          memcpy(blunt, sdl->dem->part.role[jpart] == BMM_DEM_ROLE_FREE ?
               glYellow : glWhite, sizeof glBlack);
           blunt[3] = 0.5f;
 
@@ -531,9 +2342,9 @@ static void bmm_sdl_draw(struct bmm_sdl const *const sdl) {
     }
 
     // Connected components (three deep).
-    if (false && sdl->blend) {
+    if (comps) {
       glBegin(GL_TRIANGLES);
-      for (size_t ipart = 0; ipart < sdl->dem.part.n; ++ipart)
+      for (size_t ipart = 0; ipart < sdl->dem->part.n; ++ipart)
         for (size_t icont = 0; icont < ind[ipart].n; ++icont) {
           size_t const jpart = ind[ipart].itgt[icont];
 
@@ -544,43 +2355,43 @@ static void bmm_sdl_draw(struct bmm_sdl const *const sdl) {
               size_t const lpart = ind[kpart].itgt[kcont];
 
               if (lpart == ipart &&
-                  sdl->dem.part.x[ipart][0] < sdl->dem.part.x[jpart][0] &&
-                  sdl->dem.part.x[ipart][0] < sdl->dem.part.x[kpart][0]) {
+                  sdl->dem->part.x[ipart][0] < sdl->dem->part.x[jpart][0] &&
+                  sdl->dem->part.x[ipart][0] < sdl->dem->part.x[kpart][0]) {
 
                 double x0[BMM_NDIM];
                 double x1[BMM_NDIM];
                 double x2[BMM_NDIM];
 
-                (void) memcpy(x0, sdl->dem.part.x[ipart], sizeof x0);
-                (void) memcpy(x1, sdl->dem.part.x[jpart], sizeof x1);
-                (void) memcpy(x2, sdl->dem.part.x[kpart], sizeof x2);
+                (void) memcpy(x0, sdl->dem->part.x[ipart], sizeof x0);
+                (void) memcpy(x1, sdl->dem->part.x[jpart], sizeof x1);
+                (void) memcpy(x2, sdl->dem->part.x[kpart], sizeof x2);
 
                 double dx[BMM_NDIM];
-                dx[0] = x0[0] + $(bmm_swrap, double)(x1[0] - x0[0], sdl->dem.opts.box.x[0]);
+                dx[0] = x0[0] + $(bmm_swrap, double)(x1[0] - x0[0], sdl->dem->opts.box.x[0]);
                 dx[1] = x1[1];
 
                 double dy[BMM_NDIM];
-                dy[0] = x0[0] + $(bmm_swrap, double)(x2[0] - x0[0], sdl->dem.opts.box.x[0]);
+                dy[0] = x0[0] + $(bmm_swrap, double)(x2[0] - x0[0], sdl->dem->opts.box.x[0]);
                 dy[1] = x2[1];
 
-                x0[0] += off * sdl->dem.opts.box.x[0];
-                dx[0] += off * sdl->dem.opts.box.x[0];
-                dy[0] += off * sdl->dem.opts.box.x[0];
+                x0[0] += off * sdl->dem->opts.box.x[0];
+                dx[0] += off * sdl->dem->opts.box.x[0];
+                dy[0] += off * sdl->dem->opts.box.x[0];
 
                 {
-                  double const x = sdl->dem.part.x[ipart][0];
-                  double const y = sdl->dem.part.x[ipart][1];
+                  double const x = sdl->dem->part.x[ipart][0];
+                  double const y = sdl->dem->part.x[ipart][1];
 
-                  double const xoff = x + off * sdl->dem.opts.box.x[0];
+                  double const xoff = x + off * sdl->dem->opts.box.x[0];
 
                   GLfloat blent[4];
-                  memcpy(blent, sdl->dem.part.role[ipart] == BMM_DEM_ROLE_FREE ?
+                  memcpy(blent, sdl->dem->part.role[ipart] == BMM_DEM_ROLE_FREE ?
                       glYellow : glWhite, sizeof glBlack);
                   blent[3] = 1.0f;
                   GLfloat nope[4];
                   memcpy(nope, blent, sizeof glBlack);
                   nope[3] = 0.0f;
-                  double t = fabs(xoff / sdl->dem.opts.box.x[0] - 0.5) - 0.5;
+                  double t = fabs(xoff / sdl->dem->opts.box.x[0] - 0.5) - 0.5;
                   blent[3] = 1.0f - (float) t;
                   glColor4fv(blent);
 
@@ -599,9 +2410,9 @@ static void bmm_sdl_draw(struct bmm_sdl const *const sdl) {
   // Staleness indicator.
   if (sdl->diag) {
     glColor3fv(sdl->stale ? glRed : glGreen);
-    glDisk((float) (0.05 * sdl->dem.opts.box.x[0]),
-        (float) (0.05 * sdl->dem.opts.box.x[1]),
-        (float) (0.025 * sdl->dem.opts.box.x[0]), ncorner);
+    glDisk((float) (0.05 * sdl->dem->opts.box.x[0]),
+        (float) (0.05 * sdl->dem->opts.box.x[1]),
+        (float) (0.025 * sdl->dem->opts.box.x[0]), ncorner);
   }
 
   // Cell boxes.
@@ -618,14 +2429,14 @@ static void bmm_sdl_draw(struct bmm_sdl const *const sdl) {
 
   // Bounding box.
   glColor3fv(glWhite);
-  glRectWire(0.0f, 0.0f, (float) sdl->dem.opts.box.x[0], (float) sdl->dem.opts.box.x[1]);
+  glRectWire(0.0f, 0.0f, (float) sdl->dem->opts.box.x[0], (float) sdl->dem->opts.box.x[1]);
 
   // Diagnostic text.
   glMatrixMode(GL_PROJECTION);
   glLoadIdentity();
   glOrtho(0.0, sdl->width, sdl->height, 0.0, -1.0, 1.0);
 
-  struct bmm_dem const *const dem = &sdl->dem;
+  struct bmm_dem const *const dem = sdl->dem;
 
   double const eambdis = dem->est.eambdis;
   double const epotext = dem->est.epotext_d;
@@ -652,13 +2463,13 @@ static void bmm_sdl_draw(struct bmm_sdl const *const sdl) {
         sdl->fps, bmm_sdl_tstep(sdl));
     glString(strbuf, 8, 8 + 15 * ioff++, glWhite, GLUT_BITMAP_9_BY_15);
     (void) snprintf(strbuf, sizeof strbuf, "t (now) = %g (%zu)",
-        sdl->dem.time.t, sdl->dem.time.istep);
+        sdl->dem->time.t, sdl->dem->time.istep);
     glString(strbuf, 8, 8 + 15 * ioff++, glWhite, GLUT_BITMAP_9_BY_15);
     (void) snprintf(strbuf, sizeof strbuf, "t (prev. cache refresh) = %g",
-        sdl->dem.cache.tprev);
+        sdl->dem->cache.tprev);
     glString(strbuf, 8, 8 + 15 * ioff++, glWhite, GLUT_BITMAP_9_BY_15);
     (void) snprintf(strbuf, sizeof strbuf, "n (number of particles) = %zu",
-        sdl->dem.part.n);
+        sdl->dem->part.n);
     glString(strbuf, 8, 8 + 15 * ioff++, glWhite, GLUT_BITMAP_9_BY_15);
     (void) snprintf(strbuf, sizeof strbuf, "W (work in) = %g",
         neg);
@@ -667,26 +2478,33 @@ static void bmm_sdl_draw(struct bmm_sdl const *const sdl) {
         eee);
     glString(strbuf, 8, 8 + 15 * ioff++, glWhite, GLUT_BITMAP_9_BY_15);
     (void) snprintf(strbuf, sizeof strbuf, "chi (pack. frac.) = %g",
-        sdl->dem.est.chi);
+        sdl->dem->est.chi);
     glString(strbuf, 8, 8 + 15 * ioff++, glWhite, GLUT_BITMAP_9_BY_15);
     (void) snprintf(strbuf, sizeof strbuf, "mu (eff. friction factor) = %g, %g",
-        sdl->dem.est.mueff, sdl->dem.est.mueffb);
+        sdl->dem->est.mueff, sdl->dem->est.mueffb);
     glString(strbuf, 8, 8 + 15 * ioff++, glWhite, GLUT_BITMAP_9_BY_15);
     (void) snprintf(strbuf, sizeof strbuf, "F (force feedback) = (%g, %g)",
-        sdl->dem.est.fback[0], sdl->dem.est.fback[1]);
+        sdl->dem->est.fback[0], sdl->dem->est.fback[1]);
     glString(strbuf, 8, 8 + 15 * ioff++, glWhite, GLUT_BITMAP_9_BY_15);
     (void) snprintf(strbuf, sizeof strbuf, "v (driving velocity) = (%g, %g)",
-        sdl->dem.est.vdriv[0], sdl->dem.est.vdriv[1]);
+        sdl->dem->est.vdriv[0], sdl->dem->est.vdriv[1]);
     glString(strbuf, 8, 8 + 15 * ioff++, glWhite, GLUT_BITMAP_9_BY_15);
+    if (sdl->dem == &sdl->hist.view) {
+      (void) snprintf(strbuf, sizeof strbuf, "h (history frame) = %zu / %zu",
+          sdl->hist.iview + 1, sdl->hist.nview);
+      glString(strbuf, 8, 8 + 15 * ioff++, glWhite, GLUT_BITMAP_9_BY_15);
+    }
   }
 
-  SDL_GL_SwapWindow(window);
+  free(ind);
 }
 
 static bool bmm_sdl_video(struct bmm_sdl *const sdl,
     int const width, int const height) {
   if (window == NULL) {
-    Uint32 const flags = SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE;
+    // Videos are drawn offscreen, so their window is never shown.
+    Uint32 const flags = SDL_WINDOW_OPENGL | (sdl->opts.video == NULL ?
+        SDL_WINDOW_RESIZABLE : SDL_WINDOW_HIDDEN);
     window = SDL_CreateWindow("BMM",
         SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
         width, height, flags);
@@ -697,8 +2515,15 @@ static bool bmm_sdl_video(struct bmm_sdl *const sdl,
     }
   }
 
+  // The resources of the renderer go away with the old context.
+  bmm_sdl_inst_free(sdl);
+
   glcontext = SDL_GL_CreateContext(window);
 
+  // Drawing falls back to immediate mode
+  // if the instanced renderer is not available.
+  (void) bmm_sdl_inst_def(sdl);
+
   if (sdl->blend)
     glEnable(GL_BLEND);
   // glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -727,12 +2552,12 @@ static bool heresy(struct bmm_sdl const *const sdl) {
     return false;
   }
 
-  for (size_t ipart = 0; ipart < sdl->dem.part.n; ++ipart)
+  for (size_t ipart = 0; ipart < sdl->dem->part.n; ++ipart)
     if (fprintf(stream, "%zu %g %g %g\n",
           ipart,
-          sdl->dem.part.x[ipart][0],
-          sdl->dem.part.x[ipart][1],
-          sdl->dem.part.r[ipart]) < 0) {
+          sdl->dem->part.x[ipart][0],
+          sdl->dem->part.x[ipart][1],
+          sdl->dem->part.r[ipart]) < 0) {
       BMM_TLE_STDS();
 
       break;
@@ -755,14 +2580,14 @@ static bool more_heresy(struct bmm_sdl const *const sdl) {
     return false;
   }
 
-  for (size_t ipart = 0; ipart < sdl->dem.part.n; ++ipart) {
-    for (size_t icont = 0; icont < sdl->dem.pair[BMM_DEM_CT_STRONG].cont.src[ipart].n; ++icont) {
-      size_t const jpart = sdl->dem.pair[BMM_DEM_CT_STRONG].cont.src[ipart].itgt[icont];
+  for (size_t ipart = 0; ipart < sdl->dem->part.n; ++ipart) {
+    for (size_t icont = 0; icont < sdl->dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].n; ++icont) {
+      size_t const jpart = sdl->dem->pair[BMM_DEM_CT_STRONG].cont.src[ipart].itgt[icont];
 
       if (fprintf(stream, "%zu %g %g\n",
             (size_t) 0,
-            sdl->dem.part.x[ipart][0],
-            sdl->dem.part.x[ipart][1]) < 0) {
+            sdl->dem->part.x[ipart][0],
+            sdl->dem->part.x[ipart][1]) < 0) {
         BMM_TLE_STDS();
 
         break; // out
@@ -770,8 +2595,8 @@ static bool more_heresy(struct bmm_sdl const *const sdl) {
 
       if (fprintf(stream, "%zu %g %g\n",
             (size_t) 1,
-            sdl->dem.part.x[jpart][0],
-            sdl->dem.part.x[jpart][1]) < 0) {
+            sdl->dem->part.x[jpart][0],
+            sdl->dem->part.x[jpart][1]) < 0) {
         BMM_TLE_STDS();
 
         break; // out
@@ -804,17 +2629,17 @@ static bool serious_heresy(struct bmm_sdl const *const sdl) {
     return false;
   }
 
-  if (fprintf(stream, "%zu\n.\n", sdl->dem.part.n) < 0) {
+  if (fprintf(stream, "%zu\n.\n", sdl->dem->part.n) < 0) {
     BMM_TLE_STDS();
 
     return false;
   }
 
-  for (size_t ipart = 0; ipart < sdl->dem.part.n; ++ipart)
+  for (size_t ipart = 0; ipart < sdl->dem->part.n; ++ipart)
     if (fprintf(stream, "S %g %g 0.0 %g\n",
-          sdl->dem.part.x[ipart][0],
-          sdl->dem.part.x[ipart][1],
-          sdl->dem.part.r[ipart]) < 0) {
+          sdl->dem->part.x[ipart][0],
+          sdl->dem->part.x[ipart][1],
+          sdl->dem->part.r[ipart]) < 0) {
       BMM_TLE_STDS();
 
       break;
@@ -906,7 +2731,7 @@ static bool bmm_sdl_work(struct bmm_sdl *const sdl) {
               sdl->itarget = 0;
               break;
             case SDLK_3:
-              sdl->itarget = (size_t) rand() % sdl->dem.part.n;
+              sdl->itarget = (size_t) rand() % sdl->dem->part.n;
               break;
             case SDLK_b:
               sdl->blend = !sdl->blend;
@@ -918,6 +2743,25 @@ static bool bmm_sdl_work(struct bmm_sdl *const sdl) {
             case SDLK_d:
               sdl->diag = !sdl->diag;
               break;
+            case SDLK_l:
+              sdl->lod = !sdl->lod;
+              break;
+            case SDLK_HOME:
+              if (!bmm_sdl_hist_seek(sdl, BMM_SDL_SEEK_FIRST))
+                return false;
+              break;
+            case SDLK_COMMA:
+              if (!bmm_sdl_hist_seek(sdl, BMM_SDL_SEEK_PREV))
+                return false;
+              break;
+            case SDLK_PERIOD:
+              if (!bmm_sdl_hist_seek(sdl, BMM_SDL_SEEK_NEXT))
+                return false;
+              break;
+            case SDLK_END:
+              if (!bmm_sdl_hist_seek(sdl, BMM_SDL_SEEK_LAST))
+                return false;
+              break;
           }
           break;
         case SDL_MOUSEBUTTONDOWN:
@@ -950,44 +2794,15 @@ static bool bmm_sdl_work(struct bmm_sdl *const sdl) {
     // Draw before state transformations to account for the initial state.
     bmm_sdl_draw(sdl);
 
-    // Recompute the remaining time after event handling and drawing
-    // in case they take a while to complete.
-    tnow = SDL_GetTicks();
-    trem = bmm_sdl_trem(tnow, tnext);
-
-    // TODO Think about a better way to express this thing.
-    // TODO Currently this does staleness analysis wrong.
-
-    if (sdl->active) {
-      // Use the remaining time to wait for input.
-      // If there is no time left,
-      // try to read just one message to prevent congestion.
-      struct timeval timeout;
-again:
-      bmm_sdl_t_to_timeval(&timeout, trem);
-      enum bmm_msg_num num;
-      switch (bmm_io_waitin(&timeout)) {
-        case BMM_IO_WAIT_ERROR:
-          return false;
-        case BMM_IO_WAIT_READY:
-          (void) bmm_dem_gets(&sdl->dem, &num);
-
-          if (num == BMM_MSG_NUM_PARTS)
-            sdl->stale = false;
-          else {
-            trem = bmm_sdl_t_from_timeval(&timeout);
-            if (trem > 0)
-              goto again;
-          }
+    SDL_GL_SwapWindow(window);
 
-          break;
-        case BMM_IO_WAIT_TIMEOUT:
-          sdl->stale = true;
-      }
-    }
+    // The reader thread fills the buffers on its own,
+    // so the newest complete frame is swapped in for the next tick.
+    if (sdl->active)
+      sdl->stale = !bmm_sdl_read_take(sdl);
 
-    // Recompute the remaining time again after waiting for input
-    // in case it arrives early or takes a while to process.
+    // Recompute the remaining time after event handling and drawing
+    // in case they take a while to complete.
     tnow = SDL_GetTicks();
     trem = bmm_sdl_trem(tnow, tnext);
 
@@ -1010,6 +2825,198 @@ again:
   }
 }
 
+/// The call `bmm_sdl_rec_free(sdl)`
+/// releases the offscreen framebuffers of the headless recorder of `sdl`.
+__attribute__ ((__nonnull__))
+static void bmm_sdl_rec_free(struct bmm_sdl *const sdl) {
+  free(sdl->rec.pixels);
+
+  if (sdl->rec.fread != 0)
+    glDeleteFramebuffers(1, &sdl->rec.fread);
+
+  if (sdl->rec.fdraw != 0)
+    glDeleteFramebuffers(1, &sdl->rec.fdraw);
+
+  if (sdl->rec.rread != 0)
+    glDeleteRenderbuffers(1, &sdl->rec.rread);
+
+  if (sdl->rec.rdepth != 0)
+    glDeleteRenderbuffers(1, &sdl->rec.rdepth);
+
+  if (sdl->rec.rcolor != 0)
+    glDeleteRenderbuffers(1, &sdl->rec.rcolor);
+
+  sdl->rec.fdraw = 0;
+  sdl->rec.fread = 0;
+  sdl->rec.rcolor = 0;
+  sdl->rec.rdepth = 0;
+  sdl->rec.rread = 0;
+  sdl->rec.pixels = NULL;
+}
+
+/// The call `bmm_sdl_rec_def(sdl)`
+/// sets up the offscreen framebuffers of the headless recorder of `sdl`
+/// for the current context and binds them for drawing.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_sdl_rec_def(struct bmm_sdl *const sdl) {
+  if (!GLEW_VERSION_3_0) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_GL, "Failed to initialize OpenGL 3.0");
+
+    return false;
+  }
+
+  size_t const npixel = (size_t) sdl->width * (size_t) sdl->height;
+  sdl->rec.pixels = malloc(npixel * 3);
+  if (sdl->rec.pixels == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  // Drawing happens with the same multisampling as the window would have,
+  // so the samples are resolved into another framebuffer before reading.
+  GLsizei const nsample = (GLsizei) sdl->opts.ms;
+
+  glGenRenderbuffers(1, &sdl->rec.rcolor);
+  glBindRenderbuffer(GL_RENDERBUFFER, sdl->rec.rcolor);
+  glRenderbufferStorageMultisample(GL_RENDERBUFFER, nsample,
+      GL_RGBA8, sdl->width, sdl->height);
+
+  glGenRenderbuffers(1, &sdl->rec.rdepth);
+  glBindRenderbuffer(GL_RENDERBUFFER, sdl->rec.rdepth);
+  glRenderbufferStorageMultisample(GL_RENDERBUFFER, nsample,
+      GL_DEPTH_COMPONENT24, sdl->width, sdl->height);
+
+  glGenRenderbuffers(1, &sdl->rec.rread);
+  glBindRenderbuffer(GL_RENDERBUFFER, sdl->rec.rread);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, sdl->width, sdl->height);
+
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, &sdl->rec.fread);
+  glBindFramebuffer(GL_FRAMEBUFFER, sdl->rec.fread);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+      GL_RENDERBUFFER, sdl->rec.rread);
+  GLenum const sread = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+  glGenFramebuffers(1, &sdl->rec.fdraw);
+  glBindFramebuffer(GL_FRAMEBUFFER, sdl->rec.fdraw);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+      GL_RENDERBUFFER, sdl->rec.rcolor);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+      GL_RENDERBUFFER, sdl->rec.rdepth);
+  GLenum const sdraw = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+  if (sread != GL_FRAMEBUFFER_COMPLETE || sdraw != GL_FRAMEBUFFER_COMPLETE) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_GL, "Failed to set up offscreen framebuffer");
+
+    return false;
+  }
+
+  return true;
+}
+
+/// The call `bmm_sdl_rec_put(sdl)`
+/// writes the frame that was just drawn by the headless recorder of `sdl`
+/// as raw 8-bit RGB from top to bottom.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_sdl_rec_put(struct bmm_sdl *const sdl) {
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, sdl->rec.fdraw);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sdl->rec.fread);
+  glBlitFramebuffer(0, 0, sdl->width, sdl->height,
+      0, 0, sdl->width, sdl->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, sdl->rec.fread);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, sdl->width, sdl->height,
+      GL_RGB, GL_UNSIGNED_BYTE, sdl->rec.pixels);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, sdl->rec.fdraw);
+
+  // OpenGL counts rows from the bottom, but encoders expect the opposite.
+  size_t const nrow = (size_t) sdl->height;
+  size_t const ncol = (size_t) sdl->width * 3;
+  for (size_t irow = nrow; irow-- > 0; )
+    if (fwrite(&sdl->rec.pixels[irow * ncol], 1, ncol,
+          sdl->rec.stream) != ncol) {
+      BMM_TLE_STDS();
+
+      return false;
+    }
+
+  return true;
+}
+
+/// The call `bmm_sdl_rec(sdl)`
+/// draws every frame the reader of the viewer `sdl` hands over
+/// into the video `sdl->opts.video` without showing them,
+/// until the input runs out or the process is told to quit.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_sdl_rec(struct bmm_sdl *const sdl) {
+  if (!bmm_sdl_video(sdl, sdl->width, sdl->height))
+    return false;
+
+  sdl->rec.stream = fopen(sdl->opts.video, "wb");
+  if (sdl->rec.stream == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  bool result = bmm_sdl_rec_def(sdl);
+
+  if (result) {
+    // This matches the view the interactive mode settles into.
+    bmm_sdl_zoom(sdl,
+        (double) sdl->width * 0.5, (double) sdl->height * 0.5,
+        1.0 / sdl->opts.zoomfac);
+
+    for ever {
+      // Interrupts arrive as events even without a visible window.
+      bool quit = false;
+      SDL_Event event;
+      while (SDL_PollEvent(&event))
+        if (event.type == SDL_QUIT)
+          quit = true;
+
+      if (quit || !bmm_sdl_read_wait(sdl))
+        break;
+
+      sdl->stale = false;
+
+      if (sdl->rec.iframe % sdl->opts.every == 0) {
+        bmm_sdl_draw(sdl);
+
+        if (!bmm_sdl_rec_put(sdl)) {
+          result = false;
+
+          break;
+        }
+      }
+
+      ++sdl->rec.iframe;
+    }
+  }
+
+  bmm_sdl_rec_free(sdl);
+
+  if (fclose(sdl->rec.stream) != 0) {
+    BMM_TLE_STDS();
+
+    result = false;
+  }
+
+  sdl->rec.stream = NULL;
+
+  return result;
+}
+
 bool bmm_sdl_run(struct bmm_sdl *const sdl) {
   if (SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 8) == -1 ||
       SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8) == -1 ||
@@ -1037,10 +3044,17 @@ bool bmm_sdl_run(struct bmm_sdl *const sdl) {
   char *argv[] = {arg};
   glutInit(&argc, argv);
 
-  if (!bmm_sdl_work(sdl))
+  if (!bmm_sdl_read_start(sdl))
     return false;
 
-  return true;
+  bool const result = sdl->opts.video == NULL ?
+    bmm_sdl_work(sdl) : bmm_sdl_rec(sdl);
+
+  bmm_sdl_read_stop(sdl);
+
+  bmm_sdl_inst_free(sdl);
+
+  return result;
 }
 
 static bool bmm_sdl_run_sdl(struct bmm_sdl_opts const *const opts) {
@@ -1051,14 +3065,59 @@ static bool bmm_sdl_run_sdl(struct bmm_sdl_opts const *const opts) {
     return false;
   }
 
-  bmm_sdl_def(sdl, opts);
-  bool const result = bmm_sdl_run(sdl);
+  bool const result = bmm_sdl_def(sdl, opts) && bmm_sdl_run(sdl);
+
+  bmm_sdl_free(sdl);
 
   free(sdl);
 
   return result;
 }
 
+static bool bmm_sdl_run_map(struct bmm_sdl_opts const *const opts) {
+  struct bmm_map map;
+  if (!bmm_map_open(&map, STDIN_FILENO))
+    return false;
+
+  if (map.ptr == NULL)
+    return bmm_sdl_run_sdl(opts);
+
+  msgmap = &map;
+
+  bool result = bmm_sdl_run_sdl(opts);
+
+  msgmap = NULL;
+
+  if (!bmm_map_close(&map))
+    result = false;
+
+  return result;
+}
+
+static bool bmm_sdl_run_store(struct bmm_sdl_opts const *const opts) {
+  if (opts->store == NULL)
+    return bmm_sdl_run_map(opts);
+
+  struct bmm_store_reader store;
+  if (!bmm_store_open(&store, opts->store))
+    return false;
+
+  bool result = opts->frame == 0 || bmm_store_seek(&store, opts->frame);
+
+  if (result) {
+    msgstore = &store;
+
+    result = bmm_sdl_run_sdl(opts);
+
+    msgstore = NULL;
+  }
+
+  if (!bmm_store_close(&store))
+    result = false;
+
+  return result;
+}
+
 bool bmm_sdl_run_with(struct bmm_sdl_opts const *const opts) {
   if (SDL_Init(SDL_INIT_VIDEO) == -1) {
     BMM_TLE_EXTS(BMM_TLE_NUM_SDL, "SDL error: %s", SDL_GetError());
@@ -1066,7 +3125,12 @@ bool bmm_sdl_run_with(struct bmm_sdl_opts const *const opts) {
     return false;
   }
 
-  bool const result = bmm_sdl_run_sdl(opts);
+  bool const result = bmm_sdl_run_store(opts);
+
+  bmm_zip_free(&msgzip);
+  bmm_zip_def(&msgzip);
+  bmm_lit_free(&msglit);
+  bmm_lit_def(&msglit);
 
   SDL_Quit();
 
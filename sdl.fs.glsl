@@ -0,0 +1,8 @@
+#version 330 core
+
+in vec4 fColor;
+out vec4 color;
+
+void main(void) {
+  color = fColor;
+}
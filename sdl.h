@@ -3,14 +3,19 @@
 #ifndef BMM_SDL_H
 #define BMM_SDL_H
 
+#include <GL/glew.h>
+
 #include <SDL2/SDL.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <sys/time.h>
 
 #include "dem.h"
 #include "ext.h"
+#include "zip.h"
 
 /// The call `bmm_sdl_t_to_timeval(tp, t)`
 /// sets the time structure `tp` to approximately `t` ticks.
@@ -46,6 +51,169 @@ struct bmm_sdl_opts {
   unsigned int fps;
   unsigned int ms;
   double zoomfac;
+  char const *store;
+  size_t frame;
+  char const *vpath;
+  char const *fpath;
+  /// Average particle radius in pixels
+  /// below which coarse tiles are drawn instead of particles.
+  double lod;
+  /// Path to write raw frames into without opening a window
+  /// or `NULL` to view them interactively.
+  char const *video;
+  /// Number of frames to take for every frame written.
+  size_t every;
+  /// Number of mebibytes of compressed frames to keep
+  /// for scrubbing back and forth or zero to keep none.
+  size_t hist;
+};
+
+/// This structure tracks the resources of the instanced renderer.
+struct bmm_sdl_inst {
+  /// Whether the renderer is available.
+  bool on;
+  GLuint vshader;
+  GLuint fshader;
+  GLuint program;
+  GLuint varray;
+  /// Buffer of corners shared by every particle.
+  GLuint vcorner;
+  /// Buffer of particle attributes refilled for every frame.
+  GLuint vpart;
+  GLint uview;
+  GLint ubox;
+  GLint uskew;
+  GLint ucfree;
+  GLint ucother;
+};
+
+/// This structure tracks the reader thread and its triple buffer.
+struct bmm_sdl_read {
+  /// Reader thread.
+  pthread_t thread;
+  /// Lock for everything below.
+  pthread_mutex_t mutex;
+  /// Signal for the reader that the renderer took the newest frame.
+  pthread_cond_t ctaken;
+  /// Signal for the renderer that a new frame is ready
+  /// or the reader has stopped.
+  pthread_cond_t cready;
+  /// Whether frames may be dropped when the renderer falls behind.
+  /// Pipes drop frames, so that the producer never waits,
+  /// while containers and regular files do not,
+  /// so that they play back one frame at a time.
+  bool lossy;
+  /// Whether the reader should stop.
+  bool quit;
+  /// Whether the reader has stopped.
+  bool done;
+  /// Whether the middle buffer holds a frame the renderer has not taken.
+  bool fresh;
+  /// Whether progress reports arrived that the renderer has not taken.
+  /// These are shown as soon as they arrive in lossy mode,
+  /// even if the frame they came with is late or never completes.
+  bool live;
+  /// Estimators of the newest progress report.
+  __typeof__ (((struct bmm_dem *) NULL)->est) est;
+  /// Profiling data of the newest progress report.
+  __typeof__ (((struct bmm_dem *) NULL)->prof) prof;
+  /// Index of the buffer being filled by the reader.
+  size_t iback;
+  /// Index of the newest complete frame.
+  size_t imid;
+  /// Index of the buffer being drawn by the renderer.
+  size_t ifront;
+  /// Simulation the messages are parsed into.
+  struct bmm_dem parse;
+  /// Snapshots of complete frames.
+  struct bmm_dem buf[3];
+};
+
+/// Maximal number of particle columns the viewer draws.
+#define BMM_SDL_MCOL (15 + BMM_NCT)
+
+/// This structure describes one particle column of a simulation.
+struct bmm_sdl_col {
+  /// Address of the first particle.
+  void *ptr;
+  /// Number of bytes per particle.
+  size_t size;
+};
+
+/// Frames to seek in the history.
+enum bmm_sdl_seek {
+  /// The oldest frame.
+  BMM_SDL_SEEK_FIRST,
+  /// The frame before the one being drawn.
+  BMM_SDL_SEEK_PREV,
+  /// The frame after the one being drawn.
+  BMM_SDL_SEEK_NEXT,
+  /// The newest frame.
+  BMM_SDL_SEEK_LAST
+};
+
+/// This structure holds one compressed frame of the history.
+struct bmm_sdl_frame {
+  /// Step the frame was taken on.
+  size_t istep;
+  /// Number of uncompressed bytes.
+  size_t nraw;
+  /// Number of compressed bytes.
+  size_t n;
+  /// Compressed bytes.
+  unsigned char *buf;
+};
+
+/// This structure tracks the ring of compressed frames
+/// that can be scrubbed back and forth while paused.
+/// The reader thread adds every complete frame it reads and
+/// throws away the oldest ones once they would take too much memory.
+/// The ring itself is guarded by the lock of the reader thread.
+struct bmm_sdl_hist {
+  /// Number of bytes the compressed frames may take.
+  size_t nmax;
+  /// Number of bytes the compressed frames take.
+  size_t nbyte;
+  /// Number of frames.
+  size_t n;
+  /// Number of frames there is room for.
+  size_t ncap;
+  /// Index of the oldest frame.
+  size_t ifirst;
+  /// Frames from the oldest to the newest, wrapping around.
+  struct bmm_sdl_frame *frame;
+  /// Scratch space of the reader thread for packing frames.
+  struct bmm_zip pack;
+  /// Scratch space of the renderer for unpacking frames.
+  struct bmm_zip unpack;
+  /// Copy of the compressed bytes of the frame being unpacked,
+  /// so that the reader thread may throw it away in the meantime.
+  unsigned char *buf;
+  /// Number of bytes there is room for in `buf`.
+  size_t ncapbuf;
+  /// Position of the frame being viewed from the oldest one.
+  size_t iview;
+  /// Number of frames when the frame being viewed was unpacked.
+  size_t nview;
+  /// Simulation the frame being viewed is unpacked into.
+  struct bmm_dem view;
+};
+
+/// This structure tracks the resources of the headless recorder.
+struct bmm_sdl_rec {
+  /// Stream raw frames are written into.
+  FILE *stream;
+  /// Framebuffer that is drawn into, possibly with multisampling.
+  GLuint fdraw;
+  /// Framebuffer that multisamples are resolved into for reading.
+  GLuint fread;
+  GLuint rcolor;
+  GLuint rdepth;
+  GLuint rread;
+  /// Pixels of the frame being written.
+  unsigned char *pixels;
+  /// Number of frames taken from the reader.
+  size_t iframe;
 };
 
 struct bmm_sdl {
@@ -60,15 +228,24 @@ struct bmm_sdl {
   bool active;
   bool blend;
   bool diag;
+  bool lod;
   size_t itarget;
-  struct bmm_dem dem;
+  struct bmm_sdl_inst inst;
+  struct bmm_sdl_read read;
+  struct bmm_sdl_rec rec;
+  struct bmm_sdl_hist hist;
+  /// Snapshot being drawn.
+  struct bmm_dem *dem;
 };
 
 __attribute__ ((__nonnull__))
 void bmm_sdl_opts_def(struct bmm_sdl_opts *);
 
 __attribute__ ((__nonnull__))
-void bmm_sdl_def(struct bmm_sdl *, struct bmm_sdl_opts const *);
+bool bmm_sdl_def(struct bmm_sdl *, struct bmm_sdl_opts const *);
+
+__attribute__ ((__nonnull__))
+void bmm_sdl_free(struct bmm_sdl *);
 
 __attribute__ ((__nonnull__))
 bool bmm_sdl_run(struct bmm_sdl *);
@@ -0,0 +1,28 @@
+#version 330 core
+
+layout (location = 0) in vec3 corner;
+layout (location = 1) in vec4 part;
+layout (location = 2) in float free;
+layout (location = 3) in float off;
+
+out vec4 fColor;
+
+uniform vec4 view;
+uniform vec2 box;
+uniform float skew;
+uniform vec3 cfree;
+uniform vec3 cother;
+
+void main(void) {
+  vec2 x = part.xy + vec2(off * box.x, 0.0f);
+  float r = part.z;
+
+  vec2 hole = skew * r *
+    (0.5f * vec2(cos(part.w), sin(part.w)) + 0.25f * corner.xy);
+  vec2 y = x + mix(hole, r * corner.xy, corner.z);
+
+  gl_Position = vec4(2.0f * (y - view.xy) / view.zw - 1.0f, 0.0f, 1.0f);
+
+  float t = abs(x.x / box.x - 0.5f) - 0.5f;
+  fColor = vec4(free != 0.0f ? cfree : cother, 1.0f - t);
+}
@@ -0,0 +1,125 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "conf.h"
+#include "ext.h"
+#include "fp.h"
+#include "sketch.h"
+
+extern inline void bmm_sketch_add(struct bmm_sketch *, double, double);
+
+void bmm_sketch_def(struct bmm_sketch *const sketch) {
+  sketch->n = 0;
+  sketch->w = 0.0;
+  sketch->min = (double) INFINITY;
+  sketch->max = (double) -INFINITY;
+}
+
+/// The call `bmm_sketch_cmp(ptr, qtr)`
+/// orders the centroids `ptr` and `qtr` by their means
+/// and breaks ties by their weights,
+/// so that sorting gives the same result regardless of the initial order.
+__attribute__ ((__nonnull__, __pure__))
+static int bmm_sketch_cmp(void const *const ptr, void const *const qtr) {
+  struct bmm_sketch_cent const *const p = ptr;
+  struct bmm_sketch_cent const *const q = qtr;
+
+  if (p->x != q->x)
+    return p->x < q->x ? -1 : 1;
+
+  if (p->w != q->w)
+    return p->w < q->w ? -1 : 1;
+
+  return 0;
+}
+
+/// The call `bmm_sketch_qlim(q)`
+/// returns the quantile one unit past `q` in the arcsine scale
+/// $k(q) = (\delta / 2 \pi) \arcsin(2 q - 1)$,
+/// where $\delta$ is `BMM_CSKETCH`.
+__attribute__ ((__const__))
+static double bmm_sketch_qlim(double const q) {
+  double const k = (BMM_CSKETCH / M_2PI) * asin(2.0 * q - 1.0) + 1.0;
+
+  return k >= BMM_CSKETCH / 4.0 ? 1.0 :
+    (sin(k * (M_2PI / BMM_CSKETCH)) + 1.0) / 2.0;
+}
+
+void bmm_sketch_compress(struct bmm_sketch *const sketch) {
+  if (sketch->n == 0)
+    return;
+
+  qsort(sketch->cent, sketch->n, sizeof *sketch->cent, bmm_sketch_cmp);
+
+  double const w = sketch->w;
+
+  // The merged centroids overwrite the sorted ones as they go,
+  // because they can never get ahead of them.
+  size_t m = 0;
+  double wprev = 0.0;
+  double qlim = bmm_sketch_qlim(0.0);
+
+  for (size_t icent = 1; icent < sketch->n; ++icent) {
+    struct bmm_sketch_cent *const cent = &sketch->cent[m];
+    struct bmm_sketch_cent const next = sketch->cent[icent];
+
+    if ((wprev + cent->w + next.w) / w <= qlim) {
+      cent->w += next.w;
+      cent->x += (next.x - cent->x) * (next.w / cent->w);
+    } else {
+      wprev += cent->w;
+      qlim = bmm_sketch_qlim(wprev / w);
+
+      ++m;
+      sketch->cent[m] = next;
+    }
+  }
+
+  sketch->n = m + 1;
+}
+
+void bmm_sketch_merge(struct bmm_sketch *const sketch,
+    struct bmm_sketch const *const other) {
+  for (size_t icent = 0; icent < other->n; ++icent)
+    bmm_sketch_add(sketch, other->cent[icent].x, other->cent[icent].w);
+
+  // The extremes of the other sketch may have been merged away.
+  sketch->min = fmin(sketch->min, other->min);
+  sketch->max = fmax(sketch->max, other->max);
+}
+
+double bmm_sketch_quant(struct bmm_sketch *const sketch, double const q) {
+  if (sketch->n == 0)
+    return (double) NAN;
+
+  bmm_sketch_compress(sketch);
+
+  // Each centroid stands at the middle of its weight,
+  // while the extremes stand at the ends of the whole weight.
+  double const t = q * sketch->w;
+
+  double wprev = sketch->cent[0].w / 2.0;
+  if (t <= wprev)
+    return wprev == 0.0 ? sketch->min :
+      sketch->min + (sketch->cent[0].x - sketch->min) * (t / wprev);
+
+  for (size_t icent = 1; icent < sketch->n; ++icent) {
+    double const wnext = wprev +
+      (sketch->cent[icent - 1].w + sketch->cent[icent].w) / 2.0;
+
+    if (t <= wnext)
+      return sketch->cent[icent - 1].x +
+        (sketch->cent[icent].x - sketch->cent[icent - 1].x) *
+        ((t - wprev) / (wnext - wprev));
+
+    wprev = wnext;
+  }
+
+  double const wlast = sketch->w - wprev;
+
+  return wlast == 0.0 ? sketch->max :
+    sketch->cent[sketch->n - 1].x +
+    (sketch->max - sketch->cent[sketch->n - 1].x) * ((t - wprev) / wlast);
+}
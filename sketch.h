@@ -0,0 +1,84 @@
+/// Streaming quantile sketches.
+///
+/// Each sketch is a merging t-digest:
+/// samples are collected as centroids of unit weight
+/// and, once there is no more room, sorted and merged with their neighbors
+/// as long as the merged centroids stay small in the arcsine scale,
+/// which keeps the centroids near the tails small and thus accurate.
+/// Sketches take constant memory and
+/// can be merged with each other in any grouping,
+/// so that each thread can fill its own and they can be combined later.
+
+#ifndef BMM_SKETCH_H
+#define BMM_SKETCH_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "conf.h"
+
+/// Centroids.
+struct bmm_sketch_cent {
+  /// Mean.
+  double x;
+  /// Weight.
+  double w;
+};
+
+/// Sketch state.
+struct bmm_sketch {
+  /// Number of centroids.
+  size_t n;
+  /// Total weight.
+  double w;
+  /// Smallest sample.
+  double min;
+  /// Largest sample.
+  double max;
+  /// Centroids.
+  struct bmm_sketch_cent cent[BMM_MSKETCH];
+};
+
+/// The call `bmm_sketch_def(sketch)`
+/// empties the sketch `sketch`.
+__attribute__ ((__nonnull__))
+void bmm_sketch_def(struct bmm_sketch *);
+
+/// The call `bmm_sketch_compress(sketch)`
+/// sorts and merges the centroids of `sketch`,
+/// leaving room for new ones.
+__attribute__ ((__nonnull__))
+void bmm_sketch_compress(struct bmm_sketch *);
+
+/// The call `bmm_sketch_add(sketch, x, w)`
+/// adds the sample `x` with the weight `w` to the sketch `sketch`.
+__attribute__ ((__nonnull__))
+inline void bmm_sketch_add(struct bmm_sketch *const sketch,
+    double const x, double const w) {
+  if (sketch->n == BMM_MSKETCH)
+    bmm_sketch_compress(sketch);
+
+  sketch->cent[sketch->n].x = x;
+  sketch->cent[sketch->n].w = w;
+  ++sketch->n;
+
+  sketch->w += w;
+  sketch->min = fmin(sketch->min, x);
+  sketch->max = fmax(sketch->max, x);
+}
+
+/// The call `bmm_sketch_merge(sketch, other)`
+/// adds every sample of the sketch `other` to the sketch `sketch`.
+__attribute__ ((__nonnull__))
+void bmm_sketch_merge(struct bmm_sketch *, struct bmm_sketch const *);
+
+/// The call `bmm_sketch_quant(sketch, q)`
+/// estimates the quantile `q` of the samples in the sketch `sketch`
+/// by interpolating linearly between the centroids.
+/// If the sketch is empty, `NAN` is returned.
+/// The sketch is compressed along the way.
+__attribute__ ((__nonnull__))
+double bmm_sketch_quant(struct bmm_sketch *, double);
+
+#endif
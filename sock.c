@@ -0,0 +1,199 @@
+#include <errno.h>
+#include <netdb.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ext.h"
+#include "sock.h"
+#include "tle.h"
+
+/// The call `bmm_sock_unix(sun, addr)`
+/// fills in the local socket address `sun` from `addr`
+/// if it names a local socket.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_sock_unix(struct sockaddr_un *const sun,
+    char const *const addr) {
+  if (strncmp(addr, "unix:", 5) != 0)
+    return false;
+
+  char const *const path = &addr[5];
+  size_t const n = strlen(path);
+
+  (void) memset(sun, 0, sizeof *sun);
+  sun->sun_family = AF_UNIX;
+
+  if (n >= sizeof sun->sun_path)
+    return false;
+
+  (void) memcpy(sun->sun_path, path, n + 1);
+
+  return true;
+}
+
+/// The call `bmm_sock_open(addr, server)`
+/// opens a socket for the address `addr`,
+/// binding it if `server` is set and connecting it otherwise.
+__attribute__ ((__nonnull__))
+static int bmm_sock_open(char const *const addr, bool const server) {
+  if (strncmp(addr, "unix:", 5) == 0) {
+    struct sockaddr_un sun;
+    if (!bmm_sock_unix(&sun, addr)) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_PARSE, "Socket path too long");
+
+      return -1;
+    }
+
+    int const fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+      BMM_TLE_STDS();
+
+      return -1;
+    }
+
+    if ((server ?
+          bind(fd, (struct sockaddr const *) &sun, sizeof sun) :
+          connect(fd, (struct sockaddr const *) &sun, sizeof sun)) == -1) {
+      BMM_TLE_STDS();
+
+      (void) close(fd);
+
+      return -1;
+    }
+
+    return fd;
+  }
+
+  if (strncmp(addr, "tcp:", 4) != 0) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_PARSE, "Unsupported socket address");
+
+    return -1;
+  }
+
+  // The port comes after the last colon,
+  // so that numeric addresses may have colons of their own.
+  char const *const host = &addr[4];
+  char const *const port = strrchr(host, ':');
+  if (port == NULL) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_PARSE, "Missing port");
+
+    return -1;
+  }
+
+  char buf[BUFSIZ];
+  size_t const n = (size_t) (port - host);
+  if (n >= sizeof buf) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_PARSE, "Host name too long");
+
+    return -1;
+  }
+
+  (void) memcpy(buf, host, n);
+  buf[n] = '\0';
+
+  struct addrinfo hints;
+  (void) memset(&hints, 0, sizeof hints);
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = server ? AI_PASSIVE : 0;
+
+  struct addrinfo *res;
+  int const nerr = getaddrinfo(n == 0 ? NULL : buf, &port[1], &hints, &res);
+  if (nerr != 0) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_IO, "%s", gai_strerror(nerr));
+
+    return -1;
+  }
+
+  int fd = -1;
+
+  for (struct addrinfo const *ai = res; ai != NULL; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd == -1)
+      continue;
+
+    if (server) {
+      // Restarting the server should not have to wait for old connections.
+      int const on = 1;
+      (void) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+
+      if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+        break;
+    } else if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+      break;
+
+    int const nerrno = errno;
+    (void) close(fd);
+    errno = nerrno;
+
+    fd = -1;
+  }
+
+  freeaddrinfo(res);
+
+  if (fd == -1)
+    BMM_TLE_STDS();
+
+  return fd;
+}
+
+int bmm_sock_listen(char const *const addr) {
+  int const fd = bmm_sock_open(addr, true);
+  if (fd == -1)
+    return -1;
+
+  if (listen(fd, SOMAXCONN) == -1) {
+    BMM_TLE_STDS();
+
+    (void) close(fd);
+
+    return -1;
+  }
+
+  return fd;
+}
+
+int bmm_sock_connect(char const *const addr) {
+  return bmm_sock_open(addr, false);
+}
+
+bool bmm_sock_unlink(char const *const addr) {
+  struct sockaddr_un sun;
+  if (!bmm_sock_unix(&sun, addr))
+    return true;
+
+  if (unlink(sun.sun_path) == -1 && errno != ENOENT) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return true;
+}
+
+bool bmm_sock_send(int const fd, void const *const ptr, size_t const size) {
+  unsigned char const *const buf = ptr;
+
+  size_t progress = 0;
+
+  while (progress < size) {
+    ssize_t const nsent = send(fd, &buf[progress], size - progress,
+        MSG_NOSIGNAL);
+    if (nsent == -1) {
+      if (errno == EINTR)
+        continue;
+
+      return false;
+    }
+
+    progress += (size_t) nsent;
+  }
+
+  return true;
+}
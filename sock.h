@@ -0,0 +1,44 @@
+/// Stream sockets.
+///
+/// Addresses are either `unix:path` for local sockets or
+/// `tcp:host:port` for network sockets,
+/// where the host may be left empty when listening
+/// to accept connections from anywhere.
+
+#ifndef BMM_SOCK_H
+#define BMM_SOCK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// The call `bmm_sock_listen(addr)`
+/// creates a socket that listens for connections at the address `addr`.
+/// If the operation is successful, the file descriptor is returned.
+/// Otherwise `-1` is returned.
+__attribute__ ((__nonnull__))
+int bmm_sock_listen(char const *);
+
+/// The call `bmm_sock_connect(addr)`
+/// connects to the socket listening at the address `addr`.
+/// If the operation is successful, the file descriptor is returned.
+/// Otherwise `-1` is returned.
+__attribute__ ((__nonnull__))
+int bmm_sock_connect(char const *);
+
+/// The call `bmm_sock_unlink(addr)`
+/// removes the file of the local socket at the address `addr`
+/// if there is one.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_sock_unlink(char const *);
+
+/// The call `bmm_sock_send(fd, buf, n)`
+/// sends `n` bytes from the buffer `buf` into the socket `fd`
+/// without raising `SIGPIPE` if the other end has gone away.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_sock_send(int, void const *, size_t);
+
+#endif
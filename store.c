@@ -0,0 +1,501 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "common.h"
+#include "conf.h"
+#include "ext.h"
+#include "io.h"
+#include "msg.h"
+#include "store.h"
+#include "tle.h"
+
+static_assert(sizeof (double) == sizeof (uint64_t), "Unsupported double");
+
+static char const bmm_store_head[8] = {'B', 'M', 'M', 'S', 'T', 'O', 'R', 'E'};
+
+static char const bmm_store_tail[8] = {'B', 'M', 'M', 'I', 'N', 'D', 'E', 'X'};
+
+/// The call `bmm_store_reserve(pptr, pncap, n, size)`
+/// makes sure that the array `pptr` of `pncap` members of size `size`
+/// has room for at least `n` members.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_store_reserve(void *const pptr, size_t *const pncap,
+    size_t const n, size_t const size) {
+  size_t const ncap = *pncap;
+
+  if (n <= ncap)
+    return true;
+
+  size_t const nnew = $(bmm_max, size_t)(n,
+      ncap > SIZE_MAX / 2 ? SIZE_MAX : ncap * 2);
+
+  if (nnew > SIZE_MAX / size) {
+    errno = ENOMEM;
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  void **const pp = pptr;
+
+  void *const ptr = realloc(*pp, nnew * size);
+  if (ptr == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  *pp = ptr;
+  *pncap = nnew;
+
+  return true;
+}
+
+/// The call `bmm_store_emit(writer, ptr, size)`
+/// writes `size` bytes from `ptr` into the container.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_store_emit(struct bmm_store_writer *const writer,
+    void const *const ptr, size_t const size) {
+  if (size != 0 && fwrite(ptr, size, 1, writer->stream) != 1) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  writer->pos += size;
+
+  return true;
+}
+
+/// The call `bmm_store_flush(writer)`
+/// compresses and writes out the current block if it is not empty.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_store_flush(struct bmm_store_writer *const writer) {
+  if (writer->nraw == 0)
+    return true;
+
+  uLong const nbound = compressBound((uLong) writer->nraw);
+  if (!bmm_store_reserve(&writer->zip, &writer->ncapzip,
+        (size_t) nbound, sizeof *writer->zip))
+    return false;
+
+  uLongf nzip = (uLongf) writer->ncapzip;
+  int const nerr = compress2(writer->zip, &nzip,
+      writer->raw, (uLong) writer->nraw, Z_DEFAULT_COMPRESSION);
+  if (nerr != Z_OK) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_ZLIB, "%s", zError(nerr));
+
+    return false;
+  }
+
+  uint64_t const size[] = {(uint64_t) nzip, (uint64_t) writer->nraw};
+  if (!bmm_store_emit(writer, size, sizeof size) ||
+      !bmm_store_emit(writer, writer->zip, (size_t) nzip))
+    return false;
+
+  writer->off = writer->pos;
+  writer->nraw = 0;
+
+  return true;
+}
+
+bool bmm_store_begin(struct bmm_store_writer *const writer,
+    FILE *const stream) {
+  writer->stream = stream;
+  writer->pos = 0;
+  writer->raw = NULL;
+  writer->nraw = 0;
+  writer->ncapraw = 0;
+  writer->zip = NULL;
+  writer->ncapzip = 0;
+  writer->entry = NULL;
+  writer->nentry = 0;
+  writer->ncapentry = 0;
+  writer->frame = NULL;
+  writer->nframe = 0;
+  writer->ncapframe = 0;
+  writer->t = 0.0;
+
+  if (!bmm_store_emit(writer, bmm_store_head, sizeof bmm_store_head))
+    return false;
+
+  writer->off = writer->pos;
+
+  return true;
+}
+
+bool bmm_store_put(struct bmm_store_writer *const writer,
+    enum bmm_msg_num const num, void const *const hdr, size_t const nhdr,
+    void const *const body, size_t const nbody) {
+  bool const start = num == BMM_MSG_NUM_ISTEP;
+
+  // Frames should begin new blocks,
+  // but blocks must not grow without bounds either.
+  if (writer->nraw >= (start ? BMM_MBLOCK : 4 * (size_t) BMM_MBLOCK))
+    if (!bmm_store_flush(writer))
+      return false;
+
+  if (nhdr > SIZE_MAX - nbody ||
+      writer->nraw > SIZE_MAX - (nhdr + nbody)) {
+    errno = ENOMEM;
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  if (!bmm_store_reserve(&writer->raw, &writer->ncapraw,
+        writer->nraw + nhdr + nbody, sizeof *writer->raw) ||
+      !bmm_store_reserve(&writer->entry, &writer->ncapentry,
+        writer->nentry + 1, sizeof *writer->entry))
+    return false;
+
+  if (start) {
+    if (!bmm_store_reserve(&writer->frame, &writer->ncapframe,
+          writer->nframe + 1, sizeof *writer->frame))
+      return false;
+
+    writer->frame[writer->nframe] = (uint64_t) writer->nentry;
+    ++writer->nframe;
+
+    // The step message begins with the time.
+    double t = 0.0;
+    if (nbody >= sizeof t)
+      (void) memcpy(&t, body, sizeof t);
+
+    writer->t = t;
+  }
+
+  struct bmm_store_entry *const entry = &writer->entry[writer->nentry];
+  entry->iframe = writer->nframe == 0 ? UINT64_MAX :
+    (uint64_t) (writer->nframe - 1);
+  entry->t = writer->nframe == 0 ? 0.0 : writer->t;
+  entry->num = (uint64_t) num;
+  entry->off = writer->off;
+  entry->offmsg = (uint64_t) writer->nraw;
+  ++writer->nentry;
+
+  (void) memcpy(&writer->raw[writer->nraw], hdr, nhdr);
+  writer->nraw += nhdr;
+  (void) memcpy(&writer->raw[writer->nraw], body, nbody);
+  writer->nraw += nbody;
+
+  return true;
+}
+
+bool bmm_store_end(struct bmm_store_writer *const writer) {
+  bool result = bmm_store_flush(writer);
+
+  struct bmm_store_trailer trailer;
+  trailer.offend = writer->pos;
+
+  if (result) {
+    // The index is aligned, so that it can be used straight from a map.
+    unsigned char const pad[sizeof (uint64_t)] = {0};
+    result = bmm_store_emit(writer, pad,
+        (size_t) ((sizeof pad - writer->pos % sizeof pad) % sizeof pad));
+  }
+
+  trailer.offentry = writer->pos;
+  trailer.nentry = (uint64_t) writer->nentry;
+
+  if (result)
+    result = bmm_store_emit(writer, writer->entry,
+        writer->nentry * sizeof *writer->entry);
+
+  trailer.offframe = writer->pos;
+  trailer.nframe = (uint64_t) writer->nframe;
+
+  if (result)
+    result = bmm_store_emit(writer, writer->frame,
+        writer->nframe * sizeof *writer->frame);
+
+  (void) memcpy(trailer.magic, bmm_store_tail, sizeof trailer.magic);
+
+  if (result)
+    result = bmm_store_emit(writer, &trailer, sizeof trailer);
+
+  if (result && fflush(writer->stream) == EOF) {
+    BMM_TLE_STDS();
+
+    result = false;
+  }
+
+  free(writer->frame);
+  free(writer->entry);
+  free(writer->zip);
+  free(writer->raw);
+
+  return result;
+}
+
+/// The call `bmm_store_invalid()`
+/// reports that the container is corrupt and returns `false`.
+static bool bmm_store_invalid(void) {
+  BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Invalid container");
+
+  return false;
+}
+
+/// The call `bmm_store_load(reader, off)`
+/// decompresses the block at the offset `off`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_store_load(struct bmm_store_reader *const reader,
+    uint64_t const off) {
+  uint64_t size[2];
+
+  if (off > reader->offend || reader->offend - off < sizeof size)
+    return bmm_store_invalid();
+
+  (void) memcpy(size, &reader->map[off], sizeof size);
+
+  if (size[0] > reader->offend - off - sizeof size || size[1] > SIZE_MAX)
+    return bmm_store_invalid();
+
+  if (!bmm_store_reserve(&reader->raw, &reader->ncapraw,
+        (size_t) size[1], sizeof *reader->raw))
+    return false;
+
+  uLongf nraw = (uLongf) size[1];
+  int const nerr = uncompress(reader->raw, &nraw,
+      &reader->map[off + sizeof size], (uLong) size[0]);
+  if (nerr != Z_OK) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_ZLIB, "%s", zError(nerr));
+
+    return false;
+  }
+
+  if ((uint64_t) nraw != size[1])
+    return bmm_store_invalid();
+
+  reader->nraw = (size_t) size[1];
+  reader->off = off;
+  reader->offnext = off + sizeof size + size[0];
+  reader->iraw = 0;
+
+  return true;
+}
+
+/// The call `bmm_store_rewind(reader)`
+/// moves the reader to the beginning of the container.
+__attribute__ ((__nonnull__))
+static void bmm_store_rewind(struct bmm_store_reader *const reader) {
+  reader->nraw = 0;
+  reader->off = UINT64_MAX;
+  reader->offnext = sizeof bmm_store_head;
+  reader->iraw = 0;
+  reader->jump = false;
+}
+
+bool bmm_store_open(struct bmm_store_reader *const reader,
+    char const *const path) {
+  reader->fd = open(path, O_RDONLY);
+  if (reader->fd == -1) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(reader->fd, &st) == -1) {
+    BMM_TLE_STDS();
+
+    (void) close(reader->fd);
+
+    return false;
+  }
+
+  struct bmm_store_trailer trailer;
+
+  if (st.st_size < 0 || (uintmax_t) st.st_size > SIZE_MAX ||
+      (size_t) st.st_size < sizeof bmm_store_head + sizeof trailer) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Not a container");
+
+    (void) close(reader->fd);
+
+    return false;
+  }
+
+  reader->size = (size_t) st.st_size;
+
+  void *const map = mmap(NULL, reader->size, PROT_READ, MAP_PRIVATE,
+      reader->fd, 0);
+  if (map == MAP_FAILED) {
+    BMM_TLE_STDS();
+
+    (void) close(reader->fd);
+
+    return false;
+  }
+
+  reader->map = map;
+  reader->raw = NULL;
+  reader->ncapraw = 0;
+
+  (void) memcpy(&trailer, &reader->map[reader->size - sizeof trailer],
+      sizeof trailer);
+
+  uint64_t const offtrailer = (uint64_t) (reader->size - sizeof trailer);
+
+  if (memcmp(reader->map, bmm_store_head, sizeof bmm_store_head) != 0 ||
+      memcmp(trailer.magic, bmm_store_tail, sizeof bmm_store_tail) != 0 ||
+      trailer.offend < sizeof bmm_store_head ||
+      trailer.offend > trailer.offentry ||
+      trailer.offentry % sizeof (uint64_t) != 0 ||
+      trailer.offentry > trailer.offframe ||
+      trailer.nentry > (trailer.offframe - trailer.offentry) /
+      sizeof *reader->entry ||
+      trailer.offframe > offtrailer ||
+      trailer.nframe > (offtrailer - trailer.offframe) /
+      sizeof *reader->frame) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Not a container");
+
+    (void) bmm_store_close(reader);
+
+    return false;
+  }
+
+  reader->offend = trailer.offend;
+  reader->entry = (void const *) &reader->map[trailer.offentry];
+  reader->nentry = (size_t) trailer.nentry;
+  reader->frame = (void const *) &reader->map[trailer.offframe];
+  reader->nframe = (size_t) trailer.nframe;
+
+  for (size_t iframe = 0; iframe < reader->nframe; ++iframe)
+    if (reader->frame[iframe] >= trailer.nentry) {
+      (void) bmm_store_close(reader);
+
+      return bmm_store_invalid();
+    }
+
+  bmm_store_rewind(reader);
+
+  return true;
+}
+
+bool bmm_store_close(struct bmm_store_reader *const reader) {
+  bool result = true;
+
+  free(reader->raw);
+
+  if (munmap((void *) reader->map, reader->size) == -1) {
+    BMM_TLE_STDS();
+
+    result = false;
+  }
+
+  if (close(reader->fd) == -1) {
+    BMM_TLE_STDS();
+
+    result = false;
+  }
+
+  return result;
+}
+
+bool bmm_store_seek(struct bmm_store_reader *const reader,
+    size_t const iframe) {
+  if (iframe >= reader->nframe) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "No such frame");
+
+    return false;
+  }
+
+  bmm_store_rewind(reader);
+
+  // The preamble ends where the first frame begins.
+  struct bmm_store_entry const *const from =
+    &reader->entry[reader->frame[0]];
+  struct bmm_store_entry const *const to =
+    &reader->entry[reader->frame[iframe]];
+
+  if (to != from) {
+    reader->jump = true;
+    reader->from.off = from->off;
+    reader->from.offraw = (size_t) from->offmsg;
+    reader->to.off = to->off;
+    reader->to.offraw = (size_t) to->offmsg;
+  }
+
+  return true;
+}
+
+/// The call `bmm_store_take(reader, buf, size)`
+/// reads `size` bytes from the reader into `buf`
+/// or discards them if `buf` is `NULL`.
+__attribute__ ((__nonnull__ (1)))
+static enum bmm_io_read bmm_store_take(struct bmm_store_reader *const reader,
+    unsigned char *const buf, size_t const size) {
+  size_t progress = 0;
+
+  while (progress < size) {
+    bool const here = reader->jump && reader->off == reader->from.off;
+
+    if (here && reader->iraw == reader->from.offraw) {
+      reader->jump = false;
+
+      if (!bmm_store_load(reader, reader->to.off))
+        return BMM_IO_READ_ERROR;
+
+      if (reader->to.offraw > reader->nraw) {
+        (void) bmm_store_invalid();
+
+        return BMM_IO_READ_ERROR;
+      }
+
+      reader->iraw = reader->to.offraw;
+
+      continue;
+    }
+
+    if (reader->off == UINT64_MAX || reader->iraw == reader->nraw) {
+      if (reader->offnext >= reader->offend)
+        return BMM_IO_READ_EOF;
+
+      if (!bmm_store_load(reader, reader->offnext))
+        return BMM_IO_READ_ERROR;
+
+      continue;
+    }
+
+    size_t const nrem = reader->nraw - reader->iraw;
+    size_t const nhere = here && reader->from.offraw > reader->iraw ?
+      $(bmm_min, size_t)(nrem, reader->from.offraw - reader->iraw) : nrem;
+    size_t const n = $(bmm_min, size_t)(size - progress, nhere);
+
+    if (buf != NULL)
+      (void) memcpy(&buf[progress], &reader->raw[reader->iraw], n);
+
+    reader->iraw += n;
+    progress += n;
+  }
+
+  return BMM_IO_READ_SUCCESS;
+}
+
+enum bmm_io_read bmm_store_read(struct bmm_store_reader *const reader,
+    void *const ptr, size_t const size) {
+  return bmm_store_take(reader, ptr, size);
+}
+
+enum bmm_io_read bmm_store_fastfw(struct bmm_store_reader *const reader,
+    size_t const size) {
+  return bmm_store_take(reader, NULL, size);
+}
@@ -0,0 +1,196 @@
+/// Indexed message containers.
+///
+/// A container holds a stream of messages in independently compressed blocks
+/// and ends with an index that maps every message to its block.
+/// Frames begin with `BMM_MSG_NUM_ISTEP` messages and
+/// the messages before the first frame form a preamble,
+/// which is replayed whenever a reader seeks.
+///
+///     | Header | Block | Block | ... | Padding | Entries | Frames | Trailer
+///
+/// Each block begins with its compressed and uncompressed sizes
+/// as two 64-bit integers and
+/// frames begin new blocks once the previous ones grow
+/// beyond `BMM_MBLOCK` bytes.
+
+#ifndef BMM_STORE_H
+#define BMM_STORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "conf.h"
+#include "ext.h"
+#include "io.h"
+#include "msg.h"
+
+/// Index entries, one for each message.
+struct bmm_store_entry {
+  /// Frame number or `UINT64_MAX` for the preamble.
+  uint64_t iframe;
+  /// Time of the frame or zero for the preamble.
+  double t;
+  /// Message number.
+  uint64_t num;
+  /// Offset of the block from the beginning of the container.
+  uint64_t off;
+  /// Offset of the message from the beginning of the uncompressed block.
+  uint64_t offmsg;
+};
+
+/// Trailers at the ends of containers.
+struct bmm_store_trailer {
+  /// End of the blocks.
+  uint64_t offend;
+  /// Offset of the entries.
+  uint64_t offentry;
+  /// Number of entries.
+  uint64_t nentry;
+  /// Offset of the first entry index of each frame.
+  uint64_t offframe;
+  /// Number of frames.
+  uint64_t nframe;
+  /// Magic number.
+  char magic[8];
+};
+
+/// Container writer state.
+struct bmm_store_writer {
+  /// Destination.
+  FILE *stream;
+  /// Number of bytes written so far.
+  uint64_t pos;
+  /// Offset of the current block.
+  uint64_t off;
+  /// Uncompressed contents of the current block.
+  unsigned char *raw;
+  /// Number of uncompressed bytes.
+  size_t nraw;
+  /// Number of uncompressed bytes there is room for.
+  size_t ncapraw;
+  /// Compressed contents of the current block.
+  unsigned char *zip;
+  /// Number of compressed bytes there is room for.
+  size_t ncapzip;
+  /// Index entries.
+  struct bmm_store_entry *entry;
+  /// Number of index entries.
+  size_t nentry;
+  /// Number of index entries there is room for.
+  size_t ncapentry;
+  /// First entry index of each frame.
+  uint64_t *frame;
+  /// Number of frames.
+  size_t nframe;
+  /// Number of frames there is room for.
+  size_t ncapframe;
+  /// Time of the current frame.
+  double t;
+};
+
+/// Places in containers.
+struct bmm_store_place {
+  /// Offset of the block.
+  uint64_t off;
+  /// Offset from the beginning of the uncompressed block.
+  size_t offraw;
+};
+
+/// Container reader state.
+struct bmm_store_reader {
+  /// File descriptor.
+  int fd;
+  /// Memory map of the whole container.
+  unsigned char const *map;
+  /// Size of the container.
+  size_t size;
+  /// End of the blocks.
+  uint64_t offend;
+  /// Index entries.
+  struct bmm_store_entry const *entry;
+  /// Number of index entries.
+  size_t nentry;
+  /// First entry index of each frame.
+  uint64_t const *frame;
+  /// Number of frames.
+  size_t nframe;
+  /// Uncompressed contents of the current block.
+  unsigned char *raw;
+  /// Number of uncompressed bytes.
+  size_t nraw;
+  /// Number of uncompressed bytes there is room for.
+  size_t ncapraw;
+  /// Offset of the current block or `UINT64_MAX` if there is none.
+  uint64_t off;
+  /// Offset of the next block.
+  uint64_t offnext;
+  /// Position in the current block.
+  size_t iraw;
+  /// Whether the preamble is followed by a jump.
+  bool jump;
+  /// Where the preamble ends.
+  struct bmm_store_place from;
+  /// Where the jump goes.
+  struct bmm_store_place to;
+};
+
+/// The call `bmm_store_begin(writer, stream)`
+/// starts writing a container into `stream`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_store_begin(struct bmm_store_writer *, FILE *);
+
+/// The call `bmm_store_put(writer, num, hdr, nhdr, body, nbody)`
+/// adds the message with the number `num`
+/// that consists of the `nhdr` bytes in `hdr`,
+/// which cover everything up to and including the message number, and
+/// the `nbody` bytes in `body`, which cover the rest.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_store_put(struct bmm_store_writer *, enum bmm_msg_num,
+    void const *, size_t, void const *, size_t);
+
+/// The call `bmm_store_end(writer)`
+/// finishes writing the container
+/// and releases the resources acquired by `bmm_store_begin`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_store_end(struct bmm_store_writer *);
+
+/// The call `bmm_store_open(reader, path)`
+/// maps the container in `path` into memory for reading from the beginning.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_store_open(struct bmm_store_reader *, char const *);
+
+/// The call `bmm_store_close(reader)`
+/// releases the resources acquired by `bmm_store_open`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_store_close(struct bmm_store_reader *);
+
+/// The call `bmm_store_seek(reader, iframe)`
+/// moves the reader to the preamble followed by the frame `iframe`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_store_seek(struct bmm_store_reader *, size_t);
+
+/// The call `bmm_store_read(reader, ptr, size)`
+/// reads `size` bytes from the reader into `ptr`.
+__attribute__ ((__nonnull__))
+enum bmm_io_read bmm_store_read(struct bmm_store_reader *, void *, size_t);
+
+/// The call `bmm_store_fastfw(reader, size)`
+/// reads `size` bytes from the reader and discards them.
+__attribute__ ((__nonnull__))
+enum bmm_io_read bmm_store_fastfw(struct bmm_store_reader *, size_t);
+
+#endif
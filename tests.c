@@ -1,18 +1,30 @@
 #include <cheat.h>
 #include <cheats.h>
+#include <float.h>
 #include <math.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "alias.h"
 #include "common.h"
+#include "col.h"
 #include "cpp.h"
+#include "dem.h"
 #include "endy.h"
 #include "ext.h"
 #include "fp.h"
 #include "geom2d.h"
+#include "kde.h"
+#include "kernel.h"
+#include "lit.h"
 #include "neigh.h"
 #include "msg.h"
+#include "plug.h"
+#include "random.h"
+#include "sketch.h"
+#include "trace.h"
 
 CHEAT_DECLARE(
   static int const val = 64;
@@ -679,6 +691,71 @@ CHEAT_TEST(clog,
       cheat_assert_size($(bmm_clog, size_t)(i, j), clog_ref(i, j));
 )
 
+CHEAT_TEST(fp_quant_iso,
+  for (size_t nbit = 1; nbit <= 32; ++nbit)
+    for (int i = -32; i < 96; ++i) {
+      double const a = -1.0;
+      double const b = 3.0;
+      double const x = (double) i / 32.0;
+      uint32_t const k = bmm_fp_quant(x, a, b, nbit);
+      double const y = bmm_fp_dequant(k, a, b, nbit);
+
+      cheat_assert(fabs(y - x) <= ldexp(b - a, -(int) nbit));
+      cheat_assert(bmm_fp_quant(y, a, b, nbit) == k);
+    }
+)
+
+CHEAT_TEST(fp_fsqrt_tol,
+  cheat_assert(bmm_fp_fsqrt(0.0, 0) == 0.0);
+
+  for (int itol = 1; itol <= 15; ++itol) {
+    double const tol = pow(10.0, -(double) itol);
+    size_t const n = bmm_fp_fsqrtn(tol);
+
+    for (int iexp = -64; iexp <= 64; ++iexp)
+      for (int imant = 0; imant < 64; ++imant) {
+        double const x = ldexp(1.0 + (double) imant / 64.0, iexp);
+        double const y = sqrt(x);
+
+        cheat_assert(fabs(bmm_fp_fsqrt(x, n) - y) <=
+            fmax(tol, 4.0 * DBL_EPSILON) * y);
+      }
+  }
+)
+
+CHEAT_TEST(fp_psum_exact,
+  double x[1000];
+  for (size_t i = 0; i < nmembof(x); ++i)
+    x[i] = (double) i;
+
+  cheat_assert(bmm_fp_psum(x, 0) == 0.0);
+  cheat_assert(bmm_fp_psum(x, 1) == 0.0);
+  cheat_assert(bmm_fp_psum(x, nmembof(x)) == 499500.0);
+)
+
+CHEAT_TEST(kde_conv_point,
+  for (int ik = BMM_KERNEL_RECT; ik <= BMM_KERNEL_LOGISTIC; ++ik) {
+    enum bmm_kernel const k = (enum bmm_kernel) ik;
+    double (*const f)(double) = bmm_kernel(k);
+
+    double const dx = 1.0 / 8.0;
+    double const h = 2.0;
+
+    double c[64];
+    for (size_t i = 0; i < nmembof(c); ++i)
+      c[i] = 0.0;
+
+    bmm_kde_bin(c, nmembof(c), -4.0, dx, 0.0, 3.0);
+
+    double y[nmembof(c)];
+    bmm_kde_conv(y, c, nmembof(c), dx, k, h);
+
+    for (size_t i = 0; i < nmembof(y); ++i)
+      cheat_assert_double(y[i],
+          3.0 * f((-4.0 + (double) i * dx) / h) / h, 1.0e-12);
+  }
+)
+
 CHEAT_DECLARE(
   __attribute__ ((__nonnull__, __pure__))
   static int compar(size_t const i, size_t const j, void *const cls) {
@@ -747,6 +824,54 @@ CHEAT_TEST(geom2d_shell_outside,
       (M_PI_2 / 3.0) * r, 1e-6);
 )
 
+CHEAT_TEST(geom2d_lecpdiff_across,
+  double const x0[] = {0.1, 0.05};
+  double const x1[] = {0.3, 0.95};
+  double const xper[] = {1.0, 1.0};
+  bool const per[] = {true, true};
+
+  double xdiff[2];
+  cheat_assert_double(bmm_geom2d_lecpdiff(xdiff, x0, x1, xper, per, 0.5),
+      -1.0, 1e-12);
+  cheat_assert_double(xdiff[0], 0.3, 1e-12);
+  cheat_assert_double(xdiff[1], 0.1, 1e-12);
+)
+
+CHEAT_TEST(geom2d_orient_ccw,
+  double const x0[] = {0.0, 0.0};
+  double const x1[] = {1.0, 0.0};
+  double const x2[] = {0.0, 1.0};
+
+  cheat_assert_double(bmm_geom2d_orient(x0, x1, x2), 1.0, 1e-12);
+  cheat_assert_double(bmm_geom2d_orient(x0, x2, x1), -1.0, 1e-12);
+)
+
+CHEAT_TEST(geom2d_powin_weight,
+  double const x0[] = {1.0, 0.0};
+  double const x1[] = {0.0, 1.0};
+  double const x2[] = {-1.0, 0.0};
+  double const x[] = {0.0, -0.9};
+
+  cheat_assert(bmm_geom2d_powin(x0, 0.0, x1, 0.0, x2, 0.0, x, 0.0) > 0.0);
+  cheat_assert(bmm_geom2d_powin(x0, 0.0, x1, 0.0, x2, 0.0, x, -0.5) < 0.0);
+  cheat_assert(bmm_geom2d_powin(x0, 0.5, x1, 0.5, x2, 0.5, x, 0.0) < 0.0);
+)
+
+CHEAT_TEST(geom2d_lecpdist2s_same,
+  double const x0[] = {0.1, 0.05};
+  double const x[][2] = {{0.3, 0.95}, {0.9, 0.5}, {0.15, 0.1}};
+  size_t const ix[] = {2, 0, 1};
+  double const xper[] = {1.0, 1.0};
+  bool const per[] = {true, false};
+
+  double d2[nmembof(ix)];
+  bmm_geom2d_lecpdist2s(d2, x0, x, ix, nmembof(ix), xper, per, 0.5);
+
+  for (size_t k = 0; k < nmembof(ix); ++k)
+    cheat_assert_double(d2[k],
+        bmm_geom2d_lecpdist2(x[ix[k]], x0, xper, per, 0.5), 1e-12);
+)
+
 CHEAT_TEST(size_hc_ord,
   size_t ij[2];
 
@@ -1015,6 +1140,71 @@ CHEAT_TEST(neigh_ijcpuh,
   cheat_assert_size(ij[1], 4);
 )
 
+CHEAT_TEST(neigh_ticp,
+  int const mask = BMM_NEIGH_MASK_UPPERH;
+
+  size_t n[6 * 5];
+  size_t icell[6 * 5][BMM_NEIGH_NMAX(2)];
+
+  cheat_assert_size(bmm_neigh_ticp(n, &icell[0][0], nmembof(icell[0]),
+        ndim, nper, per, mask), 6 * 5);
+
+  size_t const jcell = $(bmm_unhcd, size_t)((size_t const[]) {4, 3},
+      ndim, nper);
+  cheat_assert_size(n[jcell], bmm_neigh_ncpi(jcell, ndim, nper, per, mask));
+  for (size_t ineigh = 0; ineigh < n[jcell]; ++ineigh)
+    cheat_assert_size(icell[jcell][ineigh],
+        bmm_neigh_icpi(jcell, ineigh, ndim, nper, per, mask));
+)
+
+CHEAT_TEST(random_philox,
+  uint64_t const x[] = {
+    UINT64_C(0x243f6a8885a308d3), UINT64_C(0x13198a2e03707344),
+    UINT64_C(0xa4093822299f31d0), UINT64_C(0x082efa98ec4e6c89)
+  };
+  uint64_t const k[] = {
+    UINT64_C(0x452821e638d01377), UINT64_C(0xbe5466cf34e90c6c)
+  };
+  uint64_t const z[] = {
+    UINT64_C(0xa528f45403e61d95), UINT64_C(0x38c72dbd566e9788),
+    UINT64_C(0xa5a1610e72fd18b5), UINT64_C(0x57bd43b5e52b7fe6)
+  };
+
+  uint64_t y[4];
+  bmm_random_philox(y, x, k);
+  for (size_t i = 0; i < nmembof(y); ++i)
+    cheat_assert_uint64(y[i], z[i]);
+)
+
+CHEAT_TEST(endy_swap,
+  uint64_t x[5];
+  uint16_t h[3];
+  unsigned char c[3][3];
+
+  for (size_t i = 0; i < nmembof(x); ++i)
+    x[i] = UINT64_C(0x0102030405060708) * (i + 1);
+  for (size_t i = 0; i < nmembof(h); ++i)
+    h[i] = (uint16_t) (0x0102 * (i + 1));
+  for (size_t i = 0; i < nmembof(c); ++i)
+    for (size_t j = 0; j < nmembof(*c); ++j)
+      c[i][j] = (unsigned char) (i * nmembof(*c) + j);
+
+  bmm_endy_swap(x, nmembof(x), sizeof *x);
+  bmm_endy_swap(h, nmembof(h), sizeof *h);
+  bmm_endy_swap(c, nmembof(c), sizeof *c);
+
+  for (size_t i = 0; i < nmembof(x); ++i)
+    cheat_assert_uint64(x[i],
+        __builtin_bswap64(UINT64_C(0x0102030405060708) * (i + 1)));
+  for (size_t i = 0; i < nmembof(h); ++i)
+    cheat_assert_uint16(h[i],
+        __builtin_bswap16((uint16_t) (0x0102 * (i + 1))));
+  for (size_t i = 0; i < nmembof(c); ++i)
+    for (size_t j = 0; j < nmembof(*c); ++j)
+      cheat_assert_int(c[i][j],
+          (int) (i * nmembof(*c) + nmembof(*c) - 1 - j));
+)
+
 CHEAT_DECLARE(
   static enum bmm_msg_prio const msg_prio[] = {
     BMM_MSG_PRIO_LOW,
@@ -1120,3 +1310,347 @@ CHEAT_TEST(msg_spec_lt_iso,
           cheat_assert_unsigned_char(out.msg.term.buf[i], in.msg.term.buf[i]);
       }
 )
+
+CHEAT_DECLARE(
+  struct lit {
+    size_t i;
+    size_t n;
+    unsigned char buf[1024];
+  };
+
+  static enum bmm_io_read lit_read(void *const buf, size_t const n,
+      void *const ptr) {
+    struct lit *const lit = ptr;
+
+    if (n > lit->n - lit->i)
+      return BMM_IO_READ_EOF;
+
+    (void) memcpy(buf, &lit->buf[lit->i], n);
+    lit->i += n;
+
+    return BMM_IO_READ_SUCCESS;
+  }
+
+  static size_t lit_peek(void *const buf, size_t const n, void *const ptr) {
+    struct lit const *const lit = ptr;
+
+    size_t const m = $(bmm_min, size_t)(n, lit->n - lit->i);
+    (void) memcpy(buf, &lit->buf[lit->i], m);
+
+    return m;
+  }
+
+  static bool lit_write(void const *const buf, size_t const n,
+      void *const ptr) {
+    struct lit *const lit = ptr;
+
+    if (n > sizeof lit->buf - lit->n)
+      return false;
+
+    (void) memcpy(&lit->buf[lit->n], buf, n);
+    lit->n += n;
+
+    return true;
+  }
+)
+
+CHEAT_TEST(msg_lit_iso,
+  struct bmm_msg_spec spec;
+  bmm_msg_spec_def(&spec);
+  bmm_lit_spec(&spec);
+
+  unsigned char const term[] = BMM_LIT_TERM;
+  size_t const nterm = sizeof term - 1;
+
+  // Bodies are pieced together from parts of the literal and other bytes.
+  uint64_t state = 1;
+  for (size_t itry = 0; itry < 256; ++itry) {
+    unsigned char body[256];
+    size_t nbody = 0;
+
+    while (nbody < 200) {
+      state = state * UINT64_C(6364136223846793005) + 1;
+      size_t const k = (size_t) (state >> 33);
+
+      switch (k % 4) {
+        case 0:
+          (void) memcpy(&body[nbody], term, nterm);
+          nbody += nterm;
+
+          break;
+        case 1:
+          (void) memcpy(&body[nbody], term, k / 4 % nterm);
+          nbody += k / 4 % nterm;
+
+          break;
+        case 2:
+          (void) memcpy(&body[nbody], &term[k / 4 % nterm],
+              nterm - k / 4 % nterm);
+          nbody += nterm - k / 4 % nterm;
+
+          break;
+        default:
+          body[nbody] = (unsigned char) (k / 4);
+          ++nbody;
+      }
+    }
+
+    struct bmm_lit lit;
+    bmm_lit_def(&lit);
+    bmm_lit_begin(&lit, &spec);
+
+    // Occurrences must also be found across separate writes.
+    size_t const nfirst = itry % nbody;
+
+    struct lit enc = {.i = 0, .n = 0};
+    cheat_assert(bmm_lit_put(&lit, body, nfirst, lit_write, &enc));
+    cheat_assert(bmm_lit_put(&lit, &body[nfirst], nbody - nfirst,
+          lit_write, &enc));
+    cheat_assert(bmm_lit_end(&lit, lit_write, &enc));
+
+    // Whatever comes after the end must stay unread.
+    size_t const nenc = enc.n;
+    enc.buf[enc.n] = 0x42;
+    ++enc.n;
+
+    cheat_assert_size(bmm_lit_scan(&spec, enc.buf, enc.n), nenc);
+
+    for (size_t ipeek = 0; ipeek < 2; ++ipeek) {
+      enc.i = 0;
+      cheat_assert(bmm_lit_open(&lit, &spec, lit_read,
+            ipeek == 0 ? NULL : lit_peek, &enc) == BMM_IO_READ_SUCCESS);
+      cheat_assert_size(enc.i, nenc);
+      cheat_assert_size(lit.nraw, nbody);
+      cheat_assert_int(memcmp(lit.raw, body, nbody), 0);
+    }
+
+    bmm_lit_free(&lit);
+  }
+)
+
+CHEAT_DECLARE(
+  static enum bmm_io_read lit_skip(size_t const n, void *const ptr) {
+    struct lit *const lit = ptr;
+
+    if (n > lit->n - lit->i)
+      return BMM_IO_READ_EOF;
+
+    lit->i += n;
+
+    return BMM_IO_READ_SUCCESS;
+  }
+)
+
+CHEAT_TEST(msg_col_iso,
+  struct bmm_col_schema out;
+  out.ntab = 1;
+  bmm_col_tab_def(&out.tab[0], BMM_MSG_NUM_CPARTS);
+  bmm_col_tab_add(&out.tab[0], "k", BMM_COL_TYPE_U16, 1);
+  bmm_col_tab_add(&out.tab[0], "x", BMM_COL_TYPE_F64, 2);
+  bmm_col_tab_add(&out.tab[0], "l", BMM_COL_TYPE_U32, 1);
+
+  struct lit msg = {.i = 0, .n = 0};
+  cheat_assert(bmm_col_schema_write(&out, lit_write, &msg));
+  cheat_assert_size(msg.n, bmm_col_schema_size(&out));
+
+  struct bmm_col_schema in;
+  cheat_assert(bmm_col_schema_read(&in, msg.n, false, lit_read, &msg) ==
+      BMM_IO_READ_SUCCESS);
+
+  struct bmm_col_tab const *const tab =
+    bmm_col_schema_find(&in, BMM_MSG_NUM_CPARTS);
+  cheat_assert_not_pointer(tab, NULL);
+  cheat_assert_pointer(bmm_col_schema_find(&in, BMM_MSG_NUM_CEST), NULL);
+  cheat_assert_size(tab->ncol, 3);
+
+  for (size_t icol = 0; icol < tab->ncol; ++icol) {
+    cheat_assert_string(tab->col[icol].name, out.tab[0].col[icol].name);
+    cheat_assert_int(tab->col[icol].type, out.tab[0].col[icol].type);
+    cheat_assert_size(tab->col[icol].n, out.tab[0].col[icol].n);
+  }
+
+  uint16_t const k[] = {1, 2, 3};
+  double const x[][2] = {{0.5, 1.5}, {2.5, 3.5}, {4.5, 5.5}};
+  uint32_t const l[] = {7, 8, 9};
+
+  msg.i = 0;
+  msg.n = 0;
+  cheat_assert(lit_write(k, sizeof k, &msg));
+  cheat_assert(lit_write(x, sizeof x, &msg));
+  cheat_assert(lit_write(l, sizeof l, &msg));
+  cheat_assert_size(msg.n + sizeof (size_t), bmm_col_tab_size(tab, 3));
+
+  // Columns that are not wanted or do not match are skipped.
+  double y[3][2];
+  uint32_t m[3] = {0, 0, 0};
+  struct bmm_col_want const want[] = {
+    {"l", BMM_COL_TYPE_U32, 1, m},
+    {"k", BMM_COL_TYPE_U32, 1, NULL},
+    {"x", BMM_COL_TYPE_F64, 2, y}
+  };
+  cheat_assert(bmm_col_tab_read(tab, 3, want, nmembof(want), false,
+        lit_read, lit_skip, &msg) == BMM_IO_READ_SUCCESS);
+  cheat_assert_size(msg.i, msg.n);
+
+  for (size_t i = 0; i < nmembof(l); ++i) {
+    cheat_assert_double(y[i][0], x[i][0], 0.0);
+    cheat_assert_double(y[i][1], x[i][1], 0.0);
+    cheat_assert_uint32(m[i], l[i]);
+  }
+)
+
+CHEAT_TEST(trace_ring_wrap,
+  char const *const name[] = {"zero", "one", "two", "three", "four", "five"};
+
+  struct bmm_trace trace;
+  cheat_assert(bmm_trace_start(&trace, 1, 4));
+  cheat_assert(bmm_trace_on(&trace));
+
+  for (size_t iev = 0; iev < nmembof(name); ++iev)
+    bmm_trace_mark(&trace, 0, name[iev]);
+
+  // Threads that were not started are left alone.
+  bmm_trace_mark(&trace, 1, "six");
+
+  char *buf;
+  size_t n;
+  FILE *const stream = open_memstream(&buf, &n);
+  cheat_assert_not_pointer(stream, NULL);
+  cheat_assert(bmm_trace_dump(&trace, stream));
+  cheat_assert_int(fclose(stream), 0);
+
+  // Only the four most recent events survive, in order.
+  char const *const zero = strstr(buf, "\"zero\"");
+  char const *const one = strstr(buf, "\"one\"");
+  char const *const two = strstr(buf, "\"two\"");
+  char const *const five = strstr(buf, "\"five\"");
+  cheat_assert_pointer(zero, NULL);
+  cheat_assert_pointer(one, NULL);
+  cheat_assert_not_pointer(two, NULL);
+  cheat_assert_not_pointer(five, NULL);
+  cheat_assert(two < five);
+  cheat_assert_pointer(strstr(buf, "\"six\""), NULL);
+
+  free(buf);
+
+  bmm_trace_stop(&trace);
+  cheat_assert_not(bmm_trace_on(&trace));
+)
+
+CHEAT_TEST(plug_missing,
+  char const *const path[] = {"./does-not-exist.so"};
+
+  // Failed loads leave nothing behind to unload.
+  struct bmm_plug plug;
+  cheat_assert_not(bmm_plug_load(&plug, path, nmembof(path), NULL));
+  cheat_assert_size(plug.n, 0);
+  cheat_assert(bmm_plug_unload(&plug));
+)
+
+CHEAT_TEST(sketch_quant,
+  struct bmm_sketch sketch;
+  bmm_sketch_def(&sketch);
+
+  cheat_assert(isnan(bmm_sketch_quant(&sketch, 0.5)));
+
+  // The samples go in backwards and overflow the sketch several times.
+  size_t const n = 10 * BMM_MSKETCH + 1;
+  for (size_t i = n; i-- > 0; )
+    bmm_sketch_add(&sketch, (double) i, 1.0);
+
+  cheat_assert_double(bmm_sketch_quant(&sketch, 0.0), 0.0, 1.0e-12);
+  cheat_assert_double(bmm_sketch_quant(&sketch, 1.0), (double) (n - 1), 1.0e-12);
+  cheat_assert_double(bmm_sketch_quant(&sketch, 0.5), (double) (n - 1) / 2.0,
+      (double) n / 100.0);
+  cheat_assert_double(bmm_sketch_quant(&sketch, 0.01), (double) (n - 1) / 100.0,
+      (double) n / 1000.0);
+)
+
+CHEAT_TEST(dem_role_unparted,
+  struct bmm_dem_opts opts;
+  bmm_dem_opts_def(&opts);
+
+  struct bmm_dem *const dem = malloc(sizeof *dem);
+  cheat_assert_not_pointer(dem, NULL);
+  cheat_assert(bmm_dem_def(dem, &opts));
+
+  // The fixed particles of the ring come first and
+  // the free particle in the middle touches all of them,
+  // so moving it in front would give it too many contacts.
+  size_t const nring = BMM_MCONTACT + 2;
+  for (size_t iring = 0; iring < nring; ++iring) {
+    size_t const ipart = bmm_dem_addpart(dem);
+    double const phi = M_2PI * (double) iring / (double) nring;
+
+    dem->part.r[ipart] = 0.02;
+    dem->part.x[ipart][0] = 0.5 + 0.12 * cos(phi);
+    dem->part.x[ipart][1] = 0.5 + 0.12 * sin(phi);
+    bmm_dem_setrole(dem, ipart, BMM_DEM_ROLE_FIXED);
+  }
+
+  size_t const jpart = bmm_dem_addpart(dem);
+  dem->part.r[jpart] = 0.1;
+  dem->part.x[jpart][0] = 0.5;
+  dem->part.x[jpart][1] = 0.5;
+
+  for (size_t ipart = 0; ipart < nring; ++ipart)
+    cheat_assert_not_size(bmm_dem_addcont(dem, BMM_DEM_CT_STRONG,
+          ipart, jpart), SIZE_MAX);
+
+  cheat_assert(bmm_dem_cache_build(dem));
+  cheat_assert_not(dem->cache.parted);
+  cheat_assert_int(dem->part.role[0], BMM_DEM_ROLE_FIXED);
+  cheat_assert_int(dem->part.role[jpart], BMM_DEM_ROLE_FREE);
+
+  // The ranges cover every particle when the partition does not hold.
+  cheat_assert_size(bmm_dem_role_begin(dem, BMM_DEM_ROLE_FIXED), 0);
+  cheat_assert_size(bmm_dem_role_end(dem, BMM_DEM_ROLE_FREE), nring + 1);
+
+  bmm_dem_free(dem);
+  free(dem);
+)
+
+CHEAT_DECLARE(
+  static double dem_force_bshp(bool const fuse) {
+    struct bmm_dem_opts opts;
+    bmm_dem_opts_def(&opts);
+    opts.cache.fuse = fuse;
+
+    struct bmm_dem *const dem = malloc(sizeof *dem);
+    if (dem == NULL || !bmm_dem_def(dem, &opts))
+      return (double) NAN;
+
+    // Two overlapping particles with the default Hertzian weak contacts.
+    for (size_t i = 0; i < 2; ++i) {
+      size_t const ipart = bmm_dem_addpart(dem);
+
+      dem->part.r[ipart] = 0.05;
+      dem->part.x[ipart][0] = 0.45 + 0.09 * (double) i;
+      dem->part.x[ipart][1] = 0.5;
+    }
+
+    double f = (double) NAN;
+
+    if (bmm_dem_cache_build(dem)) {
+      if (!fuse)
+        bmm_dem_analyze(dem);
+
+      bmm_dem_force(dem);
+
+      f = dem->part.f[0][0];
+    }
+
+    bmm_dem_free(dem);
+    free(dem);
+
+    return f;
+  }
+)
+
+CHEAT_TEST(dem_force_fused,
+  double const f = dem_force_bshp(false);
+
+  // The fused sweep must see the elastic prefactor on the very first step.
+  cheat_assert(f < 0.0);
+  cheat_assert_double(dem_force_bshp(true), f, 1.0e-12);
+)
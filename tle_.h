@@ -8,4 +8,5 @@ BMM_TLE_DECLARE(UNIMPL)
 BMM_TLE_DECLARE(SDL)
 BMM_TLE_DECLARE(GL)
 BMM_TLE_DECLARE(NC)
+BMM_TLE_DECLARE(ZLIB)
 BMM_TLE_DECLARE(UNKNOWN)
@@ -0,0 +1,138 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ext.h"
+#include "sec.h"
+#include "tle.h"
+#include "trace.h"
+
+extern inline bool bmm_trace_on(struct bmm_trace const *);
+
+bool bmm_trace_start(struct bmm_trace *const trace,
+    size_t const nthread, size_t const ncap) {
+  trace->ncap = 0;
+  trace->nthread = 0;
+
+  if (ncap == 0)
+    return true;
+
+  if (nthread > BMM_MTHREAD) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Unsupported number of threads");
+
+    return false;
+  }
+
+  for (size_t ithread = 0; ithread < nthread; ++ithread) {
+    trace->ring[ithread].ev = malloc(ncap * sizeof *trace->ring[ithread].ev);
+    if (trace->ring[ithread].ev == NULL) {
+      BMM_TLE_STDS();
+
+      for (size_t jthread = 0; jthread < ithread; ++jthread)
+        free(trace->ring[jthread].ev);
+
+      return false;
+    }
+
+    trace->ring[ithread].n = 0;
+  }
+
+  trace->ncap = ncap;
+  trace->nthread = nthread;
+  trace->t0 = bmm_sec_now();
+
+  return true;
+}
+
+void bmm_trace_stop(struct bmm_trace *const trace) {
+  for (size_t ithread = 0; ithread < trace->nthread; ++ithread)
+    free(trace->ring[ithread].ev);
+
+  trace->ncap = 0;
+  trace->nthread = 0;
+}
+
+/// The call `bmm_trace_push(trace, ithread, name, kind, t, dt)`
+/// records an event in the ring of the thread `ithread` in `trace`,
+/// overwriting the oldest one if the ring is full.
+__attribute__ ((__nonnull__))
+static void bmm_trace_push(struct bmm_trace *const trace,
+    size_t const ithread, char const *const name,
+    enum bmm_trace_kind const kind, double const t, double const dt) {
+  if (ithread >= trace->nthread)
+    return;
+
+  struct bmm_trace_ring *const ring = &trace->ring[ithread];
+  struct bmm_trace_ev *const ev = &ring->ev[ring->n % trace->ncap];
+  ev->name = name;
+  ev->kind = kind;
+  ev->t = t;
+  ev->dt = dt;
+  ++ring->n;
+}
+
+void bmm_trace_span(struct bmm_trace *const trace,
+    size_t const ithread, char const *const name, double const t) {
+  if (!bmm_trace_on(trace))
+    return;
+
+  bmm_trace_push(trace, ithread, name, BMM_TRACE_KIND_SPAN,
+      t, bmm_sec_now() - t);
+}
+
+void bmm_trace_mark(struct bmm_trace *const trace,
+    size_t const ithread, char const *const name) {
+  if (!bmm_trace_on(trace))
+    return;
+
+  bmm_trace_push(trace, ithread, name, BMM_TRACE_KIND_MARK,
+      bmm_sec_now(), 0.0);
+}
+
+bool bmm_trace_dump(struct bmm_trace const *const trace,
+    FILE *const stream) {
+  if (fputs("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [", stream) == EOF) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  bool first = true;
+
+  for (size_t ithread = 0; ithread < trace->nthread; ++ithread) {
+    struct bmm_trace_ring const *const ring = &trace->ring[ithread];
+    size_t const nev = ring->n < trace->ncap ? ring->n : trace->ncap;
+
+    for (size_t iev = ring->n - nev; iev < ring->n; ++iev) {
+      struct bmm_trace_ev const *const ev = &ring->ev[iev % trace->ncap];
+
+      // Times are in microseconds from the start of tracing.
+      double const ts = (ev->t - trace->t0) * 1.0e+6;
+
+      int const n = ev->kind == BMM_TRACE_KIND_SPAN ?
+        fprintf(stream, "%s\n{\"name\": \"%s\", \"ph\": \"X\", "
+            "\"ts\": %.3f, \"dur\": %.3f, \"pid\": 0, \"tid\": %zu}",
+            first ? "" : ",", ev->name, ts, ev->dt * 1.0e+6, ithread) :
+        fprintf(stream, "%s\n{\"name\": \"%s\", \"ph\": \"i\", \"s\": \"t\", "
+            "\"ts\": %.3f, \"pid\": 0, \"tid\": %zu}",
+            first ? "" : ",", ev->name, ts, ithread);
+      if (n < 0) {
+        BMM_TLE_STDS();
+
+        return false;
+      }
+
+      first = false;
+    }
+  }
+
+  if (fputs("\n]}\n", stream) == EOF || fflush(stream) == EOF) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  return true;
+}
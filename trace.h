@@ -0,0 +1,107 @@
+/// Timeline tracing.
+///
+/// Each thread records events into a ring of its own,
+/// so that recording takes no locks and
+/// only the most recent events are kept once the ring fills up.
+/// Events are recorded as complete spans when they end,
+/// so that overwriting old events never leaves a span half open.
+/// The rings can be dumped in the trace event format of Chrome,
+/// which Perfetto also reads.
+
+#ifndef BMM_TRACE_H
+#define BMM_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "conf.h"
+
+/// Kinds of events.
+enum bmm_trace_kind {
+  /// Span with a duration.
+  BMM_TRACE_KIND_SPAN,
+  /// Instant without a duration.
+  BMM_TRACE_KIND_MARK
+};
+
+/// Events.
+struct bmm_trace_ev {
+  /// Name, which needs to outlive the tracer
+  /// and contain no characters that would need escaping.
+  char const *name;
+  /// Kind.
+  enum bmm_trace_kind kind;
+  /// Start time in seconds.
+  double t;
+  /// Duration in seconds.
+  double dt;
+};
+
+/// Events of one thread.
+struct bmm_trace_ring {
+  /// Ring of events.
+  struct bmm_trace_ev *ev;
+  /// Number of events recorded so far, including the overwritten ones.
+  size_t n;
+};
+
+/// Tracer state.
+struct bmm_trace {
+  /// Number of events each thread has room for
+  /// or zero if tracing is off.
+  size_t ncap;
+  /// Number of threads.
+  size_t nthread;
+  /// Time when tracing started.
+  double t0;
+  /// Events of each thread.
+  struct bmm_trace_ring ring[BMM_MTHREAD];
+};
+
+/// The call `bmm_trace_on(trace)`
+/// checks whether the tracer `trace` is recording.
+__attribute__ ((__nonnull__, __pure__))
+inline bool bmm_trace_on(struct bmm_trace const *const trace) {
+  return trace->ncap != 0;
+}
+
+/// The call `bmm_trace_start(trace, nthread, ncap)`
+/// starts recording up to `ncap` of the most recent events
+/// for each of the `nthread` threads into `trace`.
+/// If `ncap` is zero, nothing is recorded.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned and `trace` is left off.
+__attribute__ ((__nonnull__))
+bool bmm_trace_start(struct bmm_trace *, size_t, size_t);
+
+/// The call `bmm_trace_stop(trace)`
+/// stops recording into `trace` and discards its events.
+__attribute__ ((__nonnull__))
+void bmm_trace_stop(struct bmm_trace *);
+
+/// The call `bmm_trace_span(trace, ithread, name, t)`
+/// records a span called `name`
+/// from the time `t` to the present for the thread `ithread` in `trace`.
+/// Only the thread `ithread` may record events for itself.
+__attribute__ ((__nonnull__))
+void bmm_trace_span(struct bmm_trace *, size_t, char const *, double);
+
+/// The call `bmm_trace_mark(trace, ithread, name)`
+/// records an instant called `name`
+/// at the present for the thread `ithread` in `trace`.
+/// Only the thread `ithread` may record events for itself.
+__attribute__ ((__nonnull__))
+void bmm_trace_mark(struct bmm_trace *, size_t, char const *);
+
+/// The call `bmm_trace_dump(trace, stream)`
+/// writes the events of `trace` into `stream`
+/// as a JSON object in the trace event format,
+/// with the oldest events of each thread first.
+/// No thread may record events during the call.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_trace_dump(struct bmm_trace const *, FILE *);
+
+#endif
@@ -0,0 +1,179 @@
+#include <gsl/gsl_rng.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "conf.h"
+#include "dem.h"
+#include "endy.h"
+#include "ext.h"
+#include "tle.h"
+#include "view.h"
+
+struct bmm_dem *bmm_view_open(char const *const *const args,
+    size_t const narg) {
+  // This only reads the default seed.
+  if (gsl_rng_env_setup() == NULL) {
+    BMM_TLE_STDS();
+
+    return NULL;
+  }
+
+  struct bmm_dem_opts opts;
+  bmm_dem_opts_def(&opts);
+
+  if (!bmm_dem_opts_parse(&opts, args, narg))
+    return NULL;
+
+  if (opts.ens.n != 1) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Ensembles cannot be viewed");
+
+    return NULL;
+  }
+
+  struct bmm_dem *const dem = malloc(sizeof *dem);
+  if (dem == NULL) {
+    BMM_TLE_STDS();
+
+    return NULL;
+  }
+
+  if (!bmm_dem_def(dem, &opts)) {
+    bmm_dem_free(dem);
+
+    free(dem);
+
+    return NULL;
+  }
+
+  dem->seed = (uint64_t) gsl_rng_default_seed;
+
+  return dem;
+}
+
+void bmm_view_close(struct bmm_dem *const dem) {
+  bmm_dem_free(dem);
+
+  free(dem);
+}
+
+/// The call `bmm_view_set(col, name, kind, size, ncomp, nrow, stride, ptr)`
+/// writes the view of the array `ptr` called `name`
+/// with `nrow` rows of `ncomp` components
+/// of the type kind `kind` whose values take `size` bytes
+/// and `stride` bytes from one row to the next into `col`.
+__attribute__ ((__nonnull__ (1, 2)))
+static void bmm_view_set(struct bmm_view_col *const col,
+    char const *const name, char const kind, size_t const size,
+    size_t const ncomp, size_t const nrow, size_t const stride,
+    void *const ptr) {
+  col->name = name;
+  (void) snprintf(col->type, sizeof col->type, "%c%c%zu",
+      bmm_endy_get() == BMM_ENDY_BIG ? '>' : '<', kind, size);
+  col->ncomp = ncomp;
+  col->nrow = nrow;
+  col->stride = stride;
+  col->ptr = nrow == 0 ? NULL : ptr;
+}
+
+size_t bmm_view_cols(struct bmm_view_col *const cols, size_t const ncap,
+    struct bmm_dem *const dem) {
+  size_t const npart = dem->part.n;
+
+  size_t icol = 0;
+
+  // The address is only taken when there is something to point to,
+  // because the arrays of an empty simulation may not exist.
+#define VIEW(name, kind, p, ncomp, nrow, stride) \
+  do { \
+    if (icol < ncap) \
+      bmm_view_set(&cols[icol], name, kind, sizeof *(p), \
+          ncomp, nrow, stride, (nrow) == 0 ? NULL : (void *) (p)); \
+    ++icol; \
+  } while (false)
+
+#define PART(name, kind, p, ncomp) \
+  VIEW(name, kind, p, ncomp, npart, ncomp * sizeof *(p))
+
+  PART("l", 'u', dem->part.l, 1);
+  PART("role", 'i', dem->part.role, 1);
+  PART("r", 'f', dem->part.r, 1);
+  PART("m", 'f', dem->part.m, 1);
+  PART("jred", 'f', dem->part.jred, 1);
+  PART("x", 'f', *dem->part.x, BMM_NDIM);
+  PART("v", 'f', *dem->part.v, BMM_NDIM);
+  PART("a", 'f', *dem->part.a, BMM_NDIM);
+  PART("phi", 'f', dem->part.phi, 1);
+  PART("omega", 'f', dem->part.omega, 1);
+  PART("alpha", 'f', dem->part.alpha, 1);
+  PART("f", 'f', *dem->part.f, BMM_NDIM);
+  PART("tau", 'f', dem->part.tau, 1);
+
+#undef PART
+
+  // Contacts are stored with a fixed number of slots per particle,
+  // of which only the first `n` are in use.
+#define CONT(name, kind, ict, memb, ncomp) \
+  VIEW(name, kind, &dem->pair[ict].cont.src->memb, ncomp, npart, \
+      sizeof *dem->pair[ict].cont.src)
+
+  CONT("weak.n", 'u', BMM_DEM_CT_WEAK, n, 1);
+  CONT("weak.itgt", 'u', BMM_DEM_CT_WEAK, itgt[0], BMM_MCONTACT);
+  CONT("weak.drest", 'f', BMM_DEM_CT_WEAK, drest[0], BMM_MCONTACT);
+  CONT("strong.n", 'u', BMM_DEM_CT_STRONG, n, 1);
+  CONT("strong.itgt", 'u', BMM_DEM_CT_STRONG, itgt[0], BMM_MCONTACT);
+  CONT("strong.drest", 'f', BMM_DEM_CT_STRONG, drest[0], BMM_MCONTACT);
+  CONT("strong.strength", 'f', BMM_DEM_CT_STRONG, strength[0], BMM_MCONTACT);
+
+#undef CONT
+
+#define EST(name, kind, p, ncomp) \
+  VIEW(name, kind, p, ncomp, 1, ncomp * sizeof *(p))
+
+  EST("t", 'f', &dem->time.t, 1);
+  EST("istep", 'u', &dem->time.istep, 1);
+  EST("est.eambdis", 'f', &dem->est.eambdis, 1);
+  EST("est.epotext", 'f', &dem->est.epotext_d, 1);
+  EST("est.eklin", 'f', &dem->est.eklin_d, 1);
+  EST("est.ekrot", 'f', &dem->est.ekrot_d, 1);
+  EST("est.ewcont", 'f', &dem->est.ewcont_d, 1);
+  EST("est.escont", 'f', &dem->est.escont_d, 1);
+  EST("est.edrivnorm", 'f', &dem->est.edrivnorm, 1);
+  EST("est.edrivtang", 'f', &dem->est.edrivtang, 1);
+  EST("est.ebond", 'f', &dem->est.ebond, 1);
+  EST("est.eyieldis", 'f', &dem->est.eyieldis, 1);
+  EST("est.ewcontdis", 'f', &dem->est.ewcontdis, 1);
+  EST("est.escontdis", 'f', &dem->est.escontdis, 1);
+  EST("est.fback", 'f', dem->est.fback, BMM_NDIM);
+  EST("est.vfix", 'f', dem->est.vfix, BMM_NDIM);
+  EST("est.vdriv", 'f', dem->est.vdriv, BMM_NDIM);
+  EST("est.chi", 'f', &dem->est.chi, 1);
+  EST("est.mueff", 'f', &dem->est.mueff, 1);
+  EST("est.nclump", 'u', &dem->est.nclump, 1);
+
+#undef EST
+
+#undef VIEW
+
+  return icol;
+}
+
+bool bmm_view_find(struct bmm_view_col *const col,
+    struct bmm_dem *const dem, char const *const name) {
+  size_t const ncol = bmm_view_cols(NULL, 0, dem);
+
+  struct bmm_view_col cols[ncol];
+  (void) bmm_view_cols(cols, ncol, dem);
+
+  for (size_t icol = 0; icol < ncol; ++icol)
+    if (strcmp(cols[icol].name, name) == 0) {
+      *col = cols[icol];
+
+      return true;
+    }
+
+  return false;
+}
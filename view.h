@@ -0,0 +1,76 @@
+/// Views into the simulation state for scripting languages.
+///
+/// Every view describes an array of the simulation
+/// by its address, element type, shape and stride,
+/// so that a foreign function interface such as `ctypes` can
+/// wrap the memory as a NumPy array without copying it.
+/// Views point into the live simulation and are only valid
+/// until the simulation takes its next step or changes its particles,
+/// because particle arrays may be moved when they grow.
+
+#ifndef BMM_VIEW_H
+#define BMM_VIEW_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "dem.h"
+
+/// Views.
+struct bmm_view_col {
+  /// Name, such as `x` or `weak.itgt`.
+  char const *name;
+  /// NumPy type string, such as `<f8`, terminated with a zero.
+  char type[4];
+  /// Number of components per row.
+  size_t ncomp;
+  /// Number of rows.
+  size_t nrow;
+  /// Number of bytes from one row to the next.
+  size_t stride;
+  /// Address of the first component of the first row
+  /// or `NULL` if there are no rows.
+  void *ptr;
+};
+
+/// The call `bmm_dem_opts_parse(opts, args, narg)`
+/// parses the `narg` command line arguments in `args`
+/// into the simulation options `opts`.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+/// This is not defined here, but by the simulation program,
+/// so that scripts accept exactly the same options.
+__attribute__ ((__nonnull__))
+bool bmm_dem_opts_parse(struct bmm_dem_opts *, char const *const *, size_t);
+
+/// The call `bmm_view_open(args, narg)`
+/// allocates and sets up a simulation
+/// with the `narg` command line arguments in `args`.
+/// If the operation is successful,
+/// the simulation is returned and must later be released
+/// by calling `bmm_view_close`.
+/// Otherwise `NULL` is returned.
+__attribute__ ((__malloc__, __nonnull__))
+struct bmm_dem *bmm_view_open(char const *const *, size_t);
+
+/// The call `bmm_view_close(dem)`
+/// releases the simulation `dem` set up by `bmm_view_open`.
+__attribute__ ((__nonnull__))
+void bmm_view_close(struct bmm_dem *);
+
+/// The call `bmm_view_cols(cols, ncap, dem)`
+/// writes views of up to `ncap` arrays of the simulation `dem` into `cols`
+/// and returns the number of views there are,
+/// which may be more than `ncap`.
+__attribute__ ((__nonnull__ (3)))
+size_t bmm_view_cols(struct bmm_view_col *, size_t, struct bmm_dem *);
+
+/// The call `bmm_view_find(col, dem, name)`
+/// writes the view of the array called `name`
+/// in the simulation `dem` into `col`.
+/// If there is such an array, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+bool bmm_view_find(struct bmm_view_col *, struct bmm_dem *, char const *);
+
+#endif
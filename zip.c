@@ -0,0 +1,341 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "common.h"
+#include "endy.h"
+#include "ext.h"
+#include "io.h"
+#include "msg.h"
+#include "tle.h"
+#include "zip.h"
+
+/// The call `bmm_zip_reserve(pbuf, pncap, n)`
+/// makes sure that the buffer `pbuf` of `pncap` bytes
+/// has room for at least `n` bytes.
+/// If the operation is successful, `true` is returned.
+/// Otherwise `false` is returned.
+__attribute__ ((__nonnull__))
+static bool bmm_zip_reserve(unsigned char **const pbuf, size_t *const pncap,
+    size_t const n) {
+  size_t const ncap = *pncap;
+
+  if (n <= ncap)
+    return true;
+
+  size_t const nnew = $(bmm_max, size_t)(n,
+      ncap > SIZE_MAX / 2 ? SIZE_MAX : ncap * 2);
+
+  unsigned char *const buf = realloc(*pbuf, nnew);
+  if (buf == NULL) {
+    BMM_TLE_STDS();
+
+    return false;
+  }
+
+  *pbuf = buf;
+  *pncap = nnew;
+
+  return true;
+}
+
+void bmm_zip_def(struct bmm_zip *const zip) {
+  zip->raw = NULL;
+  zip->nraw = 0;
+  zip->ncapraw = 0;
+  zip->iraw = 0;
+  zip->tmp = NULL;
+  zip->ncaptmp = 0;
+}
+
+void bmm_zip_free(struct bmm_zip *const zip) {
+  free(zip->tmp);
+  free(zip->raw);
+}
+
+void bmm_zip_shuffle(unsigned char *restrict const dst,
+    unsigned char const *restrict const src, size_t const n) {
+  size_t const nword = n / BMM_ZIP_WORDSIZE;
+
+  for (size_t iword = 0; iword < nword; ++iword)
+    for (size_t i = 0; i < BMM_ZIP_WORDSIZE; ++i)
+      dst[i * nword + iword] = src[iword * BMM_ZIP_WORDSIZE + i];
+
+  for (size_t i = nword * BMM_ZIP_WORDSIZE; i < n; ++i)
+    dst[i] = src[i];
+}
+
+void bmm_zip_unshuffle(unsigned char *restrict const dst,
+    unsigned char const *restrict const src, size_t const n) {
+  size_t const nword = n / BMM_ZIP_WORDSIZE;
+
+  for (size_t iword = 0; iword < nword; ++iword)
+    for (size_t i = 0; i < BMM_ZIP_WORDSIZE; ++i)
+      dst[iword * BMM_ZIP_WORDSIZE + i] = src[i * nword + iword];
+
+  for (size_t i = nword * BMM_ZIP_WORDSIZE; i < n; ++i)
+    dst[i] = src[i];
+}
+
+enum bmm_io_read bmm_zip_head_read(struct bmm_zip_head *const head,
+    bmm_msg_reader const f, void *const ptr) {
+  unsigned char buf[BMM_ZIP_HEADSIZE];
+  switch (f(buf, sizeof buf, ptr)) {
+    case BMM_IO_READ_ERROR:
+      return BMM_IO_READ_ERROR;
+    case BMM_IO_READ_EOF:
+      return BMM_IO_READ_EOF;
+  }
+
+  uint64_t size;
+  (void) memcpy(&size, &buf[BMM_MSG_NUMSIZE + 1], sizeof size);
+
+  if (size > SIZE_MAX) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Compressed payload too large");
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  head->num = (enum bmm_msg_num) buf[0];
+  head->shuffle = BMM_MASKALL(buf[BMM_MSG_NUMSIZE], BMM_ZIP_MASK_SHUFFLE);
+  head->size = (size_t) size;
+
+  return BMM_IO_READ_SUCCESS;
+}
+
+bool bmm_zip_head_write(struct bmm_zip_head const *const head,
+    bmm_msg_writer const f, void *const ptr) {
+  dynamic_assert(head->num <= 0xff, "Type would be truncated");
+
+  unsigned char buf[BMM_ZIP_HEADSIZE];
+  buf[0] = (unsigned char) head->num;
+  buf[BMM_MSG_NUMSIZE] = head->shuffle ? BMM_ZIP_MASK_SHUFFLE : 0;
+
+  uint64_t const size = (uint64_t) head->size;
+  (void) memcpy(&buf[BMM_MSG_NUMSIZE + 1], &size, sizeof size);
+
+  return f(buf, sizeof buf, ptr);
+}
+
+void bmm_zip_clear(struct bmm_zip *const zip) {
+  zip->nraw = 0;
+  zip->iraw = 0;
+}
+
+bool bmm_zip_put(struct bmm_zip *const zip,
+    void const *const buf, size_t const n) {
+  if (n == 0)
+    return true;
+
+  if (n > SIZE_MAX - zip->nraw) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_UNSUPP, "Payload too large");
+
+    return false;
+  }
+
+  if (!bmm_zip_reserve(&zip->raw, &zip->ncapraw, zip->nraw + n))
+    return false;
+
+  (void) memcpy(&zip->raw[zip->nraw], buf, n);
+  zip->nraw += n;
+
+  return true;
+}
+
+bool bmm_zip_deflate(struct bmm_zip *const zip, int const level,
+    bool const shuffle, unsigned char const **const pbuf, size_t *const pn) {
+  size_t const nraw = zip->nraw;
+  size_t const nbound = (size_t) compressBound((uLong) nraw);
+
+  // Shuffled bytes go in front of the compressed ones.
+  size_t const noff = shuffle ? nraw : 0;
+  if (!bmm_zip_reserve(&zip->tmp, &zip->ncaptmp, noff + nbound))
+    return false;
+
+  if (shuffle)
+    bmm_zip_shuffle(zip->tmp, zip->raw, nraw);
+
+  unsigned char const *const src = shuffle ? zip->tmp : zip->raw;
+  unsigned char *const dst = &zip->tmp[noff];
+
+  uLongf nzip = (uLongf) nbound;
+  int const nerr = compress2(dst, &nzip, src, (uLong) nraw, level);
+  if (nerr != Z_OK) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_ZLIB, "%s", zError(nerr));
+
+    return false;
+  }
+
+  *pbuf = dst;
+  *pn = (size_t) nzip;
+
+  return true;
+}
+
+bool bmm_zip_inflate(struct bmm_zip *const zip, bool const shuffle,
+    unsigned char const *const buf, size_t const n, size_t const nraw) {
+  bmm_zip_clear(zip);
+
+  // Shuffled bytes go where the compressed ones would otherwise be.
+  if (!bmm_zip_reserve(&zip->raw, &zip->ncapraw, nraw) ||
+      (shuffle && !bmm_zip_reserve(&zip->tmp, &zip->ncaptmp, nraw)))
+    return false;
+
+  unsigned char *const dst = shuffle ? zip->tmp : zip->raw;
+
+  uLongf m = (uLongf) nraw;
+  int const nerr = uncompress(dst, &m, buf, (uLong) n);
+  if (nerr != Z_OK) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_ZLIB, "%s", zError(nerr));
+
+    return false;
+  }
+
+  if ((size_t) m != nraw) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Compressed payload size mismatch");
+
+    return false;
+  }
+
+  if (shuffle)
+    bmm_zip_unshuffle(zip->raw, dst, nraw);
+
+  zip->nraw = nraw;
+
+  return true;
+}
+
+bool bmm_zip_write(struct bmm_zip *const zip, enum bmm_msg_num const num,
+    int const level, bool const shuffle,
+    bmm_msg_writer const f, void *const ptr) {
+  unsigned char const *buf;
+  size_t nzip;
+  if (!bmm_zip_deflate(zip, level, shuffle, &buf, &nzip))
+    return false;
+
+  struct bmm_msg_spec spec;
+  bmm_msg_spec_def(&spec);
+  spec.msg.size = BMM_MSG_NUMSIZE + BMM_ZIP_HEADSIZE + nzip;
+
+  enum bmm_msg_num const zipnum = BMM_MSG_NUM_ZIP;
+
+  struct bmm_zip_head const head = {
+    .num = num,
+    .shuffle = shuffle,
+    .size = zip->nraw
+  };
+
+  return bmm_msg_spec_write(&spec, f, ptr) &&
+    bmm_msg_num_write(&zipnum, f, ptr) &&
+    bmm_zip_head_write(&head, f, ptr) &&
+    f(buf, nzip, ptr);
+}
+
+enum bmm_io_read bmm_zip_open(struct bmm_zip *const zip,
+    enum bmm_msg_num *const num, size_t *const psize,
+    size_t const size, enum bmm_endy const endy,
+    bmm_msg_reader const f, void *const ptr) {
+  bmm_zip_clear(zip);
+
+  if (size < BMM_ZIP_HEADSIZE) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Compressed message too short");
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  struct bmm_zip_head head;
+  switch (bmm_zip_head_read(&head, f, ptr)) {
+    case BMM_IO_READ_ERROR:
+      return BMM_IO_READ_ERROR;
+    case BMM_IO_READ_EOF:
+      return BMM_IO_READ_EOF;
+  }
+
+  if (endy != bmm_endy_get()) {
+    uint64_t n = (uint64_t) head.size;
+    bmm_endy_swap(&n, 1, sizeof n);
+
+    if (n > SIZE_MAX) {
+      BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Compressed payload too large");
+
+      return BMM_IO_READ_ERROR;
+    }
+
+    head.size = (size_t) n;
+  }
+
+  size_t const nzip = size - BMM_ZIP_HEADSIZE;
+
+  // Shuffled bytes go behind the compressed ones.
+  size_t const nshuffle = head.shuffle ? head.size : 0;
+  if (nshuffle > SIZE_MAX - nzip) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Compressed payload too large");
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  if (!bmm_zip_reserve(&zip->raw, &zip->ncapraw, head.size) ||
+      !bmm_zip_reserve(&zip->tmp, &zip->ncaptmp, nzip + nshuffle))
+    return BMM_IO_READ_ERROR;
+
+  switch (f(zip->tmp, nzip, ptr)) {
+    case BMM_IO_READ_ERROR:
+      return BMM_IO_READ_ERROR;
+    case BMM_IO_READ_EOF:
+      return BMM_IO_READ_EOF;
+  }
+
+  unsigned char *const dst = head.shuffle ? &zip->tmp[nzip] : zip->raw;
+
+  uLongf nraw = (uLongf) head.size;
+  int const nerr = uncompress(dst, &nraw, zip->tmp, (uLong) nzip);
+  if (nerr != Z_OK) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_ZLIB, "%s", zError(nerr));
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  if ((size_t) nraw != head.size) {
+    BMM_TLE_EXTS(BMM_TLE_NUM_PROTO, "Compressed payload size mismatch");
+
+    return BMM_IO_READ_ERROR;
+  }
+
+  if (head.shuffle)
+    bmm_zip_unshuffle(zip->raw, dst, head.size);
+
+  zip->nraw = head.size;
+
+  *num = head.num;
+  *psize = head.size;
+
+  return BMM_IO_READ_SUCCESS;
+}
+
+bool bmm_zip_ongoing(struct bmm_zip const *const zip) {
+  return zip->iraw < zip->nraw;
+}
+
+enum bmm_io_read bmm_zip_read(struct bmm_zip *const zip,
+    void *const buf, size_t const n) {
+  if (n > zip->nraw - zip->iraw)
+    return BMM_IO_READ_EOF;
+
+  if (n != 0)
+    (void) memcpy(buf, &zip->raw[zip->iraw], n);
+  zip->iraw += n;
+
+  return BMM_IO_READ_SUCCESS;
+}
+
+enum bmm_io_read bmm_zip_fastfw(struct bmm_zip *const zip, size_t const n) {
+  if (n > zip->nraw - zip->iraw)
+    return BMM_IO_READ_EOF;
+
+  zip->iraw += n;
+
+  return BMM_IO_READ_SUCCESS;
+}
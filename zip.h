@@ -0,0 +1,184 @@
+/// Compressed messages.
+///
+/// A compressed message wraps another message
+/// whose payload is compressed with zlib.
+/// Its payload begins with a small header
+/// that holds the number of the wrapped message,
+/// some flags and the uncompressed size of the wrapped payload,
+/// so that filters can tell what is inside without decompressing it.
+///
+///     | Number | Flags | Size | Compressed Payload
+///
+/// The size is a 64-bit integer in the byte order of the message
+/// just like everything else in the payload.
+/// If the payload was shuffled before compression,
+/// the bytes of every 8-byte word were first grouped by their position,
+/// which makes arrays of floating-point numbers compress better.
+
+#ifndef BMM_ZIP_H
+#define BMM_ZIP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpp.h"
+#include "ext.h"
+#include "io.h"
+#include "msg.h"
+
+/// Number of octets in the header of a compressed payload.
+#define BMM_ZIP_HEADSIZE (BMM_MSG_NUMSIZE + 1 + 8)
+
+/// Number of octets from which payloads are worth compressing.
+#define BMM_ZIP_MINSIZE 256
+
+/// Number of octets in each shuffled word.
+#define BMM_ZIP_WORDSIZE 8
+
+/// These preprocessor directives help work with bits in payload headers.
+#define BMM_ZIP_MASK_SHUFFLE (BMM_MASKBITS(0))
+
+/// This structure describes the payload of a compressed message.
+struct bmm_zip_head {
+  /// Number of the wrapped message.
+  enum bmm_msg_num num;
+  /// Whether the payload was shuffled.
+  bool shuffle;
+  /// Uncompressed size of the wrapped payload.
+  size_t size;
+};
+
+/// This structure holds the uncompressed payload of one message
+/// along with scratch space for compressing or decompressing it.
+struct bmm_zip {
+  /// Uncompressed payload.
+  unsigned char *raw;
+  /// Number of uncompressed bytes.
+  size_t nraw;
+  /// Number of uncompressed bytes there is room for.
+  size_t ncapraw;
+  /// Position of the reader in the uncompressed payload.
+  size_t iraw;
+  /// Compressed or shuffled payload.
+  unsigned char *tmp;
+  /// Number of compressed or shuffled bytes there is room for.
+  size_t ncaptmp;
+};
+
+/// The call `bmm_zip_def(zip)`
+/// writes the default state into `zip`.
+__attribute__ ((__nonnull__))
+void bmm_zip_def(struct bmm_zip *);
+
+/// The call `bmm_zip_free(zip)`
+/// releases the resources held by `zip`.
+__attribute__ ((__nonnull__))
+void bmm_zip_free(struct bmm_zip *);
+
+/// The call `bmm_zip_shuffle(dst, src, n)`
+/// writes the `n` bytes from `src` into `dst`
+/// with the bytes of every whole word grouped by their position.
+/// Any bytes after the last whole word are copied as they are.
+/// The buffers must not overlap.
+__attribute__ ((__nonnull__))
+void bmm_zip_shuffle(unsigned char *restrict, unsigned char const *restrict,
+    size_t);
+
+/// The call `bmm_zip_unshuffle(dst, src, n)`
+/// undoes what `bmm_zip_shuffle(src, dst, n)` did.
+__attribute__ ((__nonnull__))
+void bmm_zip_unshuffle(unsigned char *restrict, unsigned char const *restrict,
+    size_t);
+
+/// The call `bmm_zip_head_read(head, f, ptr)`
+/// extracts the payload header `head`
+/// from the buffer `buf` of length `n`
+/// that is read by calling `f(buf, n, ptr)`.
+/// It is guaranteed that `n == BMM_ZIP_HEADSIZE`.
+/// The size is taken to be in native endianness.
+__attribute__ ((__nonnull__ (1, 2)))
+enum bmm_io_read bmm_zip_head_read(struct bmm_zip_head *,
+    bmm_msg_reader, void *);
+
+/// The call `bmm_zip_head_write(head, f, ptr)`
+/// builds the payload header `buf` of length `n`
+/// for the payload header `head` and
+/// writes it by calling `f(buf, n, ptr)`.
+/// It is guaranteed that `n == BMM_ZIP_HEADSIZE`.
+__attribute__ ((__nonnull__ (1, 2)))
+bool bmm_zip_head_write(struct bmm_zip_head const *, bmm_msg_writer, void *);
+
+/// The call `bmm_zip_clear(zip)`
+/// forgets the uncompressed payload in `zip`.
+__attribute__ ((__nonnull__))
+void bmm_zip_clear(struct bmm_zip *);
+
+/// The call `bmm_zip_put(zip, buf, n)`
+/// appends `n` bytes from the buffer `buf`
+/// to the uncompressed payload in `zip`.
+__attribute__ ((__nonnull__))
+bool bmm_zip_put(struct bmm_zip *, void const *, size_t);
+
+/// The call `bmm_zip_deflate(zip, level, shuffle, pbuf, pn)`
+/// compresses the uncompressed payload in `zip`
+/// with the compression level `level`,
+/// shuffling it first if `shuffle` is set, and
+/// sets `pbuf` to the compressed bytes and `pn` to their number.
+/// The compressed bytes stay in the scratch space of `zip`,
+/// so they are only valid until `zip` is used again.
+__attribute__ ((__nonnull__))
+bool bmm_zip_deflate(struct bmm_zip *, int, bool,
+    unsigned char const **, size_t *);
+
+/// The call `bmm_zip_inflate(zip, shuffle, buf, n, nraw)`
+/// decompresses the `n` bytes from the buffer `buf`
+/// that were compressed by `bmm_zip_deflate` from `nraw` bytes,
+/// unshuffling them afterwards if `shuffle` is set,
+/// into the uncompressed payload in `zip`.
+/// The payload can then be consumed by calling `bmm_zip_read`.
+/// The buffer must not be the scratch space of `zip`.
+__attribute__ ((__nonnull__))
+bool bmm_zip_inflate(struct bmm_zip *, bool,
+    unsigned char const *, size_t, size_t);
+
+/// The call `bmm_zip_write(zip, num, level, shuffle, f, ptr)`
+/// compresses the uncompressed payload in `zip`
+/// with the compression level `level`,
+/// shuffling it first if `shuffle` is set, and
+/// writes it as a compressed message wrapping the message number `num`
+/// by sequentially calling `f(buf, n, ptr)`.
+__attribute__ ((__nonnull__ (1, 5)))
+bool bmm_zip_write(struct bmm_zip *, enum bmm_msg_num, int, bool,
+    bmm_msg_writer, void *);
+
+/// The call `bmm_zip_open(zip, num, psize, size, endy, f, ptr)`
+/// reads the rest of a compressed message of size `size`
+/// and endianness `endy`, not counting its message number,
+/// by sequentially calling `f(buf, n, ptr)` and
+/// decompresses it into `zip`,
+/// setting `num` to the wrapped message number and
+/// `psize` to the size of the wrapped payload.
+/// The payload can then be consumed by calling `bmm_zip_read`.
+__attribute__ ((__nonnull__ (1, 2, 3, 6)))
+enum bmm_io_read bmm_zip_open(struct bmm_zip *, enum bmm_msg_num *, size_t *,
+    size_t, enum bmm_endy, bmm_msg_reader, void *);
+
+/// The call `bmm_zip_ongoing(zip)`
+/// checks whether the uncompressed payload in `zip`
+/// has not been consumed yet.
+__attribute__ ((__nonnull__, __pure__))
+bool bmm_zip_ongoing(struct bmm_zip const *);
+
+/// The call `bmm_zip_read(zip, buf, n)`
+/// reads `n` bytes from the uncompressed payload in `zip`
+/// into the buffer `buf`.
+__attribute__ ((__nonnull__ (1)))
+enum bmm_io_read bmm_zip_read(struct bmm_zip *, void *, size_t);
+
+/// The call `bmm_zip_fastfw(zip, n)`
+/// skips `n` bytes of the uncompressed payload in `zip`.
+__attribute__ ((__nonnull__))
+enum bmm_io_read bmm_zip_fastfw(struct bmm_zip *, size_t);
+
+#endif